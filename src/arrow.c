@@ -0,0 +1,1440 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * arrow.c - Flickcurl photo lists written as Apache Arrow IPC streams
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * The stream is a Schema message followed by one RecordBatch message
+ * per list written and an end of stream marker as described in
+ * https://arrow.apache.org/docs/format/Columnar.html#ipc-streaming-format
+ *
+ * Each message is a 0xFFFFFFFF continuation word, the size of the
+ * flatbuffer metadata, the metadata padded to 8 bytes and the body of
+ * 8 byte aligned column buffers.  The flatbuffers are small so they
+ * are written front to back here: a table is written before the
+ * strings, vectors and tables it refers to and its offset fields are
+ * set once they are written, since flatbuffer offsets point forwards.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* Arrow MetadataVersion V5 */
+#define ARROW_METADATA_VERSION 4
+
+/* Arrow MessageHeader union types */
+#define ARROW_MESSAGE_SCHEMA 1
+#define ARROW_MESSAGE_RECORD_BATCH 3
+
+/* Arrow Type union types */
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_TYPE_LIST 12
+
+/* Arrow Precision DOUBLE */
+#define ARROW_PRECISION_DOUBLE 2
+
+
+#ifndef STANDALONE
+
+typedef struct {
+  unsigned char* data;
+  size_t length;
+  size_t size;
+  int failed;
+} flickcurl_arrow_buffer;
+
+
+typedef enum {
+  ARROW_COLUMN_UTF8,
+  ARROW_COLUMN_INT32,
+  ARROW_COLUMN_BOOL,
+  ARROW_COLUMN_TIMESTAMP,
+  ARROW_COLUMN_FLOAT64,
+  /* list of strings */
+  ARROW_COLUMN_TAGS
+} flickcurl_arrow_column_type;
+
+
+typedef enum {
+  ARROW_SOURCE_ID,
+  ARROW_SOURCE_FIELD,
+  ARROW_SOURCE_MEDIA,
+  ARROW_SOURCE_TAGS,
+  ARROW_SOURCE_PLACE_NAME,
+  ARROW_SOURCE_VIDEO_DURATION,
+  ARROW_SOURCE_VIDEO_WIDTH,
+  ARROW_SOURCE_VIDEO_HEIGHT
+} flickcurl_arrow_source;
+
+
+typedef struct {
+  const char* name;
+  flickcurl_arrow_column_type type;
+  flickcurl_arrow_source source;
+  flickcurl_photo_field_type field;
+
+  /* buffers of the batch being built */
+  int null_count;
+  flickcurl_arrow_buffer validity;
+  /* values or string/list offsets */
+  flickcurl_arrow_buffer values;
+  /* string bytes */
+  flickcurl_arrow_buffer data;
+  /* list items: count, string offsets and bytes */
+  int items_count;
+  flickcurl_arrow_buffer item_offsets;
+  flickcurl_arrow_buffer item_data;
+} flickcurl_arrow_column;
+
+
+struct flickcurl_arrow_writer_s {
+  flickcurl* fc;
+  FILE* fh;
+
+  int columns_count;
+  flickcurl_arrow_column* columns;
+
+  /* rows in the batch being built */
+  int rows;
+
+  /* message metadata and body, reused for every message */
+  flickcurl_arrow_buffer meta;
+  flickcurl_arrow_buffer body;
+
+  int finished;
+};
+
+
+/* a flatbuffer table field of @size 1, 2, 4 or 8 bytes; offsets are 4
+ * bytes and set after the table with flickcurl_fb_set_offset() */
+typedef struct {
+  int id;
+  int size;
+  unsigned long value;
+  /* out: position of the field in the buffer */
+  size_t pos;
+} flickcurl_fb_field;
+
+
+static void
+flickcurl_arrow_buffer_reserve(flickcurl_arrow_buffer* b, size_t len)
+{
+  unsigned char* new_data;
+  size_t new_size;
+
+  if(b->failed || b->length + len <= b->size)
+    return;
+
+  new_size = b->size ? b->size * 2 : 1024;
+  while(b->length + len > new_size)
+    new_size *= 2;
+
+  new_data = (unsigned char*)realloc(b->data, new_size);
+  if(!new_data) {
+    b->failed = 1;
+    return;
+  }
+  b->data = new_data;
+  b->size = new_size;
+}
+
+
+static void
+flickcurl_arrow_buffer_append(flickcurl_arrow_buffer* b, const void* p,
+                              size_t len)
+{
+  flickcurl_arrow_buffer_reserve(b, len);
+  if(b->failed)
+    return;
+  memcpy(b->data + b->length, p, len);
+  b->length += len;
+}
+
+
+/* Set @bytes bytes at @pos to @value little-endian */
+static void
+flickcurl_arrow_buffer_set_le(flickcurl_arrow_buffer* b, size_t pos,
+                              unsigned long value, int bytes)
+{
+  int i;
+
+  if(b->failed)
+    return;
+  for(i = 0; i < bytes; i++) {
+    b->data[pos + i] = (unsigned char)(value & 0xff);
+    value = (i < (int)sizeof(value) - 1) ? (value >> 8) : 0;
+  }
+}
+
+
+static void
+flickcurl_arrow_buffer_append_le(flickcurl_arrow_buffer* b,
+                                 unsigned long value, int bytes)
+{
+  flickcurl_arrow_buffer_reserve(b, bytes);
+  if(b->failed)
+    return;
+  b->length += bytes;
+  flickcurl_arrow_buffer_set_le(b, b->length - bytes, value, bytes);
+}
+
+
+/* Append a signed 64 bit integer */
+static void
+flickcurl_arrow_buffer_append_int64(flickcurl_arrow_buffer* b, long value)
+{
+  unsigned long u = (unsigned long)value;
+  int bytes = (int)sizeof(u);
+
+  if(bytes > 8)
+    bytes = 8;
+  flickcurl_arrow_buffer_append_le(b, u, bytes);
+  /* sign extend where long is narrower than 64 bits */
+  for(; bytes < 8; bytes++)
+    flickcurl_arrow_buffer_append_le(b, value < 0 ? 0xff : 0, 1);
+}
+
+
+/* Append an IEEE 754 double little-endian whatever the host byte order */
+static void
+flickcurl_arrow_buffer_append_double(flickcurl_arrow_buffer* b, double value)
+{
+  static const double one = 1.0;
+  unsigned char bytes[8];
+  unsigned long low = 0;
+  unsigned long high = 0;
+  int big_endian;
+  int i;
+
+  /* 1.0 is 0x3FF0000000000000 so its first byte says the order */
+  memcpy(bytes, &one, 8);
+  big_endian = (bytes[0] == 0x3f);
+
+  memcpy(bytes, &value, 8);
+  for(i = 3; i >= 0; i--) {
+    low = (low << 8) | bytes[big_endian ? 7 - i : i];
+    high = (high << 8) | bytes[big_endian ? 3 - i : 4 + i];
+  }
+
+  flickcurl_arrow_buffer_append_le(b, low, 4);
+  flickcurl_arrow_buffer_append_le(b, high, 4);
+}
+
+
+/* Append zero bytes until the length is @phase modulo @align */
+static void
+flickcurl_arrow_buffer_pad(flickcurl_arrow_buffer* b, size_t align,
+                           size_t phase)
+{
+  while(!b->failed && (b->length % align) != phase)
+    flickcurl_arrow_buffer_append_le(b, 0, 1);
+}
+
+
+/* Add bit @index of a bitmap set to @value */
+static void
+flickcurl_arrow_buffer_append_bit(flickcurl_arrow_buffer* b, int index,
+                                  int value)
+{
+  if(!(index % 8))
+    flickcurl_arrow_buffer_append_le(b, 0, 1);
+  if(!b->failed && value)
+    b->data[index / 8] |= (unsigned char)(1 << (index % 8));
+}
+
+
+/* Write a table of @fields, 8 byte aligned with the fields in
+ * decreasing size order so all are aligned, after its vtable.
+ *
+ * Return value: position of the table */
+static size_t
+flickcurl_fb_table(flickcurl_arrow_buffer* b, flickcurl_fb_field* fields,
+                   int count)
+{
+  size_t rel[8];
+  size_t vtable_pos;
+  size_t table_pos;
+  size_t table_len = 4;
+  int max_id = -1;
+  int size;
+  int i;
+
+  for(i = 0; i < count; i++) {
+    if(fields[i].id > max_id)
+      max_id = fields[i].id;
+    if(fields[i].size == 8)
+      table_len = 8;
+  }
+
+  for(size = 8; size; size /= 2) {
+    for(i = 0; i < count; i++) {
+      if(fields[i].size == size) {
+        rel[i] = table_len;
+        table_len += size;
+      }
+    }
+  }
+  table_len = (table_len + 3) & ~(size_t)3;
+
+  flickcurl_arrow_buffer_pad(b, 2, 0);
+  vtable_pos = b->length;
+  flickcurl_arrow_buffer_append_le(b, 4 + 2 * (max_id + 1), 2);
+  flickcurl_arrow_buffer_append_le(b, table_len, 2);
+  for(size = 0; size <= max_id; size++) {
+    unsigned long offset = 0;
+
+    for(i = 0; i < count; i++) {
+      if(fields[i].id == size)
+        offset = rel[i];
+    }
+    flickcurl_arrow_buffer_append_le(b, offset, 2);
+  }
+
+  flickcurl_arrow_buffer_pad(b, 8, 0);
+  table_pos = b->length;
+  flickcurl_arrow_buffer_append_le(b, table_pos - vtable_pos, 4);
+  for(i = 4; i < (int)table_len; i++)
+    flickcurl_arrow_buffer_append_le(b, 0, 1);
+
+  for(i = 0; i < count; i++) {
+    fields[i].pos = table_pos + rel[i];
+    flickcurl_arrow_buffer_set_le(b, fields[i].pos, fields[i].value,
+                                  fields[i].size);
+  }
+
+  return table_pos;
+}
+
+
+/* Point the offset at @pos to the object at @target after it */
+static void
+flickcurl_fb_set_offset(flickcurl_arrow_buffer* b, size_t pos, size_t target)
+{
+  flickcurl_arrow_buffer_set_le(b, pos, target - pos, 4);
+}
+
+
+static size_t
+flickcurl_fb_string(flickcurl_arrow_buffer* b, const char* s)
+{
+  size_t pos;
+  size_t len = strlen(s);
+
+  flickcurl_arrow_buffer_pad(b, 4, 0);
+  pos = b->length;
+  flickcurl_arrow_buffer_append_le(b, len, 4);
+  flickcurl_arrow_buffer_append(b, s, len + 1);
+
+  return pos;
+}
+
+
+/* Write a vector of @count offsets to set later.  The first is at the
+ * returned position + 4. */
+static size_t
+flickcurl_fb_offsets_vector(flickcurl_arrow_buffer* b, int count)
+{
+  size_t pos;
+  int i;
+
+  flickcurl_arrow_buffer_pad(b, 4, 0);
+  pos = b->length;
+  flickcurl_arrow_buffer_append_le(b, count, 4);
+  for(i = 0; i < count; i++)
+    flickcurl_arrow_buffer_append_le(b, 0, 4);
+
+  return pos;
+}
+
+
+/* Write a Field table for a column and what it refers to */
+static size_t
+flickcurl_arrow_fb_field(flickcurl_arrow_buffer* b, const char* name,
+                         flickcurl_arrow_column_type type)
+{
+  flickcurl_fb_field fields[5] = {
+    /* name, nullable, type_type, type, children */
+    { 0, 4, 0, 0 }, { 1, 1, 1, 0 }, { 2, 1, 0, 0 }, { 3, 4, 0, 0 },
+    { 5, 4, 0, 0 }
+  };
+  flickcurl_fb_field type_fields[2];
+  int type_fields_count = 0;
+  size_t table_pos;
+  size_t pos;
+
+  switch(type) {
+    case ARROW_COLUMN_INT32:
+      fields[2].value = ARROW_TYPE_INT;
+      /* bitWidth, is_signed */
+      type_fields[0].id = 0; type_fields[0].size = 4; type_fields[0].value = 32;
+      type_fields[1].id = 1; type_fields[1].size = 1; type_fields[1].value = 1;
+      type_fields_count = 2;
+      break;
+
+    case ARROW_COLUMN_BOOL:
+      fields[2].value = ARROW_TYPE_BOOL;
+      break;
+
+    case ARROW_COLUMN_TIMESTAMP:
+      fields[2].value = ARROW_TYPE_TIMESTAMP;
+      /* unit SECOND, timezone */
+      type_fields[0].id = 0; type_fields[0].size = 2; type_fields[0].value = 0;
+      type_fields[1].id = 1; type_fields[1].size = 4; type_fields[1].value = 0;
+      type_fields_count = 2;
+      break;
+
+    case ARROW_COLUMN_FLOAT64:
+      fields[2].value = ARROW_TYPE_FLOATING_POINT;
+      /* precision */
+      type_fields[0].id = 0; type_fields[0].size = 2;
+      type_fields[0].value = ARROW_PRECISION_DOUBLE;
+      type_fields_count = 1;
+      break;
+
+    case ARROW_COLUMN_TAGS:
+      fields[2].value = ARROW_TYPE_LIST;
+      break;
+
+    case ARROW_COLUMN_UTF8:
+    default:
+      fields[2].value = ARROW_TYPE_UTF8;
+      break;
+  }
+
+  table_pos = flickcurl_fb_table(b, fields, 5);
+
+  pos = flickcurl_fb_string(b, name);
+  flickcurl_fb_set_offset(b, fields[0].pos, pos);
+
+  pos = flickcurl_fb_table(b, type_fields, type_fields_count);
+  flickcurl_fb_set_offset(b, fields[3].pos, pos);
+  if(type == ARROW_COLUMN_TIMESTAMP)
+    flickcurl_fb_set_offset(b, type_fields[1].pos,
+                            flickcurl_fb_string(b, "UTC"));
+
+  if(type == ARROW_COLUMN_TAGS) {
+    pos = flickcurl_fb_offsets_vector(b, 1);
+    flickcurl_fb_set_offset(b, fields[4].pos, pos);
+    flickcurl_fb_set_offset(b, pos + 4,
+                            flickcurl_arrow_fb_field(b, "item",
+                                                     ARROW_COLUMN_UTF8));
+  } else
+    flickcurl_fb_set_offset(b, fields[4].pos, flickcurl_fb_offsets_vector(b, 0));
+
+  return table_pos;
+}
+
+
+/* Start a Message flatbuffer in @b.
+ *
+ * Return value: position of the header offset field to set */
+static size_t
+flickcurl_arrow_fb_message(flickcurl_arrow_buffer* b, int header_type,
+                           size_t body_length)
+{
+  flickcurl_fb_field fields[4] = {
+    /* version, header_type, header, bodyLength */
+    { 0, 2, ARROW_METADATA_VERSION, 0 }, { 1, 1, 0, 0 }, { 2, 4, 0, 0 },
+    { 3, 8, 0, 0 }
+  };
+  size_t pos;
+
+  fields[1].value = header_type;
+  fields[3].value = body_length;
+
+  b->length = 0;
+  /* root table offset */
+  flickcurl_arrow_buffer_append_le(b, 0, 4);
+  pos = flickcurl_fb_table(b, fields, 4);
+  flickcurl_fb_set_offset(b, 0, pos);
+
+  return fields[2].pos;
+}
+
+
+/* Write a message of metadata @meta and @body */
+static int
+flickcurl_arrow_write_message(flickcurl_arrow_writer* writer,
+                              flickcurl_arrow_buffer* body)
+{
+  flickcurl_arrow_buffer* meta = &writer->meta;
+  unsigned char prefix[8];
+
+  flickcurl_arrow_buffer_pad(meta, 8, 0);
+  if(meta->failed || (body && body->failed)) {
+    flickcurl_error(writer->fc, "Out of memory writing Arrow message");
+    return 1;
+  }
+
+  /* continuation and metadata size */
+  memset(prefix, 0xff, 4);
+  prefix[4] = (unsigned char)(meta->length & 0xff);
+  prefix[5] = (unsigned char)((meta->length >> 8) & 0xff);
+  prefix[6] = (unsigned char)((meta->length >> 16) & 0xff);
+  prefix[7] = (unsigned char)((meta->length >> 24) & 0xff);
+
+  if(fwrite(prefix, 1, 8, writer->fh) != 8 ||
+     fwrite(meta->data, 1, meta->length, writer->fh) != meta->length ||
+     (body && body->length &&
+      fwrite(body->data, 1, body->length, writer->fh) != body->length)) {
+    flickcurl_error(writer->fc, "Failed to write Arrow stream");
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+flickcurl_arrow_write_schema(flickcurl_arrow_writer* writer)
+{
+  flickcurl_arrow_buffer* b = &writer->meta;
+  flickcurl_fb_field fields[2] = {
+    /* endianness Little, fields */
+    { 0, 2, 0, 0 }, { 1, 4, 0, 0 }
+  };
+  size_t header_pos;
+  size_t pos;
+  int i;
+
+  header_pos = flickcurl_arrow_fb_message(b, ARROW_MESSAGE_SCHEMA, 0);
+  pos = flickcurl_fb_table(b, fields, 2);
+  flickcurl_fb_set_offset(b, header_pos, pos);
+
+  pos = flickcurl_fb_offsets_vector(b, writer->columns_count);
+  flickcurl_fb_set_offset(b, fields[1].pos, pos);
+  for(i = 0; i < writer->columns_count; i++)
+    flickcurl_fb_set_offset(b, pos + 4 + 4 * i,
+                            flickcurl_arrow_fb_field(b,
+                                                     writer->columns[i].name,
+                                                     writer->columns[i].type));
+
+  return flickcurl_arrow_write_message(writer, NULL);
+}
+
+
+static void
+flickcurl_arrow_add_column(flickcurl_arrow_writer* writer, const char* name,
+                           flickcurl_arrow_column_type type,
+                           flickcurl_arrow_source source,
+                           flickcurl_photo_field_type field)
+{
+  flickcurl_arrow_column* column = &writer->columns[writer->columns_count++];
+
+  column->name = name;
+  column->type = type;
+  column->source = source;
+  column->field = field;
+}
+
+
+/**
+ * flickcurl_new_arrow_writer:
+ * @fc: flickcurl object
+ * @fh: file handle to write to
+ * @fields: array of photo fields ending with PHOTO_FIELD_none or NULL for all
+ *
+ * Constructor - create a writer of photo lists as an Arrow IPC stream
+ *
+ * The stream has one column for the photo ID, one for each of
+ * @fields named by flickcurl_get_photo_field_label() and columns
+ * media, tags (a list of the raw tags where known), place_name, video_duration,
+ * video_width and video_height.  Dates are timestamps in seconds,
+ * latitude and longitude are doubles, integer and boolean fields
+ * are int32 and bool and the other fields are strings.  Missing
+ * values are nulls.
+ *
+ * The schema is written now.  Each call to
+ * flickcurl_arrow_writer_write_photos_list() then writes one record
+ * batch, so paging through a large list takes no more memory than
+ * one page.  Use flickcurl_arrow_writer_finish() to end the stream.
+ *
+ * Return value: new writer or NULL on failure
+ */
+flickcurl_arrow_writer*
+flickcurl_new_arrow_writer(flickcurl* fc, FILE* fh,
+                           const flickcurl_photo_field_type* fields)
+{
+  flickcurl_arrow_writer* writer;
+  int count = 0;
+  int i;
+
+  if(fields) {
+    for(count = 0; fields[count] != PHOTO_FIELD_none; count++) {
+      if(fields[count] < PHOTO_FIELD_FIRST ||
+         fields[count] > PHOTO_FIELD_LAST) {
+        flickcurl_error(fc, "Invalid photo field %d", (int)fields[count]);
+        return NULL;
+      }
+    }
+  } else
+    count = PHOTO_FIELD_LAST - PHOTO_FIELD_FIRST + 1;
+
+  writer = (flickcurl_arrow_writer*)calloc(1, sizeof(*writer));
+  if(!writer)
+    return NULL;
+
+  writer->fc = fc;
+  writer->fh = fh;
+
+  /* id, fields, media, tags, place and 3 video columns */
+  writer->columns = (flickcurl_arrow_column*)calloc(count + 7, sizeof(flickcurl_arrow_column));
+  if(!writer->columns) {
+    free(writer);
+    return NULL;
+  }
+
+  flickcurl_arrow_add_column(writer, "id", ARROW_COLUMN_UTF8,
+                             ARROW_SOURCE_ID, PHOTO_FIELD_none);
+
+  for(i = 0; i < count; i++) {
+    flickcurl_photo_field_type field;
+    flickcurl_arrow_column_type type;
+
+    field = fields ? fields[i] : (flickcurl_photo_field_type)(PHOTO_FIELD_FIRST + i);
+    switch(flickcurl_get_photo_field_value_type(field)) {
+      case VALUE_TYPE_INTEGER:
+        type = ARROW_COLUMN_INT32;
+        break;
+
+      case VALUE_TYPE_BOOLEAN:
+        type = ARROW_COLUMN_BOOL;
+        break;
+
+      case VALUE_TYPE_UNIXTIME:
+      case VALUE_TYPE_DATETIME:
+        type = ARROW_COLUMN_TIMESTAMP;
+        break;
+
+      case VALUE_TYPE_FLOAT:
+        type = ARROW_COLUMN_FLOAT64;
+        break;
+
+      case VALUE_TYPE_NONE:
+      case VALUE_TYPE_PHOTO_ID:
+      case VALUE_TYPE_PHOTO_URI:
+      case VALUE_TYPE_STRING:
+      case VALUE_TYPE_URI:
+      case VALUE_TYPE_MEDIA_TYPE:
+      case VALUE_TYPE_TAG_STRING:
+      case VALUE_TYPE_COLLECTION_ID:
+      case VALUE_TYPE_ICON_PHOTOS:
+      case VALUE_TYPE_PERSON_ID:
+      default:
+        type = ARROW_COLUMN_UTF8;
+        break;
+    }
+
+    flickcurl_arrow_add_column(writer, flickcurl_get_photo_field_label(field),
+                               type, ARROW_SOURCE_FIELD, field);
+  }
+
+  flickcurl_arrow_add_column(writer, "media", ARROW_COLUMN_UTF8,
+                             ARROW_SOURCE_MEDIA, PHOTO_FIELD_none);
+  flickcurl_arrow_add_column(writer, "tags", ARROW_COLUMN_TAGS,
+                             ARROW_SOURCE_TAGS, PHOTO_FIELD_none);
+  flickcurl_arrow_add_column(writer, "place_name", ARROW_COLUMN_UTF8,
+                             ARROW_SOURCE_PLACE_NAME, PHOTO_FIELD_none);
+  flickcurl_arrow_add_column(writer, "video_duration", ARROW_COLUMN_INT32,
+                             ARROW_SOURCE_VIDEO_DURATION, PHOTO_FIELD_none);
+  flickcurl_arrow_add_column(writer, "video_width", ARROW_COLUMN_INT32,
+                             ARROW_SOURCE_VIDEO_WIDTH, PHOTO_FIELD_none);
+  flickcurl_arrow_add_column(writer, "video_height", ARROW_COLUMN_INT32,
+                             ARROW_SOURCE_VIDEO_HEIGHT, PHOTO_FIELD_none);
+
+  if(flickcurl_arrow_write_schema(writer)) {
+    flickcurl_free_arrow_writer(writer);
+    return NULL;
+  }
+
+  return writer;
+}
+
+
+static void
+flickcurl_arrow_buffer_free(flickcurl_arrow_buffer* b)
+{
+  if(b->data)
+    free(b->data);
+  b->data = NULL;
+}
+
+
+/**
+ * flickcurl_free_arrow_writer:
+ * @writer: Arrow writer
+ *
+ * Destructor for Arrow writer
+ *
+ * This does not end the stream; see flickcurl_arrow_writer_finish().
+ */
+void
+flickcurl_free_arrow_writer(flickcurl_arrow_writer* writer)
+{
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(writer, flickcurl_arrow_writer);
+
+  for(i = 0; i < writer->columns_count; i++) {
+    flickcurl_arrow_column* column = &writer->columns[i];
+
+    flickcurl_arrow_buffer_free(&column->validity);
+    flickcurl_arrow_buffer_free(&column->values);
+    flickcurl_arrow_buffer_free(&column->data);
+    flickcurl_arrow_buffer_free(&column->item_offsets);
+    flickcurl_arrow_buffer_free(&column->item_data);
+  }
+  free(writer->columns);
+  flickcurl_arrow_buffer_free(&writer->meta);
+  flickcurl_arrow_buffer_free(&writer->body);
+  free(writer);
+}
+
+
+static void
+flickcurl_arrow_column_add_string(flickcurl_arrow_column* column, int row,
+                                  const char* value)
+{
+  if(!row)
+    flickcurl_arrow_buffer_append_le(&column->values, 0, 4);
+
+  flickcurl_arrow_buffer_append_bit(&column->validity, row, value != NULL);
+  if(value)
+    flickcurl_arrow_buffer_append(&column->data, value, strlen(value));
+  else
+    column->null_count++;
+  flickcurl_arrow_buffer_append_le(&column->values, column->data.length, 4);
+}
+
+
+static void
+flickcurl_arrow_column_add_tags(flickcurl_arrow_column* column, int row,
+                                flickcurl_tag** tags)
+{
+  int i;
+
+  if(!row)
+    flickcurl_arrow_buffer_append_le(&column->values, 0, 4);
+  if(!column->items_count && !column->item_offsets.length)
+    flickcurl_arrow_buffer_append_le(&column->item_offsets, 0, 4);
+
+  flickcurl_arrow_buffer_append_bit(&column->validity, row, tags != NULL);
+  if(tags) {
+    for(i = 0; tags[i]; i++) {
+      /* tags from a photo list have only the cooked form */
+      const char* tag = tags[i]->raw ? tags[i]->raw : tags[i]->cooked;
+
+      flickcurl_arrow_buffer_append(&column->item_data, tag, strlen(tag));
+      flickcurl_arrow_buffer_append_le(&column->item_offsets,
+                                       column->item_data.length, 4);
+      column->items_count++;
+    }
+  } else
+    column->null_count++;
+  flickcurl_arrow_buffer_append_le(&column->values, column->items_count, 4);
+}
+
+
+/* Add a value or null if @present is 0 to a fixed width column */
+static void
+flickcurl_arrow_column_add_number(flickcurl_arrow_column* column, int row,
+                                  int present, long integer, double real)
+{
+  flickcurl_arrow_buffer_append_bit(&column->validity, row, present);
+  if(!present) {
+    column->null_count++;
+    integer = 0;
+    real = 0.0;
+  }
+
+  switch(column->type) {
+    case ARROW_COLUMN_INT32:
+      flickcurl_arrow_buffer_append_le(&column->values,
+                                       (unsigned long)integer & 0xffffffffUL, 4);
+      break;
+
+    case ARROW_COLUMN_BOOL:
+      flickcurl_arrow_buffer_append_bit(&column->values, row, integer != 0);
+      break;
+
+    case ARROW_COLUMN_TIMESTAMP:
+      flickcurl_arrow_buffer_append_int64(&column->values, integer);
+      break;
+
+    case ARROW_COLUMN_FLOAT64:
+      flickcurl_arrow_buffer_append_double(&column->values, real);
+      break;
+
+    case ARROW_COLUMN_UTF8:
+    case ARROW_COLUMN_TAGS:
+    default:
+      break;
+  }
+}
+
+
+/* Add a field value of @photo or of row @row of @pc */
+static void
+flickcurl_arrow_column_add_field(flickcurl_arrow_column* column, int row,
+                                 flickcurl_photo* photo,
+                                 flickcurl_photo_columns* pc, int pc_row)
+{
+  flickcurl_photo_field_type field = column->field;
+  const char* string = NULL;
+  int present = 0;
+  long integer = 0;
+  double real = 0.0;
+
+  if(column->type == ARROW_COLUMN_UTF8) {
+    if(photo)
+      string = flickcurl_photo_get_field_string(photo, field);
+    else
+      string = flickcurl_photo_columns_get_string(pc, pc_row, field);
+    flickcurl_arrow_column_add_string(column, row, string);
+    return;
+  }
+
+  if(!photo) {
+    present = flickcurl_photo_columns_has_value(pc, pc_row, field);
+    if(present) {
+      if(column->type == ARROW_COLUMN_TIMESTAMP)
+        integer = (long)flickcurl_photo_columns_get_time(pc, pc_row, field);
+      else if(column->type == ARROW_COLUMN_FLOAT64)
+        real = flickcurl_photo_columns_get_float(pc, pc_row, field);
+      else
+        integer = flickcurl_photo_columns_get_integer(pc, pc_row, field);
+    }
+  } else {
+    flickcurl_field_value_type type;
+
+    type = flickcurl_photo_get_field_type(photo, field);
+    if(type == VALUE_TYPE_NONE)
+      ;
+    else if(column->type == ARROW_COLUMN_TIMESTAMP) {
+      time_t unix_time = flickcurl_photo_get_time(photo, field);
+
+      /* a date that photos keep as a string */
+      if(unix_time < 0 && type == VALUE_TYPE_STRING)
+        unix_time = flickcurl_photo_columns_decode_date(flickcurl_photo_get_field_string(photo, field));
+      present = (unix_time >= 0);
+      integer = (long)unix_time;
+    } else if(column->type == ARROW_COLUMN_FLOAT64) {
+      string = flickcurl_photo_get_field_string(photo, field);
+      present = (string != NULL);
+      if(present)
+        real = atof(string);
+    } else {
+      present = 1;
+      integer = flickcurl_photo_get_field_integer(photo, field);
+    }
+  }
+
+  flickcurl_arrow_column_add_number(column, row, present, integer, real);
+}
+
+
+static void
+flickcurl_arrow_add_row(flickcurl_arrow_writer* writer,
+                        flickcurl_photo* photo,
+                        flickcurl_photo_columns* pc, int pc_row)
+{
+  int row = writer->rows++;
+  int i;
+
+  for(i = 0; i < writer->columns_count; i++) {
+    flickcurl_arrow_column* column = &writer->columns[i];
+    flickcurl_video* video = photo ? photo->video : NULL;
+
+    switch(column->source) {
+      case ARROW_SOURCE_ID:
+        flickcurl_arrow_column_add_string(column, row,
+                                          photo ? photo->id :
+                                          flickcurl_photo_columns_get_id(pc, pc_row));
+        break;
+
+      case ARROW_SOURCE_FIELD:
+        flickcurl_arrow_column_add_field(column, row, photo, pc, pc_row);
+        break;
+
+      case ARROW_SOURCE_MEDIA:
+        flickcurl_arrow_column_add_string(column, row,
+                                          photo ? photo->media_type : NULL);
+        break;
+
+      case ARROW_SOURCE_TAGS:
+        flickcurl_arrow_column_add_tags(column, row,
+                                        photo ? photo->tags : NULL);
+        break;
+
+      case ARROW_SOURCE_PLACE_NAME:
+        flickcurl_arrow_column_add_string(column, row,
+                                          (photo && photo->place) ?
+                                          photo->place->names[FLICKCURL_PLACE_LOCATION] : NULL);
+        break;
+
+      case ARROW_SOURCE_VIDEO_DURATION:
+        flickcurl_arrow_column_add_number(column, row, video != NULL,
+                                          video ? video->duration : 0, 0.0);
+        break;
+
+      case ARROW_SOURCE_VIDEO_WIDTH:
+        flickcurl_arrow_column_add_number(column, row, video != NULL,
+                                          video ? video->width : 0, 0.0);
+        break;
+
+      case ARROW_SOURCE_VIDEO_HEIGHT:
+        flickcurl_arrow_column_add_number(column, row, video != NULL,
+                                          video ? video->height : 0, 0.0);
+        break;
+    }
+  }
+}
+
+
+/* Add @buffer to the body and its Buffer struct to @buffers */
+static void
+flickcurl_arrow_add_body_buffer(flickcurl_arrow_writer* writer,
+                                flickcurl_arrow_buffer* buffers,
+                                flickcurl_arrow_buffer* buffer)
+{
+  flickcurl_arrow_buffer* body = &writer->body;
+
+  flickcurl_arrow_buffer_append_int64(buffers, (long)body->length);
+  flickcurl_arrow_buffer_append_int64(buffers, (long)buffer->length);
+  if(buffer->length)
+    flickcurl_arrow_buffer_append(body, buffer->data, buffer->length);
+  flickcurl_arrow_buffer_pad(body, 8, 0);
+}
+
+
+/* Write the batch of rows added and start a new one */
+static int
+flickcurl_arrow_write_batch(flickcurl_arrow_writer* writer)
+{
+  flickcurl_arrow_buffer* b = &writer->meta;
+  flickcurl_arrow_buffer nodes;
+  flickcurl_arrow_buffer buffers;
+  flickcurl_arrow_buffer empty;
+  flickcurl_fb_field fields[3] = {
+    /* length, nodes, buffers */
+    { 0, 8, 0, 0 }, { 1, 4, 0, 0 }, { 2, 4, 0, 0 }
+  };
+  int nodes_count = 0;
+  int buffers_count = 0;
+  size_t header_pos;
+  size_t pos;
+  int rc;
+  int i;
+
+  memset(&nodes, '\0', sizeof(nodes));
+  memset(&buffers, '\0', sizeof(buffers));
+  memset(&empty, '\0', sizeof(empty));
+
+  writer->body.length = 0;
+  for(i = 0; i < writer->columns_count; i++) {
+    flickcurl_arrow_column* column = &writer->columns[i];
+
+    /* FieldNode length, null_count */
+    flickcurl_arrow_buffer_append_int64(&nodes, writer->rows);
+    flickcurl_arrow_buffer_append_int64(&nodes, column->null_count);
+    nodes_count++;
+
+    flickcurl_arrow_add_body_buffer(writer, &buffers, &column->validity);
+    flickcurl_arrow_add_body_buffer(writer, &buffers, &column->values);
+    buffers_count += 2;
+    if(column->type == ARROW_COLUMN_UTF8) {
+      flickcurl_arrow_add_body_buffer(writer, &buffers, &column->data);
+      buffers_count++;
+    } else if(column->type == ARROW_COLUMN_TAGS) {
+      /* the list items: no nulls so no validity bitmap */
+      flickcurl_arrow_buffer_append_int64(&nodes, column->items_count);
+      flickcurl_arrow_buffer_append_int64(&nodes, 0);
+      nodes_count++;
+
+      flickcurl_arrow_add_body_buffer(writer, &buffers, &empty);
+      flickcurl_arrow_add_body_buffer(writer, &buffers, &column->item_offsets);
+      flickcurl_arrow_add_body_buffer(writer, &buffers, &column->item_data);
+      buffers_count += 3;
+    }
+  }
+
+  header_pos = flickcurl_arrow_fb_message(b, ARROW_MESSAGE_RECORD_BATCH,
+                                          writer->body.length);
+  fields[0].value = writer->rows;
+  pos = flickcurl_fb_table(b, fields, 3);
+  flickcurl_fb_set_offset(b, header_pos, pos);
+
+  /* struct vectors with 8 byte aligned elements */
+  flickcurl_arrow_buffer_pad(b, 8, 4);
+  flickcurl_fb_set_offset(b, fields[1].pos, b->length);
+  flickcurl_arrow_buffer_append_le(b, nodes_count, 4);
+  if(nodes.length)
+    flickcurl_arrow_buffer_append(b, nodes.data, nodes.length);
+
+  flickcurl_arrow_buffer_pad(b, 8, 4);
+  flickcurl_fb_set_offset(b, fields[2].pos, b->length);
+  flickcurl_arrow_buffer_append_le(b, buffers_count, 4);
+  if(buffers.length)
+    flickcurl_arrow_buffer_append(b, buffers.data, buffers.length);
+
+  if(nodes.failed || buffers.failed)
+    b->failed = 1;
+  flickcurl_arrow_buffer_free(&nodes);
+  flickcurl_arrow_buffer_free(&buffers);
+
+  rc = flickcurl_arrow_write_message(writer, &writer->body);
+
+  /* keep the buffers for the next batch */
+  writer->rows = 0;
+  for(i = 0; i < writer->columns_count; i++) {
+    flickcurl_arrow_column* column = &writer->columns[i];
+
+    column->null_count = 0;
+    column->items_count = 0;
+    column->validity.length = 0;
+    column->values.length = 0;
+    column->data.length = 0;
+    column->item_offsets.length = 0;
+    column->item_data.length = 0;
+  }
+
+  return rc;
+}
+
+
+/**
+ * flickcurl_arrow_writer_write_photos_list:
+ * @writer: Arrow writer
+ * @photos_list: photos list
+ *
+ * Write the photos of a photos list as one record batch
+ *
+ * The photos may be #flickcurl_photo objects or photo columns (see
+ * flickcurl_set_photo_columns()).  Photo columns have no media, tags,
+ * place or video, and fields that are not columns are written as
+ * nulls.  A list with no photos writes nothing.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_arrow_writer_write_photos_list(flickcurl_arrow_writer* writer,
+                                         flickcurl_photos_list* photos_list)
+{
+  int i;
+
+  if(writer->finished) {
+    flickcurl_error(writer->fc, "Arrow stream is finished");
+    return 1;
+  }
+
+  if(photos_list->columns) {
+    int rows = flickcurl_photo_columns_get_rows_count(photos_list->columns);
+
+    for(i = 0; i < rows; i++)
+      flickcurl_arrow_add_row(writer, NULL, photos_list->columns, i);
+  } else if(photos_list->photos) {
+    for(i = 0; photos_list->photos[i]; i++)
+      flickcurl_arrow_add_row(writer, photos_list->photos[i], NULL, 0);
+  }
+
+  if(!writer->rows)
+    return 0;
+
+  return flickcurl_arrow_write_batch(writer);
+}
+
+
+/**
+ * flickcurl_arrow_writer_finish:
+ * @writer: Arrow writer
+ *
+ * End the Arrow stream
+ *
+ * This writes the end of stream marker.  The file handle is not
+ * closed or flushed.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_arrow_writer_finish(flickcurl_arrow_writer* writer)
+{
+  static const unsigned char eos[8] = {
+    0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0
+  };
+
+  if(writer->finished)
+    return 0;
+  writer->finished = 1;
+
+  if(fwrite(eos, 1, sizeof(eos), writer->fh) != sizeof(eos)) {
+    flickcurl_error(writer->fc, "Failed to write Arrow stream");
+    return 1;
+  }
+
+  return 0;
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+#define ARROW_TEST_FILE "flickcurl_arrow_test.arrow"
+
+/* columns: id, latitude, media, tags, place_name and 3 video columns */
+#define ARROW_TEST_NODES 9
+#define ARROW_TEST_BUFFERS 22
+/* buffers of the id and latitude columns */
+#define ARROW_TEST_ID_OFFSETS 1
+#define ARROW_TEST_ID_DATA 2
+#define ARROW_TEST_LATITUDE_VALIDITY 3
+#define ARROW_TEST_LATITUDE_VALUES 4
+
+
+static unsigned long
+arrow_test_u16(const unsigned char* p)
+{
+  return (unsigned long)p[0] | ((unsigned long)p[1] << 8);
+}
+
+
+static unsigned long
+arrow_test_u32(const unsigned char* p)
+{
+  return arrow_test_u16(p) | (arrow_test_u16(p + 2) << 16);
+}
+
+
+/* Read a little-endian 64 bit value that fits in 32 bits or -1 */
+static long
+arrow_test_u64(const unsigned char* p)
+{
+  if(arrow_test_u32(p + 4))
+    return -1;
+  return (long)arrow_test_u32(p);
+}
+
+
+/* Get the position of field @id of the flatbuffer table at @table of
+ * @meta or 0 if it has the default value */
+static size_t
+arrow_test_field(const unsigned char* meta, size_t table, int id)
+{
+  size_t vtable = table - arrow_test_u32(meta + table);
+  unsigned long offset;
+
+  if(4 + 2 * (unsigned long)id >= arrow_test_u16(meta + vtable))
+    return 0;
+  offset = arrow_test_u16(meta + vtable + 4 + 2 * id);
+  return offset ? table + offset : 0;
+}
+
+
+/* Follow the offset field @id of the table at @table of @meta */
+static size_t
+arrow_test_offset(const unsigned char* meta, size_t table, int id)
+{
+  size_t pos = arrow_test_field(meta, table, id);
+
+  return pos ? pos + arrow_test_u32(meta + pos) : 0;
+}
+
+
+/* Check the message framing at @offset of @stream and get its header
+ * type, metadata and body
+ *
+ * Return value: non-0 on failure */
+static int
+arrow_test_message(const unsigned char* stream, size_t stream_len,
+                   size_t offset, int* header_type_p,
+                   const unsigned char** meta_p, size_t* body_p,
+                   size_t* body_len_p)
+{
+  const unsigned char* meta;
+  size_t meta_len;
+  size_t message;
+  size_t pos;
+
+  if(offset % 8 || offset + 8 > stream_len ||
+     arrow_test_u32(stream + offset) != 0xffffffffUL) {
+    fprintf(stderr, "%s: FAIL\n  no message continuation at %d\n", program,
+            (int)offset);
+    return 1;
+  }
+
+  meta_len = arrow_test_u32(stream + offset + 4);
+  meta = stream + offset + 8;
+  if(!meta_len || meta_len % 8 || offset + 8 + meta_len > stream_len) {
+    fprintf(stderr, "%s: FAIL\n  bad metadata size %d at %d\n", program,
+            (int)meta_len, (int)offset);
+    return 1;
+  }
+
+  message = arrow_test_u32(meta);
+  pos = arrow_test_field(meta, message, 0);
+  if(!pos || arrow_test_u16(meta + pos) != ARROW_METADATA_VERSION) {
+    fprintf(stderr, "%s: FAIL\n  bad metadata version at %d\n", program,
+            (int)offset);
+    return 1;
+  }
+
+  pos = arrow_test_field(meta, message, 1);
+  *header_type_p = pos ? meta[pos] : 0;
+  pos = arrow_test_field(meta, message, 3);
+  *body_len_p = pos ? (size_t)arrow_test_u64(meta + pos) : 0;
+  *body_p = offset + 8 + meta_len;
+  *meta_p = meta;
+
+  if(*body_len_p % 8 || *body_p + *body_len_p > stream_len) {
+    fprintf(stderr, "%s: FAIL\n  bad body length %d at %d\n", program,
+            (int)*body_len_p, (int)offset);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Check the record batch of the two test photos */
+static int
+arrow_test_batch(const unsigned char* meta, const unsigned char* body,
+                 size_t body_len)
+{
+  static const unsigned char latitude_values[16] = {
+    /* 1.5 little-endian and a null */
+    0, 0, 0, 0, 0, 0, 0xf8, 0x3f, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+  size_t batch;
+  size_t pos;
+  size_t nodes;
+  size_t buffers;
+  size_t end = 0;
+  long offsets[ARROW_TEST_BUFFERS];
+  long lengths[ARROW_TEST_BUFFERS];
+  int i;
+
+  batch = arrow_test_offset(meta, arrow_test_u32(meta), 2);
+  pos = arrow_test_field(meta, batch, 0);
+  if(!batch || !pos || arrow_test_u64(meta + pos) != 2) {
+    fprintf(stderr, "%s: FAIL\n  record batch does not have 2 rows\n",
+            program);
+    return 1;
+  }
+
+  nodes = arrow_test_offset(meta, batch, 1);
+  buffers = arrow_test_offset(meta, batch, 2);
+  if(!nodes || arrow_test_u32(meta + nodes) != ARROW_TEST_NODES ||
+     !buffers || arrow_test_u32(meta + buffers) != ARROW_TEST_BUFFERS) {
+    fprintf(stderr, "%s: FAIL\n  record batch does not have %d nodes and"
+            " %d buffers\n", program, ARROW_TEST_NODES, ARROW_TEST_BUFFERS);
+    return 1;
+  }
+
+  /* struct vector elements are 8 byte aligned */
+  if((nodes + 4) % 8 || (buffers + 4) % 8) {
+    fprintf(stderr, "%s: FAIL\n  nodes or buffers vector not aligned\n",
+            program);
+    return 1;
+  }
+
+  /* FieldNode of the latitude column: length 2, null_count 1 */
+  if(arrow_test_u64(meta + nodes + 4 + 16) != 2 ||
+     arrow_test_u64(meta + nodes + 4 + 16 + 8) != 1) {
+    fprintf(stderr, "%s: FAIL\n  latitude field node is wrong\n", program);
+    return 1;
+  }
+
+  /* Buffers are aligned, in order and inside the body */
+  for(i = 0; i < ARROW_TEST_BUFFERS; i++) {
+    offsets[i] = arrow_test_u64(meta + buffers + 4 + 16 * i);
+    lengths[i] = arrow_test_u64(meta + buffers + 4 + 16 * i + 8);
+    if(offsets[i] < 0 || lengths[i] < 0 || offsets[i] % 8 ||
+       (size_t)offsets[i] < end ||
+       (size_t)(offsets[i] + lengths[i]) > body_len) {
+      fprintf(stderr, "%s: FAIL\n  buffer %d at %ld length %ld is outside"
+              " the body of %d bytes\n", program, i, offsets[i], lengths[i],
+              (int)body_len);
+      return 1;
+    }
+    end = (size_t)(offsets[i] + lengths[i]);
+  }
+
+  if(lengths[ARROW_TEST_ID_OFFSETS] != 12 ||
+     arrow_test_u32(body + offsets[ARROW_TEST_ID_OFFSETS] + 4) != 1 ||
+     arrow_test_u32(body + offsets[ARROW_TEST_ID_OFFSETS] + 8) != 2 ||
+     lengths[ARROW_TEST_ID_DATA] != 2 ||
+     memcmp(body + offsets[ARROW_TEST_ID_DATA], "12", 2)) {
+    fprintf(stderr, "%s: FAIL\n  id column buffers are wrong\n", program);
+    return 1;
+  }
+
+  if(lengths[ARROW_TEST_LATITUDE_VALIDITY] != 1 ||
+     body[offsets[ARROW_TEST_LATITUDE_VALIDITY]] != 0x01 ||
+     lengths[ARROW_TEST_LATITUDE_VALUES] != 16 ||
+     memcmp(body + offsets[ARROW_TEST_LATITUDE_VALUES], latitude_values,
+            16)) {
+    fprintf(stderr, "%s: FAIL\n  latitude column buffers are wrong\n",
+            program);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  static const flickcurl_photo_field_type fields[2] = {
+    PHOTO_FIELD_location_latitude, PHOTO_FIELD_none
+  };
+  flickcurl *fc = NULL;
+  flickcurl_arrow_writer* writer;
+  flickcurl_photo photo1;
+  flickcurl_photo photo2;
+  flickcurl_photo* photos[3];
+  flickcurl_photos_list photos_list;
+  unsigned char stream[4096];
+  size_t stream_len;
+  const unsigned char* meta;
+  size_t body;
+  size_t body_len;
+  int header_type;
+  FILE* fh;
+  int failures = 0;
+  int i;
+
+  program = "flickcurl_arrow_test";
+
+  flickcurl_init();
+
+  fc = flickcurl_new();
+  if(!fc) {
+    failures++;
+    goto tidy;
+  }
+
+  memset(&photo1, '\0', sizeof(photo1));
+  memset(&photo2, '\0', sizeof(photo2));
+  for(i = 0; i <= PHOTO_FIELD_LAST; i++) {
+    photo1.fields[i].integer = (flickcurl_photo_field_type)-1;
+    photo2.fields[i].integer = (flickcurl_photo_field_type)-1;
+  }
+  photo1.id = (char*)"1";
+  photo1.fields[PHOTO_FIELD_location_latitude].string = (char*)"1.5";
+  photo1.fields[PHOTO_FIELD_location_latitude].type = VALUE_TYPE_FLOAT;
+  photo2.id = (char*)"2";
+  photos[0] = &photo1;
+  photos[1] = &photo2;
+  photos[2] = NULL;
+
+  memset(&photos_list, '\0', sizeof(photos_list));
+  photos_list.photos = photos;
+  photos_list.photos_count = 2;
+
+  fh = fopen(ARROW_TEST_FILE, "wb");
+  if(!fh) {
+    fprintf(stderr, "%s: FAIL\n  cannot write %s\n", program, ARROW_TEST_FILE);
+    failures++;
+    goto tidy;
+  }
+  writer = flickcurl_new_arrow_writer(fc, fh, fields);
+  if(!writer ||
+     flickcurl_arrow_writer_write_photos_list(writer, &photos_list) ||
+     flickcurl_arrow_writer_finish(writer)) {
+    fprintf(stderr, "%s: FAIL\n  writing the stream failed\n", program);
+    failures++;
+  }
+  if(writer)
+    flickcurl_free_arrow_writer(writer);
+  fclose(fh);
+  if(failures)
+    goto tidy;
+
+  fh = fopen(ARROW_TEST_FILE, "rb");
+  stream_len = fh ? fread(stream, 1, sizeof(stream), fh) : 0;
+  if(fh)
+    fclose(fh);
+
+  /* the schema message */
+  if(arrow_test_message(stream, stream_len, 0, &header_type, &meta, &body,
+                        &body_len)) {
+    failures++;
+    goto tidy;
+  }
+  if(header_type != ARROW_MESSAGE_SCHEMA || body_len) {
+    fprintf(stderr, "%s: FAIL\n  first message is not a schema\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  /* the record batch message */
+  if(arrow_test_message(stream, stream_len, body, &header_type, &meta, &body,
+                        &body_len)) {
+    failures++;
+    goto tidy;
+  }
+  if(header_type != ARROW_MESSAGE_RECORD_BATCH) {
+    fprintf(stderr, "%s: FAIL\n  second message is not a record batch\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+  failures += arrow_test_batch(meta, stream + body, body_len);
+
+  /* the end of stream marker ends the file */
+  body += body_len;
+  if(stream_len != body + 8 || arrow_test_u32(stream + body) != 0xffffffffUL ||
+     arrow_test_u32(stream + body + 4)) {
+    fprintf(stderr, "%s: FAIL\n  no end of stream marker at %d of %d bytes\n",
+            program, (int)body, (int)stream_len);
+    failures++;
+  }
+
+  tidy:
+  remove(ARROW_TEST_FILE);
+  if(fc)
+    flickcurl_free(fc);
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
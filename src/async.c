@@ -0,0 +1,1637 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * async.c - Flickcurl asynchronous calls driven by an event loop
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * An asynchronous call runs a builder function that makes an ordinary
+ * flickcurl API call.  The first time the builder reaches
+ * flickcurl_invoke(), the prepared request is copied to its own curl
+ * handle and queued, and the builder is left to fail quietly.  When
+ * the response has arrived the builder is run again: this time the
+ * invoke is given the saved response instead of making a transfer, so
+ * the usual parsing, error handling and object building make the
+ * result.  A builder that makes several requests is run once more
+ * for each of them.  Each response DOM is kept with its request and
+ * handed straight back on later runs, so a response is transferred
+ * and parsed once however many times the builder passes it again.
+ * A builder that keeps its progress can drop the requests before a
+ * checkpoint so later runs do not repeat them at all.
+ *
+ * The transfers run on a curl multi handle using the socket
+ * interface so the application's event loop waits on the sockets
+ * and one timer.  The timer also covers the request delay rate limit
+ * and the delays before retries, so nothing here ever sleeps.
+ *
+ * Calls may be made for other OAuth accounts than the session's from
+ * a table of credentials, sharing the one request delay budget and
+ * connection pool.  Waiting requests are sent high priority lane
+ * first and then by weighted fair queuing across the accounts: each
+ * request is tagged with a virtual finish time of the later of the
+ * lane's virtual time and the account's last tag, plus the inverse
+ * of the account weight, and the smallest tag is sent next.  An
+ * account with a long backlog so only gets its weighted share and
+ * does not hold up others.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+#include <curl/multi.h>
+
+
+typedef enum {
+  FLICKCURL_ASYNC_REQUEST_WAITING,
+  FLICKCURL_ASYNC_REQUEST_RUNNING,
+  FLICKCURL_ASYNC_REQUEST_DONE
+} flickcurl_async_request_state;
+
+
+/* One web service request made by an asynchronous call */
+struct flickcurl_async_request_s {
+  flickcurl_async_call* call;
+  /* next request made by the same call */
+  flickcurl_async_request* next;
+  /* next request in the queue waiting to be sent */
+  flickcurl_async_request* next_waiting;
+
+  CURL* handle;
+  struct curl_slist* slist;
+  /* prepared URI and parameters, signed again each time it is sent */
+  char* uri;
+  char** param_fields;
+  char** param_values;
+  int is_write;
+  flickcurl_async_request_state state;
+  /* time in seconds before which a retry is not sent */
+  double not_before;
+  int retries;
+  /* fair queuing virtual finish time */
+  double finish;
+
+  /* response header lines and content */
+  char* headers;
+  size_t headers_len;
+  size_t headers_size;
+  char* content;
+  size_t content_len;
+  size_t content_size;
+
+  CURLcode result;
+  char error_buffer[CURL_ERROR_SIZE];
+
+  /* response DOM kept for later runs of the builder or NULL */
+  flickcurl_shared_doc* doc;
+};
+
+
+struct flickcurl_async_call_s {
+  flickcurl_async_builder builder;
+  void* builder_data;
+  flickcurl_async_handler handler;
+  void* user_data;
+
+  /* requests in the order the builder makes them */
+  flickcurl_async_request* requests;
+  flickcurl_async_request* requests_tail;
+  /* number of invokes made by the builder during this run */
+  int invoke_index;
+  /* request of the invoke being run */
+  flickcurl_async_request* current;
+
+  double start_time;
+  /* time by which the call must end in seconds or 0 */
+  double deadline;
+
+  /* account index (0 for the session credentials) */
+  int account;
+  flickcurl_async_priority priority;
+
+  flickcurl_async_call* prev;
+  flickcurl_async_call* next;
+};
+
+
+#if LIBCURL_VERSION_NUM >= 0x071101
+/* Remove @r from the queue of requests waiting to be sent */
+static void
+flickcurl_async_unqueue(flickcurl* fc, flickcurl_async_request* r)
+{
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_request* prev = NULL;
+  flickcurl_async_request* w;
+
+  for(w = as->waiting; w; prev = w, w = w->next_waiting) {
+    if(w == r)
+      break;
+  }
+  if(!w)
+    return;
+
+  if(prev)
+    prev->next_waiting = r->next_waiting;
+  else
+    as->waiting = r->next_waiting;
+  if(as->waiting_tail == r)
+    as->waiting_tail = prev;
+  r->next_waiting = NULL;
+}
+
+
+static flickcurl_async_account*
+flickcurl_async_get_account(flickcurl* fc, int account)
+{
+  flickcurl_async_state* as = &fc->async;
+
+  return account ? as->accounts[account - 1] : &as->session_account;
+}
+
+
+static void
+flickcurl_async_queue(flickcurl* fc, flickcurl_async_request* r)
+{
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_call* call = r->call;
+  flickcurl_async_account* a = flickcurl_async_get_account(fc, call->account);
+  double start;
+
+  start = a->last_finish[call->priority];
+  if(start < as->vtime[call->priority])
+    start = as->vtime[call->priority];
+  r->finish = start + 1.0 / a->weight;
+  a->last_finish[call->priority] = r->finish;
+
+  r->state = FLICKCURL_ASYNC_REQUEST_WAITING;
+  r->next_waiting = NULL;
+  if(as->waiting_tail)
+    as->waiting_tail->next_waiting = r;
+  else
+    as->waiting = r;
+  as->waiting_tail = r;
+}
+
+
+/*
+ * Find the waiting request to send next: the smallest fair queuing
+ * tag in the highest priority lane that has one ready.  Requests of
+ * calls past their deadline are returned first.
+ */
+static flickcurl_async_request*
+flickcurl_async_next_request(flickcurl* fc, double now)
+{
+  flickcurl_async_request* best = NULL;
+  flickcurl_async_request* r;
+
+  for(r = fc->async.waiting; r; r = r->next_waiting) {
+    if(r->not_before > now)
+      continue;
+
+    if(r->call->deadline && r->call->deadline <= now)
+      return r;
+
+    if(!best || r->call->priority < best->call->priority ||
+       (r->call->priority == best->call->priority &&
+        r->finish < best->finish))
+      best = r;
+  }
+
+  return best;
+}
+
+
+/* Take @r off the queue to be sent, advancing its lane's virtual time */
+static void
+flickcurl_async_dequeue(flickcurl* fc, flickcurl_async_request* r)
+{
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_call* call = r->call;
+
+  flickcurl_async_unqueue(fc, r);
+  as->vtime[call->priority] = r->finish;
+  flickcurl_async_get_account(fc, call->account)->sent++;
+}
+#endif
+
+
+#ifndef STANDALONE
+
+#if LIBCURL_VERSION_NUM >= 0x071101
+static int
+flickcurl_async_append(char** buffer_p, size_t* len_p, size_t* size_p,
+                       const char* ptr, size_t len)
+{
+  if(*len_p + len > *size_p) {
+    size_t size = *size_p ? *size_p : 1024;
+    char* buffer;
+
+    while(size < *len_p + len)
+      size <<= 1;
+    buffer = (char*)realloc(*buffer_p, size);
+    if(!buffer)
+      return 1;
+    *buffer_p = buffer;
+    *size_p = size;
+  }
+
+  memcpy(*buffer_p + *len_p, ptr, len);
+  *len_p += len;
+  return 0;
+}
+
+
+static size_t
+flickcurl_async_write_callback(void *ptr, size_t size, size_t nmemb,
+                               void *userdata)
+{
+  flickcurl_async_request* r = (flickcurl_async_request*)userdata;
+  size_t len = size * nmemb;
+
+  if(flickcurl_async_append(&r->content, &r->content_len, &r->content_size,
+                            (const char*)ptr, len))
+    return 0;
+
+  return len;
+}
+
+
+static size_t
+flickcurl_async_header_callback(void *ptr, size_t size, size_t nmemb,
+                                void *userdata)
+{
+  flickcurl_async_request* r = (flickcurl_async_request*)userdata;
+  size_t len = size * nmemb;
+
+  if(flickcurl_async_append(&r->headers, &r->headers_len, &r->headers_size,
+                            (const char*)ptr, len))
+    return 0;
+
+  return len;
+}
+
+
+static void
+flickcurl_async_free_request(flickcurl* fc, flickcurl_async_request* r)
+{
+  if(r->handle) {
+    if(r->state == FLICKCURL_ASYNC_REQUEST_RUNNING)
+      curl_multi_remove_handle(fc->async.multi, r->handle);
+    curl_easy_cleanup(r->handle);
+  }
+  if(r->slist)
+    curl_slist_free_all(r->slist);
+  if(r->uri)
+    free(r->uri);
+  if(r->param_fields) {
+    int i;
+
+    for(i = 0; r->param_fields[i]; i++) {
+      free(r->param_fields[i]);
+      if(r->param_values && r->param_values[i])
+        free(r->param_values[i]);
+    }
+    free(r->param_fields);
+  }
+  if(r->param_values)
+    free(r->param_values);
+  if(r->headers)
+    free(r->headers);
+  if(r->content)
+    free(r->content);
+  if(r->doc)
+    flickcurl_release_doc(r->doc);
+  free(r);
+}
+
+
+/* Forget @call and free its requests; the handler is not called */
+static void
+flickcurl_async_free_call(flickcurl* fc, flickcurl_async_call* call)
+{
+  flickcurl_async_state* as = &fc->async;
+
+  if(call->prev)
+    call->prev->next = call->next;
+  else
+    as->calls = call->next;
+  if(call->next)
+    call->next->prev = call->prev;
+  as->calls_count--;
+
+  while(call->requests) {
+    flickcurl_async_request* r = call->requests;
+    call->requests = r->next;
+    if(r->state == FLICKCURL_ASYNC_REQUEST_WAITING)
+      flickcurl_async_unqueue(fc, r);
+    flickcurl_async_free_request(fc, r);
+  }
+
+  free(call);
+}
+
+
+/* Deliver the result of @call to its handler and free it */
+static void
+flickcurl_async_complete(flickcurl* fc, flickcurl_async_call* call,
+                         void* result)
+{
+  flickcurl_async_handler handler = call->handler;
+  void* user_data = call->user_data;
+
+  /* the handler may submit or cancel other calls */
+  call->handler = NULL;
+  if(handler)
+    handler(user_data, call, result);
+
+  flickcurl_async_free_call(fc, call);
+}
+
+
+/*
+ * Run the builder of @call, ending it unless it is waiting again
+ *
+ * Return value: non-0 if the call ended
+ */
+static int
+flickcurl_async_run(flickcurl* fc, flickcurl_async_call* call)
+{
+  flickcurl_async_state* as = &fc->async;
+  void* result;
+
+  flickcurl_async_account* a = NULL;
+  char* token = NULL;
+  size_t token_len = 0;
+  char* token_secret = NULL;
+  size_t token_secret_len = 0;
+
+  as->call = call;
+  as->deferred = 0;
+  call->invoke_index = 0;
+  call->current = NULL;
+
+  if(call->account) {
+    /* sign the requests with the account's credentials */
+    a = flickcurl_async_get_account(fc, call->account);
+    token = fc->od.token;
+    token_len = fc->od.token_len;
+    token_secret = fc->od.token_secret;
+    token_secret_len = fc->od.token_secret_len;
+    fc->od.token = a->token;
+    fc->od.token_len = strlen(a->token);
+    fc->od.token_secret = a->token_secret;
+    fc->od.token_secret_len = strlen(a->token_secret);
+  }
+
+  result = call->builder(fc, call->builder_data);
+
+  if(a) {
+    fc->od.token = token;
+    fc->od.token_len = token_len;
+    fc->od.token_secret = token_secret;
+    fc->od.token_secret_len = token_secret_len;
+  }
+
+  as->call = NULL;
+  if(as->deferred) {
+    /* builders return NULL when an invoke fails, as it did here */
+    as->deferred = 0;
+    return 0;
+  }
+
+  flickcurl_async_complete(fc, call, result);
+  return 1;
+}
+
+
+static char*
+flickcurl_async_copy_string(const char* string)
+{
+  size_t len = strlen(string);
+  char* copy = (char*)malloc(len + 1);
+
+  if(copy)
+    memcpy(copy, string, len + 1);
+  return copy;
+}
+
+
+/* Copy the prepared request URI and parameters of @fc into @r */
+static int
+flickcurl_async_copy_params(flickcurl* fc, flickcurl_async_request* r)
+{
+  int count;
+  int i;
+
+  r->is_write = fc->is_write;
+  if(!fc->uri || !fc->param_fields)
+    return 0;
+
+  r->uri = flickcurl_async_copy_string(fc->uri);
+  if(!r->uri)
+    return 1;
+
+  for(count = 0; fc->param_fields[count]; count++)
+    ;
+  r->param_fields = (char**)calloc(count + 1, sizeof(char*));
+  r->param_values = (char**)calloc(count + 1, sizeof(char*));
+  if(!r->param_fields || !r->param_values)
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    r->param_fields[i] = flickcurl_async_copy_string(fc->param_fields[i]);
+    if(!r->param_fields[i])
+      return 1;
+    r->param_values[i] = flickcurl_async_copy_string(fc->param_values[i]);
+    if(!r->param_values[i])
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Sign @r with a new nonce and timestamp just before it is sent, so
+ * that a request waiting in the queue or sent again as a retry is not
+ * refused as stale or replayed
+ */
+static int
+flickcurl_async_sign(flickcurl* fc, flickcurl_async_request* r)
+{
+  flickcurl_async_account* a = NULL;
+  char* token = NULL;
+  size_t token_len = 0;
+  char* token_secret = NULL;
+  size_t token_secret_len = 0;
+  char* uri = NULL;
+  int rc;
+
+  if(!r->uri)
+    return 0;
+
+  if(r->call->account) {
+    a = flickcurl_async_get_account(fc, r->call->account);
+    token = fc->od.token;
+    token_len = fc->od.token_len;
+    token_secret = fc->od.token_secret;
+    token_secret_len = fc->od.token_secret_len;
+    fc->od.token = a->token;
+    fc->od.token_len = strlen(a->token);
+    fc->od.token_secret = a->token_secret;
+    fc->od.token_secret_len = strlen(a->token_secret);
+  }
+
+  rc = flickcurl_oauth_resign(fc, r->is_write ? "POST" : "GET", r->uri,
+                              r->param_fields, r->param_values, &uri);
+
+  if(a) {
+    fc->od.token = token;
+    fc->od.token_len = token_len;
+    fc->od.token_secret = token_secret;
+    fc->od.token_secret_len = token_secret_len;
+  }
+
+  if(rc)
+    return 1;
+
+  if(uri) {
+    curl_easy_setopt(r->handle, CURLOPT_URL, uri);
+    free(r->uri);
+    r->uri = uri;
+  }
+
+  return 0;
+}
+
+
+/* Tell the application when flickcurl_async_timeout() is next needed */
+static void
+flickcurl_async_update_timer(flickcurl* fc)
+{
+  flickcurl_async_state* as = &fc->async;
+  double now = flickcurl_get_time();
+  double at = as->curl_timer;
+  long timeout;
+
+  if(as->waiting) {
+    flickcurl_async_request* r;
+    int wait = flickcurl_get_current_request_wait(fc);
+    /* 'infinity' is more than 247 seconds */
+    double next_slot = now + ((wait < 0) ? 248.0 : wait / 1000000.0);
+
+    for(r = as->waiting; r; r = r->next_waiting) {
+      double start = (r->not_before > next_slot) ? r->not_before : next_slot;
+      if(at < 0 || start < at)
+        at = start;
+    }
+  }
+
+  /* only tell of a change of more than a millisecond */
+  if(at < 0) {
+    if(as->timer < 0)
+      return;
+    timeout = -1;
+  } else {
+    if(as->timer >= 0 && at > as->timer - 0.001 && at < as->timer + 0.001)
+      return;
+    timeout = (at > now) ? (long)((at - now) * 1000 + 0.999) : 0;
+  }
+
+  as->timer = at;
+  if(as->timer_handler)
+    as->timer_handler(as->user_data, timeout);
+}
+
+
+/* Send the waiting requests the request delay and retry delays allow */
+static void
+flickcurl_async_start_requests(flickcurl* fc)
+{
+  flickcurl_async_state* as = &fc->async;
+
+  while(1) {
+    flickcurl_async_request* r;
+    flickcurl_async_call* call;
+    double now = flickcurl_get_time();
+
+    r = flickcurl_async_next_request(fc, now);
+    if(!r)
+      break;
+    call = r->call;
+
+    if(call->deadline && call->deadline <= now) {
+      /* the call ran out of time waiting for the rate limit */
+      flickcurl_async_unqueue(fc, r);
+      r->state = FLICKCURL_ASYNC_REQUEST_DONE;
+      r->result = CURLE_OPERATION_TIMEDOUT;
+      flickcurl_async_run(fc, call);
+      continue;
+    }
+
+    if(flickcurl_get_current_request_wait(fc))
+      break;
+
+    flickcurl_async_dequeue(fc, r);
+    curl_easy_setopt(r->handle, CURLOPT_TIMEOUT_MS,
+                     call->deadline ?
+                     (long)((call->deadline - now) * 1000) + 1 : 0L);
+    r->error_buffer[0] = '\0';
+    if(flickcurl_async_sign(fc, r)) {
+      r->state = FLICKCURL_ASYNC_REQUEST_DONE;
+      r->result = CURLE_FAILED_INIT;
+      flickcurl_async_run(fc, call);
+      continue;
+    }
+    r->state = FLICKCURL_ASYNC_REQUEST_RUNNING;
+    if(curl_multi_add_handle(as->multi, r->handle) != CURLM_OK) {
+      r->state = FLICKCURL_ASYNC_REQUEST_DONE;
+      r->result = CURLE_FAILED_INIT;
+      flickcurl_async_run(fc, call);
+      continue;
+    }
+
+    gettimeofday(&fc->last_request_time, NULL);
+  }
+}
+
+
+/* Run the calls whose requests have finished */
+static void
+flickcurl_async_check_done(flickcurl* fc)
+{
+  flickcurl_async_state* as = &fc->async;
+  CURLMsg* msg;
+  int left;
+
+  while((msg = curl_multi_info_read(as->multi, &left))) {
+    flickcurl_async_request* r = NULL;
+
+    if(msg->msg != CURLMSG_DONE)
+      continue;
+
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&r);
+    r->result = msg->data.result;
+    curl_multi_remove_handle(as->multi, r->handle);
+    r->state = FLICKCURL_ASYNC_REQUEST_DONE;
+
+    flickcurl_async_run(fc, r->call);
+  }
+}
+
+
+static int
+flickcurl_async_curl_socket(CURL* easy, curl_socket_t s, int what,
+                            void* userp, void* socketp)
+{
+  flickcurl* fc = (flickcurl*)userp;
+  flickcurl_async_state* as = &fc->async;
+  int events = 0;
+
+  if(what == CURL_POLL_REMOVE)
+    events = FLICKCURL_ASYNC_REMOVE;
+  else {
+    if(what & CURL_POLL_IN)
+      events |= FLICKCURL_ASYNC_IN;
+    if(what & CURL_POLL_OUT)
+      events |= FLICKCURL_ASYNC_OUT;
+  }
+
+  if(as->socket_handler)
+    as->socket_handler(as->user_data, (int)s, events);
+
+  return 0;
+}
+
+
+static int
+flickcurl_async_curl_timer(CURLM* multi, long timeout_ms, void* userp)
+{
+  flickcurl* fc = (flickcurl*)userp;
+
+  fc->async.curl_timer = (timeout_ms < 0) ? -1.0 :
+                         flickcurl_get_time() + timeout_ms / 1000.0;
+  flickcurl_async_update_timer(fc);
+
+  return 0;
+}
+#endif
+
+
+/**
+ * flickcurl_set_async_handlers:
+ * @fc: flickcurl object
+ * @socket_handler: socket interest callback
+ * @timer_handler: timer callback
+ * @user_data: user data for the handlers
+ *
+ * Set the event loop callbacks for asynchronous calls
+ *
+ * @socket_handler is told which sockets to wait on and for what;
+ * when one is ready call flickcurl_async_socket_action().
+ * @timer_handler is given the time after which
+ * flickcurl_async_timeout() must be called, replacing any earlier
+ * time.  These work like the libcurl multi socket interface
+ * callbacks.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_async_handlers(flickcurl* fc,
+                             flickcurl_async_socket_handler socket_handler,
+                             flickcurl_async_timer_handler timer_handler,
+                             void* user_data)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+
+  if(!socket_handler || !timer_handler)
+    return 1;
+
+  if(!as->multi) {
+    as->multi = curl_multi_init();
+    if(!as->multi) {
+      flickcurl_error(fc, "Failed to create curl multi handle");
+      return 1;
+    }
+    curl_multi_setopt(as->multi, CURLMOPT_SOCKETFUNCTION,
+                      flickcurl_async_curl_socket);
+    curl_multi_setopt(as->multi, CURLMOPT_SOCKETDATA, fc);
+    curl_multi_setopt(as->multi, CURLMOPT_TIMERFUNCTION,
+                      flickcurl_async_curl_timer);
+    curl_multi_setopt(as->multi, CURLMOPT_TIMERDATA, fc);
+    as->curl_timer = -1.0;
+    as->timer = -1.0;
+    as->session_account.weight = 1;
+  }
+
+  as->socket_handler = socket_handler;
+  as->timer_handler = timer_handler;
+  as->user_data = user_data;
+
+  return 0;
+#else
+  flickcurl_error(fc, "Asynchronous calls need libcurl 7.17.1 or newer");
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_async_submit:
+ * @fc: flickcurl object
+ * @builder: function making the call
+ * @builder_data: data for @builder
+ * @handler: function called with the result
+ * @user_data: user data for @handler
+ *
+ * Start an asynchronous web service call
+ *
+ * @builder makes the call with the usual flickcurl API and returns
+ * its result, for example by calling flickcurl_photos_getInfo().  It
+ * is run once when the call is submitted and once more each time a
+ * response arrives, so it must make the same requests each time and
+ * return NULL when a flickcurl call fails.
+ *
+ * @handler is called once with the result, or NULL if the call
+ * failed, from within flickcurl_async_socket_action() or
+ * flickcurl_async_timeout().  The result then belongs to the handler.
+ * Errors are reported to the error handler as for other calls.
+ *
+ * Requests are sent no faster than the request delay allows: high
+ * priority ones first and, within a lane, in weighted fair share
+ * order across the accounts, so not always in the order they were
+ * submitted.  Apart from retries, requests of one account in one
+ * lane are sent in order.
+ * The call timeout and retry policy apply to each call.
+ * flickcurl_set_async_handlers() must be called first.
+ *
+ * A builder making N requests is run N + 1 times but each response
+ * is parsed only once; the DOMs are kept until the call ends.  As
+ * each run still repeats the earlier calls, such a builder should
+ * use flickcurl_async_checkpoint() to keep the call cost linear.
+ *
+ * The call is made with the session credentials at high priority;
+ * see flickcurl_async_submit_params() for other accounts and the low
+ * priority lane.
+ *
+ * Return value: the call or NULL if it has already ended and
+ * @handler has been called
+ */
+flickcurl_async_call*
+flickcurl_async_submit(flickcurl* fc,
+                       flickcurl_async_builder builder, void* builder_data,
+                       flickcurl_async_handler handler, void* user_data)
+{
+  return flickcurl_async_submit_params(fc, builder, builder_data,
+                                       handler, user_data, NULL);
+}
+
+
+/**
+ * flickcurl_async_submit_params:
+ * @fc: flickcurl object
+ * @builder: function making the call
+ * @builder_data: data for @builder
+ * @handler: function called with the result
+ * @user_data: user data for @handler
+ * @params: call parameters or NULL for the defaults
+ *
+ * Start an asynchronous web service call for an account and priority
+ *
+ * As flickcurl_async_submit() with the call made using the OAuth
+ * credentials of the account from flickcurl_async_add_account() in
+ * @params and queued in its priority lane.  Waiting high priority
+ * requests are always sent before low priority ones; within a lane
+ * the accounts share the request delay budget in proportion to their
+ * weights.
+ *
+ * Return value: the call or NULL if it has already ended and
+ * @handler has been called
+ */
+flickcurl_async_call*
+flickcurl_async_submit_params(flickcurl* fc,
+                              flickcurl_async_builder builder,
+                              void* builder_data,
+                              flickcurl_async_handler handler,
+                              void* user_data,
+                              flickcurl_async_params* params)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_call* call;
+  flickcurl_async_params defaults;
+
+  if(!params) {
+    flickcurl_async_params_init(&defaults);
+    params = &defaults;
+  }
+
+  if(!as->multi) {
+    flickcurl_error(fc, "No asynchronous call handlers set");
+    goto failed;
+  }
+
+  if(params->version != 1 || params->account < 0 ||
+     params->account > as->accounts_count ||
+     (params->priority != FLICKCURL_ASYNC_PRIORITY_HIGH &&
+      params->priority != FLICKCURL_ASYNC_PRIORITY_LOW)) {
+    flickcurl_error(fc, "Bad asynchronous call parameters");
+    goto failed;
+  }
+
+  if(as->call) {
+    flickcurl_error(fc, "Cannot submit an asynchronous call from a builder");
+    goto failed;
+  }
+
+  call = (flickcurl_async_call*)calloc(1, sizeof(*call));
+  if(!call) {
+    flickcurl_error(fc, "Out of memory");
+    goto failed;
+  }
+
+  call->builder = builder;
+  call->builder_data = builder_data;
+  call->handler = handler;
+  call->user_data = user_data;
+  call->start_time = flickcurl_get_time();
+  call->deadline = fc->call_timeout ?
+    call->start_time + fc->call_timeout / 1000.0 : 0;
+  call->account = params->account;
+  call->priority = params->priority;
+
+  call->next = as->calls;
+  if(as->calls)
+    as->calls->prev = call;
+  as->calls = call;
+  as->calls_count++;
+
+  if(flickcurl_async_run(fc, call))
+    call = NULL;
+
+  flickcurl_async_start_requests(fc);
+  flickcurl_async_update_timer(fc);
+
+  return call;
+
+  failed:
+#else
+  flickcurl_error(fc, "Asynchronous calls need libcurl 7.17.1 or newer");
+#endif
+  if(handler)
+    handler(user_data, NULL, NULL);
+  return NULL;
+}
+
+
+/**
+ * flickcurl_async_socket_action:
+ * @fc: flickcurl object
+ * @fd: socket descriptor
+ * @events: #flickcurl_async_event flags the socket is ready for
+ *
+ * Handle a socket being ready for an asynchronous call
+ *
+ * Call handlers for calls that end are called from here.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_async_socket_action(flickcurl* fc, int fd, int events)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+  int mask = 0;
+  int running;
+
+  if(!as->multi)
+    return 1;
+
+  if(events & FLICKCURL_ASYNC_IN)
+    mask |= CURL_CSELECT_IN;
+  if(events & FLICKCURL_ASYNC_OUT)
+    mask |= CURL_CSELECT_OUT;
+  if(events & FLICKCURL_ASYNC_ERROR)
+    mask |= CURL_CSELECT_ERR;
+
+  curl_multi_socket_action(as->multi, (curl_socket_t)fd, mask, &running);
+  flickcurl_async_check_done(fc);
+  flickcurl_async_start_requests(fc);
+  flickcurl_async_update_timer(fc);
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_async_timeout:
+ * @fc: flickcurl object
+ *
+ * Handle the asynchronous call timer expiring
+ *
+ * Call when the time last given to the timer handler has passed.
+ * Call handlers for calls that end are called from here.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_async_timeout(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+  int running;
+
+  if(!as->multi)
+    return 1;
+
+  /* the timer has gone off so any new time must be passed on */
+  as->timer = -1.0;
+  if(as->curl_timer >= 0 && as->curl_timer <= flickcurl_get_time())
+    as->curl_timer = -1.0;
+
+  curl_multi_socket_action(as->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+  flickcurl_async_check_done(fc);
+  flickcurl_async_start_requests(fc);
+  flickcurl_async_update_timer(fc);
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_async_cancel:
+ * @fc: flickcurl object
+ * @call: asynchronous call
+ *
+ * Cancel an asynchronous call
+ *
+ * The call handler is called at once with a NULL result.
+ */
+void
+flickcurl_async_cancel(flickcurl* fc, flickcurl_async_call* call)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+
+  /* a call cannot be cancelled while its builder is running */
+  if(!call || call == as->call || !call->handler)
+    return;
+
+  flickcurl_async_complete(fc, call, NULL);
+  flickcurl_async_update_timer(fc);
+#endif
+}
+
+
+/**
+ * flickcurl_async_checkpoint:
+ * @fc: flickcurl object
+ *
+ * Mark the progress of a builder making several requests
+ *
+ * Call from a builder once it has kept what it built from the
+ * requests made so far, for example in its builder data.  Later
+ * runs of the builder start from here: they must not make the
+ * flickcurl calls made before the checkpoint again, and the
+ * responses of those are freed.  Without checkpoints each run
+ * repeats every earlier call, so a builder making N requests costs
+ * O(N^2).
+ *
+ * Return value: non-0 on failure, such as when not called from a
+ * builder or after a call of this run has had to wait
+ */
+int
+flickcurl_async_checkpoint(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_call* call = as->call;
+
+  if(!call || as->deferred)
+    return 1;
+
+  /* the requests up to the current one are done */
+  if(call->current) {
+    int last = 0;
+
+    while(!last) {
+      flickcurl_async_request* r = call->requests;
+
+      last = (r == call->current);
+      call->requests = r->next;
+      flickcurl_async_free_request(fc, r);
+    }
+    if(!call->requests)
+      call->requests_tail = NULL;
+  }
+  call->invoke_index = 0;
+  call->current = NULL;
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_async_get_pending:
+ * @fc: flickcurl object
+ *
+ * Get the number of asynchronous calls that have not ended
+ *
+ * Return value: number of calls
+ */
+int
+flickcurl_async_get_pending(flickcurl* fc)
+{
+  return fc->async.calls_count;
+}
+
+
+/**
+ * flickcurl_async_params_init:
+ * @params: asynchronous call params to init
+ *
+ * Initialise an existing asynchronous call parameter structure
+ *
+ * The defaults are the session credentials (account 0) and high
+ * priority.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_async_params_init(flickcurl_async_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(*params));
+  params->version = 1;
+
+  params->account = 0;
+  params->priority = FLICKCURL_ASYNC_PRIORITY_HIGH;
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_async_add_account:
+ * @fc: flickcurl object
+ * @oauth_token: OAuth access token
+ * @oauth_token_secret: OAuth access token secret
+ * @weight: share of the request budget relative to other accounts (1 or more)
+ *
+ * Add an account to make asynchronous calls for
+ *
+ * The account's calls are signed with these credentials and the
+ * session's OAuth client key and secret.  Account 0 is always the
+ * session's own credentials with weight 1.
+ *
+ * Return value: account index (1 or more) or < 0 on failure
+ */
+int
+flickcurl_async_add_account(flickcurl* fc, const char* oauth_token,
+                            const char* oauth_token_secret, int weight)
+{
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_account* a;
+  size_t token_len;
+  size_t secret_len;
+
+  if(!oauth_token || !oauth_token_secret || weight < 1)
+    return -1;
+
+  if(as->accounts_count == as->accounts_size) {
+    int size = as->accounts_size ? as->accounts_size * 2 : 8;
+    flickcurl_async_account** accounts;
+
+    accounts = (flickcurl_async_account**)realloc(as->accounts,
+                                                  sizeof(*accounts) * size);
+    if(!accounts)
+      return -1;
+    as->accounts = accounts;
+    as->accounts_size = size;
+  }
+
+  token_len = strlen(oauth_token);
+  secret_len = strlen(oauth_token_secret);
+  a = (flickcurl_async_account*)calloc(1, sizeof(*a) + token_len +
+                                       secret_len + 2);
+  if(!a)
+    return -1;
+
+  /* credential strings are stored after the structure */
+  a->token = (char*)(a + 1);
+  memcpy(a->token, oauth_token, token_len + 1);
+  a->token_secret = a->token + token_len + 1;
+  memcpy(a->token_secret, oauth_token_secret, secret_len + 1);
+  a->weight = weight;
+
+  as->accounts[as->accounts_count++] = a;
+  return as->accounts_count;
+}
+
+
+/**
+ * flickcurl_async_get_account_sent:
+ * @fc: flickcurl object
+ * @account: account index
+ *
+ * Get the number of asynchronous requests sent for an account
+ *
+ * Retries are counted as requests.
+ *
+ * Return value: number of requests or < 0 if there is no such account
+ */
+int
+flickcurl_async_get_account_sent(flickcurl* fc, int account)
+{
+  if(account < 0 || account > fc->async.accounts_count)
+    return -1;
+
+  return flickcurl_async_get_account(fc, account)->sent;
+}
+
+
+/*
+ * INTERNAL - free asynchronous call state; call handlers are not called
+ */
+void
+flickcurl_async_free(flickcurl* fc)
+{
+  flickcurl_async_state* as = &fc->async;
+  int i;
+
+  for(i = 0; i < as->accounts_count; i++)
+    free(as->accounts[i]);
+  if(as->accounts)
+    free(as->accounts);
+  as->accounts = NULL;
+  as->accounts_count = 0;
+
+#if LIBCURL_VERSION_NUM >= 0x071101
+  while(as->calls)
+    flickcurl_async_free_call(fc, as->calls);
+
+  if(as->multi) {
+    curl_multi_cleanup(as->multi);
+    as->multi = NULL;
+  }
+#endif
+}
+
+
+/*
+ * INTERNAL - start an invoke made by the builder of an asynchronous call
+ *
+ * Sets the call timing and retry count from the call's request for
+ * this invoke, if it has been made already.
+ */
+void
+flickcurl_async_begin_invoke(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_call* call = fc->async.call;
+  flickcurl_async_request* r;
+
+  /* the request after the last invoke's */
+  if(!call->invoke_index)
+    r = call->requests;
+  else
+    r = call->current ? call->current->next : NULL;
+  call->invoke_index++;
+  call->current = r;
+
+  fc->call_start_time = call->start_time;
+  fc->call_deadline = call->deadline;
+  fc->call_retries = r ? r->retries : 0;
+#endif
+}
+
+
+/*
+ * INTERNAL - perform the prepared request of an asynchronous call
+ *
+ * If the response for this invoke has arrived, it is passed to the
+ * header and content handlers as a transfer would be and the request
+ * handle is returned in @handle_p for reading the response
+ * information.  Otherwise the request is copied and queued and the
+ * call marked as waiting.
+ *
+ * Return value: libcurl result of the request
+ */
+CURLcode
+flickcurl_async_perform(flickcurl* fc, CURL** handle_p)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_call* call = as->call;
+  flickcurl_async_request* r = call->current;
+
+  *handle_p = fc->curl_handle;
+
+  if(r && r->state == FLICKCURL_ASYNC_REQUEST_DONE) {
+    size_t offset = 0;
+
+    while(offset < r->headers_len) {
+      const char* line = r->headers + offset;
+      const char* end = (const char*)memchr(line, '\n',
+                                            r->headers_len - offset);
+      size_t len = end ? (size_t)(end - line) + 1 : r->headers_len - offset;
+
+      flickcurl_header_content(fc, line, len);
+      offset += len;
+    }
+    if(r->content_len)
+      flickcurl_write_content(fc, r->content, r->content_len);
+
+    memcpy(fc->error_buffer, r->error_buffer, CURL_ERROR_SIZE);
+    *handle_p = r->handle;
+    return r->result;
+  }
+
+  /* a request not yet done means the builder made different calls */
+  if(r)
+    return CURLE_FAILED_INIT;
+
+  r = (flickcurl_async_request*)calloc(1, sizeof(*r));
+  if(!r)
+    return CURLE_OUT_OF_MEMORY;
+
+  r->handle = curl_easy_duphandle(fc->curl_handle);
+  if(!r->handle) {
+    free(r);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  r->call = call;
+  if(flickcurl_async_copy_params(fc, r)) {
+    flickcurl_async_free_request(fc, r);
+    return CURLE_OUT_OF_MEMORY;
+  }
+
+  curl_easy_setopt(r->handle, CURLOPT_PRIVATE, (char*)r);
+  curl_easy_setopt(r->handle, CURLOPT_WRITEFUNCTION,
+                   flickcurl_async_write_callback);
+  curl_easy_setopt(r->handle, CURLOPT_WRITEDATA, r);
+  curl_easy_setopt(r->handle, CURLOPT_HEADERFUNCTION,
+                   flickcurl_async_header_callback);
+  curl_easy_setopt(r->handle, CURLOPT_WRITEHEADER, r);
+  curl_easy_setopt(r->handle, CURLOPT_ERRORBUFFER, r->error_buffer);
+  /* the call timeout is set when the request is sent */
+  curl_easy_setopt(r->handle, CURLOPT_NOPROGRESS, 1L);
+
+  /* the header list and data are the invoke's and freed after it */
+  if(fc->http_accept)
+    r->slist = curl_slist_append(NULL, (const char*)fc->http_accept);
+  curl_easy_setopt(r->handle, CURLOPT_HTTPHEADER, r->slist);
+  if(fc->data) {
+    curl_easy_setopt(r->handle, CURLOPT_POSTFIELDSIZE, (long)fc->data_length);
+    curl_easy_setopt(r->handle, CURLOPT_COPYPOSTFIELDS, fc->data);
+  }
+
+  if(call->requests_tail)
+    call->requests_tail->next = r;
+  else
+    call->requests = r;
+  call->requests_tail = r;
+  call->current = r;
+
+  flickcurl_async_queue(fc, r);
+  as->deferred = 1;
+
+#ifdef FLICKCURL_DEBUG
+  fprintf(stderr, "Method %s queued for asynchronous transfer\n",
+          fc->method);
+#endif
+
+  return CURLE_ABORTED_BY_CALLBACK;
+#else
+  *handle_p = fc->curl_handle;
+  return CURLE_FAILED_INIT;
+#endif
+}
+
+
+/*
+ * INTERNAL - keep the response DOM of the current invoke for later
+ * runs of the builder
+ */
+void
+flickcurl_async_keep_doc(flickcurl* fc, xmlDocPtr doc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_request* r = fc->async.call->current;
+
+  if(r && !r->doc)
+    r->doc = flickcurl_share_doc(fc, doc);
+#endif
+}
+
+
+/*
+ * INTERNAL - get the response DOM kept by an earlier run of the
+ * builder for the current invoke
+ *
+ * The DOM becomes the session's current response as if it had just
+ * been parsed.
+ *
+ * Return value: DOM or NULL if the request must be performed
+ */
+xmlDocPtr
+flickcurl_async_reuse_doc(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_request* r = fc->async.call->current;
+
+  if(!r || !r->doc || r->state != FLICKCURL_ASYNC_REQUEST_DONE)
+    return NULL;
+
+  r->doc->usage++;
+  fc->shared_doc = r->doc;
+  return r->doc->doc;
+#else
+  return NULL;
+#endif
+}
+
+
+/*
+ * INTERNAL - send the request of the current invoke again after the
+ * retry delay rather than sleeping
+ */
+void
+flickcurl_async_retry(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_request* r = as->call->current;
+
+  r->retries++;
+  fc->total_retries++;
+
+  r->headers_len = 0;
+  r->content_len = 0;
+  r->not_before = flickcurl_get_time() + fc->retry_delay / 1000000.0;
+  flickcurl_async_queue(fc, r);
+
+  as->deferred = 1;
+#endif
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+
+#if LIBCURL_VERSION_NUM >= 0x071101
+static void
+async_test_socket_handler(void* user_data, int fd, int events)
+{
+}
+
+
+static void
+async_test_timer_handler(void* user_data, long timeout_ms)
+{
+}
+
+
+/* Queue a request for a new call of @account in @priority's lane */
+static flickcurl_async_request*
+async_test_queue(flickcurl* fc, int account, flickcurl_async_priority priority)
+{
+  flickcurl_async_state* as = &fc->async;
+  flickcurl_async_call* call;
+  flickcurl_async_request* r;
+
+  call = (flickcurl_async_call*)calloc(1, sizeof(*call));
+  r = (flickcurl_async_request*)calloc(1, sizeof(*r));
+  if(!call || !r) {
+    if(call)
+      free(call);
+    if(r)
+      free(r);
+    return NULL;
+  }
+
+  call->account = account;
+  call->priority = priority;
+  call->requests = r;
+  call->requests_tail = r;
+  call->next = as->calls;
+  if(as->calls)
+    as->calls->prev = call;
+  as->calls = call;
+  as->calls_count++;
+
+  r->call = call;
+  flickcurl_async_queue(fc, r);
+  return r;
+}
+
+
+/*
+ * Send the next request as flickcurl_async_start_requests() would
+ * but with no transfer; the request is left done
+ *
+ * Return value: account of the request sent or < 0 if none is ready
+ */
+static int
+async_test_send(flickcurl* fc, double now)
+{
+  flickcurl_async_request* r;
+
+  r = flickcurl_async_next_request(fc, now);
+  if(!r)
+    return -1;
+
+  flickcurl_async_dequeue(fc, r);
+  r->state = FLICKCURL_ASYNC_REQUEST_DONE;
+  return r->call->account;
+}
+#endif
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl *fc = NULL;
+  int failures = 0;
+#if LIBCURL_VERSION_NUM >= 0x071101
+  flickcurl_async_request* low;
+  flickcurl_async_request* r;
+  int a;
+  int b;
+  int c;
+  int sent[4];
+  int i;
+#endif
+
+  program = "flickcurl_async_test";
+
+  flickcurl_init();
+
+  fc = flickcurl_new();
+  if(!fc) {
+    failures++;
+    goto tidy;
+  }
+
+#if LIBCURL_VERSION_NUM >= 0x071101
+  if(flickcurl_set_async_handlers(fc, async_test_socket_handler,
+                                  async_test_timer_handler, NULL)) {
+    fprintf(stderr, "%s: FAIL\n  async handlers could not be set\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  a = flickcurl_async_add_account(fc, "token-a", "secret-a", 1);
+  b = flickcurl_async_add_account(fc, "token-b", "secret-b", 3);
+  c = flickcurl_async_add_account(fc, "token-c", "secret-c", 1);
+  if(a != 1 || b != 2 || c != 3) {
+    fprintf(stderr, "%s: FAIL\n  accounts numbered %d, %d, %d\n", program,
+            a, b, c);
+    failures++;
+    goto tidy;
+  }
+
+  /* a high priority request is sent before a low one queued earlier */
+  low = async_test_queue(fc, 0, FLICKCURL_ASYNC_PRIORITY_LOW);
+  r = async_test_queue(fc, 0, FLICKCURL_ASYNC_PRIORITY_HIGH);
+  if(!low || !r) {
+    failures++;
+    goto tidy;
+  }
+  if(flickcurl_async_next_request(fc, 0) != r) {
+    fprintf(stderr, "%s: FAIL\n  high priority request not sent first\n",
+            program);
+    failures++;
+  }
+  async_test_send(fc, 0);
+  if(flickcurl_async_next_request(fc, 0) != low) {
+    fprintf(stderr, "%s: FAIL\n  low priority request not sent next\n",
+            program);
+    failures++;
+  }
+  async_test_send(fc, 0);
+
+  /* a backlog of account a queued first is shared 1:3 with b */
+  for(i = 0; i < 10; i++) {
+    async_test_queue(fc, a, FLICKCURL_ASYNC_PRIORITY_HIGH);
+    async_test_queue(fc, b, FLICKCURL_ASYNC_PRIORITY_HIGH);
+  }
+  /* tags are the account's last tag plus the inverse of its weight */
+  for(r = fc->async.waiting; r; r = r->next_waiting) {
+    double expected = (r->call->account == a) ? 1.0 : 1.0 / 3;
+
+    if(r->next_waiting && r->next_waiting->next_waiting &&
+       r->next_waiting->next_waiting->call->account == r->call->account)
+      expected += r->finish;
+    else
+      break;
+    if(r->next_waiting->next_waiting->finish < expected - 1e-9 ||
+       r->next_waiting->next_waiting->finish > expected + 1e-9) {
+      fprintf(stderr, "%s: FAIL\n  account %d tag %g after %g\n", program,
+              r->call->account, r->next_waiting->next_waiting->finish,
+              r->finish);
+      failures++;
+      break;
+    }
+  }
+
+  /* after the one high priority request the virtual time is 1 so
+   * a's tags 2, 3, 4 and b's up to 4 are the first 12 sent */
+  memset(sent, '\0', sizeof(sent));
+  for(i = 0; i < 12; i++) {
+    int account = async_test_send(fc, 0);
+    if(account >= 0)
+      sent[account]++;
+  }
+  if(sent[a] != 3 || sent[b] != 9) {
+    fprintf(stderr, "%s: FAIL\n  first 12 sent %d of a and %d of b, "
+            "expected 3 and 9\n", program, sent[a], sent[b]);
+    failures++;
+  }
+  if(fc->async.vtime[FLICKCURL_ASYNC_PRIORITY_HIGH] < 4.0 - 1e-9 ||
+     fc->async.vtime[FLICKCURL_ASYNC_PRIORITY_HIGH] > 4.0 + 1e-9) {
+    fprintf(stderr, "%s: FAIL\n  virtual time %g, expected 4\n", program,
+            fc->async.vtime[FLICKCURL_ASYNC_PRIORITY_HIGH]);
+    failures++;
+  }
+
+  /* an idle account starts from the virtual time, not from 0 */
+  r = async_test_queue(fc, c, FLICKCURL_ASYNC_PRIORITY_HIGH);
+  if(!r || r->finish < 5.0 - 1e-9 || r->finish > 5.0 + 1e-9) {
+    fprintf(stderr, "%s: FAIL\n  idle account tag %g, expected 5\n",
+            program, r ? r->finish : -1.0);
+    failures++;
+  }
+
+  /* b's last tag 4.33 goes before a's 5 and c's 5 */
+  if(async_test_send(fc, 0) != b) {
+    fprintf(stderr, "%s: FAIL\n  b's last request not sent next\n",
+            program);
+    failures++;
+  }
+
+  /* a retry waiting for its delay is passed over until it is due */
+  r = async_test_queue(fc, 0, FLICKCURL_ASYNC_PRIORITY_HIGH);
+  if(r) {
+    r->not_before = 100.0;
+    memset(sent, '\0', sizeof(sent));
+    while((i = async_test_send(fc, 50.0)) >= 0)
+      sent[i]++;
+    if(sent[0] || sent[a] != 7 || sent[c] != 1 ||
+       flickcurl_async_next_request(fc, 100.0) != r) {
+      fprintf(stderr, "%s: FAIL\n  retry delay not kept\n", program);
+      failures++;
+    }
+  }
+
+  /* a request of a call past its deadline is taken first */
+  r = async_test_queue(fc, a, FLICKCURL_ASYNC_PRIORITY_LOW);
+  if(r) {
+    r->call->deadline = 10.0;
+    if(flickcurl_async_next_request(fc, 20.0) != r) {
+      fprintf(stderr, "%s: FAIL\n  late call not taken first\n", program);
+      failures++;
+    }
+  }
+
+  if(flickcurl_async_get_account_sent(fc, b) != 10) {
+    fprintf(stderr, "%s: FAIL\n  account b sent %d, expected 10\n", program,
+            flickcurl_async_get_account_sent(fc, b));
+    failures++;
+  }
+#endif
+
+  tidy:
+  if(fc)
+    flickcurl_free(fc);
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
@@ -0,0 +1,504 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * coalesce.c - Flickcurl coalescing of identical read requests
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * A coalescer is shared by flickcurl sessions running in different
+ * threads.  It holds a table of the read requests in flight, keyed
+ * by the service URI and the sorted request parameters without the
+ * ones that change on every request (OAuth nonce, timestamp and
+ * signatures).  The credentials stay in the key so different users
+ * never share responses.
+ *
+ * The first session to make a request is the leader: it sends it as
+ * usual and also saves the response header lines and content into
+ * the flight.  A session making the same request meanwhile waits for
+ * the leader to finish and then feeds the saved response through its
+ * own header and content handlers, so it parses and builds its own
+ * result objects that it owns and frees as usual.  If the leader's
+ * transfer fails or it gets an HTTP error status, each waiter sends
+ * the request itself so the retry policy applies to it.
+ *
+ * A flight is removed from the table when the leader finishes, so a
+ * request made after that is sent again: this is not a cache.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* Longest wait for a leader so that a cancel is noticed promptly */
+#define FLICKCURL_COALESCE_WAIT_SLICE_USEC 20000
+
+
+/* One request in flight */
+struct flickcurl_coalesce_flight_s {
+  char* key;
+  /* sessions using the flight: the leader and the waiters */
+  int usage;
+  /* non-0 when the leader's transfer has ended */
+  int done;
+  /* non-0 when the response can be used by the waiters */
+  int ok;
+
+  /* response header lines and content */
+  char* headers;
+  size_t headers_len;
+  size_t headers_size;
+  char* content;
+  size_t content_len;
+  size_t content_size;
+  /* non-0 if saving the response ran out of memory */
+  int failed;
+
+  struct flickcurl_coalesce_flight_s* next;
+};
+
+
+struct flickcurl_coalescer_s {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+  /* signalled when a flight is done */
+  pthread_cond_t done;
+#endif
+  /* requests in flight */
+  flickcurl_coalesce_flight* flights;
+};
+
+
+/**
+ * flickcurl_new_coalescer:
+ *
+ * Create a coalescer of identical read requests
+ *
+ * Set the coalescer on several flickcurl sessions, usually used from
+ * different threads, with flickcurl_set_coalescer().  When a session
+ * makes a read web service call while another session is making the
+ * same request, it waits for that response and uses it instead of
+ * sending its own.  Each session still parses the response and
+ * returns its own result.
+ *
+ * Coalescing needs POSIX threads.
+ *
+ * Return value: new coalescer or NULL on failure
+ */
+flickcurl_coalescer*
+flickcurl_new_coalescer(void)
+{
+#ifdef HAVE_PTHREAD
+  flickcurl_coalescer* co;
+
+  co = (flickcurl_coalescer*)calloc(1, sizeof(*co));
+  if(!co)
+    return NULL;
+
+  if(pthread_mutex_init(&co->lock, NULL)) {
+    free(co);
+    return NULL;
+  }
+  if(pthread_cond_init(&co->done, NULL)) {
+    pthread_mutex_destroy(&co->lock);
+    free(co);
+    return NULL;
+  }
+
+  return co;
+#else
+  return NULL;
+#endif
+}
+
+
+/**
+ * flickcurl_free_coalescer:
+ * @co: coalescer
+ *
+ * Destructor for a coalescer
+ *
+ * No session may still be making a call with the coalescer.
+ */
+void
+flickcurl_free_coalescer(flickcurl_coalescer* co)
+{
+  if(!co)
+    return;
+
+#ifdef HAVE_PTHREAD
+  pthread_cond_destroy(&co->done);
+  pthread_mutex_destroy(&co->lock);
+#endif
+  free(co);
+}
+
+
+/**
+ * flickcurl_set_coalescer:
+ * @fc: flickcurl object
+ * @co: coalescer or NULL to stop coalescing
+ *
+ * Set the coalescer for the session's read web service calls
+ *
+ * See flickcurl_new_coalescer().  Writes and uploads are never
+ * coalesced and neither are asynchronous calls.
+ */
+void
+flickcurl_set_coalescer(flickcurl* fc, flickcurl_coalescer* co)
+{
+  fc->coalescer = co;
+}
+
+
+/**
+ * flickcurl_get_coalesced_count:
+ * @fc: flickcurl object
+ *
+ * Get the number of requests answered by another session's response
+ *
+ * Return value: number of coalesced requests in the session
+ */
+int
+flickcurl_get_coalesced_count(flickcurl* fc)
+{
+  return fc->coalesced_count;
+}
+
+
+#ifdef HAVE_PTHREAD
+static int
+flickcurl_coalesce_compare_params(const void* a, const void* b)
+{
+  const char** pa = *(const char***)a;
+  const char** pb = *(const char***)b;
+  int rc;
+
+  rc = strcmp(pa[0], pb[0]);
+  if(!rc)
+    rc = strcmp(pa[1] ? pa[1] : "", pb[1] ? pb[1] : "");
+  return rc;
+}
+
+
+/* Return non-0 if parameter @name changes on every request */
+static int
+flickcurl_coalesce_param_varies(const char* name)
+{
+  return (!strcmp(name, "oauth_nonce") ||
+          !strcmp(name, "oauth_timestamp") ||
+          !strcmp(name, "oauth_signature") ||
+          !strcmp(name, "api_sig"));
+}
+
+
+/*
+ * Make the key of the prepared request: the URI before any query and
+ * the sorted parameters that do not change between requests
+ *
+ * Return value: new key or NULL on failure
+ */
+static char*
+flickcurl_coalesce_key(flickcurl* fc)
+{
+  const char** params[FLICKCURL_TOTAL_PARAM_COUNT];
+  const char* query;
+  size_t uri_len;
+  size_t len;
+  char* key;
+  char* p;
+  int count = 0;
+  int i;
+
+  query = strchr(fc->uri, '?');
+  uri_len = query ? (size_t)(query - fc->uri) : strlen(fc->uri);
+
+  len = uri_len + 1;
+  for(i = 0; i < fc->count; i++) {
+    if(flickcurl_coalesce_param_varies(fc->parameters[i][0]))
+      continue;
+    params[count++] = fc->parameters[i];
+    len += strlen(fc->parameters[i][0]) + 2;
+    if(fc->parameters[i][1])
+      len += strlen(fc->parameters[i][1]);
+  }
+
+  qsort(params, count, sizeof(params[0]),
+        flickcurl_coalesce_compare_params);
+
+  key = (char*)malloc(len + 1);
+  if(!key)
+    return NULL;
+
+  memcpy(key, fc->uri, uri_len);
+  p = key + uri_len;
+  *p++ = '?';
+  for(i = 0; i < count; i++) {
+    size_t l = strlen(params[i][0]);
+
+    memcpy(p, params[i][0], l);
+    p += l;
+    *p++ = '=';
+    if(params[i][1]) {
+      l = strlen(params[i][1]);
+      memcpy(p, params[i][1], l);
+      p += l;
+    }
+    *p++ = '&';
+  }
+  *p = '\0';
+
+  return key;
+}
+
+
+/* Release the session's use of @flight; call with the lock held */
+static void
+flickcurl_coalesce_release(flickcurl_coalesce_flight* flight)
+{
+  if(--flight->usage)
+    return;
+
+  if(flight->headers)
+    free(flight->headers);
+  if(flight->content)
+    free(flight->content);
+  free(flight->key);
+  free(flight);
+}
+
+
+static void
+flickcurl_coalesce_append(flickcurl_coalesce_flight* flight,
+                          char** buffer_p, size_t* len_p, size_t* size_p,
+                          const char* ptr, size_t len)
+{
+  if(flight->failed)
+    return;
+
+  if(*len_p + len > *size_p) {
+    size_t size = *size_p ? *size_p : 1024;
+    char* buffer;
+
+    while(size < *len_p + len)
+      size <<= 1;
+    buffer = (char*)realloc(*buffer_p, size);
+    if(!buffer) {
+      flight->failed = 1;
+      return;
+    }
+    *buffer_p = buffer;
+    *size_p = size;
+  }
+
+  memcpy(*buffer_p + *len_p, ptr, len);
+  *len_p += len;
+}
+
+
+/*
+ * Wait for the leader of @flight to finish; call with the lock held
+ *
+ * Return value: non-0 if the call was cancelled or passed its deadline
+ */
+static int
+flickcurl_coalesce_wait(flickcurl* fc, flickcurl_coalesce_flight* flight)
+{
+  flickcurl_coalescer* co = fc->coalescer;
+
+  while(!flight->done) {
+    struct timeval now;
+    struct timespec until;
+    long usec;
+
+    if(fc->cancelled ||
+       (fc->call_deadline && flickcurl_get_time() >= fc->call_deadline))
+      return 1;
+
+    gettimeofday(&now, NULL);
+    usec = now.tv_usec + FLICKCURL_COALESCE_WAIT_SLICE_USEC;
+    until.tv_sec = now.tv_sec + usec / 1000000;
+    until.tv_nsec = 1000 * (usec % 1000000);
+    pthread_cond_timedwait(&co->done, &co->lock, &until);
+  }
+
+  return 0;
+}
+#endif
+
+
+/*
+ * INTERNAL - save response header or content bytes for coalesced
+ * requests while leading a flight
+ */
+void
+flickcurl_coalesce_content(flickcurl* fc, int header, const char* ptr,
+                           size_t len)
+{
+#ifdef HAVE_PTHREAD
+  flickcurl_coalesce_flight* flight = fc->coalesce_flight;
+
+  if(header)
+    flickcurl_coalesce_append(flight, &flight->headers, &flight->headers_len,
+                              &flight->headers_size, ptr, len);
+  else
+    flickcurl_coalesce_append(flight, &flight->content, &flight->content_len,
+                              &flight->content_size, ptr, len);
+#endif
+}
+
+
+/*
+ * INTERNAL - perform the prepared read request or use the response
+ * of the same request made by another session
+ *
+ * When the response of another session is used, fc->coalesced is set
+ * and *@handle_p is the session's handle which was not used.
+ *
+ * Return value: libcurl result of the request
+ */
+CURLcode
+flickcurl_coalesce_perform(flickcurl* fc, int hedge, CURL** handle_p)
+{
+#ifdef HAVE_PTHREAD
+  flickcurl_coalescer* co = fc->coalescer;
+  flickcurl_coalesce_flight* flight;
+  char* key;
+  CURLcode rc;
+  long status = 0;
+
+  fc->coalesced = 0;
+
+  key = flickcurl_coalesce_key(fc);
+  if(!key)
+    return flickcurl_hedge_perform(fc, hedge, handle_p);
+
+  pthread_mutex_lock(&co->lock);
+
+  for(flight = co->flights; flight; flight = flight->next) {
+    if(!strcmp(flight->key, key))
+      break;
+  }
+
+  if(flight) {
+    int stopped;
+
+    free(key);
+    flight->usage++;
+    stopped = flickcurl_coalesce_wait(fc, flight);
+    if(!stopped && flight->ok) {
+      size_t offset = 0;
+
+      /* the flight is done so its response no longer changes */
+      pthread_mutex_unlock(&co->lock);
+
+      while(offset < flight->headers_len) {
+        const char* line = flight->headers + offset;
+        const char* end = (const char*)memchr(line, '\n',
+                                              flight->headers_len - offset);
+        size_t len = end ? (size_t)(end - line) + 1 :
+                     flight->headers_len - offset;
+
+        flickcurl_header_content(fc, line, len);
+        offset += len;
+      }
+      if(flight->content_len)
+        flickcurl_write_content(fc, flight->content, flight->content_len);
+
+      pthread_mutex_lock(&co->lock);
+      flickcurl_coalesce_release(flight);
+      pthread_mutex_unlock(&co->lock);
+
+      fc->coalesced = 1;
+      fc->coalesced_count++;
+      *handle_p = fc->curl_handle;
+      return CURLE_OK;
+    }
+
+    flickcurl_coalesce_release(flight);
+    pthread_mutex_unlock(&co->lock);
+
+    if(stopped) {
+      *handle_p = fc->curl_handle;
+      return CURLE_ABORTED_BY_CALLBACK;
+    }
+
+    /* the leader failed so make the request */
+    return flickcurl_hedge_perform(fc, hedge, handle_p);
+  }
+
+  flight = (flickcurl_coalesce_flight*)calloc(1, sizeof(*flight));
+  if(!flight) {
+    pthread_mutex_unlock(&co->lock);
+    free(key);
+    return flickcurl_hedge_perform(fc, hedge, handle_p);
+  }
+  flight->key = key;
+  flight->usage = 1;
+  flight->next = co->flights;
+  co->flights = flight;
+
+  pthread_mutex_unlock(&co->lock);
+
+  /* lead: the content handlers save the response into the flight */
+  fc->coalesce_flight = flight;
+  rc = flickcurl_hedge_perform(fc, hedge, handle_p);
+  fc->coalesce_flight = NULL;
+
+  if(rc == CURLE_OK)
+    curl_easy_getinfo(*handle_p, CURLINFO_RESPONSE_CODE, &status);
+
+  pthread_mutex_lock(&co->lock);
+
+  if(co->flights == flight)
+    co->flights = flight->next;
+  else {
+    flickcurl_coalesce_flight* prev;
+
+    for(prev = co->flights; prev->next != flight; prev = prev->next)
+      ;
+    prev->next = flight->next;
+  }
+
+  flight->done = 1;
+  flight->ok = (rc == CURLE_OK && status == 200 && !flight->failed);
+  pthread_cond_broadcast(&co->done);
+  flickcurl_coalesce_release(flight);
+
+  pthread_mutex_unlock(&co->lock);
+
+  return rc;
+#else
+  fc->coalesced = 0;
+  return flickcurl_hedge_perform(fc, hedge, handle_p);
+#endif
+}
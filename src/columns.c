@@ -0,0 +1,619 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * columns.c - Flickcurl photo lists stored as columns
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * A columns object holds one array per requested photo field, with a
+ * value slot per photo, plus a bitmap of which photos have a value.
+ * Integers and booleans are stored as int, times as time_t, floats as
+ * double and strings as offsets into one string heap shared by all
+ * the columns, which also holds the photo IDs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define FLICKCURL_COLUMNS_INITIAL_HEAP_SIZE 4096
+
+
+typedef struct {
+  flickcurl_photo_field_type field;
+  /* VALUE_TYPE_INTEGER, _BOOLEAN, _DATETIME, _FLOAT or _STRING */
+  flickcurl_field_value_type type;
+  union {
+    int* integers;
+    time_t* times;
+    double* floats;
+    size_t* strings;
+  } values;
+  /* bit per row set if the row has a value */
+  unsigned char* present;
+} flickcurl_photo_column;
+
+
+struct flickcurl_photo_columns_s {
+  int rows;
+  int rows_size;
+
+  /* heap offset of each row's photo ID */
+  size_t* ids;
+
+  int columns_count;
+  flickcurl_photo_column* columns;
+  /* index into @columns for each field or -1 */
+  int index[PHOTO_FIELD_LAST + 1];
+
+  char* heap;
+  size_t heap_used;
+  size_t heap_size;
+};
+
+
+/**
+ * flickcurl_set_photo_columns:
+ * @fc: flickcurl object
+ * @fields: array of photo fields ending with PHOTO_FIELD_none or NULL
+ *
+ * Set photo lists to be returned as columns of the given fields
+ *
+ * Photo lists such as from flickcurl_photos_search_params() then have
+ * no #flickcurl_photo objects (@photos is empty) and instead return the
+ * photo IDs and the values of just the given fields in @columns.
+ * See flickcurl_photo_columns_get_string() and the other accessors.
+ * This takes much less memory than building photos for lists of
+ * many photos.  The array is copied and repeated fields are ignored.
+ * Passing NULL returns to building photos.
+ *
+ * The calls that return only an array of photos, such as
+ * flickcurl_photos_search(), fail while columns are set.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_photo_columns(flickcurl* fc,
+                            const flickcurl_photo_field_type* fields)
+{
+  int count;
+  int i;
+
+  if(fc->photo_columns) {
+    free(fc->photo_columns);
+    fc->photo_columns = NULL;
+  }
+
+  if(!fields)
+    return 0;
+
+  for(count = 0; fields[count] != PHOTO_FIELD_none; count++) {
+    if(fields[count] < PHOTO_FIELD_FIRST || fields[count] > PHOTO_FIELD_LAST) {
+      flickcurl_error(fc, "Invalid photo field %d", (int)fields[count]);
+      return 1;
+    }
+  }
+
+  fc->photo_columns = (flickcurl_photo_field_type*)malloc((count + 1) * sizeof(*fields));
+  if(!fc->photo_columns)
+    return 1;
+
+  for(i = 0; i <= count; i++)
+    fc->photo_columns[i] = fields[i];
+
+  return 0;
+}
+
+
+/*
+ * flickcurl_new_photo_columns:
+ * @fc: flickcurl object
+ * @rows: most photos that will be added
+ * @types: value type of each photo field
+ *
+ * INTERNAL - Constructor for columns of the session's photo columns fields
+ *
+ * Return value: new columns object or NULL on failure
+ */
+flickcurl_photo_columns*
+flickcurl_new_photo_columns(flickcurl* fc, int rows,
+                            const flickcurl_field_value_type* types)
+{
+  flickcurl_photo_columns* pc;
+  size_t bitmap_size = (rows + 7) / 8;
+  int i;
+
+  pc = (flickcurl_photo_columns*)calloc(1, sizeof(*pc));
+  if(!pc)
+    return NULL;
+
+  for(i = 0; i <= PHOTO_FIELD_LAST; i++)
+    pc->index[i] = -1;
+
+  for(i = 0; fc->photo_columns[i] != PHOTO_FIELD_none; i++)
+    ;
+  pc->columns = (flickcurl_photo_column*)calloc(i + 1, sizeof(*pc->columns));
+  pc->ids = (size_t*)malloc((rows + 1) * sizeof(size_t));
+  pc->heap_size = FLICKCURL_COLUMNS_INITIAL_HEAP_SIZE;
+  pc->heap = (char*)malloc(pc->heap_size);
+  if(!pc->columns || !pc->ids || !pc->heap)
+    goto failed;
+  pc->rows_size = rows;
+
+  for(i = 0; fc->photo_columns[i] != PHOTO_FIELD_none; i++) {
+    flickcurl_photo_field_type field = fc->photo_columns[i];
+    flickcurl_photo_column* column;
+    size_t value_size;
+
+    if(pc->index[field] >= 0)
+      continue;
+
+    column = &pc->columns[pc->columns_count];
+    column->field = field;
+    switch(types[field]) {
+      case VALUE_TYPE_BOOLEAN:
+      case VALUE_TYPE_INTEGER:
+        column->type = types[field];
+        value_size = sizeof(int);
+        break;
+
+      case VALUE_TYPE_UNIXTIME:
+      case VALUE_TYPE_DATETIME:
+        column->type = VALUE_TYPE_DATETIME;
+        value_size = sizeof(time_t);
+        break;
+
+      case VALUE_TYPE_FLOAT:
+        column->type = VALUE_TYPE_FLOAT;
+        value_size = sizeof(double);
+        break;
+
+      case VALUE_TYPE_NONE:
+      case VALUE_TYPE_PHOTO_ID:
+      case VALUE_TYPE_PHOTO_URI:
+      case VALUE_TYPE_MEDIA_TYPE:
+      case VALUE_TYPE_TAG_STRING:
+      case VALUE_TYPE_COLLECTION_ID:
+      case VALUE_TYPE_ICON_PHOTOS:
+      case VALUE_TYPE_PERSON_ID:
+      case VALUE_TYPE_STRING:
+      case VALUE_TYPE_URI:
+      default:
+        column->type = VALUE_TYPE_STRING;
+        value_size = sizeof(size_t);
+        break;
+    }
+
+    /* the union members all alias the same allocation */
+    column->values.strings = (size_t*)malloc((rows + 1) * value_size);
+    column->present = (unsigned char*)calloc(bitmap_size + 1, 1);
+    if(!column->values.strings || !column->present) {
+      pc->columns_count++;
+      goto failed;
+    }
+
+    pc->index[field] = pc->columns_count++;
+  }
+
+  return pc;
+
+  failed:
+  flickcurl_free_photo_columns(pc);
+  return NULL;
+}
+
+
+/**
+ * flickcurl_free_photo_columns:
+ * @columns: photo columns object
+ *
+ * Destructor for photo columns
+ */
+void
+flickcurl_free_photo_columns(flickcurl_photo_columns* columns)
+{
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(columns, flickcurl_photo_columns);
+
+  if(columns->columns) {
+    for(i = 0; i < columns->columns_count; i++) {
+      if(columns->columns[i].values.strings)
+        free(columns->columns[i].values.strings);
+      if(columns->columns[i].present)
+        free(columns->columns[i].present);
+    }
+    free(columns->columns);
+  }
+  if(columns->ids)
+    free(columns->ids);
+  if(columns->heap)
+    free(columns->heap);
+  free(columns);
+}
+
+
+/* Return value: heap offset of a copy of @len bytes of @value or
+ * (size_t)-1 on failure */
+static size_t
+flickcurl_photo_columns_add_string(flickcurl_photo_columns* pc,
+                                   const char* value, size_t len)
+{
+  size_t offset;
+
+  if(pc->heap_used + len + 1 > pc->heap_size) {
+    size_t new_size = pc->heap_size * 2;
+    char* new_heap;
+
+    while(pc->heap_used + len + 1 > new_size)
+      new_size *= 2;
+    new_heap = (char*)realloc(pc->heap, new_size);
+    if(!new_heap)
+      return (size_t)-1;
+    pc->heap = new_heap;
+    pc->heap_size = new_size;
+  }
+
+  offset = pc->heap_used;
+  memcpy(pc->heap + offset, value, len);
+  pc->heap[offset + len] = '\0';
+  pc->heap_used += len + 1;
+
+  return offset;
+}
+
+
+/*
+ * flickcurl_photo_columns_add_row:
+ * @pc: photo columns object
+ * @id: photo ID
+ *
+ * INTERNAL - Add a photo with no field values
+ *
+ * Return value: the new row or <0 on failure
+ */
+int
+flickcurl_photo_columns_add_row(flickcurl_photo_columns* pc, const char* id)
+{
+  size_t offset;
+
+  if(pc->rows == pc->rows_size)
+    return -1;
+
+  offset = flickcurl_photo_columns_add_string(pc, id, strlen(id));
+  if(offset == (size_t)-1)
+    return -1;
+
+  pc->ids[pc->rows] = offset;
+
+  return pc->rows++;
+}
+
+
+/*
+ * flickcurl_photo_columns_decode_date:
+ * @value: date string
+ *
+ * INTERNAL - Decode a date as curl_getdate() does, also allowing the
+ * "YYYY-MM-DD HH:MM:SS" form of taken dates that it does not read.
+ *
+ * Return value: unix time or <0 on failure
+ */
+time_t
+flickcurl_photo_columns_decode_date(const char* value)
+{
+  time_t unix_time;
+  char compact[20];
+
+  unix_time = curl_getdate(value, NULL);
+  if(unix_time >= 0)
+    return unix_time;
+
+  /* rewrite as "YYYYMMDD HH:MM:SS" */
+  if(strlen(value) != 19 || value[4] != '-' || value[7] != '-' ||
+     value[10] != ' ')
+    return -1;
+  memcpy(compact, value, 4);
+  memcpy(compact + 4, value + 5, 2);
+  memcpy(compact + 6, value + 8, 11);
+  compact[17] = '\0';
+
+  return curl_getdate(compact, NULL);
+}
+
+
+/*
+ * flickcurl_photo_columns_set_value:
+ * @pc: photo columns object
+ * @row: row
+ * @field: photo field with a column
+ * @datatype: type of @value as in the photo fields table
+ * @value: value string
+ *
+ * INTERNAL - Decode a field value into its column
+ *
+ * Values that do not decode, such as bad dates, are not set.  Unlike
+ * photos, taken dates in the "YYYY-MM-DD HH:MM:SS" form are decoded.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_photo_columns_set_value(flickcurl_photo_columns* pc, int row,
+                                  flickcurl_photo_field_type field,
+                                  flickcurl_field_value_type datatype,
+                                  const char* value)
+{
+  flickcurl_photo_column* column = &pc->columns[pc->index[field]];
+  time_t unix_time;
+  size_t offset;
+
+  switch(column->type) {
+    case VALUE_TYPE_BOOLEAN:
+    case VALUE_TYPE_INTEGER:
+      /* skip setting field with a boolean value '' */
+      if(!*value && datatype == VALUE_TYPE_BOOLEAN)
+        return 0;
+      column->values.integers[row] = atoi(value);
+      break;
+
+    case VALUE_TYPE_DATETIME:
+      if(datatype == VALUE_TYPE_UNIXTIME)
+        unix_time = atoi(value);
+      else
+        unix_time = flickcurl_photo_columns_decode_date(value);
+      if(unix_time < 0)
+        return 0;
+      column->values.times[row] = unix_time;
+      break;
+
+    case VALUE_TYPE_FLOAT:
+      column->values.floats[row] = atof(value);
+      break;
+
+    case VALUE_TYPE_NONE:
+    case VALUE_TYPE_PHOTO_ID:
+    case VALUE_TYPE_PHOTO_URI:
+    case VALUE_TYPE_UNIXTIME:
+    case VALUE_TYPE_STRING:
+    case VALUE_TYPE_URI:
+    case VALUE_TYPE_MEDIA_TYPE:
+    case VALUE_TYPE_TAG_STRING:
+    case VALUE_TYPE_COLLECTION_ID:
+    case VALUE_TYPE_ICON_PHOTOS:
+    case VALUE_TYPE_PERSON_ID:
+    default:
+      offset = flickcurl_photo_columns_add_string(pc, value, strlen(value));
+      if(offset == (size_t)-1)
+        return 1;
+      column->values.strings[row] = offset;
+      break;
+  }
+
+  column->present[row / 8] |= (unsigned char)(1 << (row % 8));
+
+  return 0;
+}
+
+
+/* Return value: column of @field that has a value in @row or NULL */
+static flickcurl_photo_column*
+flickcurl_photo_columns_get_cell(flickcurl_photo_columns* columns, int row,
+                                 flickcurl_photo_field_type field)
+{
+  flickcurl_photo_column* column;
+
+  if(row < 0 || row >= columns->rows ||
+     field < PHOTO_FIELD_FIRST || field > PHOTO_FIELD_LAST ||
+     columns->index[field] < 0)
+    return NULL;
+
+  column = &columns->columns[columns->index[field]];
+  if(!(column->present[row / 8] & (1 << (row % 8))))
+    return NULL;
+
+  return column;
+}
+
+
+/**
+ * flickcurl_photo_columns_get_rows_count:
+ * @columns: photo columns object
+ *
+ * Get the number of photos in photo columns
+ *
+ * Return value: number of photos (rows)
+ */
+int
+flickcurl_photo_columns_get_rows_count(flickcurl_photo_columns* columns)
+{
+  return columns->rows;
+}
+
+
+/**
+ * flickcurl_photo_columns_get_id:
+ * @columns: photo columns object
+ * @row: photo row from 0
+ *
+ * Get the ID of a photo in photo columns
+ *
+ * Return value: shared photo ID string or NULL if @row is out of range
+ */
+const char*
+flickcurl_photo_columns_get_id(flickcurl_photo_columns* columns, int row)
+{
+  if(row < 0 || row >= columns->rows)
+    return NULL;
+
+  return columns->heap + columns->ids[row];
+}
+
+
+/**
+ * flickcurl_photo_columns_get_field_type:
+ * @columns: photo columns object
+ * @field: photo field
+ *
+ * Get the value type of a column in photo columns
+ *
+ * The type is #VALUE_TYPE_INTEGER or #VALUE_TYPE_BOOLEAN for values
+ * read with flickcurl_photo_columns_get_integer(),
+ * #VALUE_TYPE_DATETIME for flickcurl_photo_columns_get_time(),
+ * #VALUE_TYPE_FLOAT for flickcurl_photo_columns_get_float() and
+ * #VALUE_TYPE_STRING for flickcurl_photo_columns_get_string().
+ *
+ * Return value: value type or #VALUE_TYPE_NONE if @field is not a column
+ */
+flickcurl_field_value_type
+flickcurl_photo_columns_get_field_type(flickcurl_photo_columns* columns,
+                                       flickcurl_photo_field_type field)
+{
+  if(field < PHOTO_FIELD_FIRST || field > PHOTO_FIELD_LAST ||
+     columns->index[field] < 0)
+    return VALUE_TYPE_NONE;
+
+  return columns->columns[columns->index[field]].type;
+}
+
+
+/**
+ * flickcurl_photo_columns_has_value:
+ * @columns: photo columns object
+ * @row: photo row from 0
+ * @field: photo field
+ *
+ * Check if a photo in photo columns has a value for a field
+ *
+ * Return value: non-0 if the photo has a value
+ */
+int
+flickcurl_photo_columns_has_value(flickcurl_photo_columns* columns, int row,
+                                  flickcurl_photo_field_type field)
+{
+  return flickcurl_photo_columns_get_cell(columns, row, field) != NULL;
+}
+
+
+/**
+ * flickcurl_photo_columns_get_string:
+ * @columns: photo columns object
+ * @row: photo row from 0
+ * @field: photo field of a #VALUE_TYPE_STRING column
+ *
+ * Get a string field of a photo in photo columns
+ *
+ * Return value: shared string or NULL if the photo has no value
+ */
+const char*
+flickcurl_photo_columns_get_string(flickcurl_photo_columns* columns, int row,
+                                   flickcurl_photo_field_type field)
+{
+  flickcurl_photo_column* column;
+
+  column = flickcurl_photo_columns_get_cell(columns, row, field);
+  if(!column || column->type != VALUE_TYPE_STRING)
+    return NULL;
+
+  return columns->heap + column->values.strings[row];
+}
+
+
+/**
+ * flickcurl_photo_columns_get_integer:
+ * @columns: photo columns object
+ * @row: photo row from 0
+ * @field: photo field of a #VALUE_TYPE_INTEGER or #VALUE_TYPE_BOOLEAN column
+ *
+ * Get an integer or boolean field of a photo in photo columns
+ *
+ * Return value: value or -1 if the photo has no value
+ */
+int
+flickcurl_photo_columns_get_integer(flickcurl_photo_columns* columns, int row,
+                                    flickcurl_photo_field_type field)
+{
+  flickcurl_photo_column* column;
+
+  column = flickcurl_photo_columns_get_cell(columns, row, field);
+  if(!column ||
+     (column->type != VALUE_TYPE_INTEGER && column->type != VALUE_TYPE_BOOLEAN))
+    return -1;
+
+  return column->values.integers[row];
+}
+
+
+/**
+ * flickcurl_photo_columns_get_time:
+ * @columns: photo columns object
+ * @row: photo row from 0
+ * @field: photo field of a #VALUE_TYPE_DATETIME column
+ *
+ * Get a date field of a photo in photo columns
+ *
+ * Return value: unix time or -1 if the photo has no value
+ */
+time_t
+flickcurl_photo_columns_get_time(flickcurl_photo_columns* columns, int row,
+                                 flickcurl_photo_field_type field)
+{
+  flickcurl_photo_column* column;
+
+  column = flickcurl_photo_columns_get_cell(columns, row, field);
+  if(!column || column->type != VALUE_TYPE_DATETIME)
+    return (time_t)-1;
+
+  return column->values.times[row];
+}
+
+
+/**
+ * flickcurl_photo_columns_get_float:
+ * @columns: photo columns object
+ * @row: photo row from 0
+ * @field: photo field of a #VALUE_TYPE_FLOAT column
+ *
+ * Get a floating point field of a photo in photo columns
+ *
+ * Use flickcurl_photo_columns_has_value() to tell a value of 0.0
+ * from a missing one.
+ *
+ * Return value: value or 0.0 if the photo has no value
+ */
+double
+flickcurl_photo_columns_get_float(flickcurl_photo_columns* columns, int row,
+                                  flickcurl_photo_field_type field)
+{
+  flickcurl_photo_column* column;
+
+  column = flickcurl_photo_columns_get_cell(columns, row, field);
+  if(!column || column->type != VALUE_TYPE_FLOAT)
+    return 0.0;
+
+  return column->values.floats[row];
+}
@@ -85,6 +85,10 @@ static void
 flickcurl_error_varargs(flickcurl* fc, const char *message, 
                         va_list arguments)
 {
+  /* failures of a builder left waiting for a response are expected */
+  if(fc && fc->async.deferred)
+    return;
+
   if(fc && fc->error_handler) {
     char *buffer = my_vsnprintf(message, arguments);
     if(!buffer) {
@@ -112,17 +116,22 @@ flickcurl_error(flickcurl* fc, const char *message, ...)
 }
 
   
-static size_t
-flickcurl_write_callback(void *ptr, size_t size, size_t nmemb, 
-                         void *userdata) 
+/*
+ * INTERNAL - handle @len bytes of response content
+ *
+ * Return value: @len or 0 to abort the transfer
+ */
+size_t
+flickcurl_write_content(flickcurl* fc, const char* ptr, size_t len)
 {
-  flickcurl* fc = (flickcurl*)userdata;
-  int len = size*nmemb;
   int rc = 0;
   
   if(fc->failed)
     return 0;
 
+  if(fc->coalesce_flight)
+    flickcurl_coalesce_content(fc, 0, ptr, len);
+
   fc->total_bytes += len;
 
   if(fc->save_content) {
@@ -150,25 +159,41 @@ flickcurl_write_callback(void *ptr, size_t size, size_t nmemb,
       
   }
   
-  if(fc->xml_parse_content) {
-    if(!fc->xc) {
-      xmlParserCtxtPtr xc;
+  if(fc->xml_parse_content && fc->json_call) {
+    if(!fc->jp) {
+      fc->jp = flickcurl_new_json_parser(fc, fc->uri);
+      if(fc->jp && fc->json_photos_name)
+        flickcurl_json_parser_build_photos(fc->jp, fc->json_photos_name);
+    }
 
-      xc = xmlCreatePushParserCtxt(NULL, NULL,
-                                   (const char*)ptr, len,
-                                   (const char*)fc->uri);
-      if(!xc)
-        rc = 1;
-      else {
-        xc->replaceEntities = 1;
-        xc->loadsubset = 1;
+    /* parse errors are reported by the JSON parser */
+    if(!fc->jp)
+      flickcurl_error(fc, "Out of memory");
+    else
+      flickcurl_json_parser_parse_chunk(fc->jp, (const char*)ptr, len);
+  } else if(fc->xml_parse_content) {
+    if(!fc->xc_active) {
+      if(!fc->xc) {
+        fc->xc = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0,
+                                         (const char*)fc->uri);
+        /* Flickr responses have no DTD: fetch nothing from the
+         * network and do not substitute entities a response declares */
+        if(fc->xc)
+          xmlCtxtUseOptions(fc->xc, XML_PARSE_NONET | XML_PARSE_COMPACT);
       }
-      fc->xc = xc;
+
+      /* start a new document keeping the parser's dictionary */
+      if(!fc->xc ||
+         xmlCtxtResetPush(fc->xc, (const char*)ptr, len,
+                          (const char*)fc->uri, NULL))
+        rc = 1;
+      else
+        fc->xc_active = 1;
     } else
       rc = xmlParseChunk(fc->xc, (const char*)ptr, len, 0);
 
 #if FLICKCURL_DEBUG > 1
-    fprintf(stderr, "Got >>%s<< (%d bytes)\n", (const char*)ptr, len);
+    fprintf(stderr, "Got >>%s<< (%d bytes)\n", (const char*)ptr, (int)len);
 #endif
 
     if(rc)
@@ -177,12 +202,26 @@ flickcurl_write_callback(void *ptr, size_t size, size_t nmemb,
 
 #ifdef CAPTURE
   if(fc->fh)
-    fwrite(ptr, size, nmemb, fc->fh);
+    fwrite(ptr, 1, len, fc->fh);
 #endif
   return len;
 }
 
 
+static size_t
+flickcurl_write_callback(void *ptr, size_t size, size_t nmemb, 
+                         void *userdata) 
+{
+  flickcurl* fc = (flickcurl*)userdata;
+
+  /* a hedged duplicate request answered first */
+  if(fc->hedge.active && fc->hedge.winner == 1)
+    return 0;
+
+  return flickcurl_write_content(fc, (const char*)ptr, size*nmemb);
+}
+
+
 #if FLICKCURL_DEBUG > 1
 static int
 flickcurl_debug_callback(CURL *handle, curl_infotype type,
@@ -199,6 +238,79 @@ flickcurl_debug_callback(CURL *handle, curl_infotype type,
 #endif
 
 
+/*
+ * flickcurl_share_doc:
+ * @fc: flickcurl object
+ * @doc: response DOM
+ *
+ * INTERNAL - Keep the current response DOM alive for objects pointing into it
+ *
+ * The DOM is detached from the session when the next call starts or
+ * the session is freed, and is freed when the last reference is
+ * released with flickcurl_release_doc().
+ *
+ * Return value: new reference or NULL if @doc is not the current response
+ */
+flickcurl_shared_doc*
+flickcurl_share_doc(flickcurl* fc, xmlDocPtr doc)
+{
+  if(!doc)
+    return NULL;
+
+  if(fc->shared_doc && fc->shared_doc->doc == doc) {
+    fc->shared_doc->usage++;
+    return fc->shared_doc;
+  }
+
+  if(!((fc->xc && fc->xc->myDoc == doc) || (fc->jp && flickcurl_json_parser_get_doc(fc->jp) == doc)))
+    return NULL;
+
+  fc->shared_doc = (flickcurl_shared_doc*)malloc(sizeof(*fc->shared_doc));
+  if(!fc->shared_doc)
+    return NULL;
+
+  fc->shared_doc->doc = doc;
+  /* the session and the caller */
+  fc->shared_doc->usage = 2;
+
+  return fc->shared_doc;
+}
+
+
+/*
+ * flickcurl_release_doc:
+ * @shared_doc: shared response DOM
+ *
+ * INTERNAL - Release a reference from flickcurl_share_doc()
+ */
+void
+flickcurl_release_doc(flickcurl_shared_doc* shared_doc)
+{
+  if(--shared_doc->usage)
+    return;
+
+  xmlFreeDoc(shared_doc->doc);
+  free(shared_doc);
+}
+
+
+/* Hand a shared response DOM over to the objects still using it */
+static void
+flickcurl_unshare_doc(flickcurl* fc)
+{
+  if(!fc->shared_doc)
+    return;
+
+  if(fc->xc && fc->xc->myDoc == fc->shared_doc->doc)
+    fc->xc->myDoc = NULL;
+  if(fc->jp && flickcurl_json_parser_get_doc(fc->jp) == fc->shared_doc->doc)
+    flickcurl_json_parser_detach_doc(fc->jp);
+
+  flickcurl_release_doc(fc->shared_doc);
+  fc->shared_doc = NULL;
+}
+
+
 /**
  * flickcurl_new_with_handle:
  * @curl_handle: CURL* handle
@@ -249,6 +361,10 @@ flickcurl_new_with_handle(void* curl_handle)
   /* DEFAULT delay between requests is 1000ms i.e 1 request/second max */
   fc->request_delay = 1000;
 
+  /* DEFAULT is no retries; flickcurl_set_retry_params() turns them on */
+  flickcurl_retry_params_init(&fc->retry_params);
+  fc->retry_params.max_retries = 0;
+
   fc->mt = mtwist_new();
   if(!fc->mt) {
     free(fc);
@@ -284,6 +400,8 @@ flickcurl_new_with_handle(void* curl_handle)
 
   curl_easy_setopt(fc->curl_handle, CURLOPT_ERRORBUFFER, fc->error_buffer);
 
+  flickcurl_hedge_init(fc);
+
   return fc;
 }
 
@@ -311,6 +429,7 @@ flickcurl_new(void)
 void
 flickcurl_free(flickcurl *fc)
 {
+  flickcurl_unshare_doc(fc);
   if(fc->xc) {
     if(fc->xc->myDoc) {
       xmlFreeDoc(fc->xc->myDoc);
@@ -318,6 +437,19 @@ flickcurl_free(flickcurl *fc)
     }
     xmlFreeParserCtxt(fc->xc); 
   }
+  if(fc->jp)
+    flickcurl_free_json_parser(fc->jp);
+  if(fc->json_response_methods)
+    flickcurl_set_json_response_methods(fc, NULL);
+  if(fc->accept_encoding)
+    free(fc->accept_encoding);
+  flickcurl_hedge_free(fc);
+  flickcurl_async_free(fc);
+  if(fc->tag_intern)
+    flickcurl_release_tag_intern(fc->tag_intern);
+  if(fc->photo_columns)
+    free(fc->photo_columns);
+  flickcurl_free_photo_source_sizes(fc);
 
   if(fc->secret)
     free(fc->secret);
@@ -507,6 +639,41 @@ flickcurl_set_proxy(flickcurl* fc, const char *proxy)
 }
 
 
+/**
+ * flickcurl_set_accept_encoding:
+ * @fc: flickcurl object
+ * @encoding: HTTP content encodings such as "gzip, deflate", "" for all supported or NULL for none
+ *
+ * Set the compressed transfer encodings to accept for flickcurl requests
+ *
+ * The default is "" which accepts all the encodings libcurl was built
+ * with such as gzip, deflate and brotli.  The responses are decoded
+ * as they arrive.  NULL turns off compressed transfers.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_accept_encoding(flickcurl* fc, const char *encoding)
+{
+  char *encoding_copy = NULL;
+
+  if(encoding) {
+    size_t len = strlen(encoding);
+    encoding_copy = (char*)malloc(len + 1);
+    if(!encoding_copy)
+      return 1;
+    memcpy(encoding_copy, encoding, len + 1);
+  }
+
+  if(fc->accept_encoding)
+    free(fc->accept_encoding);
+  fc->accept_encoding = encoding_copy;
+  fc->no_accept_encoding = (encoding == NULL);
+
+  return 0;
+}
+
+
 /**
  * flickcurl_set_http_accept:
  * @fc: flickcurl object
@@ -539,6 +706,101 @@ flickcurl_set_http_accept(flickcurl* fc, const char *value)
 }
 
 
+/**
+ * flickcurl_set_json_response:
+ * @fc: flickcurl object
+ * @json_response: non-0 to get JSON responses for all methods
+ *
+ * Set web service responses to be requested as JSON
+ *
+ * JSON responses are turned into the same DOM as XML responses so
+ * this makes no difference to the API functions.  The photos of photo
+ * lists such as from flickcurl_photos_search() are built straight from
+ * the JSON tokens with no DOM or XPath, unless lazy photos or photo
+ * columns are set or the call is asynchronous; they then have only the
+ * fields and no tags, notes, place or video objects, which list
+ * responses do not carry.  Uploads always use XML responses.
+ */
+void
+flickcurl_set_json_response(flickcurl* fc, int json_response)
+{
+  fc->json_response = json_response;
+}
+
+
+/**
+ * flickcurl_set_lazy_photos:
+ * @fc: flickcurl object
+ * @lazy_photos: non-0 to decode photo list fields on first use
+ *
+ * Set photo lists to be built without decoding their fields
+ *
+ * Photos returned in lists such as by flickcurl_photos_search()
+ * then keep the response document and decode each field on the
+ * first call to flickcurl_photo_get_field_string() or the other
+ * field accessors.  This makes large pages of results much quicker
+ * to build when only a few fields are read.  Lazy photos have no
+ * tags, place, video or notes.  The default is 0.
+ */
+void
+flickcurl_set_lazy_photos(flickcurl* fc, int lazy_photos)
+{
+  fc->lazy_photos = lazy_photos;
+}
+
+
+/**
+ * flickcurl_set_json_response_methods:
+ * @fc: flickcurl object
+ * @methods: NULL-terminated array of Flickr API method names or NULL
+ *
+ * Set the web service methods to request JSON responses for
+ *
+ * This selects JSON responses (see flickcurl_set_json_response())
+ * for just the given methods such as "flickr.photos.search".  The
+ * array is copied.  Passing NULL removes the list.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_json_response_methods(flickcurl* fc, const char** methods)
+{
+  int i;
+  int count;
+
+  if(fc->json_response_methods) {
+    for(i = 0; fc->json_response_methods[i]; i++)
+      free(fc->json_response_methods[i]);
+    free(fc->json_response_methods);
+    fc->json_response_methods = NULL;
+  }
+
+  if(!methods)
+    return 0;
+
+  for(count = 0; methods[count]; count++)
+    ;
+
+  fc->json_response_methods = (char**)calloc(count + 1, sizeof(char*));
+  if(!fc->json_response_methods)
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    size_t len = strlen(methods[i]);
+    char* method = (char*)malloc(len + 1);
+
+    if(!method) {
+      flickcurl_set_json_response_methods(fc, NULL);
+      return 1;
+    }
+    memcpy(method, methods[i], len + 1);
+    fc->json_response_methods[i] = method;
+  }
+
+  return 0;
+}
+
+
 /**
  * flickcurl_set_service_uri:
  * @fc: flickcurl object
@@ -783,6 +1045,104 @@ flickcurl_set_request_delay(flickcurl *fc, long delay_msec)
 }
 
 
+/**
+ * flickcurl_set_call_timeout:
+ * @fc: flickcurl object
+ * @timeout_msec: call time limit in milliseconds or 0 for none
+ *
+ * Set a time limit for each web service call
+ *
+ * The limit covers the whole call: waiting for the request rate
+ * limit, the transfer and parsing the response, and any retries.
+ * A call that runs out of time fails.  The default is no limit.
+ */
+void
+flickcurl_set_call_timeout(flickcurl *fc, long timeout_msec)
+{
+  if(timeout_msec >= 0)
+    fc->call_timeout = timeout_msec;
+}
+
+
+/**
+ * flickcurl_cancel:
+ * @fc: flickcurl object
+ *
+ * Cancel the web service call in progress
+ *
+ * The call fails shortly after: its transfer is aborted and any wait
+ * for the request rate limit or before a retry is cut short.  If no
+ * call is in progress, or the call ends before it sees the cancel,
+ * the next call is cancelled instead.
+ *
+ * This is the only function that may be called on @fc from another
+ * thread while a call is in progress.  It must not be called from a
+ * signal handler.
+ */
+void
+flickcurl_cancel(flickcurl *fc)
+{
+  fc->cancelled = 1;
+#if LIBCURL_VERSION_NUM >= 0x074400
+  /* end the transfer loop's wait now; the multi handle lives as long
+   * as the session */
+  if(fc->hedge.multi)
+    curl_multi_wakeup(fc->hedge.multi);
+#endif
+}
+
+
+/*
+ * INTERNAL - clear a cancel of the call in progress as it stops
+ *
+ * Return value: non-0 if the call was cancelled
+ */
+int
+flickcurl_take_cancel(flickcurl *fc)
+{
+#if defined(HAVE_STDATOMIC_H) && !defined(__STDC_NO_ATOMICS__)
+  return atomic_exchange(&fc->cancelled, 0);
+#else
+  if(!fc->cancelled)
+    return 0;
+  fc->cancelled = 0;
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_set_retry_params:
+ * @fc: flickcurl object
+ * @params: retry parameters or NULL to turn off retries
+ *
+ * Set the retry policy for read web service calls
+ *
+ * See #flickcurl_retry_params for the details.  The default is no
+ * retries.  flickcurl_retry_params_init() gives a suggested policy;
+ * with it a blocking call can take up to its 2 minute deadline.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_retry_params(flickcurl *fc, flickcurl_retry_params* params)
+{
+  if(!params) {
+    flickcurl_retry_params_init(&fc->retry_params);
+    fc->retry_params.max_retries = 0;
+    return 0;
+  }
+
+  if(params->version != 1 || params->max_retries < 0 ||
+     params->base_delay < 0 || params->max_delay < params->base_delay ||
+     params->deadline < 0)
+    return 1;
+
+  memcpy(&fc->retry_params, params, sizeof(*params));
+  return 0;
+}
+
+
 /*
  * INTERNAL: initialise parameter array
  */
@@ -829,6 +1189,26 @@ flickcurl_end_params(flickcurl *fc)
 }
 
 
+/* Return non-0 if @method should get a JSON response */
+static int
+flickcurl_want_json_response(flickcurl *fc, const char* method)
+{
+  int i;
+
+  if(fc->json_response)
+    return 1;
+
+  if(fc->json_response_methods) {
+    for(i = 0; fc->json_response_methods[i]; i++) {
+      if(!strcmp(fc->json_response_methods[i], method))
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
 static int
 flickcurl_prepare_common(flickcurl *fc, 
                          const char* service_uri,
@@ -839,6 +1219,23 @@ flickcurl_prepare_common(flickcurl *fc,
 {
   int rc = 1;
 
+  fc->json_call = 0;
+  if(method && !upload_field && flickcurl_want_json_response(fc, method)) {
+    int i;
+
+    /* Keep any format the caller asked for such as a feed format */
+    for(i = 0; i < fc->count; i++) {
+      if(!strcmp(fc->parameters[i][0], "format"))
+        break;
+    }
+    if(i == fc->count) {
+      flickcurl_add_param(fc, "format", "json");
+      flickcurl_add_param(fc, "nojsoncallback", "1");
+      flickcurl_end_params(fc);
+      fc->json_call = 1;
+    }
+  }
+
   if(fc->api_key && fc->secret)
     /* Call with legacy Flickr auth */
     rc = flickcurl_legacy_prepare_common(fc, service_uri, method,
@@ -1005,23 +1402,34 @@ nanosleep(const struct timespec *rqtp, struct timespec *rmtp)
 /* end HAVE_NANOSLEEP */
 
 
-static size_t 
-flickcurl_curl_header_callback(void* ptr,  size_t  size, size_t nmemb,
-                               void *userdata) 
+/*
+ * INTERNAL - handle a response header line of @len bytes
+ *
+ * Return value: @len or 0 to abort the transfer
+ */
+size_t
+flickcurl_header_content(flickcurl* fc, const char* ptr, size_t length)
 {
-  flickcurl* fc = (flickcurl*)userdata;
-  int bytes = size*nmemb;
+  int bytes = (int)length;
 
   /* If flickcurl has already failed, return nothing so that
    * libcurl will abort the transfer
    */
   if(fc->failed)
     return 0;
+
+  if(fc->coalesce_flight)
+    flickcurl_coalesce_content(fc, 1, ptr, length);
   
 #define EC_HEADER_LEN 17
 #define EM_HEADER_LEN 20
+#define RA_HEADER_LEN 13
 
-  if(!strncmp((char*)ptr, "X-FlickrErrCode: ", EC_HEADER_LEN)) {
+  if(!strncmp((char*)ptr, "Retry-After: ", RA_HEADER_LEN) ||
+     !strncmp((char*)ptr, "retry-after: ", RA_HEADER_LEN)) {
+    /* only the delay-seconds form is used */
+    fc->retry_after = atol((char*)ptr + RA_HEADER_LEN);
+  } else if(!strncmp((char*)ptr, "X-FlickrErrCode: ", EC_HEADER_LEN)) {
     fc->error_code = atoi((char*)ptr+EC_HEADER_LEN);
   } else if(!strncmp((char*)ptr, "X-FlickrErrMessage: ", EM_HEADER_LEN)) {
     int len = bytes - EM_HEADER_LEN;
@@ -1040,6 +1448,38 @@ flickcurl_curl_header_callback(void* ptr,  size_t  size, size_t nmemb,
 }
 
 
+static size_t 
+flickcurl_curl_header_callback(void* ptr,  size_t  size, size_t nmemb,
+                               void *userdata) 
+{
+  flickcurl* fc = (flickcurl*)userdata;
+  size_t len = size*nmemb;
+
+  if(fc->hedge.active && flickcurl_hedge_header(fc, 0, (const char*)ptr, len))
+    return 0;
+
+  return flickcurl_header_content(fc, (const char*)ptr, len);
+}
+
+
+/*
+ * flickcurl_get_time:
+ *
+ * INTERNAL - Get the current time in seconds since the epoch with
+ * microsecond resolution, for measuring intervals
+ *
+ * Return value: time in seconds
+ */
+double
+flickcurl_get_time(void)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return (double)now.tv_sec + ((double)now.tv_usec / 1000000.0);
+}
+
+
 /**
  * flickcurl_get_current_request_wait:
  * @fc: flickcurl object
@@ -1100,13 +1540,231 @@ flickcurl_get_current_request_wait(flickcurl *fc)
 #endif
 }
 
+
+/**
+ * flickcurl_get_response_bytes:
+ * @fc: flickcurl object
+ * @transfer_bytes_p: pointer to store bytes received on the wire (or NULL)
+ * @content_bytes_p: pointer to store content bytes after decoding (or NULL)
+ *
+ * Get the size of the last web service response body
+ *
+ * With a compressed transfer (see flickcurl_set_accept_encoding())
+ * the transfer size is the compressed size.
+ */
+void
+flickcurl_get_response_bytes(flickcurl *fc, size_t* transfer_bytes_p,
+                             size_t* content_bytes_p)
+{
+  if(transfer_bytes_p)
+    *transfer_bytes_p = fc->transfer_bytes;
+  if(content_bytes_p)
+    *content_bytes_p = (size_t)fc->total_bytes;
+}
+
+
+/**
+ * flickcurl_get_total_response_bytes:
+ * @fc: flickcurl object
+ * @transfer_bytes_p: pointer to store bytes received on the wire (or NULL)
+ * @content_bytes_p: pointer to store content bytes after decoding (or NULL)
+ *
+ * Get the total size of all web service response bodies for the session
+ */
+void
+flickcurl_get_total_response_bytes(flickcurl *fc, size_t* transfer_bytes_p,
+                                   size_t* content_bytes_p)
+{
+  if(transfer_bytes_p)
+    *transfer_bytes_p = fc->session_transfer_bytes;
+  if(content_bytes_p)
+    *content_bytes_p = fc->session_content_bytes;
+}
+
+
+/**
+ * flickcurl_get_retry_counts:
+ * @fc: flickcurl object
+ * @call_retries_p: pointer to store the retries of the last call (or NULL)
+ * @total_retries_p: pointer to store the retries for the session (or NULL)
+ *
+ * Get the number of times web service calls were retried
+ *
+ * See flickcurl_set_retry_params().
+ */
+void
+flickcurl_get_retry_counts(flickcurl *fc, int* call_retries_p,
+                           int* total_retries_p)
+{
+  if(call_retries_p)
+    *call_retries_p = fc->call_retries;
+  if(total_retries_p)
+    *total_retries_p = fc->total_retries;
+}
+
+/* Record the body bytes received on the wire and after decoding for
+ * the call just made
+ */
+static void
+flickcurl_update_response_bytes(flickcurl *fc, CURL* handle)
+{
+#if LIBCURL_VERSION_NUM >= 0x073700
+  curl_off_t size = 0;
+
+  if(curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size) ==
+     CURLE_OK && size > 0)
+    fc->transfer_bytes = (size_t)size;
+#else
+  double size = 0;
+
+  if(curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &size) ==
+     CURLE_OK && size > 0)
+    fc->transfer_bytes = (size_t)size;
+#endif
+
+  fc->session_transfer_bytes += fc->transfer_bytes;
+  fc->session_content_bytes += (size_t)fc->total_bytes;
+}
+
+
+/* Longest single sleep so that a cancel is noticed promptly */
+#define FLICKCURL_SLEEP_SLICE_USEC 20000
+
+/*
+ * Sleep for @usec microseconds unless the call is cancelled first
+ *
+ * Return value: non-0 if the call was cancelled
+ */
+static int
+flickcurl_sleep(flickcurl *fc, long usec)
+{
+  while(usec > 0 && !fc->cancelled) {
+    struct timespec nwait;
+    long slice = (usec < FLICKCURL_SLEEP_SLICE_USEC) ? usec :
+                 FLICKCURL_SLEEP_SLICE_USEC;
+
+    nwait.tv_sec = 0;
+    nwait.tv_nsec = 1000 * slice;
+    while(1) {
+      struct timespec rem;
+      if(nanosleep(&nwait, &rem) < 0 && errno == EINTR) {
+        memcpy(&nwait, &rem, sizeof(struct timespec));
+        continue;
+      }
+      break;
+    }
+    usec -= slice;
+  }
+
+  return flickcurl_take_cancel(fc);
+}
+
+
+/* Return the time left before the call deadline in seconds or a
+ * large value if the call has no deadline
+ */
+static double
+flickcurl_call_time_left(flickcurl *fc)
+{
+  if(!fc->call_deadline)
+    return 1.0e9;
+
+  return fc->call_deadline - flickcurl_get_time();
+}
+
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+static int
+flickcurl_progress_callback(void *userdata,
+                            curl_off_t dltotal, curl_off_t dlnow,
+                            curl_off_t ultotal, curl_off_t ulnow)
+#else
+static int
+flickcurl_progress_callback(void *userdata,
+                            double dltotal, double dlnow,
+                            double ultotal, double ulnow)
+#endif
+{
+  flickcurl* fc = (flickcurl*)userdata;
+
+  /* non-0 aborts the transfer */
+  return (fc->cancelled || flickcurl_call_time_left(fc) <= 0);
+}
+
+
+/* Return non-0 if a libcurl error may go away if the call is repeated */
 static int
-flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
-                        xmlDocPtr* docptr_p)
+flickcurl_curl_error_is_transient(CURLcode code)
+{
+  return (code == CURLE_COULDNT_RESOLVE_PROXY ||
+          code == CURLE_COULDNT_RESOLVE_HOST ||
+          code == CURLE_COULDNT_CONNECT ||
+          code == CURLE_PARTIAL_FILE ||
+          code == CURLE_OPERATION_TIMEDOUT ||
+          code == CURLE_SSL_CONNECT_ERROR ||
+          code == CURLE_GOT_NOTHING ||
+          code == CURLE_SEND_ERROR ||
+          code == CURLE_RECV_ERROR);
+}
+
+
+/*
+ * Decide if a failed attempt of the current call is to be retried.
+ * @transient is non-0 if the failure may go away on a retry.
+ *
+ * Sets the delay before the retry: a random time between half and
+ * all of the exponential backoff, and no less than any Retry-After
+ * time.  There is no retry if the call would then run past the
+ * deadline.
+ *
+ * Return value: non-0 if the call is to be retried
+ */
+static int
+flickcurl_retry_wanted(flickcurl *fc, int transient)
+{
+  flickcurl_retry_params* params = &fc->retry_params;
+  double backoff;
+  double delay;
+  int i;
+
+  if(!transient || !fc->idempotent || fc->cancelled ||
+     fc->call_retries >= params->max_retries)
+    return 0;
+
+  backoff = (double)params->base_delay;
+  for(i = 0; i < fc->call_retries && backoff < params->max_delay; i++)
+    backoff *= 2;
+  if(backoff > params->max_delay)
+    backoff = (double)params->max_delay;
+
+  delay = (backoff / 2) * (1.0 + mtwist_drand(fc->mt));
+  if(fc->retry_after > 0 && delay < 1000.0 * fc->retry_after)
+    delay = 1000.0 * fc->retry_after;
+
+  if(params->deadline &&
+     1000.0 * (flickcurl_get_time() - fc->call_start_time) + delay >
+     (double)params->deadline)
+    return 0;
+
+  if(1000.0 * flickcurl_call_time_left(fc) <= delay)
+    return 0;
+
+  fc->retry_delay = (long)(delay * 1000);
+  fc->retry_wanted = 1;
+  return 1;
+}
+
+
+static int
+flickcurl_invoke_attempt(flickcurl *fc, char** content_p, size_t* size_p,
+                         xmlDocPtr* docptr_p)
 {
   struct curl_slist *slist = NULL;
   xmlDocPtr doc = NULL;
   struct timeval now;
+  CURLcode curl_rc;
+  /* handle the response came from */
+  CURL* handle = fc->curl_handle;
 #if defined(OFFLINE) || defined(CAPTURE)
   char filename[200];
 #endif
@@ -1163,7 +1821,8 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
   
   gettimeofday(&now, NULL);
 #ifndef OFFLINE
-  if(fc->last_request_time.tv_sec) {
+  /* asynchronous requests are spaced when they are sent */
+  if(fc->last_request_time.tv_sec && !fc->async.call) {
     /* If there was a previous request, check it's not too soon to
      * do another
      */
@@ -1208,22 +1867,26 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
       fprintf(stderr, "Waiting for %lu sec N%lu nsec period\n",
               (unsigned long)nwait.tv_sec, (unsigned long)nwait.tv_nsec);
 #endif
-      while(1) {
-        struct timespec rem;
-        if(nanosleep(&nwait, &rem) < 0 && errno == EINTR) {
-          memcpy(&nwait, &rem, sizeof(struct timeval));
-#if FLICKCURL_DEBUG > 1
-          fprintf(stderr, "EINTR - waiting for %lu sec N%lu nsec period\n",
-                  (unsigned long)nwait.tv_sec, (unsigned long)nwait.tv_nsec);
-#endif
-          continue;
-        }
-        break;
+      if(flickcurl_call_time_left(fc) <=
+         nwait.tv_sec + nwait.tv_nsec / 1000000000.0) {
+        flickcurl_error(fc, "Method %s deadline would pass waiting for the request rate limit",
+                        fc->method);
+        fc->failed = 1;
+        return 1;
+      }
+      if(flickcurl_sleep(fc, nwait.tv_sec * 1000000L + nwait.tv_nsec / 1000)) {
+        flickcurl_error(fc, "Method %s cancelled", fc->method);
+        fc->failed = 1;
+        return 1;
       }
+
+      /* the request is made now, after the wait */
+      gettimeofday(&now, NULL);
     }
   }
 #endif
-  memcpy(&fc->last_request_time, &now, sizeof(struct timeval));
+  if(!fc->async.call)
+    memcpy(&fc->last_request_time, &now, sizeof(struct timeval));
 
 #ifdef CAPTURE
   if(1) {
@@ -1234,13 +1897,23 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
   }
 #endif
 
-  if(fc->xc) {
-    if(fc->xc->myDoc) {
-      xmlFreeDoc(fc->xc->myDoc);
-      fc->xc->myDoc = NULL;
-    }
-    xmlFreeParserCtxt(fc->xc); 
-    fc->xc = NULL;
+  flickcurl_unshare_doc(fc);
+  /* the XML parser is kept and reset by the first response content */
+  if(fc->xc && fc->xc->myDoc) {
+    xmlFreeDoc(fc->xc->myDoc);
+    fc->xc->myDoc = NULL;
+  }
+  fc->xc_active = 0;
+  if(fc->jp) {
+    flickcurl_free_json_parser(fc->jp);
+    fc->jp = NULL;
+  }
+
+  /* a later run of an asynchronous builder reuses the parsed response */
+  if(fc->async.call && docptr_p) {
+    *docptr_p = flickcurl_async_reuse_doc(fc);
+    if(*docptr_p)
+      goto tidy;
   }
 
   if(fc->proxy)
@@ -1256,7 +1929,42 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
   /* specify URL to call */
   curl_easy_setopt(fc->curl_handle, CURLOPT_URL, fc->uri);
 
+  /* Negotiate a compressed transfer; libcurl decodes it before the
+   * write callback so the parsers only ever see the decoded content
+   */
+#if LIBCURL_VERSION_NUM >= 0x071506
+  curl_easy_setopt(fc->curl_handle, CURLOPT_ACCEPT_ENCODING,
+                   fc->no_accept_encoding ? NULL :
+                   (fc->accept_encoding ? fc->accept_encoding : ""));
+#else
+  curl_easy_setopt(fc->curl_handle, CURLOPT_ENCODING,
+                   fc->no_accept_encoding ? NULL :
+                   (fc->accept_encoding ? fc->accept_encoding : ""));
+#endif
+
+  /* Limit the transfer to the time left before the call deadline and
+   * check for cancelling while it runs
+   */
+  if(fc->call_deadline) {
+    double left = flickcurl_call_time_left(fc);
+    long timeout_ms = (left > 0.001) ? (long)(left * 1000) : 1;
+    curl_easy_setopt(fc->curl_handle, CURLOPT_TIMEOUT_MS, timeout_ms);
+  } else
+    curl_easy_setopt(fc->curl_handle, CURLOPT_TIMEOUT_MS, 0L);
+#if LIBCURL_VERSION_NUM >= 0x072000
+  curl_easy_setopt(fc->curl_handle, CURLOPT_XFERINFOFUNCTION,
+                   flickcurl_progress_callback);
+  curl_easy_setopt(fc->curl_handle, CURLOPT_XFERINFODATA, fc);
+#else
+  curl_easy_setopt(fc->curl_handle, CURLOPT_PROGRESSFUNCTION,
+                   flickcurl_progress_callback);
+  curl_easy_setopt(fc->curl_handle, CURLOPT_PROGRESSDATA, fc);
+#endif
+  curl_easy_setopt(fc->curl_handle, CURLOPT_NOPROGRESS, 0L);
+
   fc->total_bytes = 0;
+  fc->transfer_bytes = 0;
+  fc->retry_after = 0;
 
   /* default: read with no data: GET */
   curl_easy_setopt(fc->curl_handle, CURLOPT_NOBODY, 1);
@@ -1349,11 +2057,32 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
   fprintf(stderr, "Invoking CURL to resolve the URL\n");
 #endif
 
-  if(curl_easy_perform(fc->curl_handle)) {
+  fc->coalesced = 0;
+  if(fc->async.call)
+    curl_rc = flickcurl_async_perform(fc, &handle);
+  else if(fc->coalescer && fc->idempotent && fc->method)
+    curl_rc = flickcurl_coalesce_perform(fc, (fc->hedge_params.percentile != 0),
+                                         &handle);
+  else
+    curl_rc = flickcurl_hedge_perform(fc, (fc->hedge_params.percentile &&
+                                           fc->idempotent && fc->method),
+                                       &handle);
+  /* a coalesced response was transferred by another session */
+  if(!fc->async.deferred && !fc->coalesced)
+    flickcurl_update_response_bytes(fc, handle);
+  if(curl_rc != CURLE_OK) {
     /* failed */
     fc->failed = 1;
-    flickcurl_error(fc, "Method %s failed with CURL error %s",
-                    fc->method, fc->error_buffer);
+    if(fc->async.deferred)
+      ; /* the request was queued to run asynchronously */
+    else if(flickcurl_take_cancel(fc))
+      flickcurl_error(fc, "Method %s cancelled", fc->method);
+    else if(fc->call_deadline && (curl_rc == CURLE_OPERATION_TIMEDOUT ||
+                                  flickcurl_call_time_left(fc) <= 0))
+      flickcurl_error(fc, "Method %s deadline passed", fc->method);
+    else if(!flickcurl_retry_wanted(fc, flickcurl_curl_error_is_transient(curl_rc)))
+      flickcurl_error(fc, "Method %s failed with CURL error %s",
+                      fc->method, fc->error_buffer);
   } else {
     long lstatus;
 
@@ -1362,13 +2091,19 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
 #endif
 
     fc->status_code = 0;
+    /* only successful responses are coalesced */
+    if(fc->coalesced)
+      fc->status_code = 200;
     /* Requires pointer to a long */
-    if(CURLE_OK == 
-       curl_easy_getinfo(fc->curl_handle, CURLINFO_RESPONSE_CODE, &lstatus) )
+    else if(CURLE_OK == 
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &lstatus) )
       fc->status_code = lstatus;
 
     if(fc->status_code != 200) {
-      if(fc->method)
+      if(flickcurl_retry_wanted(fc, (fc->status_code == 429 ||
+                                     fc->status_code >= 500)))
+        ;
+      else if(fc->method)
         flickcurl_error(fc, "Method %s failed with error %d - %s (HTTP %d)", 
                         fc->method, fc->error_code, fc->error_msg,
                         fc->status_code);
@@ -1381,6 +2116,8 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
 
   }
 
+  flickcurl_hedge_finish(fc);
+
 #ifdef HAVE_LIBCURL_CURL_MIME_INIT
   if(mime)
     curl_mime_free(mime);
@@ -1447,14 +2184,19 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
     xmlAttr* attr;
     int failed = 0;
     
-    xmlParseChunk(fc->xc, NULL, 0, 1);
+    if(fc->json_call) {
+      if(fc->jp)
+        doc = flickcurl_json_parser_finish(fc->jp);
+    } else if(fc->xc && fc->xc_active) {
+      xmlParseChunk(fc->xc, NULL, 0, 1);
+      doc = fc->xc->myDoc;
+    }
 
 #ifdef FLICKCURL_DEBUG
     fprintf(stderr, "Got %d bytes content from URI '%s'\n",
             fc->total_bytes, fc->uri);
 #endif
 
-    doc = fc->xc->myDoc;
     if(!doc) {
       flickcurl_error(fc, "Failed to create XML DOM for document");
       fc->failed = 1;
@@ -1481,19 +2223,34 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
     }
 
     if(failed) {
-      xmlNodePtr err = xnp->children->next;
+      xmlNodePtr err;
+
+      /* XML has an <err code msg> child; JSON has code and message
+       * fields that are attributes of the root element
+       */
+      for(err = xnp->children; err; err = err->next) {
+        if(err->type == XML_ELEMENT_NODE &&
+           !strcmp((const char*)err->name, "err"))
+          break;
+      }
+      if(!err)
+        err = xnp;
+
       for(attr = err->properties; attr; attr = attr->next) {
         const char *attr_name = (const char*)attr->name;
         const char *attr_value = (const char*)attr->children->content;
         if(!strcmp(attr_name, "code"))
           fc->error_code = atoi(attr_value);
-        else if(!strcmp(attr_name, "msg")) {
+        else if(!strcmp(attr_name, "msg") || !strcmp(attr_name, "message")) {
           size_t attr_len = strlen(attr_value);
           fc->error_msg = (char*)malloc(attr_len + 1);
           memcpy(fc->error_msg, attr_value, attr_len + 1);
         }
       }
-      if(fc->method)
+      /* Flickr error 105: Service currently unavailable */
+      if(flickcurl_retry_wanted(fc, (fc->error_code == 105)))
+        ;
+      else if(fc->method)
         flickcurl_error(fc, "Method %s failed with error %d - %s", 
                         fc->method, fc->error_code, fc->error_msg);
       else
@@ -1504,6 +2261,8 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
       /* pass DOM as an output parameter */
       if(docptr_p)
         *docptr_p = doc;
+      if(fc->async.call)
+        flickcurl_async_keep_doc(fc, doc);
     }
   }
 
@@ -1520,11 +2279,123 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
 
   /* reset special flags */
   fc->sign = 0;
+  fc->json_call = 0;
   
   return rc;
 }
 
 
+/* Free any content saved by a failed attempt */
+static void
+flickcurl_free_chunks(flickcurl *fc)
+{
+  while(fc->chunks) {
+    flickcurl_chunk* chunk = fc->chunks;
+    fc->chunks = chunk->prev;
+    free(chunk->content);
+    free(chunk);
+  }
+  fc->chunks_count = 0;
+}
+
+
+/*
+ * INTERNAL - sign the prepared request again with a new OAuth nonce
+ * and timestamp before it is sent again
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_resign(flickcurl *fc)
+{
+  char* uri = NULL;
+
+  if(!fc->param_fields || !fc->uri)
+    return 0;
+
+  if(flickcurl_oauth_resign(fc, fc->is_write ? "POST" : "GET", fc->uri,
+                            fc->param_fields, fc->param_values, &uri))
+    return 1;
+
+  if(uri) {
+    free(fc->uri);
+    fc->uri = uri;
+    fc->uri_len = strlen(uri);
+  }
+
+  return 0;
+}
+
+
+static int
+flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
+                        xmlDocPtr* docptr_p)
+{
+  int rc;
+
+  fc->call_start_time = flickcurl_get_time();
+  fc->call_deadline = fc->call_timeout ?
+    fc->call_start_time + fc->call_timeout / 1000.0 : 0;
+  fc->call_retries = 0;
+
+  /* Only reads can be repeated safely */
+  fc->idempotent = (!fc->is_write && !fc->upload_field);
+
+  if(fc->async.call)
+    flickcurl_async_begin_invoke(fc);
+
+  while(1) {
+    fc->retry_wanted = 0;
+    rc = flickcurl_invoke_attempt(fc, content_p, size_p, docptr_p);
+    if(!rc || !fc->retry_wanted)
+      break;
+
+#ifdef FLICKCURL_DEBUG
+    fprintf(stderr, "Method %s retry %d after %ld usec\n",
+            fc->method, fc->call_retries + 1, fc->retry_delay);
+#endif
+
+    flickcurl_free_chunks(fc);
+    fc->failed = 0;
+    fc->error_code = 0;
+    if(fc->error_msg) {
+      free(fc->error_msg);
+      fc->error_msg = NULL;
+    }
+
+    if(fc->async.call) {
+      /* send the request again from the event loop */
+      flickcurl_async_retry(fc);
+      break;
+    }
+
+    if(flickcurl_sleep(fc, fc->retry_delay)) {
+      flickcurl_error(fc, "Method %s cancelled", fc->method);
+      fc->failed = 1;
+      break;
+    }
+
+    /* the retry is signed again so it does not repeat the nonce */
+    if(flickcurl_resign(fc)) {
+      flickcurl_error(fc, "Method %s could not be signed again", fc->method);
+      fc->failed = 1;
+      break;
+    }
+
+    fc->call_retries++;
+    fc->total_retries++;
+  }
+
+  /* the objects a write may have changed are no longer cached */
+  if(fc->snapshot_cache && !fc->idempotent)
+    flickcurl_snapshot_invalidate_params(fc);
+
+  fc->call_deadline = 0;
+
+  return rc;
+}
+
+
 xmlDocPtr
 flickcurl_invoke(flickcurl *fc)
 {
@@ -1647,11 +2518,17 @@ flickcurl_unixtime_to_isotime(time_t unix_time)
   struct tm* structured_time;
 #define ISO_DATE_FORMAT "%Y-%m-%dT%H:%M:%SZ"
 #define ISO_DATE_LEN 20
-  static char date_buffer[ISO_DATE_LEN + 1];
+  char date_buffer[ISO_DATE_LEN + 1];
   size_t len;
   char *value = NULL;
-  
+#ifdef HAVE_GMTIME_R
+  struct tm tm_buffer;
+
+  /* builders may run in several threads */
+  structured_time = gmtime_r(&unix_time, &tm_buffer);
+#else
   structured_time = (struct tm*)gmtime(&unix_time);
+#endif
   len = ISO_DATE_LEN;
   strftime(date_buffer, len+1, ISO_DATE_FORMAT, structured_time);
   
@@ -1667,11 +2544,17 @@ flickcurl_unixtime_to_sqltimestamp(time_t unix_time)
   struct tm* structured_time;
 #define SQL_DATETIME_FORMAT "%Y %m %d %H:%M:%S"
 #define SQL_DATETIME_LEN 19
-  static char date_buffer[SQL_DATETIME_LEN + 1];
+  char date_buffer[SQL_DATETIME_LEN + 1];
   size_t len;
   char *value = NULL;
-  
+#ifdef HAVE_GMTIME_R
+  struct tm tm_buffer;
+
+  /* builders may run in several threads */
+  structured_time = gmtime_r(&unix_time, &tm_buffer);
+#else
   structured_time = (struct tm*)gmtime(&unix_time);
+#endif
   len = SQL_DATETIME_LEN;
   strftime(date_buffer, sizeof(date_buffer), SQL_DATETIME_FORMAT, structured_time);
   
@@ -2431,6 +3314,35 @@ flickcurl_photos_list_params_init(flickcurl_photos_list_params* list_params)
 }
 
 
+/**
+ * flickcurl_retry_params_init:
+ * @params: retry params to init
+ *
+ * Initialise an existing retry parameter structure with the suggested
+ * policy: up to 3 retries starting after 1 second, at most 30 seconds
+ * apart and all within 2 minutes.  Pass it to
+ * flickcurl_set_retry_params() to turn retries on.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_retry_params_init(flickcurl_retry_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(*params));
+  params->version = 1;
+
+  params->max_retries = 3;
+  params->base_delay = 1000;
+  params->max_delay = 30000;
+  params->deadline = 120000;
+
+  return 0;
+}
+
+
 /**
  * flickcurl_search_params_init:
  * @params: search params to init
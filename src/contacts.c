@@ -80,6 +80,75 @@ flickcurl_free_contacts(flickcurl_contact **contacts_object)
 }
 
 
+/* Build the contact for one node */
+static void*
+flickcurl_build_contact_node(flickcurl* fc, xmlXPathContextPtr xpathNodeCtx,
+                             xmlNodePtr node, void* user_data)
+{
+  xmlAttr* attr;
+  flickcurl_contact* contact_object;
+  
+  if(node->type != XML_ELEMENT_NODE) {
+    flickcurl_error(fc, "Got unexpected node type %d", node->type);
+    fc->failed = 1;
+    return NULL;
+  }
+  
+  contact_object = (flickcurl_contact*)calloc(1, sizeof(flickcurl_contact));
+  if(!contact_object) {
+    fc->failed = 1;
+    return NULL;
+  }
+  
+  for(attr = node->properties; attr; attr = attr->next) {
+    size_t attr_len = strlen((const char*)attr->children->content);
+    const char *attr_name = (const char*)attr->name;
+    char *attr_value;
+    
+    attr_value = (char*)malloc(attr_len + 1);
+    memcpy(attr_value, attr->children->content, attr_len + 1);
+    
+    if(!strcmp(attr_name, "nsid"))
+      contact_object->nsid = attr_value;
+    else if(!strcmp(attr_name, "username"))
+      contact_object->username = attr_value;
+    else if(!strcmp(attr_name, "iconserver")) {
+      contact_object->iconserver = atoi((const char*)attr_value);
+      free(attr_value);
+    } else if(!strcmp(attr_name, "realname"))
+      contact_object->realname = attr_value;
+    else if(!strcmp(attr_name, "friend")) {
+      contact_object->is_friend = atoi((const char*)attr_value);
+      free(attr_value);
+    } else if(!strcmp(attr_name, "family")) {
+      contact_object->is_family = atoi((const char*)attr_value);
+      free(attr_value);
+    } else if(!strcmp(attr_name, "ignored")) {
+      contact_object->ignored = atoi((const char*)attr_value);
+      free(attr_value);
+    } else if(!strcmp(attr_name, "uploaded")) {
+      contact_object->uploaded = atoi((const char*)attr_value);
+      free(attr_value);
+    } else
+      free(attr_value);
+  }
+
+#if FLICKCURL_DEBUG > 1
+  fprintf(stderr, "contact: NSID %s username %s iconserver %d realname %s friend %d family %d ignored %d uploaded %d\n",
+          contact_object->nsid,
+          contact_object->username,
+          contact_object->iconserver,
+          contact_object->realname,
+          contact_object->is_friend,
+          contact_object->is_family,
+          contact_object->ignored,
+          contact_object->uploaded);
+#endif
+  
+  return contact_object;
+}
+
+
 flickcurl_contact**
 flickcurl_build_contacts(flickcurl* fc, 
                          xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr,
@@ -105,67 +174,31 @@ flickcurl_build_contacts(flickcurl* fc,
   /* This is a max size - it can include nodes that are CDATA */
   nodes_count = xmlXPathNodeSetGetLength(nodes);
   contacts = (flickcurl_contact**)calloc(nodes_count+1, sizeof(flickcurl_contact*));
-  
-  for(i = 0, contact_count = 0; i < nodes_count; i++) {
-    xmlNodePtr node = nodes->nodeTab[i];
-    xmlAttr* attr;
-    flickcurl_contact* contact_object;
-    
-    if(node->type != XML_ELEMENT_NODE) {
-      flickcurl_error(fc, "Got unexpected node type %d", node->type);
-      fc->failed = 1;
-      break;
+  if(!contacts) {
+    fc->failed = 1;
+    goto tidy;
+  }
+
+  if(!flickcurl_build_parallel(fc, xpathCtx->doc, nodes, (void**)contacts,
+                               flickcurl_build_contact_node, NULL)) {
+    /* skip NULLs from failed nodes keeping the order */
+    for(i = 0, contact_count = 0; i < nodes_count; i++) {
+      if(contacts[i])
+        contacts[contact_count++] = contacts[i];
     }
-    
-    contact_object = (flickcurl_contact*)calloc(1, sizeof(flickcurl_contact));
-    
-    for(attr = node->properties; attr; attr = attr->next) {
-      size_t attr_len = strlen((const char*)attr->children->content);
-      const char *attr_name = (const char*)attr->name;
-      char *attr_value;
-      
-      attr_value = (char*)malloc(attr_len + 1);
-      memcpy(attr_value, attr->children->content, attr_len + 1);
-      
-      if(!strcmp(attr_name, "nsid"))
-        contact_object->nsid = attr_value;
-      else if(!strcmp(attr_name, "username"))
-        contact_object->username = attr_value;
-      else if(!strcmp(attr_name, "iconserver")) {
-        contact_object->iconserver = atoi((const char*)attr_value);
-        free(attr_value);
-      } else if(!strcmp(attr_name, "realname"))
-        contact_object->realname = attr_value;
-      else if(!strcmp(attr_name, "friend")) {
-        contact_object->is_friend = atoi((const char*)attr_value);
-        free(attr_value);
-      } else if(!strcmp(attr_name, "family")) {
-        contact_object->is_family = atoi((const char*)attr_value);
-        free(attr_value);
-      } else if(!strcmp(attr_name, "ignored")) {
-        contact_object->ignored = atoi((const char*)attr_value);
-        free(attr_value);
-      } else if(!strcmp(attr_name, "uploaded")) {
-        contact_object->uploaded = atoi((const char*)attr_value);
-        free(attr_value);
-      } else
-        free(attr_value);
+    for(i = contact_count; i < nodes_count; i++)
+      contacts[i] = NULL;
+  } else {
+    for(i = 0, contact_count = 0; i < nodes_count; i++) {
+      flickcurl_contact* contact_object;
+
+      contact_object = (flickcurl_contact*)
+        flickcurl_build_contact_node(fc, NULL, nodes->nodeTab[i], NULL);
+      if(!contact_object)
+        break;
+      contacts[contact_count++] = contact_object;
     }
-
-#if FLICKCURL_DEBUG > 1
-    fprintf(stderr, "contact: NSID %s username %s iconserver %d realname %s friend %d family %d ignored %d uploaded %d\n",
-            contact_object->nsid,
-            contact_object->username,
-            contact_object->iconserver,
-            contact_object->realname,
-            contact_object->is_friend,
-            contact_object->is_family,
-            contact_object->ignored,
-            contact_object->uploaded);
-#endif
-    
-    contacts[contact_count++] = contact_object;
-  } /* for nodes */
+  }
 
   if(contact_count_p)
     *contact_count_p = contact_count;
@@ -0,0 +1,1895 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * crawl.c - Flickcurl resumable graph crawls from concurrent calls
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * A crawl is a breadth first walk from seed IDs where each node is
+ * expanded into its neighbours by expander functions making paged
+ * web service calls.  The nodes of one depth are all expanded before
+ * those of the next are started.
+ *
+ * Every node found is appended to a node log, a file of records
+ *   depth byte, ID, NUL
+ * and the log in order is the frontier: nodes are read back from it
+ * to be expanded, so breadth first order needs no queue in memory.
+ *
+ * The visited set is a Bloom filter in front of an open addressing
+ * table of ID hashes and IDs, memory-mapped from a file when one is
+ * given.  Most new nodes are told apart by the Bloom filter alone;
+ * the table only confirms the nodes that may have been seen.
+ *
+ * A checkpoint writes the offset of the first node in the log not yet
+ * fully expanded and the length of the log to a small state file.
+ * Resuming reads the log up to that length to rebuild the visited
+ * set and carries on from that node, so nodes being expanded when the
+ * checkpoint was made are expanded again.
+ *
+ * Each page of an expander is its own asynchronous call.  The pages
+ * after the first and the expanders of a node being expanded are
+ * queued ahead of new nodes and at most the concurrency limit of
+ * calls run at once; the application's event loop drives the crawl.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#define FLICKCURL_CRAWL_MMAP 1
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define FLICKCURL_CRAWL_STATE_MAGIC "flickcurl-crawl 1"
+
+/* Bloom filter bits per expected node and bits set per node */
+#define FLICKCURL_CRAWL_BLOOM_BITS 10
+#define FLICKCURL_CRAWL_BLOOM_HASHES 7
+
+#define FLICKCURL_CRAWL_MIN_SLOTS 1024
+#define FLICKCURL_CRAWL_MAX_DEPTH 255
+#define FLICKCURL_CRAWL_MAX_EXPANDERS 8
+
+
+#ifndef STANDALONE
+
+/* Visited set table slot; a hash of 0 marks an empty slot */
+typedef struct {
+  uint64_t hash;
+  char id[FLICKCURL_CRAWL_ID_SIZE];
+} flickcurl_crawl_slot;
+
+
+typedef struct {
+  flickcurl_crawl_expander expander;
+  void* user_data;
+  int first_depth;
+  int last_depth;
+} flickcurl_crawl_expansion;
+
+
+/* Node being expanded */
+typedef struct flickcurl_crawl_node_s {
+  struct flickcurl_crawl_node_s* prev;
+  struct flickcurl_crawl_node_s* next;
+  /* offset of the node's record in the log and its index */
+  size_t offset;
+  int index;
+  int depth;
+  /* calls queued or running */
+  int calls;
+  int failed;
+  char id[FLICKCURL_CRAWL_ID_SIZE];
+} flickcurl_crawl_node;
+
+
+/* One expander page call to make */
+typedef struct {
+  flickcurl_crawl_node* node;
+  int expansion;
+  int page;
+} flickcurl_crawl_task;
+
+
+/* One asynchronous call made by a crawler */
+typedef struct flickcurl_crawl_work_s {
+  flickcurl_crawler* crawler;
+  struct flickcurl_crawl_work_s* prev;
+  struct flickcurl_crawl_work_s* next;
+  flickcurl_async_call* call;
+  flickcurl_crawl_task task;
+  int cancelled;
+} flickcurl_crawl_work;
+
+
+struct flickcurl_crawler_s {
+  flickcurl* fc;
+  flickcurl_crawler_params params;
+  char* state_filename;
+  /* most new nodes and nodes found at each depth */
+  int* depth_limits;
+  int* depth_counts;
+
+  flickcurl_crawl_expansion expansions[FLICKCURL_CRAWL_MAX_EXPANDERS];
+  int expansions_count;
+
+  flickcurl_crawl_handler handler;
+  void* handler_data;
+
+  unsigned char* bloom;
+  size_t bloom_bits;
+
+  flickcurl_crawl_slot* slots;
+  size_t slots_count;
+  size_t slots_used;
+  /* file descriptor of the mapped table file or -1 */
+  int table_fd;
+
+  /* log in a file or in memory */
+  FILE* log_writer;
+  FILE* log_reader;
+  char* log_buffer;
+  size_t log_size;
+  size_t log_length;
+  /* length of the log the reader can see */
+  size_t log_flushed;
+  /* offset of the next node record to read */
+  size_t read_offset;
+
+  int nodes_count;
+  int nodes_read;
+  int expanded_count;
+  int failed_count;
+  int since_checkpoint;
+
+  /* nodes being expanded, all of depth @level */
+  flickcurl_crawl_node* nodes;
+  int nodes_expanding;
+  int level;
+
+  /* calls of nodes being expanded waiting to be made */
+  flickcurl_crawl_task* tasks;
+  int tasks_head;
+  int tasks_tail;
+  int tasks_size;
+
+  flickcurl_crawl_work* works;
+  int works_count;
+
+  int started;
+  /* non-0 while calls are not to be submitted */
+  int submitting;
+};
+
+
+static void flickcurl_crawler_submit(flickcurl_crawler* crawler);
+
+
+static uint64_t
+flickcurl_crawl_hash(const char* id, size_t len)
+{
+  /* FNV-1a */
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+
+  for(i = 0; i < len; i++) {
+    hash ^= (unsigned char)id[i];
+    hash *= 1099511628211ULL;
+  }
+
+  /* 0 marks an empty slot */
+  return hash ? hash : 1;
+}
+
+
+/* Test the Bloom filter bits of @hash, setting them if @set */
+static int
+flickcurl_crawl_bloom(flickcurl_crawler* crawler, uint64_t hash, int set)
+{
+  uint32_t h1 = (uint32_t)hash;
+  uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+  int present = 1;
+  int i;
+
+  for(i = 0; i < FLICKCURL_CRAWL_BLOOM_HASHES; i++) {
+    size_t bit = (size_t)(h1 + (uint32_t)i * h2) % crawler->bloom_bits;
+    unsigned char mask = (unsigned char)(1 << (bit & 7));
+
+    if(!(crawler->bloom[bit >> 3] & mask)) {
+      present = 0;
+      if(!set)
+        break;
+      crawler->bloom[bit >> 3] |= mask;
+    }
+  }
+
+  return present;
+}
+
+
+/* Find the slot of @id or the empty slot where it would go */
+static flickcurl_crawl_slot*
+flickcurl_crawl_find_slot(flickcurl_crawl_slot* slots, size_t slots_count,
+                          uint64_t hash, const char* id)
+{
+  size_t i = (size_t)hash & (slots_count - 1);
+
+  while(slots[i].hash) {
+    if(slots[i].hash == hash && !strcmp(slots[i].id, id))
+      break;
+    i = (i + 1) & (slots_count - 1);
+  }
+
+  return &slots[i];
+}
+
+
+/* Make the name of a state file from the base name and @suffix */
+static char*
+flickcurl_crawl_filename(flickcurl_crawler* crawler, const char* suffix)
+{
+  size_t len = strlen(crawler->state_filename);
+  size_t suffix_len = strlen(suffix);
+  char* filename;
+
+  filename = (char*)malloc(len + suffix_len + 1);
+  if(!filename)
+    return NULL;
+  memcpy(filename, crawler->state_filename, len);
+  memcpy(filename + len, suffix, suffix_len + 1);
+
+  return filename;
+}
+
+
+/* Free a visited set table of @slots_count slots */
+static void
+flickcurl_crawl_free_table(flickcurl_crawl_slot* slots, size_t slots_count,
+                           int fd)
+{
+#ifdef FLICKCURL_CRAWL_MMAP
+  if(fd >= 0) {
+    munmap(slots, slots_count * sizeof(*slots));
+    close(fd);
+    return;
+  }
+#endif
+  free(slots);
+}
+
+
+/*
+ * Replace the visited set table with an empty one of @slots_count
+ * slots holding the IDs of the old one.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+flickcurl_crawl_resize_table(flickcurl_crawler* crawler, size_t slots_count)
+{
+  flickcurl_crawl_slot* slots = NULL;
+  int fd = -1;
+  size_t i;
+
+#ifdef FLICKCURL_CRAWL_MMAP
+  if(crawler->state_filename) {
+    char* new_filename = flickcurl_crawl_filename(crawler, ".set.new");
+    char* filename = flickcurl_crawl_filename(crawler, ".set");
+    size_t size = slots_count * sizeof(*slots);
+    int rc = 1;
+
+    /* a new file is mapped and renamed over the old one */
+    if(new_filename && filename) {
+      fd = open(new_filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+      if(fd >= 0 && !ftruncate(fd, (off_t)size)) {
+        void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fd, 0);
+
+        if(base != MAP_FAILED) {
+          slots = (flickcurl_crawl_slot*)base;
+          rc = rename(new_filename, filename);
+        }
+      }
+    }
+    if(new_filename)
+      free(new_filename);
+    if(filename)
+      free(filename);
+
+    if(rc) {
+      if(slots)
+        munmap(slots, size);
+      if(fd >= 0)
+        close(fd);
+      return 1;
+    }
+  } else
+#endif
+  {
+    slots = (flickcurl_crawl_slot*)calloc(slots_count, sizeof(*slots));
+    if(!slots)
+      return 1;
+  }
+
+  for(i = 0; i < crawler->slots_count; i++) {
+    flickcurl_crawl_slot* old = &crawler->slots[i];
+
+    if(old->hash)
+      memcpy(flickcurl_crawl_find_slot(slots, slots_count, old->hash,
+                                       old->id), old, sizeof(*old));
+  }
+
+  if(crawler->slots)
+    flickcurl_crawl_free_table(crawler->slots, crawler->slots_count,
+                               crawler->table_fd);
+  crawler->slots = slots;
+  crawler->slots_count = slots_count;
+  crawler->table_fd = fd;
+
+  return 0;
+}
+
+
+/* Append a node record to the log; return non-0 on failure */
+static int
+flickcurl_crawl_log_append(flickcurl_crawler* crawler, int depth,
+                           const char* id, size_t len)
+{
+  unsigned char depth_byte = (unsigned char)depth;
+
+  if(crawler->log_writer) {
+    if(fwrite(&depth_byte, 1, 1, crawler->log_writer) != 1 ||
+       fwrite(id, 1, len + 1, crawler->log_writer) != len + 1)
+      return 1;
+  } else {
+    if(crawler->log_length + len + 2 > crawler->log_size) {
+      size_t size = crawler->log_size ? crawler->log_size * 2 : 4096;
+      char* buffer;
+
+      while(size < crawler->log_length + len + 2)
+        size *= 2;
+      buffer = (char*)realloc(crawler->log_buffer, size);
+      if(!buffer)
+        return 1;
+      crawler->log_buffer = buffer;
+      crawler->log_size = size;
+    }
+    crawler->log_buffer[crawler->log_length] = (char)depth_byte;
+    memcpy(crawler->log_buffer + crawler->log_length + 1, id, len + 1);
+  }
+
+  crawler->log_length += len + 2;
+  return 0;
+}
+
+
+/* Depth of the node record at the read offset or < 0 if there is none */
+static int
+flickcurl_crawl_log_peek(flickcurl_crawler* crawler)
+{
+  int c;
+
+  if(crawler->read_offset >= crawler->log_length)
+    return -1;
+
+  if(!crawler->log_reader)
+    return (unsigned char)crawler->log_buffer[crawler->read_offset];
+
+  if(crawler->read_offset >= crawler->log_flushed ||
+     feof(crawler->log_reader)) {
+    /* let the reader see what has been written, dropping anything it
+     * buffered from before */
+    if(crawler->log_flushed < crawler->log_length) {
+      if(fflush(crawler->log_writer))
+        return -1;
+      crawler->log_flushed = crawler->log_length;
+    }
+    if(fseek(crawler->log_reader, (long)crawler->read_offset, SEEK_SET))
+      return -1;
+  }
+
+  c = getc(crawler->log_reader);
+  if(c == EOF)
+    return -1;
+  ungetc(c, crawler->log_reader);
+
+  return c;
+}
+
+
+/*
+ * Read the node record at the read offset into @id of
+ * FLICKCURL_CRAWL_ID_SIZE bytes and *@depth_p, moving past it.
+ *
+ * Return value: non-0 if there is none or on failure
+ */
+static int
+flickcurl_crawl_log_read(flickcurl_crawler* crawler, char* id, int* depth_p)
+{
+  size_t len = 0;
+  int c;
+
+  *depth_p = flickcurl_crawl_log_peek(crawler);
+  if(*depth_p < 0)
+    return 1;
+
+  if(!crawler->log_reader) {
+    const char* record = crawler->log_buffer + crawler->read_offset;
+
+    len = strlen(record + 1);
+    memcpy(id, record + 1, len + 1);
+    crawler->read_offset += len + 2;
+    return 0;
+  }
+
+  getc(crawler->log_reader);
+  while((c = getc(crawler->log_reader)) != EOF && c) {
+    if(len == FLICKCURL_CRAWL_ID_SIZE - 1)
+      return 1;
+    id[len++] = (char)c;
+  }
+  if(c == EOF)
+    return 1;
+  id[len] = '\0';
+
+  crawler->read_offset += len + 2;
+  return 0;
+}
+
+
+/* Insert new node @id at @depth into the visited set */
+static int
+flickcurl_crawl_insert(flickcurl_crawler* crawler, uint64_t hash,
+                       const char* id, size_t len, int depth)
+{
+  flickcurl_crawl_slot* slot;
+
+  /* keep the table at most half full */
+  if((crawler->slots_used + 1) * 2 > crawler->slots_count &&
+     flickcurl_crawl_resize_table(crawler, crawler->slots_count * 2)) {
+    flickcurl_error(crawler->fc, "Failed to grow the crawl visited set");
+    return 1;
+  }
+
+  slot = flickcurl_crawl_find_slot(crawler->slots, crawler->slots_count,
+                                   hash, id);
+  slot->hash = hash;
+  memcpy(slot->id, id, len + 1);
+  crawler->slots_used++;
+  flickcurl_crawl_bloom(crawler, hash, 1);
+
+  crawler->nodes_count++;
+  crawler->depth_counts[depth]++;
+
+  return 0;
+}
+
+
+/*
+ * Add node @id at @depth to the visited set and the log unless it is
+ * there already or the depth is full, reporting the edge from
+ * @from_id to the handler.
+ *
+ * Return value: 1 if new, 0 if not, < 0 on failure
+ */
+static int
+flickcurl_crawl_add_node(flickcurl_crawler* crawler, const char* id,
+                         const char* from_id, int depth)
+{
+  size_t len = strlen(id);
+  uint64_t hash;
+  flickcurl_crawl_slot* slot;
+
+  if(len >= FLICKCURL_CRAWL_ID_SIZE) {
+    flickcurl_error(crawler->fc, "Crawl node ID '%s' is too long", id);
+    return -1;
+  }
+
+  hash = flickcurl_crawl_hash(id, len);
+  if(flickcurl_crawl_bloom(crawler, hash, 0)) {
+    /* maybe seen: the table knows */
+    slot = flickcurl_crawl_find_slot(crawler->slots, crawler->slots_count,
+                                     hash, id);
+    if(slot->hash) {
+      if(crawler->handler)
+        crawler->handler(crawler->handler_data, id, from_id, depth, 0);
+      return 0;
+    }
+  }
+
+  if(crawler->depth_limits[depth] >= 0 &&
+     crawler->depth_counts[depth] >= crawler->depth_limits[depth])
+    return 0;
+
+  if(flickcurl_crawl_log_append(crawler, depth, id, len)) {
+    flickcurl_error(crawler->fc, "Failed to write the crawl node log");
+    return -1;
+  }
+
+  if(flickcurl_crawl_insert(crawler, hash, id, len, depth))
+    return -1;
+
+  if(crawler->handler)
+    crawler->handler(crawler->handler_data, id, from_id, depth, 1);
+
+  return 1;
+}
+
+
+/**
+ * flickcurl_crawler_params_init:
+ * @params: crawler params to init
+ *
+ * Initialise an existing crawler parameter structure
+ *
+ * The defaults are a depth of 2 with no limits per depth, 8 calls
+ * at once, 500 items per page, the crawl kept in memory and a
+ * visited set sized for a million nodes.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_crawler_params_init(flickcurl_crawler_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(*params));
+  params->version = 1;
+  params->max_depth = 2;
+  params->concurrency = 8;
+  params->per_page = 500;
+  params->checkpoint_interval = 1000;
+  params->expected_nodes = 1000000;
+
+  return 0;
+}
+
+
+/* Read the checkpoint state file; return non-0 if there is none */
+static int
+flickcurl_crawl_read_state(flickcurl_crawler* crawler, size_t* cursor_p,
+                           size_t* length_p)
+{
+  char* filename = flickcurl_crawl_filename(crawler, ".state");
+  char magic[32];
+  unsigned long cursor;
+  unsigned long length;
+  int expanded;
+  int failed;
+  FILE* fh;
+  int rc = 1;
+
+  if(!filename)
+    return 1;
+  fh = fopen(filename, "r");
+  free(filename);
+  if(!fh)
+    return 1;
+
+  if(fgets(magic, sizeof(magic), fh) &&
+     !strncmp(magic, FLICKCURL_CRAWL_STATE_MAGIC,
+              strlen(FLICKCURL_CRAWL_STATE_MAGIC)) &&
+     fscanf(fh, "cursor %lu\nlength %lu\nexpanded %d\nfailed %d\n",
+            &cursor, &length, &expanded, &failed) == 4 &&
+     cursor <= length) {
+    *cursor_p = (size_t)cursor;
+    *length_p = (size_t)length;
+    crawler->expanded_count = expanded;
+    crawler->failed_count = failed;
+    rc = 0;
+  }
+  fclose(fh);
+
+  return rc;
+}
+
+
+/*
+ * Open the node log, resuming from the last checkpoint if there is
+ * one by reading the log up to it into the visited set.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+flickcurl_crawl_open_log(flickcurl_crawler* crawler)
+{
+  char* filename;
+  size_t cursor = 0;
+  size_t length = 0;
+  int resume;
+  int rc = 1;
+
+  filename = flickcurl_crawl_filename(crawler, ".log");
+  if(!filename)
+    return 1;
+
+  resume = !flickcurl_crawl_read_state(crawler, &cursor, &length);
+  if(resume) {
+    /* anything after the checkpointed length is cut off */
+    crawler->log_writer = fopen(filename, "r+b");
+    if(crawler->log_writer) {
+      if(fseek(crawler->log_writer, 0, SEEK_END) ||
+         ftell(crawler->log_writer) < (long)length)
+        goto tidy;
+#ifdef HAVE_FTRUNCATE
+      if(fflush(crawler->log_writer) ||
+         ftruncate(fileno(crawler->log_writer), (off_t)length))
+        goto tidy;
+#endif
+      if(fseek(crawler->log_writer, (long)length, SEEK_SET))
+        goto tidy;
+    }
+  }
+  if(!crawler->log_writer) {
+    resume = 0;
+    crawler->log_writer = fopen(filename, "w+b");
+  }
+  if(!crawler->log_writer)
+    goto tidy;
+
+  crawler->log_reader = fopen(filename, "rb");
+  if(!crawler->log_reader)
+    goto tidy;
+
+  if(resume) {
+    char id[FLICKCURL_CRAWL_ID_SIZE];
+    int depth;
+
+    crawler->log_length = length;
+    crawler->log_flushed = length;
+    while(crawler->read_offset < length) {
+      size_t offset = crawler->read_offset;
+      size_t len;
+
+      if(flickcurl_crawl_log_read(crawler, id, &depth) ||
+         depth > crawler->params.max_depth)
+        goto tidy;
+
+      len = strlen(id);
+      if(flickcurl_crawl_insert(crawler, flickcurl_crawl_hash(id, len), id,
+                                len, depth))
+        goto tidy;
+      if(offset < cursor)
+        crawler->nodes_read++;
+    }
+
+    crawler->read_offset = cursor;
+    if(fseek(crawler->log_reader, (long)cursor, SEEK_SET))
+      goto tidy;
+  }
+
+  rc = 0;
+
+  tidy:
+  free(filename);
+  return rc;
+}
+
+
+/* Add @task to the end of the task queue; return non-0 on failure */
+static int
+flickcurl_crawl_add_task(flickcurl_crawler* crawler, flickcurl_crawl_task* task)
+{
+  if(crawler->tasks_tail == crawler->tasks_size) {
+    if(crawler->tasks_head > 0) {
+      /* reuse the space of tasks already taken */
+      memmove(crawler->tasks, crawler->tasks + crawler->tasks_head,
+              (crawler->tasks_tail - crawler->tasks_head) * sizeof(*task));
+      crawler->tasks_tail -= crawler->tasks_head;
+      crawler->tasks_head = 0;
+    }
+
+    if(crawler->tasks_tail == crawler->tasks_size) {
+      int size = crawler->tasks_size ? crawler->tasks_size * 2 : 64;
+      flickcurl_crawl_task* tasks;
+
+      tasks = (flickcurl_crawl_task*)realloc(crawler->tasks,
+                                             size * sizeof(*task));
+      if(!tasks)
+        return 1;
+      crawler->tasks = tasks;
+      crawler->tasks_size = size;
+    }
+  }
+
+  memcpy(&crawler->tasks[crawler->tasks_tail++], task, sizeof(*task));
+  task->node->calls++;
+  return 0;
+}
+
+
+/* Count a node as done with, checkpointing when it is time to */
+static void
+flickcurl_crawl_node_done(flickcurl_crawler* crawler, int failed)
+{
+  if(failed)
+    crawler->failed_count++;
+  else
+    crawler->expanded_count++;
+
+  if(crawler->params.checkpoint_interval > 0 &&
+     ++crawler->since_checkpoint >= crawler->params.checkpoint_interval)
+    flickcurl_crawler_checkpoint(crawler);
+}
+
+
+/* End a call of expanding node @node */
+static void
+flickcurl_crawl_end_call(flickcurl_crawler* crawler, flickcurl_crawl_node* node,
+                         int failed)
+{
+  if(failed)
+    node->failed = 1;
+  if(--node->calls > 0)
+    return;
+
+  if(node->prev)
+    node->prev->next = node->next;
+  else
+    crawler->nodes = node->next;
+  if(node->next)
+    node->next->prev = node->prev;
+  crawler->nodes_expanding--;
+
+  flickcurl_crawl_node_done(crawler, node->failed);
+  free(node);
+}
+
+
+/*
+ * Read the next node from the log and queue the calls expanding it.
+ *
+ * Return value: non-0 if there are no nodes to expand yet
+ */
+static int
+flickcurl_crawl_next_node(flickcurl_crawler* crawler)
+{
+  flickcurl_crawl_node* node;
+  flickcurl_crawl_task task;
+  size_t offset = crawler->read_offset;
+  int depth;
+  int i;
+
+  node = (flickcurl_crawl_node*)calloc(1, sizeof(*node));
+  if(!node) {
+    flickcurl_error(crawler->fc, "Out of memory");
+    return 1;
+  }
+
+  /* a depth is done with before the next is started so every node
+   * is found first at its shortest distance from the seeds */
+  depth = flickcurl_crawl_log_peek(crawler);
+  if(depth < 0 || (depth > crawler->level && crawler->nodes_expanding)) {
+    if(depth < 0 && crawler->read_offset < crawler->log_length)
+      flickcurl_error(crawler->fc, "Failed to read the crawl node log");
+    free(node);
+    return 1;
+  }
+
+  if(flickcurl_crawl_log_read(crawler, node->id, &depth)) {
+    flickcurl_error(crawler->fc, "Failed to read the crawl node log");
+    free(node);
+    return 1;
+  }
+  crawler->nodes_read++;
+  crawler->level = depth;
+
+  node->offset = offset;
+  node->index = crawler->nodes_read - 1;
+  node->depth = depth;
+
+  node->next = crawler->nodes;
+  if(crawler->nodes)
+    crawler->nodes->prev = node;
+  crawler->nodes = node;
+  crawler->nodes_expanding++;
+
+  /* the calls are counted from 1 so none ends the node while queueing */
+  node->calls = 1;
+  if(depth < crawler->params.max_depth) {
+    for(i = 0; i < crawler->expansions_count; i++) {
+      flickcurl_crawl_expansion* e = &crawler->expansions[i];
+
+      if(depth < e->first_depth || depth > e->last_depth)
+        continue;
+
+      task.node = node;
+      task.expansion = i;
+      task.page = 1;
+      if(flickcurl_crawl_add_task(crawler, &task)) {
+        flickcurl_error(crawler->fc, "Out of memory");
+        node->failed = 1;
+        break;
+      }
+    }
+  }
+  flickcurl_crawl_end_call(crawler, node, 0);
+
+  return 0;
+}
+
+
+/* Asynchronous call builder running the expander of the work in @builder_data */
+static void*
+flickcurl_crawl_build(flickcurl* fc, void* builder_data)
+{
+  flickcurl_crawl_work* w = (flickcurl_crawl_work*)builder_data;
+  flickcurl_crawler* crawler = w->crawler;
+  flickcurl_crawl_expansion* e = &crawler->expansions[w->task.expansion];
+
+  return e->expander(fc, e->user_data, w->task.node->id,
+                     crawler->params.per_page, w->task.page);
+}
+
+
+/* Asynchronous call handler adding the neighbours found by a call */
+static void
+flickcurl_crawl_call_handler(void* user_data, flickcurl_async_call* call,
+                             void* result)
+{
+  flickcurl_crawl_work* w = (flickcurl_crawl_work*)user_data;
+  flickcurl_crawler* crawler = w->crawler;
+  flickcurl_crawl_node* node = w->task.node;
+  char** ids = (char**)result;
+  int failed = !ids;
+  int count;
+
+  if(w->prev)
+    w->prev->next = w->next;
+  else
+    crawler->works = w->next;
+  if(w->next)
+    w->next->prev = w->prev;
+  crawler->works_count--;
+
+  for(count = 0; ids && ids[count]; count++) {
+    if(!failed &&
+       flickcurl_crawl_add_node(crawler, ids[count], node->id,
+                                node->depth + 1) < 0)
+      failed = 1;
+    free(ids[count]);
+  }
+  if(ids)
+    free(ids);
+
+  /* a full page may have another after it */
+  if(!failed && count == crawler->params.per_page) {
+    flickcurl_crawl_task task;
+
+    memcpy(&task, &w->task, sizeof(task));
+    task.page++;
+    if(flickcurl_crawl_add_task(crawler, &task)) {
+      flickcurl_error(crawler->fc, "Out of memory");
+      failed = 1;
+    }
+  }
+
+  if(w->cancelled) {
+    /* the node is expanded again when the crawl is resumed */
+    node->calls--;
+  } else
+    flickcurl_crawl_end_call(crawler, node, failed);
+
+  free(w);
+
+  flickcurl_crawler_submit(crawler);
+}
+
+
+/* Submit queued calls and expand new nodes up to the concurrency limit */
+static void
+flickcurl_crawler_submit(flickcurl_crawler* crawler)
+{
+  /* handlers of calls that end at once come back here */
+  if(crawler->submitting || !crawler->started)
+    return;
+  crawler->submitting = 1;
+
+  while(crawler->works_count < crawler->params.concurrency) {
+    flickcurl_crawl_work* w;
+    flickcurl_async_call* call;
+
+    /* calls of nodes being expanded come before new nodes */
+    if(crawler->tasks_head == crawler->tasks_tail) {
+      if(flickcurl_crawl_next_node(crawler))
+        break;
+      continue;
+    }
+
+    w = (flickcurl_crawl_work*)calloc(1, sizeof(*w));
+    if(!w) {
+      flickcurl_error(crawler->fc, "Out of memory");
+      break;
+    }
+    w->crawler = crawler;
+    memcpy(&w->task, &crawler->tasks[crawler->tasks_head++], sizeof(w->task));
+
+    w->next = crawler->works;
+    if(crawler->works)
+      crawler->works->prev = w;
+    crawler->works = w;
+    crawler->works_count++;
+
+    /* on NULL the handler has been called and @w freed */
+    call = flickcurl_async_submit(crawler->fc, flickcurl_crawl_build, w,
+                                  flickcurl_crawl_call_handler, w);
+    if(call)
+      w->call = call;
+  }
+
+  crawler->submitting = 0;
+}
+
+
+/**
+ * flickcurl_new_crawler:
+ * @fc: flickcurl object
+ * @params: crawler parameters or NULL for the defaults
+ *
+ * Constructor - create a graph crawler
+ *
+ * A crawl starts from the seed IDs added with
+ * flickcurl_crawler_add_seed() and expands nodes breadth first with
+ * the expanders added with flickcurl_crawler_add_expander() up to
+ * @params max_depth, reporting every node and edge found to the
+ * handler set with flickcurl_crawler_set_handler().  The expander
+ * calls are asynchronous so flickcurl_set_async_handlers() must have
+ * been called on @fc before flickcurl_crawler_start().
+ *
+ * With @params state_filename set, the crawl is kept in files
+ * starting with that name and a checkpoint is made every
+ * @params checkpoint_interval nodes and when the crawler is freed.
+ * If a checkpoint exists the crawl resumes from it: the nodes found
+ * before it are not reported again and seeds already found are
+ * ignored.
+ *
+ * The crawler must be freed before @fc.
+ *
+ * Return value: new crawler or NULL on failure
+ */
+flickcurl_crawler*
+flickcurl_new_crawler(flickcurl* fc, flickcurl_crawler_params* params)
+{
+  flickcurl_crawler* crawler;
+  flickcurl_crawler_params defaults;
+  size_t expected;
+  int i;
+
+  if(!params) {
+    flickcurl_crawler_params_init(&defaults);
+    params = &defaults;
+  }
+
+  if(params->version != 1 || params->max_depth < 0 ||
+     params->max_depth > FLICKCURL_CRAWL_MAX_DEPTH ||
+     params->concurrency < 1 || params->per_page < 1 ||
+     params->checkpoint_interval < 0 || params->expected_nodes < 0) {
+    flickcurl_error(fc, "Bad crawler parameters");
+    return NULL;
+  }
+
+  crawler = (flickcurl_crawler*)calloc(1, sizeof(*crawler));
+  if(!crawler)
+    goto oom;
+
+  crawler->fc = fc;
+  memcpy(&crawler->params, params, sizeof(*params));
+  crawler->params.depth_limits = NULL;
+  crawler->params.state_filename = NULL;
+  crawler->table_fd = -1;
+
+  crawler->depth_limits = (int*)malloc((params->max_depth + 1) * sizeof(int));
+  crawler->depth_counts = (int*)calloc(params->max_depth + 1, sizeof(int));
+  if(!crawler->depth_limits || !crawler->depth_counts)
+    goto oom;
+  for(i = 0; i <= params->max_depth; i++)
+    crawler->depth_limits[i] = params->depth_limits ?
+                               params->depth_limits[i] : -1;
+
+  if(params->state_filename) {
+    size_t len = strlen(params->state_filename);
+
+    crawler->state_filename = (char*)malloc(len + 1);
+    if(!crawler->state_filename)
+      goto oom;
+    memcpy(crawler->state_filename, params->state_filename, len + 1);
+  }
+
+  expected = (size_t)params->expected_nodes;
+  if(expected < FLICKCURL_CRAWL_MIN_SLOTS)
+    expected = FLICKCURL_CRAWL_MIN_SLOTS;
+  crawler->bloom_bits = expected * FLICKCURL_CRAWL_BLOOM_BITS;
+  crawler->bloom = (unsigned char*)calloc((crawler->bloom_bits + 7) / 8, 1);
+  if(!crawler->bloom)
+    goto oom;
+
+  if(flickcurl_crawl_resize_table(crawler, FLICKCURL_CRAWL_MIN_SLOTS)) {
+    flickcurl_error(fc, "Failed to create the crawl visited set");
+    goto fail;
+  }
+
+  if(crawler->state_filename && flickcurl_crawl_open_log(crawler)) {
+    flickcurl_error(fc, "Failed to open the crawl node log");
+    goto fail;
+  }
+
+  return crawler;
+
+  oom:
+  flickcurl_error(fc, "Out of memory");
+  fail:
+  if(crawler)
+    flickcurl_free_crawler(crawler);
+  return NULL;
+}
+
+
+/**
+ * flickcurl_free_crawler:
+ * @crawler: crawler
+ *
+ * Destructor - free a crawler, making a checkpoint and cancelling its calls
+ */
+void
+flickcurl_free_crawler(flickcurl_crawler* crawler)
+{
+  flickcurl_crawl_work* w;
+  flickcurl_crawl_work* next;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(crawler, flickcurl_crawler);
+
+  if(crawler->started)
+    flickcurl_crawler_checkpoint(crawler);
+
+  crawler->submitting = 1;
+  for(w = crawler->works; w; w = next) {
+    next = w->next;
+    w->cancelled = 1;
+    flickcurl_async_cancel(crawler->fc, w->call);
+  }
+
+  while(crawler->nodes) {
+    flickcurl_crawl_node* node = crawler->nodes;
+
+    crawler->nodes = node->next;
+    free(node);
+  }
+
+  if(crawler->tasks)
+    free(crawler->tasks);
+  if(crawler->log_writer)
+    fclose(crawler->log_writer);
+  if(crawler->log_reader)
+    fclose(crawler->log_reader);
+  if(crawler->log_buffer)
+    free(crawler->log_buffer);
+  if(crawler->slots)
+    flickcurl_crawl_free_table(crawler->slots, crawler->slots_count,
+                               crawler->table_fd);
+  if(crawler->bloom)
+    free(crawler->bloom);
+  if(crawler->state_filename)
+    free(crawler->state_filename);
+  if(crawler->depth_limits)
+    free(crawler->depth_limits);
+  if(crawler->depth_counts)
+    free(crawler->depth_counts);
+
+  free(crawler);
+}
+
+
+/**
+ * flickcurl_crawler_add_expander:
+ * @crawler: crawler
+ * @expander: expander function
+ * @user_data: user data for @expander
+ * @first_depth: depth of the first nodes to expand with @expander
+ * @last_depth: depth of the last nodes to expand with @expander
+ *
+ * Add a way of finding the neighbours of nodes to a crawler
+ *
+ * The nodes of depths @first_depth to @last_depth are expanded with
+ * @expander, so for example users can be expanded into their contacts
+ * and groups into their members at alternate depths.  The built in
+ * expanders are flickcurl_crawl_expand_contacts(),
+ * flickcurl_crawl_expand_group_members() and
+ * flickcurl_crawl_expand_favorites_owners().
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_crawler_add_expander(flickcurl_crawler* crawler,
+                               flickcurl_crawl_expander expander,
+                               void* user_data,
+                               int first_depth, int last_depth)
+{
+  flickcurl_crawl_expansion* e;
+
+  if(!expander || first_depth < 0 || last_depth < first_depth) {
+    flickcurl_error(crawler->fc, "Bad crawl expander depths");
+    return 1;
+  }
+
+  if(crawler->started ||
+     crawler->expansions_count == FLICKCURL_CRAWL_MAX_EXPANDERS) {
+    flickcurl_error(crawler->fc, "Cannot add a crawl expander");
+    return 1;
+  }
+
+  e = &crawler->expansions[crawler->expansions_count++];
+  e->expander = expander;
+  e->user_data = user_data;
+  e->first_depth = first_depth;
+  e->last_depth = last_depth;
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_crawler_set_handler:
+ * @crawler: crawler
+ * @handler: node handler or NULL
+ * @user_data: user data for @handler
+ *
+ * Set the function told of the nodes and edges a crawler finds
+ */
+void
+flickcurl_crawler_set_handler(flickcurl_crawler* crawler,
+                              flickcurl_crawl_handler handler,
+                              void* user_data)
+{
+  crawler->handler = handler;
+  crawler->handler_data = user_data;
+}
+
+
+/**
+ * flickcurl_crawler_add_seed:
+ * @crawler: crawler
+ * @id: node ID
+ *
+ * Add a node to start a crawl from at depth 0
+ *
+ * A seed found already, such as when resuming a crawl, is not added
+ * again.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_crawler_add_seed(flickcurl_crawler* crawler, const char* id)
+{
+  if(flickcurl_crawl_add_node(crawler, id, NULL, 0) < 0)
+    return 1;
+
+  flickcurl_crawler_submit(crawler);
+  return 0;
+}
+
+
+/**
+ * flickcurl_crawler_start:
+ * @crawler: crawler
+ *
+ * Start making the calls of a crawl
+ *
+ * The crawl runs as the application's event loop handles the
+ * asynchronous calls until flickcurl_crawler_get_pending() returns 0.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_crawler_start(flickcurl_crawler* crawler)
+{
+  if(!crawler->fc->async.multi) {
+    flickcurl_error(crawler->fc, "No asynchronous call handlers set");
+    return 1;
+  }
+
+  crawler->started = 1;
+  flickcurl_crawler_submit(crawler);
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_crawler_checkpoint:
+ * @crawler: crawler
+ *
+ * Save the state of a crawl so it can be resumed
+ *
+ * This is done every @checkpoint_interval nodes and when the crawler
+ * is freed; it does nothing without a state file.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_crawler_checkpoint(flickcurl_crawler* crawler)
+{
+  flickcurl_crawl_node* node;
+  size_t cursor = crawler->read_offset;
+  int cursor_index = crawler->nodes_read;
+  int expanded;
+  char* new_filename;
+  char* filename;
+  FILE* fh;
+  int rc = 1;
+
+  if(!crawler->state_filename)
+    return 0;
+
+  crawler->since_checkpoint = 0;
+
+  /* the nodes being expanded are expanded again on resuming */
+  for(node = crawler->nodes; node; node = node->next) {
+    if(node->offset < cursor) {
+      cursor = node->offset;
+      cursor_index = node->index;
+    }
+  }
+
+  /* so are the nodes after them already done with */
+  expanded = crawler->expanded_count -
+             (crawler->nodes_read - cursor_index - crawler->nodes_expanding);
+  if(expanded < 0)
+    expanded = 0;
+
+  if(fflush(crawler->log_writer)) {
+    flickcurl_error(crawler->fc, "Failed to write the crawl node log");
+    return 1;
+  }
+  crawler->log_flushed = crawler->log_length;
+
+  new_filename = flickcurl_crawl_filename(crawler, ".state.new");
+  filename = flickcurl_crawl_filename(crawler, ".state");
+  if(!new_filename || !filename)
+    goto tidy;
+
+  fh = fopen(new_filename, "w");
+  if(!fh)
+    goto tidy;
+  fprintf(fh, "%s\ncursor %lu\nlength %lu\nexpanded %d\nfailed %d\n",
+          FLICKCURL_CRAWL_STATE_MAGIC, (unsigned long)cursor,
+          (unsigned long)crawler->log_length, expanded, crawler->failed_count);
+  if(fclose(fh))
+    goto tidy;
+
+  /* replaced at once so there is always a whole state file */
+  rc = rename(new_filename, filename);
+
+  tidy:
+  if(rc)
+    flickcurl_error(crawler->fc, "Failed to write the crawl state file");
+  if(new_filename)
+    free(new_filename);
+  if(filename)
+    free(filename);
+
+  return rc;
+}
+
+
+/**
+ * flickcurl_crawler_get_pending:
+ * @crawler: crawler
+ *
+ * Get the number of nodes found but not yet done with
+ *
+ * Return value: number of nodes left to expand; 0 when the crawl is over
+ */
+int
+flickcurl_crawler_get_pending(flickcurl_crawler* crawler)
+{
+  return (crawler->nodes_count - crawler->nodes_read) +
+         crawler->nodes_expanding;
+}
+
+
+/**
+ * flickcurl_crawler_get_counts:
+ * @crawler: crawler
+ * @nodes_p: pointer to store the number of nodes found (or NULL)
+ * @expanded_p: pointer to store the number of nodes done with (or NULL)
+ * @failed_p: pointer to store the number of nodes with failed expansions (or NULL)
+ *
+ * Get the progress of a crawl
+ *
+ * The counts include the nodes of the crawl before it was resumed.
+ */
+void
+flickcurl_crawler_get_counts(flickcurl_crawler* crawler, int* nodes_p,
+                             int* expanded_p, int* failed_p)
+{
+  if(nodes_p)
+    *nodes_p = crawler->nodes_count;
+  if(expanded_p)
+    *expanded_p = crawler->expanded_count;
+  if(failed_p)
+    *failed_p = crawler->failed_count;
+}
+
+
+/* Make an expander result of @count IDs */
+static char**
+flickcurl_crawl_new_ids(int count)
+{
+  return (char**)calloc(count + 1, sizeof(char*));
+}
+
+
+/* Copy @id into @ids at @i; return non-0 on failure */
+static int
+flickcurl_crawl_set_id(char** ids, int i, const char* id)
+{
+  size_t len;
+
+  if(!id)
+    return 1;
+  len = strlen(id);
+  ids[i] = (char*)malloc(len + 1);
+  if(!ids[i])
+    return 1;
+  memcpy(ids[i], id, len + 1);
+
+  return 0;
+}
+
+
+/* Free a partly made expander result */
+static void
+flickcurl_crawl_free_ids(char** ids)
+{
+  int i;
+
+  for(i = 0; ids[i]; i++)
+    free(ids[i]);
+  free(ids);
+}
+
+
+/**
+ * flickcurl_crawl_expand_contacts:
+ * @fc: flickcurl object
+ * @user_data: not used
+ * @id: user NSID
+ * @per_page: number of IDs per page
+ * @page: page number from 1
+ *
+ * Crawl expander finding the public contacts of a user
+ *
+ * Uses flickcurl_contacts_getPublicList().
+ *
+ * Return value: NULL-terminated list of user NSIDs or NULL on failure
+ */
+char**
+flickcurl_crawl_expand_contacts(flickcurl* fc, void* user_data,
+                                const char* id, int per_page, int page)
+{
+  flickcurl_contact** contacts;
+  char** ids;
+  int count;
+  int i;
+
+  contacts = flickcurl_contacts_getPublicList(fc, id, page, per_page);
+  if(!contacts)
+    return NULL;
+
+  for(count = 0; contacts[count]; count++)
+    ;
+  ids = flickcurl_crawl_new_ids(count);
+  for(i = 0; ids && i < count; i++) {
+    if(flickcurl_crawl_set_id(ids, i, contacts[i]->nsid)) {
+      flickcurl_crawl_free_ids(ids);
+      ids = NULL;
+    }
+  }
+
+  flickcurl_free_contacts(contacts);
+  return ids;
+}
+
+
+/**
+ * flickcurl_crawl_expand_group_members:
+ * @fc: flickcurl object
+ * @user_data: not used
+ * @id: group NSID
+ * @per_page: number of IDs per page
+ * @page: page number from 1
+ *
+ * Crawl expander finding the members of a group
+ *
+ * Uses flickcurl_groups_members_getList() which needs the caller to
+ * be a member of the group.
+ *
+ * Return value: NULL-terminated list of user NSIDs or NULL on failure
+ */
+char**
+flickcurl_crawl_expand_group_members(flickcurl* fc, void* user_data,
+                                     const char* id, int per_page, int page)
+{
+  flickcurl_member** members;
+  char** ids;
+  int count;
+  int i;
+
+  members = flickcurl_groups_members_getList(fc, id, NULL, per_page, page);
+  if(!members)
+    return NULL;
+
+  for(count = 0; members[count]; count++)
+    ;
+  ids = flickcurl_crawl_new_ids(count);
+  for(i = 0; ids && i < count; i++) {
+    if(flickcurl_crawl_set_id(ids, i, members[i]->nsid)) {
+      flickcurl_crawl_free_ids(ids);
+      ids = NULL;
+    }
+  }
+
+  flickcurl_free_members(members);
+  return ids;
+}
+
+
+/**
+ * flickcurl_crawl_expand_favorites_owners:
+ * @fc: flickcurl object
+ * @user_data: not used
+ * @id: user NSID
+ * @per_page: number of IDs per page
+ * @page: page number from 1
+ *
+ * Crawl expander finding the owners of the public favorites of a user
+ *
+ * Uses flickcurl_favorites_getPublicList().  An owner of several
+ * favorites is in the list once per favorite.
+ *
+ * Return value: NULL-terminated list of user NSIDs or NULL on failure
+ */
+char**
+flickcurl_crawl_expand_favorites_owners(flickcurl* fc, void* user_data,
+                                        const char* id, int per_page,
+                                        int page)
+{
+  flickcurl_photo** photos;
+  char** ids;
+  int count;
+  int i;
+
+  photos = flickcurl_favorites_getPublicList(fc, id, NULL, per_page, page);
+  if(!photos)
+    return NULL;
+
+  for(count = 0; photos[count]; count++)
+    ;
+  ids = flickcurl_crawl_new_ids(count);
+  for(i = 0; ids && i < count; i++) {
+    const char* owner;
+
+    owner = flickcurl_photo_get_field_string(photos[i],
+                                             PHOTO_FIELD_owner_nsid);
+    if(flickcurl_crawl_set_id(ids, i, owner)) {
+      flickcurl_crawl_free_ids(ids);
+      ids = NULL;
+    }
+  }
+
+  flickcurl_free_photos(photos);
+  return ids;
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+#define CRAWL_TEST_NODES 5000
+#define CRAWL_TEST_STATE "flickcurl_crawl_test"
+
+static int crawl_test_new_count;
+static int crawl_test_seen_count;
+
+
+static void
+crawl_test_error_handler(void *user_data, const char *message)
+{
+  /* errors are expected by some tests */
+}
+
+
+static void
+crawl_test_handler(void* user_data, const char* id, const char* from_id,
+                   int depth, int is_new)
+{
+  if(is_new)
+    crawl_test_new_count++;
+  else
+    crawl_test_seen_count++;
+}
+
+
+static void
+crawl_test_remove_files(void)
+{
+  remove(CRAWL_TEST_STATE ".log");
+  remove(CRAWL_TEST_STATE ".state");
+  remove(CRAWL_TEST_STATE ".set");
+}
+
+
+/* Add seeds "node<first>" to "node<last - 1>" */
+static int
+crawl_test_add_seeds(flickcurl_crawler* crawler, int first, int last)
+{
+  char id[FLICKCURL_CRAWL_ID_SIZE];
+  int i;
+
+  for(i = first; i < last; i++) {
+    sprintf(id, "node%d", i);
+    if(flickcurl_crawler_add_seed(crawler, id))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* Check the crawler found @nodes nodes of which @pending are left */
+static int
+crawl_test_check_counts(flickcurl_crawler* crawler, const char* label,
+                        int nodes, int pending)
+{
+  int found;
+
+  flickcurl_crawler_get_counts(crawler, &found, NULL, NULL);
+  if(found != nodes || flickcurl_crawler_get_pending(crawler) != pending) {
+    fprintf(stderr,
+            "%s: FAIL\n  %s: %d nodes, %d pending; expected %d, %d\n",
+            program, label, found, flickcurl_crawler_get_pending(crawler),
+            nodes, pending);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Add far more nodes than the Bloom filter was sized for, so that it
+ * gives many false positives and the table grows, then add them again.
+ */
+static int
+test_crawl_visited(flickcurl* fc, const char* state_filename)
+{
+  flickcurl_crawler_params params;
+  flickcurl_crawler* crawler;
+  char id[FLICKCURL_CRAWL_ID_SIZE + 1];
+  int failures = 0;
+
+  flickcurl_crawler_params_init(&params);
+  params.expected_nodes = 100;
+  params.state_filename = state_filename;
+
+  crawler = flickcurl_new_crawler(fc, &params);
+  if(!crawler) {
+    fprintf(stderr, "%s: FAIL\n  crawler could not be made\n", program);
+    return 1;
+  }
+  flickcurl_crawler_set_handler(crawler, crawl_test_handler, NULL);
+
+  crawl_test_new_count = crawl_test_seen_count = 0;
+  if(crawl_test_add_seeds(crawler, 0, CRAWL_TEST_NODES) ||
+     crawl_test_add_seeds(crawler, 0, CRAWL_TEST_NODES)) {
+    fprintf(stderr, "%s: FAIL\n  seeds could not be added\n", program);
+    failures++;
+  }
+  if(crawl_test_new_count != CRAWL_TEST_NODES ||
+     crawl_test_seen_count != CRAWL_TEST_NODES) {
+    fprintf(stderr,
+            "%s: FAIL\n  %d new and %d seen nodes; expected %d of each\n",
+            program, crawl_test_new_count, crawl_test_seen_count,
+            CRAWL_TEST_NODES);
+    failures++;
+  }
+  failures += crawl_test_check_counts(crawler, "visited set",
+                                      CRAWL_TEST_NODES, CRAWL_TEST_NODES);
+
+  /* an ID that does not fit is refused */
+  memset(id, 'x', FLICKCURL_CRAWL_ID_SIZE);
+  id[FLICKCURL_CRAWL_ID_SIZE] = '\0';
+  if(!flickcurl_crawler_add_seed(crawler, id)) {
+    fprintf(stderr, "%s: FAIL\n  too long ID was added\n", program);
+    failures++;
+  }
+
+  if(state_filename && flickcurl_crawler_checkpoint(crawler)) {
+    fprintf(stderr, "%s: FAIL\n  checkpoint failed\n", program);
+    failures++;
+  }
+
+  flickcurl_free_crawler(crawler);
+
+  return failures;
+}
+
+
+/* Resume the crawl saved by test_crawl_visited() from its log */
+static int
+test_crawl_resume(flickcurl* fc)
+{
+  flickcurl_crawler_params params;
+  flickcurl_crawler* crawler;
+  int failures = 0;
+
+  flickcurl_crawler_params_init(&params);
+  params.expected_nodes = 100;
+  params.state_filename = CRAWL_TEST_STATE;
+
+  crawler = flickcurl_new_crawler(fc, &params);
+  if(!crawler) {
+    fprintf(stderr, "%s: FAIL\n  crawl could not be resumed\n", program);
+    return 1;
+  }
+  flickcurl_crawler_set_handler(crawler, crawl_test_handler, NULL);
+
+  failures += crawl_test_check_counts(crawler, "resumed log",
+                                      CRAWL_TEST_NODES, CRAWL_TEST_NODES);
+
+  /* the seeds read from the log are known; new ones are added */
+  crawl_test_new_count = crawl_test_seen_count = 0;
+  if(crawl_test_add_seeds(crawler, 0, CRAWL_TEST_NODES + 10)) {
+    fprintf(stderr, "%s: FAIL\n  seeds could not be added\n", program);
+    failures++;
+  }
+  if(crawl_test_new_count != 10 ||
+     crawl_test_seen_count != CRAWL_TEST_NODES) {
+    fprintf(stderr,
+            "%s: FAIL\n  resumed: %d new and %d seen nodes; "
+            "expected 10 and %d\n", program, crawl_test_new_count,
+            crawl_test_seen_count, CRAWL_TEST_NODES);
+    failures++;
+  }
+  failures += crawl_test_check_counts(crawler, "resumed seeds",
+                                      CRAWL_TEST_NODES + 10,
+                                      CRAWL_TEST_NODES + 10);
+
+  flickcurl_free_crawler(crawler);
+
+  return failures;
+}
+
+
+static int crawl_test_expanded_b_count;
+static int crawl_test_expanded_z_count;
+
+
+static void
+crawl_test_socket_handler(void* user_data, int fd, int events)
+{
+}
+
+
+static void
+crawl_test_timer_handler(void* user_data, long timeout_msec)
+{
+}
+
+
+/* Expander making no web service call that counts the nodes expanded */
+static char**
+crawl_test_expander(flickcurl* fc, void* user_data, const char* id,
+                    int per_page, int page)
+{
+  char** ids = (char**)calloc(1, sizeof(char*));
+
+  if(id[0] == 'b')
+    crawl_test_expanded_b_count++;
+  else if(id[0] == 'z')
+    crawl_test_expanded_z_count++;
+
+  return ids;
+}
+
+
+/*
+ * Resume a crawl whose log has records after the checkpoint, as when
+ * it was stopped without one, and check the nodes added after
+ * resuming are the ones expanded
+ */
+static int
+test_crawl_torn_log(flickcurl* fc)
+{
+  flickcurl_crawler_params params;
+  flickcurl_crawler* crawler;
+  char state[256];
+  size_t state_len;
+  char id[FLICKCURL_CRAWL_ID_SIZE];
+  FILE* fh;
+  int failures = 0;
+  int i;
+
+  crawl_test_remove_files();
+
+  flickcurl_crawler_params_init(&params);
+  params.max_depth = 1;
+  params.state_filename = CRAWL_TEST_STATE;
+
+  crawler = flickcurl_new_crawler(fc, &params);
+  if(!crawler)
+    return 1;
+  if(crawl_test_add_seeds(crawler, 0, 10) ||
+     flickcurl_crawler_checkpoint(crawler))
+    failures++;
+
+  /* keep the checkpoint, add nodes after it and stop without one */
+  fh = fopen(CRAWL_TEST_STATE ".state", "rb");
+  if(!fh) {
+    flickcurl_free_crawler(crawler);
+    return 1;
+  }
+  state_len = fread(state, 1, sizeof(state), fh);
+  fclose(fh);
+
+  for(i = 0; i < 5; i++) {
+    sprintf(id, "zzzzzzzzzzzzzzzzzz%d", i);
+    if(flickcurl_crawler_add_seed(crawler, id))
+      failures++;
+  }
+  flickcurl_free_crawler(crawler);
+
+  fh = fopen(CRAWL_TEST_STATE ".state", "wb");
+  if(!fh)
+    return 1;
+  fwrite(state, 1, state_len, fh);
+  fclose(fh);
+
+  crawler = flickcurl_new_crawler(fc, &params);
+  if(!crawler) {
+    fprintf(stderr, "%s: FAIL\n  crawl could not be resumed\n", program);
+    return 1;
+  }
+
+  for(i = 0; i < 5; i++) {
+    sprintf(id, "b%d", i);
+    if(flickcurl_crawler_add_seed(crawler, id))
+      failures++;
+  }
+
+  crawl_test_expanded_b_count = crawl_test_expanded_z_count = 0;
+  if(flickcurl_set_async_handlers(fc, crawl_test_socket_handler,
+                                  crawl_test_timer_handler, NULL) ||
+     flickcurl_crawler_add_expander(crawler, crawl_test_expander, NULL,
+                                    0, 0) ||
+     flickcurl_crawler_start(crawler))
+    failures++;
+
+  if(crawl_test_expanded_b_count != 5 || crawl_test_expanded_z_count) {
+    fprintf(stderr,
+            "%s: FAIL\n  resumed after records past the checkpoint: "
+            "%d new and %d lost nodes expanded; expected 5 and 0\n",
+            program, crawl_test_expanded_b_count,
+            crawl_test_expanded_z_count);
+    failures++;
+  }
+  failures += crawl_test_check_counts(crawler, "resumed torn log", 15, 0);
+
+  flickcurl_free_crawler(crawler);
+
+  return failures;
+}
+
+
+/* A state file claiming more log than there is must not be resumed */
+static int
+test_crawl_short_log(flickcurl* fc)
+{
+  flickcurl_crawler_params params;
+  flickcurl_crawler* crawler;
+  FILE* fh;
+
+  fh = fopen(CRAWL_TEST_STATE ".state", "w");
+  if(!fh)
+    return 1;
+  fprintf(fh, "%s\ncursor 0\nlength 1000000\nexpanded 0\nfailed 0\n",
+          FLICKCURL_CRAWL_STATE_MAGIC);
+  fclose(fh);
+
+  flickcurl_crawler_params_init(&params);
+  params.state_filename = CRAWL_TEST_STATE;
+
+  crawler = flickcurl_new_crawler(fc, &params);
+  if(crawler) {
+    fprintf(stderr, "%s: FAIL\n  crawl resumed from a short log\n", program);
+    flickcurl_free_crawler(crawler);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl *fc = NULL;
+  int failures = 0;
+
+  program = "flickcurl_crawl_test";
+
+  flickcurl_init();
+
+  fc = flickcurl_new();
+  if(!fc) {
+    failures++;
+    goto tidy;
+  }
+
+  flickcurl_set_error_handler(fc, crawl_test_error_handler, NULL);
+
+  crawl_test_remove_files();
+
+  /* in memory and then in files */
+  failures += test_crawl_visited(fc, NULL);
+  failures += test_crawl_visited(fc, CRAWL_TEST_STATE);
+  failures += test_crawl_resume(fc);
+  failures += test_crawl_short_log(fc);
+  failures += test_crawl_torn_log(fc);
+
+  crawl_test_remove_files();
+
+  tidy:
+  if(fc)
+    flickcurl_free(fc);
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
@@ -0,0 +1,614 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * download.c - Flickcurl photo image downloading
+ *
+ * Copyright (C) 2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+#include <curl/multi.h>
+
+
+/* Default number of concurrent image transfers */
+#define FLICKCURL_DOWNLOAD_DEFAULT_WORKERS 4
+
+/* Suffix added to an image filename while it is being written */
+#define PART_SUFFIX ".part"
+#define PART_SUFFIX_LEN 5
+
+
+/*
+ * One concurrent image transfer.  The easy handles are kept for the
+ * whole download so that the connections to the image servers are
+ * reused from the multi handle connection cache.
+ */
+typedef struct {
+  CURL* handle;
+  /* photo being downloaded or NULL when the slot is idle */
+  flickcurl_photo* photo;
+  char* filename;
+  char* part_filename;
+  FILE* fh;
+  /* size of existing partial file resumed from */
+  curl_off_t offset;
+  /* bytes received in this transfer */
+  size_t bytes;
+  int checked_response;
+  int write_failed;
+} flickcurl_download_slot;
+
+
+/**
+ * flickcurl_download_params_init:
+ * @params: download params
+ *
+ * Initialise a #flickcurl_download_params structure with default values
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_download_params_init(flickcurl_download_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(*params));
+  params->version = 1;
+  params->size = '\0';
+  params->workers = FLICKCURL_DOWNLOAD_DEFAULT_WORKERS;
+
+  return 0;
+}
+
+
+/*
+ * Get the size letter from a static image URL
+ * https://farm{farm-id}.staticflickr.com/{server-id}/{id}_{secret}_{size}.{ext}
+ * or '\0' for the default (medium) size without a size suffix.
+ */
+static char
+flickcurl_source_uri_size(const char* uri)
+{
+  const char* base;
+  const char* dot;
+  const char* p;
+  int underscores = 0;
+
+  base = strrchr(uri, '/');
+  base = base ? base + 1 : uri;
+  dot = strrchr(base, '.');
+  if(!dot)
+    return '\0';
+
+  for(p = base; p < dot; p++)
+    if(*p == '_')
+      underscores++;
+
+  if(underscores < 2 || dot - base < 2 || dot[-2] != '_')
+    return '\0';
+
+  return dot[-1];
+}
+
+
+/*
+ * Get the image source URI for a photo of the given size.
+ *
+ * The URI is built from the photo fields when they are present and
+ * otherwise found with flickr.photos.getSizes.
+ */
+static char*
+flickcurl_download_source_uri(flickcurl* fc, flickcurl_photo* photo, char size)
+{
+  int have_fields;
+  flickcurl_size** sizes;
+  char* uri = NULL;
+  int i;
+
+  have_fields = (flickcurl_photo_get_field_string(photo, PHOTO_FIELD_farm) &&
+                 flickcurl_photo_get_field_string(photo, PHOTO_FIELD_server));
+  if(size == 'o')
+    have_fields = (have_fields &&
+                   flickcurl_photo_get_field_string(photo,
+                                                    PHOTO_FIELD_originalsecret) &&
+                   flickcurl_photo_get_field_string(photo,
+                                                    PHOTO_FIELD_originalformat));
+  else
+    have_fields = (have_fields &&
+                   flickcurl_photo_get_field_string(photo, PHOTO_FIELD_secret));
+
+  /* the larger sizes have their own secrets only known via getSizes */
+  if(have_fields && size != 'h' && size != 'k')
+    return flickcurl_photo_as_source_uri(photo, size);
+
+  sizes = flickcurl_photos_getSizes(fc, photo->id);
+  if(!sizes)
+    return NULL;
+
+  for(i = 0; sizes[i]; i++) {
+    const char* source = sizes[i]->source;
+
+    if(source && flickcurl_source_uri_size(source) == size) {
+      size_t len = strlen(source);
+      uri = (char*)malloc(len + 1);
+      if(uri)
+        memcpy(uri, source, len + 1);
+      break;
+    }
+  }
+  flickcurl_free_sizes(sizes);
+
+  if(!uri)
+    flickcurl_error(fc, "No image size '%c' for photo %s",
+                    size ? size : '-', photo->id);
+
+  return uri;
+}
+
+
+/*
+ * Make image filename {directory}/{id}_{size}.{ext} or
+ * {directory}/{id}.{ext} for the default size.
+ */
+static char*
+flickcurl_download_filename(const char* directory, flickcurl_photo* photo,
+                            char size, const char* uri)
+{
+  const char* base;
+  const char* ext;
+  size_t dir_len = directory ? strlen(directory) : 0;
+  size_t len;
+  char* filename;
+  char* p;
+
+  base = strrchr(uri, '/');
+  base = base ? base + 1 : uri;
+  ext = strrchr(base, '.');
+  if(!ext || strchr(ext, '?'))
+    ext = ".jpg";
+
+  len = dir_len + 1 + strlen(photo->id) + 2 + strlen(ext);
+  filename = (char*)malloc(len + PART_SUFFIX_LEN + 1);
+  if(!filename)
+    return NULL;
+
+  p = filename;
+  if(dir_len) {
+    memcpy(p, directory, dir_len);
+    p += dir_len;
+    if(p[-1] != '/')
+      *p++ = '/';
+  }
+  len = strlen(photo->id);
+  memcpy(p, photo->id, len);
+  p += len;
+  if(size) {
+    *p++ = '_';
+    *p++ = size;
+  }
+  len = strlen(ext);
+  memcpy(p, ext, len + 1);
+
+  return filename;
+}
+
+
+static int
+flickcurl_file_exists(const char* filename, curl_off_t* size_p)
+{
+#ifdef HAVE_SYS_STAT_H
+  struct stat sb;
+
+  if(stat(filename, &sb))
+    return 0;
+  if(size_p)
+    *size_p = (curl_off_t)sb.st_size;
+  return 1;
+#else
+  FILE* fh = fopen(filename, "rb");
+  if(!fh)
+    return 0;
+  if(size_p) {
+    fseek(fh, 0, SEEK_END);
+    *size_p = (curl_off_t)ftell(fh);
+  }
+  fclose(fh);
+  return 1;
+#endif
+}
+
+
+static size_t
+flickcurl_download_write_callback(void *ptr, size_t size, size_t nmemb,
+                                  void *userdata)
+{
+  flickcurl_download_slot* slot = (flickcurl_download_slot*)userdata;
+  size_t len = size * nmemb;
+
+  if(!slot->checked_response) {
+    long code = 0;
+
+    slot->checked_response = 1;
+    curl_easy_getinfo(slot->handle, CURLINFO_RESPONSE_CODE, &code);
+
+    /* server ignored the Range request: start the file again */
+    if(slot->offset > 0 && code == 200) {
+      slot->fh = freopen(slot->part_filename, "wb", slot->fh);
+      slot->offset = 0;
+      if(!slot->fh) {
+        slot->write_failed = 1;
+        return 0;
+      }
+    }
+  }
+
+  if(fwrite(ptr, size, nmemb, slot->fh) != nmemb) {
+    slot->write_failed = 1;
+    return 0;
+  }
+
+  slot->bytes += len;
+  return len;
+}
+
+
+static void
+flickcurl_download_report(flickcurl_download_params* params,
+                          flickcurl_download_stats* stats,
+                          flickcurl_photo* photo, const char* filename,
+                          flickcurl_download_status status, size_t bytes)
+{
+  switch(status) {
+    case FLICKCURL_DOWNLOAD_OK:
+      stats->downloaded++;
+      break;
+    case FLICKCURL_DOWNLOAD_SKIPPED:
+      stats->skipped++;
+      break;
+    case FLICKCURL_DOWNLOAD_FAILED:
+      stats->failed++;
+      break;
+  }
+  stats->bytes += bytes;
+
+  if(params->handler)
+    params->handler(params->user_data, photo, filename, status, bytes);
+}
+
+
+static void
+flickcurl_download_slot_reset(flickcurl_download_slot* slot)
+{
+  if(slot->fh) {
+    fclose(slot->fh);
+    slot->fh = NULL;
+  }
+  if(slot->filename) {
+    free(slot->filename);
+    slot->filename = NULL;
+  }
+  if(slot->part_filename) {
+    free(slot->part_filename);
+    slot->part_filename = NULL;
+  }
+  slot->photo = NULL;
+  slot->offset = 0;
+  slot->bytes = 0;
+  slot->checked_response = 0;
+  slot->write_failed = 0;
+}
+
+
+/*
+ * Start downloading a photo in an idle slot
+ *
+ * Return value: 0 if a transfer was started, >0 if the photo was
+ * skipped or failed and was reported
+ */
+static int
+flickcurl_download_start(flickcurl* fc, CURLM* multi,
+                         flickcurl_download_slot* slot,
+                         flickcurl_photo* photo,
+                         flickcurl_download_params* params,
+                         flickcurl_download_stats* stats)
+{
+  char* uri;
+  size_t len;
+
+  uri = flickcurl_download_source_uri(fc, photo, params->size);
+  if(!uri) {
+    flickcurl_download_report(params, stats, photo, NULL,
+                              FLICKCURL_DOWNLOAD_FAILED, 0);
+    return 1;
+  }
+
+  slot->photo = photo;
+  slot->filename = flickcurl_download_filename(params->directory, photo,
+                                               params->size, uri);
+  if(!slot->filename)
+    goto failed;
+
+  if(params->skip_existing && flickcurl_file_exists(slot->filename, NULL)) {
+    flickcurl_download_report(params, stats, photo, slot->filename,
+                              FLICKCURL_DOWNLOAD_SKIPPED, 0);
+    flickcurl_download_slot_reset(slot);
+    free(uri);
+    return 1;
+  }
+
+  len = strlen(slot->filename);
+  slot->part_filename = (char*)malloc(len + PART_SUFFIX_LEN + 1);
+  if(!slot->part_filename)
+    goto failed;
+  memcpy(slot->part_filename, slot->filename, len);
+  memcpy(slot->part_filename + len, PART_SUFFIX, PART_SUFFIX_LEN + 1);
+
+  slot->offset = 0;
+  if(params->resume &&
+     flickcurl_file_exists(slot->part_filename, &slot->offset) &&
+     slot->offset > 0)
+    slot->fh = fopen(slot->part_filename, "ab");
+  else {
+    slot->offset = 0;
+    slot->fh = fopen(slot->part_filename, "wb");
+  }
+  if(!slot->fh) {
+    flickcurl_error(fc, "Failed to write to %s: %s", slot->part_filename,
+                    strerror(errno));
+    goto failed;
+  }
+
+  if(!slot->handle) {
+    slot->handle = curl_easy_init();
+    if(!slot->handle)
+      goto failed;
+  }
+  curl_easy_setopt(slot->handle, CURLOPT_URL, uri);
+  curl_easy_setopt(slot->handle, CURLOPT_WRITEFUNCTION,
+                   flickcurl_download_write_callback);
+  curl_easy_setopt(slot->handle, CURLOPT_WRITEDATA, slot);
+  curl_easy_setopt(slot->handle, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(slot->handle, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(slot->handle, CURLOPT_RESUME_FROM_LARGE, slot->offset);
+  if(fc->proxy)
+    curl_easy_setopt(slot->handle, CURLOPT_PROXY, fc->proxy);
+  if(fc->user_agent)
+    curl_easy_setopt(slot->handle, CURLOPT_USERAGENT, fc->user_agent);
+  if(fc->curl_setopt_handler)
+    fc->curl_setopt_handler(slot->handle, fc->curl_setopt_handler_data);
+
+  if(curl_multi_add_handle(multi, slot->handle) != CURLM_OK)
+    goto failed;
+
+  free(uri);
+  return 0;
+
+  failed:
+  flickcurl_download_report(params, stats, photo, slot->filename,
+                            FLICKCURL_DOWNLOAD_FAILED, 0);
+  flickcurl_download_slot_reset(slot);
+  free(uri);
+  return 1;
+}
+
+
+/* Finish a completed transfer: move the file into place and report */
+static void
+flickcurl_download_finish(flickcurl* fc, CURLM* multi,
+                          flickcurl_download_slot* slot, CURLcode result,
+                          flickcurl_download_params* params,
+                          flickcurl_download_stats* stats)
+{
+  flickcurl_download_status status = FLICKCURL_DOWNLOAD_FAILED;
+  int close_failed;
+
+  curl_multi_remove_handle(multi, slot->handle);
+
+  close_failed = fclose(slot->fh);
+  slot->fh = NULL;
+
+  if(result != CURLE_OK || slot->write_failed || close_failed) {
+    long code = 0;
+
+    curl_easy_getinfo(slot->handle, CURLINFO_RESPONSE_CODE, &code);
+    flickcurl_error(fc, "Download of photo %s to %s failed: %s (HTTP %ld)",
+                    slot->photo->id, slot->filename,
+                    (slot->write_failed || close_failed) ?
+                      "write error" : curl_easy_strerror(result),
+                    code);
+    /* 416: the partial file cannot be resumed so start again next time */
+    if(code == 416)
+      remove(slot->part_filename);
+  } else if(rename(slot->part_filename, slot->filename)) {
+    flickcurl_error(fc, "Failed to rename %s to %s: %s",
+                    slot->part_filename, slot->filename, strerror(errno));
+  } else
+    status = FLICKCURL_DOWNLOAD_OK;
+
+  flickcurl_download_report(params, stats, slot->photo, slot->filename,
+                            status, slot->bytes);
+  flickcurl_download_slot_reset(slot);
+}
+
+
+/**
+ * flickcurl_download_photos:
+ * @fc: flickcurl context
+ * @photos: NULL-terminated array of photos to download
+ * @params: download parameters (or NULL for defaults)
+ * @stats: pointer to store download statistics (or NULL)
+ *
+ * Download image files for a list of photos
+ *
+ * The image URI for each photo is built with
+ * flickcurl_photo_as_source_uri() when the photo has the farm,
+ * server and secret fields (and originalsecret and originalformat
+ * for the original size) such as when the list was returned with
+ * the <code>original_format</code> extra, otherwise it is found with
+ * flickcurl_photos_getSizes().
+ *
+ * Up to @params field workers images are fetched concurrently over
+ * one connection pool.  Each image is written to
+ * <code>DIRECTORY/ID_SIZE.EXT</code> (or <code>DIRECTORY/ID.EXT</code>
+ * for the default size) via a temporary <code>.part</code> file that
+ * is renamed into place once complete.  If @params field resume is
+ * set, an existing <code>.part</code> file is continued with an HTTP
+ * Range request.  If @params field skip_existing is set, photos with
+ * an existing image file are not downloaded again.
+ *
+ * The @params field handler is called as each photo is completed,
+ * skipped or fails.
+ *
+ * Return value: non-0 on failure or if any photo failed to download
+ */
+int
+flickcurl_download_photos(flickcurl* fc, flickcurl_photo** photos,
+                          flickcurl_download_params* params,
+                          flickcurl_download_stats* stats)
+{
+  flickcurl_download_params default_params;
+  flickcurl_download_stats local_stats;
+  flickcurl_download_slot* slots = NULL;
+  CURLM* multi = NULL;
+  int workers;
+  int next = 0;
+  int active = 0;
+  int rc = 0;
+  int i;
+  double start_time;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(photos, flickcurl_photo**, 1);
+
+  if(!params) {
+    flickcurl_download_params_init(&default_params);
+    params = &default_params;
+  }
+  if(!stats)
+    stats = &local_stats;
+  memset(stats, '\0', sizeof(*stats));
+
+  start_time = flickcurl_get_time();
+
+  workers = params->workers;
+  if(workers <= 0)
+    workers = FLICKCURL_DOWNLOAD_DEFAULT_WORKERS;
+
+  slots = (flickcurl_download_slot*)calloc(workers, sizeof(*slots));
+  if(!slots)
+    return 1;
+
+  multi = curl_multi_init();
+  if(!multi) {
+    flickcurl_error(fc, "Failed to create curl multi handle");
+    rc = 1;
+    goto tidy;
+  }
+
+  while(photos[next] || active) {
+    CURLMsg* msg;
+    int msgs_left;
+    int running = 0;
+    CURLMcode mrc;
+
+    /* fill idle slots */
+    for(i = 0; i < workers && photos[next]; i++) {
+      if(slots[i].photo)
+        continue;
+
+      if(!flickcurl_download_start(fc, multi, &slots[i], photos[next],
+                                   params, stats))
+        active++;
+      next++;
+    }
+
+    if(!active)
+      continue;
+
+    if(flickcurl_take_cancel(fc)) {
+      flickcurl_error(fc, "Download cancelled");
+      rc = 1;
+      break;
+    }
+
+    mrc = curl_multi_perform(multi, &running);
+    if(mrc != CURLM_OK) {
+      flickcurl_error(fc, "Download failed: %s", curl_multi_strerror(mrc));
+      rc = 1;
+      break;
+    }
+
+    while((msg = curl_multi_info_read(multi, &msgs_left))) {
+      if(msg->msg != CURLMSG_DONE)
+        continue;
+
+      for(i = 0; i < workers; i++) {
+        if(slots[i].photo && slots[i].handle == msg->easy_handle) {
+          flickcurl_download_finish(fc, multi, &slots[i], msg->data.result,
+                                    params, stats);
+          active--;
+          break;
+        }
+      }
+    }
+
+    /* wake up often enough to notice flickcurl_cancel() */
+    if(running)
+      curl_multi_wait(multi, NULL, 0, 100, NULL);
+  }
+
+  tidy:
+  for(i = 0; i < workers; i++) {
+    if(slots[i].handle) {
+      if(slots[i].photo)
+        curl_multi_remove_handle(multi, slots[i].handle);
+      curl_easy_cleanup(slots[i].handle);
+    }
+    flickcurl_download_slot_reset(&slots[i]);
+  }
+  free(slots);
+
+  if(multi)
+    curl_multi_cleanup(multi);
+
+  stats->seconds = flickcurl_get_time() - start_time;
+
+  return (rc || stats->failed > 0);
+}
@@ -311,6 +311,9 @@ flickcurl_favorites_getList2(flickcurl* fc, const char* user_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -460,6 +463,9 @@ flickcurl_favorites_getPublicList(flickcurl* fc, const char* user_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
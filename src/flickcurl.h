@@ -23,13 +23,20 @@
 #define FLICKCURL_H
 
 
+/* needed for xmlDocPtr */
+#include <libxml/tree.h>
+
+/* needed for FILE */
+#include <stdio.h>
+
+/* needed for time_t */
+#include <time.h>
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* needed for xmlDocPtr */
-#include <libxml/tree.h>
-
 
 /**
  * FLICKCURL_API:
@@ -677,12 +684,17 @@ typedef struct flickcurl_shapedata_s {
  * @cooked: cooked tag (may be NULL, but if so @raw must not be NULL)
  * @machine_tag: boolean (non-0 true) if tag is a Machine Tag
  * @count: tag count in a histogram (or 0)
+ * @intern: internal - table owning the author and tag strings or NULL
  *
  * A tag OR a posting of a tag about a photo by a user OR a tag in a histogram
  *
  * Most of these fields may be NULL, 0 for numbers
  * but not all.  Either @raw or @cooked MUST appear. 
  *
+ * When tags are interned (see flickcurl_set_tag_interning()) @author,
+ * @authorname, @raw and @cooked are shared with other tags and must
+ * not be changed.
+ *
  * A Photo Tag.
  */
 typedef struct flickcurl_tag_s {
@@ -694,9 +706,21 @@ typedef struct flickcurl_tag_s {
   char* cooked;
   int machine_tag;
   int count;
+
+  struct flickcurl_tag_intern_s* intern;
 } flickcurl_tag;
 
 
+/**
+ * flickcurl_tag_index:
+ *
+ * Local inverted index of photos by tags and machine tags
+ *
+ * See flickcurl_new_tag_index().
+ */
+typedef struct flickcurl_tag_index_s flickcurl_tag_index;
+
+
 /**
  * flickcurl_tag_cluster: 
  * @count: number of tags
@@ -771,9 +795,15 @@ typedef struct {
  * @media_type: "photo" or "video"
  * @notes: array of notes (may be NULL)
  * @notes_count: size of notes array
+ * @lazy: internal - fields decoded on first use or NULL
  *
  * A photo or video.
  *
+ * A photo built in lazy mode (see flickcurl_set_lazy_photos()) has
+ * each of @fields decoded on first use by
+ * flickcurl_photo_get_field_string() or the other field accessors,
+ * which work for every photo.  It has no @tags, @place, @video or
+ * @notes.
  */
 typedef struct flickcurl_photo_s {
   char *id;
@@ -792,6 +822,8 @@ typedef struct flickcurl_photo_s {
 
   flickcurl_note** notes;
   int notes_count;
+
+  struct flickcurl_photo_lazy_s* lazy;
 } flickcurl_photo;
 
 
@@ -1205,6 +1237,26 @@ typedef struct {
 } flickcurl_person;
 
 
+/**
+ * flickcurl_photo_columns:
+ *
+ * Photos stored as one column of values per photo field
+ *
+ * See flickcurl_set_photo_columns().
+ */
+typedef struct flickcurl_photo_columns_s flickcurl_photo_columns;
+
+
+/**
+ * flickcurl_arrow_writer:
+ *
+ * Writer of photo lists as an Apache Arrow IPC stream
+ *
+ * See flickcurl_new_arrow_writer().
+ */
+typedef struct flickcurl_arrow_writer_s flickcurl_arrow_writer;
+
+
 /**
  * flickcurl_photos_list:
  * @format: requested content format or NULL if a list of photos was wanted.  On the result from API calls this is set to the requested feed format or "xml" if none was given.
@@ -1215,6 +1267,7 @@ typedef struct {
  * @page: current photo list page
  * @per_page: current photo list per-page
  * @total_count: total number of photos available of which the current @page and @per_page is a slice
+ * @columns: photos as columns if @format is NULL and columns were set with flickcurl_set_photo_columns(), when @photos is empty.  Otherwise NULL.
  *
  * Photos List result.
  */
@@ -1227,6 +1280,7 @@ typedef struct {
   int page;
   int per_page;
   int total_count;
+  flickcurl_photo_columns* columns;
 } flickcurl_photos_list;
 
 
@@ -1257,6 +1311,98 @@ typedef struct {
 } flickcurl_photos_list_params;
 
 
+/**
+ * flickcurl_retry_params:
+ * @version: structure version (currently 1)
+ * @max_retries: maximum number of times to retry a failed call (0 for no retries)
+ * @base_delay: delay before the first retry in milliseconds; doubled for each further retry
+ * @max_delay: largest delay between retries in milliseconds
+ * @deadline: time limit for a call including all retries in milliseconds (0 for none)
+ *
+ * Retry policy for web service calls
+ *
+ * Only read methods are retried since they can safely be repeated;
+ * writes and uploads never are.  A call is retried after a network
+ * error, an HTTP 429 or 5xx response or a Flickr "service currently
+ * unavailable" error.  The delay before each retry is a random time
+ * between half and all of the current backoff so that many clients
+ * failing together do not all retry together.  A Retry-After
+ * response header gives the smallest delay.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_retry_params_init() when adding fields
+   */
+  int version; /* 1 */
+  int max_retries;
+  int base_delay;
+  int max_delay;
+  int deadline;
+} flickcurl_retry_params;
+
+
+/**
+ * flickcurl_hedge_params:
+ * @version: structure version (currently 1)
+ * @percentile: percentile of the method's response start times after which to send a duplicate request (1-100 or 0 for no hedging)
+ * @min_delay: smallest delay before sending a duplicate request in milliseconds
+ * @min_samples: number of response times needed for a method before it is hedged (1 to 64)
+ *
+ * Hedged request policy for web service calls
+ *
+ * When a read method's response has not started within the given
+ * percentile of its recent response start times, the same request is
+ * signed again and sent on another connection and whichever response
+ * starts first is used; the other request is cancelled.  Writes and
+ * uploads are never hedged.
+ *
+ * Duplicate requests are only sent when the request delay rate limit
+ * allows so with the default delay of 1000 milliseconds no duplicate
+ * is sent until 1 second after the first request, whatever the
+ * percentile says.  Lower the delay with flickcurl_set_request_delay()
+ * for the percentile to decide when the duplicate is sent.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_hedge_params_init() when adding fields
+   */
+  int version; /* 1 */
+  int percentile;
+  int min_delay;
+  int min_samples;
+} flickcurl_hedge_params;
+
+
+/**
+ * flickcurl_coalescer:
+ *
+ * Coalescer of identical read requests made by several sessions
+ *
+ * See flickcurl_new_coalescer().
+ */
+typedef struct flickcurl_coalescer_s flickcurl_coalescer;
+
+
+/**
+ * flickcurl_snapshot_cache:
+ *
+ * Cache of decoded photos, people, places and photosets
+ *
+ * See flickcurl_new_snapshot_cache().
+ */
+typedef struct flickcurl_snapshot_cache_s flickcurl_snapshot_cache;
+
+
+/**
+ * flickcurl_store:
+ *
+ * Local store of photos, people and photosets
+ *
+ * See flickcurl_new_store().
+ */
+typedef struct flickcurl_store_s flickcurl_store;
+
+
 /**
  * flickcurl_upload_params:
  * @photo_file: photo filename
@@ -1420,6 +1566,44 @@ typedef struct {
 } flickcurl_view_stats;
 
 
+/**
+ * flickcurl_stats_engine:
+ *
+ * Photo stats time series fetched with concurrent calls
+ *
+ * See flickcurl_new_stats_engine().
+ */
+typedef struct flickcurl_stats_engine_s flickcurl_stats_engine;
+
+
+/**
+ * flickcurl_stats_engine_params:
+ * @version: structure version (currently 1)
+ * @days: number of days in the window, at most 28
+ * @concurrency: most calls to run at once
+ * @per_page: domains, referrers or popular photos per page, at most 100
+ * @domains: non-0 to fetch every page of the referring domains of each photo-day
+ * @referrers: non-0 to also fetch every page of the referrers from each domain
+ * @popular: non-0 to add the popular photos of each day in the window
+ *
+ * Parameters for flickcurl_new_stats_engine()
+ *
+ * Use flickcurl_stats_engine_params_init() to initialize this.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_stats_engine_params_init() when adding fields
+   */
+  int version; /* 1 */
+  int days;
+  int concurrency;
+  int per_page;
+  int domains;
+  int referrers;
+  int popular;
+} flickcurl_stats_engine_params;
+
+
 /**
  * flickcurl_size:
  * @label: label
@@ -1561,12 +1745,252 @@ typedef struct {
 
 typedef struct flickcurl_serializer_s flickcurl_serializer;
 
+/**
+ * flickcurl_photos_iterator:
+ * @user_data: user data
+ *
+ * Photos iterator callback for flickcurl_serialize_photos_iterator()
+ *
+ * Return value: next NULL-terminated array of photos or NULL at the end
+ */
+typedef flickcurl_photo** (*flickcurl_photos_iterator)(void* user_data);
+
 FLICKCURL_API
 flickcurl_serializer* flickcurl_new_serializer(flickcurl* fc, void* data, flickcurl_serializer_factory* factory);
 FLICKCURL_API
 void flickcurl_free_serializer(flickcurl_serializer* serializer);
 FLICKCURL_API
 int flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo);
+FLICKCURL_API
+int flickcurl_serialize_photos(flickcurl_serializer* fcs, flickcurl_photo** photos);
+FLICKCURL_API
+int flickcurl_serialize_photos_iterator(flickcurl_serializer* fcs, flickcurl_photos_iterator iterator, void* user_data);
+
+/**
+ * flickcurl_triples_writer:
+ *
+ * Buffered N-Triples and Turtle writer used with the serializer
+ * factory from flickcurl_get_triples_writer_factory()
+ */
+typedef struct flickcurl_triples_writer_s flickcurl_triples_writer;
+
+FLICKCURL_API
+const char* flickcurl_get_triples_writer_syntax(unsigned int counter, const char** label_p);
+FLICKCURL_API
+flickcurl_triples_writer* flickcurl_new_triples_writer(FILE* fh, const char* syntax_name);
+FLICKCURL_API
+void flickcurl_free_triples_writer(flickcurl_triples_writer* w);
+FLICKCURL_API
+int flickcurl_triples_writer_flush(flickcurl_triples_writer* w);
+FLICKCURL_API
+flickcurl_serializer_factory* flickcurl_get_triples_writer_factory(void);
+
+
+/**
+ * flickcurl_download_status:
+ * @FLICKCURL_DOWNLOAD_OK: image was downloaded
+ * @FLICKCURL_DOWNLOAD_SKIPPED: image file already existed
+ * @FLICKCURL_DOWNLOAD_FAILED: image could not be found or downloaded
+ *
+ * Result of downloading one photo image
+ */
+typedef enum {
+  FLICKCURL_DOWNLOAD_OK,
+  FLICKCURL_DOWNLOAD_SKIPPED,
+  FLICKCURL_DOWNLOAD_FAILED
+} flickcurl_download_status;
+
+
+/**
+ * flickcurl_download_handler:
+ * @user_data: user data
+ * @photo: photo
+ * @filename: image filename (or NULL if none could be made)
+ * @status: download result
+ * @bytes: number of bytes received
+ *
+ * Download progress callback called once for each photo
+ */
+typedef void (*flickcurl_download_handler)(void* user_data, flickcurl_photo* photo, const char* filename, flickcurl_download_status status, size_t bytes);
+
+
+/**
+ * flickcurl_download_params:
+ * @version: structure version (currently 1)
+ * @directory: directory to write image files to (or NULL for current directory)
+ * @size: image size letter as used by flickcurl_photo_as_source_uri() or '\0' for the default (medium) size
+ * @workers: maximum number of concurrent downloads (default 4)
+ * @resume: non-0 to continue partial downloads with HTTP Range requests
+ * @skip_existing: non-0 to skip photos whose image file already exists
+ * @handler: per-photo callback (or NULL)
+ * @user_data: user data for @handler
+ *
+ * Parameters for flickcurl_download_photos()
+ *
+ * Use flickcurl_download_params_init() to initialize this.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_download_params_init() when adding fields 
+   */
+  int version; /* 1 */
+  const char* directory;
+  char size;
+  int workers;
+  int resume;
+  int skip_existing;
+  flickcurl_download_handler handler;
+  void* user_data;
+} flickcurl_download_params;
+
+
+/**
+ * flickcurl_download_stats:
+ * @downloaded: number of images downloaded
+ * @skipped: number of images skipped
+ * @failed: number of images that failed
+ * @bytes: total bytes received
+ * @seconds: elapsed time in seconds
+ *
+ * Download statistics returned by flickcurl_download_photos()
+ */
+typedef struct {
+  int downloaded;
+  int skipped;
+  int failed;
+  size_t bytes;
+  double seconds;
+} flickcurl_download_stats;
+
+FLICKCURL_API
+int flickcurl_download_params_init(flickcurl_download_params* params);
+FLICKCURL_API
+int flickcurl_download_photos(flickcurl* fc, flickcurl_photo** photos, flickcurl_download_params* params, flickcurl_download_stats* stats);
+
+
+/**
+ * flickcurl_async_call:
+ *
+ * Asynchronous web service call started by flickcurl_async_submit()
+ */
+typedef struct flickcurl_async_call_s flickcurl_async_call;
+
+
+/**
+ * flickcurl_async_event:
+ * @FLICKCURL_ASYNC_IN: socket is or should be readable
+ * @FLICKCURL_ASYNC_OUT: socket is or should be writable
+ * @FLICKCURL_ASYNC_REMOVE: socket is no longer needed
+ * @FLICKCURL_ASYNC_ERROR: socket has an error condition
+ *
+ * Socket event flags for asynchronous calls
+ */
+typedef enum {
+  FLICKCURL_ASYNC_IN = 1,
+  FLICKCURL_ASYNC_OUT = 2,
+  FLICKCURL_ASYNC_REMOVE = 4,
+  FLICKCURL_ASYNC_ERROR = 8
+} flickcurl_async_event;
+
+
+/**
+ * flickcurl_async_priority:
+ * @FLICKCURL_ASYNC_PRIORITY_HIGH: high priority lane, such as for interactive calls
+ * @FLICKCURL_ASYNC_PRIORITY_LOW: low priority lane, such as for bulk calls
+ *
+ * Asynchronous call priority lanes
+ */
+typedef enum {
+  FLICKCURL_ASYNC_PRIORITY_HIGH,
+  FLICKCURL_ASYNC_PRIORITY_LOW
+} flickcurl_async_priority;
+
+
+/**
+ * flickcurl_async_params:
+ * @version: structure version (currently 1)
+ * @account: account index from flickcurl_async_add_account() or 0 for the session credentials
+ * @priority: priority lane
+ *
+ * Parameters for flickcurl_async_submit_params()
+ *
+ * Use flickcurl_async_params_init() to initialize this.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_async_params_init() when adding fields
+   */
+  int version; /* 1 */
+  int account;
+  flickcurl_async_priority priority;
+} flickcurl_async_params;
+
+
+/**
+ * flickcurl_async_builder:
+ * @fc: flickcurl object
+ * @builder_data: builder data
+ *
+ * Function making a web service call for flickcurl_async_submit()
+ *
+ * Return value: result of the call or NULL on failure
+ */
+typedef void* (*flickcurl_async_builder)(flickcurl* fc, void* builder_data);
+
+
+/**
+ * flickcurl_async_handler:
+ * @user_data: user data
+ * @call: asynchronous call (or NULL if it could not be started)
+ * @result: result returned by the builder or NULL on failure
+ *
+ * Asynchronous call result callback called once for each call
+ */
+typedef void (*flickcurl_async_handler)(void* user_data, flickcurl_async_call* call, void* result);
+
+
+/**
+ * flickcurl_async_socket_handler:
+ * @user_data: user data
+ * @fd: socket descriptor
+ * @events: #flickcurl_async_event flags to wait for or %FLICKCURL_ASYNC_REMOVE
+ *
+ * Asynchronous call socket interest callback
+ */
+typedef void (*flickcurl_async_socket_handler)(void* user_data, int fd, int events);
+
+
+/**
+ * flickcurl_async_timer_handler:
+ * @user_data: user data
+ * @timeout_msec: milliseconds after which to call flickcurl_async_timeout() or < 0 for no timer
+ *
+ * Asynchronous call timer callback
+ */
+typedef void (*flickcurl_async_timer_handler)(void* user_data, long timeout_msec);
+
+FLICKCURL_API
+int flickcurl_set_async_handlers(flickcurl* fc, flickcurl_async_socket_handler socket_handler, flickcurl_async_timer_handler timer_handler, void* user_data);
+FLICKCURL_API
+flickcurl_async_call* flickcurl_async_submit(flickcurl* fc, flickcurl_async_builder builder, void* builder_data, flickcurl_async_handler handler, void* user_data);
+FLICKCURL_API
+int flickcurl_async_params_init(flickcurl_async_params* params);
+FLICKCURL_API
+flickcurl_async_call* flickcurl_async_submit_params(flickcurl* fc, flickcurl_async_builder builder, void* builder_data, flickcurl_async_handler handler, void* user_data, flickcurl_async_params* params);
+FLICKCURL_API
+int flickcurl_async_add_account(flickcurl* fc, const char* oauth_token, const char* oauth_token_secret, int weight);
+FLICKCURL_API
+int flickcurl_async_get_account_sent(flickcurl* fc, int account);
+FLICKCURL_API
+int flickcurl_async_socket_action(flickcurl* fc, int fd, int events);
+FLICKCURL_API
+int flickcurl_async_timeout(flickcurl* fc);
+FLICKCURL_API
+void flickcurl_async_cancel(flickcurl* fc, flickcurl_async_call* call);
+FLICKCURL_API
+int flickcurl_async_checkpoint(flickcurl* fc);
+FLICKCURL_API
+int flickcurl_async_get_pending(flickcurl* fc);
 
 
 /**
@@ -1588,6 +2012,90 @@ typedef struct {
 } flickcurl_member;
 
 
+/**
+ * FLICKCURL_CRAWL_ID_SIZE:
+ *
+ * Size of the longest node ID of a crawl plus 1
+ */
+#define FLICKCURL_CRAWL_ID_SIZE 24
+
+
+/**
+ * flickcurl_crawler:
+ *
+ * Resumable breadth first graph crawl made with concurrent calls
+ *
+ * See flickcurl_new_crawler().
+ */
+typedef struct flickcurl_crawler_s flickcurl_crawler;
+
+
+/**
+ * flickcurl_crawler_params:
+ * @version: structure version (currently 1)
+ * @max_depth: depth of the last nodes to find, at most 255; seeds are at depth 0
+ * @depth_limits: most nodes to find at each depth from 0 to @max_depth, < 0 for no limit (or NULL for no limits)
+ * @concurrency: most calls to run at once
+ * @per_page: IDs asked for per expander call
+ * @state_filename: name the crawl files start with (or NULL to crawl in memory)
+ * @checkpoint_interval: nodes done with between checkpoints or 0 for none but when freeing
+ * @expected_nodes: number of nodes the visited set Bloom filter is sized for
+ *
+ * Parameters for flickcurl_new_crawler()
+ *
+ * Use flickcurl_crawler_params_init() to initialize this.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_crawler_params_init() when adding fields
+   */
+  int version; /* 1 */
+  int max_depth;
+  const int* depth_limits;
+  int concurrency;
+  int per_page;
+  const char* state_filename;
+  int checkpoint_interval;
+  int expected_nodes;
+} flickcurl_crawler_params;
+
+
+/**
+ * flickcurl_crawl_expander:
+ * @fc: flickcurl object
+ * @user_data: user data
+ * @id: ID of the node to expand
+ * @per_page: number of IDs per page
+ * @page: page number from 1
+ *
+ * Function finding a page of the neighbours of a crawl node
+ *
+ * It is called from asynchronous calls so it must make one web
+ * service call.  A page of @per_page IDs is taken to have another
+ * page after it.
+ *
+ * Return value: NULL-terminated list of new IDs for the crawler to free, or NULL on failure
+ */
+typedef char** (*flickcurl_crawl_expander)(flickcurl* fc, void* user_data, const char* id, int per_page, int page);
+
+
+/**
+ * flickcurl_crawl_handler:
+ * @user_data: user data
+ * @id: node ID
+ * @from_id: ID of the node it was found from or NULL for a seed
+ * @depth: depth of the node if new or of the edge end if not
+ * @is_new: non-0 if the node was not found before
+ *
+ * Crawl node and edge callback
+ *
+ * Called for every node found, once with @is_new set when the node is
+ * first found and again with it unset for each later edge to it.
+ * Nodes over the depth limit are not reported.
+ */
+typedef void (*flickcurl_crawl_handler)(void* user_data, const char* id, const char* from_id, int depth, int is_new);
+
+
 /* callback handlers */
 
 /**
@@ -1676,6 +2184,60 @@ flickcurl* flickcurl_new_with_handle(void* curl_handle);
 FLICKCURL_API
 void flickcurl_free(flickcurl *fc);
 
+/* cancel the call in progress - may be called from another thread */
+FLICKCURL_API
+void flickcurl_cancel(flickcurl *fc);
+
+/* coalescer of read requests shared by sessions */
+FLICKCURL_API
+flickcurl_coalescer* flickcurl_new_coalescer(void);
+FLICKCURL_API
+void flickcurl_free_coalescer(flickcurl_coalescer* co);
+
+/* cache of decoded objects shared by sessions */
+FLICKCURL_API
+flickcurl_snapshot_cache* flickcurl_new_snapshot_cache(const char* filename, size_t size, int ttl);
+FLICKCURL_API
+void flickcurl_free_snapshot_cache(flickcurl_snapshot_cache* cache);
+FLICKCURL_API
+void flickcurl_snapshot_cache_invalidate(flickcurl_snapshot_cache* cache, const char* id);
+FLICKCURL_API
+void flickcurl_snapshot_cache_get_counts(flickcurl_snapshot_cache* cache, int* hits_p, int* misses_p);
+
+/* local store of photos, people and photosets */
+FLICKCURL_API
+flickcurl_store* flickcurl_new_store(const char* filename, int read_only);
+FLICKCURL_API
+void flickcurl_free_store(flickcurl_store* store);
+FLICKCURL_API
+int flickcurl_store_put_photo(flickcurl_store* store, flickcurl_photo* photo);
+FLICKCURL_API
+int flickcurl_store_put_person(flickcurl_store* store, flickcurl_person* person);
+FLICKCURL_API
+int flickcurl_store_put_photoset(flickcurl_store* store, flickcurl_photoset* photoset);
+FLICKCURL_API
+int flickcurl_store_remove_photo(flickcurl_store* store, const char* photo_id);
+FLICKCURL_API
+int flickcurl_store_remove_person(flickcurl_store* store, const char* user_id);
+FLICKCURL_API
+int flickcurl_store_remove_photoset(flickcurl_store* store, const char* photoset_id);
+FLICKCURL_API
+flickcurl_photo* flickcurl_store_get_photo(flickcurl_store* store, const char* photo_id);
+FLICKCURL_API
+flickcurl_person* flickcurl_store_get_person(flickcurl_store* store, const char* user_id);
+FLICKCURL_API
+flickcurl_photoset* flickcurl_store_get_photoset(flickcurl_store* store, const char* photoset_id);
+FLICKCURL_API
+void flickcurl_store_get_counts(flickcurl_store* store, int* photos_p, int* people_p, int* photosets_p);
+FLICKCURL_API
+flickcurl_photo** flickcurl_store_search_photos(flickcurl_store* store, flickcurl_search_params* params);
+FLICKCURL_API
+flickcurl_photo** flickcurl_store_get_updated_photos(flickcurl_store* store, int min_date, int per_page, int page);
+FLICKCURL_API
+flickcurl_photoset** flickcurl_store_get_photosets(flickcurl_store* store, const char* user_id);
+FLICKCURL_API
+int flickcurl_store_compact(flickcurl_store* store);
+
 /* flickcurl* object set methods */
 FLICKCURL_API
 void flickcurl_set_curl_setopt_handler(flickcurl *fc, flickcurl_curl_setopt_handler curl_handler, void* curl_handler_data);
@@ -1686,26 +2248,50 @@ void flickcurl_set_upload_service_uri(flickcurl *fc, const char *uri);
 FLICKCURL_API
 void flickcurl_set_replace_service_uri(flickcurl *fc, const char *uri);
 FLICKCURL_API
+int flickcurl_set_accept_encoding(flickcurl* fc, const char *encoding);
+FLICKCURL_API
 void flickcurl_set_api_key(flickcurl* fc, const char *api_key);
 FLICKCURL_API
 void flickcurl_set_auth_token(flickcurl *fc, const char* auth_token);
 FLICKCURL_API
+void flickcurl_set_build_threads(flickcurl* fc, int threads);
+FLICKCURL_API
 void flickcurl_set_data(flickcurl *fc, void* data, size_t data_length);
 FLICKCURL_API
 void flickcurl_set_error_handler(flickcurl* fc, flickcurl_message_handler error_handler,  void *error_data);
 FLICKCURL_API
 void flickcurl_set_http_accept(flickcurl* fc, const char *value);
 FLICKCURL_API
+void flickcurl_set_json_response(flickcurl* fc, int json_response);
+FLICKCURL_API
+int flickcurl_set_json_response_methods(flickcurl* fc, const char** methods);
+FLICKCURL_API
+void flickcurl_set_lazy_photos(flickcurl* fc, int lazy_photos);
+FLICKCURL_API
+int flickcurl_set_photo_columns(flickcurl* fc, const flickcurl_photo_field_type* fields);
+FLICKCURL_API
 void flickcurl_set_proxy(flickcurl* fc, const char *proxy);
 FLICKCURL_API
+void flickcurl_set_call_timeout(flickcurl *fc, long timeout_msec);
+FLICKCURL_API
 void flickcurl_set_request_delay(flickcurl *fc, long delay_msec);
 FLICKCURL_API
+void flickcurl_set_coalescer(flickcurl* fc, flickcurl_coalescer* co);
+FLICKCURL_API
+int flickcurl_set_hedge_params(flickcurl *fc, flickcurl_hedge_params* params);
+FLICKCURL_API
+int flickcurl_set_retry_params(flickcurl *fc, flickcurl_retry_params* params);
+FLICKCURL_API
 void flickcurl_set_shared_secret(flickcurl* fc, const char *secret);
 FLICKCURL_API
+void flickcurl_set_snapshot_cache(flickcurl* fc, flickcurl_snapshot_cache* cache);
+FLICKCURL_API
 void flickcurl_set_sign(flickcurl *fc);
 FLICKCURL_API
 void flickcurl_set_tag_handler(flickcurl* fc,  flickcurl_tag_handler tag_handler, void *tag_data);
 FLICKCURL_API
+int flickcurl_set_tag_interning(flickcurl* fc, int intern_tags);
+FLICKCURL_API
 void flickcurl_set_user_agent(flickcurl* fc, const char *user_agent);
 FLICKCURL_API
 void flickcurl_set_write(flickcurl *fc, int is_write);
@@ -1713,6 +2299,16 @@ FLICKCURL_API
 void flickcurl_set_xml_data(flickcurl *fc, xmlDocPtr doc);
 FLICKCURL_API
 int flickcurl_get_current_request_wait(flickcurl *fc);
+FLICKCURL_API
+void flickcurl_get_response_bytes(flickcurl *fc, size_t* transfer_bytes_p, size_t* content_bytes_p);
+FLICKCURL_API
+void flickcurl_get_total_response_bytes(flickcurl *fc, size_t* transfer_bytes_p, size_t* content_bytes_p);
+FLICKCURL_API
+int flickcurl_get_coalesced_count(flickcurl* fc);
+FLICKCURL_API
+void flickcurl_get_hedge_counts(flickcurl *fc, int* hedges_p, int* wins_p);
+FLICKCURL_API
+void flickcurl_get_retry_counts(flickcurl *fc, int* call_retries_p, int* total_retries_p);
 
 /* flickcurl* object set methods */
 FLICKCURL_API
@@ -1746,6 +2342,18 @@ void flickcurl_free_photos(flickcurl_photo** photos);
 FLICKCURL_API
 void flickcurl_free_photos_list(flickcurl_photos_list* photos_list);
 FLICKCURL_API
+void flickcurl_free_photo_columns(flickcurl_photo_columns* columns);
+
+/* photo lists written as Arrow IPC streams */
+FLICKCURL_API
+flickcurl_arrow_writer* flickcurl_new_arrow_writer(flickcurl* fc, FILE* fh, const flickcurl_photo_field_type* fields);
+FLICKCURL_API
+void flickcurl_free_arrow_writer(flickcurl_arrow_writer* writer);
+FLICKCURL_API
+int flickcurl_arrow_writer_write_photos_list(flickcurl_arrow_writer* writer, flickcurl_photos_list* photos_list);
+FLICKCURL_API
+int flickcurl_arrow_writer_finish(flickcurl_arrow_writer* writer);
+FLICKCURL_API
 void flickcurl_free_photoset(flickcurl_photoset *photoset);
 FLICKCURL_API
 void flickcurl_free_photosets(flickcurl_photoset **photosets_object);
@@ -1808,6 +2416,32 @@ FLICKCURL_API
 char* flickcurl_user_icon_uri(int farm, int server, char *nsid);
 FLICKCURL_API
 char* flickcurl_photo_as_user_icon_uri(flickcurl_photo *photo);
+/* get photo fields, decoding them first for lazy photos */
+FLICKCURL_API
+const char* flickcurl_photo_get_field_string(flickcurl_photo *photo, flickcurl_photo_field_type field);
+FLICKCURL_API
+int flickcurl_photo_get_field_integer(flickcurl_photo *photo, flickcurl_photo_field_type field);
+FLICKCURL_API
+flickcurl_field_value_type flickcurl_photo_get_field_type(flickcurl_photo *photo, flickcurl_photo_field_type field);
+FLICKCURL_API
+time_t flickcurl_photo_get_time(flickcurl_photo *photo, flickcurl_photo_field_type field);
+/* get photo fields from photo columns */
+FLICKCURL_API
+int flickcurl_photo_columns_get_rows_count(flickcurl_photo_columns* columns);
+FLICKCURL_API
+const char* flickcurl_photo_columns_get_id(flickcurl_photo_columns* columns, int row);
+FLICKCURL_API
+flickcurl_field_value_type flickcurl_photo_columns_get_field_type(flickcurl_photo_columns* columns, flickcurl_photo_field_type field);
+FLICKCURL_API
+int flickcurl_photo_columns_has_value(flickcurl_photo_columns* columns, int row, flickcurl_photo_field_type field);
+FLICKCURL_API
+const char* flickcurl_photo_columns_get_string(flickcurl_photo_columns* columns, int row, flickcurl_photo_field_type field);
+FLICKCURL_API
+int flickcurl_photo_columns_get_integer(flickcurl_photo_columns* columns, int row, flickcurl_photo_field_type field);
+FLICKCURL_API
+time_t flickcurl_photo_columns_get_time(flickcurl_photo_columns* columns, int row, flickcurl_photo_field_type field);
+FLICKCURL_API
+double flickcurl_photo_columns_get_float(flickcurl_photo_columns* columns, int row, flickcurl_photo_field_type field);
 /* get a short URL for a photo ID - http://flic.kr */
 FLICKCURL_API
 char* flickcurl_photo_id_as_short_uri(char *photo_id);
@@ -1845,6 +2479,10 @@ FLICKCURL_API
 int flickcurl_photos_list_params_init(flickcurl_photos_list_params* list_params);
 FLICKCURL_API
 int flickcurl_search_params_init(flickcurl_search_params* params);
+FLICKCURL_API
+int flickcurl_hedge_params_init(flickcurl_hedge_params* params);
+FLICKCURL_API
+int flickcurl_retry_params_init(flickcurl_retry_params* params);
 
 
 /**
@@ -2402,6 +3040,68 @@ void flickcurl_free_stats(flickcurl_stat **stats_object);
 FLICKCURL_API
 void flickcurl_free_view_stats(flickcurl_view_stats *view_stats);
 
+/* photo stats time series */
+FLICKCURL_API
+int flickcurl_stats_engine_params_init(flickcurl_stats_engine_params* params);
+FLICKCURL_API
+flickcurl_stats_engine* flickcurl_new_stats_engine(flickcurl* fc, flickcurl_stats_engine_params* params);
+FLICKCURL_API
+void flickcurl_free_stats_engine(flickcurl_stats_engine* se);
+FLICKCURL_API
+int flickcurl_stats_engine_add_photo(flickcurl_stats_engine* se, const char* photo_id);
+FLICKCURL_API
+int flickcurl_stats_engine_refresh(flickcurl_stats_engine* se, const char* date);
+FLICKCURL_API
+int flickcurl_stats_engine_get_pending(flickcurl_stats_engine* se);
+FLICKCURL_API
+int flickcurl_stats_engine_get_failed_count(flickcurl_stats_engine* se);
+FLICKCURL_API
+int flickcurl_stats_engine_get_photos_count(flickcurl_stats_engine* se);
+FLICKCURL_API
+const char* flickcurl_stats_engine_get_photo_id(flickcurl_stats_engine* se, int photo);
+FLICKCURL_API
+int flickcurl_stats_engine_get_days_count(flickcurl_stats_engine* se);
+FLICKCURL_API
+const char* flickcurl_stats_engine_get_date(flickcurl_stats_engine* se, int day);
+FLICKCURL_API
+int flickcurl_stats_engine_get_stat(flickcurl_stats_engine* se, int photo, int day, flickcurl_stat* stat);
+FLICKCURL_API
+int flickcurl_stats_engine_get_series(flickcurl_stats_engine* se, int photo, int* views, int* comments, int* favorites);
+FLICKCURL_API
+int flickcurl_stats_engine_get_totals(flickcurl_stats_engine* se, int photo, flickcurl_stat* stat);
+FLICKCURL_API
+flickcurl_stat** flickcurl_stats_engine_get_domains(flickcurl_stats_engine* se, int photo, int day);
+FLICKCURL_API
+flickcurl_stat** flickcurl_stats_engine_get_referrers(flickcurl_stats_engine* se, int photo, int day);
+
+/* graph crawls */
+FLICKCURL_API
+int flickcurl_crawler_params_init(flickcurl_crawler_params* params);
+FLICKCURL_API
+flickcurl_crawler* flickcurl_new_crawler(flickcurl* fc, flickcurl_crawler_params* params);
+FLICKCURL_API
+void flickcurl_free_crawler(flickcurl_crawler* crawler);
+FLICKCURL_API
+int flickcurl_crawler_add_expander(flickcurl_crawler* crawler, flickcurl_crawl_expander expander, void* user_data, int first_depth, int last_depth);
+FLICKCURL_API
+void flickcurl_crawler_set_handler(flickcurl_crawler* crawler, flickcurl_crawl_handler handler, void* user_data);
+FLICKCURL_API
+int flickcurl_crawler_add_seed(flickcurl_crawler* crawler, const char* id);
+FLICKCURL_API
+int flickcurl_crawler_start(flickcurl_crawler* crawler);
+FLICKCURL_API
+int flickcurl_crawler_checkpoint(flickcurl_crawler* crawler);
+FLICKCURL_API
+int flickcurl_crawler_get_pending(flickcurl_crawler* crawler);
+FLICKCURL_API
+void flickcurl_crawler_get_counts(flickcurl_crawler* crawler, int* nodes_p, int* expanded_p, int* failed_p);
+FLICKCURL_API
+char** flickcurl_crawl_expand_contacts(flickcurl* fc, void* user_data, const char* id, int per_page, int page);
+FLICKCURL_API
+char** flickcurl_crawl_expand_group_members(flickcurl* fc, void* user_data, const char* id, int per_page, int page);
+FLICKCURL_API
+char** flickcurl_crawl_expand_favorites_owners(flickcurl* fc, void* user_data, const char* id, int per_page, int page);
+
 /* flickr.tag */
 FLICKCURL_API
 flickcurl_photos_list* flickcurl_tags_getClusterPhotos(flickcurl* fc, const char* tag, const char* cluster_id, flickcurl_photos_list_params* list_params);
@@ -2422,6 +3122,22 @@ flickcurl_tag** flickcurl_tags_getMostFrequentlyUsed(flickcurl* fc);
 FLICKCURL_API
 flickcurl_tag** flickcurl_tags_getRelated(flickcurl* fc, const char* tag);
 
+/* local tag index */
+FLICKCURL_API
+flickcurl_tag_index* flickcurl_new_tag_index(const char* filename);
+FLICKCURL_API
+void flickcurl_free_tag_index(flickcurl_tag_index* index);
+FLICKCURL_API
+int flickcurl_tag_index_save(flickcurl_tag_index* index);
+FLICKCURL_API
+int flickcurl_tag_index_add_photo(flickcurl_tag_index* index, flickcurl_photo* photo);
+FLICKCURL_API
+int flickcurl_tag_index_remove_photo(flickcurl_tag_index* index, const char* photo_id);
+FLICKCURL_API
+void flickcurl_tag_index_get_counts(flickcurl_tag_index* index, int* photos_p, int* terms_p);
+FLICKCURL_API
+char** flickcurl_tag_index_search(flickcurl_tag_index* index, const char* tags, const char* tag_mode, const char* machine_tags, const char* machine_tag_mode, int* count_p);
+
 /* flickr.test */
 FLICKCURL_API
 int flickcurl_test_echo(flickcurl* fc, const char* key, const char* value);
@@ -2502,6 +3218,12 @@ void flickcurl_array_free(char *array[]);
  * flickcurl_serializer_s
  */
 
+/**
+ * flickcurl_triples_writer_s:
+ *
+ * flickcurl_triples_writer_s
+ */
+
 /**
  * flickcurl_shapedata_s:
  *
@@ -0,0 +1,480 @@
+/* -*- Mode: c++; c-basic-offset: 2 -*-
+ *
+ * flickcurl.hpp - Flickcurl C++20 API
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * Header-only wrappers over the C API.  Nothing here allocates beyond
+ * what the C functions do:
+ *
+ *   flickcurlpp::session      owns a flickcurl* and converts to one
+ *   flickcurlpp::object<T>    owns a T* returned by the C API
+ *   flickcurlpp::array<T>     owns a NULL-terminated T** and is a range of T&
+ *   flickcurlpp::own()        takes ownership of a T* or T** result
+ *   flickcurlpp::field()      std::string_view of a photo field
+ *   flickcurlpp::paged_photos range over the photos of every page of a
+ *                           flickcurl_*_params() photo list call
+ *   flickcurlpp::async()      co_await-able call on the asynchronous
+ *                           call API (see flickcurl_async_submit())
+ *
+ * Failures are reported as by the C API: an empty object or array
+ * and a message to the session error handler.
+ *
+ * Example:
+ *
+ *   flickcurlpp::session fc;
+ *   auto photo = flickcurlpp::own(flickcurl_photos_getInfo(fc, "123"));
+ *   if(photo)
+ *     std::cout << flickcurlpp::field(*photo, PHOTO_FIELD_title) << '\n';
+ *
+ *   auto sizes = co_await flickcurlpp::async(fc, [](flickcurl* f) {
+ *     return flickcurl_photos_getSizes(f, "123");
+ *   });
+ *   for(flickcurl_size& size : sizes)
+ *     ...
+ */
+
+#ifndef FLICKCURL_HPP
+#define FLICKCURL_HPP
+
+#include <flickcurl.h>
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+
+namespace flickcurlpp {
+
+/* Free functions of the C API for each result type */
+template<class T> struct object_traits;
+template<class T> struct array_traits;
+
+#define FLICKCURL_HPP_OBJECT(type, free_fn)                             \
+  template<> struct object_traits<type> {                               \
+    static void free(type* p) noexcept { free_fn(p); }                  \
+  }
+#define FLICKCURL_HPP_ARRAY(type, free_fn)                              \
+  template<> struct array_traits<type> {                                \
+    static void free(type** p) noexcept { free_fn(p); }                 \
+  }
+
+/* strings such as NSIDs returned by the C API */
+FLICKCURL_HPP_OBJECT(char, std::free);
+FLICKCURL_HPP_ARRAY(flickcurl_activity, flickcurl_free_activities);
+FLICKCURL_HPP_ARRAY(flickcurl_blog, flickcurl_free_blogs);
+FLICKCURL_HPP_ARRAY(flickcurl_blog_service, flickcurl_free_blog_services);
+FLICKCURL_HPP_OBJECT(flickcurl_category, flickcurl_free_category);
+FLICKCURL_HPP_ARRAY(flickcurl_category, flickcurl_free_categories);
+FLICKCURL_HPP_OBJECT(flickcurl_collection, flickcurl_free_collection);
+FLICKCURL_HPP_ARRAY(flickcurl_collection, flickcurl_free_collections);
+FLICKCURL_HPP_OBJECT(flickcurl_comment, flickcurl_free_comment);
+FLICKCURL_HPP_ARRAY(flickcurl_comment, flickcurl_free_comments);
+FLICKCURL_HPP_OBJECT(flickcurl_contact, flickcurl_free_contact);
+FLICKCURL_HPP_ARRAY(flickcurl_contact, flickcurl_free_contacts);
+FLICKCURL_HPP_OBJECT(flickcurl_context, flickcurl_free_context);
+FLICKCURL_HPP_ARRAY(flickcurl_context, flickcurl_free_contexts);
+FLICKCURL_HPP_OBJECT(flickcurl_exif, flickcurl_free_exif);
+FLICKCURL_HPP_ARRAY(flickcurl_exif, flickcurl_free_exifs);
+FLICKCURL_HPP_OBJECT(flickcurl_gallery, flickcurl_free_gallery);
+FLICKCURL_HPP_ARRAY(flickcurl_gallery, flickcurl_free_galleries);
+FLICKCURL_HPP_OBJECT(flickcurl_group, flickcurl_free_group);
+FLICKCURL_HPP_ARRAY(flickcurl_group, flickcurl_free_groups);
+FLICKCURL_HPP_OBJECT(flickcurl_institution, flickcurl_free_institution);
+FLICKCURL_HPP_ARRAY(flickcurl_institution, flickcurl_free_institutions);
+FLICKCURL_HPP_OBJECT(flickcurl_location, flickcurl_free_location);
+FLICKCURL_HPP_OBJECT(flickcurl_member, flickcurl_free_member);
+FLICKCURL_HPP_ARRAY(flickcurl_member, flickcurl_free_members);
+FLICKCURL_HPP_OBJECT(flickcurl_method, flickcurl_free_method);
+FLICKCURL_HPP_OBJECT(flickcurl_perms, flickcurl_free_perms);
+FLICKCURL_HPP_OBJECT(flickcurl_person, flickcurl_free_person);
+FLICKCURL_HPP_ARRAY(flickcurl_person, flickcurl_free_persons);
+FLICKCURL_HPP_OBJECT(flickcurl_photo, flickcurl_free_photo);
+FLICKCURL_HPP_ARRAY(flickcurl_photo, flickcurl_free_photos);
+FLICKCURL_HPP_OBJECT(flickcurl_photos_list, flickcurl_free_photos_list);
+FLICKCURL_HPP_OBJECT(flickcurl_photoset, flickcurl_free_photoset);
+FLICKCURL_HPP_ARRAY(flickcurl_photoset, flickcurl_free_photosets);
+FLICKCURL_HPP_OBJECT(flickcurl_place, flickcurl_free_place);
+FLICKCURL_HPP_ARRAY(flickcurl_place, flickcurl_free_places);
+FLICKCURL_HPP_ARRAY(flickcurl_place_type_info, flickcurl_free_place_type_infos);
+FLICKCURL_HPP_OBJECT(flickcurl_shapedata, flickcurl_free_shape);
+FLICKCURL_HPP_ARRAY(flickcurl_shapedata, flickcurl_free_shapes);
+FLICKCURL_HPP_OBJECT(flickcurl_size, flickcurl_free_size);
+FLICKCURL_HPP_ARRAY(flickcurl_size, flickcurl_free_sizes);
+FLICKCURL_HPP_OBJECT(flickcurl_stat, flickcurl_free_stat);
+FLICKCURL_HPP_ARRAY(flickcurl_stat, flickcurl_free_stats);
+FLICKCURL_HPP_OBJECT(flickcurl_tag, flickcurl_free_tag);
+FLICKCURL_HPP_ARRAY(flickcurl_tag, flickcurl_free_tags);
+FLICKCURL_HPP_OBJECT(flickcurl_tag_clusters, flickcurl_free_tag_clusters);
+FLICKCURL_HPP_OBJECT(flickcurl_tag_namespace, flickcurl_free_tag_namespace);
+FLICKCURL_HPP_ARRAY(flickcurl_tag_namespace, flickcurl_free_tag_namespaces);
+FLICKCURL_HPP_OBJECT(flickcurl_tag_predicate_value, flickcurl_free_tag_predicate_value);
+FLICKCURL_HPP_ARRAY(flickcurl_tag_predicate_value, flickcurl_free_tag_predicate_values);
+FLICKCURL_HPP_OBJECT(flickcurl_ticket, flickcurl_free_ticket);
+FLICKCURL_HPP_ARRAY(flickcurl_ticket, flickcurl_free_tickets);
+FLICKCURL_HPP_OBJECT(flickcurl_upload_status, flickcurl_free_upload_status);
+FLICKCURL_HPP_OBJECT(flickcurl_user_upload_status, flickcurl_free_user_upload_status);
+FLICKCURL_HPP_OBJECT(flickcurl_video, flickcurl_free_video);
+FLICKCURL_HPP_OBJECT(flickcurl_view_stats, flickcurl_free_view_stats);
+
+#undef FLICKCURL_HPP_OBJECT
+#undef FLICKCURL_HPP_ARRAY
+
+
+template<class T>
+struct object_deleter {
+  void operator()(T* p) const noexcept { object_traits<T>::free(p); }
+};
+
+/* Owner of one result object */
+template<class T>
+using object = std::unique_ptr<T, object_deleter<T>>;
+
+
+/* Owner of a NULL-terminated result array; a range of T& */
+template<class T>
+class array {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    iterator() noexcept = default;
+    explicit iterator(T** p) noexcept : p_(p) {}
+
+    reference operator*() const noexcept { return **p_; }
+    pointer operator->() const noexcept { return *p_; }
+    iterator& operator++() noexcept { ++p_; return *this; }
+    iterator operator++(int) noexcept { iterator i = *this; ++p_; return i; }
+    bool operator==(const iterator&) const noexcept = default;
+
+  private:
+    T** p_ = nullptr;
+  };
+
+  array() noexcept = default;
+  explicit array(T** items) noexcept : items_(items) {
+    if(items_)
+      while(items_[size_])
+        size_++;
+  }
+  ~array() { reset(); }
+
+  array(array&& other) noexcept
+    : items_(std::exchange(other.items_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+  array& operator=(array&& other) noexcept {
+    if(this != &other) {
+      reset();
+      items_ = std::exchange(other.items_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+  array(const array&) = delete;
+  array& operator=(const array&) = delete;
+
+  explicit operator bool() const noexcept { return items_ != nullptr; }
+  T** get() const noexcept { return items_; }
+  T** release() noexcept { size_ = 0; return std::exchange(items_, nullptr); }
+  void reset() noexcept {
+    if(items_)
+      array_traits<T>::free(items_);
+    items_ = nullptr;
+    size_ = 0;
+  }
+
+  std::size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return !size_; }
+  T& operator[](std::size_t i) const noexcept { return *items_[i]; }
+  iterator begin() const noexcept { return iterator(items_); }
+  iterator end() const noexcept { return iterator(items_ + size_); }
+
+private:
+  T** items_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+
+/* Take ownership of a result of the C API */
+template<class T>
+object<T> own(T* p) noexcept { return object<T>(p); }
+
+template<class T>
+array<T> own(T** p) noexcept { return array<T>(p); }
+
+
+/* Calls flickcurl_init() and flickcurl_finish() */
+class library {
+public:
+  library() noexcept { flickcurl_init(); }
+  ~library() { flickcurl_finish(); }
+  library(const library&) = delete;
+  library& operator=(const library&) = delete;
+};
+
+
+/* Owner of a flickcurl session, usable wherever a flickcurl* is */
+class session {
+public:
+  session() noexcept : fc_(flickcurl_new()) {}
+  explicit session(flickcurl* fc) noexcept : fc_(fc) {}
+  ~session() { reset(); }
+
+  session(session&& other) noexcept
+    : fc_(std::exchange(other.fc_, nullptr)) {}
+  session& operator=(session&& other) noexcept {
+    if(this != &other) {
+      reset();
+      fc_ = std::exchange(other.fc_, nullptr);
+    }
+    return *this;
+  }
+  session(const session&) = delete;
+  session& operator=(const session&) = delete;
+
+  operator flickcurl*() const noexcept { return fc_; }
+  explicit operator bool() const noexcept { return fc_ != nullptr; }
+  flickcurl* get() const noexcept { return fc_; }
+  flickcurl* release() noexcept { return std::exchange(fc_, nullptr); }
+  void reset() noexcept {
+    if(fc_)
+      flickcurl_free(fc_);
+    fc_ = nullptr;
+  }
+
+private:
+  flickcurl* fc_;
+};
+
+
+/* Views of C strings that may be NULL; valid while the owner is */
+inline std::string_view
+view(const char* s) noexcept
+{
+  return s ? std::string_view(s) : std::string_view();
+}
+
+/* Photo field values; a lazy photo decodes the field on first use
+ * which does not change its value so these take a const photo */
+inline std::string_view
+field(const flickcurl_photo& photo, flickcurl_photo_field_type type) noexcept
+{
+  auto* p = const_cast<flickcurl_photo*>(&photo);
+  return view(flickcurl_photo_get_field_string(p, type));
+}
+
+inline int
+field_integer(const flickcurl_photo& photo,
+              flickcurl_photo_field_type type) noexcept
+{
+  auto* p = const_cast<flickcurl_photo*>(&photo);
+  return flickcurl_photo_get_field_integer(p, type);
+}
+
+
+/*
+ * Range over the photos of all the pages of a photo list call.
+ *
+ * @call is invoked as call(fc, &list_params) with the page set and
+ * returns a flickcurl_photos_list* such as from
+ * flickcurl_photosets_getPhotos_params().  Pages are fetched as the
+ * range is iterated and a photo reference is valid until the iterator
+ * moves past the end of its page.  Iteration ends after the last
+ * page, an empty page or a failed call.
+ */
+template<class Call>
+class paged_photos {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = flickcurl_photo;
+    using difference_type = std::ptrdiff_t;
+    using pointer = flickcurl_photo*;
+    using reference = flickcurl_photo&;
+
+    iterator() noexcept = default;
+    explicit iterator(paged_photos* range) noexcept : range_(range) {}
+
+    reference operator*() const noexcept {
+      return *range_->list_->photos[index_];
+    }
+    pointer operator->() const noexcept {
+      return range_->list_->photos[index_];
+    }
+    iterator& operator++() {
+      if(++index_ >= range_->list_->photos_count) {
+        range_->next_page();
+        index_ = 0;
+      }
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const noexcept {
+      return !range_ || !range_->list_ ||
+             index_ >= range_->list_->photos_count;
+    }
+
+  private:
+    paged_photos* range_ = nullptr;
+    int index_ = 0;
+  };
+
+  paged_photos(flickcurl* fc, Call call, int per_page = -1,
+               const char* extras = nullptr)
+    : fc_(fc), call_(std::move(call)) {
+    flickcurl_photos_list_params_init(&params_);
+    params_.per_page = per_page;
+    params_.extras = extras;
+  }
+  paged_photos(const paged_photos&) = delete;
+  paged_photos& operator=(const paged_photos&) = delete;
+
+  /* starts again from the first page */
+  iterator begin() {
+    params_.page = 1;
+    fetch();
+    return iterator(this);
+  }
+  std::default_sentinel_t end() const noexcept { return {}; }
+
+  /* list of the current page or NULL */
+  const flickcurl_photos_list* page() const noexcept { return list_.get(); }
+
+private:
+  void fetch() {
+    list_.reset(call_(fc_, &params_));
+    if(list_ && (!list_->photos || list_->photos_count <= 0))
+      list_.reset();
+  }
+
+  void next_page() {
+    if(list_ && list_->per_page > 0 &&
+       list_->page * list_->per_page < list_->total_count) {
+      params_.page = list_->page + 1;
+      fetch();
+    } else
+      list_.reset();
+  }
+
+  flickcurl* fc_;
+  Call call_;
+  flickcurl_photos_list_params params_;
+  object<flickcurl_photos_list> list_;
+};
+
+
+/*
+ * Awaitable call made with flickcurl_async_submit().
+ *
+ * @builder is invoked as builder(fc), possibly several times, and
+ * returns the C API result pointer; it must not throw.  co_await gives
+ * the owned result, empty on failure.  The awaiting coroutine is
+ * resumed from within flickcurl_async_socket_action() or
+ * flickcurl_async_timeout().  The awaiter holds all the state so the
+ * only allocations are those of the C layer; it cannot be copied or
+ * moved and destroying it, such as by destroying the suspended
+ * coroutine, cancels the call.
+ *
+ * GCC 12 destroys a temporary awaiter wrongly when its builder
+ * captures objects with destructors such as std::string: store the
+ * result of async() in a variable and co_await that instead.
+ */
+template<class Builder>
+class async_call {
+  using result_type = std::invoke_result_t<Builder&, flickcurl*>;
+  static_assert(std::is_pointer_v<result_type>,
+                "builder must return a flickcurl result pointer");
+
+public:
+  async_call(flickcurl* fc, Builder builder)
+    : fc_(fc), builder_(std::move(builder)) {}
+
+  /* the C layer holds a pointer to this awaiter until the call ends */
+  ~async_call() {
+    if(call_) {
+      flickcurl_async_call* call = call_;
+      /* done() must not resume the coroutine being destroyed */
+      call_ = nullptr;
+      flickcurl_async_cancel(fc_, call);
+    }
+  }
+
+  async_call(const async_call&) = delete;
+  async_call& operator=(const async_call&) = delete;
+  async_call(async_call&&) = delete;
+  async_call& operator=(async_call&&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) noexcept {
+    handle_ = handle;
+    call_ = flickcurl_async_submit(fc_, &async_call::build, this,
+                                   &async_call::done, this);
+    /* NULL when the call has already ended and done() has run */
+    return call_ != nullptr;
+  }
+
+  auto await_resume() noexcept { return own(result_); }
+
+private:
+  static void* build(flickcurl* fc, void* data) noexcept {
+    auto* self = static_cast<async_call*>(data);
+    return static_cast<void*>(self->builder_(fc));
+  }
+
+  static void done(void* data, flickcurl_async_call*,
+                   void* result) noexcept {
+    auto* self = static_cast<async_call*>(data);
+
+    self->result_ = static_cast<result_type>(result);
+    /* NULL when the call ended inside await_suspend() or is being
+     * cancelled by the destructor */
+    if(self->call_) {
+      self->call_ = nullptr;
+      /* the coroutine may end and free this awaiter when resumed */
+      self->handle_.resume();
+    }
+  }
+
+  flickcurl* fc_;
+  Builder builder_;
+  std::coroutine_handle<> handle_;
+  flickcurl_async_call* call_ = nullptr;
+  result_type result_ = nullptr;
+};
+
+
+template<class Builder>
+async_call<Builder>
+async(flickcurl* fc, Builder builder)
+{
+  return async_call<Builder>(fc, std::move(builder));
+}
+
+} /* namespace flickcurlpp */
+
+#endif
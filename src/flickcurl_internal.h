@@ -39,6 +39,14 @@ typedef __int16 int16_t;
 #include <mtwist_config.h>
 #include <mtwist.h>
 
+#if defined(HAVE_STDATOMIC_H) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef atomic_int flickcurl_cancel_flag;
+#else
+#include <signal.h>
+typedef volatile sig_atomic_t flickcurl_cancel_flag;
+#endif
+
 #if defined (OFFLINE) && defined (CAPTURE)
 #error "Cannot define both OFFLINE and CAPTURE"
 #endif
@@ -122,6 +130,10 @@ int flickcurl_prepare(flickcurl *fc, const char* method);
 int flickcurl_prepare_noauth(flickcurl *fc, const char* method);
 /* Prepare Flickr API request - POST with form-data parameters */
 int flickcurl_prepare_upload(flickcurl *fc, const char* url, const char* upload_field, const char* upload_filename);
+/* Sign the request prepared above again with a new OAuth nonce */
+int flickcurl_resign(flickcurl *fc);
+/* Clear a flickcurl_cancel() as the call it stops fails */
+int flickcurl_take_cancel(flickcurl *fc);
 
 /* Invoke Flickr API at URi prepared above and get back an XML document DOM */
 xmlDocPtr flickcurl_invoke(flickcurl *fc);
@@ -135,15 +147,82 @@ void flickcurl_free_form(char **form);
 void flickcurl_free_arg(flickcurl_arg *arg);
 flickcurl_arg** flickcurl_build_args(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* arg_count_p);
 
+/* async.c */
+typedef struct flickcurl_async_request_s flickcurl_async_request;
+
+typedef struct {
+  /* OAuth credentials or NULL for the session's */
+  char* token;
+  char* token_secret;
+  int weight;
+  /* fair queuing tag of the last request queued in each lane */
+  double last_finish[FLICKCURL_ASYNC_PRIORITY_LOW + 1];
+  /* requests sent */
+  int sent;
+} flickcurl_async_account;
+
+typedef struct {
+  /* multi handle running the transfers */
+  CURLM* multi;
+  flickcurl_async_socket_handler socket_handler;
+  flickcurl_async_timer_handler timer_handler;
+  void* user_data;
+
+  /* calls that have not ended */
+  flickcurl_async_call* calls;
+  int calls_count;
+  /* requests waiting to be sent, oldest first */
+  flickcurl_async_request* waiting;
+  flickcurl_async_request* waiting_tail;
+
+  /* session credentials account and the table of others */
+  flickcurl_async_account session_account;
+  flickcurl_async_account** accounts;
+  int accounts_count;
+  int accounts_size;
+  /* fair queuing virtual time of each lane */
+  double vtime[FLICKCURL_ASYNC_PRIORITY_LOW + 1];
+
+  /* call whose builder is running or NULL */
+  flickcurl_async_call* call;
+  /* non-0 when the running builder must wait for a response */
+  int deferred;
+
+  /* time libcurl next wants flickcurl_async_timeout() or < 0 for none */
+  double curl_timer;
+  /* time last given to the timer handler or < 0 for none */
+  double timer;
+} flickcurl_async_state;
+
+void flickcurl_async_free(flickcurl* fc);
+void flickcurl_async_begin_invoke(flickcurl* fc);
+CURLcode flickcurl_async_perform(flickcurl* fc, CURL** handle_p);
+void flickcurl_async_keep_doc(flickcurl* fc, xmlDocPtr doc);
+xmlDocPtr flickcurl_async_reuse_doc(flickcurl* fc);
+void flickcurl_async_retry(flickcurl* fc);
+
 /* blog.c */
 flickcurl_blog** flickcurl_build_blogs(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* blog_count_p);
 flickcurl_blog_service** flickcurl_build_blog_services(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* blog_services_count_p);
 
+/* coalesce.c */
+typedef struct flickcurl_coalesce_flight_s flickcurl_coalesce_flight;
+
+void flickcurl_coalesce_content(flickcurl* fc, int header, const char* ptr, size_t len);
+CURLcode flickcurl_coalesce_perform(flickcurl* fc, int hedge, CURL** handle_p);
+
 /* collection.c */
 flickcurl_collection** flickcurl_build_collections(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* collection_count_p);
 flickcurl_collection* flickcurl_build_collection(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* root_xpathExpr);
 
 
+/* columns.c */
+flickcurl_photo_columns* flickcurl_new_photo_columns(flickcurl* fc, int rows, const flickcurl_field_value_type* types);
+int flickcurl_photo_columns_add_row(flickcurl_photo_columns* pc, const char* id);
+int flickcurl_photo_columns_set_value(flickcurl_photo_columns* pc, int row, flickcurl_photo_field_type field, flickcurl_field_value_type datatype, const char* value);
+time_t flickcurl_photo_columns_decode_date(const char* value);
+
+
 /* common.c */
 /* invoke an error */
 void flickcurl_error(flickcurl* fc, const char *message, ...);
@@ -157,6 +236,13 @@ char* flickcurl_unixtime_to_sqltimestamp(time_t unix_time);
 /* Convert a SQL timestamp to an ISO dateTime string */
 char* flickcurl_sqltimestamp_to_isotime(const char* timestamp);
 
+/* Get the current time in seconds */
+double flickcurl_get_time(void);
+
+/* Handle response content and header lines */
+size_t flickcurl_write_content(flickcurl* fc, const char* ptr, size_t len);
+size_t flickcurl_header_content(flickcurl* fc, const char* ptr, size_t len);
+
 /* Evaluate an XPath to get the string value */
 char* flickcurl_xpath_eval(flickcurl *fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 char* flickcurl_xpath_eval_to_tree_string(flickcurl* fc, xmlXPathContextPtr xpathNodeCtx, const xmlChar* xpathExpr, size_t* length_p);
@@ -169,6 +255,18 @@ void flickcurl_init_params(flickcurl *fc, int is_write);
 void flickcurl_add_param(flickcurl *fc, const char* key, const char* value);
 void flickcurl_end_params(flickcurl *fc);
 
+/* A response DOM kept alive past the next call by the objects that
+ * point into it, such as lazy photos */
+typedef struct {
+  xmlDocPtr doc;
+  /* references: the session while it still holds @doc, objects and
+   * asynchronous requests */
+  int usage;
+} flickcurl_shared_doc;
+
+flickcurl_shared_doc* flickcurl_share_doc(flickcurl* fc, xmlDocPtr doc);
+void flickcurl_release_doc(flickcurl_shared_doc* shared_doc);
+
 
 /* activity.c */
 flickcurl_activity** flickcurl_build_activities(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* activity_count_p);
@@ -194,10 +292,55 @@ flickcurl_gallery** flickcurl_build_galleries(flickcurl* fc, xmlXPathContextPtr
 /* group.c */
 flickcurl_group** flickcurl_build_groups(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* group_count_p);
 
+/* hedge.c */
+#define FLICKCURL_HEDGE_LATENCY_SAMPLES 64
+
+typedef struct flickcurl_hedge_latency_s flickcurl_hedge_latency;
+
+typedef struct {
+  /* non-0 while a hedged call is running */
+  int active;
+  /* transfer whose response is used: 0 first, 1 duplicate or -1 none yet */
+  int winner;
+  /* non-0 when a transfer has finished or been removed */
+  int done[2];
+  /* duplicate request or NULL */
+  CURL* handle;
+  /* multi handle running the transfers, kept for the session */
+  CURLM* multi;
+  double start_time[2];
+  double response_time;
+  char error_buffer[CURL_ERROR_SIZE];
+
+  /* session counts of duplicate requests sent and used */
+  int hedges;
+  int wins;
+
+  /* recent response start times per method */
+  flickcurl_hedge_latency* latencies;
+} flickcurl_hedge_state;
+
+void flickcurl_hedge_init(flickcurl* fc);
+void flickcurl_hedge_free(flickcurl* fc);
+int flickcurl_hedge_header(flickcurl* fc, int index, const char* line, size_t len);
+CURLcode flickcurl_hedge_perform(flickcurl* fc, int hedge, CURL** handle_p);
+void flickcurl_hedge_finish(flickcurl* fc);
+
 /* institution.c */
 flickcurl_institution** flickcurl_build_institutions(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* institution_count_p);
 flickcurl_institution* flickcurl_build_institution(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 
+/* json.c */
+typedef struct flickcurl_json_parser_s flickcurl_json_parser;
+flickcurl_json_parser* flickcurl_new_json_parser(flickcurl* fc, const char* base_uri);
+void flickcurl_free_json_parser(flickcurl_json_parser* jp);
+int flickcurl_json_parser_parse_chunk(flickcurl_json_parser* jp, const char* buffer, size_t len);
+xmlDocPtr flickcurl_json_parser_finish(flickcurl_json_parser* jp);
+xmlDocPtr flickcurl_json_parser_get_doc(flickcurl_json_parser* jp);
+xmlDocPtr flickcurl_json_parser_detach_doc(flickcurl_json_parser* jp);
+int flickcurl_json_parser_build_photos(flickcurl_json_parser* jp, const char* photos_name);
+flickcurl_photo** flickcurl_json_parser_take_photos(flickcurl_json_parser* jp, int* photo_count_p);
+
 /* location.c */
 flickcurl_location* flickcurl_build_location(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 
@@ -225,15 +368,36 @@ flickcurl_note** flickcurl_build_notes(flickcurl* fc, flickcurl_photo* photo, xm
 /* perms.c */
 flickcurl_perms* flickcurl_build_perms(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 
+/* parallel.c */
+/* build one object for @node with @xpathNodeCtx, or return NULL; in a
+ * worker thread @fc is a blank session with only the failed flag,
+ * error and tag handlers and tag intern table set */
+typedef void* (*flickcurl_build_node_fn)(flickcurl* fc, xmlXPathContextPtr xpathNodeCtx, xmlNodePtr node, void* user_data);
+
+int flickcurl_build_parallel(flickcurl* fc, xmlDocPtr doc, xmlNodeSetPtr nodes, void** results, flickcurl_build_node_fn build, void* user_data);
+
 /* person.c */
 flickcurl_person** flickcurl_build_persons(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* person_count_p);
 flickcurl_person* flickcurl_build_person(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* root_xpathExpr);
 
 /* photo.c */
+/* url_* image sizes of a photo in the last photo list read */
+typedef struct {
+  flickcurl_photo* photo;
+  flickcurl_size** sizes;
+} flickcurl_photo_source_sizes;
+
 flickcurl_photos_list* flickcurl_new_photos_list(flickcurl* fc);
 flickcurl_photo** flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* photo_count_p);
 flickcurl_photo* flickcurl_build_photo(flickcurl* fc, xmlXPathContextPtr xpathCtx);
 flickcurl_photos_list* flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr, const char* format);
+int flickcurl_check_photos_array(flickcurl* fc);
+flickcurl_field_value_type flickcurl_get_photo_field_value_type(flickcurl_photo_field_type field);
+int flickcurl_photo_field_row(const char* path, int start);
+int flickcurl_photo_field_rows_count(void);
+flickcurl_photo* flickcurl_build_photo_values(flickcurl* fc, char** values);
+flickcurl_size** flickcurl_get_photo_source_sizes(flickcurl* fc, flickcurl_photo* photo);
+void flickcurl_free_photo_source_sizes(flickcurl* fc);
 
 /* photoset.c */
 flickcurl_photoset** flickcurl_build_photosets(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* photoset_count_p);
@@ -248,16 +412,91 @@ flickcurl_place_type_info** flickcurl_build_place_types(flickcurl* fc, xmlXPathC
 flickcurl_shapedata** flickcurl_build_shapes(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* shape_count_p);
 flickcurl_shapedata* flickcurl_build_shape(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 
+/* snapshot.c */
+typedef enum {
+  FLICKCURL_SNAPSHOT_PHOTO,
+  FLICKCURL_SNAPSHOT_PERSON,
+  FLICKCURL_SNAPSHOT_PLACE,
+  FLICKCURL_SNAPSHOT_PHOTOSET,
+  FLICKCURL_SNAPSHOT_LAST = FLICKCURL_SNAPSHOT_PHOTOSET
+} flickcurl_snapshot_type;
+
+/* Growable record being written */
+typedef struct {
+  uint32_t* words;
+  int words_count;
+  int words_size;
+  char* heap;
+  size_t heap_len;
+  size_t heap_size;
+  int failed;
+} flickcurl_snapshot_writer;
+
+/* Position in a record being read */
+typedef struct {
+  const uint32_t* words;
+  int words_count;
+  int word;
+  const char* heap;
+  size_t heap_len;
+  int failed;
+} flickcurl_snapshot_reader;
+
+void* flickcurl_snapshot_get(flickcurl* fc, flickcurl_snapshot_type type, const char* id);
+void flickcurl_snapshot_put(flickcurl* fc, flickcurl_snapshot_type type, const char* id, void* object);
+void flickcurl_snapshot_invalidate_params(flickcurl* fc);
+void flickcurl_snapshot_put_string(flickcurl_snapshot_writer* w, const char* s);
+void flickcurl_snapshot_put_photo(flickcurl_snapshot_writer* w, flickcurl_photo* photo);
+flickcurl_photo* flickcurl_snapshot_get_photo(flickcurl_snapshot_reader* r);
+void flickcurl_snapshot_put_person(flickcurl_snapshot_writer* w, flickcurl_person* person);
+flickcurl_person* flickcurl_snapshot_get_person(flickcurl_snapshot_reader* r);
+void flickcurl_snapshot_put_photoset(flickcurl_snapshot_writer* w, flickcurl_photoset* photoset);
+flickcurl_photoset* flickcurl_snapshot_get_photoset(flickcurl_snapshot_reader* r);
+
 /* size.c */
 flickcurl_size** flickcurl_build_sizes(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* size_count_p);
+flickcurl_size** flickcurl_build_sizes_from_extras(flickcurl* fc, xmlNodePtr node);
 
 /* stat.c */
 flickcurl_stat** flickcurl_build_stats(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* stat_count_p);
 
+/* statsengine.c */
+typedef enum {
+  FLICKCURL_STATS_TASK_STATS,
+  FLICKCURL_STATS_TASK_DOMAINS,
+  FLICKCURL_STATS_TASK_REFERRERS,
+  FLICKCURL_STATS_TASK_POPULAR
+} flickcurl_stats_task_type;
+
+/* One web service request to make */
+typedef struct {
+  flickcurl_stats_task_type type;
+  /* photo-day cell index or ring slot for popular photos */
+  int target;
+  /* domain index for referrers */
+  int domain;
+  int page;
+} flickcurl_stats_task;
+
+typedef struct {
+  flickcurl_stats_task* tasks;
+  int head;
+  int tail;
+  int size;
+} flickcurl_stats_queue;
+
+int flickcurl_stats_days_from_civil(int y, int m, int d);
+void flickcurl_stats_format_day(int day, char* buffer);
+int flickcurl_stats_parse_day(const char* date);
+int flickcurl_stats_queue_add(flickcurl_stats_queue* queue, flickcurl_stats_task* task);
+int flickcurl_stats_queue_take(flickcurl_stats_queue* queue, flickcurl_stats_task* task);
+
 /* tags.c  */
 flickcurl_tag** flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* tag_count_p);
 flickcurl_tag** flickcurl_build_tags_from_string(flickcurl* fc, flickcurl_photo* photo, const char *string, int *tag_count_p);
 flickcurl_tag_clusters* flickcurl_build_tag_clusters(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
+typedef struct flickcurl_tag_intern_s flickcurl_tag_intern;
+void flickcurl_release_tag_intern(flickcurl_tag_intern* ti);
 
 /* ticket.c */
 flickcurl_ticket** flickcurl_build_tickets(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* ticket_count_p);
@@ -276,7 +515,10 @@ flickcurl_video* flickcurl_build_video(flickcurl* fc, xmlXPathContextPtr xpathCt
 
 #define FLICKCURL_MAX_OAUTH_PARAM_COUNT 8
 
-#define FLICKCURL_TOTAL_PARAM_COUNT (FLICKCURL_MAX_PARAM_COUNT + FLICKCURL_MAX_LIST_PARAM_COUNT + FLICKCURL_MAX_OAUTH_PARAM_COUNT + 1)
+/* format and nojsoncallback for JSON responses */
+#define FLICKCURL_MAX_RESPONSE_PARAM_COUNT 2
+
+#define FLICKCURL_TOTAL_PARAM_COUNT (FLICKCURL_MAX_PARAM_COUNT + FLICKCURL_MAX_LIST_PARAM_COUNT + FLICKCURL_MAX_OAUTH_PARAM_COUNT + FLICKCURL_MAX_RESPONSE_PARAM_COUNT + 1)
 
 struct flickcurl_chunk_s {
   char* content;
@@ -336,8 +578,21 @@ typedef struct {
 
 
 struct flickcurl_s {
+  /* content bytes of the last response after any decoding */
   int total_bytes;
 
+  /* body bytes of the last response as received on the wire */
+  size_t transfer_bytes;
+
+  /* totals of @transfer_bytes and @total_bytes for the session */
+  size_t session_transfer_bytes;
+  size_t session_content_bytes;
+
+  /* Accept-Encoding: value or NULL for all libcurl supports - flickcurl_set_accept_encoding() */
+  char* accept_encoding;
+  /* non-0 to not use compressed transfers */
+  int no_accept_encoding;
+
   /* Something failed */
   int failed;
 
@@ -372,8 +627,32 @@ struct flickcurl_s {
 
   char *http_accept;
 
-  /* XML parser */
+  /* XML parser, reset for each response so its name dictionary is
+   * kept for the life of the session */
   xmlParserCtxtPtr xc;
+  /* non-0 once @xc has been reset for the current response */
+  int xc_active;
+
+  /* JSON responses - flickcurl_set_json_response() */
+  int json_response;
+  /* NULL-terminated list of methods to always get JSON responses for
+   * - flickcurl_set_json_response_methods() */
+  char** json_response_methods;
+  /* non-0 if the current call asked for a JSON response */
+  int json_call;
+  /* JSON response parser and DOM when @json_call is set */
+  flickcurl_json_parser* jp;
+  /* list element whose photos the JSON parser builds without a DOM */
+  const char* json_photos_name;
+
+  /* non-0 while flickcurl_serialize_photos_iterator() gets photos:
+   * photo lists then also read the url_* image size extras */
+  int want_source_sizes;
+  /* url_* image sizes of the photos of the last list read */
+  flickcurl_photo_source_sizes* source_sizes;
+  int source_sizes_count;
+  /* index in @source_sizes to look at first */
+  int source_sizes_next;
 
   /* The next three fields need to be set before authenticated
    * operations can be done (in most cases).
@@ -416,6 +695,65 @@ struct flickcurl_s {
 
   /* write = POST, else read = GET */
   int is_write;
+
+  /* Hedging policy for read calls - flickcurl_set_hedge_params() */
+  flickcurl_hedge_params hedge_params;
+  flickcurl_hedge_state hedge;
+
+  /* Coalescing of read requests - flickcurl_set_coalescer() */
+  flickcurl_coalescer* coalescer;
+  /* flight led by the current request or NULL */
+  flickcurl_coalesce_flight* coalesce_flight;
+  /* non-0 if the current request used another session's response */
+  int coalesced;
+  /* session count of coalesced requests */
+  int coalesced_count;
+
+  /* Cache of decoded objects - flickcurl_set_snapshot_cache() */
+  flickcurl_snapshot_cache* snapshot_cache;
+
+  /* non-0 to decode photo list fields on first use
+   * - flickcurl_set_lazy_photos() */
+  int lazy_photos;
+  /* photo fields to build photo lists as columns of, ending with
+   * PHOTO_FIELD_none, or NULL - flickcurl_set_photo_columns() */
+  flickcurl_photo_field_type* photo_columns;
+  /* current response DOM when shared with lazy objects or NULL */
+  flickcurl_shared_doc* shared_doc;
+
+  /* threads to build large result lists with
+   * - flickcurl_set_build_threads() */
+  int build_threads;
+
+  /* table of shared tag strings - flickcurl_set_tag_interning() */
+  flickcurl_tag_intern* tag_intern;
+
+  /* Asynchronous calls - flickcurl_async_submit() */
+  flickcurl_async_state async;
+
+  /* Call time limit in milliseconds or 0 - flickcurl_set_call_timeout() */
+  long call_timeout;
+  /* time by which the current call must end in seconds or 0 */
+  double call_deadline;
+  /* set by flickcurl_cancel(), maybe from another thread, and cleared
+   * by the call it stops - flickcurl_take_cancel() */
+  flickcurl_cancel_flag cancelled;
+
+  /* Retry policy for read calls - flickcurl_set_retry_params() */
+  flickcurl_retry_params retry_params;
+  /* time the current call started in seconds */
+  double call_start_time;
+  /* retries done for the current or last call and for the session */
+  int call_retries;
+  int total_retries;
+  /* non-0 if the current call is a read that may be repeated */
+  int idempotent;
+  /* non-0 if the current attempt failed and should be retried after
+   * @retry_delay microseconds */
+  int retry_wanted;
+  long retry_delay;
+  /* Retry-After: response header value in seconds or 0 */
+  long retry_after;
   
   /* data to send in a request */
   void* data;
@@ -480,6 +818,44 @@ struct flickcurl_serializer_s
 void flickcurl_serializer_init(void);
 void flickcurl_serializer_terminate(void);
 
+/* triples.c */
+typedef struct {
+  char* prefix;
+  char* uri;
+  size_t uri_len;
+  /* IRI escaped for writing inside <> */
+  char* escaped_uri;
+  size_t escaped_uri_len;
+  /* non-0 if the prefix can be used in Turtle names */
+  int usable;
+} flickcurl_triples_writer_nspace;
+
+struct flickcurl_triples_writer_s
+{
+  FILE* fh;
+  int turtle;
+  int failed;
+
+  char* buffer;
+  size_t buffer_len;
+
+  flickcurl_triples_writer_nspace* nspaces;
+  int nspaces_count;
+  int nspaces_size;
+  /* index of the last namespace found or -1 */
+  int last_nspace;
+
+  /* Turtle statement being written: subject and predicate IRI */
+  int in_statement;
+  char* subject;
+  size_t subject_len;
+  size_t subject_size;
+  int subject_type;
+  char* predicate;
+  size_t predicate_len;
+  size_t predicate_size;
+};
+
 
 /* sha1.c */
 #define SHA1_DIGEST_LENGTH 20
@@ -493,5 +869,6 @@ int flickcurl_legacy_prepare_common(flickcurl *fc, const char* url, const char*
 void flickcurl_oauth_free(flickcurl_oauth_data* od);
 char* flickcurl_oauth_compute_signature(flickcurl_oauth_data* od, size_t* len_p);
 int flickcurl_oauth_prepare_common(flickcurl *fc, const char* url, const char* method, const char* upload_field, const char* upload_value, int parameters_in_url, int need_auth);
+int flickcurl_oauth_resign(flickcurl *fc, const char* http_method, const char* uri, char** fields, char** values, char** new_uri_p);
 
 #endif
@@ -618,6 +618,9 @@ flickcurl_galleries_getPhotos(flickcurl* fc, const char* gallery_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
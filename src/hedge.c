@@ -0,0 +1,550 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * hedge.c - Flickcurl hedged requests
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * A hedged call runs the request on a curl multi handle.  If the
+ * response has not started after the configured percentile of the
+ * method's recent response start times, a duplicate request is sent
+ * on a fresh connection.  The first of the two to send a final
+ * response status line wins: from then on only its headers and
+ * content reach the parsers and the other transfer is removed.
+ *
+ * An error status from one of the two is only used if the other has
+ * already failed, so that a duplicate rejected by the server cannot
+ * beat a good answer.
+ *
+ * Calls that are not hedged use the same loop with one transfer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+struct flickcurl_hedge_latency_s {
+  char* method;
+  /* response start times in seconds: a ring of the last samples */
+  double samples[FLICKCURL_HEDGE_LATENCY_SAMPLES];
+  int samples_count;
+  int next_sample;
+  struct flickcurl_hedge_latency_s* next;
+};
+
+
+/**
+ * flickcurl_hedge_params_init:
+ * @params: hedge params to init
+ *
+ * Initialise an existing hedge parameter structure
+ *
+ * The defaults are to hedge at the 95th percentile, no sooner than
+ * 50 milliseconds and once 20 response times have been seen for the
+ * method.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_hedge_params_init(flickcurl_hedge_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(*params));
+  params->version = 1;
+
+  params->percentile = 95;
+  params->min_delay = 50;
+  params->min_samples = 20;
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_set_hedge_params:
+ * @fc: flickcurl object
+ * @params: hedge parameters or NULL to turn off hedging
+ *
+ * Set hedging of read web service calls
+ *
+ * See #flickcurl_hedge_params for the details.  Hedging is off by
+ * default.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_hedge_params(flickcurl *fc, flickcurl_hedge_params* params)
+{
+  if(!params) {
+    fc->hedge_params.percentile = 0;
+    return 0;
+  }
+
+  if(params->version != 1 || params->percentile < 0 ||
+     params->percentile > 100 || params->min_delay < 0 ||
+     params->min_samples < 1 ||
+     params->min_samples > FLICKCURL_HEDGE_LATENCY_SAMPLES)
+    return 1;
+
+#if LIBCURL_VERSION_NUM < 0x071c00
+  /* curl_multi_wait() is needed */
+  if(params->percentile) {
+    flickcurl_error(fc, "Hedged requests need libcurl 7.28.0 or newer");
+    return 1;
+  }
+#endif
+
+  memcpy(&fc->hedge_params, params, sizeof(*params));
+  return 0;
+}
+
+
+/**
+ * flickcurl_get_hedge_counts:
+ * @fc: flickcurl object
+ * @hedges_p: pointer to store the number of duplicate requests sent (or NULL)
+ * @wins_p: pointer to store how many of those answered first (or NULL)
+ *
+ * Get the hedged request counts for the session
+ *
+ * See flickcurl_set_hedge_params().
+ */
+void
+flickcurl_get_hedge_counts(flickcurl *fc, int* hedges_p, int* wins_p)
+{
+  if(hedges_p)
+    *hedges_p = fc->hedge.hedges;
+  if(wins_p)
+    *wins_p = fc->hedge.wins;
+}
+
+
+/*
+ * INTERNAL - make the multi handle all calls of the session run on
+ *
+ * It is kept until the session is freed so that its connections are
+ * reused and flickcurl_cancel() can always wake it from another
+ * thread.  Without it, calls are made with curl_easy_perform().
+ */
+void
+flickcurl_hedge_init(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  fc->hedge.multi = curl_multi_init();
+#endif
+}
+
+
+/*
+ * INTERNAL - free hedged request state
+ */
+void
+flickcurl_hedge_free(flickcurl* fc)
+{
+  flickcurl_hedge_state* hs = &fc->hedge;
+
+  while(hs->latencies) {
+    flickcurl_hedge_latency* hl = hs->latencies;
+    hs->latencies = hl->next;
+    free(hl->method);
+    free(hl);
+  }
+
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  if(hs->multi) {
+    curl_multi_cleanup(hs->multi);
+    hs->multi = NULL;
+  }
+#endif
+}
+
+
+static flickcurl_hedge_latency*
+flickcurl_hedge_get_latency(flickcurl* fc, const char* method)
+{
+  flickcurl_hedge_latency* hl;
+  size_t len;
+
+  for(hl = fc->hedge.latencies; hl; hl = hl->next) {
+    if(!strcmp(hl->method, method))
+      return hl;
+  }
+
+  hl = (flickcurl_hedge_latency*)calloc(1, sizeof(*hl));
+  if(!hl)
+    return NULL;
+
+  len = strlen(method);
+  hl->method = (char*)malloc(len + 1);
+  if(!hl->method) {
+    free(hl);
+    return NULL;
+  }
+  memcpy(hl->method, method, len + 1);
+
+  hl->next = fc->hedge.latencies;
+  fc->hedge.latencies = hl;
+
+  return hl;
+}
+
+
+static int
+flickcurl_hedge_compare_doubles(const void* a, const void* b)
+{
+  double da = *(const double*)a;
+  double db = *(const double*)b;
+
+  return (da > db) - (da < db);
+}
+
+
+/* Return delay in seconds before hedging or < 0 to not hedge yet */
+static double
+flickcurl_hedge_delay(flickcurl* fc, flickcurl_hedge_latency* hl)
+{
+  double sorted[FLICKCURL_HEDGE_LATENCY_SAMPLES];
+  double delay;
+  int i;
+
+  if(!hl || hl->samples_count < fc->hedge_params.min_samples)
+    return -1.0;
+
+  memcpy(sorted, hl->samples, sizeof(double) * hl->samples_count);
+  qsort(sorted, hl->samples_count, sizeof(double),
+        flickcurl_hedge_compare_doubles);
+
+  /* nearest rank */
+  i = (fc->hedge_params.percentile * hl->samples_count + 99) / 100 - 1;
+  if(i < 0)
+    i = 0;
+  delay = sorted[i];
+
+  if(delay < fc->hedge_params.min_delay / 1000.0)
+    delay = fc->hedge_params.min_delay / 1000.0;
+
+  return delay;
+}
+
+
+/*
+ * INTERNAL - handle a response header line from transfer @index
+ * (0 for the first request, 1 for the duplicate)
+ *
+ * Return value: non-0 if the transfer should be stopped
+ */
+int
+flickcurl_hedge_header(flickcurl* fc, int index, const char* line,
+                       size_t len)
+{
+  flickcurl_hedge_state* hs = &fc->hedge;
+  const char* p;
+  int status;
+
+  if(hs->winner >= 0)
+    return (hs->winner != index);
+
+  /* Only a final status line can decide the winner */
+  if(len < 12 || strncmp(line, "HTTP/", 5))
+    return 0;
+
+  p = (const char*)memchr(line, ' ', len);
+  if(!p)
+    return 0;
+  status = atoi(p + 1);
+
+  /* ignore interim and redirect responses */
+  if(status < 200 || (status >= 300 && status < 400))
+    return 0;
+
+  /* an error loses to the other request if that is still running */
+  if(status >= 300 && hs->handle && !hs->done[1 - index])
+    return 1;
+
+  hs->winner = index;
+  hs->response_time = flickcurl_get_time();
+
+  return 0;
+}
+
+
+#if LIBCURL_VERSION_NUM >= 0x071c00
+static size_t
+flickcurl_hedge_write_callback(void *ptr, size_t size, size_t nmemb,
+                               void *userdata)
+{
+  flickcurl* fc = (flickcurl*)userdata;
+
+  if(fc->hedge.winner != 1)
+    return 0;
+
+  return flickcurl_write_content(fc, (const char*)ptr, size * nmemb);
+}
+
+
+static size_t
+flickcurl_hedge_header_callback(void *ptr, size_t size, size_t nmemb,
+                                void *userdata)
+{
+  flickcurl* fc = (flickcurl*)userdata;
+  size_t len = size * nmemb;
+
+  if(flickcurl_hedge_header(fc, 1, (const char*)ptr, len))
+    return 0;
+
+  return flickcurl_header_content(fc, (const char*)ptr, len);
+}
+
+
+/* Send the duplicate request */
+static int
+flickcurl_hedge_start(flickcurl* fc)
+{
+  flickcurl_hedge_state* hs = &fc->hedge;
+  CURL* handle;
+  char* uri = NULL;
+
+  handle = curl_easy_duphandle(fc->curl_handle);
+  if(!handle)
+    return 1;
+
+  /* the duplicate is a second request to the service so it needs its
+   * own nonce and timestamp; only reads are hedged */
+  if(flickcurl_oauth_resign(fc, "GET", fc->uri, fc->param_fields,
+                            fc->param_values, &uri)) {
+    curl_easy_cleanup(handle);
+    return 1;
+  }
+  if(uri) {
+    /* libcurl keeps its own copy of the URL */
+    curl_easy_setopt(handle, CURLOPT_URL, uri);
+    free(uri);
+  }
+
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION,
+                   flickcurl_hedge_write_callback);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, fc);
+  curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION,
+                   flickcurl_hedge_header_callback);
+  curl_easy_setopt(handle, CURLOPT_WRITEHEADER, fc);
+  curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, hs->error_buffer);
+  /* do not queue behind the slow request on its connection */
+  curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT, 1L);
+  /* end with the call deadline, not a full timeout after now */
+  if(fc->call_deadline) {
+    double left = fc->call_deadline - flickcurl_get_time();
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS,
+                     (left > 0.001) ? (long)(left * 1000) : 1L);
+  }
+
+  hs->error_buffer[0] = '\0';
+  if(curl_multi_add_handle(hs->multi, handle) != CURLM_OK) {
+    curl_easy_cleanup(handle);
+    return 1;
+  }
+
+  hs->handle = handle;
+  hs->start_time[1] = flickcurl_get_time();
+  hs->hedges++;
+
+  /* the duplicate counts against the request rate limit */
+  gettimeofday(&fc->last_request_time, NULL);
+
+#ifdef FLICKCURL_DEBUG
+  fprintf(stderr, "Method %s hedged after %f secs\n", fc->method,
+          hs->start_time[1] - hs->start_time[0]);
+#endif
+
+  return 0;
+}
+
+
+/* Stop and free the duplicate request */
+static void
+flickcurl_hedge_stop(flickcurl* fc)
+{
+  flickcurl_hedge_state* hs = &fc->hedge;
+
+  if(hs->handle) {
+    if(!hs->done[1])
+      curl_multi_remove_handle(hs->multi, hs->handle);
+    curl_easy_cleanup(hs->handle);
+    hs->handle = NULL;
+  }
+}
+#endif
+
+
+/*
+ * INTERNAL - perform the prepared request, hedged if @hedge is non-0
+ *
+ * All calls run here on the session multi handle rather than with
+ * curl_easy_perform() so that a flickcurl_cancel() is noticed within
+ * a loop interval even when the transfer is stalled.
+ *
+ * The handle the result came from is returned in @handle_p for
+ * reading the response information and flickcurl_hedge_finish() must
+ * be called after.
+ *
+ * Return value: libcurl result of the winning request
+ */
+CURLcode
+flickcurl_hedge_perform(flickcurl* fc, int hedge, CURL** handle_p)
+{
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  flickcurl_hedge_state* hs = &fc->hedge;
+  flickcurl_hedge_latency* hl;
+  double delay;
+  CURLcode result = CURLE_OK;
+
+  *handle_p = fc->curl_handle;
+
+  if(hedge) {
+    hl = flickcurl_hedge_get_latency(fc, fc->method);
+    delay = flickcurl_hedge_delay(fc, hl);
+  } else {
+    hl = NULL;
+    delay = -1.0;
+  }
+
+  if(!hs->multi)
+    return curl_easy_perform(fc->curl_handle);
+
+  hs->active = 1;
+  hs->winner = -1;
+  hs->done[0] = hs->done[1] = 0;
+  hs->handle = NULL;
+  hs->start_time[0] = flickcurl_get_time();
+
+  if(curl_multi_add_handle(hs->multi, fc->curl_handle) != CURLM_OK) {
+    hs->active = 0;
+    return curl_easy_perform(fc->curl_handle);
+  }
+
+  while(1) {
+    CURLMsg* msg;
+    int running;
+    int left;
+    int finished = 0;
+    int timeout = 100;
+
+    curl_multi_perform(hs->multi, &running);
+
+    while((msg = curl_multi_info_read(hs->multi, &left))) {
+      int index;
+
+      if(msg->msg != CURLMSG_DONE)
+        continue;
+
+      index = (msg->easy_handle == fc->curl_handle) ? 0 : 1;
+      hs->done[index] = 1;
+      if(hs->winner == index ||
+         (hs->winner < 0 && (!hs->handle || hs->done[1 - index]))) {
+        result = msg->data.result;
+        *handle_p = msg->easy_handle;
+        finished = 1;
+      }
+      curl_multi_remove_handle(hs->multi, msg->easy_handle);
+    }
+    if(finished)
+      break;
+
+    /* the progress callback stops a running transfer but not one
+     * that has not connected yet */
+    if(fc->cancelled) {
+      result = CURLE_ABORTED_BY_CALLBACK;
+      break;
+    }
+
+    if(hs->winner >= 0 && hs->handle && !hs->done[1 - hs->winner]) {
+      /* cancel the loser */
+      if(hs->winner)
+        curl_multi_remove_handle(hs->multi, fc->curl_handle);
+      else
+        curl_multi_remove_handle(hs->multi, hs->handle);
+      hs->done[1 - hs->winner] = 1;
+    }
+
+    if(delay >= 0 && !hs->handle && hs->winner < 0) {
+      double wait = hs->start_time[0] + delay - flickcurl_get_time();
+
+      if(wait <= 0) {
+        if(!flickcurl_get_current_request_wait(fc)) {
+          if(flickcurl_hedge_start(fc))
+            delay = -1.0;
+        }
+      } else if(wait * 1000 < timeout)
+        timeout = (int)(wait * 1000) + 1;
+    }
+
+    curl_multi_wait(hs->multi, NULL, 0, timeout, NULL);
+  }
+
+  if(hs->winner >= 0 && hl) {
+    hl->samples[hl->next_sample] = hs->response_time -
+                                   hs->start_time[hs->winner];
+    hl->next_sample = (hl->next_sample + 1) % FLICKCURL_HEDGE_LATENCY_SAMPLES;
+    if(hl->samples_count < FLICKCURL_HEDGE_LATENCY_SAMPLES)
+      hl->samples_count++;
+  }
+
+  if(*handle_p != fc->curl_handle) {
+    hs->wins++;
+    if(result != CURLE_OK)
+      memcpy(fc->error_buffer, hs->error_buffer, CURL_ERROR_SIZE);
+  }
+
+  return result;
+#else
+  *handle_p = fc->curl_handle;
+  return curl_easy_perform(fc->curl_handle);
+#endif
+}
+
+
+/*
+ * INTERNAL - release the resources of a hedged call
+ */
+void
+flickcurl_hedge_finish(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  flickcurl_hedge_state* hs = &fc->hedge;
+
+  if(!hs->active)
+    return;
+
+  if(!hs->done[0])
+    curl_multi_remove_handle(hs->multi, fc->curl_handle);
+  flickcurl_hedge_stop(fc);
+
+  hs->active = 0;
+#endif
+}
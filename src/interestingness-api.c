@@ -114,6 +114,9 @@ flickcurl_interestingness_getList(flickcurl* fc, const char* date, const char* e
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
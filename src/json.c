@@ -0,0 +1,1265 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * json.c - Flickcurl JSON response parser
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * Flickr JSON responses carry the same data as the XML ones with a
+ * fixed mapping, so this streaming tokenizer turns them back into the
+ * DOM that the XML response would have produced and all the
+ * existing XPath builders work unchanged:
+ *
+ *   top level object         -> <rsp> root element
+ *   "key": scalar            -> key="scalar" attribute
+ *   "_content": scalar       -> element text content
+ *   "key": {object}          -> <key> child element
+ *   "key": [items]           -> one <key> child element per item
+ *   true / false             -> "1" / "0"
+ *   null                     -> absent
+ *
+ * Error responses {"stat":"fail","code":N,"message":"..."} become a
+ * <rsp> with stat, code and message attributes.
+ *
+ * Any JSONP wrapper text before the top level object and after it is
+ * ignored.
+ *
+ * For the photo list calls the parser can instead build each list
+ * item straight into a #flickcurl_photo from the tokens (see
+ * flickcurl_json_parser_build_photos()): the scalar values of an item
+ * are matched against the photo fields table by their path, such as
+ * "@title" or "dates/@posted", and no DOM nodes are made for it.
+ * Everything else is still built as a DOM for the XPath builders.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#ifndef STANDALONE
+
+#define JSON_MAX_DEPTH 64
+
+typedef enum {
+  JSON_STATE_VALUE,         /* expecting a value */
+  JSON_STATE_KEY_OR_END,    /* after '{' */
+  JSON_STATE_KEY,           /* after ',' in an object */
+  JSON_STATE_COLON,         /* after a key */
+  JSON_STATE_VALUE_OR_END,  /* after '[' */
+  JSON_STATE_COMMA_OR_END,  /* after a value */
+  JSON_STATE_DONE           /* after the top level object */
+} flickcurl_json_state;
+
+typedef enum {
+  JSON_TOKEN_NONE,
+  JSON_TOKEN_STRING,
+  JSON_TOKEN_LITERAL
+} flickcurl_json_token;
+
+typedef struct {
+  /* element for an object; the parent element for an array */
+  xmlNodePtr node;
+  /* element name for array items or NULL for an object */
+  char* name;
+  /* inside a photo item, where @node is NULL: length of the value path
+   * of this frame's element ending with '/' */
+  size_t path_len;
+  /* photo fields table row with an attribute predicate that this
+   * element matches or <0 and the element text if seen first */
+  int predicate_row;
+  char* content;
+} flickcurl_json_frame;
+
+struct flickcurl_json_parser_s {
+  flickcurl* fc;
+  xmlDocPtr doc;
+  int failed;
+
+  flickcurl_json_state state;
+  flickcurl_json_token token;
+  /* non-0 if the string token is an object key */
+  int token_is_key;
+
+  /* string escape state: 0 none, 1 after '\', 2-5 reading \u digits */
+  int escape;
+  unsigned long ucs;
+  unsigned long high_surrogate;
+
+  /* current string or literal token */
+  char* buffer;
+  size_t buffer_len;
+  size_t buffer_size;
+
+  /* last object key read */
+  char* key;
+  size_t key_size;
+
+  int depth;
+  flickcurl_json_frame stack[JSON_MAX_DEPTH];
+
+  /* list element name whose photo items are built without a DOM or
+   * NULL - flickcurl_json_parser_build_photos() */
+  char* photos_name;
+  /* depth of the photo item being read or 0 */
+  int photo_depth;
+  /* values of the photo item indexed by photo fields table row */
+  char** photo_values;
+  int photo_values_count;
+  /* value path being matched */
+  char* path;
+  size_t path_size;
+  /* NULL-terminated array of photos built */
+  flickcurl_photo** photos;
+  int photos_count;
+  int photos_size;
+};
+
+
+static void
+flickcurl_json_error(flickcurl_json_parser* jp, const char* message)
+{
+  if(!jp->failed)
+    flickcurl_error(jp->fc, "JSON parsing failed - %s", message);
+  jp->failed = 1;
+}
+
+
+static int
+flickcurl_json_append(flickcurl_json_parser* jp, const char* s, size_t len)
+{
+  if(jp->buffer_len + len + 1 > jp->buffer_size) {
+    size_t new_size = jp->buffer_size ? jp->buffer_size : 256;
+    char* new_buffer;
+
+    while(jp->buffer_len + len + 1 > new_size)
+      new_size <<= 1;
+
+    new_buffer = (char*)realloc(jp->buffer, new_size);
+    if(!new_buffer) {
+      flickcurl_json_error(jp, "out of memory");
+      return 1;
+    }
+    jp->buffer = new_buffer;
+    jp->buffer_size = new_size;
+  }
+
+  memcpy(jp->buffer + jp->buffer_len, s, len);
+  jp->buffer_len += len;
+  return 0;
+}
+
+
+/* Append UCS codepoint @c as UTF-8 */
+static int
+flickcurl_json_append_ucs(flickcurl_json_parser* jp, unsigned long c)
+{
+  char utf8[4];
+  size_t len;
+
+  if(c < 0x80) {
+    utf8[0] = (char)c;
+    len = 1;
+  } else if(c < 0x800) {
+    utf8[0] = (char)(0xc0 | (c >> 6));
+    utf8[1] = (char)(0x80 | (c & 0x3f));
+    len = 2;
+  } else if(c < 0x10000) {
+    utf8[0] = (char)(0xe0 | (c >> 12));
+    utf8[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+    utf8[2] = (char)(0x80 | (c & 0x3f));
+    len = 3;
+  } else {
+    utf8[0] = (char)(0xf0 | (c >> 18));
+    utf8[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+    utf8[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+    utf8[3] = (char)(0x80 | (c & 0x3f));
+    len = 4;
+  }
+
+  return flickcurl_json_append(jp, utf8, len);
+}
+
+
+static int
+flickcurl_json_push(flickcurl_json_parser* jp, xmlNodePtr node,
+                    const char* name, size_t path_len)
+{
+  flickcurl_json_frame* frame;
+
+  if(jp->depth == JSON_MAX_DEPTH) {
+    flickcurl_json_error(jp, "nesting too deep");
+    return 1;
+  }
+
+  frame = &jp->stack[jp->depth];
+  frame->node = node;
+  frame->name = NULL;
+  frame->path_len = path_len;
+  frame->predicate_row = -1;
+  frame->content = NULL;
+  if(name) {
+    size_t len = strlen(name);
+    frame->name = (char*)malloc(len + 1);
+    if(!frame->name) {
+      flickcurl_json_error(jp, "out of memory");
+      return 1;
+    }
+    memcpy(frame->name, name, len + 1);
+  }
+  jp->depth++;
+
+  return 0;
+}
+
+
+/* Build the photo item that has been read */
+static void
+flickcurl_json_photo_end(flickcurl_json_parser* jp)
+{
+  flickcurl_photo* photo;
+
+  jp->photo_depth = 0;
+
+  if(jp->photos_count + 1 >= jp->photos_size) {
+    int new_size = jp->photos_size ? jp->photos_size << 1 : 16;
+    flickcurl_photo** new_photos;
+
+    new_photos = (flickcurl_photo**)realloc(jp->photos,
+                                            new_size * sizeof(*new_photos));
+    if(!new_photos) {
+      flickcurl_json_error(jp, "out of memory");
+      return;
+    }
+    jp->photos = new_photos;
+    jp->photos_size = new_size;
+  }
+
+  photo = flickcurl_build_photo_values(jp->fc, jp->photo_values);
+  if(!photo) {
+    flickcurl_json_error(jp, "failed to build photo");
+    return;
+  }
+  jp->photos[jp->photos_count++] = photo;
+  jp->photos[jp->photos_count] = NULL;
+}
+
+
+static void
+flickcurl_json_pop(flickcurl_json_parser* jp)
+{
+  flickcurl_json_frame* frame;
+
+  if(jp->depth == jp->photo_depth)
+    flickcurl_json_photo_end(jp);
+
+  frame = &jp->stack[--jp->depth];
+
+  if(frame->name) {
+    free(frame->name);
+    frame->name = NULL;
+  }
+  if(frame->content) {
+    free(frame->content);
+    frame->content = NULL;
+  }
+
+  jp->state = jp->depth ? JSON_STATE_COMMA_OR_END : JSON_STATE_DONE;
+}
+
+
+/* Element name for a value at the current position */
+static const char*
+flickcurl_json_value_name(flickcurl_json_parser* jp)
+{
+  flickcurl_json_frame* frame = &jp->stack[jp->depth - 1];
+  return frame->name ? frame->name : jp->key;
+}
+
+
+/* non-0 if a '{' at the current position starts a photo list item:
+ * {"photos": {"photo": [{...}, ...]}} or {"photos": {"photo": {...}}} */
+static int
+flickcurl_json_photo_start(flickcurl_json_parser* jp)
+{
+  flickcurl_json_frame* list = &jp->stack[1];
+
+  if(!jp->photos_name || jp->photo_depth)
+    return 0;
+
+  if(jp->depth == 3) {
+    if(!jp->stack[2].name || jp->stack[2].node != list->node)
+      return 0;
+  } else if(jp->depth != 2)
+    return 0;
+
+  return !list->name &&
+         !strcmp(flickcurl_json_value_name(jp), "photo") &&
+         !strcmp((const char*)list->node->name, jp->photos_name);
+}
+
+
+/* Set the value path to the first @len bytes of the current one
+ * followed by @name and @suffix */
+static int
+flickcurl_json_set_path(flickcurl_json_parser* jp, size_t len,
+                        const char* name, const char* suffix)
+{
+  size_t name_len = strlen(name);
+  size_t suffix_len = strlen(suffix);
+  size_t new_len = len + name_len + suffix_len;
+
+  if(new_len + 1 > jp->path_size) {
+    size_t new_size = jp->path_size ? jp->path_size : 64;
+    char* new_path;
+
+    while(new_len + 1 > new_size)
+      new_size <<= 1;
+
+    new_path = (char*)realloc(jp->path, new_size);
+    if(!new_path) {
+      flickcurl_json_error(jp, "out of memory");
+      return 1;
+    }
+    jp->path = new_path;
+    jp->path_size = new_size;
+  }
+
+  memcpy(jp->path + len, name, name_len);
+  memcpy(jp->path + len + name_len, suffix, suffix_len + 1);
+  return 0;
+}
+
+
+/* Save a copy of @value of @len bytes as the value of photo fields
+ * table @row unless it has one; the first value wins as for XPath */
+static void
+flickcurl_json_photo_value(flickcurl_json_parser* jp, int row,
+                           const char* value, size_t len)
+{
+  char* string_value;
+
+  if(jp->photo_values[row])
+    return;
+
+  string_value = (char*)malloc(len + 1);
+  if(!string_value) {
+    flickcurl_json_error(jp, "out of memory");
+    return;
+  }
+  memcpy(string_value, value, len);
+  string_value[len] = '\0';
+  jp->photo_values[row] = string_value;
+}
+
+
+/* Find the row for the first @len bytes of the value path followed
+ * by the attribute predicate for @key and @value such as
+ * urls/url[@type = "photopage"] */
+static int
+flickcurl_json_predicate_row(flickcurl_json_parser* jp, size_t len,
+                             const char* key, const char* value)
+{
+  if(flickcurl_json_set_path(jp, len, "[@", key) ||
+     flickcurl_json_set_path(jp, strlen(jp->path), " = \"", value) ||
+     flickcurl_json_set_path(jp, strlen(jp->path), "\"]", ""))
+    return -1;
+
+  return flickcurl_photo_field_row(jp->path, 0);
+}
+
+
+/* Save a scalar value of @len bytes of a photo item for the photo
+ * fields it is read into, with the same values XPath would give */
+static void
+flickcurl_json_photo_scalar(flickcurl_json_parser* jp, const char* value,
+                            size_t len)
+{
+  flickcurl_json_frame* frame = &jp->stack[jp->depth - 1];
+  int content = 0;
+  int row;
+
+  jp->state = JSON_STATE_COMMA_OR_END;
+
+  if(frame->name) {
+    /* element text; an empty element has no value */
+    if(!len)
+      return;
+    if(flickcurl_json_set_path(jp, frame->path_len, frame->name, ""))
+      return;
+  } else if(!strcmp(jp->key, "_content")) {
+    /* text of this frame's element: the path without its '/' */
+    if(!len || !frame->path_len)
+      return;
+    jp->path[frame->path_len - 1] = '\0';
+    content = 1;
+  } else if(flickcurl_json_set_path(jp, frame->path_len, "@", jp->key))
+    return;
+
+  for(row = flickcurl_photo_field_row(jp->path, 0);
+      row >= 0 && !jp->failed;
+      row = flickcurl_photo_field_row(jp->path, row + 1))
+    flickcurl_json_photo_value(jp, row, value, len);
+
+  if(content) {
+    /* keep the text until an attribute predicate matches the element */
+    if(frame->predicate_row >= 0)
+      flickcurl_json_photo_value(jp, frame->predicate_row, value, len);
+    else if(!frame->content) {
+      frame->content = (char*)malloc(len + 1);
+      if(frame->content) {
+        memcpy(frame->content, value, len);
+        frame->content[len] = '\0';
+      } else
+        flickcurl_json_error(jp, "out of memory");
+    }
+  } else if(!frame->name && frame->path_len && frame->predicate_row < 0) {
+    frame->predicate_row = flickcurl_json_predicate_row(jp,
+                                                        frame->path_len - 1,
+                                                        jp->key, value);
+    if(frame->predicate_row >= 0 && frame->content)
+      flickcurl_json_photo_value(jp, frame->predicate_row, frame->content,
+                                 strlen(frame->content));
+  }
+
+  if(frame->path_len)
+    jp->path[frame->path_len - 1] = '/';
+}
+
+
+/* Add a scalar value of @len bytes to the DOM */
+static void
+flickcurl_json_scalar(flickcurl_json_parser* jp, const char* value,
+                      size_t len)
+{
+  flickcurl_json_frame* frame = &jp->stack[jp->depth - 1];
+
+  if(!frame->node) {
+    flickcurl_json_photo_scalar(jp, value, len);
+    return;
+  }
+
+  if(frame->name) {
+    xmlNodePtr node;
+
+    node = xmlNewChild(frame->node, NULL, (const xmlChar*)frame->name, NULL);
+    if(node && len)
+      xmlNodeAddContentLen(node, (const xmlChar*)value, (int)len);
+  } else if(!strcmp(jp->key, "_content")) {
+    if(len)
+      xmlNodeAddContentLen(frame->node, (const xmlChar*)value, (int)len);
+  } else
+    /* xmlNewProp() takes the value as-is with no entity parsing */
+    xmlNewProp(frame->node, (const xmlChar*)jp->key, (const xmlChar*)value);
+
+  jp->state = JSON_STATE_COMMA_OR_END;
+}
+
+
+static void
+flickcurl_json_string_end(flickcurl_json_parser* jp)
+{
+  jp->token = JSON_TOKEN_NONE;
+
+  if(jp->high_surrogate) {
+    /* unpaired high surrogate */
+    jp->high_surrogate = 0;
+    if(flickcurl_json_append_ucs(jp, 0xFFFD))
+      return;
+  }
+
+  if(flickcurl_json_append(jp, "", 1))
+    return;
+  jp->buffer_len--;
+
+  if(jp->token_is_key) {
+    if(jp->buffer_len + 1 > jp->key_size) {
+      char* new_key = (char*)realloc(jp->key, jp->buffer_len + 1);
+      if(!new_key) {
+        flickcurl_json_error(jp, "out of memory");
+        return;
+      }
+      jp->key = new_key;
+      jp->key_size = jp->buffer_len + 1;
+    }
+    memcpy(jp->key, jp->buffer, jp->buffer_len + 1);
+    jp->state = JSON_STATE_COLON;
+  } else
+    flickcurl_json_scalar(jp, jp->buffer, jp->buffer_len);
+}
+
+
+static void
+flickcurl_json_literal_end(flickcurl_json_parser* jp)
+{
+  const char* value;
+  size_t len = jp->buffer_len;
+
+  jp->token = JSON_TOKEN_NONE;
+
+  if(flickcurl_json_append(jp, "", 1))
+    return;
+  value = jp->buffer;
+
+  if(len == 4 && !memcmp(value, "true", 4)) {
+    value = "1";
+    len = 1;
+  } else if(len == 5 && !memcmp(value, "false", 5)) {
+    value = "0";
+    len = 1;
+  } else if(len == 4 && !memcmp(value, "null", 4)) {
+    jp->state = JSON_STATE_COMMA_OR_END;
+    return;
+  } else {
+    size_t i;
+
+    /* numbers are kept in their text form */
+    for(i = 0; i < len; i++) {
+      char c = value[i];
+      if(!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+           c == 'e' || c == 'E')) {
+        flickcurl_json_error(jp, "bad literal value");
+        return;
+      }
+    }
+  }
+
+  flickcurl_json_scalar(jp, value, len);
+}
+
+
+#define JSON_IS_LITERAL_CHAR(c) (((c) >= '0' && (c) <= '9') || \
+                                 ((c) >= 'a' && (c) <= 'z') || \
+                                 ((c) >= 'A' && (c) <= 'Z') || \
+                                 (c) == '-' || (c) == '+' || (c) == '.')
+
+/* Handle one character after a '\' in a string */
+static void
+flickcurl_json_escape(flickcurl_json_parser* jp, char c)
+{
+  if(jp->escape == 1) {
+    const char* s = NULL;
+
+    switch(c) {
+      case '"':  s = "\""; break;
+      case '\\': s = "\\"; break;
+      case '/':  s = "/"; break;
+      case 'b':  s = "\b"; break;
+      case 'f':  s = "\f"; break;
+      case 'n':  s = "\n"; break;
+      case 'r':  s = "\r"; break;
+      case 't':  s = "\t"; break;
+      case 'u':
+        jp->escape = 2;
+        jp->ucs = 0;
+        return;
+      default:
+        flickcurl_json_error(jp, "bad string escape");
+        return;
+    }
+    jp->escape = 0;
+    if(jp->high_surrogate) {
+      jp->high_surrogate = 0;
+      if(flickcurl_json_append_ucs(jp, 0xFFFD))
+        return;
+    }
+    flickcurl_json_append(jp, s, 1);
+    return;
+  }
+
+  /* \uXXXX digits */
+  if(c >= '0' && c <= '9')
+    jp->ucs = (jp->ucs << 4) | (unsigned long)(c - '0');
+  else if(c >= 'a' && c <= 'f')
+    jp->ucs = (jp->ucs << 4) | (unsigned long)(c - 'a' + 10);
+  else if(c >= 'A' && c <= 'F')
+    jp->ucs = (jp->ucs << 4) | (unsigned long)(c - 'A' + 10);
+  else {
+    flickcurl_json_error(jp, "bad \\u escape");
+    return;
+  }
+
+  if(++jp->escape < 6)
+    return;
+  jp->escape = 0;
+
+  if(jp->ucs >= 0xD800 && jp->ucs <= 0xDBFF) {
+    if(jp->high_surrogate)
+      flickcurl_json_append_ucs(jp, 0xFFFD);
+    jp->high_surrogate = jp->ucs;
+  } else if(jp->ucs >= 0xDC00 && jp->ucs <= 0xDFFF) {
+    if(jp->high_surrogate) {
+      unsigned long c32 = 0x10000 + ((jp->high_surrogate - 0xD800) << 10) +
+                          (jp->ucs - 0xDC00);
+      jp->high_surrogate = 0;
+      flickcurl_json_append_ucs(jp, c32);
+    } else
+      flickcurl_json_append_ucs(jp, 0xFFFD);
+  } else {
+    if(jp->high_surrogate) {
+      jp->high_surrogate = 0;
+      if(flickcurl_json_append_ucs(jp, 0xFFFD))
+        return;
+    }
+    /* NUL cannot appear in the DOM */
+    flickcurl_json_append_ucs(jp, jp->ucs ? jp->ucs : 0xFFFD);
+  }
+}
+
+
+/* Handle a structural character or the start of a token */
+static void
+flickcurl_json_char(flickcurl_json_parser* jp, char c)
+{
+  if(c == ' ' || c == '\t' || c == '\n' || c == '\r')
+    return;
+
+  switch(jp->state) {
+    case JSON_STATE_VALUE:
+    case JSON_STATE_VALUE_OR_END:
+      if(!jp->depth) {
+        xmlNodePtr root;
+
+        /* skip any JSONP callback text before the top level object */
+        if(c != '{')
+          return;
+
+        root = xmlNewDocNode(jp->doc, NULL, (const xmlChar*)"rsp", NULL);
+        if(!root) {
+          flickcurl_json_error(jp, "out of memory");
+          return;
+        }
+        xmlDocSetRootElement(jp->doc, root);
+        if(!flickcurl_json_push(jp, root, NULL, 0))
+          jp->state = JSON_STATE_KEY_OR_END;
+        return;
+      }
+
+      if(c == ']' && jp->state == JSON_STATE_VALUE_OR_END) {
+        flickcurl_json_pop(jp);
+        return;
+      }
+
+      if(c == '{') {
+        flickcurl_json_frame* frame = &jp->stack[jp->depth - 1];
+        xmlNodePtr node;
+
+        if(flickcurl_json_photo_start(jp)) {
+          /* a photo item: no DOM nodes below here */
+          if(!flickcurl_json_push(jp, NULL, NULL, 0)) {
+            jp->photo_depth = jp->depth;
+            jp->state = JSON_STATE_KEY_OR_END;
+          }
+          return;
+        }
+
+        if(!frame->node) {
+          /* an element inside a photo item */
+          if(!flickcurl_json_set_path(jp, frame->path_len,
+                                      flickcurl_json_value_name(jp), "/") &&
+             !flickcurl_json_push(jp, NULL, NULL, strlen(jp->path)))
+            jp->state = JSON_STATE_KEY_OR_END;
+          return;
+        }
+
+        node = xmlNewChild(frame->node, NULL,
+                           (const xmlChar*)flickcurl_json_value_name(jp), NULL);
+        if(!node) {
+          flickcurl_json_error(jp, "out of memory");
+          return;
+        }
+        if(!flickcurl_json_push(jp, node, NULL, 0))
+          jp->state = JSON_STATE_KEY_OR_END;
+      } else if(c == '[') {
+        flickcurl_json_frame* frame = &jp->stack[jp->depth - 1];
+
+        /* items of nested arrays are flattened into the parent */
+        if(!flickcurl_json_push(jp, frame->node,
+                                flickcurl_json_value_name(jp),
+                                frame->path_len))
+          jp->state = JSON_STATE_VALUE_OR_END;
+      } else if(c == '"') {
+        jp->token = JSON_TOKEN_STRING;
+        jp->token_is_key = 0;
+        jp->buffer_len = 0;
+      } else if(JSON_IS_LITERAL_CHAR(c)) {
+        jp->token = JSON_TOKEN_LITERAL;
+        jp->buffer_len = 0;
+        flickcurl_json_append(jp, &c, 1);
+      } else
+        flickcurl_json_error(jp, "value expected");
+      break;
+
+    case JSON_STATE_KEY_OR_END:
+    case JSON_STATE_KEY:
+      if(c == '}' && jp->state == JSON_STATE_KEY_OR_END)
+        flickcurl_json_pop(jp);
+      else if(c == '"') {
+        jp->token = JSON_TOKEN_STRING;
+        jp->token_is_key = 1;
+        jp->buffer_len = 0;
+      } else
+        flickcurl_json_error(jp, "object key expected");
+      break;
+
+    case JSON_STATE_COLON:
+      if(c == ':')
+        jp->state = JSON_STATE_VALUE;
+      else
+        flickcurl_json_error(jp, "':' expected");
+      break;
+
+    case JSON_STATE_COMMA_OR_END:
+      if(c == ',')
+        jp->state = jp->stack[jp->depth - 1].name ? JSON_STATE_VALUE :
+                                                     JSON_STATE_KEY;
+      else if(c == '}' && !jp->stack[jp->depth - 1].name)
+        flickcurl_json_pop(jp);
+      else if(c == ']' && jp->stack[jp->depth - 1].name)
+        flickcurl_json_pop(jp);
+      else
+        flickcurl_json_error(jp, "',' or end of object or array expected");
+      break;
+
+    case JSON_STATE_DONE:
+      /* ignore any JSONP callback text after the top level object */
+      break;
+  }
+}
+
+
+/*
+ * INTERNAL - create a JSON response parser
+ */
+flickcurl_json_parser*
+flickcurl_new_json_parser(flickcurl* fc, const char* base_uri)
+{
+  flickcurl_json_parser* jp;
+
+  jp = (flickcurl_json_parser*)calloc(1, sizeof(*jp));
+  if(!jp)
+    return NULL;
+
+  jp->fc = fc;
+  jp->state = JSON_STATE_VALUE;
+
+  jp->doc = xmlNewDoc((const xmlChar*)"1.0");
+  if(!jp->doc) {
+    free(jp);
+    return NULL;
+  }
+  if(base_uri)
+    jp->doc->URL = xmlStrdup((const xmlChar*)base_uri);
+
+  return jp;
+}
+
+
+/*
+ * INTERNAL - destroy a JSON response parser and the DOM it built
+ */
+void
+flickcurl_free_json_parser(flickcurl_json_parser* jp)
+{
+  int i;
+
+  /* an unfinished photo item is not built */
+  jp->photo_depth = 0;
+  while(jp->depth)
+    flickcurl_json_pop(jp);
+
+  if(jp->photos_name)
+    free(jp->photos_name);
+  if(jp->photo_values) {
+    for(i = 0; i < jp->photo_values_count; i++) {
+      if(jp->photo_values[i])
+        free(jp->photo_values[i]);
+    }
+    free(jp->photo_values);
+  }
+  if(jp->path)
+    free(jp->path);
+  if(jp->photos) {
+    for(i = 0; i < jp->photos_count; i++)
+      flickcurl_free_photo(jp->photos[i]);
+    free(jp->photos);
+  }
+
+  if(jp->doc)
+    xmlFreeDoc(jp->doc);
+  if(jp->buffer)
+    free(jp->buffer);
+  if(jp->key)
+    free(jp->key);
+
+  free(jp);
+}
+
+
+/*
+ * INTERNAL - parse a chunk of JSON response content
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_json_parser_parse_chunk(flickcurl_json_parser* jp,
+                                  const char* buffer, size_t len)
+{
+  const char* p = buffer;
+  const char* end = buffer + len;
+
+  while(p < end && !jp->failed) {
+    const char* run;
+
+    if(jp->token == JSON_TOKEN_STRING) {
+      if(jp->escape) {
+        flickcurl_json_escape(jp, *p++);
+        continue;
+      }
+
+      /* copy the run of bytes up to the next quote or escape */
+      for(run = p; p < end && *p != '"' && *p != '\\'; p++)
+        ;
+      if(p > run) {
+        if(jp->high_surrogate) {
+          jp->high_surrogate = 0;
+          if(flickcurl_json_append_ucs(jp, 0xFFFD))
+            break;
+        }
+        if(flickcurl_json_append(jp, run, p - run))
+          break;
+      }
+      if(p == end)
+        break;
+
+      if(*p++ == '\\')
+        jp->escape = 1;
+      else
+        flickcurl_json_string_end(jp);
+      continue;
+    }
+
+    if(jp->token == JSON_TOKEN_LITERAL) {
+      for(run = p; p < end && JSON_IS_LITERAL_CHAR(*p); p++)
+        ;
+      if(p > run && flickcurl_json_append(jp, run, p - run))
+        break;
+      if(p == end)
+        break;
+
+      /* the character ending the literal is handled below */
+      flickcurl_json_literal_end(jp);
+      continue;
+    }
+
+    flickcurl_json_char(jp, *p++);
+  }
+
+  return jp->failed;
+}
+
+
+/*
+ * INTERNAL - finish parsing a JSON response
+ *
+ * Return value: the DOM owned by the parser or NULL on failure
+ */
+xmlDocPtr
+flickcurl_json_parser_finish(flickcurl_json_parser* jp)
+{
+  if(!jp->failed && jp->state != JSON_STATE_DONE)
+    flickcurl_json_error(jp, "incomplete content");
+
+  return jp->failed ? NULL : jp->doc;
+}
+
+
+/*
+ * INTERNAL - get the parser's DOM without giving up ownership
+ */
+xmlDocPtr
+flickcurl_json_parser_get_doc(flickcurl_json_parser* jp)
+{
+  return jp->doc;
+}
+
+
+/*
+ * INTERNAL - take ownership of the parser's DOM
+ *
+ * Return value: the DOM, now owned by the caller, or NULL
+ */
+xmlDocPtr
+flickcurl_json_parser_detach_doc(flickcurl_json_parser* jp)
+{
+  xmlDocPtr doc = jp->doc;
+
+  jp->doc = NULL;
+  return doc;
+}
+
+
+/*
+ * INTERNAL - build the photo items of list element @photos_name as
+ * photos without making DOM nodes for them
+ *
+ * The items are taken with flickcurl_json_parser_take_photos(); the
+ * rest of the response is still built as a DOM.  Must be called before
+ * any content is parsed.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_json_parser_build_photos(flickcurl_json_parser* jp,
+                                   const char* photos_name)
+{
+  size_t len = strlen(photos_name);
+
+  jp->photo_values_count = flickcurl_photo_field_rows_count();
+  jp->photo_values = (char**)calloc(jp->photo_values_count, sizeof(char*));
+  jp->photos_name = (char*)malloc(len + 1);
+  if(!jp->photo_values || !jp->photos_name) {
+    flickcurl_json_error(jp, "out of memory");
+    return 1;
+  }
+  memcpy(jp->photos_name, photos_name, len + 1);
+
+  return 0;
+}
+
+
+/*
+ * INTERNAL - take the photos built by the parser
+ * @jp: JSON parser
+ * @photo_count_p: pointer to store number of photos (or NULL)
+ *
+ * Return value: NULL-terminated array of photos, now owned by the
+ * caller, or NULL if the parser was not building photos
+ */
+flickcurl_photo**
+flickcurl_json_parser_take_photos(flickcurl_json_parser* jp,
+                                  int* photo_count_p)
+{
+  flickcurl_photo** photos = jp->photos;
+
+  if(!jp->photos_name || jp->failed)
+    return NULL;
+
+  if(!photos) {
+    /* an empty list of photos */
+    photos = (flickcurl_photo**)calloc(1, sizeof(flickcurl_photo*));
+    if(!photos)
+      return NULL;
+  }
+
+  if(photo_count_p)
+    *photo_count_p = jp->photos_count;
+
+  jp->photos = NULL;
+  jp->photos_count = 0;
+  jp->photos_size = 0;
+
+  return photos;
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+/* JSON responses and the XML root element expected; NULL for failure */
+static const struct {
+  const char* json;
+  const char* xml;
+} json_tests[] = {
+  { "{\"stat\":\"ok\"}",
+    "<rsp stat=\"ok\"/>" },
+  { "{\"photos\":{\"page\":1,\"photo\":[{\"id\":\"1\",\"title\":\"a\"},"
+    "{\"id\":\"2\",\"title\":\"b\"}]},\"stat\":\"ok\"}",
+    "<rsp stat=\"ok\"><photos page=\"1\"><photo id=\"1\" title=\"a\"/>"
+    "<photo id=\"2\" title=\"b\"/></photos></rsp>" },
+  { " { \"photos\" : { \"photo\" : [ ] } , \"stat\" : \"ok\" } ",
+    "<rsp stat=\"ok\"><photos/></rsp>" },
+  { "{\"photo\":{\"title\":{\"_content\":\"Fish & <Chips>\"}}}",
+    "<rsp><photo><title>Fish &amp; &lt;Chips&gt;</title></photo></rsp>" },
+  { "{\"tags\":{\"tag\":[\"a\",\"b\"]}}",
+    "<rsp><tags><tag>a</tag><tag>b</tag></tags></rsp>" },
+  { "{\"p\":{\"a\":true,\"b\":false,\"c\":null,\"d\":-1.5e3}}",
+    "<rsp><p a=\"1\" b=\"0\" d=\"-1.5e3\"/></rsp>" },
+  { "{\"s\":{\"_content\":\"\\\"\\\\\\/\\t|\\u00e9|\\ud83d\\ude00\"}}",
+    "<rsp><s>\"\\/\t|\xc3\xa9|\xf0\x9f\x98\x80</s></rsp>" },
+  { "{\"s\":{\"_content\":\"\\ud83dx|\\ude00|\\u0000\"}}",
+    "<rsp><s>\xef\xbf\xbdx|\xef\xbf\xbd|\xef\xbf\xbd</s></rsp>" },
+  { "jsonFlickrApi({\"stat\":\"ok\"})",
+    "<rsp stat=\"ok\"/>" },
+  { "{\"stat\":\"fail\",\"code\":1,\"message\":\"Photo not found\"}",
+    "<rsp stat=\"fail\" code=\"1\" message=\"Photo not found\"/>" },
+  { "{\"stat\":\"ok\"", NULL },
+  { "{\"stat\" \"ok\"}", NULL },
+  { "{\"stat\":\"ok\",}", NULL },
+  { "{\"a\":[1,}", NULL },
+  { "{\"a\":tru}", NULL },
+  { "{\"a\":\"\\q\"}", NULL },
+  { "{\"a\":\"\\u00g0\"}", NULL },
+  { "{\"a\":]}", NULL },
+  { NULL, NULL }
+};
+
+
+static void
+json_test_error_handler(void *user_data, const char *message)
+{
+  /* errors are expected by some tests */
+}
+
+
+/* Parse @json in chunks of @chunk_len bytes and compare the root
+ * element with @expected */
+static int
+test_json_parse(flickcurl* fc, const char* json, const char* expected,
+                size_t chunk_len)
+{
+  flickcurl_json_parser* jp;
+  xmlDocPtr doc;
+  xmlBufferPtr buffer = NULL;
+  size_t len = strlen(json);
+  size_t offset;
+  int failed = 0;
+
+  jp = flickcurl_new_json_parser(fc, NULL);
+  if(!jp)
+    return 1;
+
+  for(offset = 0; offset < len; offset += chunk_len) {
+    size_t n = (len - offset < chunk_len) ? len - offset : chunk_len;
+    if(flickcurl_json_parser_parse_chunk(jp, json + offset, n))
+      break;
+  }
+  doc = flickcurl_json_parser_finish(jp);
+
+  if(!doc) {
+    if(expected) {
+      fprintf(stderr, "%s: FAIL\n  JSON '%s' (%d byte chunks) failed\n"
+              "  expected %s\n", program, json, (int)chunk_len, expected);
+      failed = 1;
+    }
+    goto tidy;
+  }
+
+  buffer = xmlBufferCreate();
+  if(!buffer || xmlNodeDump(buffer, doc, xmlDocGetRootElement(doc), 0, 0) < 0) {
+    failed = 1;
+    goto tidy;
+  }
+
+  if(!expected || strcmp((const char*)xmlBufferContent(buffer), expected)) {
+    fprintf(stderr, "%s: FAIL\n  JSON '%s' (%d byte chunks) gave\n    %s\n"
+            "  expected\n    %s\n", program, json, (int)chunk_len,
+            (const char*)xmlBufferContent(buffer),
+            expected ? expected : "failure");
+    failed = 1;
+  }
+
+  tidy:
+  if(buffer)
+    xmlBufferFree(buffer);
+  flickcurl_free_json_parser(jp);
+
+  return failed;
+}
+
+
+/* Parse a document nested deeper than the parser allows */
+static int
+test_json_depth(flickcurl* fc)
+{
+  char json[256];
+  int i;
+
+  /* {"a":[[[...]]]} which is complete apart from its depth */
+  memcpy(json, "{\"a\":", 5);
+  for(i = 0; i < 90; i++) {
+    json[5 + i] = '[';
+    json[5 + 90 + i] = ']';
+  }
+  memcpy(json + 5 + 180, "}", 2);
+
+  return test_json_parse(fc, json, NULL, sizeof(json));
+}
+
+
+static int
+test_json_photo_field(flickcurl_photo* photo, flickcurl_photo_field_type field,
+                      const char* expected)
+{
+  const char* s = flickcurl_photo_get_field_string(photo, field);
+
+  if(expected ? (s && !strcmp(s, expected)) : !s)
+    return 0;
+
+  fprintf(stderr, "%s: FAIL\n  JSON photo %s field %s gave '%s'\n"
+          "  expected '%s'\n", program, photo->id,
+          flickcurl_get_photo_field_label(field), s ? s : "NULL",
+          expected ? expected : "NULL");
+  return 1;
+}
+
+
+/* Build the photos of a list from the tokens in chunks of @chunk_len
+ * bytes and check the fields and the DOM left for the rest */
+static int
+test_json_photos(flickcurl* fc, size_t chunk_len)
+{
+  const char* json = "{\"photos\":{\"page\":2,\"photo\":["
+    "{\"id\":\"10\",\"title\":\"Fish\",\"ispublic\":1,"
+    "\"tags\":\"a b\",\"description\":{\"_content\":\"Chips\"},"
+    "\"dates\":{\"lastupdate\":\"1300000000\"},\"media\":\"video\","
+    "\"urls\":{\"url\":[{\"type\":\"x\",\"_content\":\"nope\"},"
+    "{\"_content\":\"http://f/p/10\",\"type\":\"photopage\"}]}},"
+    "{\"id\":\"11\",\"title\":\"\",\"description\":{\"_content\":\"\"},"
+    "\"owner\":{\"nsid\":\"1@N00\",\"x\":[{\"y\":1}]}}]},"
+    "\"stat\":\"ok\"}";
+  const char* expected_xml = "<rsp stat=\"ok\"><photos page=\"2\"/></rsp>";
+  flickcurl_json_parser* jp;
+  flickcurl_photo** photos = NULL;
+  xmlDocPtr doc;
+  xmlBufferPtr buffer = NULL;
+  size_t len = strlen(json);
+  size_t offset;
+  int count = -1;
+  int failed = 0;
+
+  jp = flickcurl_new_json_parser(fc, NULL);
+  if(!jp || flickcurl_json_parser_build_photos(jp, "photos"))
+    return 1;
+
+  for(offset = 0; offset < len; offset += chunk_len) {
+    size_t n = (len - offset < chunk_len) ? len - offset : chunk_len;
+    if(flickcurl_json_parser_parse_chunk(jp, json + offset, n))
+      break;
+  }
+  doc = flickcurl_json_parser_finish(jp);
+  if(doc)
+    photos = flickcurl_json_parser_take_photos(jp, &count);
+  if(!photos || count != 2) {
+    fprintf(stderr, "%s: FAIL\n  JSON photos (%d byte chunks) gave %d photos"
+            "\n  expected 2\n", program, (int)chunk_len, count);
+    failed = 1;
+    goto tidy;
+  }
+
+  if(!photos[0]->id || strcmp(photos[0]->id, "10") ||
+     !photos[0]->media_type || strcmp(photos[0]->media_type, "video") ||
+     !photos[0]->uri || strcmp(photos[0]->uri, "http://f/p/10") ||
+     photos[0]->tags_count != 2 ||
+     flickcurl_photo_get_field_integer(photos[0], PHOTO_FIELD_visibility_ispublic) != 1 ||
+     !photos[1]->id || strcmp(photos[1]->id, "11") ||
+     !photos[1]->media_type || strcmp(photos[1]->media_type, "photo")) {
+    fprintf(stderr, "%s: FAIL\n  JSON photos (%d byte chunks) gave wrong id,"
+            " media, uri, tags or visibility\n", program, (int)chunk_len);
+    failed = 1;
+  }
+  failed += test_json_photo_field(photos[0], PHOTO_FIELD_title, "Fish");
+  failed += test_json_photo_field(photos[0], PHOTO_FIELD_description, "Chips");
+  failed += test_json_photo_field(photos[0], PHOTO_FIELD_dates_lastupdate,
+                                  "2011-03-13T07:06:40Z");
+  /* an empty attribute is a value; an empty element is not */
+  failed += test_json_photo_field(photos[1], PHOTO_FIELD_title, "");
+  failed += test_json_photo_field(photos[1], PHOTO_FIELD_description, NULL);
+  failed += test_json_photo_field(photos[1], PHOTO_FIELD_owner_nsid, "1@N00");
+
+  buffer = xmlBufferCreate();
+  if(!buffer || xmlNodeDump(buffer, doc, xmlDocGetRootElement(doc), 0, 0) < 0 ||
+     strcmp((const char*)xmlBufferContent(buffer), expected_xml)) {
+    fprintf(stderr, "%s: FAIL\n  JSON photos (%d byte chunks) left DOM\n"
+            "    %s\n  expected\n    %s\n", program, (int)chunk_len,
+            buffer ? (const char*)xmlBufferContent(buffer) : "",
+            expected_xml);
+    failed = 1;
+  }
+
+  tidy:
+  if(photos) {
+    int i;
+    for(i = 0; photos[i]; i++)
+      flickcurl_free_photo(photos[i]);
+    free(photos);
+  }
+  if(buffer)
+    xmlBufferFree(buffer);
+  flickcurl_free_json_parser(jp);
+
+  return failed;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl *fc = NULL;
+  int failures = 0;
+  int i;
+
+  program = "flickcurl_json_test";
+
+  flickcurl_init();
+
+  fc = flickcurl_new();
+  if(!fc) {
+    failures++;
+    goto tidy;
+  }
+
+  flickcurl_set_error_handler(fc, json_test_error_handler, NULL);
+
+  for(i = 0; json_tests[i].json; i++) {
+    /* whole and one byte at a time to check tokens split over chunks */
+    failures += test_json_parse(fc, json_tests[i].json, json_tests[i].xml,
+                                strlen(json_tests[i].json));
+    failures += test_json_parse(fc, json_tests[i].json, json_tests[i].xml, 1);
+  }
+
+  failures += test_json_depth(fc);
+
+  failures += test_json_photos(fc, strlen("{\"photos\":"));
+  failures += test_json_photos(fc, 1);
+
+  tidy:
+  if(fc)
+    flickcurl_free(fc);
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
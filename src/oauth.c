@@ -680,6 +680,224 @@ flickcurl_oauth_prepare_common(flickcurl *fc,
 
 
 
+/* Replace the malloced value @values[@i] with a copy of @value */
+static int
+flickcurl_oauth_replace_value(char** values, int i, const char* value)
+{
+  size_t len = strlen(value);
+  char* new_value = (char*)malloc(len + 1);
+
+  if(!new_value)
+    return 1;
+  memcpy(new_value, value, len + 1);
+  free(values[i]);
+  values[i] = new_value;
+
+  return 0;
+}
+
+
+/*
+ * flickcurl_oauth_resign:
+ * @fc: flickcurl object
+ * @http_method: "GET" or "POST"
+ * @uri: prepared request URI with the parameters in the query
+ * @fields: prepared parameter names, sorted, as in fc->param_fields
+ * @values: prepared parameter values, as in fc->param_values
+ * @new_uri_p: pointer to store the new request URI
+ *
+ * INTERNAL - sign a prepared OAuth request again for sending again
+ *
+ * A request that is sent more than once, as a retry or a hedge, needs
+ * a new oauth_nonce each time.  The oauth_nonce, oauth_timestamp and
+ * oauth_signature values in @fields and @values are replaced using
+ * the credentials in fc->od and the new request URI is returned in
+ * @new_uri_p.  A request without an oauth_signature parameter or
+ * without parameters in the URI is left alone and @new_uri_p is set
+ * to NULL.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_oauth_resign(flickcurl *fc, const char* http_method,
+                       const char* uri, char** fields, char** values,
+                       char** new_uri_p)
+{
+  flickcurl_oauth_data* od = &fc->od;
+  const char* query;
+  size_t service_uri_len;
+  char** escaped = NULL;
+  int count;
+  int signature_index = -1;
+  char nonce[20];
+  char timestamp[20];
+  char* param_buf = NULL;
+  size_t param_buf_len = 0;
+  char* escaped_s = NULL;
+  char* buf = NULL;
+  char* signature_string = NULL;
+  size_t vlen;
+  char* new_uri = NULL;
+  char* p;
+  int i;
+  int rc = 1;
+
+  *new_uri_p = NULL;
+
+  for(count = 0; fields[count]; count++) {
+    if(!strcmp(fields[count], "oauth_signature"))
+      signature_index = count;
+  }
+  query = strchr(uri, '?');
+  if(signature_index < 0 || !query)
+    return 0;
+  service_uri_len = query - uri;
+
+  sprintf(nonce, "%ld", (long)mtwist_u32rand(fc->mt));
+
+  if(od->timestamp)
+    sprintf(timestamp, "%ld", (long)od->timestamp);
+  else {
+    struct timeval tp;
+    (void)gettimeofday(&tp, NULL);
+    sprintf(timestamp, "%ld", (long)tp.tv_sec);
+  }
+
+  for(i = 0; i < count; i++) {
+    if(!strcmp(fields[i], "oauth_nonce")) {
+      if(flickcurl_oauth_replace_value(values, i,
+                                       od->nonce ? od->nonce : nonce))
+        return 1;
+    } else if(!strcmp(fields[i], "oauth_timestamp")) {
+      if(flickcurl_oauth_replace_value(values, i, timestamp))
+        return 1;
+    }
+  }
+
+  escaped = (char**)calloc(count, sizeof(char*));
+  if(!escaped)
+    return 1;
+
+  /* parameters for the signature: all but oauth_signature */
+  for(i = 0; i < count; i++) {
+    if(i == signature_index)
+      continue;
+    escaped[i] = curl_escape(values[i], 0);
+    if(!escaped[i])
+      goto tidy;
+    param_buf_len += strlen(fields[i]) + 1 + strlen(escaped[i]) + 1;
+  }
+
+  param_buf = (char*)malloc(param_buf_len + 1);
+  if(!param_buf)
+    goto tidy;
+  p = param_buf;
+  for(i = 0; i < count; i++) {
+    size_t len;
+
+    if(i == signature_index)
+      continue;
+    if(p > param_buf)
+      *p++ = '&';
+    len = strlen(fields[i]);
+    memcpy(p, fields[i], len);
+    p += len;
+    *p++ = '=';
+    len = strlen(escaped[i]);
+    memcpy(p, escaped[i], len);
+    p += len;
+  }
+  *p = '\0';
+
+  /* signature base string: METHOD&escaped URI&escaped parameters */
+  buf = (char*)malloc(strlen(http_method) + 1 + 3 * service_uri_len + 1 +
+                      3 * (size_t)(p - param_buf) + 1);
+  if(!buf)
+    goto tidy;
+  p = buf;
+  memcpy(p, http_method, strlen(http_method));
+  p += strlen(http_method);
+  *p++ = '&';
+  escaped_s = curl_escape(uri, (int)service_uri_len);
+  if(!escaped_s)
+    goto tidy;
+  memcpy(p, escaped_s, strlen(escaped_s));
+  p += strlen(escaped_s);
+  curl_free(escaped_s);
+  *p++ = '&';
+  escaped_s = curl_escape(param_buf, 0);
+  if(!escaped_s)
+    goto tidy;
+  memcpy(p, escaped_s, strlen(escaped_s));
+  p += strlen(escaped_s);
+  curl_free(escaped_s);
+  escaped_s = NULL;
+  *p = '\0';
+
+  if(flickcurl_oauth_build_key(od))
+    goto tidy;
+  od->data = (unsigned char*)buf;
+  od->data_len = p - buf;
+  signature_string = flickcurl_oauth_compute_signature(od, &vlen);
+  free(od->key);
+  od->key = NULL;
+  od->data = NULL;
+  od->data_len = 0;
+  if(!signature_string ||
+     flickcurl_oauth_replace_value(values, signature_index, signature_string))
+    goto tidy;
+
+  escaped[signature_index] = curl_escape(values[signature_index], 0);
+  if(!escaped[signature_index])
+    goto tidy;
+
+  /* the new URI: service URI?name=value&... in the prepared order */
+  vlen = service_uri_len + 1;
+  for(i = 0; i < count; i++)
+    vlen += strlen(fields[i]) + 1 + strlen(escaped[i]) + 1;
+  new_uri = (char*)malloc(vlen + 1);
+  if(!new_uri)
+    goto tidy;
+  memcpy(new_uri, uri, service_uri_len + 1);
+  p = new_uri + service_uri_len + 1;
+  for(i = 0; i < count; i++) {
+    size_t len = strlen(fields[i]);
+
+    memcpy(p, fields[i], len);
+    p += len;
+    *p++ = '=';
+    len = strlen(escaped[i]);
+    memcpy(p, escaped[i], len);
+    p += len;
+    *p++ = '&';
+  }
+  /* zap last & */
+  *--p = '\0';
+
+  *new_uri_p = new_uri;
+  rc = 0;
+
+#ifdef FLICKCURL_DEBUG
+  fprintf(stderr, "Request URI signed again:\n  %s\n", new_uri);
+#endif
+
+  tidy:
+  for(i = 0; i < count; i++) {
+    if(escaped[i])
+      curl_free(escaped[i]);
+  }
+  free(escaped);
+  if(param_buf)
+    free(param_buf);
+  if(buf)
+    free(buf);
+  if(signature_string)
+    free(signature_string);
+
+  return rc;
+}
+
+
 /**
  * flickcurl_oauth_create_request_token:
  * @fc: flickcurl object
@@ -1469,6 +1687,62 @@ test_signature_calc(flickcurl* fc)
 }
 
 
+/* Signing a prepared request again gives the same URI for the same
+ * nonce and timestamp and a new one otherwise */
+static int
+test_resign(flickcurl* fc)
+{
+  flickcurl_oauth_data* od = &fc->od;
+  char* uri = NULL;
+  int rc = 0;
+
+  flickcurl_set_oauth_client_key(fc, test_oauth_consumer_key);
+  flickcurl_set_oauth_client_secret(fc, test_client_secret);
+  flickcurl_set_oauth_token(fc, "72157626318069415-087bfc7b5816092c");
+  flickcurl_set_oauth_token_secret(fc, "a202d1f853ec69de");
+  od->nonce = (char*)test_oauth_nonce;
+  od->timestamp = test_oauth_timestamp;
+
+  flickcurl_init_params(fc, 0);
+  flickcurl_add_param(fc, "photo_id", "2294223386");
+  flickcurl_add_param(fc, "extras", "date_taken, url_sq");
+  flickcurl_end_params(fc);
+  if(flickcurl_prepare(fc, "flickr.photos.getInfo")) {
+    rc = 1;
+    goto tidy;
+  }
+
+  if(flickcurl_oauth_resign(fc, "GET", fc->uri, fc->param_fields,
+                            fc->param_values, &uri) ||
+     !uri || strcmp(uri, fc->uri)) {
+    fprintf(stderr, "%s: FAIL\n  signed again URI is\n    %s\n"
+            "  expected URI is\n    %s\n", program,
+            uri ? uri : "(none)", fc->uri);
+    rc++;
+  }
+  if(uri)
+    free(uri);
+  uri = NULL;
+
+  od->nonce = NULL;
+  if(flickcurl_oauth_resign(fc, "GET", fc->uri, fc->param_fields,
+                            fc->param_values, &uri) ||
+     !uri || !strcmp(uri, fc->uri) || strstr(uri, test_oauth_nonce)) {
+    fprintf(stderr, "%s: FAIL\n  signed again URI with a new nonce is\n"
+            "    %s\n", program, uri ? uri : "(none)");
+    rc++;
+  }
+  if(uri)
+    free(uri);
+
+  tidy:
+  od->nonce = NULL;
+  od->timestamp = 0;
+
+  return rc;
+}
+
+
 static void
 my_message_handler(void *user_data, const char *message)
 {
@@ -1500,6 +1774,7 @@ main(int argc, char *argv[])
     failures += test_access_token(fc);
   }
   failures += test_signature_calc(fc);
+  failures += test_resign(fc);
 
   tidy:
   if(fc)
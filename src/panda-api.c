@@ -192,6 +192,9 @@ flickcurl_panda_getPhotos(flickcurl *fc, const char *panda_name)
   flickcurl_photo** photos = NULL;
   flickcurl_photos_list* photos_list = NULL;
   const char* format = NULL;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   flickcurl_init_params(fc, 0);
 
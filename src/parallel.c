@@ -0,0 +1,257 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * parallel.c - Flickcurl parallel building of result objects
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * A large node set is split into contiguous ranges, one per worker
+ * thread, and each worker builds the objects for its range into the
+ * caller's result array at the nodes' own positions so the order is
+ * unchanged.  The calling thread builds the first range itself.
+ *
+ * The response DOM is only read.  Each worker has its own XPath
+ * context and its own blank session that only carries what the
+ * builders use: the failed flag, error and tag sinks that call the
+ * handlers of the session through a lock so they never run
+ * concurrently, and the tag intern table which has its own lock.
+ * Nothing else of the session is shared with the workers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* Fewest nodes worth giving to a worker thread */
+#define FLICKCURL_BUILD_MIN_NODES_PER_THREAD 32
+
+/* Most worker threads for one build */
+#define FLICKCURL_BUILD_MAX_THREADS 64
+
+
+/**
+ * flickcurl_set_build_threads:
+ * @fc: flickcurl object
+ * @threads: number of threads to build result objects with (0 or 1 for none)
+ *
+ * Set the number of threads used to build large lists of results
+ *
+ * Lists of photos and contacts from a response with many items, such
+ * as a 500 photo page from flickcurl_photos_search(), are then built
+ * by up to @threads threads at once, in the same order as before.
+ * Smaller lists are built in the calling thread.  Error and tag
+ * handlers may be called from the other threads but never at the same
+ * time.  Photos built lazily (see flickcurl_set_lazy_photos()) are
+ * always built in the calling thread.
+ *
+ * Parallel building needs POSIX threads.  The default is 0.
+ */
+void
+flickcurl_set_build_threads(flickcurl* fc, int threads)
+{
+  if(threads < 0)
+    threads = 0;
+  if(threads > FLICKCURL_BUILD_MAX_THREADS)
+    threads = FLICKCURL_BUILD_MAX_THREADS;
+
+  fc->build_threads = threads;
+}
+
+
+#ifdef HAVE_PTHREAD
+
+typedef struct {
+  /* session doing the build */
+  flickcurl* owner;
+  /* serializes calls to the owner's error and tag handlers */
+  pthread_mutex_t* lock;
+
+  /* blank session passed to the builders for their errors and tags */
+  flickcurl fc;
+
+  xmlDocPtr doc;
+  xmlNodeSetPtr nodes;
+  int start;
+  int end;
+  void** results;
+  flickcurl_build_node_fn build;
+  void* user_data;
+
+  pthread_t thread;
+  int started;
+} flickcurl_build_worker;
+
+
+static void
+flickcurl_build_worker_error(void* user_data, const char* message)
+{
+  flickcurl_build_worker* w = (flickcurl_build_worker*)user_data;
+
+  pthread_mutex_lock(w->lock);
+  flickcurl_error(w->owner, "%s", message);
+  pthread_mutex_unlock(w->lock);
+}
+
+
+static void
+flickcurl_build_worker_tag(void* user_data, flickcurl_tag* tag)
+{
+  flickcurl_build_worker* w = (flickcurl_build_worker*)user_data;
+
+  pthread_mutex_lock(w->lock);
+  w->owner->tag_handler(w->owner->tag_data, tag);
+  pthread_mutex_unlock(w->lock);
+}
+
+
+static void*
+flickcurl_build_worker_run(void* arg)
+{
+  flickcurl_build_worker* w = (flickcurl_build_worker*)arg;
+  xmlXPathContextPtr xpathNodeCtx;
+  int i;
+
+  xpathNodeCtx = xmlXPathNewContext(w->doc);
+  if(!xpathNodeCtx) {
+    flickcurl_error(&w->fc, "Failed to create XPath context for document");
+    w->fc.failed = 1;
+    return NULL;
+  }
+
+  for(i = w->start; i < w->end && !w->fc.failed; i++)
+    w->results[i] = w->build(&w->fc, xpathNodeCtx, w->nodes->nodeTab[i],
+                             w->user_data);
+
+  xmlXPathFreeContext(xpathNodeCtx);
+
+  return NULL;
+}
+
+#endif
+
+
+/*
+ * flickcurl_build_parallel:
+ * @fc: flickcurl object
+ * @doc: response DOM
+ * @nodes: node set in @doc
+ * @results: array of at least the number of nodes to write the objects into
+ * @build: function to build one object
+ * @user_data: data for @build
+ *
+ * INTERNAL - Build objects for a node set with the session's build threads
+ *
+ * The object for node i is stored in @results[i] or NULL if @build
+ * returned NULL.  If any @build failed, fc->failed is set.
+ *
+ * Return value: non-0 if nothing was built and the caller should build serially
+ */
+int
+flickcurl_build_parallel(flickcurl* fc, xmlDocPtr doc, xmlNodeSetPtr nodes,
+                         void** results, flickcurl_build_node_fn build,
+                         void* user_data)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+  flickcurl_build_worker* workers;
+  int nodes_count = xmlXPathNodeSetGetLength(nodes);
+  int threads;
+  int per_thread;
+  int i;
+
+  threads = nodes_count / FLICKCURL_BUILD_MIN_NODES_PER_THREAD;
+  if(threads > fc->build_threads)
+    threads = fc->build_threads;
+  if(threads < 2)
+    return 1;
+
+  workers = (flickcurl_build_worker*)calloc(threads, sizeof(*workers));
+  if(!workers)
+    return 1;
+
+  if(pthread_mutex_init(&lock, NULL)) {
+    free(workers);
+    return 1;
+  }
+
+  per_thread = (nodes_count + threads - 1) / threads;
+  for(i = 0; i < threads; i++) {
+    flickcurl_build_worker* w = &workers[i];
+
+    w->owner = fc;
+    w->lock = &lock;
+    /* the workers were allocated zeroed */
+    w->fc.error_handler = flickcurl_build_worker_error;
+    w->fc.error_data = w;
+    w->fc.tag_intern = fc->tag_intern;
+    if(fc->tag_handler) {
+      w->fc.tag_handler = flickcurl_build_worker_tag;
+      w->fc.tag_data = w;
+    }
+    w->doc = doc;
+    w->nodes = nodes;
+    w->start = i * per_thread;
+    w->end = w->start + per_thread;
+    if(w->end > nodes_count)
+      w->end = nodes_count;
+    w->results = results;
+    w->build = build;
+    w->user_data = user_data;
+  }
+
+  /* a range without a thread is built here after the first */
+  for(i = 1; i < threads; i++)
+    workers[i].started = !pthread_create(&workers[i].thread, NULL,
+                                         flickcurl_build_worker_run,
+                                         &workers[i]);
+
+  flickcurl_build_worker_run(&workers[0]);
+  for(i = 1; i < threads; i++) {
+    if(workers[i].started)
+      pthread_join(workers[i].thread, NULL);
+    else
+      flickcurl_build_worker_run(&workers[i]);
+  }
+
+  for(i = 0; i < threads; i++) {
+    if(workers[i].fc.failed)
+      fc->failed = 1;
+  }
+
+  pthread_mutex_destroy(&lock);
+  free(workers);
+
+  return 0;
+#else
+  return 1;
+#endif
+}
@@ -169,6 +169,13 @@ flickcurl_people_getInfo(flickcurl* fc, const char* user_id)
   
   flickcurl_init_params(fc, 0);
 
+  if(fc->snapshot_cache) {
+    person = (flickcurl_person*)flickcurl_snapshot_get(fc, FLICKCURL_SNAPSHOT_PERSON,
+                                                       user_id);
+    if(person)
+      return person;
+  }
+
   flickcurl_add_param(fc, "user_id", user_id);
 
   flickcurl_end_params(fc);
@@ -198,6 +205,9 @@ flickcurl_people_getInfo(flickcurl* fc, const char* user_id)
     person = NULL;
   }
 
+  if(person && fc->snapshot_cache)
+    flickcurl_snapshot_put(fc, FLICKCURL_SNAPSHOT_PERSON, user_id, person);
+
   return person;
 }
 
@@ -340,6 +350,9 @@ flickcurl_people_getPublicPhotos(flickcurl* fc, const char* user_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -543,6 +556,9 @@ flickcurl_people_getPhotos(flickcurl* fc, const char* user_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -644,6 +660,9 @@ flickcurl_people_getPhotosOf(flickcurl* fc, const char* user_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
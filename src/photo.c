@@ -36,6 +36,26 @@
 #include <flickcurl_internal.h>
 
 
+/* Field decoding state of a lazy photo */
+typedef enum {
+  PHOTO_LAZY_RAW,
+  PHOTO_LAZY_INTEGER,
+  PHOTO_LAZY_DONE
+} flickcurl_photo_lazy_state;
+
+/* Undecoded fields of a photo built by flickcurl_set_lazy_photos() */
+struct flickcurl_photo_lazy_s {
+  /* response DOM that @raw points into */
+  flickcurl_shared_doc* doc;
+  /* field string values in the DOM or NULL */
+  const xmlChar* raw[PHOTO_FIELD_LAST + 1];
+  /* flickcurl_field_value_type of each field in @raw */
+  unsigned char types[PHOTO_FIELD_LAST + 1];
+  /* flickcurl_photo_lazy_state of each field */
+  unsigned char state[PHOTO_FIELD_LAST + 1];
+};
+
+
 static const char* flickcurl_photo_field_label[PHOTO_FIELD_LAST+1] = {
   "(none)",
   "dateuploaded",
@@ -135,7 +155,8 @@ flickcurl_free_photo(flickcurl_photo *photo)
       free(photo->fields[i].string);
   }
   
-  flickcurl_free_tags(photo->tags);
+  if(photo->tags)
+    flickcurl_free_tags(photo->tags);
 
   for(i = 0; i < photo->notes_count; i++)
     flickcurl_free_note(photo->notes[i]);
@@ -156,20 +177,196 @@ flickcurl_free_photo(flickcurl_photo *photo)
   if(photo->video)
     flickcurl_free_video(photo->video);
   
+  if(photo->lazy) {
+    flickcurl_release_doc(photo->lazy->doc);
+    free(photo->lazy);
+  }
+
   free(photo);
 }
 
 
+/* Decode a lazy photo field into photo->fields[] as far as needed */
+static void
+flickcurl_photo_decode_field(flickcurl_photo *photo,
+                             flickcurl_photo_field_type field,
+                             int need_string)
+{
+  struct flickcurl_photo_lazy_s* lazy = photo->lazy;
+  const char* raw;
+  flickcurl_field_value_type datatype;
+  time_t unix_time;
+
+  if(!lazy || lazy->state[field] == PHOTO_LAZY_DONE)
+    return;
+
+  raw = (const char*)lazy->raw[field];
+  if(!raw) {
+    lazy->state[field] = PHOTO_LAZY_DONE;
+    return;
+  }
+
+  if(lazy->state[field] == PHOTO_LAZY_RAW) {
+    datatype = (flickcurl_field_value_type)lazy->types[field];
+    switch(datatype) {
+      case VALUE_TYPE_UNIXTIME:
+      case VALUE_TYPE_DATETIME:
+        if(datatype == VALUE_TYPE_UNIXTIME)
+          unix_time = atoi(raw);
+        else
+          unix_time = curl_getdate(raw, NULL);
+
+        if(unix_time >= 0) {
+          photo->fields[field].integer = (flickcurl_photo_field_type)unix_time;
+          datatype = VALUE_TYPE_DATETIME;
+        } else
+          /* failed to convert, make it a string */
+          datatype = VALUE_TYPE_STRING;
+        break;
+
+      case VALUE_TYPE_INTEGER:
+      case VALUE_TYPE_BOOLEAN:
+        photo->fields[field].integer = (flickcurl_photo_field_type)atoi(raw);
+        break;
+
+      case VALUE_TYPE_NONE:
+      case VALUE_TYPE_STRING:
+      case VALUE_TYPE_FLOAT:
+      case VALUE_TYPE_URI:
+        break;
+
+      case VALUE_TYPE_PHOTO_ID:
+      case VALUE_TYPE_PHOTO_URI:
+      case VALUE_TYPE_MEDIA_TYPE:
+      case VALUE_TYPE_TAG_STRING:
+      case VALUE_TYPE_PERSON_ID:
+      case VALUE_TYPE_COLLECTION_ID:
+      case VALUE_TYPE_ICON_PHOTOS:
+        /* never kept as raw field values */
+        break;
+    }
+    photo->fields[field].type = datatype;
+    lazy->state[field] = PHOTO_LAZY_INTEGER;
+  }
+
+  if(!need_string)
+    return;
+
+  if(photo->fields[field].type == VALUE_TYPE_DATETIME)
+    photo->fields[field].string = flickcurl_unixtime_to_isotime((time_t)photo->fields[field].integer);
+  else {
+    size_t len = strlen(raw);
+    photo->fields[field].string = (char*)malloc(len + 1);
+    if(photo->fields[field].string)
+      memcpy(photo->fields[field].string, raw, len + 1);
+  }
+  lazy->state[field] = PHOTO_LAZY_DONE;
+}
+
+
+/**
+ * flickcurl_photo_get_field_string:
+ * @photo: photo object
+ * @field: field enum
+ *
+ * Get the string value of a photo field
+ *
+ * This decodes the field first if @photo was built lazily (see
+ * flickcurl_set_lazy_photos()) and otherwise is the same as
+ * reading photo->fields[@field].string
+ *
+ * Return value: shared string or NULL if the field is absent
+ */
+const char*
+flickcurl_photo_get_field_string(flickcurl_photo *photo,
+                                 flickcurl_photo_field_type field)
+{
+  if(field > PHOTO_FIELD_LAST)
+    return NULL;
+
+  flickcurl_photo_decode_field(photo, field, 1);
+  return photo->fields[field].string;
+}
+
+
+/**
+ * flickcurl_photo_get_field_integer:
+ * @photo: photo object
+ * @field: field enum
+ *
+ * Get the integer value of a photo field
+ *
+ * This does not make the field's string value so is the cheapest
+ * way to read integer, boolean and date fields of a lazy photo.
+ *
+ * Return value: integer value or -1 if the field is absent or has none
+ */
+int
+flickcurl_photo_get_field_integer(flickcurl_photo *photo,
+                                  flickcurl_photo_field_type field)
+{
+  if(field > PHOTO_FIELD_LAST)
+    return -1;
+
+  flickcurl_photo_decode_field(photo, field, 0);
+  return (int)photo->fields[field].integer;
+}
+
+
+/**
+ * flickcurl_photo_get_field_type:
+ * @photo: photo object
+ * @field: field enum
+ *
+ * Get the value type of a photo field
+ *
+ * Return value: value type or VALUE_TYPE_NONE if the field is absent
+ */
+flickcurl_field_value_type
+flickcurl_photo_get_field_type(flickcurl_photo *photo,
+                               flickcurl_photo_field_type field)
+{
+  if(field > PHOTO_FIELD_LAST)
+    return VALUE_TYPE_NONE;
+
+  flickcurl_photo_decode_field(photo, field, 0);
+  return photo->fields[field].type;
+}
+
+
+/**
+ * flickcurl_photo_get_time:
+ * @photo: photo object
+ * @field: date field enum such as PHOTO_FIELD_dates_taken
+ *
+ * Get the value of a photo date field as a unix time
+ *
+ * Return value: unix time or -1 if the field is absent or not a date
+ */
+time_t
+flickcurl_photo_get_time(flickcurl_photo *photo,
+                         flickcurl_photo_field_type field)
+{
+  if(flickcurl_photo_get_field_type(photo, field) != VALUE_TYPE_DATETIME)
+    return (time_t)-1;
+
+  return (time_t)photo->fields[field].integer;
+}
+
+
 /**
  * flickcurl_photo_as_source_uri:
  * @photo: photo object
- * @c: size s, m, t or b
+ * @c: size s, q, t, m, n, z, c or b
  *
  * Get a photo's image source URIs
  *
- * @c can be s,m,t,b for sizes, o for original, otherwise default
+ * @c can be s,q,t,m,n,z,c,b for sizes, o for original, otherwise default
  * https://www.flickr.com/services/api/misc.urls.html
  *
+ * The h and k sizes use a different secret that is only returned by
+ * flickcurl_photos_getSizes() so cannot be made here.
+ *
  * Return value: new source URI string or NULL on failure
  */
 char*
@@ -178,30 +375,30 @@ flickcurl_photo_as_source_uri(flickcurl_photo *photo, const char c)
   char buf[512];
   char *result;
   size_t len;
+  const char* farm = flickcurl_photo_get_field_string(photo, PHOTO_FIELD_farm);
+  const char* server = flickcurl_photo_get_field_string(photo, PHOTO_FIELD_server);
   
   if(c == 'o') {
     /* https://farm{farm-id}.staticflickr.com/{server-id}/{id}_{o-secret}_o.(jpg|gif|png) */
     sprintf(buf, "https://farm%s.staticflickr.com/%s/%s_%s_o.%s",
-            photo->fields[PHOTO_FIELD_farm].string,
-            photo->fields[PHOTO_FIELD_server].string,
+            farm, server,
             photo->id,
-            photo->fields[PHOTO_FIELD_originalsecret].string,
-            photo->fields[PHOTO_FIELD_originalformat].string);
-  } else if (c == 'm' || c == 's' || c == 't' || c == 'b') {
-    /* https://farm{farm-id}.staticflickr.com/{server-id}/{id}_{secret}_[mstb].jpg */
+            flickcurl_photo_get_field_string(photo, PHOTO_FIELD_originalsecret),
+            flickcurl_photo_get_field_string(photo, PHOTO_FIELD_originalformat));
+  } else if (c == 'm' || c == 's' || c == 't' || c == 'b' ||
+             c == 'q' || c == 'n' || c == 'z' || c == 'c') {
+    /* https://farm{farm-id}.staticflickr.com/{server-id}/{id}_{secret}_[mstbqnzc].jpg */
     sprintf(buf, "https://farm%s.staticflickr.com/%s/%s_%s_%c.jpg",
-            photo->fields[PHOTO_FIELD_farm].string,
-            photo->fields[PHOTO_FIELD_server].string,
+            farm, server,
             photo->id,
-            photo->fields[PHOTO_FIELD_secret].string,
+            flickcurl_photo_get_field_string(photo, PHOTO_FIELD_secret),
             c);
   } else {
     /* https://farm{farm-id}.staticflickr.com/{server-id}/{id}_{secret}.jpg */
     sprintf(buf, "https://farm%s.staticflickr.com/%s/%s_%s.jpg",
-            photo->fields[PHOTO_FIELD_farm].string,
-            photo->fields[PHOTO_FIELD_server].string,
+            farm, server,
             photo->id,
-            photo->fields[PHOTO_FIELD_secret].string);
+            flickcurl_photo_get_field_string(photo, PHOTO_FIELD_secret));
   }
   len = strlen(buf);
   result = (char*)malloc(len + 1);
@@ -227,7 +424,8 @@ flickcurl_photo_as_page_uri(flickcurl_photo *photo)
   
   /* https://www.flickr.com/photos/{owner}/{photo id}/ */
   sprintf(buf, "https://www.flickr.com/photos/%s/%s",
-          photo->fields[PHOTO_FIELD_owner_nsid].string, photo->id);
+          flickcurl_photo_get_field_string(photo, PHOTO_FIELD_owner_nsid),
+          photo->id);
 
   len = strlen(buf);
   result = (char*)malloc(len + 1);
@@ -446,9 +644,9 @@ char*
 flickcurl_photo_as_user_icon_uri(flickcurl_photo *photo)
 {
   return flickcurl_user_icon_uri(
-            photo->fields[PHOTO_FIELD_owner_iconfarm].integer,
-            photo->fields[PHOTO_FIELD_owner_iconserver].integer,
-            photo->fields[PHOTO_FIELD_owner_nsid].string);
+            flickcurl_photo_get_field_integer(photo, PHOTO_FIELD_owner_iconfarm),
+            flickcurl_photo_get_field_integer(photo, PHOTO_FIELD_owner_iconserver),
+            (char*)flickcurl_photo_get_field_string(photo, PHOTO_FIELD_owner_nsid));
 }
 
 
@@ -965,9 +1163,506 @@ static struct {
 };
 
 
-flickcurl_photo**
-flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
-                       const xmlChar* xpathExpr, int* photo_count_p)
+#define PHOTO_PATH_NAME_LEN 31
+
+/* A photo_fields_table XPath compiled to DOM steps for lazy photos:
+ * "./a/b/@c", "./a/b" and "./a/b[@c = \"v\"]" forms with up to
+ * two element steps */
+typedef struct {
+  /* element steps below the photo element */
+  int steps;
+  char name[2][PHOTO_PATH_NAME_LEN + 1];
+  /* attribute name or "" to use the element content */
+  char attr[PHOTO_PATH_NAME_LEN + 1];
+  /* attribute and value the last element step must have or "" */
+  char pred_attr[PHOTO_PATH_NAME_LEN + 1];
+  char pred_value[PHOTO_PATH_NAME_LEN + 1];
+} flickcurl_photo_path;
+
+
+static const char*
+flickcurl_photo_path_name(const char* p, char* name)
+{
+  size_t len = 0;
+
+  while(isalnum((unsigned char)p[len]) || p[len] == '_') {
+    if(len == PHOTO_PATH_NAME_LEN)
+      return NULL;
+    name[len] = p[len];
+    len++;
+  }
+  name[len] = '\0';
+
+  return len ? p + len : NULL;
+}
+
+
+/* Return value: non-0 if @xpath has no compiled form */
+static int
+flickcurl_photo_path_compile(const xmlChar* xpath, flickcurl_photo_path* path)
+{
+  const char* p = (const char*)xpath;
+  const char* end;
+
+  memset(path, '\0', sizeof(*path));
+
+  if(p[0] != '.' || p[1] != '/')
+    return 1;
+  p += 2;
+
+  while(*p != '@') {
+    if(path->steps == 2)
+      return 1;
+    p = flickcurl_photo_path_name(p, path->name[path->steps++]);
+    if(!p)
+      return 1;
+
+    if(*p == '[') {
+      /* [@attr = "value"] ending the path */
+      if(p[1] != '@')
+        return 1;
+      p = flickcurl_photo_path_name(p + 2, path->pred_attr);
+      if(!p || strncmp(p, " = \"", 4))
+        return 1;
+      p += 4;
+      end = strchr(p, '"');
+      if(!end || (end - p) > PHOTO_PATH_NAME_LEN || strcmp(end, "\"]"))
+        return 1;
+      memcpy(path->pred_value, p, end - p);
+      path->pred_value[end - p] = '\0';
+      return 0;
+    }
+
+    if(!*p)
+      return 0;
+    if(*p++ != '/')
+      return 1;
+  }
+
+  p = flickcurl_photo_path_name(p + 1, path->attr);
+  return (!p || *p);
+}
+
+
+/*
+ * Find the value of a compiled path below @node the same way as
+ * flickcurl_xpath_eval(): the first matching node in document order
+ * decides and its first child gives the value.
+ *
+ * Return value: non-0 if a node matched
+ */
+static int
+flickcurl_photo_path_eval(xmlNodePtr node, flickcurl_photo_path* path,
+                          int step, const xmlChar** value_p)
+{
+  xmlNodePtr child;
+
+  if(step == path->steps) {
+    if(*path->attr) {
+      xmlAttrPtr attr = xmlHasProp(node, (const xmlChar*)path->attr);
+      if(!attr)
+        return 0;
+      *value_p = attr->children ? attr->children->content : NULL;
+    } else
+      *value_p = node->children ? node->children->content : NULL;
+    return 1;
+  }
+
+  for(child = node->children; child; child = child->next) {
+    if(child->type != XML_ELEMENT_NODE ||
+       strcmp((const char*)child->name, path->name[step]))
+      continue;
+
+    if(step + 1 == path->steps && *path->pred_attr) {
+      xmlAttrPtr attr = xmlHasProp(child, (const xmlChar*)path->pred_attr);
+      if(!attr || !attr->children || !attr->children->content ||
+         strcmp((const char*)attr->children->content, path->pred_value))
+        continue;
+    }
+
+    if(flickcurl_photo_path_eval(child, path, step + 1, value_p))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* Set up a lazy photo: only the id, URI and media type are copied
+ * and the other fields point into the response DOM */
+static void
+flickcurl_build_lazy_photo(flickcurl_photo* photo, xmlNodePtr node,
+                           flickcurl_photo_path* paths)
+{
+  struct flickcurl_photo_lazy_s* lazy = photo->lazy;
+  int expri;
+
+  for(expri = 0; photo_fields_table[expri].xpath; expri++) {
+    flickcurl_field_value_type datatype = photo_fields_table[expri].type;
+    flickcurl_photo_field_type field = photo_fields_table[expri].field;
+    const xmlChar* value = NULL;
+    char** copy_p = NULL;
+    size_t len;
+
+    if(!flickcurl_photo_path_eval(node, &paths[expri], 0, &value) || !value)
+      continue;
+
+    switch(datatype) {
+      case VALUE_TYPE_PHOTO_ID:
+        copy_p = &photo->id;
+        break;
+
+      case VALUE_TYPE_PHOTO_URI:
+        copy_p = &photo->uri;
+        break;
+
+      case VALUE_TYPE_MEDIA_TYPE:
+        copy_p = &photo->media_type;
+        break;
+
+      case VALUE_TYPE_TAG_STRING:
+        /* lazy photos have no tags */
+        continue;
+
+      case VALUE_TYPE_BOOLEAN:
+        /* skip setting field with a boolean value '' */
+        if(!*value)
+          continue;
+        break;
+
+      case VALUE_TYPE_NONE:
+      case VALUE_TYPE_UNIXTIME:
+      case VALUE_TYPE_DATETIME:
+      case VALUE_TYPE_FLOAT:
+      case VALUE_TYPE_INTEGER:
+      case VALUE_TYPE_STRING:
+      case VALUE_TYPE_URI:
+        break;
+
+      case VALUE_TYPE_PERSON_ID:
+      case VALUE_TYPE_COLLECTION_ID:
+      case VALUE_TYPE_ICON_PHOTOS:
+        abort();
+    }
+
+    if(copy_p) {
+      if(*copy_p)
+        free(*copy_p);
+      len = strlen((const char*)value);
+      *copy_p = (char*)malloc(len + 1);
+      if(*copy_p)
+        memcpy(*copy_p, value, len + 1);
+      continue;
+    }
+
+    lazy->raw[field] = value;
+    lazy->types[field] = (unsigned char)datatype;
+  }
+}
+
+
+/* Convert @string_value of photo_fields_table row @expri and store it
+ * in @photo, which takes ownership of it */
+static void
+flickcurl_photo_set_value(flickcurl* fc, flickcurl_photo* photo, int expri,
+                          char* string_value)
+{
+  flickcurl_field_value_type datatype = photo_fields_table[expri].type;
+  int int_value= -1;
+  flickcurl_photo_field_type field = photo_fields_table[expri].field;
+  time_t unix_time;
+  int special = 0;
+
+#if FLICKCURL_DEBUG > 1
+  fprintf(stderr, "  type %d  string value '%s'\n", datatype,
+          string_value);
+#endif
+  switch(datatype) {
+    case VALUE_TYPE_PHOTO_ID:
+      photo->id = string_value;
+      string_value = NULL;
+      datatype = VALUE_TYPE_NONE;
+      break;
+
+    case VALUE_TYPE_PHOTO_URI:
+      photo->uri = string_value;
+      string_value = NULL;
+      datatype = VALUE_TYPE_NONE;
+      break;
+
+    case VALUE_TYPE_MEDIA_TYPE:
+      photo->media_type = string_value;
+      string_value = NULL;
+      datatype = VALUE_TYPE_NONE;
+      break;
+
+    case VALUE_TYPE_UNIXTIME:
+    case VALUE_TYPE_DATETIME:
+
+      if(datatype == VALUE_TYPE_UNIXTIME)
+        unix_time = atoi(string_value);
+      else
+        unix_time = curl_getdate((const char*)string_value, NULL);
+
+      if(unix_time >= 0) {
+        char* new_value = flickcurl_unixtime_to_isotime(unix_time);
+#if FLICKCURL_DEBUG > 1
+        fprintf(stderr, "  date from: '%s' unix time %ld to '%s'\n",
+                string_value, (long)unix_time, new_value);
+#endif
+        free(string_value);
+        string_value = new_value;
+        int_value = (int)unix_time;
+        datatype = VALUE_TYPE_DATETIME;
+      } else
+        /* failed to convert, make it a string */
+        datatype = VALUE_TYPE_STRING;
+      break;
+
+    case VALUE_TYPE_INTEGER:
+    case VALUE_TYPE_BOOLEAN:
+      if(!*string_value && datatype == VALUE_TYPE_BOOLEAN) {
+        /* skip setting field with a boolean value '' */
+        free(string_value);
+        special = 1;
+        break;
+      }
+
+      int_value = atoi(string_value);
+      break;
+
+    case VALUE_TYPE_TAG_STRING:
+      /* A space-separated list of tags */
+      photo->tags = flickcurl_build_tags_from_string(fc, photo,
+                                                     (const char*)string_value,
+                                                     &photo->tags_count);
+      free(string_value);
+      special = 1;
+      break;
+
+    case VALUE_TYPE_NONE:
+    case VALUE_TYPE_STRING:
+    case VALUE_TYPE_FLOAT:
+    case VALUE_TYPE_URI:
+      break;
+
+    case VALUE_TYPE_PERSON_ID:
+    case VALUE_TYPE_COLLECTION_ID:
+    case VALUE_TYPE_ICON_PHOTOS:
+      abort();
+  }
+
+  /* If special, do not store here */
+  if(special)
+    return;
+
+  /* a later table row for the same field replaces the value */
+  if(photo->fields[field].string)
+    free(photo->fields[field].string);
+  photo->fields[field].string = string_value;
+  photo->fields[field].integer= (flickcurl_photo_field_type)int_value;
+  photo->fields[field].type   = datatype;
+
+#if FLICKCURL_DEBUG > 1
+  fprintf(stderr, "field %d with %s value: '%s' / %d\n",
+          field, flickcurl_get_field_value_type_label(datatype), 
+          string_value, int_value);
+#endif
+}
+
+
+/* Build the photo for one node: lazily when @user_data has the
+ * compiled paths of photo_fields_table */
+static void*
+flickcurl_build_photo_node(flickcurl* fc, xmlXPathContextPtr xpathNodeCtx,
+                           xmlNodePtr node, void* user_data)
+{
+  flickcurl_photo_path* paths = (flickcurl_photo_path*)user_data;
+  flickcurl_photo* photo;
+  int expri;
+  
+  if(node->type != XML_ELEMENT_NODE) {
+    flickcurl_error(fc, "Got unexpected node type %d", node->type);
+    fc->failed = 1;
+    return NULL;
+  }
+  
+  photo = (flickcurl_photo*)calloc(1, sizeof(flickcurl_photo));
+  if(!photo) {
+    fc->failed = 1;
+    return NULL;
+  }
+
+  for(expri = 0; expri <= PHOTO_FIELD_LAST; expri++) {
+    photo->fields[expri].integer= (flickcurl_photo_field_type)-1;
+    photo->fields[expri].type   = VALUE_TYPE_NONE;
+  }
+
+  if(paths) {
+    photo->lazy = (struct flickcurl_photo_lazy_s*)calloc(1, sizeof(*photo->lazy));
+    if(photo->lazy)
+      photo->lazy->doc = flickcurl_share_doc(fc, node->doc);
+
+    if(photo->lazy && photo->lazy->doc) {
+      flickcurl_build_lazy_photo(photo, node, paths);
+      goto photo_done;
+    }
+
+    /* the DOM cannot be kept: decode everything now */
+    if(photo->lazy) {
+      free(photo->lazy);
+      photo->lazy = NULL;
+    }
+  }
+
+  xpathNodeCtx->node = node;
+  
+  for(expri = 0; photo_fields_table[expri].xpath; expri++) {
+    char *string_value;
+    
+    string_value = flickcurl_xpath_eval(fc, xpathNodeCtx,
+                                      photo_fields_table[expri].xpath);
+    if(!string_value)
+      continue;
+
+    flickcurl_photo_set_value(fc, photo, expri, string_value);
+
+    if(fc->failed) {
+      flickcurl_free_photo(photo);
+      return NULL;
+    }
+  } /* end for */
+
+  if(!photo->tags)
+    photo->tags = flickcurl_build_tags(fc, photo, xpathNodeCtx, 
+                                     (const xmlChar*)"./tags/tag",
+                                     &photo->tags_count);
+
+  if(!photo->place)
+    photo->place = flickcurl_build_place(fc, xpathNodeCtx,
+                                       (const xmlChar*)"./location");
+
+  photo->video = flickcurl_build_video(fc, xpathNodeCtx,
+                                     (const xmlChar*)"./video");
+  
+  photo->notes = flickcurl_build_notes(fc, photo, xpathNodeCtx, 
+                                       (const xmlChar*)"./notes/note",
+                                       &photo->notes_count);
+
+  photo_done:
+  if(!photo->media_type) {
+#define PHOTO_STR_LEN 5
+    photo->media_type = (char*)malloc(PHOTO_STR_LEN + 1);
+    memcpy(photo->media_type, "photo", PHOTO_STR_LEN + 1);
+  }
+
+  return photo;
+}
+
+
+/*
+ * flickcurl_photo_field_row:
+ * @path: value path relative to a photo element such as "@title" or "dates/@posted"
+ * @start: first table row to check
+ *
+ * INTERNAL - Find the next photo fields table row read from @path
+ *
+ * Return value: row index or <0 if no row from @start reads @path
+ */
+int
+flickcurl_photo_field_row(const char* path, int start)
+{
+  int expri;
+
+  for(expri = start; photo_fields_table[expri].xpath; expri++) {
+    const char* xpath = (const char*)photo_fields_table[expri].xpath;
+
+    if(xpath[0] == '.' && xpath[1] == '/' && !strcmp(xpath + 2, path))
+      return expri;
+  }
+
+  return -1;
+}
+
+
+/*
+ * flickcurl_photo_field_rows_count:
+ *
+ * INTERNAL - Get the number of rows in the photo fields table
+ *
+ * Return value: number of rows
+ */
+int
+flickcurl_photo_field_rows_count(void)
+{
+  int expri;
+
+  for(expri = 0; photo_fields_table[expri].xpath; expri++)
+    ;
+
+  return expri;
+}
+
+
+/*
+ * flickcurl_build_photo_values:
+ * @fc: flickcurl context
+ * @values: array of string values indexed by photo fields table row
+ *
+ * INTERNAL - Build a photo from values read without a DOM
+ *
+ * The non-NULL @values are taken by the photo and set to NULL.  Only
+ * the table fields are set; no tags, place, video or notes are built
+ * from elements.
+ *
+ * Return value: new photo or NULL on failure
+ */
+flickcurl_photo*
+flickcurl_build_photo_values(flickcurl* fc, char** values)
+{
+  flickcurl_photo* photo;
+  int expri;
+
+  photo = (flickcurl_photo*)calloc(1, sizeof(flickcurl_photo));
+  if(!photo) {
+    fc->failed = 1;
+    return NULL;
+  }
+
+  for(expri = 0; expri <= PHOTO_FIELD_LAST; expri++) {
+    photo->fields[expri].integer= (flickcurl_photo_field_type)-1;
+    photo->fields[expri].type   = VALUE_TYPE_NONE;
+  }
+
+  for(expri = 0; photo_fields_table[expri].xpath; expri++) {
+    char* string_value = values[expri];
+
+    if(!string_value)
+      continue;
+    values[expri] = NULL;
+
+    flickcurl_photo_set_value(fc, photo, expri, string_value);
+
+    if(fc->failed) {
+      flickcurl_free_photo(photo);
+      return NULL;
+    }
+  }
+
+  if(!photo->media_type) {
+    photo->media_type = (char*)malloc(PHOTO_STR_LEN + 1);
+    if(photo->media_type)
+      memcpy(photo->media_type, "photo", PHOTO_STR_LEN + 1);
+  }
+
+  return photo;
+}
+
+
+static flickcurl_photo**
+flickcurl_build_photos_common(flickcurl* fc, xmlXPathContextPtr xpathCtx,
+                              const xmlChar* xpathExpr, int* photo_count_p,
+                              int lazy)
 {
   flickcurl_photo** photos = NULL;
   int nodes_count;
@@ -977,7 +1672,23 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlChar full_xpath[512];
   size_t xpathExpr_len;
   int i;
+  flickcurl_photo_path* paths = NULL;
   
+  if(lazy) {
+    int expri;
+
+    for(expri = 0; photo_fields_table[expri].xpath; expri++)
+      ;
+    paths = (flickcurl_photo_path*)malloc(expri * sizeof(*paths));
+    if(!paths)
+      lazy = 0;
+    for(expri = 0; lazy && photo_fields_table[expri].xpath; expri++) {
+      if(flickcurl_photo_path_compile(photo_fields_table[expri].xpath,
+                                      &paths[expri]))
+        lazy = 0;
+    }
+  }
+
   xpathExpr_len = strlen((const char*)xpathExpr);
   memcpy(full_xpath, xpathExpr, xpathExpr_len + 1);
   
@@ -993,170 +1704,46 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   /* This is a max size - it can include nodes that are CDATA */
   nodes_count = xmlXPathNodeSetGetLength(nodes);
   photos = (flickcurl_photo**)calloc(nodes_count+1, sizeof(flickcurl_photo*));
+  if(!photos) {
+    fc->failed = 1;
+    goto tidy;
+  }
 
-  for(i = 0, photo_count = 0; i < nodes_count; i++) {
-    xmlNodePtr node = nodes->nodeTab[i];
-    flickcurl_photo* photo;
-    int expri;
-    xmlXPathContextPtr xpathNodeCtx = NULL;
-    
-    if(node->type != XML_ELEMENT_NODE) {
-      flickcurl_error(fc, "Got unexpected node type %d", node->type);
-      fc->failed = 1;
-      break;
+  /* lazy photos share the session's DOM so are built here */
+  if(!lazy &&
+     !flickcurl_build_parallel(fc, xpathCtx->doc, nodes, (void**)photos,
+                               flickcurl_build_photo_node, NULL)) {
+    /* skip NULLs from failed nodes keeping the order */
+    for(i = 0, photo_count = 0; i < nodes_count; i++) {
+      if(photos[i])
+        photos[photo_count++] = photos[i];
     }
-    
-    photo = (flickcurl_photo*)calloc(1, sizeof(flickcurl_photo));
+    for(i = photo_count; i < nodes_count; i++)
+      photos[i] = NULL;
+  } else {
+    xmlXPathContextPtr xpathNodeCtx;
 
-    /* set up a new XPath context relative to the current node */
+    /* one XPath context moved from node to node */
     xpathNodeCtx = xmlXPathNewContext(xpathCtx->doc);
-    xpathNodeCtx->node = node;
-    
-    for(expri = 0; expri <= PHOTO_FIELD_LAST; expri++) {
-      if(photo->fields[expri].string)
-        free(photo->fields[expri].string);
-      photo->fields[expri].string = NULL;
-      photo->fields[expri].integer= (flickcurl_photo_field_type)-1;
-      photo->fields[expri].type   = VALUE_TYPE_NONE;
+    if(!xpathNodeCtx) {
+      flickcurl_error(fc, "Failed to create XPath context for document");
+      fc->failed = 1;
+      goto tidy;
     }
 
-    for(expri = 0; photo_fields_table[expri].xpath; expri++) {
-      char *string_value;
-      flickcurl_field_value_type datatype = photo_fields_table[expri].type;
-      int int_value= -1;
-      flickcurl_photo_field_type field = photo_fields_table[expri].field;
-      time_t unix_time;
-      int special = 0;
-      
-      string_value = flickcurl_xpath_eval(fc, xpathNodeCtx,
-                                        photo_fields_table[expri].xpath);
-      if(!string_value)
-        continue;
-
-#if FLICKCURL_DEBUG > 1
-        fprintf(stderr, "  type %d  string value '%s'\n", datatype,
-                string_value);
-#endif
-      switch(datatype) {
-        case VALUE_TYPE_PHOTO_ID:
-          photo->id = string_value;
-          string_value = NULL;
-          datatype = VALUE_TYPE_NONE;
-          break;
-
-        case VALUE_TYPE_PHOTO_URI:
-          photo->uri = string_value;
-          string_value = NULL;
-          datatype = VALUE_TYPE_NONE;
-          break;
-
-        case VALUE_TYPE_MEDIA_TYPE:
-          photo->media_type = string_value;
-          string_value = NULL;
-          datatype = VALUE_TYPE_NONE;
-          break;
-
-        case VALUE_TYPE_UNIXTIME:
-        case VALUE_TYPE_DATETIME:
-
-          if(datatype == VALUE_TYPE_UNIXTIME)
-            unix_time = atoi(string_value);
-          else
-            unix_time = curl_getdate((const char*)string_value, NULL);
-
-          if(unix_time >= 0) {
-            char* new_value = flickcurl_unixtime_to_isotime(unix_time);
-#if FLICKCURL_DEBUG > 1
-            fprintf(stderr, "  date from: '%s' unix time %ld to '%s'\n",
-                    string_value, (long)unix_time, new_value);
-#endif
-            free(string_value);
-            string_value = new_value;
-            int_value = (int)unix_time;
-            datatype = VALUE_TYPE_DATETIME;
-          } else
-            /* failed to convert, make it a string */
-            datatype = VALUE_TYPE_STRING;
-          break;
-
-        case VALUE_TYPE_INTEGER:
-        case VALUE_TYPE_BOOLEAN:
-          if(!*string_value && datatype == VALUE_TYPE_BOOLEAN) {
-            /* skip setting field with a boolean value '' */
-            free(string_value);
-            special = 1;
-            break;
-          }
-
-          int_value = atoi(string_value);
-          break;
-
-        case VALUE_TYPE_TAG_STRING:
-          /* A space-separated list of tags */
-          photo->tags = flickcurl_build_tags_from_string(fc, photo,
-                                                         (const char*)string_value,
-                                                         &photo->tags_count);
-          free(string_value);
-          special = 1;
-          break;
-
-
-        case VALUE_TYPE_NONE:
-        case VALUE_TYPE_STRING:
-        case VALUE_TYPE_FLOAT:
-        case VALUE_TYPE_URI:
-          break;
-
-        case VALUE_TYPE_PERSON_ID:
-        case VALUE_TYPE_COLLECTION_ID:
-        case VALUE_TYPE_ICON_PHOTOS:
-          abort();
-      }
-
-      /* If special, do not store here */
-      if(special)
-        continue;
-
-      photo->fields[field].string = string_value;
-      photo->fields[field].integer= (flickcurl_photo_field_type)int_value;
-      photo->fields[field].type   = datatype;
-
-  #if FLICKCURL_DEBUG > 1
-      fprintf(stderr, "field %d with %s value: '%s' / %d\n",
-              field, flickcurl_get_field_value_type_label(datatype), 
-              string_value, int_value);
-  #endif
-
-      if(fc->failed)
-        goto tidy;
-    } /* end for */
-
-    if(!photo->tags)
-      photo->tags = flickcurl_build_tags(fc, photo, xpathNodeCtx, 
-                                       (const xmlChar*)"./tags/tag",
-                                       &photo->tags_count);
-
-    if(!photo->place)
-      photo->place = flickcurl_build_place(fc, xpathNodeCtx,
-                                         (const xmlChar*)"./location");
-
-    photo->video = flickcurl_build_video(fc, xpathNodeCtx,
-                                       (const xmlChar*)"./video");
-    
-    photo->notes = flickcurl_build_notes(fc, photo, xpathNodeCtx, 
-                                         (const xmlChar*)"./notes/note",
-                                         &photo->notes_count);
+    for(i = 0, photo_count = 0; i < nodes_count; i++) {
+      flickcurl_photo* photo;
 
-    if(!photo->media_type) {
-#define PHOTO_STR_LEN 5
-      photo->media_type = (char*)malloc(PHOTO_STR_LEN + 1);
-      memcpy(photo->media_type, "photo", PHOTO_STR_LEN + 1);
+      photo = (flickcurl_photo*)flickcurl_build_photo_node(fc, xpathNodeCtx,
+                                                           nodes->nodeTab[i],
+                                                           lazy ? paths : NULL);
+      if(!photo)
+        break;
+      photos[photo_count++] = photo;
     }
 
     xmlXPathFreeContext(xpathNodeCtx);
-
-    photos[photo_count++] = photo;
-  } /* for photos */
+  }
   
   if(photo_count_p)
     *photo_count_p = photo_count;
@@ -1164,6 +1751,8 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   tidy:
   if(xpathObj)
     xmlXPathFreeObject(xpathObj);
+  if(paths)
+    free(paths);
   if(fc->failed) {
     if(photos)
       flickcurl_free_photos(photos);
@@ -1174,14 +1763,25 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
 }
 
 
+flickcurl_photo**
+flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
+                       const xmlChar* xpathExpr, int* photo_count_p)
+{
+  return flickcurl_build_photos_common(fc, xpathCtx, xpathExpr,
+                                       photo_count_p, fc->lazy_photos);
+}
+
+
 flickcurl_photo*
 flickcurl_build_photo(flickcurl* fc, xmlXPathContextPtr xpathCtx)
 {
   flickcurl_photo** photos;
   flickcurl_photo* result = NULL;
 
-  photos = flickcurl_build_photos(fc, xpathCtx,
-                                (const xmlChar*)"/rsp/photo", NULL);
+  /* single photos are always decoded so they can be cached */
+  photos = flickcurl_build_photos_common(fc, xpathCtx,
+                                         (const xmlChar*)"/rsp/photo", NULL,
+                                         0);
   if(photos) {
     result = photos[0];
     free(photos);
@@ -1191,6 +1791,145 @@ flickcurl_build_photo(flickcurl* fc, xmlXPathContextPtr xpathCtx)
 }
 
 
+/*
+ * flickcurl_get_photo_field_value_type:
+ * @field: photo field
+ *
+ * INTERNAL - Get the type of the values read for a photo field
+ *
+ * Return value: value type or VALUE_TYPE_NONE if @field is not known
+ */
+flickcurl_field_value_type
+flickcurl_get_photo_field_value_type(flickcurl_photo_field_type field)
+{
+  int expri;
+
+  for(expri = 0; photo_fields_table[expri].xpath; expri++) {
+    if(field != PHOTO_FIELD_none && photo_fields_table[expri].field == field)
+      return photo_fields_table[expri].type;
+  }
+
+  return VALUE_TYPE_NONE;
+}
+
+
+/* Build the photos at @xpathExpr as columns of the session's photo
+ * columns fields, reading the values straight from the DOM */
+static flickcurl_photo_columns*
+flickcurl_build_photo_columns(flickcurl* fc, xmlXPathContextPtr xpathCtx,
+                              const xmlChar* xpathExpr)
+{
+  flickcurl_photo_columns* pc = NULL;
+  flickcurl_field_value_type types[PHOTO_FIELD_LAST + 1];
+  flickcurl_photo_path* paths = NULL;
+  int* entries = NULL;
+  int entries_count = 0;
+  xmlXPathObjectPtr xpathObj = NULL;
+  xmlNodeSetPtr nodes;
+  int nodes_count;
+  int expri;
+  int i;
+
+  for(i = 0; i <= PHOTO_FIELD_LAST; i++)
+    types[i] = flickcurl_get_photo_field_value_type((flickcurl_photo_field_type)i);
+
+  for(expri = 0; photo_fields_table[expri].xpath; expri++)
+    ;
+
+  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  if(!xpathObj) {
+    flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
+                    xpathExpr);
+    fc->failed = 1;
+    goto tidy;
+  }
+
+  nodes = xpathObj->nodesetval;
+  nodes_count = xmlXPathNodeSetGetLength(nodes);
+
+  pc = flickcurl_new_photo_columns(fc, nodes_count, types);
+  paths = (flickcurl_photo_path*)malloc(expri * sizeof(*paths));
+  entries = (int*)malloc(expri * sizeof(int));
+  if(!pc || !paths || !entries) {
+    fc->failed = 1;
+    goto tidy;
+  }
+
+  /* the table entries of the wanted fields, last first since the
+   * last matching entry for a field gives its value */
+  while(expri--) {
+    flickcurl_photo_field_type field = photo_fields_table[expri].field;
+
+    if(field == PHOTO_FIELD_none ||
+       flickcurl_photo_columns_get_field_type(pc, field) == VALUE_TYPE_NONE)
+      continue;
+
+    if(flickcurl_photo_path_compile(photo_fields_table[expri].xpath,
+                                    &paths[entries_count])) {
+      flickcurl_error(fc, "Cannot read photo field %s as a column",
+                      flickcurl_get_photo_field_label(field));
+      fc->failed = 1;
+      goto tidy;
+    }
+    entries[entries_count++] = expri;
+  }
+
+  for(i = 0; i < nodes_count; i++) {
+    xmlNodePtr node = nodes->nodeTab[i];
+    xmlAttrPtr id_attr;
+    int row;
+    int j;
+
+    if(node->type != XML_ELEMENT_NODE) {
+      flickcurl_error(fc, "Got unexpected node type %d", node->type);
+      fc->failed = 1;
+      break;
+    }
+
+    id_attr = xmlHasProp(node, (const xmlChar*)"id");
+    row = flickcurl_photo_columns_add_row(pc,
+                                          (id_attr && id_attr->children) ?
+                                          (const char*)id_attr->children->content : "");
+    if(row < 0) {
+      fc->failed = 1;
+      break;
+    }
+
+    for(j = 0; j < entries_count; j++) {
+      flickcurl_photo_field_type field = photo_fields_table[entries[j]].field;
+      const xmlChar* value = NULL;
+
+      if(flickcurl_photo_columns_has_value(pc, row, field))
+        continue;
+
+      if(!flickcurl_photo_path_eval(node, &paths[j], 0, &value) || !value)
+        continue;
+
+      if(flickcurl_photo_columns_set_value(pc, row, field,
+                                           photo_fields_table[entries[j]].type,
+                                           (const char*)value)) {
+        fc->failed = 1;
+        break;
+      }
+    }
+  }
+
+  tidy:
+  if(xpathObj)
+    xmlXPathFreeObject(xpathObj);
+  if(paths)
+    free(paths);
+  if(entries)
+    free(entries);
+  if(fc->failed && pc) {
+    flickcurl_free_photo_columns(pc);
+    pc = NULL;
+  }
+
+  return pc;
+}
+
+
 /**
  * flickcurl_free_photos:
  * @photos: photo object array
@@ -1210,6 +1949,136 @@ flickcurl_free_photos(flickcurl_photo** photos)
 }
 
 
+/*
+ * flickcurl_check_photos_array:
+ * @fc: Flickcurl context
+ *
+ * INTERNAL - check a call returning an array of photos can be made
+ *
+ * Photo lists built as columns (see flickcurl_set_photo_columns())
+ * have no photos so the calls returning just the array of photos
+ * fail rather than return no photos.
+ *
+ * Return value: non-0 if photo lists are built as columns
+ */
+int
+flickcurl_check_photos_array(flickcurl* fc)
+{
+  if(!fc->photo_columns)
+    return 0;
+
+  flickcurl_error(fc, "Photo columns are set: use the _params call for a photos list");
+  return 1;
+}
+
+
+/*
+ * flickcurl_free_photo_source_sizes:
+ * @fc: flickcurl context
+ *
+ * INTERNAL - Free the url_* image sizes of the last photo list read
+ */
+void
+flickcurl_free_photo_source_sizes(flickcurl* fc)
+{
+  int i;
+
+  if(!fc->source_sizes)
+    return;
+
+  for(i = 0; i < fc->source_sizes_count; i++)
+    flickcurl_free_sizes(fc->source_sizes[i].sizes);
+  free(fc->source_sizes);
+  fc->source_sizes = NULL;
+  fc->source_sizes_count = 0;
+  fc->source_sizes_next = 0;
+}
+
+
+/*
+ * flickcurl_get_photo_source_sizes:
+ * @fc: flickcurl context
+ * @photo: photo from the last photo list read
+ *
+ * INTERNAL - Get the image sizes given by the url_* extras of a photo
+ *
+ * The sizes are only read while flickcurl_serialize_photos_iterator()
+ * gets photo lists.  Photos are usually looked up in list order so the
+ * search starts after the last one found.
+ *
+ * Return value: shared sizes array or NULL if the photo has none
+ */
+flickcurl_size**
+flickcurl_get_photo_source_sizes(flickcurl* fc, flickcurl_photo* photo)
+{
+  int count = fc->source_sizes_count;
+  int n;
+
+  for(n = 0; n < count; n++) {
+    int i = (fc->source_sizes_next + n) % count;
+
+    if(fc->source_sizes[i].photo == photo) {
+      fc->source_sizes_next = i + 1;
+      return fc->source_sizes[i].sizes;
+    }
+  }
+
+  return NULL;
+}
+
+
+/* Read the url_* image sizes of the @photos built from the nodes at
+ * @xpathExpr into the session */
+static void
+flickcurl_build_photo_source_sizes(flickcurl* fc, xmlXPathContextPtr xpathCtx,
+                                   const xmlChar* xpathExpr,
+                                   flickcurl_photo** photos, int photo_count)
+{
+  xmlXPathObjectPtr xpathObj;
+  xmlNodeSetPtr nodes;
+  int nodes_count;
+  int i;
+  int p;
+
+  flickcurl_free_photo_source_sizes(fc);
+
+  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  if(!xpathObj)
+    return;
+
+  nodes = xpathObj->nodesetval;
+  nodes_count = xmlXPathNodeSetGetLength(nodes);
+  if(nodes_count && photo_count)
+    fc->source_sizes = (flickcurl_photo_source_sizes*)calloc(photo_count, sizeof(*fc->source_sizes));
+
+  /* photos are in node order but nodes that failed have no photo */
+  for(i = 0, p = 0; fc->source_sizes && i < nodes_count && p < photo_count;
+      i++) {
+    xmlNodePtr node = nodes->nodeTab[i];
+    xmlChar* id;
+    flickcurl_size** sizes;
+
+    if(node->type != XML_ELEMENT_NODE)
+      continue;
+
+    id = xmlGetProp(node, (const xmlChar*)"id");
+    if(!id)
+      continue;
+    if(photos[p]->id && !strcmp((const char*)id, photos[p]->id)) {
+      sizes = flickcurl_build_sizes_from_extras(fc, node);
+      if(sizes) {
+        fc->source_sizes[fc->source_sizes_count].photo = photos[p];
+        fc->source_sizes[fc->source_sizes_count++].sizes = sizes;
+      }
+      p++;
+    }
+    xmlFree(id);
+  }
+
+  xmlXPathFreeObject(xpathObj);
+}
+
+
 /*
  * flickcurl_invoke_photos_list:
  * @fc: Flickcurl context
@@ -1257,8 +2126,17 @@ flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr,
 
     nformat = "xml";
     format_len = 3;
-    
+
+    /* a JSON response for a /rsp/NAME list can have its photos built
+     * from the tokens; asynchronous builders reuse the DOM instead */
+    if(fc->json_call && !fc->photo_columns && !fc->lazy_photos &&
+       !fc->async.call && !fc->want_source_sizes &&
+       !strncmp((const char*)xpathExpr, "/rsp/", 5) &&
+       !strpbrk((const char*)xpathExpr + 5, "/["))
+      fc->json_photos_name = (const char*)xpathExpr + 5;
+
     doc = flickcurl_invoke(fc);
+    fc->json_photos_name = NULL;
     if(!doc)
       goto tidy;
 
@@ -1331,8 +2209,28 @@ flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr,
     memcpy(photosXpathExpr, xpathExpr, xpathExprLen);
     memcpy(photosXpathExpr + xpathExprLen, SUFFIX, SUFFIX_LEN + 1);
   
-    photos_list->photos = flickcurl_build_photos(fc, xpathCtx, photosXpathExpr,
-                                                 &photos_list->photos_count);
+    /* photos already built from JSON tokens */
+    if(fc->jp && flickcurl_json_parser_get_doc(fc->jp) == doc)
+      photos_list->photos = flickcurl_json_parser_take_photos(fc->jp,
+                                                              &photos_list->photos_count);
+
+    if(photos_list->photos)
+      ;
+    else if(fc->photo_columns) {
+      photos_list->columns = flickcurl_build_photo_columns(fc, xpathCtx,
+                                                           photosXpathExpr);
+      /* an empty list of photos */
+      if(photos_list->columns)
+        photos_list->photos = (flickcurl_photo**)calloc(1, sizeof(flickcurl_photo*));
+    } else
+      photos_list->photos = flickcurl_build_photos(fc, xpathCtx,
+                                                   photosXpathExpr,
+                                                   &photos_list->photos_count);
+
+    if(fc->want_source_sizes && photos_list->photos)
+      flickcurl_build_photo_source_sizes(fc, xpathCtx, photosXpathExpr,
+                                         photos_list->photos,
+                                         photos_list->photos_count);
     free(photosXpathExpr);
     if(!photos_list->photos) {
       fc->failed = 1;
@@ -1403,6 +2301,8 @@ flickcurl_free_photos_list(flickcurl_photos_list* photos_list)
     free(photos_list->format);
   if(photos_list->photos)
     flickcurl_free_photos(photos_list->photos);
+  if(photos_list->columns)
+    flickcurl_free_photo_columns(photos_list->columns);
   if(photos_list->content)
     free(photos_list->content);
   free(photos_list);
@@ -268,6 +268,9 @@ flickcurl_photos_getContactsPhotos(flickcurl* fc,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -397,6 +400,9 @@ flickcurl_photos_getContactsPublicPhotos(flickcurl* fc, const char* user_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -791,6 +797,13 @@ flickcurl_photos_getInfo2(flickcurl* fc, const char* photo_id,
   
   flickcurl_init_params(fc, 0);
 
+  if(fc->snapshot_cache) {
+    photo = (flickcurl_photo*)flickcurl_snapshot_get(fc, FLICKCURL_SNAPSHOT_PHOTO,
+                                                     photo_id);
+    if(photo)
+      return photo;
+  }
+
   flickcurl_add_param(fc, "photo_id", photo_id);
 
   if(secret)
@@ -825,6 +838,9 @@ flickcurl_photos_getInfo2(flickcurl* fc, const char* photo_id,
     photo = NULL;
   }
 
+  if(photo && fc->snapshot_cache)
+    flickcurl_snapshot_put(fc, FLICKCURL_SNAPSHOT_PHOTO, photo_id, photo);
+
   return photo;
 }
 
@@ -974,6 +990,9 @@ flickcurl_photos_getNotInSet(flickcurl* fc,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -1128,6 +1147,9 @@ flickcurl_photos_getRecent(flickcurl* fc, const char* extras,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -1275,6 +1297,9 @@ flickcurl_photos_getUntagged(flickcurl* fc,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -1369,6 +1394,9 @@ flickcurl_photos_getWithGeoData(flickcurl* fc,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -1466,6 +1494,9 @@ flickcurl_photos_getWithoutGeoData(flickcurl* fc,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -1578,6 +1609,9 @@ flickcurl_photos_recentlyUpdated(flickcurl* fc, int min_date,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -1864,6 +1898,9 @@ flickcurl_photos_search(flickcurl* fc, flickcurl_search_params* params)
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -400,6 +400,9 @@ flickcurl_photos_geo_photosForLocation(flickcurl* fc,
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
 
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
+
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
   list_params.extras   = extras;
@@ -377,6 +377,13 @@ flickcurl_photosets_getInfo(flickcurl* fc, const char* photoset_id)
   if(!photoset_id)
     return NULL;
 
+  if(fc->snapshot_cache) {
+    photoset = (flickcurl_photoset*)flickcurl_snapshot_get(fc, FLICKCURL_SNAPSHOT_PHOTOSET,
+                                                           photoset_id);
+    if(photoset)
+      return photoset;
+  }
+
   flickcurl_add_param(fc, "photoset_id", photoset_id);
 
   flickcurl_end_params(fc);
@@ -408,6 +415,10 @@ flickcurl_photosets_getInfo(flickcurl* fc, const char* photoset_id)
     photoset = NULL;
   }
 
+  if(photoset && fc->snapshot_cache)
+    flickcurl_snapshot_put(fc, FLICKCURL_SNAPSHOT_PHOTOSET, photoset_id,
+                           photoset);
+
   return photoset;
 }
 
@@ -557,6 +568,9 @@ flickcurl_photosets_getPhotos(flickcurl* fc, const char* photoset_id,
   flickcurl_photos_list_params list_params;
   flickcurl_photos_list* photos_list;
   flickcurl_photo** photos;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   memset(&list_params, '\0', sizeof(list_params));
   list_params.format   = NULL;
@@ -339,6 +339,14 @@ flickcurl_places_getInfo2(flickcurl* fc, const char* place_id, int woe_id)
 
   flickcurl_init_params(fc, 0);
 
+  /* only lookups by place ID are cached */
+  if(place_id && fc->snapshot_cache) {
+    place = (flickcurl_place*)flickcurl_snapshot_get(fc, FLICKCURL_SNAPSHOT_PLACE,
+                                                     place_id);
+    if(place)
+      return place;
+  }
+
   if(place_id) {
     flickcurl_add_param(fc, "place_id", place_id);
   } else if(woe_id >= 0) {
@@ -376,6 +384,9 @@ flickcurl_places_getInfo2(flickcurl* fc, const char* place_id, int woe_id)
     place = NULL;
   }
 
+  if(place && place_id && fc->snapshot_cache)
+    flickcurl_snapshot_put(fc, FLICKCURL_SNAPSHOT_PLACE, place_id, place);
+
   return place;
 }
 
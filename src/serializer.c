@@ -145,6 +145,9 @@ static struct {
   { PHOTO_FIELD_none, NULL, NULL }
 };
 
+/* index into field_table for each photo field or -1 if it has no predicate */
+static int field_predicate[PHOTO_FIELD_LAST + 1];
+
 
 void
 flickcurl_serializer_init(void)
@@ -155,6 +158,11 @@ flickcurl_serializer_init(void)
     namespace_table[i].uri_len = strlen(namespace_table[i].uri);
     namespace_table[i].prefix_len = strlen(namespace_table[i].prefix);
   }
+
+  for(i = 0; i <= PHOTO_FIELD_LAST; i++)
+    field_predicate[i] = -1;
+  for(i = 0; field_table[i].field != PHOTO_FIELD_none; i++)
+    field_predicate[field_table[i].field] = i;
 }
 
 
@@ -215,11 +223,14 @@ flickcurl_free_serializer(flickcurl_serializer* serializer)
 
 
 static flickrdf_nspace*
-nspace_add_new(flickrdf_nspace* list, char* prefix, char *uri) 
+nspace_add_new(flickrdf_nspace* list, const char* prefix, const char *uri) 
 {
   flickrdf_nspace* ns;
 
   ns = (flickrdf_nspace*)malloc(sizeof(flickrdf_nspace));
+  if(!ns)
+    return list;
+  
   ns->prefix_len = strlen(prefix);
   ns->uri_len = strlen(uri);
 
@@ -229,6 +240,7 @@ nspace_add_new(flickrdf_nspace* list, char* prefix, char *uri)
   ns->uri = (char*)malloc(ns->uri_len + 1);
   memcpy(ns->uri, uri, ns->uri_len + 1);
 
+  ns->seen = 0;
   ns->next = list;
   return ns;
 }
@@ -315,334 +327,405 @@ free_nspaces(flickrdf_nspace* list)
     free(list);
   }
 }
-    
 
-/**
- * flickcurl_serialize_photo:
- * @fcs: flickcurl serializer object
- * @photo: photo object
+
+/* longest machine tag namespace prefix that is looked up */
+#define TAG_PREFIX_SIZE 64
+
+/*
+ * tag_get_prefix:
+ * @raw: raw tag string
+ * @sep: separator character after the prefix
+ * @prefix: buffer of size TAG_PREFIX_SIZE to write the prefix into
  *
- * Serialize photo description to RDF triples
+ * INTERNAL - Get the PREFIX of a tag "PREFIX<sep>..." without
+ * modifying the tag
  *
- * Return value: non-0 on failure
+ * Return value: pointer to the separator in @raw or NULL if there is none
  */
-int
-flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
+static const char*
+tag_get_prefix(const char* raw, char sep, char* prefix)
 {
-  int i;
-  int need_person = 0;
-  int need_foaf = 0;
-  int need_rdfs = 0;
-  flickrdf_nspace* nspaces = NULL;
-  flickrdf_nspace* ns;
-  flickcurl_serializer_factory* fsf = fcs->factory;
-  flickcurl* fc = fcs->fc;
-#if FLICKCURL_DEBUG > 1
-  FILE* fh = stderr;
-  const char* label = "libflickcurl";
-#endif
-  flickcurl_size** sizes = NULL;
+  const char* p;
+  size_t len;
 
-  if(!photo)
-    return 1;
+  for(p = raw; *p && *p != sep; p++)
+    ;
+  if(!*p)
+    return NULL;
 
-  /* Always add XSD, RDF and Flickr namespaces */
-  nspaces = nspace_add_if_not_declared(nspaces, NULL, XSD_NS);
-  nspaces = nspace_add_if_not_declared(nspaces, "rdf", RDF_NS);
-  nspaces = nspace_add_if_not_declared(nspaces, "flickr", FLICKR_NS);
+  len = p - raw;
+  if(!len || len >= TAG_PREFIX_SIZE)
+    return NULL;
 
-  if(photo->place)
-    nspaces = nspace_add_if_not_declared(nspaces, "places", PLACES_NS);
+  memcpy(prefix, raw, len);
+  prefix[len] = '\0';
+  return p;
+}
 
-  sizes = flickcurl_photos_getSizes(fc, photo->id);
-  if(sizes) {
-    need_foaf = 1;
-    need_rdfs = 1;
-  }
 
-  /* mark namespaces used in fields */
-  for(i = PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
-    flickcurl_photo_field_type field = (flickcurl_photo_field_type)i;
-    flickcurl_field_value_type datatype = photo->fields[field].type;
-    int f;
+static flickcurl_license*
+serializer_get_license(flickcurl* fc, flickcurl_license** licenses, int id)
+{
+  int i;
 
-    if(datatype == VALUE_TYPE_NONE)
-      continue;
+  if(!licenses)
+    return flickcurl_photos_licenses_getInfo_by_id(fc, id);
 
-    for(f = 0; field_table[f].field != PHOTO_FIELD_none; f++) {
-      if(field_table[f].field != field) 
-        continue;
+  for(i = 0; licenses[i]; i++) {
+    if(licenses[i]->id == id)
+      return licenses[i];
+  }
+  return NULL;
+}
 
-      if(field_table[f].flags & FIELD_FLAGS_PERSON)
-        need_person = 1;
 
-      nspaces = nspace_add_if_not_declared(nspaces, NULL, field_table[f].nspace_uri);
-      break;
-    }
-
-  }
-  
+/*
+ * flickcurl_serializer_emit_field:
+ * @fcs: flickcurl serializer object
+ * @photo: photo object
+ * @field: photo field with a predicate in field_table
+ * @subject: subject URI or blank node ID
+ * @subject_type: subject term type
+ * @licenses: licenses array or NULL to look them up when needed
+ *
+ * INTERNAL - Emit the triple for one photo field
+ */
+static void
+flickcurl_serializer_emit_field(flickcurl_serializer* fcs,
+                                flickcurl_photo* photo,
+                                flickcurl_photo_field_type field,
+                                const char* subject, int subject_type,
+                                flickcurl_license** licenses)
+{
+  flickcurl_field_value_type datatype;
+  int f = field_predicate[field];
+  const char* datatype_uri = NULL;
+  char* object = NULL;
+  char* new_object = NULL;
+  int type= FLICKCURL_TERM_TYPE_LITERAL;
 
-  /* in tags look for xmlns:PREFIX = "URI" otherwise look for PREFIX: */
-  for(i = 0; i < photo->tags_count; i++) {
-    char* prefix;
-    char *p;
-    flickcurl_tag* tag = photo->tags[i];
-
-    if(!strncmp(tag->raw, "xmlns:", 6)) {
-      prefix = &tag->raw[6];
-      for(p = prefix; *p && *p != '='; p++)
-        ;
-      if(!*p) /* "xmlns:PREFIX" seen */
-        continue;
+  /* the accessors decode the field first for a lazy photo */
+  datatype = flickcurl_photo_get_field_type(photo, field);
+  object = (char*)flickcurl_photo_get_field_string(photo, field);
 
-      /* "xmlns:PREFIX = " seen */
-      *p = '\0';
-      nspaces = nspace_add_new(nspaces, prefix, p+1);
 #if FLICKCURL_DEBUG > 1
-        fprintf(fh,
-                "%s: Found declaration of namespace prefix %s uri %s in tag '%s'\n",
-                label, prefix, p+1, tag->raw);
+  fprintf(stderr,
+          "libflickcurl: field %s (%d) with %s value: '%s' has predicate %s%s\n", 
+          flickcurl_get_photo_field_label(field), field,
+          flickcurl_get_field_value_type_label(datatype),
+          object,
+          field_table[f].nspace_uri, field_table[f].name);
 #endif
-      *p = '=';
-      continue;
-    }
-
-    prefix = tag->raw;
-    for(p = prefix; *p && *p != ':'; p++)
-      ;
-    if(!*p) /* "PREFIX:" seen */
-      continue;
 
-    *p = '\0';
-    nspaces = nspace_add_if_not_declared(nspaces, prefix, NULL);
-    *p = ':';
+  if(field_table[f].flags & FIELD_FLAGS_STRING) {
+    datatype = VALUE_TYPE_STRING;
+  } else if(field_table[f].flags & FIELD_FLAGS_FLOAT) {
+    datatype = VALUE_TYPE_FLOAT;
+  } else if(field_table[f].flags & FIELD_FLAGS_SQL_DATE) {
+    new_object = flickcurl_sqltimestamp_to_isotime(object);
+    object = new_object;
+    datatype = VALUE_TYPE_DATETIME;
   }
 
+  if(field == PHOTO_FIELD_license) {
+    flickcurl_license* license;
 
-  if(need_person) {
-    need_foaf = 1;
-    nspaces = nspace_add_if_not_declared(nspaces, "dc", DCTERMS_NS);
+    license = serializer_get_license(fcs->fc, licenses,
+                                     flickcurl_photo_get_field_integer(photo,
+                                                                       field));
+    if(!license) {
+      if(new_object)
+        free(new_object);
+      return;
+    }
+
+    if(license->url) {
+      datatype = VALUE_TYPE_URI;
+      object = license->url;
+    } else {
+      datatype = VALUE_TYPE_STRING;
+      object = license->name;
+    }
   }
-  
-  if(need_foaf)
-    nspaces = nspace_add_if_not_declared(nspaces, "foaf", FOAF_NS);
+      
+  switch(datatype) {
+    case VALUE_TYPE_BOOLEAN:
+      datatype_uri= XSD_NS "boolean";
+      break;
 
-  if(need_rdfs)
-    nspaces = nspace_add_if_not_declared(nspaces, "rdfs", RDFS_NS);
+    case VALUE_TYPE_DATETIME:
+      datatype_uri= XSD_NS "dateTime";
+      break;
+          
+    case VALUE_TYPE_FLOAT:
+      datatype_uri= XSD_NS "double";
+      break;
+          
+    case VALUE_TYPE_INTEGER:
+      datatype_uri= XSD_NS "integer";
+      break;
+          
+    case VALUE_TYPE_STRING:
+      break;
+          
+    case VALUE_TYPE_URI:
+      type= FLICKCURL_TERM_TYPE_RESOURCE;
+      break;
+          
+      /* these value can never been seen; code above never sets it */
+    case VALUE_TYPE_NONE:
+    case VALUE_TYPE_PHOTO_ID:
+    case VALUE_TYPE_PHOTO_URI:
+    case VALUE_TYPE_UNIXTIME:
+    case VALUE_TYPE_PERSON_ID:
+    case VALUE_TYPE_MEDIA_TYPE:
+    case VALUE_TYPE_TAG_STRING:
+    case VALUE_TYPE_COLLECTION_ID:
+    case VALUE_TYPE_ICON_PHOTOS:
+    default:
+      break;
+  }
 
+  if(object)
+    fcs->factory->emit_triple(fcs->data,
+                              subject, subject_type,
+                              field_table[f].nspace_uri, field_table[f].name,
+                              object, type,
+                              datatype_uri);
 
+  if(new_object)
+    free(new_object);
+}
+
+
+/*
+ * flickcurl_serializer_emit_photo_triples:
+ * @fcs: flickcurl serializer object
+ * @photo: photo object
+ * @subject: photo page URI
+ * @local_nspaces: namespaces declared only for this photo or NULL
+ * @nspaces: declared namespaces
+ * @licenses: licenses array or NULL to look them up when needed
+ * @sizes: photo sizes or NULL
+ * @bnode_suffix: suffix making blank node IDs unique for this photo
+ *
+ * INTERNAL - Emit the triples describing one photo
+ *
+ * The triples are emitted grouped by subject: the photo, then the
+ * person, places and images.
+ */
+static void
+flickcurl_serializer_emit_photo_triples(flickcurl_serializer* fcs,
+                                        flickcurl_photo* photo,
+                                        const char* subject,
+                                        flickrdf_nspace* local_nspaces,
+                                        flickrdf_nspace* nspaces,
+                                        flickcurl_license** licenses,
+                                        flickcurl_size** sizes,
+                                        const char* bnode_suffix)
+{
+  int i;
+  int need_person = 0;
+  size_t suffix_len = strlen(bnode_suffix);
+  char* person_bnode;
+  char* place_bnode;
+  char* tag_buffer = NULL;
+  size_t tag_buffer_size = 0;
+  flickcurl_serializer_factory* fsf = fcs->factory;
+  flickcurl_place* place = photo->place;
 #if FLICKCURL_DEBUG > 1
-  print_nspaces(fh, label, nspaces);
+  FILE* fh = stderr;
+  const char* label = "libflickcurl";
 #endif
 
-  /* generate seen namespace declarations */
-  for(ns = nspaces; ns; ns = ns->next)
-    fsf->emit_namespace(fcs->data,
-                        ns->prefix, ns->prefix_len, ns->uri, ns->uri_len);
-  
+  /* "person" and "placeN" followed by the suffix */
+  person_bnode = (char*)malloc(6 + suffix_len + 1);
+  place_bnode = (char*)malloc(6 + suffix_len + 1);
+  if(!person_bnode || !place_bnode)
+    goto tidy;
+  memcpy(person_bnode, "person", 6);
+  memcpy(person_bnode + 6, bnode_suffix, suffix_len + 1);
+  memcpy(place_bnode, "placeX", 6);
+  memcpy(place_bnode + 6, bnode_suffix, suffix_len + 1);
 
-  if(need_person) {
+  for(i = PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
+    int f = field_predicate[i];
+    flickcurl_field_value_type datatype;
+
+    datatype = flickcurl_photo_get_field_type(photo,
+                                              (flickcurl_photo_field_type)i);
+
+    if(f >= 0 && datatype != VALUE_TYPE_NONE &&
+       (field_table[f].flags & FIELD_FLAGS_PERSON)) {
+      need_person = 1;
+      break;
+    }
+  }
+
+  if(need_person)
     fsf->emit_triple(fcs->data,
-                     photo->uri, FLICKCURL_TERM_TYPE_RESOURCE,
+                     subject, FLICKCURL_TERM_TYPE_RESOURCE,
                      DCTERMS_NS, "creator",
-                     "person", FLICKCURL_TERM_TYPE_BLANK,
-                     NULL);
-    fsf->emit_triple(fcs->data,
-                     "person", FLICKCURL_TERM_TYPE_BLANK,
-                     RDF_NS, "type",
-                     FOAF_NS "Person", FLICKCURL_TERM_TYPE_RESOURCE,
-                     NULL);
-    fsf->emit_triple(fcs->data,
-                     "person", FLICKCURL_TERM_TYPE_BLANK,
-                     FOAF_NS, "maker",
-                     photo->uri, FLICKCURL_TERM_TYPE_RESOURCE,
+                     person_bnode, FLICKCURL_TERM_TYPE_BLANK,
                      NULL);
 
-  }
-  
-
   /* generate triples from fields */
   for(i = PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
-    flickcurl_photo_field_type field = (flickcurl_photo_field_type)i;
-    flickcurl_field_value_type datatype = photo->fields[field].type;
-    int f;
-
-    if(datatype == VALUE_TYPE_NONE)
-      continue;
-
-    for(f = 0; field_table[f].field != PHOTO_FIELD_none; f++) {
-      const char* datatype_uri = NULL;
-      char* object = NULL;
-      char* new_object = NULL;
-      int type= FLICKCURL_TERM_TYPE_LITERAL;
-      
-      if(field_table[f].field != field) 
-        continue;
-
-#if FLICKCURL_DEBUG > 1
-        fprintf(fh,
-                "%s: field %s (%d) with %s value: '%s' has predicate %s%s\n", 
-                label,
-                flickcurl_get_photo_field_label(field), field,
-                flickcurl_get_field_value_type_label(datatype),
-                photo->fields[field].string,
-                field_table[f].nspace_uri, field_table[f].name);
-#endif
+    int f = field_predicate[i];
+    flickcurl_field_value_type datatype;
 
-      object = photo->fields[field].string;
-
-      if(field_table[f].flags & FIELD_FLAGS_STRING) {
-        datatype = VALUE_TYPE_STRING;
-      } else if(field_table[f].flags & FIELD_FLAGS_FLOAT) {
-        datatype = VALUE_TYPE_FLOAT;
-      } else if(field_table[f].flags & FIELD_FLAGS_SQL_DATE) {
-        new_object = flickcurl_sqltimestamp_to_isotime(object);
-        object = new_object;
-        datatype = VALUE_TYPE_DATETIME;
-      }
-
-      if(field == PHOTO_FIELD_license) {
-        flickcurl_license* license;
-        license = flickcurl_photos_licenses_getInfo_by_id(fc, 
-                                                        photo->fields[field].integer);
-        if(!license) {
-          if(new_object)
-            free(new_object);
-          continue;
-        }
+    datatype = flickcurl_photo_get_field_type(photo,
+                                              (flickcurl_photo_field_type)i);
 
-        if(license->url) {
-          datatype = VALUE_TYPE_URI;
-          object = license->url;
-        } else {
-          datatype = VALUE_TYPE_STRING;
-          object = license->name;
-        }
-      }
-      
-      switch(datatype) {
-        case VALUE_TYPE_BOOLEAN:
-          datatype_uri= XSD_NS "boolean";
-          break;
-
-        case VALUE_TYPE_DATETIME:
-          datatype_uri= XSD_NS "dateTime";
-          break;
-          
-        case VALUE_TYPE_FLOAT:
-          datatype_uri= XSD_NS "double";
-          break;
-          
-        case VALUE_TYPE_INTEGER:
-          datatype_uri= XSD_NS "integer";
-          break;
-          
-        case VALUE_TYPE_STRING:
-          break;
-          
-        case VALUE_TYPE_URI:
-          type= FLICKCURL_TERM_TYPE_RESOURCE;
-          break;
-          
-          /* these value can never been seen; code above never sets it */
-        case VALUE_TYPE_NONE:
-        case VALUE_TYPE_PHOTO_ID:
-        case VALUE_TYPE_PHOTO_URI:
-        case VALUE_TYPE_UNIXTIME:
-        case VALUE_TYPE_PERSON_ID:
-        case VALUE_TYPE_MEDIA_TYPE:
-        case VALUE_TYPE_TAG_STRING:
-        case VALUE_TYPE_COLLECTION_ID:
-        case VALUE_TYPE_ICON_PHOTOS:
-        default:
-          break;
-      }
-
-      if(field_table[f].flags & FIELD_FLAGS_PERSON)
-        fsf->emit_triple(fcs->data,
-                         "person", FLICKCURL_TERM_TYPE_BLANK,
-                         field_table[f].nspace_uri, field_table[f].name,
-                         object, type,
-                         datatype_uri);
-      else
-        fsf->emit_triple(fcs->data,
-                         photo->uri, FLICKCURL_TERM_TYPE_RESOURCE,
-                         field_table[f].nspace_uri, field_table[f].name,
-                         object, type,
-                         datatype_uri);
+    if(f < 0 || datatype == VALUE_TYPE_NONE ||
+       (field_table[f].flags & FIELD_FLAGS_PERSON))
+      continue;
 
-      if(new_object)
-        free(new_object);
-      
-      break;
-    }
+    flickcurl_serializer_emit_field(fcs, photo, (flickcurl_photo_field_type)i,
+                                    subject, FLICKCURL_TERM_TYPE_RESOURCE,
+                                    licenses);
   }
   
 
-  /* generate triples from tags */
+  /* generate triples from tags "PREFIX:NAME=VALUE" with a known PREFIX */
   for(i = 0; i < photo->tags_count; i++) {
-    flickcurl_tag* tag = photo->tags[i];
-    char* prefix;
-    char *p;
-    char *f;
-    char *v;
+    const char* raw = photo->tags[i]->raw;
+    char prefix[TAG_PREFIX_SIZE];
+    const char *p;
+    const char *v;
+    char* name;
+    char* value;
+    size_t name_len;
     size_t value_len;
+    flickrdf_nspace* ns = NULL;
     
-    prefix = &tag->raw[0];
-
-    if(!strncmp(prefix, "xmlns:", 6))
+    if(!raw || !strncmp(raw, "xmlns:", 6))
       continue;
     
-    for(p = prefix; *p && *p != ':'; p++)
-      ;
-    if(!*p) /* No ':' found */
+    p = tag_get_prefix(raw, ':', prefix);
+    if(!p)
       continue;
-    
-    /* ":" seen */
-    *p = '\0';
+    p++;
 
-    f = p+1;
-    
-    for(v = f; *v && *v != '='; v++)
+    for(v = p; *v && *v != '='; v++)
       ;
     if(!*v) /* "prefix:name" seen with no value */
       continue;
-    /* zap = */
-    *v++ = '\0';
 
-    value_len = strlen(v);
-    if(*v == '"') {
-      v++;
-      if(v[value_len-1] == '"')
-        v[--value_len] = '\0';
-    }
-        
-    ns = nspace_get_by_prefix(nspaces, prefix);
+    if(local_nspaces)
+      ns = nspace_get_by_prefix(local_nspaces, prefix);
+    if(!ns)
+      ns = nspace_get_by_prefix(nspaces, prefix);
     
 #if FLICKCURL_DEBUG > 1
-      fprintf(fh,
-              "%s: tag with prefix '%s' field '%s' value '%s' namespace uri %s\n",
-              label, prefix, f, v, 
-              ns ? ns->uri : "(No namespace)");
+    fprintf(fh,
+            "%s: tag '%s' with prefix '%s' namespace uri %s\n",
+            label, raw, prefix, ns ? ns->uri : "(No namespace)");
 #endif
     if(!ns)
       continue;
+
+    /* copy the name and value so the tag is not modified */
+    name_len = v - p;
+    v++;
+    value_len = strlen(v);
+    if(value_len >= 2 && v[0] == '"' && v[value_len - 1] == '"') {
+      v++;
+      value_len -= 2;
+    }
+
+    if(name_len + value_len + 2 > tag_buffer_size) {
+      char* new_buffer;
+
+      new_buffer = (char*)realloc(tag_buffer, name_len + value_len + 2);
+      if(!new_buffer)
+        continue;
+      tag_buffer = new_buffer;
+      tag_buffer_size = name_len + value_len + 2;
+    }
+    name = tag_buffer;
+    memcpy(name, p, name_len);
+    name[name_len] = '\0';
+    value = tag_buffer + name_len + 1;
+    memcpy(value, v, value_len);
+    value[value_len] = '\0';
     
     fsf->emit_triple(fcs->data,
-                     photo->uri, FLICKCURL_TERM_TYPE_RESOURCE,
-                     ns->uri, f,
-                     v, FLICKCURL_TERM_TYPE_LITERAL, 
+                     subject, FLICKCURL_TERM_TYPE_RESOURCE,
+                     ns->uri, name,
+                     value, FLICKCURL_TERM_TYPE_LITERAL, 
                      NULL);
-    
   }
 
 
-  /* generate triples from places */
-  if(photo->place) {
-    char place_bnode[7] = {'p', 'l', 'a', 'c', 'e', 'X', '\0'};
-    flickcurl_place* place = photo->place;
-    
+  /* generate triples linking to places */
+  if(place) {
+    for(i = (int)0; i <= (int)FLICKCURL_PLACE_LAST; i++) {
+      if(!place->names[i] && !place->ids[i] && !place->urls[i] &&
+         !place->woe_ids[i])
+        continue;
+      
+      place_bnode[5] = '0'+i;
+      
+      fsf->emit_triple(fcs->data,
+                       subject, FLICKCURL_TERM_TYPE_RESOURCE,
+                       PLACES_NS, "place",
+                       place_bnode, FLICKCURL_TERM_TYPE_BLANK,
+                       NULL);
+    }
+  }
+
+
+  /* generate triples linking to sizes */
+  if(sizes) {
+    for(i = 0; sizes[i]; i++) {
+      flickcurl_size* size = sizes[i];
+      int is_photo = (!size->media || !strcmp(size->media, "photo"));
+
+      fsf->emit_triple(fcs->data,
+                       subject, FLICKCURL_TERM_TYPE_RESOURCE,
+                       FLICKR_NS, is_photo ? "photo" : "video",
+                       size->source, FLICKCURL_TERM_TYPE_RESOURCE,
+                       NULL);
+    }
+  }
+
+
+  /* generate triples about the person */
+  if(need_person) {
+    fsf->emit_triple(fcs->data,
+                     person_bnode, FLICKCURL_TERM_TYPE_BLANK,
+                     RDF_NS, "type",
+                     FOAF_NS "Person", FLICKCURL_TERM_TYPE_RESOURCE,
+                     NULL);
+    fsf->emit_triple(fcs->data,
+                     person_bnode, FLICKCURL_TERM_TYPE_BLANK,
+                     FOAF_NS, "maker",
+                     subject, FLICKCURL_TERM_TYPE_RESOURCE,
+                     NULL);
+
+    for(i = PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
+      int f = field_predicate[i];
+      flickcurl_field_value_type datatype;
+
+      datatype = flickcurl_photo_get_field_type(photo,
+                                                (flickcurl_photo_field_type)i);
+
+      if(f < 0 || datatype == VALUE_TYPE_NONE ||
+         !(field_table[f].flags & FIELD_FLAGS_PERSON))
+        continue;
+
+      flickcurl_serializer_emit_field(fcs, photo,
+                                      (flickcurl_photo_field_type)i,
+                                      person_bnode, FLICKCURL_TERM_TYPE_BLANK,
+                                      licenses);
+    }
+  }
+
+
+  /* generate triples about places */
+  if(place) {
     for(i = (int)0; i <= (int)FLICKCURL_PLACE_LAST; i++) {
       char* name = place->names[i];
       char* id = place->ids[i];
@@ -654,11 +737,6 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
       
       place_bnode[5] = '0'+i;
       
-      fsf->emit_triple(fcs->data,
-                       photo->uri, FLICKCURL_TERM_TYPE_RESOURCE,
-                       PLACES_NS, "place",
-                       place_bnode, FLICKCURL_TERM_TYPE_BLANK,
-                       NULL);
       fsf->emit_triple(fcs->data,
                        place_bnode, FLICKCURL_TERM_TYPE_BLANK,
                        RDF_NS, "type",
@@ -700,24 +778,17 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
   }
 
 
-  /* generate triples from sizes */
+  /* generate triples about sizes */
   if(sizes) {
     for(i = 0; sizes[i]; i++) {
       flickcurl_size* size = sizes[i];
-      char buf[10];
+      char buf[12];
       int is_photo;
-      const char* sizePredicate;
       const char* sizeClass;
 
-      is_photo = (!strcmp(size->media, "photo"));
-      sizePredicate = is_photo ? "photo" : "video";
+      is_photo = (!size->media || !strcmp(size->media, "photo"));
       sizeClass = is_photo ? FOAF_NS "Image" : FLICKR_NS "Video";
 
-      fsf->emit_triple(fcs->data,
-                       photo->uri, FLICKCURL_TERM_TYPE_RESOURCE,
-                       FLICKR_NS, sizePredicate,
-                       size->source, FLICKCURL_TERM_TYPE_RESOURCE,
-                       NULL);
       fsf->emit_triple(fcs->data,
                        size->source, FLICKCURL_TERM_TYPE_RESOURCE,
                        RDF_NS, "type",
@@ -730,23 +801,158 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
                          RDFS_NS, "label",
                          size->label, FLICKCURL_TERM_TYPE_LITERAL,
                          NULL);
-      sprintf(buf, "%d", size->width);
-      fsf->emit_triple(fcs->data,
-                       size->source, FLICKCURL_TERM_TYPE_RESOURCE,
-                       FLICKR_NS, "width",
-                       buf, FLICKCURL_TERM_TYPE_LITERAL,
-                       XSD_NS "integer");
-      sprintf(buf, "%d", size->height);
-      fsf->emit_triple(fcs->data,
-                       size->source, FLICKCURL_TERM_TYPE_RESOURCE,
-                       FLICKR_NS, "height",
-                       buf, FLICKCURL_TERM_TYPE_LITERAL,
-                       XSD_NS "integer");
 
+      /* sizes from url_* extras without width_* and height_* have none */
+      if(size->width > 0) {
+        sprintf(buf, "%d", size->width);
+        fsf->emit_triple(fcs->data,
+                         size->source, FLICKCURL_TERM_TYPE_RESOURCE,
+                         FLICKR_NS, "width",
+                         buf, FLICKCURL_TERM_TYPE_LITERAL,
+                         XSD_NS "integer");
+      }
+      if(size->height > 0) {
+        sprintf(buf, "%d", size->height);
+        fsf->emit_triple(fcs->data,
+                         size->source, FLICKCURL_TERM_TYPE_RESOURCE,
+                         FLICKR_NS, "height",
+                         buf, FLICKCURL_TERM_TYPE_LITERAL,
+                         XSD_NS "integer");
+      }
     }
-    flickcurl_free_sizes(sizes);
   }
 
+ tidy:
+  if(tag_buffer)
+    free(tag_buffer);
+  if(person_bnode)
+    free(person_bnode);
+  if(place_bnode)
+    free(place_bnode);
+}
+    
+
+/**
+ * flickcurl_serialize_photo:
+ * @fcs: flickcurl serializer object
+ * @photo: photo object
+ *
+ * Serialize photo description to RDF triples
+ *
+ * Calls flickr.photos.getSizes to describe the photo's images and
+ * declares just the namespaces used by this photo.  To serialize many
+ * photos to one output, use flickcurl_serialize_photos_iterator().
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
+{
+  int i;
+  int need_person = 0;
+  int need_foaf = 0;
+  int need_rdfs = 0;
+  flickrdf_nspace* nspaces = NULL;
+  flickrdf_nspace* ns;
+  flickcurl_serializer_factory* fsf = fcs->factory;
+  flickcurl* fc = fcs->fc;
+#if FLICKCURL_DEBUG > 1
+  FILE* fh = stderr;
+  const char* label = "libflickcurl";
+#endif
+  flickcurl_size** sizes = NULL;
+
+  if(!photo)
+    return 1;
+
+  /* Always add XSD, RDF and Flickr namespaces */
+  nspaces = nspace_add_if_not_declared(nspaces, NULL, XSD_NS);
+  nspaces = nspace_add_if_not_declared(nspaces, "rdf", RDF_NS);
+  nspaces = nspace_add_if_not_declared(nspaces, "flickr", FLICKR_NS);
+
+  if(photo->place)
+    nspaces = nspace_add_if_not_declared(nspaces, "places", PLACES_NS);
+
+  sizes = flickcurl_photos_getSizes(fc, photo->id);
+  if(sizes) {
+    need_foaf = 1;
+    need_rdfs = 1;
+  }
+
+  /* mark namespaces used in fields */
+  for(i = PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
+    int f = field_predicate[i];
+    flickcurl_field_value_type datatype;
+
+    datatype = flickcurl_photo_get_field_type(photo,
+                                              (flickcurl_photo_field_type)i);
+
+    if(f < 0 || datatype == VALUE_TYPE_NONE)
+      continue;
+
+    if(field_table[f].flags & FIELD_FLAGS_PERSON)
+      need_person = 1;
+
+    nspaces = nspace_add_if_not_declared(nspaces, NULL,
+                                         field_table[f].nspace_uri);
+  }
+  
+
+  /* in tags look for xmlns:PREFIX = "URI" otherwise look for PREFIX: */
+  for(i = 0; i < photo->tags_count; i++) {
+    const char* raw = photo->tags[i]->raw;
+    char prefix[TAG_PREFIX_SIZE];
+    const char *p;
+
+    if(!raw)
+      continue;
+
+    if(!strncmp(raw, "xmlns:", 6)) {
+      p = tag_get_prefix(raw + 6, '=', prefix);
+      if(!p) /* "xmlns:PREFIX" seen */
+        continue;
+
+      /* "xmlns:PREFIX = " seen */
+      nspaces = nspace_add_new(nspaces, prefix, p + 1);
+#if FLICKCURL_DEBUG > 1
+      fprintf(fh,
+              "%s: Found declaration of namespace prefix %s uri %s in tag '%s'\n",
+              label, prefix, p + 1, raw);
+#endif
+      continue;
+    }
+
+    if(tag_get_prefix(raw, ':', prefix)) /* "PREFIX:" seen */
+      nspaces = nspace_add_if_not_declared(nspaces, prefix, NULL);
+  }
+
+
+  if(need_person) {
+    need_foaf = 1;
+    nspaces = nspace_add_if_not_declared(nspaces, NULL, DCTERMS_NS);
+  }
+  
+  if(need_foaf)
+    nspaces = nspace_add_if_not_declared(nspaces, "foaf", FOAF_NS);
+
+  if(need_rdfs)
+    nspaces = nspace_add_if_not_declared(nspaces, "rdfs", RDFS_NS);
+
+
+#if FLICKCURL_DEBUG > 1
+  print_nspaces(fh, label, nspaces);
+#endif
+
+  /* generate seen namespace declarations */
+  for(ns = nspaces; ns; ns = ns->next)
+    fsf->emit_namespace(fcs->data,
+                        ns->prefix, ns->prefix_len, ns->uri, ns->uri_len);
+  
+  flickcurl_serializer_emit_photo_triples(fcs, photo, photo->uri, NULL,
+                                          nspaces, NULL, sizes, "");
+
+  if(sizes)
+    flickcurl_free_sizes(sizes);
 
   if(nspaces)
     free_nspaces(nspaces);
@@ -756,3 +962,237 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
   
   return 0;
 }
+
+
+/* Get the next batch of photos from @iterator, reading the url_*
+ * image size extras of the photo lists it gets during this call */
+static flickcurl_photo**
+flickcurl_serializer_next_photos(flickcurl* fc,
+                                 flickcurl_photos_iterator iterator,
+                                 void* user_data)
+{
+  flickcurl_photo** photos;
+
+  flickcurl_free_photo_source_sizes(fc);
+
+  fc->want_source_sizes = 1;
+  photos = iterator(user_data);
+  fc->want_source_sizes = 0;
+
+  return photos;
+}
+
+
+/* one-shot iterator used by flickcurl_serialize_photos() */
+static flickcurl_photo**
+flickcurl_serializer_array_iterator(void* user_data)
+{
+  flickcurl_photo*** photos_p = (flickcurl_photo***)user_data;
+  flickcurl_photo** photos = *photos_p;
+
+  *photos_p = NULL;
+  return photos;
+}
+
+
+/**
+ * flickcurl_serialize_photos_iterator:
+ * @fcs: flickcurl serializer object
+ * @iterator: function returning the next batch of photos
+ * @user_data: user data for @iterator
+ *
+ * Serialize the descriptions of many photos to RDF triples as one stream
+ *
+ * The @iterator is called repeatedly to get NULL-terminated arrays of
+ * photos, for example one page of a flickcurl_photos_list at a time,
+ * until it returns NULL.  The batch stays owned by the iterator and
+ * only needs to remain valid until the next call, so memory use is
+ * bounded by the batch size rather than the total number of photos.
+ *
+ * Unlike flickcurl_serialize_photo(), the standard namespaces are
+ * declared once at the start, machine tag namespaces are declared the
+ * first time they are used, the photo licenses are read once for the
+ * whole stream and the image sizes of photo lists that @iterator gets
+ * are taken from their url_* extras so need no request.  Request the
+ * url_sq, url_q, url_t, url_s, url_n, url_m, url_z, url_c, url_l and
+ * url_o extras in the photo list to use them; flickr.photos.getSizes
+ * is only called for photos without any of those extras.  Blank node
+ * IDs have the photo ID appended so they are unique in the stream.
+ *
+ * The factory emit_finish method is called once at the end.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_serialize_photos_iterator(flickcurl_serializer* fcs,
+                                    flickcurl_photos_iterator iterator,
+                                    void* user_data)
+{
+  static const char* stream_nspace_uris[] = {
+    XSD_NS, RDF_NS, RDFS_NS, FLICKR_NS, PLACES_NS, DCTERMS_NS, FOAF_NS,
+    GEO_NS, NULL
+  };
+  static flickcurl_license* no_licenses[1] = { NULL };
+  flickcurl_serializer_factory* fsf = fcs->factory;
+  flickcurl* fc = fcs->fc;
+  flickrdf_nspace* nspaces = NULL;
+  flickrdf_nspace* ns;
+  flickcurl_license** licenses;
+  char* bnode_suffix = NULL;
+  size_t bnode_suffix_size = 0;
+  flickcurl_photo** photos;
+  int i;
+  int rc = 0;
+
+  if(!iterator)
+    return 1;
+
+  /* Declare the namespaces used by fields, places and sizes once */
+  for(i = 0; stream_nspace_uris[i]; i++)
+    nspaces = nspace_add_if_not_declared(nspaces, NULL, stream_nspace_uris[i]);
+  for(ns = nspaces; ns; ns = ns->next)
+    fsf->emit_namespace(fcs->data,
+                        ns->prefix, ns->prefix_len, ns->uri, ns->uri_len);
+
+  /* Read the license table once for the whole stream */
+  licenses = flickcurl_photos_licenses_getInfo(fc);
+  if(!licenses)
+    licenses = no_licenses;
+
+  while((photos = flickcurl_serializer_next_photos(fc, iterator, user_data))) {
+    int p;
+
+    for(p = 0; photos[p]; p++) {
+      flickcurl_photo* photo = photos[p];
+      flickrdf_nspace* local_nspaces = NULL;
+      flickcurl_size** sizes;
+      flickcurl_size** fetched_sizes = NULL;
+      char* page_uri = NULL;
+      const char* subject = photo->uri;
+      size_t id_len;
+      int t;
+
+      if(!photo->id)
+        continue;
+
+      /* photo lists have no page URI; make it from the owner */
+      if(!subject &&
+         flickcurl_photo_get_field_string(photo, PHOTO_FIELD_owner_nsid)) {
+        page_uri = flickcurl_photo_as_page_uri(photo);
+        subject = page_uri;
+      }
+      if(!subject)
+        continue;
+
+      /* blank node IDs suffix "_PHOTO-ID" */
+      id_len = strlen(photo->id);
+      if(id_len + 2 > bnode_suffix_size) {
+        char* new_suffix = (char*)realloc(bnode_suffix, id_len + 2);
+        if(!new_suffix) {
+          if(page_uri)
+            free(page_uri);
+          rc = 1;
+          break;
+        }
+        bnode_suffix = new_suffix;
+        bnode_suffix_size = id_len + 2;
+      }
+      bnode_suffix[0] = '_';
+      memcpy(bnode_suffix + 1, photo->id, id_len + 1);
+
+      /* declare namespaces of machine tags when first seen */
+      for(t = 0; t < photo->tags_count; t++) {
+        const char* raw = photo->tags[t]->raw;
+        char prefix[TAG_PREFIX_SIZE];
+        const char* sep;
+        flickrdf_nspace* old_nspaces = nspaces;
+
+        if(!raw)
+          continue;
+
+        if(!strncmp(raw, "xmlns:", 6)) {
+          sep = tag_get_prefix(raw + 6, '=', prefix);
+          if(!sep)
+            continue;
+
+          ns = nspace_get_by_prefix(nspaces, prefix);
+          if(!ns)
+            nspaces = nspace_add_new(nspaces, prefix, sep + 1);
+          else if(strcmp(ns->uri, sep + 1))
+            /* prefix already declared for another URI in the stream */
+            local_nspaces = nspace_add_new(local_nspaces, prefix, sep + 1);
+        } else if(tag_get_prefix(raw, ':', prefix)) {
+          if(!nspace_get_by_prefix(nspaces, prefix))
+            nspaces = nspace_add_if_not_declared(nspaces, prefix, NULL);
+        }
+
+        if(nspaces != old_nspaces)
+          fsf->emit_namespace(fcs->data,
+                              nspaces->prefix, nspaces->prefix_len,
+                              nspaces->uri, nspaces->uri_len);
+      }
+
+      sizes = flickcurl_get_photo_source_sizes(fc, photo);
+      if(!sizes) {
+        fetched_sizes = flickcurl_photos_getSizes(fc, photo->id);
+        sizes = fetched_sizes;
+      }
+
+      flickcurl_serializer_emit_photo_triples(fcs, photo, subject,
+                                              local_nspaces, nspaces,
+                                              licenses, sizes, bnode_suffix);
+
+      if(fetched_sizes)
+        flickcurl_free_sizes(fetched_sizes);
+      if(local_nspaces)
+        free_nspaces(local_nspaces);
+      if(page_uri)
+        free(page_uri);
+    }
+
+    if(rc)
+      break;
+  }
+
+  if(bnode_suffix)
+    free(bnode_suffix);
+
+  flickcurl_free_photo_source_sizes(fc);
+
+  if(nspaces)
+    free_nspaces(nspaces);
+  
+  if(fsf->emit_finish)
+    fsf->emit_finish(fcs->data);
+
+  return rc;
+}
+
+
+/**
+ * flickcurl_serialize_photos:
+ * @fcs: flickcurl serializer object
+ * @photos: NULL-terminated array of photo objects
+ *
+ * Serialize the descriptions of an array of photos to RDF triples as
+ * one stream
+ *
+ * See flickcurl_serialize_photos_iterator() for how the stream differs
+ * from calling flickcurl_serialize_photo() on each photo.  The image
+ * sizes of @photos, which are already built, come from
+ * flickr.photos.getSizes.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_serialize_photos(flickcurl_serializer* fcs, flickcurl_photo** photos)
+{
+  flickcurl_photo** photos_state = photos;
+
+  if(!photos)
+    return 1;
+
+  return flickcurl_serialize_photos_iterator(fcs,
+                                             flickcurl_serializer_array_iterator,
+                                             &photos_state);
+}
@@ -162,3 +162,154 @@ flickcurl_build_sizes(flickcurl* fc, xmlXPathContextPtr xpathCtx,
 
   return sizes;
 }
+
+
+/* Image sizes given by the url_* photo list extras, smallest first */
+static const struct {
+  const char* suffix;
+  const char* label;
+} flickcurl_size_extras[] = {
+  { "sq", "Square" },
+  { "q",  "Large Square" },
+  { "t",  "Thumbnail" },
+  { "s",  "Small" },
+  { "n",  "Small 320" },
+  { "m",  "Medium" },
+  { "z",  "Medium 640" },
+  { "c",  "Medium 800" },
+  { "l",  "Large" },
+  { "o",  "Original" },
+  { NULL, NULL }
+};
+
+#define FLICKCURL_SIZE_EXTRAS_COUNT 10
+
+
+/* Copy @len bytes of @value as a new string or NULL on failure */
+static char*
+flickcurl_size_copy_string(const char* value, size_t len)
+{
+  char* s = (char*)malloc(len + 1);
+
+  if(s) {
+    memcpy(s, value, len);
+    s[len] = '\0';
+  }
+  return s;
+}
+
+
+/*
+ * flickcurl_build_sizes_from_extras:
+ * @fc: flickcurl context
+ * @node: photo list item element
+ *
+ * INTERNAL - Build the image sizes given by the url_*, width_* and
+ * height_* attributes of a photo list item
+ *
+ * These are returned when the url_sq ... url_o extras are requested.
+ * Only the sizes with a url_* attribute are made since not every size
+ * exists for every photo.
+ *
+ * Return value: NULL-terminated array of sizes or NULL if there are none
+ */
+flickcurl_size**
+flickcurl_build_sizes_from_extras(flickcurl* fc, xmlNodePtr node)
+{
+  flickcurl_size* found[FLICKCURL_SIZE_EXTRAS_COUNT];
+  flickcurl_size** sizes = NULL;
+  xmlAttr* attr;
+  int size_count = 0;
+  int failed = 0;
+  int i;
+
+  memset(found, '\0', sizeof(found));
+
+  for(attr = node->properties; attr && !failed; attr = attr->next) {
+    const char *attr_name = (const char*)attr->name;
+    const char *attr_value;
+    const char *suffix;
+    flickcurl_size* s;
+
+    if(!strncmp(attr_name, "url_", 4))
+      suffix = attr_name + 4;
+    else if(!strncmp(attr_name, "width_", 6))
+      suffix = attr_name + 6;
+    else if(!strncmp(attr_name, "height_", 7))
+      suffix = attr_name + 7;
+    else
+      continue;
+
+    for(i = 0; flickcurl_size_extras[i].suffix; i++) {
+      if(!strcmp(suffix, flickcurl_size_extras[i].suffix))
+        break;
+    }
+    if(!flickcurl_size_extras[i].suffix || !attr->children)
+      continue;
+    attr_value = (const char*)attr->children->content;
+
+    s = found[i];
+    if(!s) {
+      s = (flickcurl_size*)calloc(1, sizeof(flickcurl_size));
+      if(!s) {
+        failed = 1;
+        break;
+      }
+      found[i] = s;
+    }
+
+    if(*attr_name == 'u') {
+      if(!s->source) {
+        s->source = flickcurl_size_copy_string(attr_value, strlen(attr_value));
+        if(!s->source)
+          failed = 1;
+      }
+    } else if(*attr_name == 'w')
+      s->width = atoi(attr_value);
+    else
+      s->height = atoi(attr_value);
+  }
+
+  if(!failed) {
+    for(i = 0; i < FLICKCURL_SIZE_EXTRAS_COUNT; i++) {
+      if(found[i] && found[i]->source)
+        size_count++;
+    }
+  }
+
+  if(size_count) {
+    sizes = (flickcurl_size**)calloc(size_count + 1, sizeof(flickcurl_size*));
+    if(!sizes)
+      failed = 1;
+  }
+
+  for(i = 0, size_count = 0; i < FLICKCURL_SIZE_EXTRAS_COUNT; i++) {
+    flickcurl_size* s = found[i];
+    const char* label = flickcurl_size_extras[i].label;
+
+    if(!s)
+      continue;
+
+    if(!failed && s->source) {
+      s->label = flickcurl_size_copy_string(label, strlen(label));
+      s->media = flickcurl_size_copy_string("photo", 5);
+      if(s->label && s->media) {
+        sizes[size_count++] = s;
+        continue;
+      }
+      failed = 1;
+    }
+    flickcurl_free_size(s);
+  }
+
+  if(failed && sizes) {
+    for(i = 0; i < size_count; i++)
+      flickcurl_free_size(sizes[i]);
+    free(sizes);
+    sizes = NULL;
+  }
+  if(failed)
+    flickcurl_error(fc, "Out of memory");
+
+  return sizes;
+}
@@ -0,0 +1,1416 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * snapshot.c - Flickcurl cache of decoded objects
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * The snapshot cache keeps photos, people, places and photosets
+ * returned by the getInfo calls as records in one block of memory,
+ * optionally a memory-mapped file so that it survives the process.
+ * The block holds no pointers: everything is an offset from the
+ * start of the block or of a record, so a file can be mapped at any
+ * address and used as it is.
+ *
+ * Layout, all integers in the byte order of the writer:
+ *
+ *   header     magic, layout version, byte order mark, field counts,
+ *              size, end of the records, hash bucket count
+ *   buckets    32-bit offsets of the first record in each hash chain
+ *   records    8-byte aligned, each:
+ *                next record in chain, length, key hash, type,
+ *                dead flag, expiry time, word count, key length
+ *                words: 32-bit integers and string references
+ *                heap: key then the string bytes, each NUL terminated
+ *
+ * A string reference is two words: its offset in the heap plus one
+ * (0 for NULL) and its length.  Objects are written and read as the
+ * same fixed sequence of words per type, so reading a record back is
+ * a walk along the words copying strings out; there is no parsing.
+ *
+ * Records are only ever appended.  A replaced or invalidated record
+ * is marked dead and when the block is full everything is dropped
+ * and filling starts again.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#define FLICKCURL_SNAPSHOT_MMAP 1
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define FLICKCURL_SNAPSHOT_MAGIC "FCSNAP\r\n"
+/* Bump when the header, record or any object word sequence changes */
+#define FLICKCURL_SNAPSHOT_VERSION 1
+#define FLICKCURL_SNAPSHOT_BYTE_ORDER 0x01020304
+/* Object field counts the records were written with */
+#define FLICKCURL_SNAPSHOT_FIELDS ((PHOTO_FIELD_LAST << 16) | \
+                                   (PERSON_FIELD_LAST << 8) | \
+                                   FLICKCURL_PLACE_LAST)
+#define FLICKCURL_SNAPSHOT_MIN_SIZE 65536
+#define FLICKCURL_SNAPSHOT_MAX_SIZE 0x7fffffff
+
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t fields;
+  uint32_t size;
+  /* offset of the end of the records */
+  uint32_t used;
+  uint32_t buckets_count;
+} flickcurl_snapshot_header;
+
+
+typedef struct {
+  /* offset of the next record in the hash chain or 0 */
+  uint32_t next;
+  uint32_t length;
+  uint32_t hash;
+  uint16_t type;
+  uint16_t dead;
+  /* time_t after which the record is stale */
+  int64_t expires;
+  uint32_t words_count;
+  uint32_t key_length;
+} flickcurl_snapshot_record;
+
+
+struct flickcurl_snapshot_cache_s {
+  /* block holding the header, buckets and records */
+  unsigned char* base;
+  size_t size;
+  /* file descriptor of the mapped file or -1 */
+  int fd;
+  int ttl;
+
+  int hits;
+  int misses;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+};
+
+
+#define SNAPSHOT_HEADER(cache) ((flickcurl_snapshot_header*)(cache)->base)
+#define SNAPSHOT_BUCKETS(cache) ((uint32_t*)((cache)->base + sizeof(flickcurl_snapshot_header)))
+#define SNAPSHOT_RECORD(cache, offset) ((flickcurl_snapshot_record*)((cache)->base + (offset)))
+#define SNAPSHOT_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+
+#ifndef STANDALONE
+
+static uint32_t
+flickcurl_snapshot_hash(flickcurl_snapshot_type type, const char* id,
+                        size_t len)
+{
+  /* FNV-1a */
+  uint32_t hash = 2166136261U ^ (uint32_t)type;
+  size_t i;
+
+  hash *= 16777619U;
+  for(i = 0; i < len; i++) {
+    hash ^= (unsigned char)id[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+
+/* Offset of the first record */
+static size_t
+flickcurl_snapshot_records_start(flickcurl_snapshot_cache* cache)
+{
+  return SNAPSHOT_ALIGN(sizeof(flickcurl_snapshot_header) +
+                        SNAPSHOT_HEADER(cache)->buckets_count *
+                        sizeof(uint32_t));
+}
+
+
+/* Drop all records */
+static void
+flickcurl_snapshot_clear(flickcurl_snapshot_cache* cache)
+{
+  flickcurl_snapshot_header* header = SNAPSHOT_HEADER(cache);
+
+  memset(SNAPSHOT_BUCKETS(cache), '\0',
+         header->buckets_count * sizeof(uint32_t));
+  header->used = (uint32_t)flickcurl_snapshot_records_start(cache);
+}
+
+
+/* Write a new empty header and bucket table */
+static void
+flickcurl_snapshot_format(flickcurl_snapshot_cache* cache)
+{
+  flickcurl_snapshot_header* header = SNAPSHOT_HEADER(cache);
+  uint32_t buckets_count = 64;
+
+  /* about one bucket per 512 bytes of records */
+  while(buckets_count < cache->size / 512)
+    buckets_count <<= 1;
+
+  memset(header, '\0', sizeof(*header));
+  memcpy(header->magic, FLICKCURL_SNAPSHOT_MAGIC, 8);
+  header->version = FLICKCURL_SNAPSHOT_VERSION;
+  header->byte_order = FLICKCURL_SNAPSHOT_BYTE_ORDER;
+  header->fields = FLICKCURL_SNAPSHOT_FIELDS;
+  header->size = (uint32_t)cache->size;
+  header->buckets_count = buckets_count;
+
+  flickcurl_snapshot_clear(cache);
+}
+
+
+/* Return non-0 if the block holds a header this code can use */
+static int
+flickcurl_snapshot_header_ok(flickcurl_snapshot_cache* cache)
+{
+  flickcurl_snapshot_header* header = SNAPSHOT_HEADER(cache);
+
+  return (!memcmp(header->magic, FLICKCURL_SNAPSHOT_MAGIC, 8) &&
+          header->version == FLICKCURL_SNAPSHOT_VERSION &&
+          header->byte_order == FLICKCURL_SNAPSHOT_BYTE_ORDER &&
+          header->fields == FLICKCURL_SNAPSHOT_FIELDS &&
+          header->size == cache->size &&
+          header->buckets_count > 0 &&
+          !(header->buckets_count & (header->buckets_count - 1)) &&
+          flickcurl_snapshot_records_start(cache) < cache->size &&
+          header->used >= flickcurl_snapshot_records_start(cache) &&
+          header->used <= cache->size);
+}
+
+
+/**
+ * flickcurl_new_snapshot_cache:
+ * @filename: file to keep the cache in or NULL to keep it in memory
+ * @size: size of the cache in bytes (64K to 2G)
+ * @ttl: time to keep objects in seconds
+ *
+ * Create a cache of decoded photos, people, places and photosets
+ *
+ * Set the cache on flickcurl sessions with
+ * flickcurl_set_snapshot_cache().  Then flickcurl_photos_getInfo2(),
+ * flickcurl_people_getInfo(), flickcurl_places_getInfo2() (by place
+ * ID) and flickcurl_photosets_getInfo() return a copy of an object
+ * that is in the cache and younger than @ttl instead of calling the
+ * web service.  A write call with a parameter naming an ID (such as
+ * photo_id or photo_ids) removes the objects with that ID.
+ *
+ * A cache file is memory-mapped and kept between uses, so a later
+ * process starts with the same objects.  A file written by a
+ * different version of the cache layout, or of a different size, is
+ * started again empty.  A file may only be used by one process at a
+ * time.  Objects may be private, so only share a cache between
+ * sessions with the same credentials.
+ *
+ * Return value: new cache or NULL on failure
+ */
+flickcurl_snapshot_cache*
+flickcurl_new_snapshot_cache(const char* filename, size_t size, int ttl)
+{
+  flickcurl_snapshot_cache* cache;
+
+  if(size < FLICKCURL_SNAPSHOT_MIN_SIZE || size > FLICKCURL_SNAPSHOT_MAX_SIZE ||
+     ttl < 0)
+    return NULL;
+
+  cache = (flickcurl_snapshot_cache*)calloc(1, sizeof(*cache));
+  if(!cache)
+    return NULL;
+
+  cache->size = size;
+  cache->fd = -1;
+  cache->ttl = ttl;
+
+  if(filename) {
+#ifdef FLICKCURL_SNAPSHOT_MMAP
+    struct stat sb;
+    void* base;
+
+    cache->fd = open(filename, O_RDWR | O_CREAT, 0600);
+    if(cache->fd < 0)
+      goto failed;
+    if(fstat(cache->fd, &sb) || ((size_t)sb.st_size != size &&
+                                 ftruncate(cache->fd, (off_t)size)))
+      goto failed;
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if(base == MAP_FAILED)
+      goto failed;
+    cache->base = (unsigned char*)base;
+#else
+    goto failed;
+#endif
+  } else {
+    cache->base = (unsigned char*)malloc(size);
+    if(!cache->base)
+      goto failed;
+    memset(cache->base, '\0', sizeof(flickcurl_snapshot_header));
+  }
+
+  if(!flickcurl_snapshot_header_ok(cache))
+    flickcurl_snapshot_format(cache);
+
+#ifdef HAVE_PTHREAD
+  if(pthread_mutex_init(&cache->lock, NULL))
+    goto failed;
+#endif
+
+  return cache;
+
+  failed:
+#ifdef FLICKCURL_SNAPSHOT_MMAP
+  if(cache->fd >= 0) {
+    if(cache->base)
+      munmap(cache->base, size);
+    close(cache->fd);
+  } else
+#endif
+  if(cache->base)
+    free(cache->base);
+  free(cache);
+  return NULL;
+}
+
+
+/**
+ * flickcurl_free_snapshot_cache:
+ * @cache: snapshot cache
+ *
+ * Destructor for a snapshot cache
+ *
+ * A cache file is left with the objects in it.  No session may still
+ * be making a call with the cache.
+ */
+void
+flickcurl_free_snapshot_cache(flickcurl_snapshot_cache* cache)
+{
+  if(!cache)
+    return;
+
+#ifdef FLICKCURL_SNAPSHOT_MMAP
+  if(cache->fd >= 0) {
+    munmap(cache->base, cache->size);
+    close(cache->fd);
+  } else
+#endif
+    free(cache->base);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&cache->lock);
+#endif
+  free(cache);
+}
+
+
+/**
+ * flickcurl_set_snapshot_cache:
+ * @fc: flickcurl object
+ * @cache: snapshot cache or NULL to stop using one
+ *
+ * Set the cache of decoded objects for the session
+ *
+ * See flickcurl_new_snapshot_cache().
+ */
+void
+flickcurl_set_snapshot_cache(flickcurl* fc, flickcurl_snapshot_cache* cache)
+{
+  fc->snapshot_cache = cache;
+}
+
+
+/**
+ * flickcurl_snapshot_cache_get_counts:
+ * @cache: snapshot cache
+ * @hits_p: pointer to store the number of objects found (or NULL)
+ * @misses_p: pointer to store the number of objects not found or stale (or NULL)
+ *
+ * Get the lookup counts of a snapshot cache since it was created
+ */
+void
+flickcurl_snapshot_cache_get_counts(flickcurl_snapshot_cache* cache,
+                                    int* hits_p, int* misses_p)
+{
+  if(hits_p)
+    *hits_p = cache->hits;
+  if(misses_p)
+    *misses_p = cache->misses;
+}
+
+
+/*
+ * Return non-0 if the record at @offset lies within the records and
+ * its words and key lie within it, as in a damaged file they may not
+ */
+static int
+flickcurl_snapshot_record_ok(flickcurl_snapshot_cache* cache, size_t offset)
+{
+  flickcurl_snapshot_header* header = SNAPSHOT_HEADER(cache);
+  flickcurl_snapshot_record* r;
+  size_t length;
+
+  if(offset < flickcurl_snapshot_records_start(cache) || (offset & 7) ||
+     offset + sizeof(*r) > header->used)
+    return 0;
+
+  r = SNAPSHOT_RECORD(cache, offset);
+  length = r->length;
+  /* the key is followed by a NUL */
+  return (length >= sizeof(*r) && !(length & 7) &&
+          length <= header->used - offset &&
+          r->words_count <= (length - sizeof(*r)) / sizeof(uint32_t) &&
+          r->key_length < length - sizeof(*r) -
+                          r->words_count * sizeof(uint32_t));
+}
+
+
+/* Find the record for @type and @id; call with the lock held */
+static flickcurl_snapshot_record*
+flickcurl_snapshot_find(flickcurl_snapshot_cache* cache,
+                        flickcurl_snapshot_type type, const char* id)
+{
+  flickcurl_snapshot_header* header = SNAPSHOT_HEADER(cache);
+  size_t len = strlen(id);
+  uint32_t hash = flickcurl_snapshot_hash(type, id, len);
+  uint32_t offset;
+
+  offset = SNAPSHOT_BUCKETS(cache)[hash & (header->buckets_count - 1)];
+  while(offset) {
+    flickcurl_snapshot_record* r = SNAPSHOT_RECORD(cache, offset);
+
+    /* chains run from newer to older records; stop at any damage */
+    if(!flickcurl_snapshot_record_ok(cache, offset) || r->next >= offset)
+      break;
+
+    if(!r->dead && r->hash == hash && r->type == type &&
+       r->key_length == len &&
+       !memcmp((const char*)(r + 1) + r->words_count * sizeof(uint32_t),
+               id, len))
+      return r;
+
+    offset = r->next;
+  }
+
+  return NULL;
+}
+
+
+/* Mark every live record with @id dead; call with the lock held */
+static void
+flickcurl_snapshot_remove(flickcurl_snapshot_cache* cache, const char* id)
+{
+  int type;
+
+  for(type = 0; type <= FLICKCURL_SNAPSHOT_LAST; type++) {
+    flickcurl_snapshot_record* r;
+
+    r = flickcurl_snapshot_find(cache, (flickcurl_snapshot_type)type, id);
+    if(r)
+      r->dead = 1;
+  }
+}
+
+
+/**
+ * flickcurl_snapshot_cache_invalidate:
+ * @cache: snapshot cache
+ * @id: object ID
+ *
+ * Remove any objects with an ID from a snapshot cache
+ */
+void
+flickcurl_snapshot_cache_invalidate(flickcurl_snapshot_cache* cache,
+                                    const char* id)
+{
+  if(!id)
+    return;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&cache->lock);
+#endif
+  flickcurl_snapshot_remove(cache, id);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+
+static void
+flickcurl_snapshot_put_int(flickcurl_snapshot_writer* w, int value)
+{
+  if(w->words_count == w->words_size) {
+    int size = w->words_size ? w->words_size * 2 : 128;
+    uint32_t* words;
+
+    words = (uint32_t*)realloc(w->words, size * sizeof(uint32_t));
+    if(!words) {
+      w->failed = 1;
+      return;
+    }
+    w->words = words;
+    w->words_size = size;
+  }
+
+  w->words[w->words_count++] = (uint32_t)value;
+}
+
+
+static void
+flickcurl_snapshot_put_double(flickcurl_snapshot_writer* w, double value)
+{
+  uint32_t halves[2];
+
+  memcpy(halves, &value, sizeof(halves));
+  flickcurl_snapshot_put_int(w, (int)halves[0]);
+  flickcurl_snapshot_put_int(w, (int)halves[1]);
+}
+
+
+static void
+flickcurl_snapshot_put_data(flickcurl_snapshot_writer* w, const char* data,
+                            size_t len)
+{
+  if(!data) {
+    flickcurl_snapshot_put_int(w, 0);
+    flickcurl_snapshot_put_int(w, 0);
+    return;
+  }
+
+  if(w->heap_len + len + 1 > w->heap_size) {
+    size_t size = w->heap_size ? w->heap_size : 1024;
+    char* heap;
+
+    while(size < w->heap_len + len + 1)
+      size <<= 1;
+    heap = (char*)realloc(w->heap, size);
+    if(!heap) {
+      w->failed = 1;
+      return;
+    }
+    w->heap = heap;
+    w->heap_size = size;
+  }
+
+  flickcurl_snapshot_put_int(w, (int)(w->heap_len + 1));
+  flickcurl_snapshot_put_int(w, (int)len);
+  memcpy(w->heap + w->heap_len, data, len);
+  w->heap_len += len;
+  w->heap[w->heap_len++] = '\0';
+}
+
+
+/*
+ * INTERNAL - append a string reference to a record being written
+ */
+void
+flickcurl_snapshot_put_string(flickcurl_snapshot_writer* w, const char* s)
+{
+  flickcurl_snapshot_put_data(w, s, s ? strlen(s) : 0);
+}
+
+
+static int
+flickcurl_snapshot_get_int(flickcurl_snapshot_reader* r)
+{
+  if(r->word >= r->words_count) {
+    r->failed = 1;
+    return 0;
+  }
+
+  return (int)r->words[r->word++];
+}
+
+
+static double
+flickcurl_snapshot_get_double(flickcurl_snapshot_reader* r)
+{
+  uint32_t halves[2];
+  double value;
+
+  halves[0] = (uint32_t)flickcurl_snapshot_get_int(r);
+  halves[1] = (uint32_t)flickcurl_snapshot_get_int(r);
+  memcpy(&value, halves, sizeof(value));
+  return value;
+}
+
+
+/* Return a new copy of a string or data or NULL */
+static char*
+flickcurl_snapshot_get_data(flickcurl_snapshot_reader* r, size_t* len_p)
+{
+  uint32_t offset = (uint32_t)flickcurl_snapshot_get_int(r);
+  uint32_t len = (uint32_t)flickcurl_snapshot_get_int(r);
+  char* s;
+
+  if(len_p)
+    *len_p = len;
+  if(!offset)
+    return NULL;
+
+  if(offset - 1 + (size_t)len >= r->heap_len) {
+    r->failed = 1;
+    return NULL;
+  }
+
+  s = (char*)malloc(len + 1);
+  if(!s) {
+    r->failed = 1;
+    return NULL;
+  }
+  /* the NUL after it may be damaged */
+  memcpy(s, r->heap + offset - 1, len);
+  s[len] = '\0';
+  return s;
+}
+
+
+static char*
+flickcurl_snapshot_get_string(flickcurl_snapshot_reader* r)
+{
+  return flickcurl_snapshot_get_data(r, NULL);
+}
+
+
+static void
+flickcurl_snapshot_put_place(flickcurl_snapshot_writer* w,
+                             flickcurl_place* place)
+{
+  flickcurl_shapedata* shape = place->shape;
+  int i;
+
+  for(i = 0; i <= FLICKCURL_PLACE_LAST; i++) {
+    flickcurl_snapshot_put_string(w, place->names[i]);
+    flickcurl_snapshot_put_string(w, place->ids[i]);
+    flickcurl_snapshot_put_string(w, place->urls[i]);
+    flickcurl_snapshot_put_string(w, place->woe_ids[i]);
+  }
+  flickcurl_snapshot_put_int(w, (int)place->type);
+  flickcurl_snapshot_put_double(w, place->location.latitude);
+  flickcurl_snapshot_put_double(w, place->location.longitude);
+  flickcurl_snapshot_put_int(w, place->location.accuracy);
+  flickcurl_snapshot_put_int(w, place->count);
+  flickcurl_snapshot_put_string(w, place->timezone);
+
+  flickcurl_snapshot_put_int(w, (shape != NULL));
+  if(shape) {
+    flickcurl_snapshot_put_int(w, shape->created);
+    flickcurl_snapshot_put_double(w, shape->alpha);
+    flickcurl_snapshot_put_int(w, shape->points);
+    flickcurl_snapshot_put_int(w, shape->edges);
+    flickcurl_snapshot_put_data(w, shape->data, shape->data_length);
+    flickcurl_snapshot_put_int(w, shape->file_urls_count);
+    for(i = 0; i < shape->file_urls_count; i++)
+      flickcurl_snapshot_put_string(w, shape->file_urls[i]);
+    flickcurl_snapshot_put_int(w, shape->is_donuthole);
+    flickcurl_snapshot_put_int(w, shape->has_donuthole);
+  }
+}
+
+
+static flickcurl_place*
+flickcurl_snapshot_get_place(flickcurl_snapshot_reader* r)
+{
+  flickcurl_place* place;
+  flickcurl_shapedata* shape;
+  int i;
+
+  place = (flickcurl_place*)calloc(1, sizeof(*place));
+  if(!place) {
+    r->failed = 1;
+    return NULL;
+  }
+
+  for(i = 0; i <= FLICKCURL_PLACE_LAST; i++) {
+    place->names[i] = flickcurl_snapshot_get_string(r);
+    place->ids[i] = flickcurl_snapshot_get_string(r);
+    place->urls[i] = flickcurl_snapshot_get_string(r);
+    place->woe_ids[i] = flickcurl_snapshot_get_string(r);
+  }
+  place->type = (flickcurl_place_type)flickcurl_snapshot_get_int(r);
+  place->location.latitude = flickcurl_snapshot_get_double(r);
+  place->location.longitude = flickcurl_snapshot_get_double(r);
+  place->location.accuracy = flickcurl_snapshot_get_int(r);
+  place->count = flickcurl_snapshot_get_int(r);
+  place->timezone = flickcurl_snapshot_get_string(r);
+
+  if(!flickcurl_snapshot_get_int(r) || r->failed)
+    return place;
+
+  shape = (flickcurl_shapedata*)calloc(1, sizeof(*shape));
+  if(!shape) {
+    r->failed = 1;
+    return place;
+  }
+  place->shape = shape;
+
+  shape->created = flickcurl_snapshot_get_int(r);
+  shape->alpha = flickcurl_snapshot_get_double(r);
+  shape->points = flickcurl_snapshot_get_int(r);
+  shape->edges = flickcurl_snapshot_get_int(r);
+  shape->data = flickcurl_snapshot_get_data(r, &shape->data_length);
+  i = flickcurl_snapshot_get_int(r);
+  if(i < 0 || i > r->words_count) {
+    r->failed = 1;
+    return place;
+  }
+  shape->file_urls = (char**)calloc(i + 1, sizeof(char*));
+  if(!shape->file_urls) {
+    r->failed = 1;
+    return place;
+  }
+  for(shape->file_urls_count = 0; shape->file_urls_count < i;
+      shape->file_urls_count++)
+    shape->file_urls[shape->file_urls_count] = flickcurl_snapshot_get_string(r);
+  shape->is_donuthole = flickcurl_snapshot_get_int(r);
+  shape->has_donuthole = flickcurl_snapshot_get_int(r);
+
+  /* DEPRECATED fields point into the shape */
+  place->shapedata = shape->data;
+  place->shapedata_length = shape->data_length;
+  place->shapefile_urls = shape->file_urls;
+  place->shapefile_urls_count = shape->file_urls_count;
+
+  return place;
+}
+
+
+/*
+ * INTERNAL - append the words of @photo to a record being written
+ *
+ * A lazy photo has its fields decoded first.
+ */
+void
+flickcurl_snapshot_put_photo(flickcurl_snapshot_writer* w,
+                             flickcurl_photo* photo)
+{
+  int i;
+
+  flickcurl_snapshot_put_string(w, photo->id);
+  flickcurl_snapshot_put_string(w, photo->uri);
+  flickcurl_snapshot_put_string(w, photo->media_type);
+
+  for(i = 0; i <= PHOTO_FIELD_LAST; i++) {
+    flickcurl_photo_field_type field = (flickcurl_photo_field_type)i;
+
+    flickcurl_snapshot_put_string(w, flickcurl_photo_get_field_string(photo,
+                                                                      field));
+    flickcurl_snapshot_put_int(w, photo->fields[i].integer);
+    flickcurl_snapshot_put_int(w, (int)photo->fields[i].type);
+  }
+
+  flickcurl_snapshot_put_int(w, photo->tags_count);
+  for(i = 0; i < photo->tags_count; i++) {
+    flickcurl_tag* tag = photo->tags[i];
+
+    flickcurl_snapshot_put_string(w, tag->id);
+    flickcurl_snapshot_put_string(w, tag->author);
+    flickcurl_snapshot_put_string(w, tag->authorname);
+    flickcurl_snapshot_put_string(w, tag->raw);
+    flickcurl_snapshot_put_string(w, tag->cooked);
+    flickcurl_snapshot_put_int(w, tag->machine_tag);
+    flickcurl_snapshot_put_int(w, tag->count);
+  }
+
+  flickcurl_snapshot_put_int(w, (photo->place != NULL));
+  if(photo->place)
+    flickcurl_snapshot_put_place(w, photo->place);
+
+  flickcurl_snapshot_put_int(w, (photo->video != NULL));
+  if(photo->video) {
+    flickcurl_snapshot_put_int(w, photo->video->ready);
+    flickcurl_snapshot_put_int(w, photo->video->failed);
+    flickcurl_snapshot_put_int(w, photo->video->pending);
+    flickcurl_snapshot_put_int(w, photo->video->duration);
+    flickcurl_snapshot_put_int(w, photo->video->width);
+    flickcurl_snapshot_put_int(w, photo->video->height);
+  }
+
+  flickcurl_snapshot_put_int(w, photo->notes_count);
+  for(i = 0; i < photo->notes_count; i++) {
+    flickcurl_note* note = photo->notes[i];
+
+    flickcurl_snapshot_put_int(w, note->id);
+    flickcurl_snapshot_put_string(w, note->author);
+    flickcurl_snapshot_put_string(w, note->authorname);
+    flickcurl_snapshot_put_int(w, (int)note->x);
+    flickcurl_snapshot_put_int(w, (int)note->y);
+    flickcurl_snapshot_put_int(w, (int)note->w);
+    flickcurl_snapshot_put_int(w, (int)note->h);
+    flickcurl_snapshot_put_string(w, note->text);
+  }
+}
+
+
+/*
+ * INTERNAL - read a photo written by flickcurl_snapshot_put_photo()
+ *
+ * Return value: new photo or NULL; it is incomplete if r->failed is set
+ */
+flickcurl_photo*
+flickcurl_snapshot_get_photo(flickcurl_snapshot_reader* r)
+{
+  flickcurl_photo* photo;
+  int count;
+  int i;
+
+  photo = (flickcurl_photo*)calloc(1, sizeof(*photo));
+  if(!photo) {
+    r->failed = 1;
+    return NULL;
+  }
+
+  photo->id = flickcurl_snapshot_get_string(r);
+  photo->uri = flickcurl_snapshot_get_string(r);
+  photo->media_type = flickcurl_snapshot_get_string(r);
+
+  for(i = 0; i <= PHOTO_FIELD_LAST; i++) {
+    photo->fields[i].string = flickcurl_snapshot_get_string(r);
+    photo->fields[i].integer = (flickcurl_photo_field_type)flickcurl_snapshot_get_int(r);
+    photo->fields[i].type = (flickcurl_field_value_type)flickcurl_snapshot_get_int(r);
+  }
+
+  count = flickcurl_snapshot_get_int(r);
+  if(count < 0 || count > r->words_count) {
+    r->failed = 1;
+    return photo;
+  }
+  photo->tags = (flickcurl_tag**)calloc(count + 1, sizeof(flickcurl_tag*));
+  if(!photo->tags) {
+    r->failed = 1;
+    return photo;
+  }
+  for(photo->tags_count = 0; photo->tags_count < count; photo->tags_count++) {
+    flickcurl_tag* tag;
+
+    tag = (flickcurl_tag*)calloc(1, sizeof(*tag));
+    if(!tag) {
+      r->failed = 1;
+      return photo;
+    }
+    photo->tags[photo->tags_count] = tag;
+
+    tag->photo = photo;
+    tag->id = flickcurl_snapshot_get_string(r);
+    tag->author = flickcurl_snapshot_get_string(r);
+    tag->authorname = flickcurl_snapshot_get_string(r);
+    tag->raw = flickcurl_snapshot_get_string(r);
+    tag->cooked = flickcurl_snapshot_get_string(r);
+    tag->machine_tag = flickcurl_snapshot_get_int(r);
+    tag->count = flickcurl_snapshot_get_int(r);
+  }
+
+  if(flickcurl_snapshot_get_int(r))
+    photo->place = flickcurl_snapshot_get_place(r);
+
+  if(flickcurl_snapshot_get_int(r)) {
+    photo->video = (flickcurl_video*)calloc(1, sizeof(flickcurl_video));
+    if(!photo->video) {
+      r->failed = 1;
+      return photo;
+    }
+    photo->video->ready = flickcurl_snapshot_get_int(r);
+    photo->video->failed = flickcurl_snapshot_get_int(r);
+    photo->video->pending = flickcurl_snapshot_get_int(r);
+    photo->video->duration = flickcurl_snapshot_get_int(r);
+    photo->video->width = flickcurl_snapshot_get_int(r);
+    photo->video->height = flickcurl_snapshot_get_int(r);
+  }
+
+  count = flickcurl_snapshot_get_int(r);
+  if(count < 0 || count > r->words_count) {
+    r->failed = 1;
+    return photo;
+  }
+  if(count) {
+    photo->notes = (flickcurl_note**)calloc(count + 1, sizeof(flickcurl_note*));
+    if(!photo->notes) {
+      r->failed = 1;
+      return photo;
+    }
+  }
+  for(photo->notes_count = 0; photo->notes_count < count;
+      photo->notes_count++) {
+    flickcurl_note* note;
+
+    note = (flickcurl_note*)calloc(1, sizeof(*note));
+    if(!note) {
+      r->failed = 1;
+      return photo;
+    }
+    photo->notes[photo->notes_count] = note;
+
+    note->id = flickcurl_snapshot_get_int(r);
+    note->author = flickcurl_snapshot_get_string(r);
+    note->authorname = flickcurl_snapshot_get_string(r);
+    note->x = (unsigned int)flickcurl_snapshot_get_int(r);
+    note->y = (unsigned int)flickcurl_snapshot_get_int(r);
+    note->w = (unsigned int)flickcurl_snapshot_get_int(r);
+    note->h = (unsigned int)flickcurl_snapshot_get_int(r);
+    note->text = flickcurl_snapshot_get_string(r);
+  }
+
+  return photo;
+}
+
+
+/* INTERNAL - append the words of @person to a record being written */
+void
+flickcurl_snapshot_put_person(flickcurl_snapshot_writer* w,
+                              flickcurl_person* person)
+{
+  int i;
+
+  flickcurl_snapshot_put_string(w, person->nsid);
+  for(i = 0; i <= PERSON_FIELD_LAST; i++) {
+    flickcurl_snapshot_put_string(w, person->fields[i].string);
+    flickcurl_snapshot_put_int(w, person->fields[i].integer);
+    flickcurl_snapshot_put_int(w, (int)person->fields[i].type);
+  }
+}
+
+
+/* INTERNAL - read a person written by flickcurl_snapshot_put_person() */
+flickcurl_person*
+flickcurl_snapshot_get_person(flickcurl_snapshot_reader* r)
+{
+  flickcurl_person* person;
+  int i;
+
+  person = (flickcurl_person*)calloc(1, sizeof(*person));
+  if(!person) {
+    r->failed = 1;
+    return NULL;
+  }
+
+  person->nsid = flickcurl_snapshot_get_string(r);
+  for(i = 0; i <= PERSON_FIELD_LAST; i++) {
+    person->fields[i].string = flickcurl_snapshot_get_string(r);
+    person->fields[i].integer = (flickcurl_person_field_type)flickcurl_snapshot_get_int(r);
+    person->fields[i].type = (flickcurl_field_value_type)flickcurl_snapshot_get_int(r);
+  }
+
+  return person;
+}
+
+
+/* INTERNAL - append the words of @photoset to a record being written */
+void
+flickcurl_snapshot_put_photoset(flickcurl_snapshot_writer* w,
+                                flickcurl_photoset* photoset)
+{
+  flickcurl_snapshot_put_string(w, photoset->id);
+  flickcurl_snapshot_put_string(w, photoset->primary);
+  flickcurl_snapshot_put_string(w, photoset->secret);
+  flickcurl_snapshot_put_int(w, photoset->server);
+  flickcurl_snapshot_put_int(w, photoset->farm);
+  flickcurl_snapshot_put_int(w, photoset->photos_count);
+  flickcurl_snapshot_put_string(w, photoset->title);
+  flickcurl_snapshot_put_string(w, photoset->description);
+  flickcurl_snapshot_put_string(w, photoset->owner);
+}
+
+
+/* INTERNAL - read a photoset written by flickcurl_snapshot_put_photoset() */
+flickcurl_photoset*
+flickcurl_snapshot_get_photoset(flickcurl_snapshot_reader* r)
+{
+  flickcurl_photoset* photoset;
+
+  photoset = (flickcurl_photoset*)calloc(1, sizeof(*photoset));
+  if(!photoset) {
+    r->failed = 1;
+    return NULL;
+  }
+
+  photoset->id = flickcurl_snapshot_get_string(r);
+  photoset->primary = flickcurl_snapshot_get_string(r);
+  photoset->secret = flickcurl_snapshot_get_string(r);
+  photoset->server = flickcurl_snapshot_get_int(r);
+  photoset->farm = flickcurl_snapshot_get_int(r);
+  photoset->photos_count = flickcurl_snapshot_get_int(r);
+  photoset->title = flickcurl_snapshot_get_string(r);
+  photoset->description = flickcurl_snapshot_get_string(r);
+  photoset->owner = flickcurl_snapshot_get_string(r);
+
+  return photoset;
+}
+
+
+static void
+flickcurl_snapshot_free_object(flickcurl_snapshot_type type, void* object)
+{
+  if(!object)
+    return;
+
+  switch(type) {
+    case FLICKCURL_SNAPSHOT_PHOTO:
+      flickcurl_free_photo((flickcurl_photo*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PERSON:
+      flickcurl_free_person((flickcurl_person*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PLACE:
+      flickcurl_free_place((flickcurl_place*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PHOTOSET:
+      flickcurl_free_photoset((flickcurl_photoset*)object);
+      break;
+  }
+}
+
+
+/*
+ * INTERNAL - get a new copy of the cached object of @type with @id
+ *
+ * Return value: new object or NULL if there is none or it is stale
+ */
+void*
+flickcurl_snapshot_get(flickcurl* fc, flickcurl_snapshot_type type,
+                       const char* id)
+{
+  flickcurl_snapshot_cache* cache = fc->snapshot_cache;
+  flickcurl_snapshot_record* rec;
+  flickcurl_snapshot_reader r;
+  void* object = NULL;
+
+  if(!id)
+    return NULL;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&cache->lock);
+#endif
+
+  rec = flickcurl_snapshot_find(cache, type, id);
+  if(rec && rec->expires < (int64_t)time(NULL)) {
+    rec->dead = 1;
+    rec = NULL;
+  }
+
+  if(rec) {
+    memset(&r, '\0', sizeof(r));
+    r.words = (const uint32_t*)(rec + 1);
+    r.words_count = (int)rec->words_count;
+    r.heap = (const char*)(r.words + r.words_count);
+    /* the find checked the words lie within the record */
+    r.heap_len = rec->length - sizeof(*rec) -
+                 r.words_count * sizeof(uint32_t);
+
+    switch(type) {
+      case FLICKCURL_SNAPSHOT_PHOTO:
+        object = flickcurl_snapshot_get_photo(&r);
+        break;
+      case FLICKCURL_SNAPSHOT_PERSON:
+        object = flickcurl_snapshot_get_person(&r);
+        break;
+      case FLICKCURL_SNAPSHOT_PLACE:
+        object = flickcurl_snapshot_get_place(&r);
+        break;
+      case FLICKCURL_SNAPSHOT_PHOTOSET:
+        object = flickcurl_snapshot_get_photoset(&r);
+        break;
+    }
+
+    if(r.failed) {
+      flickcurl_snapshot_free_object(type, object);
+      object = NULL;
+      rec->dead = 1;
+    }
+  }
+
+  if(object)
+    cache->hits++;
+  else
+    cache->misses++;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&cache->lock);
+#endif
+
+  return object;
+}
+
+
+/*
+ * INTERNAL - add or replace the object of @type with @id in the cache
+ */
+void
+flickcurl_snapshot_put(flickcurl* fc, flickcurl_snapshot_type type,
+                       const char* id, void* object)
+{
+  flickcurl_snapshot_cache* cache = fc->snapshot_cache;
+  flickcurl_snapshot_header* header;
+  flickcurl_snapshot_writer w;
+  flickcurl_snapshot_record* rec;
+  size_t key_len;
+  size_t length;
+  size_t offset;
+  uint32_t* bucket;
+
+  if(!id || !object)
+    return;
+
+  memset(&w, '\0', sizeof(w));
+  key_len = strlen(id);
+  /* the key starts the heap */
+  flickcurl_snapshot_put_string(&w, id);
+  w.words_count = 0;
+
+  switch(type) {
+    case FLICKCURL_SNAPSHOT_PHOTO:
+      flickcurl_snapshot_put_photo(&w, (flickcurl_photo*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PERSON:
+      flickcurl_snapshot_put_person(&w, (flickcurl_person*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PLACE:
+      flickcurl_snapshot_put_place(&w, (flickcurl_place*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PHOTOSET:
+      flickcurl_snapshot_put_photoset(&w, (flickcurl_photoset*)object);
+      break;
+  }
+
+  length = SNAPSHOT_ALIGN(sizeof(*rec) + w.words_count * sizeof(uint32_t) +
+                          w.heap_len);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&cache->lock);
+#endif
+
+  header = SNAPSHOT_HEADER(cache);
+  if(w.failed ||
+     length > cache->size - flickcurl_snapshot_records_start(cache))
+    goto tidy;
+
+  flickcurl_snapshot_remove(cache, id);
+
+  if(header->used + length > cache->size)
+    flickcurl_snapshot_clear(cache);
+
+  offset = header->used;
+  rec = SNAPSHOT_RECORD(cache, offset);
+  memset(rec, '\0', sizeof(*rec));
+  rec->length = (uint32_t)length;
+  rec->hash = flickcurl_snapshot_hash(type, id, key_len);
+  rec->type = (uint16_t)type;
+  rec->expires = (int64_t)time(NULL) + cache->ttl;
+  rec->words_count = (uint32_t)w.words_count;
+  rec->key_length = (uint32_t)key_len;
+  memcpy(rec + 1, w.words, w.words_count * sizeof(uint32_t));
+  memcpy((char*)(rec + 1) + w.words_count * sizeof(uint32_t), w.heap,
+         w.heap_len);
+
+  /* the record is complete before it is linked in */
+  header->used = (uint32_t)(offset + length);
+  bucket = &SNAPSHOT_BUCKETS(cache)[rec->hash & (header->buckets_count - 1)];
+  rec->next = *bucket;
+  *bucket = (uint32_t)offset;
+
+  tidy:
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&cache->lock);
+#endif
+
+  if(w.words)
+    free(w.words);
+  if(w.heap)
+    free(w.heap);
+}
+
+
+/*
+ * INTERNAL - remove cached objects named by ID parameters of a write call
+ *
+ * Every parameter ending in _id or _ids is taken as one or a comma
+ * separated list of object IDs.
+ */
+void
+flickcurl_snapshot_invalidate_params(flickcurl* fc)
+{
+  flickcurl_snapshot_cache* cache = fc->snapshot_cache;
+  int i;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&cache->lock);
+#endif
+
+  for(i = 0; i < fc->count; i++) {
+    const char* name = fc->parameters[i][0];
+    const char* value = fc->parameters[i][1];
+    size_t len = strlen(name);
+
+    if(!value)
+      continue;
+
+    if((len > 3 && !strcmp(name + len - 3, "_id")) ||
+       (len > 4 && !strcmp(name + len - 4, "_ids"))) {
+      while(*value) {
+        const char* end = strchr(value, ',');
+        size_t id_len = end ? (size_t)(end - value) : strlen(value);
+        char id[128];
+
+        if(id_len && id_len < sizeof(id)) {
+          memcpy(id, value, id_len);
+          id[id_len] = '\0';
+          flickcurl_snapshot_remove(cache, id);
+        }
+        if(!end)
+          break;
+        value = end + 1;
+      }
+    }
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+#define SNAPSHOT_TEST_FILE "flickcurl_snapshot_test.cache"
+#define SNAPSHOT_TEST_SIZE 65536
+
+static unsigned char snapshot_test_block[SNAPSHOT_TEST_SIZE];
+
+
+/* Damage done to the record of the cache file */
+typedef enum {
+  SNAPSHOT_TEST_NONE,
+  SNAPSHOT_TEST_WORDS_COUNT,
+  SNAPSHOT_TEST_SHORT_LENGTH,
+  SNAPSHOT_TEST_LONG_LENGTH,
+  SNAPSHOT_TEST_KEY_LENGTH,
+  SNAPSHOT_TEST_STRING_OFFSET,
+  SNAPSHOT_TEST_STRING_NUL,
+  SNAPSHOT_TEST_LAST = SNAPSHOT_TEST_STRING_NUL
+} snapshot_test_damage;
+
+static const char* snapshot_test_labels[SNAPSHOT_TEST_LAST + 1] = {
+  "undamaged",
+  "word count past the record",
+  "length shorter than the words",
+  "length past the records",
+  "key length past the record",
+  "string offset past the heap",
+  "string without its NUL"
+};
+
+
+/* Write the cache file from the block with @damage to its one record */
+static int
+snapshot_test_write(snapshot_test_damage damage)
+{
+  unsigned char block[SNAPSHOT_TEST_SIZE];
+  flickcurl_snapshot_header* header;
+  flickcurl_snapshot_record* r;
+  uint32_t* words;
+  char* title;
+  FILE* fh;
+  size_t written;
+
+  memcpy(block, snapshot_test_block, SNAPSHOT_TEST_SIZE);
+  header = (flickcurl_snapshot_header*)block;
+  r = (flickcurl_snapshot_record*)(block +
+        SNAPSHOT_ALIGN(sizeof(*header) +
+                       header->buckets_count * sizeof(uint32_t)));
+  words = (uint32_t*)(r + 1);
+  title = (char*)(words + r->words_count) + r->key_length + 1;
+
+  switch(damage) {
+    case SNAPSHOT_TEST_NONE:
+      break;
+    case SNAPSHOT_TEST_WORDS_COUNT:
+      r->words_count = 0x3fffffff;
+      break;
+    case SNAPSHOT_TEST_SHORT_LENGTH:
+      r->length = sizeof(*r);
+      break;
+    case SNAPSHOT_TEST_LONG_LENGTH:
+      r->length += 8;
+      break;
+    case SNAPSHOT_TEST_KEY_LENGTH:
+      r->key_length = r->length;
+      break;
+    case SNAPSHOT_TEST_STRING_OFFSET:
+      /* the first word is the reference of the ID */
+      words[0] = SNAPSHOT_TEST_SIZE;
+      break;
+    case SNAPSHOT_TEST_STRING_NUL:
+      /* the heap is the key, then the ID and the title strings */
+      title += strlen(title) + 1;
+      title[strlen(title)] = 'X';
+      break;
+  }
+
+  fh = fopen(SNAPSHOT_TEST_FILE, "wb");
+  if(!fh)
+    return 1;
+  written = fwrite(block, 1, SNAPSHOT_TEST_SIZE, fh);
+  if(fclose(fh) || written != SNAPSHOT_TEST_SIZE)
+    return 1;
+
+  return 0;
+}
+
+
+/* Get the photoset from the cache file with @damage */
+static int
+snapshot_test_get(flickcurl* fc, snapshot_test_damage damage)
+{
+  flickcurl_snapshot_cache* cache;
+  flickcurl_photoset* photoset;
+  int expected = (damage == SNAPSHOT_TEST_NONE ||
+                  damage == SNAPSHOT_TEST_STRING_NUL);
+  int failed;
+
+  if(snapshot_test_write(damage))
+    return 1;
+  cache = flickcurl_new_snapshot_cache(SNAPSHOT_TEST_FILE,
+                                       SNAPSHOT_TEST_SIZE, 3600);
+  if(!cache)
+    return 1;
+  flickcurl_set_snapshot_cache(fc, cache);
+
+  photoset = (flickcurl_photoset*)flickcurl_snapshot_get(fc,
+               FLICKCURL_SNAPSHOT_PHOTOSET, "72157");
+  if(expected)
+    failed = !photoset || strcmp(photoset->id, "72157") ||
+             strcmp(photoset->title, "set title") ||
+             photoset->photos_count != 42;
+  else
+    failed = (photoset != NULL);
+  if(failed)
+    fprintf(stderr, "%s: FAIL\n  %s: photoset %s\n", program,
+            snapshot_test_labels[damage],
+            photoset ? "read wrongly" : "not read");
+
+  if(photoset)
+    flickcurl_free_photoset(photoset);
+  flickcurl_set_snapshot_cache(fc, NULL);
+  flickcurl_free_snapshot_cache(cache);
+
+  return failed;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl *fc = NULL;
+  flickcurl_snapshot_cache* cache;
+  flickcurl_photoset photoset;
+  FILE* fh;
+  int failures = 0;
+  int damage;
+
+  program = "flickcurl_snapshot_test";
+
+  flickcurl_init();
+
+  fc = flickcurl_new();
+  if(!fc) {
+    failures++;
+    goto tidy;
+  }
+
+  remove(SNAPSHOT_TEST_FILE);
+  cache = flickcurl_new_snapshot_cache(SNAPSHOT_TEST_FILE,
+                                       SNAPSHOT_TEST_SIZE, 3600);
+  if(!cache) {
+    fprintf(stderr, "%s: FAIL\n  cache could not be made\n", program);
+    failures++;
+    goto tidy;
+  }
+  flickcurl_set_snapshot_cache(fc, cache);
+
+  memset(&photoset, '\0', sizeof(photoset));
+  photoset.id = (char*)"72157";
+  photoset.title = (char*)"set title";
+  photoset.photos_count = 42;
+  flickcurl_snapshot_put(fc, FLICKCURL_SNAPSHOT_PHOTOSET, photoset.id,
+                         &photoset);
+
+  flickcurl_set_snapshot_cache(fc, NULL);
+  flickcurl_free_snapshot_cache(cache);
+
+  fh = fopen(SNAPSHOT_TEST_FILE, "rb");
+  if(!fh || fread(snapshot_test_block, 1, SNAPSHOT_TEST_SIZE, fh) !=
+     SNAPSHOT_TEST_SIZE) {
+    fprintf(stderr, "%s: FAIL\n  cache file could not be read\n", program);
+    if(fh)
+      fclose(fh);
+    failures++;
+    goto tidy;
+  }
+  fclose(fh);
+
+  for(damage = 0; damage <= SNAPSHOT_TEST_LAST; damage++)
+    failures += snapshot_test_get(fc, (snapshot_test_damage)damage);
+
+  tidy:
+  remove(SNAPSHOT_TEST_FILE);
+  if(fc)
+    flickcurl_free(fc);
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
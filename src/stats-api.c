@@ -1049,6 +1049,9 @@ flickcurl_stats_getPopularPhotos(flickcurl* fc, const char* date,
   const char* format = NULL;
   flickcurl_photos_list* photos_list = NULL;
   flickcurl_photo** photos = NULL;
+
+  if(flickcurl_check_photos_array(fc))
+    return NULL;
   
   flickcurl_init_params(fc, 0);
 
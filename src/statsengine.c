@@ -0,0 +1,1720 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * statsengine.c - Flickcurl photo stats time series from concurrent calls
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * An engine holds a window of days ending at the last refreshed day
+ * and the views, comments and favorites of each photo on each day in
+ * it.  A photo's days are kept in a ring indexed by the day number
+ * modulo the window length, so moving the window on a day replaces
+ * only the oldest day and a refresh fetches just the photo-days that
+ * are not already held.
+ *
+ * Every web service request is its own asynchronous call: the stats
+ * of a photo-day, each page of its referring domains, each page of
+ * the referrers from each domain and each page of the popular photos
+ * of a day.  Wanted photo-days and popular photo days wait in a
+ * queue; the calls that follow from a result, such as the next page
+ * or the referrers of the domains just found, wait in a second queue
+ * that is taken from first so started photo-days finish soon.  At
+ * most the concurrency limit of calls run at once and as each ends
+ * its handler submits the next, so the application's event loop
+ * drives the whole refresh.  A photo-day is held once all its calls
+ * have ended well.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* Most stats items a domains or referrers page may return */
+#define FLICKCURL_STATS_MAX_PER_PAGE 100
+
+/* Most days the Flickr stats API keeps */
+#define FLICKCURL_STATS_MAX_DAYS 28
+
+
+typedef enum {
+  FLICKCURL_STATS_CELL_EMPTY,
+  FLICKCURL_STATS_CELL_WANTED,
+  FLICKCURL_STATS_CELL_RUNNING,
+  /* running but a call failed or was cancelled */
+  FLICKCURL_STATS_CELL_FAILING,
+  FLICKCURL_STATS_CELL_DONE
+} flickcurl_stats_cell_state;
+
+
+/* One asynchronous call made by an engine */
+typedef struct flickcurl_stats_work_s {
+  flickcurl_stats_engine* engine;
+  struct flickcurl_stats_work_s* prev;
+  struct flickcurl_stats_work_s* next;
+  flickcurl_async_call* call;
+  flickcurl_stats_task task;
+  int day;
+  char date[11];
+  /* non-0 when cancelled by the engine rather than failed */
+  int cancelled;
+} flickcurl_stats_work;
+
+
+struct flickcurl_stats_engine_s {
+  flickcurl* fc;
+  flickcurl_stats_engine_params params;
+
+  char** photo_ids;
+  /* photo indexes in photo ID order for finding photos */
+  int* photo_order;
+  int photos_count;
+  int photos_size;
+
+  /* day number of the newest day in the window or < 0 before a refresh */
+  int end_day;
+  /* date string of each ring slot */
+  char (*dates)[11];
+
+  /* photo-day values at [photo * days + slot] */
+  int* cell_days;
+  unsigned char* cell_states;
+  /* calls of a running photo-day not yet ended */
+  int* cell_calls;
+  int* views;
+  int* comments;
+  int* favorites;
+  flickcurl_stat*** domains;
+  flickcurl_stat*** referrers;
+
+  /* popular photo finding day and state of each ring slot */
+  int* popular_days;
+  unsigned char* popular_states;
+
+  /* wanted photo-days and popular photo days */
+  flickcurl_stats_queue wanted;
+  /* calls following from results, taken first */
+  flickcurl_stats_queue follow_ups;
+
+  /* calls that have not ended */
+  flickcurl_stats_work* works;
+  int works_count;
+
+  /* photo-days and popular photo days wanted or being fetched */
+  int pending;
+  /* fetches that failed since the last refresh */
+  int failed;
+
+  /* non-0 while calls are not to be submitted */
+  int submitting;
+};
+
+
+#ifndef STANDALONE
+
+static void flickcurl_stats_engine_submit(flickcurl_stats_engine* se);
+
+
+/* Day number counted from 1970-01-01 of a civil date */
+int
+flickcurl_stats_days_from_civil(int y, int m, int d)
+{
+  int era;
+  int yoe;
+  int doy;
+  int doe;
+
+  y -= (m <= 2);
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+
+/* Format day number @day as YYYY-MM-DD into @buffer of 11 chars */
+void
+flickcurl_stats_format_day(int day, char* buffer)
+{
+  int z = day + 719468;
+  int era = (z >= 0 ? z : z - 146096) / 146097;
+  int doe = z - era * 146097;
+  int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int mp = (5 * doy + 2) / 153;
+  int d = doy - (153 * mp + 2) / 5 + 1;
+  int m = mp + (mp < 10 ? 3 : -9);
+  int y = yoe + era * 400 + (m <= 2);
+
+  sprintf(buffer, "%04d-%02d-%02d", y, m, d);
+}
+
+
+/* Day number of a YYYY-MM-DD date or < 0 if it is not one */
+int
+flickcurl_stats_parse_day(const char* date)
+{
+  int y, m, d;
+  int day;
+  char buffer[11];
+  char end;
+
+  if(sscanf(date, "%4d-%2d-%2d%c", &y, &m, &d, &end) != 3)
+    return -1;
+  if(y < 1970 || m < 1 || m > 12 || d < 1 || d > 31)
+    return -1;
+
+  /* a day past the end of its month such as 2024-02-31 or a date not
+   * written in full comes back different */
+  day = flickcurl_stats_days_from_civil(y, m, d);
+  flickcurl_stats_format_day(day, buffer);
+  if(strcmp(buffer, date))
+    return -1;
+
+  return day;
+}
+
+
+/* Add @task to the end of @queue; return non-0 on failure */
+int
+flickcurl_stats_queue_add(flickcurl_stats_queue* queue,
+                          flickcurl_stats_task* task)
+{
+  if(queue->tail == queue->size) {
+    if(queue->head > 0) {
+      /* reuse the space of tasks already taken */
+      memmove(queue->tasks, queue->tasks + queue->head,
+              (queue->tail - queue->head) * sizeof(*task));
+      queue->tail -= queue->head;
+      queue->head = 0;
+    }
+
+    if(queue->tail == queue->size) {
+      int size = queue->size ? queue->size * 2 : 64;
+      flickcurl_stats_task* tasks;
+
+      tasks = (flickcurl_stats_task*)realloc(queue->tasks,
+                                             size * sizeof(*task));
+      if(!tasks)
+        return 1;
+      queue->tasks = tasks;
+      queue->size = size;
+    }
+  }
+
+  memcpy(&queue->tasks[queue->tail++], task, sizeof(*task));
+  return 0;
+}
+
+
+/* Take the first task of @queue into @task; return non-0 if empty */
+int
+flickcurl_stats_queue_take(flickcurl_stats_queue* queue,
+                           flickcurl_stats_task* task)
+{
+  if(queue->head == queue->tail)
+    return 1;
+
+  memcpy(task, &queue->tasks[queue->head++], sizeof(*task));
+  if(queue->head == queue->tail)
+    queue->head = queue->tail = 0;
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_stats_engine_params_init:
+ * @params: stats engine params to init
+ *
+ * Initialise an existing stats engine parameter structure
+ *
+ * The defaults are a 28 day window, 8 calls at once, 100 items per
+ * page and only the photo stats fetched.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_stats_engine_params_init(flickcurl_stats_engine_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(*params));
+  params->version = 1;
+  params->days = FLICKCURL_STATS_MAX_DAYS;
+  params->concurrency = 8;
+  params->per_page = FLICKCURL_STATS_MAX_PER_PAGE;
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_new_stats_engine:
+ * @fc: flickcurl object
+ * @params: engine parameters or NULL for the defaults
+ *
+ * Constructor - create a photo stats engine
+ *
+ * The engine fetches the flickr.stats calls for its photos on every
+ * day of a window of @params days with asynchronous calls, so
+ * flickcurl_set_async_handlers() must have been called on @fc.  Add
+ * photos with flickcurl_stats_engine_add_photo() or set
+ * @params popular to find them, then call
+ * flickcurl_stats_engine_refresh() and run the event loop until
+ * flickcurl_stats_engine_get_pending() returns 0.
+ *
+ * The engine must be freed before @fc.
+ *
+ * Return value: new engine or NULL on failure
+ */
+flickcurl_stats_engine*
+flickcurl_new_stats_engine(flickcurl* fc,
+                           flickcurl_stats_engine_params* params)
+{
+  flickcurl_stats_engine* se;
+  flickcurl_stats_engine_params defaults;
+  int i;
+
+  if(!params) {
+    flickcurl_stats_engine_params_init(&defaults);
+    params = &defaults;
+  }
+
+  if(params->version != 1 || params->days < 1 ||
+     params->days > FLICKCURL_STATS_MAX_DAYS || params->concurrency < 1 ||
+     params->per_page < 1 ||
+     params->per_page > FLICKCURL_STATS_MAX_PER_PAGE) {
+    flickcurl_error(fc, "Bad stats engine parameters");
+    return NULL;
+  }
+
+  se = (flickcurl_stats_engine*)calloc(1, sizeof(*se));
+  if(!se)
+    goto oom;
+
+  se->fc = fc;
+  memcpy(&se->params, params, sizeof(*params));
+  /* referrers are found through the domains */
+  if(se->params.referrers)
+    se->params.domains = 1;
+  se->end_day = -1;
+
+  se->dates = (char (*)[11])calloc(params->days, sizeof(*se->dates));
+  se->popular_days = (int*)malloc(params->days * sizeof(int));
+  se->popular_states = (unsigned char*)calloc(params->days, 1);
+  if(!se->dates || !se->popular_days || !se->popular_states)
+    goto oom;
+  for(i = 0; i < params->days; i++)
+    se->popular_days[i] = -1;
+
+  return se;
+
+  oom:
+  flickcurl_error(fc, "Out of memory");
+  if(se)
+    flickcurl_free_stats_engine(se);
+  return NULL;
+}
+
+
+/* Forget the values held for cell @cell */
+static void
+flickcurl_stats_engine_clear_cell(flickcurl_stats_engine* se, int cell)
+{
+  se->views[cell] = 0;
+  se->comments[cell] = 0;
+  se->favorites[cell] = 0;
+  if(se->domains && se->domains[cell]) {
+    flickcurl_free_stats(se->domains[cell]);
+    se->domains[cell] = NULL;
+  }
+  if(se->referrers && se->referrers[cell]) {
+    flickcurl_free_stats(se->referrers[cell]);
+    se->referrers[cell] = NULL;
+  }
+}
+
+
+/* Want cell @cell for day @day unless it is held or being fetched */
+static int
+flickcurl_stats_engine_want_cell(flickcurl_stats_engine* se, int cell,
+                                 int day)
+{
+  flickcurl_stats_task task;
+
+  if(se->cell_days[cell] != day) {
+    flickcurl_stats_engine_clear_cell(se, cell);
+    se->cell_days[cell] = day;
+    /* a queued cell fetches its new day when taken from the queue */
+    if(se->cell_states[cell] == FLICKCURL_STATS_CELL_WANTED)
+      return 0;
+    se->cell_states[cell] = FLICKCURL_STATS_CELL_EMPTY;
+  }
+
+  if(se->cell_states[cell] != FLICKCURL_STATS_CELL_EMPTY)
+    return 0;
+
+  task.type = FLICKCURL_STATS_TASK_STATS;
+  task.target = cell;
+  task.domain = 0;
+  task.page = 0;
+  if(flickcurl_stats_queue_add(&se->wanted, &task)) {
+    flickcurl_error(se->fc, "Out of memory");
+    return 1;
+  }
+  se->cell_states[cell] = FLICKCURL_STATS_CELL_WANTED;
+  se->pending++;
+
+  return 0;
+}
+
+
+/* Want the popular photos of day @day for ring slot @slot */
+static int
+flickcurl_stats_engine_want_popular(flickcurl_stats_engine* se, int slot,
+                                    int day)
+{
+  flickcurl_stats_task task;
+
+  if(se->popular_days[slot] != day) {
+    se->popular_days[slot] = day;
+    if(se->popular_states[slot] == FLICKCURL_STATS_CELL_WANTED)
+      return 0;
+    se->popular_states[slot] = FLICKCURL_STATS_CELL_EMPTY;
+  }
+
+  if(se->popular_states[slot] != FLICKCURL_STATS_CELL_EMPTY)
+    return 0;
+
+  task.type = FLICKCURL_STATS_TASK_POPULAR;
+  task.target = slot;
+  task.domain = 0;
+  task.page = 1;
+  if(flickcurl_stats_queue_add(&se->wanted, &task)) {
+    flickcurl_error(se->fc, "Out of memory");
+    return 1;
+  }
+  se->popular_states[slot] = FLICKCURL_STATS_CELL_WANTED;
+  se->pending++;
+
+  return 0;
+}
+
+
+/* Grow the photo tables to hold at least @size photos */
+static int
+flickcurl_stats_engine_grow(flickcurl_stats_engine* se, int size)
+{
+  int days = se->params.days;
+  size_t old_cells = (size_t)se->photos_size * days;
+  size_t cells = (size_t)size * days;
+  size_t i;
+  void* p;
+
+#define FLICKCURL_STATS_GROW(field, type, count)                       \
+  p = realloc(se->field, (count) * sizeof(type));                      \
+  if(!p)                                                               \
+    return 1;                                                          \
+  se->field = (type*)p;
+
+  FLICKCURL_STATS_GROW(photo_ids, char*, size)
+  FLICKCURL_STATS_GROW(photo_order, int, size)
+  FLICKCURL_STATS_GROW(cell_days, int, cells)
+  FLICKCURL_STATS_GROW(cell_states, unsigned char, cells)
+  FLICKCURL_STATS_GROW(cell_calls, int, cells)
+  FLICKCURL_STATS_GROW(views, int, cells)
+  FLICKCURL_STATS_GROW(comments, int, cells)
+  FLICKCURL_STATS_GROW(favorites, int, cells)
+  if(se->params.domains) {
+    FLICKCURL_STATS_GROW(domains, flickcurl_stat**, cells)
+  }
+  if(se->params.referrers) {
+    FLICKCURL_STATS_GROW(referrers, flickcurl_stat**, cells)
+  }
+#undef FLICKCURL_STATS_GROW
+
+  for(i = old_cells; i < cells; i++) {
+    se->cell_days[i] = -1;
+    se->cell_states[i] = FLICKCURL_STATS_CELL_EMPTY;
+    se->cell_calls[i] = 0;
+    se->views[i] = 0;
+    se->comments[i] = 0;
+    se->favorites[i] = 0;
+    if(se->domains)
+      se->domains[i] = NULL;
+    if(se->referrers)
+      se->referrers[i] = NULL;
+  }
+
+  se->photos_size = size;
+  return 0;
+}
+
+
+/* Find the position of @photo_id in the photo order; set *@found_p */
+static int
+flickcurl_stats_engine_find_photo(flickcurl_stats_engine* se,
+                                  const char* photo_id, int* found_p)
+{
+  int lo = 0;
+  int hi = se->photos_count;
+
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    int c = strcmp(se->photo_ids[se->photo_order[mid]], photo_id);
+
+    if(!c) {
+      *found_p = 1;
+      return mid;
+    }
+    if(c < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  *found_p = 0;
+  return lo;
+}
+
+
+/**
+ * flickcurl_stats_engine_add_photo:
+ * @se: stats engine
+ * @photo_id: photo ID
+ *
+ * Add a photo to a stats engine
+ *
+ * If the engine has been refreshed, the stats of the photo for each
+ * day in the window are fetched at once.  Adding a photo the engine
+ * already has returns its index.
+ *
+ * Return value: photo index or < 0 on failure
+ */
+int
+flickcurl_stats_engine_add_photo(flickcurl_stats_engine* se,
+                                 const char* photo_id)
+{
+  int days = se->params.days;
+  int photo;
+  int pos;
+  int found;
+  size_t len;
+  char* id;
+  int i;
+
+  if(!photo_id)
+    return -1;
+
+  pos = flickcurl_stats_engine_find_photo(se, photo_id, &found);
+  if(found)
+    return se->photo_order[pos];
+
+  if(se->photos_count == se->photos_size &&
+     flickcurl_stats_engine_grow(se, se->photos_size ?
+                                 se->photos_size * 2 : 16)) {
+    flickcurl_error(se->fc, "Out of memory");
+    return -1;
+  }
+
+  len = strlen(photo_id);
+  id = (char*)malloc(len + 1);
+  if(!id) {
+    flickcurl_error(se->fc, "Out of memory");
+    return -1;
+  }
+  memcpy(id, photo_id, len + 1);
+
+  photo = se->photos_count++;
+  se->photo_ids[photo] = id;
+  memmove(se->photo_order + pos + 1, se->photo_order + pos,
+          (photo - pos) * sizeof(int));
+  se->photo_order[pos] = photo;
+
+  if(se->end_day >= 0) {
+    for(i = 0; i < days; i++) {
+      int day = se->end_day - i;
+
+      if(flickcurl_stats_engine_want_cell(se, photo * days + day % days,
+                                          day))
+        break;
+    }
+    flickcurl_stats_engine_submit(se);
+  }
+
+  return photo;
+}
+
+
+/* Queue @task following from a result of a running photo-day or popular day */
+static int
+flickcurl_stats_engine_follow(flickcurl_stats_engine* se,
+                              flickcurl_stats_task_type type, int target,
+                              int domain, int page)
+{
+  flickcurl_stats_task task;
+
+  task.type = type;
+  task.target = target;
+  task.domain = domain;
+  task.page = page;
+  if(flickcurl_stats_queue_add(&se->follow_ups, &task)) {
+    flickcurl_error(se->fc, "Out of memory");
+    return 1;
+  }
+
+  if(type != FLICKCURL_STATS_TASK_POPULAR)
+    se->cell_calls[target]++;
+
+  return 0;
+}
+
+
+/*
+ * End one call of running photo-day @cell, well if @ok; the photo-day
+ * is held when its last call ends if they all ended well.
+ */
+static void
+flickcurl_stats_engine_end_cell_call(flickcurl_stats_engine* se, int cell,
+                                     int ok)
+{
+  if(!ok)
+    se->cell_states[cell] = FLICKCURL_STATS_CELL_FAILING;
+
+  if(--se->cell_calls[cell] > 0)
+    return;
+
+  if(se->cell_states[cell] == FLICKCURL_STATS_CELL_FAILING) {
+    flickcurl_stats_engine_clear_cell(se, cell);
+    se->cell_states[cell] = FLICKCURL_STATS_CELL_EMPTY;
+  } else
+    se->cell_states[cell] = FLICKCURL_STATS_CELL_DONE;
+  se->pending--;
+}
+
+
+/* Append NULL terminated @page to the NULL terminated array at *@stats_p */
+static int
+flickcurl_stats_engine_append(flickcurl_stat*** stats_p,
+                              flickcurl_stat** page)
+{
+  flickcurl_stat** stats;
+  int count = 0;
+  int page_count;
+
+  if(*stats_p) {
+    while((*stats_p)[count])
+      count++;
+  }
+  for(page_count = 0; page[page_count]; page_count++)
+    ;
+
+  stats = (flickcurl_stat**)realloc(*stats_p, (count + page_count + 1) *
+                                    sizeof(flickcurl_stat*));
+  if(!stats)
+    return 1;
+
+  memcpy(stats + count, page, (page_count + 1) * sizeof(flickcurl_stat*));
+  *stats_p = stats;
+  free(page);
+
+  return 0;
+}
+
+
+/* Asynchronous call builder making the request of the work in @builder_data */
+static void*
+flickcurl_stats_engine_build(flickcurl* fc, void* builder_data)
+{
+  flickcurl_stats_work* w = (flickcurl_stats_work*)builder_data;
+  flickcurl_stats_engine* se = w->engine;
+  flickcurl_stats_task* task = &w->task;
+  int per_page = se->params.per_page;
+  const char* photo_id = NULL;
+  flickcurl_stat** stats;
+  const char* domain;
+  int i;
+
+  if(task->type != FLICKCURL_STATS_TASK_POPULAR)
+    photo_id = se->photo_ids[task->target / se->params.days];
+
+  switch(task->type) {
+    case FLICKCURL_STATS_TASK_STATS:
+      return flickcurl_stats_getPhotoStats(fc, w->date, photo_id);
+
+    case FLICKCURL_STATS_TASK_DOMAINS:
+      return flickcurl_stats_getPhotoDomains(fc, w->date, photo_id,
+                                             per_page, task->page);
+
+    case FLICKCURL_STATS_TASK_REFERRERS:
+      domain = se->domains[task->target][task->domain]->name;
+      stats = flickcurl_stats_getPhotoReferrers(fc, w->date, domain, photo_id,
+                                                per_page, task->page);
+      /* the referrers of all domains are kept together */
+      for(i = 0; stats && stats[i]; i++) {
+        if(!stats[i]->name) {
+          size_t len = strlen(domain);
+
+          stats[i]->name = (char*)malloc(len + 1);
+          if(stats[i]->name)
+            memcpy(stats[i]->name, domain, len + 1);
+        }
+      }
+      return stats;
+
+    case FLICKCURL_STATS_TASK_POPULAR:
+      return flickcurl_stats_getPopularPhotos(fc, w->date, "views", per_page,
+                                              task->page, NULL);
+  }
+
+  return NULL;
+}
+
+
+/* Store the result of a photo-day call and queue the calls following it */
+static int
+flickcurl_stats_engine_store(flickcurl_stats_engine* se,
+                             flickcurl_stats_task* task, void* result)
+{
+  int cell = task->target;
+  flickcurl_stat* stat;
+  flickcurl_stat** stats;
+  int first;
+  int count;
+  int i;
+
+  switch(task->type) {
+    case FLICKCURL_STATS_TASK_STATS:
+      stat = (flickcurl_stat*)result;
+      se->views[cell] = stat->views;
+      se->comments[cell] = stat->comments;
+      se->favorites[cell] = stat->favorites;
+      flickcurl_free_stat(stat);
+      return 0;
+
+    case FLICKCURL_STATS_TASK_DOMAINS:
+      stats = (flickcurl_stat**)result;
+      for(count = 0; stats[count]; count++)
+        ;
+
+      first = 0;
+      if(se->domains[cell]) {
+        while(se->domains[cell][first])
+          first++;
+      }
+      if(flickcurl_stats_engine_append(&se->domains[cell], stats)) {
+        flickcurl_free_stats(stats);
+        return 1;
+      }
+
+      /* a full page may have another after it */
+      if(count == se->params.per_page &&
+         flickcurl_stats_engine_follow(se, FLICKCURL_STATS_TASK_DOMAINS,
+                                       cell, 0, task->page + 1))
+        return 1;
+
+      if(se->params.referrers) {
+        if(!se->referrers[cell]) {
+          se->referrers[cell] = (flickcurl_stat**)calloc(1, sizeof(*stats));
+          if(!se->referrers[cell])
+            return 1;
+        }
+        for(i = first; i < first + count; i++) {
+          if(se->domains[cell][i]->name &&
+             flickcurl_stats_engine_follow(se,
+                                           FLICKCURL_STATS_TASK_REFERRERS,
+                                           cell, i, 1))
+            return 1;
+        }
+      }
+      return 0;
+
+    case FLICKCURL_STATS_TASK_REFERRERS:
+      stats = (flickcurl_stat**)result;
+      for(count = 0; stats[count]; count++)
+        ;
+
+      if(flickcurl_stats_engine_append(&se->referrers[cell], stats)) {
+        flickcurl_free_stats(stats);
+        return 1;
+      }
+
+      if(count == se->params.per_page &&
+         flickcurl_stats_engine_follow(se, FLICKCURL_STATS_TASK_REFERRERS,
+                                       cell, task->domain, task->page + 1))
+        return 1;
+      return 0;
+
+    case FLICKCURL_STATS_TASK_POPULAR:
+      break;
+  }
+
+  return 1;
+}
+
+
+/* Add the photos of a popular photos page and queue the next page */
+static int
+flickcurl_stats_engine_store_popular(flickcurl_stats_engine* se,
+                                     flickcurl_stats_task* task,
+                                     flickcurl_photo** photos)
+{
+  int rc = 0;
+  int i;
+
+  for(i = 0; photos[i]; i++) {
+    if(flickcurl_stats_engine_add_photo(se, photos[i]->id) < 0)
+      rc = 1;
+  }
+
+  if(!rc && i == se->params.per_page) {
+    rc = flickcurl_stats_engine_follow(se, FLICKCURL_STATS_TASK_POPULAR,
+                                       task->target, 0, task->page + 1);
+    if(!rc) {
+      flickcurl_free_photos(photos);
+      return -1;
+    }
+  }
+
+  flickcurl_free_photos(photos);
+  return rc;
+}
+
+
+/* Asynchronous call handler storing the result of a call */
+static void
+flickcurl_stats_engine_handler(void* user_data, flickcurl_async_call* call,
+                               void* result)
+{
+  flickcurl_stats_work* w = (flickcurl_stats_work*)user_data;
+  flickcurl_stats_engine* se = w->engine;
+  flickcurl_stats_task* task = &w->task;
+  int failed = !result;
+
+  if(w->prev)
+    w->prev->next = w->next;
+  else
+    se->works = w->next;
+  if(w->next)
+    w->next->prev = w->prev;
+  se->works_count--;
+
+  if(task->type == FLICKCURL_STATS_TASK_POPULAR) {
+    int slot = task->target;
+    int rc = 1;
+
+    if(result)
+      rc = flickcurl_stats_engine_store_popular(se, task,
+                                                (flickcurl_photo**)result);
+    /* < 0 when the next page has been queued */
+    if(rc >= 0) {
+      se->popular_states[slot] = rc ? FLICKCURL_STATS_CELL_EMPTY :
+                                      FLICKCURL_STATS_CELL_DONE;
+      se->pending--;
+    }
+    failed = (rc > 0);
+  } else {
+    int cell = task->target;
+
+    if(result) {
+      if(se->cell_states[cell] == FLICKCURL_STATS_CELL_FAILING) {
+        /* not wanted now another call of the photo-day has failed */
+        if(task->type == FLICKCURL_STATS_TASK_STATS)
+          flickcurl_free_stat((flickcurl_stat*)result);
+        else
+          flickcurl_free_stats((flickcurl_stat**)result);
+      } else
+        failed = flickcurl_stats_engine_store(se, task, result);
+    }
+
+    /* count each photo-day failure once */
+    if(failed && se->cell_states[cell] == FLICKCURL_STATS_CELL_FAILING)
+      failed = 0;
+    flickcurl_stats_engine_end_cell_call(se, cell, !failed);
+  }
+
+  if(failed && !w->cancelled)
+    se->failed++;
+
+  free(w);
+
+  flickcurl_stats_engine_submit(se);
+}
+
+
+/* Take the next task to start, marking it running; return non-0 if none */
+static int
+flickcurl_stats_engine_next_task(flickcurl_stats_engine* se,
+                                 flickcurl_stats_task* task)
+{
+  if(!flickcurl_stats_queue_take(&se->follow_ups, task))
+    return 0;
+
+  if(flickcurl_stats_queue_take(&se->wanted, task))
+    return 1;
+
+  if(task->type == FLICKCURL_STATS_TASK_POPULAR) {
+    se->popular_states[task->target] = FLICKCURL_STATS_CELL_RUNNING;
+    return 0;
+  }
+
+  se->cell_states[task->target] = FLICKCURL_STATS_CELL_RUNNING;
+  se->cell_calls[task->target] = 1;
+  /* the first domains page is fetched alongside the stats */
+  if(se->params.domains &&
+     flickcurl_stats_engine_follow(se, FLICKCURL_STATS_TASK_DOMAINS,
+                                   task->target, 0, 1))
+    se->cell_states[task->target] = FLICKCURL_STATS_CELL_FAILING;
+
+  return 0;
+}
+
+
+/* Submit queued tasks up to the concurrency limit */
+static void
+flickcurl_stats_engine_submit(flickcurl_stats_engine* se)
+{
+  /* handlers of calls that end at once come back here */
+  if(se->submitting)
+    return;
+  se->submitting = 1;
+
+  while(se->works_count < se->params.concurrency) {
+    flickcurl_stats_work* w;
+    flickcurl_async_call* call;
+
+    w = (flickcurl_stats_work*)calloc(1, sizeof(*w));
+    if(!w) {
+      flickcurl_error(se->fc, "Out of memory");
+      break;
+    }
+
+    if(flickcurl_stats_engine_next_task(se, &w->task)) {
+      free(w);
+      break;
+    }
+
+    w->engine = se;
+    if(w->task.type == FLICKCURL_STATS_TASK_POPULAR)
+      w->day = se->popular_days[w->task.target];
+    else
+      w->day = se->cell_days[w->task.target];
+    flickcurl_stats_format_day(w->day, w->date);
+
+    w->next = se->works;
+    if(se->works)
+      se->works->prev = w;
+    se->works = w;
+    se->works_count++;
+
+    /* on NULL the handler has been called and @w freed */
+    call = flickcurl_async_submit(se->fc, flickcurl_stats_engine_build, w,
+                                  flickcurl_stats_engine_handler, w);
+    if(call)
+      w->call = call;
+  }
+
+  se->submitting = 0;
+}
+
+
+/* Cancel the calls of tasks for days before @start, all if < 0 */
+static void
+flickcurl_stats_engine_cancel(flickcurl_stats_engine* se, int start)
+{
+  flickcurl_stats_queue* queue = &se->follow_ups;
+  flickcurl_stats_work* w;
+  flickcurl_stats_work* next;
+  int i;
+  int kept = queue->head;
+
+  /* queued follow ups never become calls */
+  for(i = queue->head; i < queue->tail; i++) {
+    flickcurl_stats_task* task = &queue->tasks[i];
+
+    if(task->type == FLICKCURL_STATS_TASK_POPULAR) {
+      if(start >= 0 && se->popular_days[task->target] >= start) {
+        queue->tasks[kept++] = *task;
+        continue;
+      }
+      se->popular_states[task->target] = FLICKCURL_STATS_CELL_EMPTY;
+      se->pending--;
+    } else {
+      if(start >= 0 && se->cell_days[task->target] >= start) {
+        queue->tasks[kept++] = *task;
+        continue;
+      }
+      flickcurl_stats_engine_end_cell_call(se, task->target, 0);
+    }
+  }
+  queue->tail = kept;
+
+  for(w = se->works; w; w = next) {
+    next = w->next;
+    if(start < 0 || w->day < start) {
+      w->cancelled = 1;
+      flickcurl_async_cancel(se->fc, w->call);
+    }
+  }
+}
+
+
+/**
+ * flickcurl_stats_engine_refresh:
+ * @se: stats engine
+ * @date: newest day of the window in YYYY-MM-DD format or NULL for yesterday (UTC)
+ *
+ * Move the window of a stats engine to end on a day and fetch what it lacks
+ *
+ * The window becomes the days up to and including @date.  Days that
+ * leave the window are dropped and their calls cancelled.  Every
+ * photo-day in the window that is not held or being fetched is
+ * queued, newest day first and including ones that failed before,
+ * so refreshing daily fetches just the new day.  With popular photo
+ * finding on, the popular photos of each day not yet searched are
+ * added first.
+ *
+ * The fetches run as the application's event loop handles the
+ * asynchronous calls.  Calling this again with the same @date
+ * retries failed fetches.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_stats_engine_refresh(flickcurl_stats_engine* se, const char* date)
+{
+  flickcurl* fc = se->fc;
+  int days = se->params.days;
+  char yesterday[11];
+  int day;
+  int start;
+  int i;
+  int photo;
+  int rc = 0;
+
+  if(date)
+    day = flickcurl_stats_parse_day(date);
+  else {
+    day = (int)(time(NULL) / (24 * 60 * 60)) - 1;
+    flickcurl_stats_format_day(day, yesterday);
+    date = yesterday;
+  }
+
+  start = day - days + 1;
+  if(day < 0 || start < 0) {
+    flickcurl_error(fc, "Bad stats date '%s'", date);
+    return 1;
+  }
+
+  if(day < se->end_day) {
+    flickcurl_error(fc, "Stats date '%s' is before the last refresh", date);
+    return 1;
+  }
+
+  if(!fc->async.multi) {
+    flickcurl_error(fc, "No asynchronous call handlers set");
+    return 1;
+  }
+
+  se->failed = 0;
+  se->submitting = 1;
+
+  flickcurl_stats_engine_cancel(se, start);
+
+  se->end_day = day;
+
+  for(i = 0; i < days && !rc; i++) {
+    int d = day - i;
+
+    flickcurl_stats_format_day(d, se->dates[d % days]);
+    if(se->params.popular)
+      rc = flickcurl_stats_engine_want_popular(se, d % days, d);
+  }
+
+  for(i = 0; i < days && !rc; i++) {
+    int d = day - i;
+
+    for(photo = 0; photo < se->photos_count && !rc; photo++)
+      rc = flickcurl_stats_engine_want_cell(se, photo * days + d % days, d);
+  }
+
+  se->submitting = 0;
+  flickcurl_stats_engine_submit(se);
+
+  return rc;
+}
+
+
+/**
+ * flickcurl_free_stats_engine:
+ * @se: stats engine
+ *
+ * Destructor - destroy a stats engine, cancelling its calls
+ */
+void
+flickcurl_free_stats_engine(flickcurl_stats_engine* se)
+{
+  size_t cells;
+  size_t i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(se, flickcurl_stats_engine);
+
+  se->submitting = 1;
+  flickcurl_stats_engine_cancel(se, -1);
+
+  cells = (size_t)se->photos_size * se->params.days;
+  for(i = 0; i < cells; i++)
+    flickcurl_stats_engine_clear_cell(se, (int)i);
+
+  for(i = 0; i < (size_t)se->photos_count; i++)
+    free(se->photo_ids[i]);
+
+  if(se->photo_ids)
+    free(se->photo_ids);
+  if(se->photo_order)
+    free(se->photo_order);
+  if(se->dates)
+    free(se->dates);
+  if(se->cell_days)
+    free(se->cell_days);
+  if(se->cell_states)
+    free(se->cell_states);
+  if(se->cell_calls)
+    free(se->cell_calls);
+  if(se->views)
+    free(se->views);
+  if(se->comments)
+    free(se->comments);
+  if(se->favorites)
+    free(se->favorites);
+  if(se->domains)
+    free(se->domains);
+  if(se->referrers)
+    free(se->referrers);
+  if(se->popular_days)
+    free(se->popular_days);
+  if(se->popular_states)
+    free(se->popular_states);
+  if(se->wanted.tasks)
+    free(se->wanted.tasks);
+  if(se->follow_ups.tasks)
+    free(se->follow_ups.tasks);
+
+  free(se);
+}
+
+
+/**
+ * flickcurl_stats_engine_get_pending:
+ * @se: stats engine
+ *
+ * Get the number of fetches a stats engine has still to make
+ *
+ * Return value: number of photo-days and popular photo days wanted or being fetched
+ */
+int
+flickcurl_stats_engine_get_pending(flickcurl_stats_engine* se)
+{
+  return se->pending;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_failed_count:
+ * @se: stats engine
+ *
+ * Get the number of fetches that failed since the last refresh
+ *
+ * Return value: number of failed fetches
+ */
+int
+flickcurl_stats_engine_get_failed_count(flickcurl_stats_engine* se)
+{
+  return se->failed;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_photos_count:
+ * @se: stats engine
+ *
+ * Get the number of photos in a stats engine
+ *
+ * Return value: number of photos
+ */
+int
+flickcurl_stats_engine_get_photos_count(flickcurl_stats_engine* se)
+{
+  return se->photos_count;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_photo_id:
+ * @se: stats engine
+ * @photo: photo index
+ *
+ * Get the ID of a photo in a stats engine
+ *
+ * Return value: shared photo ID or NULL if @photo is out of range
+ */
+const char*
+flickcurl_stats_engine_get_photo_id(flickcurl_stats_engine* se, int photo)
+{
+  if(photo < 0 || photo >= se->photos_count)
+    return NULL;
+
+  return se->photo_ids[photo];
+}
+
+
+/**
+ * flickcurl_stats_engine_get_days_count:
+ * @se: stats engine
+ *
+ * Get the number of days in the window of a stats engine
+ *
+ * Return value: number of days
+ */
+int
+flickcurl_stats_engine_get_days_count(flickcurl_stats_engine* se)
+{
+  return se->params.days;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_date:
+ * @se: stats engine
+ * @day: day index in the window from 0 for the oldest
+ *
+ * Get the date of a day in the window of a stats engine
+ *
+ * Return value: shared date in YYYY-MM-DD format or NULL before a refresh or if @day is out of range
+ */
+const char*
+flickcurl_stats_engine_get_date(flickcurl_stats_engine* se, int day)
+{
+  int days = se->params.days;
+
+  if(se->end_day < 0 || day < 0 || day >= days)
+    return NULL;
+
+  return se->dates[(se->end_day - days + 1 + day) % days];
+}
+
+
+/* Cell of a held photo-day by index or < 0 if it is not held */
+static int
+flickcurl_stats_engine_get_cell(flickcurl_stats_engine* se, int photo,
+                                int day)
+{
+  int days = se->params.days;
+  int d;
+  int cell;
+
+  if(se->end_day < 0 || photo < 0 || photo >= se->photos_count ||
+     day < 0 || day >= days)
+    return -1;
+
+  d = se->end_day - days + 1 + day;
+  cell = photo * days + d % days;
+  if(se->cell_days[cell] != d ||
+     se->cell_states[cell] != FLICKCURL_STATS_CELL_DONE)
+    return -1;
+
+  return cell;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_stat:
+ * @se: stats engine
+ * @photo: photo index
+ * @day: day index in the window from 0 for the oldest
+ * @stat: stat to fill with the views, comments and favorites
+ *
+ * Get the stats of a photo on one day of the window of a stats engine
+ *
+ * Return value: non-0 if the photo-day is not held
+ */
+int
+flickcurl_stats_engine_get_stat(flickcurl_stats_engine* se, int photo,
+                                int day, flickcurl_stat* stat)
+{
+  int cell = flickcurl_stats_engine_get_cell(se, photo, day);
+
+  if(cell < 0)
+    return 1;
+
+  memset(stat, '\0', sizeof(*stat));
+  stat->views = se->views[cell];
+  stat->comments = se->comments[cell];
+  stat->favorites = se->favorites[cell];
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_series:
+ * @se: stats engine
+ * @photo: photo index
+ * @views: array of window days to fill with the views (or NULL)
+ * @comments: array of window days to fill with the comments (or NULL)
+ * @favorites: array of window days to fill with the favorites (or NULL)
+ *
+ * Get the daily stats of a photo over the window of a stats engine
+ *
+ * The arrays are filled oldest day first with 0 for days not held.
+ *
+ * Return value: number of days held or < 0 on failure
+ */
+int
+flickcurl_stats_engine_get_series(flickcurl_stats_engine* se, int photo,
+                                  int* views, int* comments, int* favorites)
+{
+  int days = se->params.days;
+  int held = 0;
+  int day;
+
+  if(photo < 0 || photo >= se->photos_count)
+    return -1;
+
+  for(day = 0; day < days; day++) {
+    int cell = flickcurl_stats_engine_get_cell(se, photo, day);
+
+    if(views)
+      views[day] = cell < 0 ? 0 : se->views[cell];
+    if(comments)
+      comments[day] = cell < 0 ? 0 : se->comments[cell];
+    if(favorites)
+      favorites[day] = cell < 0 ? 0 : se->favorites[cell];
+    if(cell >= 0)
+      held++;
+  }
+
+  return held;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_totals:
+ * @se: stats engine
+ * @photo: photo index or < 0 for all photos
+ * @stat: stat to fill with the total views, comments and favorites
+ *
+ * Get the stats of a photo or all photos summed over the window of a stats engine
+ *
+ * Return value: number of photo-days held and summed
+ */
+int
+flickcurl_stats_engine_get_totals(flickcurl_stats_engine* se, int photo,
+                                  flickcurl_stat* stat)
+{
+  int days = se->params.days;
+  int first = photo < 0 ? 0 : photo;
+  int last = photo < 0 ? se->photos_count : photo + 1;
+  int held = 0;
+  int day;
+
+  memset(stat, '\0', sizeof(*stat));
+
+  for(photo = first; photo < last; photo++) {
+    for(day = 0; day < days; day++) {
+      int cell = flickcurl_stats_engine_get_cell(se, photo, day);
+
+      if(cell < 0)
+        continue;
+      stat->views += se->views[cell];
+      stat->comments += se->comments[cell];
+      stat->favorites += se->favorites[cell];
+      held++;
+    }
+  }
+
+  return held;
+}
+
+
+/**
+ * flickcurl_stats_engine_get_domains:
+ * @se: stats engine
+ * @photo: photo index
+ * @day: day index in the window from 0 for the oldest
+ *
+ * Get the referring domains of a photo on one day of the window of a stats engine
+ *
+ * Every page of the domains is fetched when the engine parameters
+ * ask for domains or referrers.
+ *
+ * Return value: shared array of domain stats or NULL if not held
+ */
+flickcurl_stat**
+flickcurl_stats_engine_get_domains(flickcurl_stats_engine* se, int photo,
+                                   int day)
+{
+  int cell = flickcurl_stats_engine_get_cell(se, photo, day);
+
+  if(cell < 0 || !se->domains)
+    return NULL;
+
+  return se->domains[cell];
+}
+
+
+/**
+ * flickcurl_stats_engine_get_referrers:
+ * @se: stats engine
+ * @photo: photo index
+ * @day: day index in the window from 0 for the oldest
+ *
+ * Get the referrers of a photo on one day of the window of a stats engine
+ *
+ * Every page of the referrers from every referring domain is
+ * fetched when the engine parameters ask for referrers.  The name of
+ * each referrer stat is its domain.
+ *
+ * Return value: shared array of referrer stats or NULL if not held
+ */
+flickcurl_stat**
+flickcurl_stats_engine_get_referrers(flickcurl_stats_engine* se, int photo,
+                                     int day)
+{
+  int cell = flickcurl_stats_engine_get_cell(se, photo, day);
+
+  if(cell < 0 || !se->referrers)
+    return NULL;
+
+  return se->referrers[cell];
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+
+static void
+stats_test_error_handler(void *user_data, const char *message)
+{
+  /* errors are expected by some tests */
+}
+
+
+/* Check the day arithmetic and date parsing */
+static int
+stats_test_days(void)
+{
+  static const char* bad_dates[] = {
+    "2024-02-30", "2024-02-31", "2023-02-29", "2024-04-31", "2024-13-01",
+    "2024-00-10", "2024-01-00", "1969-12-31", "2024-2-05", " 2024-02-05",
+    "2024-02-05x", "+2024-02-05", "2024/02/05", "", NULL
+  };
+  char buffer[11];
+  int failures = 0;
+  int day;
+  int i;
+
+  if(flickcurl_stats_days_from_civil(1970, 1, 1) != 0 ||
+     flickcurl_stats_days_from_civil(2000, 3, 1) != 11017 ||
+     flickcurl_stats_days_from_civil(2024, 2, 29) != 19782) {
+    fprintf(stderr, "%s: FAIL\n  wrong day numbers of civil dates\n",
+            program);
+    failures++;
+  }
+
+  /* every day to 2100-12-31 formats and parses back to itself */
+  for(day = 0; day <= 47846; day++) {
+    flickcurl_stats_format_day(day, buffer);
+    if(flickcurl_stats_parse_day(buffer) != day) {
+      fprintf(stderr, "%s: FAIL\n  day %d formatted as %s parses as %d\n",
+              program, day, buffer, flickcurl_stats_parse_day(buffer));
+      failures++;
+      break;
+    }
+  }
+
+  flickcurl_stats_format_day(19782, buffer);
+  if(strcmp(buffer, "2024-02-29") ||
+     flickcurl_stats_parse_day("2024-03-01") != 19783) {
+    fprintf(stderr, "%s: FAIL\n  leap day is %s\n", program, buffer);
+    failures++;
+  }
+
+  for(i = 0; bad_dates[i]; i++) {
+    if(flickcurl_stats_parse_day(bad_dates[i]) >= 0) {
+      fprintf(stderr, "%s: FAIL\n  bad date '%s' parsed\n", program,
+              bad_dates[i]);
+      failures++;
+    }
+  }
+
+  return failures;
+}
+
+
+/* Check tasks leave a queue in order as it reuses and grows its space */
+static int
+stats_test_queue(void)
+{
+  flickcurl_stats_queue queue;
+  flickcurl_stats_task task;
+  int next_add = 0;
+  int next_take = 0;
+  int failures = 0;
+  int round;
+  int i;
+
+  memset(&queue, '\0', sizeof(queue));
+  memset(&task, '\0', sizeof(task));
+
+  if(!flickcurl_stats_queue_take(&queue, &task)) {
+    fprintf(stderr, "%s: FAIL\n  task taken from an empty queue\n", program);
+    failures++;
+  }
+
+  /* take fewer than are added so both the reuse and the growth run */
+  for(round = 0; round < 10 && !failures; round++) {
+    for(i = 0; i < 50; i++) {
+      task.target = next_add++;
+      if(flickcurl_stats_queue_add(&queue, &task)) {
+        failures++;
+        break;
+      }
+    }
+    for(i = 0; i < 30 && !failures; i++) {
+      if(flickcurl_stats_queue_take(&queue, &task) ||
+         task.target != next_take) {
+        fprintf(stderr, "%s: FAIL\n  task %d taken out of order\n", program,
+                next_take);
+        failures++;
+      }
+      next_take++;
+    }
+  }
+
+  while(!failures && !flickcurl_stats_queue_take(&queue, &task)) {
+    if(task.target != next_take++) {
+      fprintf(stderr, "%s: FAIL\n  task %d taken out of order\n", program,
+              next_take - 1);
+      failures++;
+    }
+  }
+  if(!failures && (next_take != next_add || queue.head || queue.tail)) {
+    fprintf(stderr, "%s: FAIL\n  %d of %d tasks taken\n", program,
+            next_take, next_add);
+    failures++;
+  }
+
+  if(queue.tasks)
+    free(queue.tasks);
+
+  return failures;
+}
+
+
+/*
+ * End the wanted photo-days as their calls would, each with its day
+ * number as the views
+ *
+ * Return value: number of photo-days ended
+ */
+static int
+stats_test_fetch(flickcurl_stats_engine* se)
+{
+  flickcurl_stats_task task;
+  int count = 0;
+
+  while(!flickcurl_stats_queue_take(&se->wanted, &task)) {
+    se->cell_states[task.target] = FLICKCURL_STATS_CELL_DONE;
+    se->views[task.target] = se->cell_days[task.target];
+    se->pending--;
+    count++;
+  }
+
+  return count;
+}
+
+
+#if LIBCURL_VERSION_NUM >= 0x071101
+static void
+stats_test_socket_handler(void* user_data, int fd, int events)
+{
+}
+
+
+static void
+stats_test_timer_handler(void* user_data, long timeout_ms)
+{
+}
+
+
+/* Check the window keeps its held days as it moves over the ring */
+static int
+stats_test_window(flickcurl* fc)
+{
+  flickcurl_stats_engine_params params;
+  flickcurl_stats_engine* se;
+  flickcurl_stat stat;
+  int failures = 0;
+  int photo;
+  int day;
+
+  if(flickcurl_set_async_handlers(fc, stats_test_socket_handler,
+                                  stats_test_timer_handler, NULL)) {
+    fprintf(stderr, "%s: FAIL\n  async handlers could not be set\n",
+            program);
+    return 1;
+  }
+
+  flickcurl_stats_engine_params_init(&params);
+  params.days = 3;
+  se = flickcurl_new_stats_engine(fc, &params);
+  if(!se)
+    return 1;
+
+  /* the calls are all taken so none are made */
+  se->works_count = params.concurrency;
+
+  if(flickcurl_stats_engine_add_photo(se, "20") != 0 ||
+     flickcurl_stats_engine_add_photo(se, "10") != 1 ||
+     flickcurl_stats_engine_add_photo(se, "20") != 0) {
+    fprintf(stderr, "%s: FAIL\n  photos added with wrong indexes\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  if(flickcurl_stats_engine_refresh(se, "2024-02-29") ||
+     flickcurl_stats_engine_get_pending(se) != 6 ||
+     stats_test_fetch(se) != 6 || flickcurl_stats_engine_get_pending(se)) {
+    fprintf(stderr, "%s: FAIL\n  first refresh did not fetch 6 photo-days\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  /* the window moves on two days, over the leap day */
+  if(flickcurl_stats_engine_refresh(se, "2024-03-02") ||
+     flickcurl_stats_engine_get_pending(se) != 4) {
+    fprintf(stderr, "%s: FAIL\n  second refresh did not want 4 photo-days\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  if(strcmp(flickcurl_stats_engine_get_date(se, 0), "2024-02-29") ||
+     strcmp(flickcurl_stats_engine_get_date(se, 1), "2024-03-01") ||
+     strcmp(flickcurl_stats_engine_get_date(se, 2), "2024-03-02") ||
+     flickcurl_stats_engine_get_date(se, 3)) {
+    fprintf(stderr, "%s: FAIL\n  window dates are wrong\n", program);
+    failures++;
+  }
+
+  for(photo = 0; photo < 2; photo++) {
+    /* the day kept from the first window is held as it was */
+    if(flickcurl_stats_engine_get_stat(se, photo, 0, &stat) ||
+       stat.views != 19782) {
+      fprintf(stderr, "%s: FAIL\n  photo %d lost its kept day\n", program,
+              photo);
+      failures++;
+    }
+    for(day = 1; day < 3; day++) {
+      if(!flickcurl_stats_engine_get_stat(se, photo, day, &stat)) {
+        fprintf(stderr, "%s: FAIL\n  photo %d holds new day %d before it"
+                " is fetched\n", program, photo, day);
+        failures++;
+      }
+    }
+  }
+
+  if(stats_test_fetch(se) != 4 ||
+     flickcurl_stats_engine_get_stat(se, 1, 2, &stat) ||
+     stat.views != 19784) {
+    fprintf(stderr, "%s: FAIL\n  new days not held once fetched\n", program);
+    failures++;
+  }
+
+  /* a window cannot move back or end on a day that does not exist */
+  if(!flickcurl_stats_engine_refresh(se, "2024-03-01") ||
+     !flickcurl_stats_engine_refresh(se, "2024-02-31")) {
+    fprintf(stderr, "%s: FAIL\n  bad refresh date accepted\n", program);
+    failures++;
+  }
+
+  tidy:
+  se->works_count = 0;
+  flickcurl_free_stats_engine(se);
+
+  return failures;
+}
+#endif
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl *fc = NULL;
+  int failures = 0;
+
+  program = "flickcurl_statsengine_test";
+
+  flickcurl_init();
+
+  fc = flickcurl_new();
+  if(!fc) {
+    failures++;
+    goto tidy;
+  }
+  flickcurl_set_error_handler(fc, stats_test_error_handler, NULL);
+
+  failures += stats_test_days();
+  failures += stats_test_queue();
+#if LIBCURL_VERSION_NUM >= 0x071101
+  failures += stats_test_window(fc);
+#endif
+
+  tidy:
+  if(fc)
+    flickcurl_free(fc);
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
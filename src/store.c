@@ -0,0 +1,2343 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * store.c - Flickcurl local store of photos, people and photosets
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * The store keeps photos, people and photosets in one file of
+ * records that is only ever appended to.  Putting an object appends
+ * a record that replaces any earlier one of the same type and ID;
+ * removing one appends a record with no object.  The file is
+ * memory-mapped and an object is read by walking the words of its
+ * record as the snapshot cache does, copying strings out.
+ *
+ * Layout, all integers in the byte order of the writer:
+ *
+ *   header     magic, layout version, byte order mark, field counts
+ *   records    8-byte aligned, each:
+ *                length, checksum of the rest of the record, type,
+ *                removed flag, key length, owner length, word count,
+ *                upload, taken and last update times (or -1),
+ *                latitude and longitude in millionths of a degree,
+ *                flags
+ *                words: the object as in the snapshot cache
+ *                heap: key, owner then the string bytes, each NUL
+ *                terminated
+ *
+ * Opening a store reads the record headers once to build in memory
+ * a hash table from type and ID to the newest record, and secondary
+ * indexes on owner (by hash), the three times and latitude.  Each
+ * index is an array of (key, entry) items: a sorted part and newer
+ * items appended unsorted, which are sorted and merged in once they
+ * outnumber an eighth of the sorted part or before a query.  Items
+ * of replaced or removed objects are not looked for but skipped by
+ * a generation count on the entry and dropped when merging.  A query
+ * walks the smallest index range of its conditions, checks the rest
+ * against the record headers in the mapping and only decodes the
+ * objects returned.
+ *
+ * A record that is short or fails its checksum ends the file; the
+ * writer cuts it off when opening, so a crash during an append loses
+ * only that record.  flickcurl_store_compact() writes the newest
+ * records to a new file and renames it over the old one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define FLICKCURL_STORE_MMAP 1
+#endif
+
+#if defined(HAVE_SYS_FILE_H) && defined(HAVE_FLOCK)
+#include <sys/file.h>
+#define FLICKCURL_STORE_FLOCK 1
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define FLICKCURL_STORE_MAGIC "FCSTORE\n"
+/* Bump when the header, record or any object word sequence changes */
+#define FLICKCURL_STORE_VERSION 1
+#define FLICKCURL_STORE_BYTE_ORDER 0x01020304
+/* Object field counts the records were written with */
+#define FLICKCURL_STORE_FIELDS ((PHOTO_FIELD_LAST << 16) | \
+                                (PERSON_FIELD_LAST << 8) | \
+                                FLICKCURL_PLACE_LAST)
+/* Smallest mapping of the file; it is doubled as the file grows */
+#define FLICKCURL_STORE_MIN_MAP_SIZE 1048576
+/* Fewest unsorted index items worth merging before a query needs them */
+#define FLICKCURL_STORE_MIN_UNSORTED 64
+#define FLICKCURL_STORE_FNV_BASIS 2166136261U
+
+/* Record flags */
+#define FLICKCURL_STORE_GEO 1
+#define FLICKCURL_STORE_VIDEO 2
+
+
+#ifndef STANDALONE
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t fields;
+  uint32_t reserved;
+} flickcurl_store_header;
+
+
+typedef struct {
+  uint32_t length;
+  /* FNV-1a of the record after this field */
+  uint32_t checksum;
+  uint16_t type;
+  uint16_t removed;
+  uint32_t key_length;
+  uint32_t owner_length;
+  uint32_t words_count;
+  /* unix times or -1 */
+  int64_t dateuploaded;
+  int64_t datetaken;
+  int64_t lastupdate;
+  /* millionths of a degree if FLICKCURL_STORE_GEO is set */
+  int32_t latitude;
+  int32_t longitude;
+  uint32_t flags;
+  uint32_t reserved;
+} flickcurl_store_record;
+
+
+/* Object in the store */
+typedef struct {
+  /* offset of its newest record or 0 if the entry is free */
+  size_t offset;
+  /* hash of type and key or, when free, the next free entry + 1 */
+  uint32_t hash;
+  /* bumped on every change so index items made before are skipped */
+  uint32_t generation;
+} flickcurl_store_entry;
+
+
+/* Secondary indexes */
+typedef enum {
+  FLICKCURL_STORE_BY_OWNER,
+  FLICKCURL_STORE_BY_UPLOADED,
+  FLICKCURL_STORE_BY_TAKEN,
+  FLICKCURL_STORE_BY_LASTUPDATE,
+  FLICKCURL_STORE_BY_LATITUDE,
+  FLICKCURL_STORE_BY_LAST = FLICKCURL_STORE_BY_LATITUDE
+} flickcurl_store_by;
+
+
+typedef struct {
+  int64_t key;
+  uint32_t entry;
+  uint32_t generation;
+} flickcurl_store_item;
+
+
+typedef struct {
+  flickcurl_store_item* items;
+  /* items before this are sorted by key then entry */
+  int sorted_count;
+  int count;
+  int size;
+} flickcurl_store_index;
+
+
+/* Conditions on the objects of one type to find */
+typedef struct {
+  flickcurl_snapshot_type type;
+  /* owner NSID or NULL */
+  const char* owner;
+  /* key ranges of the indexes with used[] set */
+  int used[FLICKCURL_STORE_BY_LAST + 1];
+  int64_t min[FLICKCURL_STORE_BY_LAST + 1];
+  int64_t max[FLICKCURL_STORE_BY_LAST + 1];
+  /* longitude range; west above east crosses 180 degrees */
+  int has_longitude;
+  int32_t west;
+  int32_t east;
+  /* flags that must be set and must not be set */
+  uint32_t flags;
+  uint32_t not_flags;
+} flickcurl_store_query;
+
+
+/* Entry and its key for sorting results */
+typedef struct {
+  int64_t key;
+  int entry;
+} flickcurl_store_sort_item;
+
+
+struct flickcurl_store_s {
+  char* filename;
+  int read_only;
+  int fd;
+  /* identity of the open file, to notice it being compacted */
+  dev_t dev;
+  ino_t ino;
+
+  /* read-only mapping of the file, which may run past its end */
+  unsigned char* base;
+  size_t map_size;
+  /* end of the records read */
+  size_t end;
+
+  flickcurl_store_entry* entries;
+  int entries_count;
+  int entries_size;
+  /* first free entry + 1 or 0 */
+  int free_entry;
+
+  /* hash table of entry + 1, 0 for an empty slot */
+  int* slots;
+  int slots_count;
+  int live_count;
+
+  /* live objects by type */
+  int counts[FLICKCURL_SNAPSHOT_LAST + 1];
+
+  flickcurl_store_index indexes[FLICKCURL_STORE_BY_LAST + 1];
+};
+
+
+#define STORE_RECORD(store, offset) ((flickcurl_store_record*)((store)->base + (offset)))
+#define STORE_KEY(rec) ((const char*)((rec) + 1) + (rec)->words_count * sizeof(uint32_t))
+#define STORE_OWNER(rec) (STORE_KEY(rec) + (rec)->key_length + 1)
+#define STORE_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+
+static uint32_t
+flickcurl_store_hash(uint32_t hash, const void* data, size_t len)
+{
+  /* FNV-1a */
+  const unsigned char* p = (const unsigned char*)data;
+  size_t i;
+
+  for(i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+
+static uint32_t
+flickcurl_store_key_hash(int type, const char* key, size_t len)
+{
+  return flickcurl_store_hash((FLICKCURL_STORE_FNV_BASIS ^ (uint32_t)type) *
+                              16777619U, key, len);
+}
+
+
+static void
+flickcurl_store_init_header(flickcurl_store_header* header)
+{
+  memset(header, '\0', sizeof(*header));
+  memcpy(header->magic, FLICKCURL_STORE_MAGIC, 8);
+  header->version = FLICKCURL_STORE_VERSION;
+  header->byte_order = FLICKCURL_STORE_BYTE_ORDER;
+  header->fields = FLICKCURL_STORE_FIELDS;
+}
+
+
+/* Map at least @size bytes of the file; return non-0 on failure */
+static int
+flickcurl_store_map(flickcurl_store* store, size_t size)
+{
+#ifdef FLICKCURL_STORE_MMAP
+  size_t map_size = store->map_size;
+  void* base;
+
+  if(size <= map_size)
+    return 0;
+
+  if(!map_size)
+    map_size = FLICKCURL_STORE_MIN_MAP_SIZE;
+  while(map_size < size)
+    map_size <<= 1;
+
+  base = mmap(NULL, map_size, PROT_READ, MAP_SHARED, store->fd, 0);
+  if(base == MAP_FAILED)
+    return 1;
+
+  if(store->base)
+    munmap(store->base, store->map_size);
+  store->base = (unsigned char*)base;
+  store->map_size = map_size;
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/* Find the slot of the entry for @type and @key or the empty slot
+ * where it would go */
+static int*
+flickcurl_store_find_slot(flickcurl_store* store, int type, const char* key,
+                          size_t len, uint32_t hash)
+{
+  int mask = store->slots_count - 1;
+  int i = (int)(hash & (uint32_t)mask);
+
+  while(store->slots[i]) {
+    flickcurl_store_entry* entry = &store->entries[store->slots[i] - 1];
+
+    if(entry->hash == hash) {
+      flickcurl_store_record* rec = STORE_RECORD(store, entry->offset);
+
+      if(rec->type == type && rec->key_length == len &&
+         !memcmp(STORE_KEY(rec), key, len))
+        break;
+    }
+    i = (i + 1) & mask;
+  }
+
+  return &store->slots[i];
+}
+
+
+/* Empty slot @hole, moving later slots of its run back */
+static void
+flickcurl_store_unlink_slot(flickcurl_store* store, int hole)
+{
+  int mask = store->slots_count - 1;
+  int i = hole;
+
+  for(;;) {
+    int home;
+
+    i = (i + 1) & mask;
+    if(!store->slots[i])
+      break;
+
+    /* move the entry back if the hole is between its home and it */
+    home = (int)(store->entries[store->slots[i] - 1].hash & (uint32_t)mask);
+    if(((i - home) & mask) >= ((i - hole) & mask)) {
+      store->slots[hole] = store->slots[i];
+      hole = i;
+    }
+  }
+
+  store->slots[hole] = 0;
+}
+
+
+/* Keep the hash table at most half full; return non-0 on failure */
+static int
+flickcurl_store_grow_slots(flickcurl_store* store)
+{
+  int* slots;
+  int slots_count;
+  int mask;
+  int e;
+
+  if((store->live_count + 1) * 2 <= store->slots_count)
+    return 0;
+
+  slots_count = store->slots_count * 2;
+  slots = (int*)calloc(slots_count, sizeof(int));
+  if(!slots)
+    return 1;
+
+  mask = slots_count - 1;
+  for(e = 0; e < store->entries_count; e++) {
+    int i;
+
+    if(!store->entries[e].offset)
+      continue;
+    i = (int)(store->entries[e].hash & (uint32_t)mask);
+    while(slots[i])
+      i = (i + 1) & mask;
+    slots[i] = e + 1;
+  }
+
+  free(store->slots);
+  store->slots = slots;
+  store->slots_count = slots_count;
+  return 0;
+}
+
+
+/* Return a free entry or <0 on failure */
+static int
+flickcurl_store_new_entry(flickcurl_store* store)
+{
+  int e;
+
+  if(store->free_entry) {
+    e = store->free_entry - 1;
+    store->free_entry = (int)store->entries[e].hash;
+    return e;
+  }
+
+  if(store->entries_count == store->entries_size) {
+    int size = store->entries_size ? store->entries_size * 2 : 1024;
+    flickcurl_store_entry* entries;
+
+    entries = (flickcurl_store_entry*)realloc(store->entries,
+                                              size * sizeof(*entries));
+    if(!entries)
+      return -1;
+    store->entries = entries;
+    store->entries_size = size;
+  }
+
+  e = store->entries_count++;
+  memset(&store->entries[e], '\0', sizeof(store->entries[e]));
+  return e;
+}
+
+
+/* Get the key of @rec in index @by; return 0 if it has none */
+static int
+flickcurl_store_record_key(const flickcurl_store_record* rec,
+                           flickcurl_store_by by, int64_t* key_p)
+{
+  switch(by) {
+    case FLICKCURL_STORE_BY_OWNER:
+      if(!rec->owner_length)
+        return 0;
+      *key_p = (int64_t)flickcurl_store_hash(FLICKCURL_STORE_FNV_BASIS,
+                                             STORE_OWNER(rec),
+                                             rec->owner_length);
+      return 1;
+
+    case FLICKCURL_STORE_BY_UPLOADED:
+      *key_p = rec->dateuploaded;
+      return (rec->dateuploaded >= 0);
+
+    case FLICKCURL_STORE_BY_TAKEN:
+      *key_p = rec->datetaken;
+      return (rec->datetaken >= 0);
+
+    case FLICKCURL_STORE_BY_LASTUPDATE:
+      *key_p = rec->lastupdate;
+      return (rec->lastupdate >= 0);
+
+    case FLICKCURL_STORE_BY_LATITUDE:
+      *key_p = rec->latitude;
+      return (rec->flags & FLICKCURL_STORE_GEO) != 0;
+  }
+
+  return 0;
+}
+
+
+static int
+flickcurl_store_compare_items(const void* a, const void* b)
+{
+  const flickcurl_store_item* ia = (const flickcurl_store_item*)a;
+  const flickcurl_store_item* ib = (const flickcurl_store_item*)b;
+
+  if(ia->key != ib->key)
+    return (ia->key > ib->key) - (ia->key < ib->key);
+  return (ia->entry > ib->entry) - (ia->entry < ib->entry);
+}
+
+
+static int
+flickcurl_store_item_live(flickcurl_store* store,
+                          const flickcurl_store_item* item)
+{
+  const flickcurl_store_entry* entry = &store->entries[item->entry];
+
+  return entry->offset && entry->generation == item->generation;
+}
+
+
+/* Sort the unsorted items of @index into the rest, dropping the
+ * stale ones; return non-0 on failure */
+static int
+flickcurl_store_index_merge(flickcurl_store* store,
+                            flickcurl_store_index* index)
+{
+  flickcurl_store_item* items = index->items;
+  flickcurl_store_item* merged;
+  int i = 0;
+  int j = index->sorted_count;
+  int count = 0;
+
+  if(index->sorted_count == index->count)
+    return 0;
+
+  qsort(items + j, index->count - j, sizeof(*items),
+        flickcurl_store_compare_items);
+
+  merged = (flickcurl_store_item*)malloc(index->size * sizeof(*items));
+  if(!merged)
+    return 1;
+
+  while(i < index->sorted_count || j < index->count) {
+    flickcurl_store_item* item;
+
+    if(j == index->count ||
+       (i < index->sorted_count &&
+        flickcurl_store_compare_items(&items[i], &items[j]) <= 0))
+      item = &items[i++];
+    else
+      item = &items[j++];
+
+    if(flickcurl_store_item_live(store, item))
+      merged[count++] = *item;
+  }
+
+  free(items);
+  index->items = merged;
+  index->sorted_count = count;
+  index->count = count;
+  return 0;
+}
+
+
+static int
+flickcurl_store_index_add(flickcurl_store* store, flickcurl_store_index* index,
+                          int64_t key, int e)
+{
+  flickcurl_store_item* item;
+  int unsorted;
+
+  if(index->count == index->size) {
+    int size = index->size ? index->size * 2 : 1024;
+    flickcurl_store_item* items;
+
+    items = (flickcurl_store_item*)realloc(index->items,
+                                           size * sizeof(*items));
+    if(!items)
+      return 1;
+    index->items = items;
+    index->size = size;
+  }
+
+  item = &index->items[index->count++];
+  item->key = key;
+  item->entry = (uint32_t)e;
+  item->generation = store->entries[e].generation;
+
+  unsorted = index->count - index->sorted_count;
+  if(unsorted > FLICKCURL_STORE_MIN_UNSORTED &&
+     unsorted > index->sorted_count / 8)
+    return flickcurl_store_index_merge(store, index);
+
+  return 0;
+}
+
+
+/* Index of the first sorted item with a key at least @key, or above
+ * it if @after */
+static int
+flickcurl_store_index_bound(flickcurl_store_index* index, int64_t key,
+                            int after)
+{
+  int low = 0;
+  int high = index->sorted_count;
+
+  while(low < high) {
+    int mid = low + (high - low) / 2;
+    int64_t mid_key = index->items[mid].key;
+
+    if(mid_key < key || (after && mid_key == key))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+
+/* Bring the entries and indexes up to date with the record at
+ * @offset; return non-0 on failure */
+static int
+flickcurl_store_apply(flickcurl_store* store, size_t offset)
+{
+  flickcurl_store_record* rec = STORE_RECORD(store, offset);
+  uint32_t hash;
+  int* slot;
+  int e;
+  int by;
+
+  if(flickcurl_store_grow_slots(store))
+    return 1;
+
+  hash = flickcurl_store_key_hash(rec->type, STORE_KEY(rec), rec->key_length);
+  slot = flickcurl_store_find_slot(store, rec->type, STORE_KEY(rec),
+                                   rec->key_length, hash);
+  e = *slot - 1;
+
+  if(rec->removed) {
+    if(e >= 0) {
+      flickcurl_store_entry* entry = &store->entries[e];
+
+      flickcurl_store_unlink_slot(store, (int)(slot - store->slots));
+      entry->offset = 0;
+      entry->generation++;
+      entry->hash = (uint32_t)store->free_entry;
+      store->free_entry = e + 1;
+      store->live_count--;
+      store->counts[rec->type]--;
+    }
+    return 0;
+  }
+
+  if(e < 0) {
+    e = flickcurl_store_new_entry(store);
+    if(e < 0)
+      return 1;
+    *slot = e + 1;
+    store->live_count++;
+    store->counts[rec->type]++;
+  }
+
+  store->entries[e].offset = offset;
+  store->entries[e].hash = hash;
+  store->entries[e].generation++;
+
+  for(by = 0; by <= FLICKCURL_STORE_BY_LAST; by++) {
+    int64_t key;
+
+    if(flickcurl_store_record_key(rec, (flickcurl_store_by)by, &key) &&
+       flickcurl_store_index_add(store, &store->indexes[by], key, e))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* Read the records added to the file since the last scan; return
+ * non-0 on failure */
+static int
+flickcurl_store_scan(flickcurl_store* store)
+{
+  struct stat sb;
+  size_t size;
+
+  if(fstat(store->fd, &sb))
+    return 1;
+  size = (size_t)sb.st_size;
+  if(size <= store->end)
+    return 0;
+  if(flickcurl_store_map(store, size))
+    return 1;
+
+  while(store->end + sizeof(flickcurl_store_record) <= size) {
+    flickcurl_store_record* rec = STORE_RECORD(store, store->end);
+    size_t length = rec->length;
+
+    /* stop at a record still being written or damaged */
+    if(length < sizeof(*rec) || (length & 7) || length > size - store->end ||
+       rec->words_count > length / sizeof(uint32_t) ||
+       rec->key_length > length || rec->owner_length > length ||
+       sizeof(*rec) + rec->words_count * sizeof(uint32_t) +
+       rec->key_length + rec->owner_length + 2 > length ||
+       (rec->type != FLICKCURL_SNAPSHOT_PHOTO &&
+        rec->type != FLICKCURL_SNAPSHOT_PERSON &&
+        rec->type != FLICKCURL_SNAPSHOT_PHOTOSET) ||
+       rec->checksum != flickcurl_store_hash(FLICKCURL_STORE_FNV_BASIS,
+                                             (const char*)rec +
+                                             2 * sizeof(uint32_t),
+                                             length - 2 * sizeof(uint32_t)))
+      break;
+
+    if(flickcurl_store_apply(store, store->end))
+      return 1;
+    store->end += length;
+  }
+
+  return 0;
+}
+
+
+/* Drop the file and everything read from it */
+static void
+flickcurl_store_close(flickcurl_store* store)
+{
+  int by;
+
+#ifdef FLICKCURL_STORE_MMAP
+  if(store->base)
+    munmap(store->base, store->map_size);
+#endif
+  if(store->fd >= 0)
+    close(store->fd);
+  store->fd = -1;
+  store->base = NULL;
+  store->map_size = 0;
+  store->end = 0;
+
+  if(store->entries)
+    free(store->entries);
+  store->entries = NULL;
+  store->entries_count = 0;
+  store->entries_size = 0;
+  store->free_entry = 0;
+
+  if(store->slots)
+    free(store->slots);
+  store->slots = NULL;
+  store->slots_count = 0;
+  store->live_count = 0;
+
+  memset(store->counts, '\0', sizeof(store->counts));
+
+  for(by = 0; by <= FLICKCURL_STORE_BY_LAST; by++) {
+    if(store->indexes[by].items)
+      free(store->indexes[by].items);
+  }
+  memset(store->indexes, '\0', sizeof(store->indexes));
+}
+
+
+/*
+ * Take the writer lock on @fd; return non-0 if another writer has it
+ *
+ * flock() locks belong to the open file rather than the process, so
+ * opening and closing the file again in this process, as a reader
+ * does, neither shares nor releases the lock.  Without it, fcntl()
+ * locks are used which do both.
+ */
+static int
+flickcurl_store_lock(int fd)
+{
+#ifdef FLICKCURL_STORE_FLOCK
+  return flock(fd, LOCK_EX | LOCK_NB);
+#else
+  struct flock lock;
+
+  memset(&lock, '\0', sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  return fcntl(fd, F_SETLK, &lock);
+#endif
+}
+
+
+/*
+ * Open the file and read it, or read it from @fd if it is not < 0
+ * which then belongs to the store; return non-0 on failure
+ */
+static int
+flickcurl_store_open(flickcurl_store* store, int fd)
+{
+#ifdef FLICKCURL_STORE_MMAP
+  flickcurl_store_header header;
+  struct stat sb;
+
+  store->fd = fd;
+  if(fd < 0)
+    store->fd = open(store->filename,
+                     store->read_only ? O_RDONLY : (O_RDWR | O_CREAT), 0600);
+  else if(lseek(fd, 0, SEEK_SET) == (off_t)-1)
+    return 1;
+
+  store->slots_count = 1024;
+  store->slots = (int*)calloc(store->slots_count, sizeof(int));
+  if(!store->slots)
+    return 1;
+
+  if(store->fd < 0 || fstat(store->fd, &sb))
+    return 1;
+
+  /* only one writer: fail if another holds the lock, or if the file
+   * was compacted and replaced before the lock was taken */
+  if(!store->read_only) {
+    struct stat path_sb;
+
+    if(flickcurl_store_lock(store->fd) ||
+       stat(store->filename, &path_sb) ||
+       path_sb.st_dev != sb.st_dev || path_sb.st_ino != sb.st_ino)
+      return 1;
+  }
+  store->dev = sb.st_dev;
+  store->ino = sb.st_ino;
+
+  if(!sb.st_size && !store->read_only) {
+    flickcurl_store_init_header(&header);
+    if(write(store->fd, &header, sizeof(header)) != (ssize_t)sizeof(header))
+      return 1;
+  } else if(read(store->fd, &header, sizeof(header)) !=
+            (ssize_t)sizeof(header) ||
+            memcmp(header.magic, FLICKCURL_STORE_MAGIC, 8) ||
+            header.version != FLICKCURL_STORE_VERSION ||
+            header.byte_order != FLICKCURL_STORE_BYTE_ORDER ||
+            header.fields != FLICKCURL_STORE_FIELDS)
+    return 1;
+
+  store->end = sizeof(header);
+  if(flickcurl_store_scan(store))
+    return 1;
+
+  /* cut off a record left partly written */
+  if(!store->read_only &&
+     (fstat(store->fd, &sb) ||
+      ((size_t)sb.st_size > store->end &&
+       ftruncate(store->fd, (off_t)store->end))))
+    return 1;
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/* Catch up with records added, or the file compacted, by a writer;
+ * return non-0 on failure */
+static int
+flickcurl_store_refresh(flickcurl_store* store)
+{
+  if(store->fd < 0)
+    return 1;
+
+  if(store->read_only) {
+    struct stat sb;
+
+    if(!stat(store->filename, &sb) &&
+       (sb.st_dev != store->dev || sb.st_ino != store->ino)) {
+      flickcurl_store_close(store);
+      if(flickcurl_store_open(store, -1))
+        return 1;
+    }
+  }
+
+  return flickcurl_store_scan(store);
+}
+
+
+/**
+ * flickcurl_new_store:
+ * @filename: file to keep the store in
+ * @read_only: non-0 to only read objects from an existing store
+ *
+ * Create a local store of photos, people and photosets
+ *
+ * Objects are added or replaced by ID with flickcurl_store_put_photo()
+ * and the other put methods and read back with
+ * flickcurl_store_get_photo() and the other get methods, or found by
+ * owner, dates and location with flickcurl_store_search_photos(),
+ * flickcurl_store_get_updated_photos() and
+ * flickcurl_store_get_photosets(), none of which call the web
+ * service.
+ *
+ * The file is memory-mapped for reading and only ever appended to,
+ * so replaced objects use space until flickcurl_store_compact() is
+ * called.  Only one store at a time, in this or any other process,
+ * may be open for writing on a file: the file is locked while it is
+ * open and opening it for writing again fails until the writer frees
+ * the store.  Any number of stores may read it at the same time and
+ * see the changes made by the writer at their next call.  Objects may be private, so the file is only
+ * readable by its owner.  A store may not be used by several threads
+ * at once.
+ *
+ * Return value: new store or NULL on failure, if @filename is not a store of this version or if it is already open for writing
+ */
+flickcurl_store*
+flickcurl_new_store(const char* filename, int read_only)
+{
+  flickcurl_store* store;
+
+  if(!filename)
+    return NULL;
+
+  store = (flickcurl_store*)calloc(1, sizeof(*store));
+  if(!store)
+    return NULL;
+
+  store->fd = -1;
+  store->read_only = read_only;
+  store->filename = (char*)malloc(strlen(filename) + 1);
+  if(!store->filename) {
+    free(store);
+    return NULL;
+  }
+  strcpy(store->filename, filename);
+
+  if(flickcurl_store_open(store, -1)) {
+    flickcurl_free_store(store);
+    return NULL;
+  }
+
+  return store;
+}
+
+
+/**
+ * flickcurl_free_store:
+ * @store: store
+ *
+ * Destructor for a store
+ */
+void
+flickcurl_free_store(flickcurl_store* store)
+{
+  if(!store)
+    return;
+
+  flickcurl_store_close(store);
+  free(store->filename);
+  free(store);
+}
+
+
+/* Append a record with the keys in @rec for @object, or removing the
+ * object if it is NULL; return non-0 on failure */
+static int
+flickcurl_store_append(flickcurl_store* store, flickcurl_store_record* rec,
+                       const char* id, const char* owner, void* object)
+{
+  flickcurl_snapshot_writer w;
+  unsigned char* buffer = NULL;
+  size_t length;
+  size_t written = 0;
+  int rc = 1;
+
+  if(store->read_only || !id || flickcurl_store_refresh(store))
+    return 1;
+
+  if(!owner)
+    owner = "";
+
+  memset(&w, '\0', sizeof(w));
+  /* the key and owner start the heap */
+  flickcurl_snapshot_put_string(&w, id);
+  flickcurl_snapshot_put_string(&w, owner);
+  w.words_count = 0;
+
+  if(object) {
+    switch((flickcurl_snapshot_type)rec->type) {
+      case FLICKCURL_SNAPSHOT_PHOTO:
+        flickcurl_snapshot_put_photo(&w, (flickcurl_photo*)object);
+        break;
+      case FLICKCURL_SNAPSHOT_PERSON:
+        flickcurl_snapshot_put_person(&w, (flickcurl_person*)object);
+        break;
+      case FLICKCURL_SNAPSHOT_PHOTOSET:
+        flickcurl_snapshot_put_photoset(&w, (flickcurl_photoset*)object);
+        break;
+      case FLICKCURL_SNAPSHOT_PLACE:
+        break;
+    }
+  } else
+    rec->removed = 1;
+
+  if(w.failed)
+    goto tidy;
+
+  length = STORE_ALIGN(sizeof(*rec) + w.words_count * sizeof(uint32_t) +
+                       w.heap_len);
+  rec->length = (uint32_t)length;
+  rec->key_length = (uint32_t)strlen(id);
+  rec->owner_length = (uint32_t)strlen(owner);
+  rec->words_count = (uint32_t)w.words_count;
+
+  buffer = (unsigned char*)calloc(1, length);
+  if(!buffer)
+    goto tidy;
+  memcpy(buffer, rec, sizeof(*rec));
+  memcpy(buffer + sizeof(*rec), w.words, w.words_count * sizeof(uint32_t));
+  memcpy(buffer + sizeof(*rec) + w.words_count * sizeof(uint32_t), w.heap,
+         w.heap_len);
+  ((flickcurl_store_record*)buffer)->checksum =
+    flickcurl_store_hash(FLICKCURL_STORE_FNV_BASIS,
+                         buffer + 2 * sizeof(uint32_t),
+                         length - 2 * sizeof(uint32_t));
+
+  if(lseek(store->fd, (off_t)store->end, SEEK_SET) == (off_t)-1)
+    goto tidy;
+  while(written < length) {
+    ssize_t n = write(store->fd, buffer + written, length - written);
+
+    if(n <= 0)
+      break;
+    written += (size_t)n;
+  }
+
+  if(written == length)
+    rc = flickcurl_store_scan(store);
+#ifdef FLICKCURL_STORE_MMAP
+  else if(ftruncate(store->fd, (off_t)store->end)) {
+    /* the partial record fails its checksum when next opened */
+  }
+#endif
+
+  tidy:
+  if(buffer)
+    free(buffer);
+  if(w.words)
+    free(w.words);
+  if(w.heap)
+    free(w.heap);
+
+  return rc;
+}
+
+
+/* Time of date field @field of @photo or -1 */
+static int64_t
+flickcurl_store_photo_time(flickcurl_photo* photo,
+                           flickcurl_photo_field_type field)
+{
+  time_t unix_time = flickcurl_photo_get_time(photo, field);
+
+  if(unix_time < 0) {
+    /* taken dates in the "YYYY-MM-DD HH:MM:SS" form stay strings */
+    const char* value = flickcurl_photo_get_field_string(photo, field);
+
+    if(value)
+      unix_time = flickcurl_photo_columns_decode_date(value);
+  }
+
+  return unix_time < 0 ? -1 : (int64_t)unix_time;
+}
+
+
+static int32_t
+flickcurl_store_microdegrees(double degrees)
+{
+  if(degrees < -180.0)
+    degrees = -180.0;
+  else if(degrees > 180.0)
+    degrees = 180.0;
+
+  degrees *= 1000000.0;
+  return (int32_t)(degrees < 0 ? degrees - 0.5 : degrees + 0.5);
+}
+
+
+/**
+ * flickcurl_store_put_photo:
+ * @store: store
+ * @photo: photo
+ *
+ * Add a photo to a store, replacing any with the same ID
+ *
+ * The owner, upload, taken and last update dates and location used
+ * by flickcurl_store_search_photos() and
+ * flickcurl_store_get_updated_photos() come from the photo fields
+ * PHOTO_FIELD_owner_nsid, PHOTO_FIELD_dateuploaded,
+ * PHOTO_FIELD_dates_taken, PHOTO_FIELD_dates_lastupdate,
+ * PHOTO_FIELD_location_latitude and PHOTO_FIELD_location_longitude,
+ * as returned by flickcurl_photos_getInfo() or by photo lists with
+ * the matching extras.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_put_photo(flickcurl_store* store, flickcurl_photo* photo)
+{
+  flickcurl_store_record rec;
+  const char* latitude;
+  const char* longitude;
+
+  memset(&rec, '\0', sizeof(rec));
+  rec.type = FLICKCURL_SNAPSHOT_PHOTO;
+  rec.dateuploaded = flickcurl_store_photo_time(photo,
+                                                PHOTO_FIELD_dateuploaded);
+  rec.datetaken = flickcurl_store_photo_time(photo, PHOTO_FIELD_dates_taken);
+  rec.lastupdate = flickcurl_store_photo_time(photo,
+                                              PHOTO_FIELD_dates_lastupdate);
+
+  latitude = flickcurl_photo_get_field_string(photo,
+                                              PHOTO_FIELD_location_latitude);
+  longitude = flickcurl_photo_get_field_string(photo,
+                                               PHOTO_FIELD_location_longitude);
+  if(latitude && longitude) {
+    rec.latitude = flickcurl_store_microdegrees(atof(latitude));
+    rec.longitude = flickcurl_store_microdegrees(atof(longitude));
+    /* photos without a location are listed at 0,0 */
+    if(rec.latitude || rec.longitude)
+      rec.flags |= FLICKCURL_STORE_GEO;
+  }
+
+  if(photo->media_type && !strcmp(photo->media_type, "video"))
+    rec.flags |= FLICKCURL_STORE_VIDEO;
+
+  return flickcurl_store_append(store, &rec, photo->id,
+                                flickcurl_photo_get_field_string(photo,
+                                                                 PHOTO_FIELD_owner_nsid),
+                                photo);
+}
+
+
+/**
+ * flickcurl_store_put_person:
+ * @store: store
+ * @person: person
+ *
+ * Add a person to a store, replacing any with the same NSID
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_put_person(flickcurl_store* store, flickcurl_person* person)
+{
+  flickcurl_store_record rec;
+
+  memset(&rec, '\0', sizeof(rec));
+  rec.type = FLICKCURL_SNAPSHOT_PERSON;
+  rec.dateuploaded = rec.datetaken = rec.lastupdate = -1;
+
+  return flickcurl_store_append(store, &rec, person->nsid, NULL, person);
+}
+
+
+/**
+ * flickcurl_store_put_photoset:
+ * @store: store
+ * @photoset: photoset
+ *
+ * Add a photoset to a store, replacing any with the same ID
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_put_photoset(flickcurl_store* store,
+                             flickcurl_photoset* photoset)
+{
+  flickcurl_store_record rec;
+
+  memset(&rec, '\0', sizeof(rec));
+  rec.type = FLICKCURL_SNAPSHOT_PHOTOSET;
+  rec.dateuploaded = rec.datetaken = rec.lastupdate = -1;
+
+  return flickcurl_store_append(store, &rec, photoset->id, photoset->owner,
+                                photoset);
+}
+
+
+/* Remove the object of @type with @id if there is one */
+static int
+flickcurl_store_remove(flickcurl_store* store, flickcurl_snapshot_type type,
+                       const char* id)
+{
+  flickcurl_store_record rec;
+  size_t len;
+
+  if(!id || flickcurl_store_refresh(store))
+    return 1;
+
+  len = strlen(id);
+  if(!*flickcurl_store_find_slot(store, type, id, len,
+                                 flickcurl_store_key_hash(type, id, len)))
+    return 0;
+
+  memset(&rec, '\0', sizeof(rec));
+  rec.type = (uint16_t)type;
+  rec.dateuploaded = rec.datetaken = rec.lastupdate = -1;
+
+  return flickcurl_store_append(store, &rec, id, NULL, NULL);
+}
+
+
+/**
+ * flickcurl_store_remove_photo:
+ * @store: store
+ * @photo_id: photo ID
+ *
+ * Remove a photo from a store
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_remove_photo(flickcurl_store* store, const char* photo_id)
+{
+  return flickcurl_store_remove(store, FLICKCURL_SNAPSHOT_PHOTO, photo_id);
+}
+
+
+/**
+ * flickcurl_store_remove_person:
+ * @store: store
+ * @user_id: user NSID
+ *
+ * Remove a person from a store
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_remove_person(flickcurl_store* store, const char* user_id)
+{
+  return flickcurl_store_remove(store, FLICKCURL_SNAPSHOT_PERSON, user_id);
+}
+
+
+/**
+ * flickcurl_store_remove_photoset:
+ * @store: store
+ * @photoset_id: photoset ID
+ *
+ * Remove a photoset from a store
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_remove_photoset(flickcurl_store* store,
+                                const char* photoset_id)
+{
+  return flickcurl_store_remove(store, FLICKCURL_SNAPSHOT_PHOTOSET,
+                                photoset_id);
+}
+
+
+static void
+flickcurl_store_free_object(int type, void* object)
+{
+  if(!object)
+    return;
+
+  switch((flickcurl_snapshot_type)type) {
+    case FLICKCURL_SNAPSHOT_PHOTO:
+      flickcurl_free_photo((flickcurl_photo*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PERSON:
+      flickcurl_free_person((flickcurl_person*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PHOTOSET:
+      flickcurl_free_photoset((flickcurl_photoset*)object);
+      break;
+    case FLICKCURL_SNAPSHOT_PLACE:
+      break;
+  }
+}
+
+
+/* Return a new object decoded from the record of entry @e or NULL */
+static void*
+flickcurl_store_decode(flickcurl_store* store, int e)
+{
+  flickcurl_store_record* rec = STORE_RECORD(store, store->entries[e].offset);
+  flickcurl_snapshot_reader r;
+  void* object = NULL;
+
+  memset(&r, '\0', sizeof(r));
+  r.words = (const uint32_t*)(rec + 1);
+  r.words_count = (int)rec->words_count;
+  r.heap = (const char*)(r.words + r.words_count);
+  r.heap_len = rec->length - sizeof(*rec) - r.words_count * sizeof(uint32_t);
+
+  switch((flickcurl_snapshot_type)rec->type) {
+    case FLICKCURL_SNAPSHOT_PHOTO:
+      object = flickcurl_snapshot_get_photo(&r);
+      break;
+    case FLICKCURL_SNAPSHOT_PERSON:
+      object = flickcurl_snapshot_get_person(&r);
+      break;
+    case FLICKCURL_SNAPSHOT_PHOTOSET:
+      object = flickcurl_snapshot_get_photoset(&r);
+      break;
+    case FLICKCURL_SNAPSHOT_PLACE:
+      break;
+  }
+
+  if(r.failed) {
+    flickcurl_store_free_object(rec->type, object);
+    object = NULL;
+  }
+
+  return object;
+}
+
+
+/* Return a new copy of the object of @type with @id or NULL */
+static void*
+flickcurl_store_get(flickcurl_store* store, flickcurl_snapshot_type type,
+                    const char* id)
+{
+  size_t len;
+  int* slot;
+
+  if(!id || flickcurl_store_refresh(store))
+    return NULL;
+
+  len = strlen(id);
+  slot = flickcurl_store_find_slot(store, type, id, len,
+                                   flickcurl_store_key_hash(type, id, len));
+  if(!*slot)
+    return NULL;
+
+  return flickcurl_store_decode(store, *slot - 1);
+}
+
+
+/**
+ * flickcurl_store_get_photo:
+ * @store: store
+ * @photo_id: photo ID
+ *
+ * Get a photo from a store
+ *
+ * Return value: new photo or NULL if there is none or on failure
+ */
+flickcurl_photo*
+flickcurl_store_get_photo(flickcurl_store* store, const char* photo_id)
+{
+  return (flickcurl_photo*)flickcurl_store_get(store, FLICKCURL_SNAPSHOT_PHOTO,
+                                               photo_id);
+}
+
+
+/**
+ * flickcurl_store_get_person:
+ * @store: store
+ * @user_id: user NSID
+ *
+ * Get a person from a store
+ *
+ * Return value: new person or NULL if there is none or on failure
+ */
+flickcurl_person*
+flickcurl_store_get_person(flickcurl_store* store, const char* user_id)
+{
+  return (flickcurl_person*)flickcurl_store_get(store,
+                                                FLICKCURL_SNAPSHOT_PERSON,
+                                                user_id);
+}
+
+
+/**
+ * flickcurl_store_get_photoset:
+ * @store: store
+ * @photoset_id: photoset ID
+ *
+ * Get a photoset from a store
+ *
+ * Return value: new photoset or NULL if there is none or on failure
+ */
+flickcurl_photoset*
+flickcurl_store_get_photoset(flickcurl_store* store, const char* photoset_id)
+{
+  return (flickcurl_photoset*)flickcurl_store_get(store,
+                                                  FLICKCURL_SNAPSHOT_PHOTOSET,
+                                                  photoset_id);
+}
+
+
+/**
+ * flickcurl_store_get_counts:
+ * @store: store
+ * @photos_p: pointer to store the number of photos (or NULL)
+ * @people_p: pointer to store the number of people (or NULL)
+ * @photosets_p: pointer to store the number of photosets (or NULL)
+ *
+ * Get the number of objects in a store
+ */
+void
+flickcurl_store_get_counts(flickcurl_store* store, int* photos_p,
+                           int* people_p, int* photosets_p)
+{
+  flickcurl_store_refresh(store);
+
+  if(photos_p)
+    *photos_p = store->counts[FLICKCURL_SNAPSHOT_PHOTO];
+  if(people_p)
+    *people_p = store->counts[FLICKCURL_SNAPSHOT_PERSON];
+  if(photosets_p)
+    *photosets_p = store->counts[FLICKCURL_SNAPSHOT_PHOTOSET];
+}
+
+
+/* Return non-0 if the record at @offset meets the conditions of @q */
+static int
+flickcurl_store_match(flickcurl_store* store, flickcurl_store_query* q,
+                      size_t offset)
+{
+  const flickcurl_store_record* rec = STORE_RECORD(store, offset);
+  int by;
+
+  if(rec->type != q->type ||
+     (rec->flags & q->flags) != q->flags || (rec->flags & q->not_flags))
+    return 0;
+
+  for(by = 0; by <= FLICKCURL_STORE_BY_LAST; by++) {
+    int64_t key;
+
+    if(q->used[by] &&
+       (!flickcurl_store_record_key(rec, (flickcurl_store_by)by, &key) ||
+        key < q->min[by] || key > q->max[by]))
+      return 0;
+  }
+
+  if(q->owner && strcmp(STORE_OWNER(rec), q->owner))
+    return 0;
+
+  if(q->has_longitude) {
+    if(q->west <= q->east) {
+      if(rec->longitude < q->west || rec->longitude > q->east)
+        return 0;
+    } else if(rec->longitude < q->west && rec->longitude > q->east)
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/*
+ * Find the entries meeting the conditions of @q, in the order of the
+ * index used.
+ *
+ * Return value: new array of entries with the count in *@count_p, or NULL on failure
+ */
+static int*
+flickcurl_store_find(flickcurl_store* store, flickcurl_store_query* q,
+                     int* count_p)
+{
+  flickcurl_store_index* index = NULL;
+  int low = 0;
+  int high = 0;
+  int* entries;
+  int count = 0;
+  int by;
+  int i;
+
+  if(flickcurl_store_refresh(store))
+    return NULL;
+
+  if(q->owner) {
+    q->used[FLICKCURL_STORE_BY_OWNER] = 1;
+    q->min[FLICKCURL_STORE_BY_OWNER] =
+      (int64_t)flickcurl_store_hash(FLICKCURL_STORE_FNV_BASIS, q->owner,
+                                    strlen(q->owner));
+    q->max[FLICKCURL_STORE_BY_OWNER] = q->min[FLICKCURL_STORE_BY_OWNER];
+  }
+
+  /* walk the index with the fewest items in range */
+  for(by = 0; by <= FLICKCURL_STORE_BY_LAST; by++) {
+    flickcurl_store_index* by_index = &store->indexes[by];
+    int by_low;
+    int by_high;
+
+    if(!q->used[by])
+      continue;
+
+    if(flickcurl_store_index_merge(store, by_index))
+      return NULL;
+    by_low = flickcurl_store_index_bound(by_index, q->min[by], 0);
+    by_high = flickcurl_store_index_bound(by_index, q->max[by], 1);
+    if(!index || by_high - by_low < high - low) {
+      index = by_index;
+      low = by_low;
+      high = by_high;
+    }
+  }
+
+  entries = (int*)malloc(((index ? high - low : store->entries_count) + 1) *
+                         sizeof(int));
+  if(!entries)
+    return NULL;
+
+  if(index) {
+    for(i = low; i < high; i++) {
+      flickcurl_store_item* item = &index->items[i];
+
+      if(flickcurl_store_item_live(store, item) &&
+         flickcurl_store_match(store, q, store->entries[item->entry].offset))
+        entries[count++] = (int)item->entry;
+    }
+  } else {
+    for(i = 0; i < store->entries_count; i++) {
+      if(store->entries[i].offset &&
+         flickcurl_store_match(store, q, store->entries[i].offset))
+        entries[count++] = i;
+    }
+  }
+
+  *count_p = count;
+  return entries;
+}
+
+
+static int
+flickcurl_store_compare_sort_items(const void* a, const void* b)
+{
+  const flickcurl_store_sort_item* ia = (const flickcurl_store_sort_item*)a;
+  const flickcurl_store_sort_item* ib = (const flickcurl_store_sort_item*)b;
+
+  if(ia->key != ib->key)
+    return (ia->key > ib->key) - (ia->key < ib->key);
+  return ia->entry - ib->entry;
+}
+
+
+/* Sort @entries by their key in index @by; return non-0 on failure */
+static int
+flickcurl_store_sort(flickcurl_store* store, int* entries, int count,
+                     flickcurl_store_by by, int descending)
+{
+  flickcurl_store_sort_item* items;
+  int i;
+
+  items = (flickcurl_store_sort_item*)malloc((count + 1) * sizeof(*items));
+  if(!items)
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    const flickcurl_store_record* rec;
+
+    rec = STORE_RECORD(store, store->entries[entries[i]].offset);
+    if(!flickcurl_store_record_key(rec, by, &items[i].key))
+      items[i].key = -1;
+    if(descending)
+      items[i].key = -items[i].key;
+    items[i].entry = entries[i];
+  }
+
+  qsort(items, count, sizeof(*items), flickcurl_store_compare_sort_items);
+  for(i = 0; i < count; i++)
+    entries[i] = items[i].entry;
+
+  free(items);
+  return 0;
+}
+
+
+/* Decode page @page of @per_page of the objects of @entries into a
+ * new NULL-terminated array or return NULL on failure */
+static void**
+flickcurl_store_page(flickcurl_store* store, int* entries, int count,
+                     int per_page, int page)
+{
+  void** objects;
+  int start;
+  int i;
+
+  if(per_page <= 0)
+    per_page = 100;
+  if(page <= 0)
+    page = 1;
+
+  if(page - 1 > count / per_page)
+    start = count;
+  else
+    start = (page - 1) * per_page;
+  if(count - start > per_page)
+    count = start + per_page;
+  if(start > count)
+    start = count;
+
+  objects = (void**)calloc(count - start + 1, sizeof(void*));
+  if(!objects)
+    return NULL;
+
+  for(i = start; i < count; i++) {
+    objects[i - start] = flickcurl_store_decode(store, entries[i]);
+    if(!objects[i - start]) {
+      int type = STORE_RECORD(store, store->entries[entries[i]].offset)->type;
+
+      while(--i >= start)
+        flickcurl_store_free_object(type, objects[i - start]);
+      free(objects);
+      return NULL;
+    }
+  }
+
+  return objects;
+}
+
+
+/* Decode a "YYYY-MM-DD HH:MM:SS" taken date condition; return <0 on failure */
+static int64_t
+flickcurl_store_taken_date(const char* value)
+{
+  time_t unix_time = flickcurl_photo_columns_decode_date(value);
+
+  return unix_time < 0 ? -1 : (int64_t)unix_time;
+}
+
+
+/**
+ * flickcurl_store_search_photos:
+ * @store: store
+ * @params: #flickcurl_search_params search parameters
+ *
+ * Search the photos in a store as flickcurl_photos_search() does
+ *
+ * The conditions used are @user_id (an NSID), @min_upload_date,
+ * @max_upload_date, @min_taken_date, @max_taken_date, @bbox,
+ * @has_geo and @media, with the results in the order of @sort
+ * (date-posted-asc, date-posted-desc, date-taken-asc or
+ * date-taken-desc; default date-posted-desc) and pages by @per_page
+ * and @page.  Searches with conditions that the store cannot answer,
+ * such as tags or text, fail rather than return too many photos.
+ *
+ * Return value: non-empty array of photos (may be NULL on failure)
+ */
+flickcurl_photo**
+flickcurl_store_search_photos(flickcurl_store* store,
+                              flickcurl_search_params* params)
+{
+  flickcurl_store_query q;
+  flickcurl_store_by sort_by = FLICKCURL_STORE_BY_UPLOADED;
+  int descending = 1;
+  flickcurl_photo** photos;
+  int* entries;
+  int count;
+
+  if(params->tags || params->text || params->license ||
+     params->privacy_filter || params->accuracy || params->safe_search ||
+     params->content_type || params->machine_tags || params->group_id ||
+     params->place_id || params->radius > 0.0 || params->contacts ||
+     params->woe_id || params->geo_context || params->is_commons ||
+     params->in_gallery)
+    return NULL;
+
+  memset(&q, '\0', sizeof(q));
+  q.type = FLICKCURL_SNAPSHOT_PHOTO;
+  q.owner = params->user_id;
+
+  if(params->min_upload_date || params->max_upload_date) {
+    q.used[FLICKCURL_STORE_BY_UPLOADED] = 1;
+    q.min[FLICKCURL_STORE_BY_UPLOADED] = params->min_upload_date;
+    q.max[FLICKCURL_STORE_BY_UPLOADED] = params->max_upload_date ?
+      params->max_upload_date : INT64_MAX;
+  }
+
+  if(params->min_taken_date || params->max_taken_date) {
+    q.used[FLICKCURL_STORE_BY_TAKEN] = 1;
+    q.max[FLICKCURL_STORE_BY_TAKEN] = INT64_MAX;
+    if(params->min_taken_date) {
+      q.min[FLICKCURL_STORE_BY_TAKEN] =
+        flickcurl_store_taken_date(params->min_taken_date);
+      if(q.min[FLICKCURL_STORE_BY_TAKEN] < 0)
+        return NULL;
+    }
+    if(params->max_taken_date) {
+      q.max[FLICKCURL_STORE_BY_TAKEN] =
+        flickcurl_store_taken_date(params->max_taken_date);
+      if(q.max[FLICKCURL_STORE_BY_TAKEN] < 0)
+        return NULL;
+    }
+  }
+
+  if(params->bbox) {
+    double box[4];
+    const char* p = params->bbox;
+    int i;
+
+    /* minimum longitude, minimum latitude, maximum longitude, maximum latitude */
+    for(i = 0; i < 4; i++) {
+      char* end;
+
+      box[i] = strtod(p, &end);
+      if(end == p || (i < 3 && *end != ',') || (i == 3 && *end))
+        return NULL;
+      p = end + 1;
+    }
+
+    q.used[FLICKCURL_STORE_BY_LATITUDE] = 1;
+    q.min[FLICKCURL_STORE_BY_LATITUDE] = flickcurl_store_microdegrees(box[1]);
+    q.max[FLICKCURL_STORE_BY_LATITUDE] = flickcurl_store_microdegrees(box[3]);
+    q.has_longitude = 1;
+    q.west = flickcurl_store_microdegrees(box[0]);
+    q.east = flickcurl_store_microdegrees(box[2]);
+    q.flags |= FLICKCURL_STORE_GEO;
+  }
+
+  if(params->has_geo)
+    q.flags |= FLICKCURL_STORE_GEO;
+
+  if(params->media) {
+    if(!strcmp(params->media, "videos"))
+      q.flags |= FLICKCURL_STORE_VIDEO;
+    else if(!strcmp(params->media, "photos"))
+      q.not_flags |= FLICKCURL_STORE_VIDEO;
+    else if(strcmp(params->media, "all"))
+      return NULL;
+  }
+
+  if(params->sort) {
+    if(!strcmp(params->sort, "date-posted-asc"))
+      descending = 0;
+    else if(!strcmp(params->sort, "date-taken-asc")) {
+      sort_by = FLICKCURL_STORE_BY_TAKEN;
+      descending = 0;
+    } else if(!strcmp(params->sort, "date-taken-desc"))
+      sort_by = FLICKCURL_STORE_BY_TAKEN;
+    else if(strcmp(params->sort, "date-posted-desc"))
+      return NULL;
+  }
+
+  entries = flickcurl_store_find(store, &q, &count);
+  if(!entries)
+    return NULL;
+
+  photos = NULL;
+  if(!flickcurl_store_sort(store, entries, count, sort_by, descending))
+    photos = (flickcurl_photo**)flickcurl_store_page(store, entries, count,
+                                                     params->per_page,
+                                                     params->page);
+  free(entries);
+
+  return photos;
+}
+
+
+/**
+ * flickcurl_store_get_updated_photos:
+ * @store: store
+ * @min_date: earliest last update date as a unix timestamp
+ * @per_page: number of photos to return per page (default 100 if 0)
+ * @page: page of results to return (default 1 if 0)
+ *
+ * Get the photos in a store last updated at or after a date
+ *
+ * As flickcurl_photos_recentlyUpdated() but the photos are in order
+ * of last update, earliest first, so that a mirror can carry on from
+ * the last photo it saw.
+ *
+ * Return value: non-empty array of photos (may be NULL on failure)
+ */
+flickcurl_photo**
+flickcurl_store_get_updated_photos(flickcurl_store* store, int min_date,
+                                   int per_page, int page)
+{
+  flickcurl_store_query q;
+  flickcurl_photo** photos;
+  int* entries;
+  int count;
+
+  memset(&q, '\0', sizeof(q));
+  q.type = FLICKCURL_SNAPSHOT_PHOTO;
+  q.used[FLICKCURL_STORE_BY_LASTUPDATE] = 1;
+  q.min[FLICKCURL_STORE_BY_LASTUPDATE] = min_date;
+  q.max[FLICKCURL_STORE_BY_LASTUPDATE] = INT64_MAX;
+
+  /* the index walked is already in last update order */
+  entries = flickcurl_store_find(store, &q, &count);
+  if(!entries)
+    return NULL;
+
+  photos = (flickcurl_photo**)flickcurl_store_page(store, entries, count,
+                                                   per_page, page);
+  free(entries);
+
+  return photos;
+}
+
+
+/**
+ * flickcurl_store_get_photosets:
+ * @store: store
+ * @user_id: NSID of the owner of the photosets or NULL for all
+ *
+ * Get the photosets in a store as flickcurl_photosets_getList() does
+ *
+ * Return value: non-empty array of photosets (may be NULL on failure)
+ */
+flickcurl_photoset**
+flickcurl_store_get_photosets(flickcurl_store* store, const char* user_id)
+{
+  flickcurl_store_query q;
+  flickcurl_photoset** photosets;
+  int* entries;
+  int count;
+
+  memset(&q, '\0', sizeof(q));
+  q.type = FLICKCURL_SNAPSHOT_PHOTOSET;
+  q.owner = user_id;
+
+  entries = flickcurl_store_find(store, &q, &count);
+  if(!entries)
+    return NULL;
+
+  photosets = (flickcurl_photoset**)flickcurl_store_page(store, entries, count,
+                                                         count, 1);
+  free(entries);
+
+  return photosets;
+}
+
+
+static int
+flickcurl_store_compare_offsets(const void* a, const void* b)
+{
+  size_t oa = *(const size_t*)a;
+  size_t ob = *(const size_t*)b;
+
+  return (oa > ob) - (oa < ob);
+}
+
+
+/**
+ * flickcurl_store_compact:
+ * @store: store opened for writing
+ *
+ * Rewrite a store file with only the newest record of each object
+ *
+ * The new file is written next to the old one and renamed over it,
+ * so the store is never left incomplete.  The new file is locked for
+ * writing before it replaces the old one.  Readers of the store pick
+ * up the new file at their next call.
+ *
+ * If the new file has replaced the old one but cannot be read, the
+ * store is closed: all calls on it then fail and it can only be
+ * freed, after which the file may be opened again.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_store_compact(flickcurl_store* store)
+{
+  flickcurl_store_header header;
+  char* new_filename = NULL;
+  size_t* offsets = NULL;
+  FILE* fh = NULL;
+  int count = 0;
+  int failed = 1;
+  int fd;
+  int new_fd = -1;
+  int e;
+
+  if(store->read_only || flickcurl_store_refresh(store))
+    return 1;
+
+  offsets = (size_t*)malloc((store->live_count + 1) * sizeof(size_t));
+  new_filename = (char*)malloc(strlen(store->filename) + 5);
+  if(!offsets || !new_filename)
+    goto tidy;
+
+  /* keep the records in the order they were written */
+  for(e = 0; e < store->entries_count; e++) {
+    if(store->entries[e].offset)
+      offsets[count++] = store->entries[e].offset;
+  }
+  qsort(offsets, count, sizeof(size_t), flickcurl_store_compare_offsets);
+
+  sprintf(new_filename, "%s.new", store->filename);
+  fd = open(new_filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if(fd < 0)
+    goto tidy;
+  /* the new file is locked and kept open to become the store's, so
+   * no other writer can open it once it replaces the old one */
+  if(flickcurl_store_lock(fd) || (new_fd = dup(fd)) < 0) {
+    close(fd);
+    remove(new_filename);
+    goto tidy;
+  }
+  fh = fdopen(fd, "wb");
+  if(!fh) {
+    close(fd);
+    close(new_fd);
+    remove(new_filename);
+    goto tidy;
+  }
+
+  flickcurl_store_init_header(&header);
+  failed = (fwrite(&header, sizeof(header), 1, fh) != 1);
+  for(e = 0; !failed && e < count; e++) {
+    flickcurl_store_record* rec = STORE_RECORD(store, offsets[e]);
+
+    failed = (fwrite(rec, 1, rec->length, fh) != rec->length);
+  }
+  if(fflush(fh))
+    failed = 1;
+#ifdef FLICKCURL_STORE_MMAP
+  if(!failed && fsync(fileno(fh)))
+    failed = 1;
+#endif
+  if(fclose(fh))
+    failed = 1;
+
+  if(!failed)
+    failed = (rename(new_filename, store->filename) != 0);
+  if(failed) {
+    close(new_fd);
+    remove(new_filename);
+    goto tidy;
+  }
+
+  flickcurl_store_close(store);
+  failed = flickcurl_store_open(store, new_fd);
+  if(failed)
+    flickcurl_store_close(store);
+
+  tidy:
+  if(offsets)
+    free(offsets);
+  if(new_filename)
+    free(new_filename);
+
+  return failed;
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+#define STORE_TEST_FILE "flickcurl_store_test.db"
+#define STORE_TEST_PHOTOS 200
+/* photos after this are removed */
+#define STORE_TEST_LIVE 150
+#define STORE_TEST_TIME 1300000000
+
+
+/* Photo @id: owner o<id % 4>, uploaded at STORE_TEST_TIME + @id, last
+ * updated 2 * @id later and located at @id / 10 degrees if @id is
+ * odd */
+typedef struct {
+  flickcurl_photo photo;
+  char id[16];
+  char owner[16];
+  char uploaded[16];
+  char lastupdate[16];
+  char latitude[16];
+  char longitude[16];
+  char title[32];
+} store_test_photo;
+
+
+static void
+store_test_set_field(flickcurl_photo* photo, flickcurl_photo_field_type field,
+                     char* value, int integer,
+                     flickcurl_field_value_type type)
+{
+  photo->fields[field].string = value;
+  photo->fields[field].integer = (flickcurl_photo_field_type)integer;
+  photo->fields[field].type = type;
+}
+
+
+static int
+store_test_put(flickcurl_store* store, int id, int version)
+{
+  store_test_photo p;
+  flickcurl_photo* photo = &p.photo;
+
+  memset(&p, '\0', sizeof(p));
+  sprintf(p.id, "%d", id);
+  photo->id = p.id;
+  photo->media_type = (char*)"photo";
+
+  sprintf(p.owner, "o%d", id % 4);
+  store_test_set_field(photo, PHOTO_FIELD_owner_nsid, p.owner, 0,
+                       VALUE_TYPE_STRING);
+  sprintf(p.uploaded, "%d", STORE_TEST_TIME + id);
+  store_test_set_field(photo, PHOTO_FIELD_dateuploaded, p.uploaded,
+                       STORE_TEST_TIME + id, VALUE_TYPE_DATETIME);
+  sprintf(p.lastupdate, "%d", STORE_TEST_TIME + 2 * id);
+  store_test_set_field(photo, PHOTO_FIELD_dates_lastupdate, p.lastupdate,
+                       STORE_TEST_TIME + 2 * id, VALUE_TYPE_DATETIME);
+  if(id % 2) {
+    sprintf(p.latitude, "%d.%d", id / 10, id % 10);
+    sprintf(p.longitude, "%d.%d", id / 10, id % 10);
+    store_test_set_field(photo, PHOTO_FIELD_location_latitude, p.latitude,
+                         0, VALUE_TYPE_FLOAT);
+    store_test_set_field(photo, PHOTO_FIELD_location_longitude, p.longitude,
+                         0, VALUE_TYPE_FLOAT);
+  }
+  sprintf(p.title, "title %d v%d", id, version);
+  store_test_set_field(photo, PHOTO_FIELD_title, p.title, 0,
+                       VALUE_TYPE_STRING);
+
+  if(flickcurl_store_put_photo(store, photo)) {
+    fprintf(stderr, "%s: FAIL\n  photo %d could not be put\n", program, id);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Check photo @id has version @version, or is not there if 0 */
+static int
+store_test_get(flickcurl_store* store, const char* label, int id,
+               int version)
+{
+  flickcurl_photo* photo;
+  char id_string[16];
+  char title[32];
+  int failed;
+
+  sprintf(id_string, "%d", id);
+  sprintf(title, "title %d v%d", id, version);
+  photo = flickcurl_store_get_photo(store, id_string);
+  if(!version)
+    failed = (photo != NULL);
+  else
+    failed = !photo ||
+      strcmp(flickcurl_photo_get_field_string(photo, PHOTO_FIELD_title),
+             title) ||
+      flickcurl_photo_get_time(photo, PHOTO_FIELD_dates_lastupdate) !=
+        STORE_TEST_TIME + 2 * id;
+  if(failed)
+    fprintf(stderr, "%s: FAIL\n  %s: photo %d is %s; expected %s\n",
+            program, label, id,
+            photo ? flickcurl_photo_get_field_string(photo,
+                                                     PHOTO_FIELD_title) :
+            "missing",
+            version ? title : "missing");
+
+  if(photo)
+    flickcurl_free_photo(photo);
+  return failed;
+}
+
+
+/*
+ * Check @photos are @count live photos with ID @id_mod modulo @mod,
+ * if not 0, in @order of upload date: < 0 for latest first, > 0 for
+ * earliest first
+ */
+static int
+store_test_check_photos(const char* label, flickcurl_photo** photos,
+                        int count, int mod, int id_mod, int order)
+{
+  int last = 0;
+  int i;
+
+  if(!photos) {
+    fprintf(stderr, "%s: FAIL\n  %s: no photos\n", program, label);
+    return 1;
+  }
+
+  for(i = 0; photos[i]; i++) {
+    int id = atoi(photos[i]->id);
+
+    if(id < 1 || id > STORE_TEST_LIVE || (mod && id % mod != id_mod) ||
+       (i && (order < 0 ? id > last : id < last))) {
+      fprintf(stderr, "%s: FAIL\n  %s: photo %d is out of place\n",
+              program, label, id);
+      flickcurl_free_photos(photos);
+      return 1;
+    }
+    last = id;
+  }
+  flickcurl_free_photos(photos);
+
+  if(i != count) {
+    fprintf(stderr, "%s: FAIL\n  %s: %d photos; expected %d\n",
+            program, label, i, count);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Check the searches and gets of the photos put by test_store_put() */
+static int
+store_test_check(flickcurl_store* store, const char* label)
+{
+  flickcurl_search_params params;
+  int photos_count = 0;
+  int failures = 0;
+  int id;
+
+  flickcurl_store_get_counts(store, &photos_count, NULL, NULL);
+  if(photos_count != STORE_TEST_LIVE) {
+    fprintf(stderr, "%s: FAIL\n  %s: %d photos; expected %d\n",
+            program, label, photos_count, STORE_TEST_LIVE);
+    failures++;
+  }
+
+  for(id = 1; id <= STORE_TEST_PHOTOS; id += 7)
+    failures += store_test_get(store, label, id,
+                               id > STORE_TEST_LIVE ? 0 : (id <= 50 ? 2 : 1));
+
+  /* owner o1: 1, 5, ... 149 latest first */
+  flickcurl_search_params_init(&params);
+  params.user_id = (char*)"o1";
+  params.per_page = 500;
+  failures += store_test_check_photos(label,
+                                      flickcurl_store_search_photos(store,
+                                                                    &params),
+                                      38, 4, 1, -1);
+
+  /* uploaded from 100 to 119 */
+  flickcurl_search_params_init(&params);
+  params.min_upload_date = STORE_TEST_TIME + 100;
+  params.max_upload_date = STORE_TEST_TIME + 119;
+  failures += store_test_check_photos(label,
+                                      flickcurl_store_search_photos(store,
+                                                                    &params),
+                                      20, 0, 0, -1);
+
+  /* located from 5.0 to 9.9 degrees: odd photos 51 to 99 */
+  flickcurl_search_params_init(&params);
+  params.bbox = (char*)"5,5,9.95,9.95";
+  params.per_page = 500;
+  failures += store_test_check_photos(label,
+                                      flickcurl_store_search_photos(store,
+                                                                    &params),
+                                      25, 2, 1, -1);
+
+  /* second page of 10 */
+  flickcurl_search_params_init(&params);
+  params.per_page = 10;
+  params.page = 2;
+  failures += store_test_check_photos(label,
+                                      flickcurl_store_search_photos(store,
+                                                                    &params),
+                                      10, 0, 0, -1);
+
+  /* updated at or after photo 140 was: 140 to 150 earliest first */
+  failures += store_test_check_photos(label,
+                                      flickcurl_store_get_updated_photos(store,
+                                        STORE_TEST_TIME + 280, 100, 1),
+                                      11, 0, 0, 1);
+
+  return failures;
+}
+
+
+/* Put, replace and remove photos, a person and a photoset */
+static int
+test_store_put(flickcurl_store* store)
+{
+  flickcurl_person person;
+  flickcurl_photoset photoset;
+  flickcurl_person* got_person;
+  flickcurl_photoset* got_photoset;
+  int people_count = 0;
+  int photosets_count = 0;
+  int failures = 0;
+  int id;
+
+  for(id = 1; id <= STORE_TEST_PHOTOS; id++)
+    failures += store_test_put(store, id, 1);
+  for(id = 1; id <= 50; id++)
+    failures += store_test_put(store, id, 2);
+  for(id = STORE_TEST_LIVE + 1; id <= STORE_TEST_PHOTOS; id++) {
+    char id_string[16];
+
+    sprintf(id_string, "%d", id);
+    if(flickcurl_store_remove_photo(store, id_string))
+      failures++;
+  }
+
+  memset(&person, '\0', sizeof(person));
+  person.nsid = (char*)"o1";
+  person.fields[PERSON_FIELD_username].string = (char*)"someone";
+  person.fields[PERSON_FIELD_username].type = VALUE_TYPE_STRING;
+  memset(&photoset, '\0', sizeof(photoset));
+  photoset.id = (char*)"1";
+  photoset.owner = (char*)"o1";
+  photoset.title = (char*)"set";
+  if(flickcurl_store_put_person(store, &person) ||
+     flickcurl_store_put_photoset(store, &photoset))
+    failures++;
+
+  flickcurl_store_get_counts(store, NULL, &people_count, &photosets_count);
+  got_person = flickcurl_store_get_person(store, "o1");
+  got_photoset = flickcurl_store_get_photoset(store, "1");
+  if(people_count != 1 || photosets_count != 1 || !got_person ||
+     !got_photoset || strcmp(got_photoset->owner, "o1") ||
+     strcmp(got_person->fields[PERSON_FIELD_username].string, "someone")) {
+    fprintf(stderr, "%s: FAIL\n  person or photoset not stored\n",
+            program);
+    failures++;
+  }
+  if(got_person)
+    flickcurl_free_person(got_person);
+  if(got_photoset)
+    flickcurl_free_photoset(got_photoset);
+
+  /* the photoset ID is not a photo's */
+  if(flickcurl_store_remove_photo(store, "1") ||
+     flickcurl_store_get_photo(store, "1") ||
+     !(got_photoset = flickcurl_store_get_photoset(store, "1"))) {
+    fprintf(stderr, "%s: FAIL\n  photo and photoset IDs confused\n",
+            program);
+    failures++;
+  } else
+    flickcurl_free_photoset(got_photoset);
+  failures += store_test_put(store, 1, 2);
+
+  failures += store_test_check(store, "put");
+
+  return failures;
+}
+
+
+/* Only one store may write a file, whoever else has it open */
+static int
+store_test_locked(const char* label)
+{
+  flickcurl_store* store;
+  flickcurl_store* reader;
+
+  /* a reader opened and freed in the same process keeps the lock */
+  reader = flickcurl_new_store(STORE_TEST_FILE, 1);
+  if(reader)
+    flickcurl_free_store(reader);
+
+  store = flickcurl_new_store(STORE_TEST_FILE, 0);
+  if(store || !reader) {
+    fprintf(stderr, "%s: FAIL\n  %s: %s\n", program, label,
+            store ? "second writer opened the store" :
+            "reader could not open the store");
+    if(store)
+      flickcurl_free_store(store);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* A reader sees the writer's changes and compaction at its next call */
+static int
+test_store_refresh_compact(flickcurl_store* store)
+{
+  flickcurl_store* reader;
+  struct stat before;
+  struct stat after;
+  int failures = 0;
+
+  failures += store_test_locked("writer open");
+
+  reader = flickcurl_new_store(STORE_TEST_FILE, 1);
+  if(!reader) {
+    fprintf(stderr, "%s: FAIL\n  reader could not open the store\n",
+            program);
+    return failures + 1;
+  }
+  failures += store_test_check(reader, "reader");
+
+  failures += store_test_put(store, 60, 2);
+  failures += store_test_put(store, 60, 1);
+  failures += store_test_get(reader, "refresh", 60, 1);
+
+  if(stat(STORE_TEST_FILE, &before) || flickcurl_store_compact(store) ||
+     stat(STORE_TEST_FILE, &after) || after.st_size >= before.st_size) {
+    fprintf(stderr, "%s: FAIL\n  compaction failed or did not shrink "
+            "the file\n", program);
+    failures++;
+  }
+  failures += store_test_check(store, "compacted");
+  failures += store_test_check(reader, "reader after compaction");
+  failures += store_test_locked("after compaction");
+
+  flickcurl_free_store(reader);
+
+  return failures;
+}
+
+
+/* A record cut short is dropped when the writer opens the file */
+static int
+test_store_torn_tail(void)
+{
+  flickcurl_store* store;
+  struct stat sb;
+  FILE* fh;
+  int failures = 0;
+
+  fh = fopen(STORE_TEST_FILE, "ab");
+  if(!fh)
+    return 1;
+  fwrite("\100\0\0\0garbage", 1, 11, fh);
+  fclose(fh);
+
+  store = flickcurl_new_store(STORE_TEST_FILE, 0);
+  if(!store) {
+    fprintf(stderr, "%s: FAIL\n  store with a torn tail did not open\n",
+            program);
+    return 1;
+  }
+  failures += store_test_check(store, "torn tail");
+  if(stat(STORE_TEST_FILE, &sb) || sb.st_size % 8) {
+    fprintf(stderr, "%s: FAIL\n  torn tail was not cut off\n", program);
+    failures++;
+  }
+  flickcurl_free_store(store);
+
+  /* a file that is not a store is not opened */
+  fh = fopen(STORE_TEST_FILE, "wb");
+  if(!fh)
+    return failures + 1;
+  fputs("not a flickcurl store at all", fh);
+  fclose(fh);
+  store = flickcurl_new_store(STORE_TEST_FILE, 0);
+  if(store) {
+    fprintf(stderr, "%s: FAIL\n  a file that is not a store opened\n",
+            program);
+    flickcurl_free_store(store);
+    failures++;
+  }
+
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl_store* store;
+  int failures = 0;
+
+  program = "flickcurl_store_test";
+
+  flickcurl_init();
+
+  remove(STORE_TEST_FILE);
+  store = flickcurl_new_store(STORE_TEST_FILE, 0);
+  if(!store) {
+    fprintf(stderr, "%s: FAIL\n  store could not be made\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  failures += test_store_put(store);
+  failures += test_store_refresh_compact(store);
+  flickcurl_free_store(store);
+  failures += test_store_torn_tail();
+
+  tidy:
+  remove(STORE_TEST_FILE);
+  remove(STORE_TEST_FILE ".new");
+
+  flickcurl_finish();
+
+  return failures;
+}
+#endif
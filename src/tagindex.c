@@ -0,0 +1,2050 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * tagindex.c - Flickcurl local inverted index of photo tags
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * The index maps terms to posting lists of the numeric IDs of the
+ * photos carrying them.  A term is a type byte and a lower case text:
+ *
+ *   t  plain tag                sunset
+ *   n  machine tag namespace    geo
+ *   p  machine tag predicate    geo:country
+ *   v  machine tag value        geo:country=fr
+ *
+ * A posting list is kept sorted and compressed as the differences
+ * between successive IDs in 7-bit variable length bytes (the first
+ * difference is from 0).  Photos are mostly added in increasing ID
+ * order, so adding one is usually appending to the end of each list.
+ * Other changes are queued uncompressed on the term and folded into
+ * the list in one pass once they outnumber an eighth of it, or when
+ * the term is searched or the index saved.
+ *
+ * So that a photo added again replaces its old terms, each photo has
+ * its sorted term numbers compressed the same way in an append-only
+ * block; replaced entries are left as garbage until the index is
+ * saved.
+ *
+ * A saved index is one file, in the byte order of the writer:
+ *
+ *   header     magic, layout version, byte order mark, term count,
+ *              photo count
+ *   terms      key length, key, photo count, last ID, postings
+ *              length, postings
+ *   photos     ID, terms length, terms
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define FLICKCURL_TAG_INDEX_MAGIC "FCTAGIX\n"
+/* Bump when the file layout or the term keys change */
+#define FLICKCURL_TAG_INDEX_VERSION 1
+#define FLICKCURL_TAG_INDEX_BYTE_ORDER 0x01020304
+
+/* Term types: the first byte of a term key */
+#define FLICKCURL_TAG_INDEX_TAG 't'
+#define FLICKCURL_TAG_INDEX_NAMESPACE 'n'
+#define FLICKCURL_TAG_INDEX_PREDICATE 'p'
+#define FLICKCURL_TAG_INDEX_VALUE 'v'
+
+/* Fewest queued changes of a term worth folding into its postings */
+#define FLICKCURL_TAG_INDEX_MIN_CHANGES 32
+
+/* Longest variable length encoding of a 64 bit integer */
+#define FLICKCURL_TAG_INDEX_VARINT_SIZE 10
+
+
+#ifndef STANDALONE
+
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t terms_count;
+  uint32_t photos_count;
+} flickcurl_tag_index_header;
+
+
+/* Pending addition or removal of a photo from a term */
+typedef struct {
+  uint64_t id;
+  /* order of the changes of the same ID */
+  uint32_t seq;
+  uint32_t removed;
+} flickcurl_tag_index_change;
+
+
+typedef struct {
+  /* type byte then the text */
+  char* key;
+  unsigned char* postings;
+  size_t postings_len;
+  size_t postings_size;
+  int count;
+  /* largest ID in the postings */
+  uint64_t last;
+  /* changes not yet in the postings */
+  flickcurl_tag_index_change* changes;
+  int changes_count;
+  int changes_size;
+} flickcurl_tag_index_term;
+
+
+/* Photo table slot; an ID of 0 marks an empty slot */
+typedef struct {
+  uint64_t id;
+  /* terms of the photo in the forward block */
+  uint32_t offset;
+  uint32_t length;
+} flickcurl_tag_index_photo;
+
+
+/* Sorted list of photo IDs */
+typedef struct {
+  uint64_t* ids;
+  int count;
+} flickcurl_tag_index_set;
+
+
+struct flickcurl_tag_index_s {
+  char* filename;
+
+  flickcurl_tag_index_term* terms;
+  int terms_count;
+  int terms_size;
+  /* hash table of term number + 1, 0 for an empty slot */
+  int* term_slots;
+  int term_slots_count;
+  /* term numbers sorted by key or NULL when a term has been added */
+  int* order;
+
+  flickcurl_tag_index_photo* photos;
+  size_t photo_slots_count;
+  int photos_count;
+
+  /* compressed term lists of the photos */
+  unsigned char* forward;
+  size_t forward_len;
+  size_t forward_size;
+};
+
+
+static uint32_t
+flickcurl_tag_index_hash(const char* key, size_t len)
+{
+  /* FNV-1a */
+  uint32_t hash = 2166136261U;
+  size_t i;
+
+  for(i = 0; i < len; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+
+static size_t
+flickcurl_tag_index_put_varint(unsigned char* p, uint64_t value)
+{
+  size_t len = 0;
+
+  while(value >= 0x80) {
+    p[len++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  p[len++] = (unsigned char)value;
+
+  return len;
+}
+
+
+static uint64_t
+flickcurl_tag_index_get_varint(const unsigned char** p_p)
+{
+  const unsigned char* p = *p_p;
+  uint64_t value = 0;
+  int shift = 0;
+
+  while(*p & 0x80) {
+    value |= (uint64_t)(*p++ & 0x7f) << shift;
+    shift += 7;
+  }
+  value |= (uint64_t)*p++ << shift;
+
+  *p_p = p;
+  return value;
+}
+
+
+/*
+ * Check @len bytes at @p hold whole varints, each but the first more
+ * than 0 as they are the deltas of increasing numbers, as a damaged
+ * file may not.  The count and sum of the varints are put in
+ * *@count_p and *@sum_p.
+ *
+ * Return value: non-0 if they do not
+ */
+static int
+flickcurl_tag_index_check_varints(const unsigned char* p, size_t len,
+                                  uint64_t* count_p, uint64_t* sum_p)
+{
+  const unsigned char* end = p + len;
+  uint64_t count = 0;
+  uint64_t sum = 0;
+
+  while(p < end) {
+    uint64_t value = 0;
+    int shift = 0;
+
+    do {
+      if(p == end || shift > 63)
+        return 1;
+      value |= (uint64_t)(*p & 0x7f) << shift;
+      shift += 7;
+    } while(*p++ & 0x80);
+
+    if((count && !value) || value > UINT64_MAX - sum)
+      return 1;
+    sum += value;
+    count++;
+  }
+
+  *count_p = count;
+  *sum_p = sum;
+  return 0;
+}
+
+
+/* Make room for @len more bytes in a growable byte block */
+static int
+flickcurl_tag_index_reserve(unsigned char** block_p, size_t* size_p,
+                            size_t used, size_t len)
+{
+  size_t size = *size_p ? *size_p : 16;
+  unsigned char* block;
+
+  if(used + len <= *size_p)
+    return 0;
+
+  while(size < used + len)
+    size *= 2;
+  block = (unsigned char*)realloc(*block_p, size);
+  if(!block)
+    return 1;
+  *block_p = block;
+  *size_p = size;
+
+  return 0;
+}
+
+
+/* Parse a numeric photo ID; return 0 if it is not one */
+static uint64_t
+flickcurl_tag_index_parse_id(const char* id)
+{
+  uint64_t value = 0;
+
+  if(!id || !*id)
+    return 0;
+
+  for(; *id; id++) {
+    if(*id < '0' || *id > '9' ||
+       value > (UINT64_MAX - (uint64_t)(*id - '0')) / 10)
+      return 0;
+    value = value * 10 + (uint64_t)(*id - '0');
+  }
+
+  return value;
+}
+
+
+/* Format @value in decimal as a new string */
+static char*
+flickcurl_tag_index_format_id(uint64_t value)
+{
+  char buffer[21];
+  char* p = buffer + sizeof(buffer) - 1;
+  char* s;
+
+  *p = '\0';
+  do {
+    *--p = (char)('0' + (value % 10));
+    value /= 10;
+  } while(value);
+
+  s = (char*)malloc(buffer + sizeof(buffer) - p);
+  if(s)
+    memcpy(s, p, buffer + sizeof(buffer) - p);
+  return s;
+}
+
+
+/*
+ * Decode the postings of @term into @ids of at least count entries.
+ */
+static void
+flickcurl_tag_index_decode(flickcurl_tag_index_term* term, uint64_t* ids)
+{
+  const unsigned char* p = term->postings;
+  uint64_t id = 0;
+  int i;
+
+  for(i = 0; i < term->count; i++) {
+    id += flickcurl_tag_index_get_varint(&p);
+    ids[i] = id;
+  }
+}
+
+
+/* Replace the postings of @term with the @count sorted @ids */
+static int
+flickcurl_tag_index_encode(flickcurl_tag_index_term* term,
+                           const uint64_t* ids, int count)
+{
+  unsigned char* postings;
+  size_t len = 0;
+  uint64_t last = 0;
+  int i;
+
+  postings = (unsigned char*)malloc(count * FLICKCURL_TAG_INDEX_VARINT_SIZE +
+                                    1);
+  if(!postings)
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    len += flickcurl_tag_index_put_varint(postings + len, ids[i] - last);
+    last = ids[i];
+  }
+
+  if(term->postings)
+    free(term->postings);
+  term->postings = postings;
+  term->postings_len = len;
+  term->postings_size = count * FLICKCURL_TAG_INDEX_VARINT_SIZE + 1;
+  term->count = count;
+  term->last = last;
+
+  return 0;
+}
+
+
+static int
+flickcurl_tag_index_compare_changes(const void* a, const void* b)
+{
+  const flickcurl_tag_index_change* ca = (const flickcurl_tag_index_change*)a;
+  const flickcurl_tag_index_change* cb = (const flickcurl_tag_index_change*)b;
+
+  if(ca->id != cb->id)
+    return (ca->id > cb->id) - (ca->id < cb->id);
+  return (ca->seq > cb->seq) - (ca->seq < cb->seq);
+}
+
+
+/* Apply the pending changes of @term to its postings */
+static int
+flickcurl_tag_index_fold(flickcurl_tag_index_term* term)
+{
+  flickcurl_tag_index_change* changes = term->changes;
+  uint64_t* ids;
+  int total = term->count + term->changes_count;
+  int count = total;
+  int i;
+  int j;
+  int rc;
+
+  if(!term->changes_count)
+    return 0;
+
+  ids = (uint64_t*)malloc(total * sizeof(uint64_t));
+  if(!ids)
+    return 1;
+  flickcurl_tag_index_decode(term, ids);
+
+  qsort(changes, term->changes_count, sizeof(*changes),
+        flickcurl_tag_index_compare_changes);
+
+  /* merge in place from the end; the last change of an ID wins */
+  i = term->count - 1;
+  j = term->changes_count - 1;
+  while(j >= 0) {
+    flickcurl_tag_index_change* change = &changes[j];
+
+    while(i >= 0 && ids[i] > change->id)
+      ids[--count] = ids[i--];
+    if(i >= 0 && ids[i] == change->id)
+      i--;
+    if(!change->removed)
+      ids[--count] = change->id;
+    /* skip the earlier changes of the same ID */
+    while(j >= 0 && changes[j].id == change->id)
+      j--;
+  }
+  while(i >= 0)
+    ids[--count] = ids[i--];
+
+  term->changes_count = 0;
+  rc = flickcurl_tag_index_encode(term, ids + count, total - count);
+  free(ids);
+  return rc;
+}
+
+
+/*
+ * Add photo @id to the postings of @term, or remove it if @removed.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+flickcurl_tag_index_term_change(flickcurl_tag_index_term* term, uint64_t id,
+                                int removed)
+{
+  flickcurl_tag_index_change* change;
+
+  if(!removed && !term->changes_count && (!term->count || id > term->last)) {
+    /* the usual case of a newer photo: append */
+    if(flickcurl_tag_index_reserve(&term->postings, &term->postings_size,
+                                   term->postings_len,
+                                   FLICKCURL_TAG_INDEX_VARINT_SIZE))
+      return 1;
+    term->postings_len +=
+      flickcurl_tag_index_put_varint(term->postings + term->postings_len,
+                                     id - term->last);
+    term->last = id;
+    term->count++;
+    return 0;
+  }
+
+  if(term->changes_count == term->changes_size) {
+    int size = term->changes_size ? term->changes_size * 2 : 8;
+    flickcurl_tag_index_change* changes;
+
+    changes = (flickcurl_tag_index_change*)realloc(term->changes,
+                                                   size * sizeof(*changes));
+    if(!changes)
+      return 1;
+    term->changes = changes;
+    term->changes_size = size;
+  }
+
+  change = &term->changes[term->changes_count];
+  change->id = id;
+  change->seq = (uint32_t)term->changes_count++;
+  change->removed = (uint32_t)removed;
+
+  /* rewriting the postings costs about as much as the changes */
+  if(term->changes_count > FLICKCURL_TAG_INDEX_MIN_CHANGES &&
+     term->changes_count > term->count / 8)
+    return flickcurl_tag_index_fold(term);
+
+  return 0;
+}
+
+
+/* Find the slot of term @key or the empty slot where it would go */
+static int*
+flickcurl_tag_index_find_term_slot(flickcurl_tag_index* index,
+                                   const char* key, size_t len)
+{
+  int mask = index->term_slots_count - 1;
+  int i = (int)(flickcurl_tag_index_hash(key, len) & (uint32_t)mask);
+
+  while(index->term_slots[i]) {
+    const char* slot_key = index->terms[index->term_slots[i] - 1].key;
+
+    if(!strncmp(slot_key, key, len) && !slot_key[len])
+      break;
+    i = (i + 1) & mask;
+  }
+
+  return &index->term_slots[i];
+}
+
+
+/*
+ * Find the number of the term with @key of @len bytes, adding it if
+ * @add is set.
+ *
+ * Return value: term number, or < 0 if not found or on failure
+ */
+static int
+flickcurl_tag_index_find_term(flickcurl_tag_index* index, const char* key,
+                              size_t len, int add)
+{
+  flickcurl_tag_index_term* term;
+  int* slot;
+
+  slot = flickcurl_tag_index_find_term_slot(index, key, len);
+  if(*slot || !add)
+    return *slot - 1;
+
+  /* keep the table at most half full */
+  if((index->terms_count + 1) * 2 > index->term_slots_count) {
+    int* old_slots = index->term_slots;
+    int old_count = index->term_slots_count;
+    int i;
+
+    index->term_slots_count *= 2;
+    index->term_slots = (int*)calloc(index->term_slots_count, sizeof(int));
+    if(!index->term_slots) {
+      index->term_slots = old_slots;
+      index->term_slots_count = old_count;
+      return -1;
+    }
+    for(i = 0; i < old_count; i++) {
+      if(old_slots[i]) {
+        const char* k = index->terms[old_slots[i] - 1].key;
+
+        *flickcurl_tag_index_find_term_slot(index, k, strlen(k)) =
+          old_slots[i];
+      }
+    }
+    free(old_slots);
+    slot = flickcurl_tag_index_find_term_slot(index, key, len);
+  }
+
+  if(index->terms_count == index->terms_size) {
+    int size = index->terms_size ? index->terms_size * 2 : 256;
+    flickcurl_tag_index_term* terms;
+
+    terms = (flickcurl_tag_index_term*)realloc(index->terms,
+                                               size * sizeof(*terms));
+    if(!terms)
+      return -1;
+    index->terms = terms;
+    index->terms_size = size;
+  }
+
+  term = &index->terms[index->terms_count];
+  memset(term, '\0', sizeof(*term));
+  term->key = (char*)malloc(len + 1);
+  if(!term->key)
+    return -1;
+  memcpy(term->key, key, len);
+  term->key[len] = '\0';
+
+  *slot = ++index->terms_count;
+  if(index->order) {
+    free(index->order);
+    index->order = NULL;
+  }
+
+  return index->terms_count - 1;
+}
+
+
+/* Find the slot of photo @id or the empty slot where it would go */
+static flickcurl_tag_index_photo*
+flickcurl_tag_index_find_photo(flickcurl_tag_index* index, uint64_t id)
+{
+  size_t mask = index->photo_slots_count - 1;
+  size_t i = (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+  while(index->photos[i].id && index->photos[i].id != id)
+    i = (i + 1) & mask;
+
+  return &index->photos[i];
+}
+
+
+/* Remove the photo in slot @photo, moving later slots of its run back */
+static void
+flickcurl_tag_index_remove_photo_slot(flickcurl_tag_index* index,
+                                      flickcurl_tag_index_photo* photo)
+{
+  size_t mask = index->photo_slots_count - 1;
+  size_t hole = (size_t)(photo - index->photos);
+  size_t i = hole;
+
+  for(;;) {
+    size_t home;
+
+    i = (i + 1) & mask;
+    if(!index->photos[i].id)
+      break;
+
+    /* move the entry back if the hole is between its home and it */
+    home = (size_t)((index->photos[i].id * 0x9E3779B97F4A7C15ULL) >> 32) &
+           mask;
+    if(((i - home) & mask) >= ((i - hole) & mask)) {
+      index->photos[hole] = index->photos[i];
+      hole = i;
+    }
+  }
+
+  index->photos[hole].id = 0;
+  index->photos_count--;
+}
+
+
+/* Keep the photo table at most half full; return non-0 on failure */
+static int
+flickcurl_tag_index_grow_photos(flickcurl_tag_index* index)
+{
+  flickcurl_tag_index_photo* old_photos = index->photos;
+  size_t old_count = index->photo_slots_count;
+  size_t i;
+
+  if((size_t)(index->photos_count + 1) * 2 <= index->photo_slots_count)
+    return 0;
+
+  index->photo_slots_count = old_count ? old_count * 2 : 1024;
+  index->photos = (flickcurl_tag_index_photo*)calloc(index->photo_slots_count,
+                                                     sizeof(*old_photos));
+  if(!index->photos) {
+    index->photos = old_photos;
+    index->photo_slots_count = old_count;
+    return 1;
+  }
+
+  for(i = 0; i < old_count; i++) {
+    if(old_photos[i].id)
+      *flickcurl_tag_index_find_photo(index, old_photos[i].id) = old_photos[i];
+  }
+  if(old_photos)
+    free(old_photos);
+
+  return 0;
+}
+
+
+/* Decode the term numbers of @photo into new array *@terms_p */
+static int
+flickcurl_tag_index_photo_terms(flickcurl_tag_index* index,
+                                flickcurl_tag_index_photo* photo,
+                                int** terms_p)
+{
+  const unsigned char* p;
+  const unsigned char* end;
+  int* terms;
+  int count = 0;
+  int term = 0;
+
+  /* every term takes at least a byte */
+  terms = (int*)malloc((photo->length + 1) * sizeof(int));
+  if(!terms)
+    return -1;
+
+  p = index->forward + photo->offset;
+  end = p + photo->length;
+  while(p < end) {
+    term += (int)flickcurl_tag_index_get_varint(&p);
+    terms[count++] = term;
+  }
+
+  *terms_p = terms;
+  return count;
+}
+
+
+/* Lower case @len bytes of @text into @buffer after @type */
+static size_t
+flickcurl_tag_index_make_key(char* buffer, char type, const char* text,
+                             size_t len)
+{
+  size_t i;
+
+  buffer[0] = type;
+  for(i = 0; i < len; i++) {
+    char c = text[i];
+
+    buffer[i + 1] = (char)((c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c);
+  }
+  buffer[len + 1] = '\0';
+
+  return len + 1;
+}
+
+
+/*
+ * Split machine tag @tag of the form namespace:predicate=value into
+ * the lengths of the namespace and predicate; the value, without any
+ * double quotes around it, is from *@value_p for *@value_len_p bytes.
+ *
+ * Return value: non-0 if @tag is not a machine tag
+ */
+static int
+flickcurl_tag_index_split_machine_tag(const char* tag, size_t* ns_len_p,
+                                      size_t* predicate_len_p,
+                                      const char** value_p,
+                                      size_t* value_len_p)
+{
+  const char* colon = strchr(tag, ':');
+  const char* equals;
+  size_t len;
+
+  if(!colon || colon == tag)
+    return 1;
+  equals = strchr(colon + 1, '=');
+  if(!equals || equals == colon + 1 || !equals[1])
+    return 1;
+
+  *ns_len_p = colon - tag;
+  *predicate_len_p = equals - colon - 1;
+  *value_p = equals + 1;
+  len = strlen(equals + 1);
+  if(len >= 2 && equals[1] == '"' && equals[len] == '"') {
+    (*value_p)++;
+    len -= 2;
+  }
+  *value_len_p = len;
+
+  return 0;
+}
+
+
+/* Add the terms of @tag to @terms; return the new count or < 0 on failure */
+static int
+flickcurl_tag_index_tag_terms(flickcurl_tag_index* index, flickcurl_tag* tag,
+                              int* terms, int count)
+{
+  const char* text = tag->raw ? tag->raw : tag->cooked;
+  const char* value;
+  size_t ns_len;
+  size_t predicate_len;
+  size_t value_len;
+  size_t text_len;
+  size_t lens[3];
+  int keys_count;
+  char* key;
+  int i;
+
+  if(!text)
+    return count;
+  text_len = strlen(text);
+  if(tag->cooked && strlen(tag->cooked) > text_len)
+    text_len = strlen(tag->cooked);
+
+  key = (char*)malloc(text_len + 2);
+  if(!key)
+    return -1;
+
+  if(flickcurl_tag_index_split_machine_tag(text, &ns_len, &predicate_len,
+                                           &value, &value_len)) {
+    if(tag->cooked)
+      text = tag->cooked;
+    lens[0] = flickcurl_tag_index_make_key(key, FLICKCURL_TAG_INDEX_TAG,
+                                           text, strlen(text));
+    keys_count = 1;
+  } else {
+    /* the keys are prefixes of namespace:predicate=value */
+    flickcurl_tag_index_make_key(key, FLICKCURL_TAG_INDEX_VALUE, text,
+                                 ns_len + 1 + predicate_len + 1);
+    flickcurl_tag_index_make_key(key + ns_len + predicate_len + 2, '=',
+                                 value, value_len);
+    lens[0] = 1 + ns_len;
+    lens[1] = 1 + ns_len + 1 + predicate_len;
+    lens[2] = lens[1] + 1 + value_len;
+    keys_count = 3;
+  }
+
+  for(i = 0; i < keys_count; i++) {
+    int term;
+
+    if(keys_count > 1)
+      key[0] = (char)(i == 0 ? FLICKCURL_TAG_INDEX_NAMESPACE :
+                      i == 1 ? FLICKCURL_TAG_INDEX_PREDICATE :
+                      FLICKCURL_TAG_INDEX_VALUE);
+    term = flickcurl_tag_index_find_term(index, key, lens[i], 1);
+    if(term < 0) {
+      free(key);
+      return -1;
+    }
+    terms[count++] = term;
+  }
+
+  free(key);
+  return count;
+}
+
+
+static int
+flickcurl_tag_index_compare_ints(const void* a, const void* b)
+{
+  int ia = *(const int*)a;
+  int ib = *(const int*)b;
+
+  return (ia > ib) - (ia < ib);
+}
+
+
+/**
+ * flickcurl_new_tag_index:
+ * @filename: file the index is read from and saved to or NULL to keep it in memory
+ *
+ * Create a local inverted index of photo tags and machine tags
+ *
+ * Photos are added with flickcurl_tag_index_add_photo() and found by
+ * their tags with flickcurl_tag_index_search() without calling the
+ * web service.  If @filename exists the index is read from it, so a
+ * later process starts with the photos saved by
+ * flickcurl_tag_index_save().  An index may not be used by several
+ * threads at once.
+ *
+ * Return value: new index or NULL on failure or if @filename is not an index of this version
+ */
+flickcurl_tag_index*
+flickcurl_new_tag_index(const char* filename)
+{
+  flickcurl_tag_index* index;
+  flickcurl_tag_index_header header;
+  FILE* fh = NULL;
+  uint32_t i;
+
+  index = (flickcurl_tag_index*)calloc(1, sizeof(*index));
+  if(!index)
+    return NULL;
+
+  index->term_slots_count = 1024;
+  index->term_slots = (int*)calloc(index->term_slots_count, sizeof(int));
+  if(!index->term_slots || flickcurl_tag_index_grow_photos(index))
+    goto failed;
+
+  if(!filename)
+    return index;
+
+  index->filename = (char*)malloc(strlen(filename) + 1);
+  if(!index->filename)
+    goto failed;
+  strcpy(index->filename, filename);
+
+  fh = fopen(filename, "rb");
+  if(!fh)
+    return index;
+
+  if(fread(&header, sizeof(header), 1, fh) != 1 ||
+     memcmp(header.magic, FLICKCURL_TAG_INDEX_MAGIC, 8) ||
+     header.version != FLICKCURL_TAG_INDEX_VERSION ||
+     header.byte_order != FLICKCURL_TAG_INDEX_BYTE_ORDER)
+    goto failed;
+
+  for(i = 0; i < header.terms_count; i++) {
+    flickcurl_tag_index_term* term;
+    char* key;
+    uint32_t key_len;
+    uint32_t count;
+    uint32_t postings_len;
+    uint64_t varints_count;
+    uint64_t sum;
+    int t;
+
+    if(fread(&key_len, sizeof(key_len), 1, fh) != 1 || !key_len)
+      goto failed;
+    key = (char*)malloc(key_len);
+    if(!key)
+      goto failed;
+    t = -1;
+    if(fread(key, 1, key_len, fh) == key_len)
+      t = flickcurl_tag_index_find_term(index, key, key_len, 1);
+    free(key);
+    if(t != (int)i)
+      goto failed;
+    term = &index->terms[t];
+
+    if(fread(&count, sizeof(count), 1, fh) != 1 ||
+       fread(&term->last, sizeof(term->last), 1, fh) != 1 ||
+       fread(&postings_len, sizeof(postings_len), 1, fh) != 1)
+      goto failed;
+    /* every posting takes at least a byte */
+    if(count > postings_len)
+      goto failed;
+    term->count = (int)count;
+    term->postings_len = postings_len;
+    term->postings_size = postings_len + FLICKCURL_TAG_INDEX_VARINT_SIZE;
+    term->postings = (unsigned char*)malloc(term->postings_size);
+    if(!term->postings ||
+       fread(term->postings, 1, postings_len, fh) != postings_len ||
+       flickcurl_tag_index_check_varints(term->postings, postings_len,
+                                         &varints_count, &sum) ||
+       varints_count != count || (count && sum != term->last))
+      goto failed;
+  }
+
+  for(i = 0; i < header.photos_count; i++) {
+    flickcurl_tag_index_photo* photo;
+    uint64_t id;
+    uint32_t length;
+    uint64_t varints_count;
+    uint64_t last_term;
+
+    if(fread(&id, sizeof(id), 1, fh) != 1 || !id ||
+       fread(&length, sizeof(length), 1, fh) != 1 ||
+       flickcurl_tag_index_grow_photos(index) ||
+       flickcurl_tag_index_reserve(&index->forward, &index->forward_size,
+                                   index->forward_len, length) ||
+       fread(index->forward + index->forward_len, 1, length, fh) != length)
+      goto failed;
+    /* the term numbers increase so the last is the largest */
+    if(flickcurl_tag_index_check_varints(index->forward + index->forward_len,
+                                         length, &varints_count,
+                                         &last_term) ||
+       (varints_count && last_term >= header.terms_count))
+      goto failed;
+
+    photo = flickcurl_tag_index_find_photo(index, id);
+    if(photo->id)
+      goto failed;
+    photo->id = id;
+    photo->offset = (uint32_t)index->forward_len;
+    photo->length = length;
+    index->forward_len += length;
+    index->photos_count++;
+  }
+
+  fclose(fh);
+  return index;
+
+  failed:
+  if(fh)
+    fclose(fh);
+  flickcurl_free_tag_index(index);
+  return NULL;
+}
+
+
+/**
+ * flickcurl_free_tag_index:
+ * @index: tag index
+ *
+ * Destructor for a tag index
+ *
+ * Changes since the last flickcurl_tag_index_save() are not saved.
+ */
+void
+flickcurl_free_tag_index(flickcurl_tag_index* index)
+{
+  int i;
+
+  if(!index)
+    return;
+
+  for(i = 0; i < index->terms_count; i++) {
+    free(index->terms[i].key);
+    if(index->terms[i].postings)
+      free(index->terms[i].postings);
+    if(index->terms[i].changes)
+      free(index->terms[i].changes);
+  }
+
+  if(index->terms)
+    free(index->terms);
+  if(index->term_slots)
+    free(index->term_slots);
+  if(index->order)
+    free(index->order);
+  if(index->photos)
+    free(index->photos);
+  if(index->forward)
+    free(index->forward);
+  if(index->filename)
+    free(index->filename);
+
+  free(index);
+}
+
+
+/**
+ * flickcurl_tag_index_save:
+ * @index: tag index
+ *
+ * Write a tag index to its file
+ *
+ * The file is replaced at once so a reader never sees part of it.
+ * An index kept in memory is not saved.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_tag_index_save(flickcurl_tag_index* index)
+{
+  flickcurl_tag_index_header header;
+  char* new_filename;
+  FILE* fh;
+  size_t i;
+  int failed = 0;
+
+  if(!index->filename)
+    return 0;
+
+  new_filename = (char*)malloc(strlen(index->filename) + 5);
+  if(!new_filename)
+    return 1;
+  sprintf(new_filename, "%s.new", index->filename);
+
+  fh = fopen(new_filename, "wb");
+  if(!fh) {
+    free(new_filename);
+    return 1;
+  }
+
+  memset(&header, '\0', sizeof(header));
+  memcpy(header.magic, FLICKCURL_TAG_INDEX_MAGIC, 8);
+  header.version = FLICKCURL_TAG_INDEX_VERSION;
+  header.byte_order = FLICKCURL_TAG_INDEX_BYTE_ORDER;
+  header.terms_count = (uint32_t)index->terms_count;
+  header.photos_count = (uint32_t)index->photos_count;
+  if(fwrite(&header, sizeof(header), 1, fh) != 1)
+    failed = 1;
+
+  for(i = 0; !failed && i < (size_t)index->terms_count; i++) {
+    flickcurl_tag_index_term* term = &index->terms[i];
+    uint32_t key_len = (uint32_t)strlen(term->key);
+    uint32_t count;
+    uint32_t postings_len;
+
+    if(flickcurl_tag_index_fold(term)) {
+      failed = 1;
+      break;
+    }
+    count = (uint32_t)term->count;
+    postings_len = (uint32_t)term->postings_len;
+
+    if(fwrite(&key_len, sizeof(key_len), 1, fh) != 1 ||
+       fwrite(term->key, 1, key_len, fh) != key_len ||
+       fwrite(&count, sizeof(count), 1, fh) != 1 ||
+       fwrite(&term->last, sizeof(term->last), 1, fh) != 1 ||
+       fwrite(&postings_len, sizeof(postings_len), 1, fh) != 1 ||
+       (postings_len &&
+        fwrite(term->postings, 1, postings_len, fh) != postings_len))
+      failed = 1;
+  }
+
+  /* only the live term lists are written */
+  for(i = 0; !failed && i < index->photo_slots_count; i++) {
+    flickcurl_tag_index_photo* photo = &index->photos[i];
+
+    if(!photo->id)
+      continue;
+    if(fwrite(&photo->id, sizeof(photo->id), 1, fh) != 1 ||
+       fwrite(&photo->length, sizeof(photo->length), 1, fh) != 1 ||
+       fwrite(index->forward + photo->offset, 1, photo->length, fh) !=
+         photo->length)
+      failed = 1;
+  }
+
+  if(fclose(fh))
+    failed = 1;
+  if(!failed)
+    failed = (rename(new_filename, index->filename) != 0);
+  if(failed)
+    remove(new_filename);
+
+  free(new_filename);
+  return failed;
+}
+
+
+/**
+ * flickcurl_tag_index_add_photo:
+ * @index: tag index
+ * @photo: photo with tags
+ *
+ * Add a photo to a tag index by its tags, replacing it if it is there
+ *
+ * The photo is indexed by the cooked form of each plain tag and by
+ * the namespace, predicate and value of each machine tag (raw form
+ * namespace:predicate=value), all compared ignoring ASCII case.  A
+ * photo with no tags is removed.  The photo ID must be numeric.  A
+ * lazy photo (see flickcurl_set_lazy_photos()) has no tags so it is
+ * refused rather than removed.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_tag_index_add_photo(flickcurl_tag_index* index,
+                              flickcurl_photo* photo)
+{
+  flickcurl_tag_index_photo* slot;
+  uint64_t id = flickcurl_tag_index_parse_id(photo->id);
+  int* terms = NULL;
+  int* old_terms = NULL;
+  int count = 0;
+  int old_count = 0;
+  int i;
+  int j;
+  int rc = 1;
+
+  if(!id || photo->lazy)
+    return 1;
+
+  /* at most three terms per tag */
+  terms = (int*)malloc((photo->tags_count * 3 + 1) * sizeof(int));
+  if(!terms)
+    return 1;
+  for(i = 0; i < photo->tags_count; i++) {
+    count = flickcurl_tag_index_tag_terms(index, photo->tags[i], terms, count);
+    if(count < 0)
+      goto tidy;
+  }
+
+  qsort(terms, count, sizeof(int), flickcurl_tag_index_compare_ints);
+  for(i = 0, j = 0; i < count; i++) {
+    if(!j || terms[j - 1] != terms[i])
+      terms[j++] = terms[i];
+  }
+  count = j;
+
+  if(flickcurl_tag_index_grow_photos(index))
+    goto tidy;
+  slot = flickcurl_tag_index_find_photo(index, id);
+  if(slot->id) {
+    old_count = flickcurl_tag_index_photo_terms(index, slot, &old_terms);
+    if(old_count < 0)
+      goto tidy;
+  }
+
+  /* walk the old and new sorted term lists together */
+  for(i = 0, j = 0; i < old_count || j < count; ) {
+    if(j == count || (i < old_count && old_terms[i] < terms[j])) {
+      if(flickcurl_tag_index_term_change(&index->terms[old_terms[i++]], id,
+                                          1))
+        goto tidy;
+    } else if(i == old_count || terms[j] < old_terms[i]) {
+      if(flickcurl_tag_index_term_change(&index->terms[terms[j++]], id, 0))
+        goto tidy;
+    } else {
+      i++;
+      j++;
+    }
+  }
+
+  if(!count) {
+    if(slot->id)
+      flickcurl_tag_index_remove_photo_slot(index, slot);
+  } else {
+    unsigned char* p;
+    int last = 0;
+
+    /* offsets in the block are 32 bits */
+    if(index->forward_len + count * FLICKCURL_TAG_INDEX_VARINT_SIZE >
+         (size_t)UINT32_MAX ||
+       flickcurl_tag_index_reserve(&index->forward, &index->forward_size,
+                                   index->forward_len,
+                                   count * FLICKCURL_TAG_INDEX_VARINT_SIZE))
+      goto tidy;
+    p = index->forward + index->forward_len;
+    for(i = 0; i < count; i++) {
+      p += flickcurl_tag_index_put_varint(p, (uint64_t)(terms[i] - last));
+      last = terms[i];
+    }
+
+    if(!slot->id) {
+      slot->id = id;
+      index->photos_count++;
+    }
+    slot->offset = (uint32_t)index->forward_len;
+    slot->length = (uint32_t)(p - (index->forward + index->forward_len));
+    index->forward_len += slot->length;
+  }
+
+  rc = 0;
+
+  tidy:
+  if(terms)
+    free(terms);
+  if(old_terms)
+    free(old_terms);
+  return rc;
+}
+
+
+/**
+ * flickcurl_tag_index_remove_photo:
+ * @index: tag index
+ * @photo_id: photo ID
+ *
+ * Remove a photo from a tag index
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_tag_index_remove_photo(flickcurl_tag_index* index,
+                                 const char* photo_id)
+{
+  flickcurl_tag_index_photo* slot;
+  uint64_t id = flickcurl_tag_index_parse_id(photo_id);
+  int* terms = NULL;
+  int count;
+  int i;
+
+  if(!id)
+    return 1;
+
+  slot = flickcurl_tag_index_find_photo(index, id);
+  if(!slot->id)
+    return 0;
+
+  count = flickcurl_tag_index_photo_terms(index, slot, &terms);
+  if(count < 0)
+    return 1;
+  for(i = 0; i < count; i++) {
+    if(flickcurl_tag_index_term_change(&index->terms[terms[i]], id, 1)) {
+      free(terms);
+      return 1;
+    }
+  }
+  free(terms);
+
+  flickcurl_tag_index_remove_photo_slot(index, slot);
+  return 0;
+}
+
+
+/**
+ * flickcurl_tag_index_get_counts:
+ * @index: tag index
+ * @photos_p: pointer to store the number of photos (or NULL)
+ * @terms_p: pointer to store the number of tags, namespaces, predicates and values (or NULL)
+ *
+ * Get the size of a tag index
+ */
+void
+flickcurl_tag_index_get_counts(flickcurl_tag_index* index, int* photos_p,
+                               int* terms_p)
+{
+  if(photos_p)
+    *photos_p = index->photos_count;
+  if(terms_p)
+    *terms_p = index->terms_count;
+}
+
+
+typedef struct {
+  const char* key;
+  int term;
+} flickcurl_tag_index_sort_item;
+
+
+static int
+flickcurl_tag_index_compare_terms(const void* a, const void* b)
+{
+  return strcmp(((const flickcurl_tag_index_sort_item*)a)->key,
+                ((const flickcurl_tag_index_sort_item*)b)->key);
+}
+
+
+static int
+flickcurl_tag_index_compare_ids(const void* a, const void* b)
+{
+  uint64_t ia = *(const uint64_t*)a;
+  uint64_t ib = *(const uint64_t*)b;
+
+  return (ia > ib) - (ia < ib);
+}
+
+
+/*
+ * Find the photos of the terms with @key, or starting with @key if
+ * @prefix is set, into @set.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+flickcurl_tag_index_lookup(flickcurl_tag_index* index, const char* key,
+                           int prefix, flickcurl_tag_index_set* set)
+{
+  size_t key_len = strlen(key);
+  size_t total = 0;
+  int low;
+  int high;
+  int i;
+
+  set->ids = NULL;
+  set->count = 0;
+
+  if(!prefix) {
+    int t = flickcurl_tag_index_find_term(index, key, key_len, 0);
+
+    if(t < 0)
+      return 0;
+    if(flickcurl_tag_index_fold(&index->terms[t]))
+      return 1;
+    if(!index->terms[t].count)
+      return 0;
+    set->ids = (uint64_t*)malloc(index->terms[t].count * sizeof(uint64_t));
+    if(!set->ids)
+      return 1;
+    flickcurl_tag_index_decode(&index->terms[t], set->ids);
+    set->count = index->terms[t].count;
+    return 0;
+  }
+
+  if(!index->order) {
+    flickcurl_tag_index_sort_item* items;
+
+    items = (flickcurl_tag_index_sort_item*)malloc((index->terms_count + 1) *
+                                                   sizeof(*items));
+    index->order = (int*)malloc((index->terms_count + 1) * sizeof(int));
+    if(!items || !index->order) {
+      if(items)
+        free(items);
+      if(index->order) {
+        free(index->order);
+        index->order = NULL;
+      }
+      return 1;
+    }
+
+    for(i = 0; i < index->terms_count; i++) {
+      items[i].key = index->terms[i].key;
+      items[i].term = i;
+    }
+    qsort(items, index->terms_count, sizeof(*items),
+          flickcurl_tag_index_compare_terms);
+    for(i = 0; i < index->terms_count; i++)
+      index->order[i] = items[i].term;
+    free(items);
+  }
+
+  /* first term not before @key */
+  low = 0;
+  high = index->terms_count;
+  while(low < high) {
+    int mid = (low + high) / 2;
+
+    if(strcmp(index->terms[index->order[mid]].key, key) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for(i = low; i < index->terms_count &&
+        !strncmp(index->terms[index->order[i]].key, key, key_len); i++) {
+    if(flickcurl_tag_index_fold(&index->terms[index->order[i]]))
+      return 1;
+    total += (size_t)index->terms[index->order[i]].count;
+  }
+  high = i;
+  if(!total)
+    return 0;
+
+  set->ids = (uint64_t*)malloc(total * sizeof(uint64_t));
+  if(!set->ids)
+    return 1;
+  for(i = low; i < high; i++) {
+    flickcurl_tag_index_term* term = &index->terms[index->order[i]];
+
+    flickcurl_tag_index_decode(term, set->ids + set->count);
+    set->count += term->count;
+  }
+
+  if(high - low > 1) {
+    int j;
+
+    qsort(set->ids, set->count, sizeof(uint64_t),
+          flickcurl_tag_index_compare_ids);
+    for(i = 0, j = 0; i < set->count; i++) {
+      if(!j || set->ids[j - 1] != set->ids[i])
+        set->ids[j++] = set->ids[i];
+    }
+    set->count = j;
+  }
+
+  return 0;
+}
+
+
+/* Intersect @set with @other into @set */
+static void
+flickcurl_tag_index_intersect(flickcurl_tag_index_set* set,
+                              flickcurl_tag_index_set* other)
+{
+  int count = 0;
+  int j = 0;
+  int i;
+
+  for(i = 0; i < set->count && j < other->count; i++) {
+    uint64_t id = set->ids[i];
+    int step = 1;
+    int high;
+
+    /* gallop through @other then search the last step */
+    while(j + step < other->count && other->ids[j + step] < id) {
+      j += step;
+      step *= 2;
+    }
+    high = (j + step < other->count) ? j + step : other->count - 1;
+    while(j < high) {
+      int mid = (j + high) / 2;
+
+      if(other->ids[mid] < id)
+        j = mid + 1;
+      else
+        high = mid;
+    }
+
+    if(other->ids[j] == id)
+      set->ids[count++] = id;
+  }
+
+  set->count = count;
+}
+
+
+/* Unite @set with @other into @set; return non-0 on failure */
+static int
+flickcurl_tag_index_unite(flickcurl_tag_index_set* set,
+                          flickcurl_tag_index_set* other)
+{
+  uint64_t* ids;
+  int count = 0;
+  int i = 0;
+  int j = 0;
+
+  if(!other->count)
+    return 0;
+
+  ids = (uint64_t*)malloc((set->count + other->count) * sizeof(uint64_t));
+  if(!ids)
+    return 1;
+
+  while(i < set->count || j < other->count) {
+    if(j == other->count ||
+       (i < set->count && set->ids[i] < other->ids[j]))
+      ids[count++] = set->ids[i++];
+    else if(i == set->count || other->ids[j] < set->ids[i])
+      ids[count++] = other->ids[j++];
+    else {
+      ids[count++] = set->ids[i++];
+      j++;
+    }
+  }
+
+  if(set->ids)
+    free(set->ids);
+  set->ids = ids;
+  set->count = count;
+
+  return 0;
+}
+
+
+/*
+ * Make the term key of query item @item of @len bytes into @key,
+ * setting *@prefix_p if it ends in *.
+ *
+ * Return value: non-0 if the item is not valid
+ */
+static int
+flickcurl_tag_index_query_key(const char* item, size_t len, int machine,
+                              char* key, int* prefix_p)
+{
+  const char* colon;
+  const char* equals;
+  char type;
+
+  *prefix_p = 0;
+  if(len && item[len - 1] == '*') {
+    *prefix_p = 1;
+    len--;
+  }
+
+  if(!machine) {
+    if(!len && !*prefix_p)
+      return 1;
+    flickcurl_tag_index_make_key(key, FLICKCURL_TAG_INDEX_TAG, item, len);
+    return 0;
+  }
+
+  colon = memchr(item, ':', len);
+  if(!colon || colon == item)
+    return 1;
+  equals = memchr(colon, '=', len - (colon - item));
+
+  if(colon + 1 == item + len || (colon[1] == '*' && (colon + 2 == item + len ||
+                                                     colon + 2 == equals))) {
+    /* namespace:, namespace:* or namespace:*= with any value */
+    *prefix_p = 0;
+    type = FLICKCURL_TAG_INDEX_NAMESPACE;
+    len = colon - item;
+  } else if(!equals || equals + 1 == item + len) {
+    /* namespace:predicate, namespace:predicate= or with any value */
+    if(equals) {
+      *prefix_p = 0;
+      len = equals - item;
+    }
+    type = FLICKCURL_TAG_INDEX_PREDICATE;
+  } else
+    type = FLICKCURL_TAG_INDEX_VALUE;
+
+  flickcurl_tag_index_make_key(key, type, item, len);
+  return 0;
+}
+
+
+/*
+ * Evaluate the comma-separated @items as an AND if @all else an OR
+ * into @set.
+ *
+ * Return value: non-0 on failure or for a bad item
+ */
+static int
+flickcurl_tag_index_query(flickcurl_tag_index* index, const char* items,
+                          int machine, int all, flickcurl_tag_index_set* set)
+{
+  char* key;
+  int first = 1;
+  int rc = 1;
+
+  set->ids = NULL;
+  set->count = 0;
+
+  key = (char*)malloc(strlen(items) + 2);
+  if(!key)
+    return 1;
+
+  while(*items) {
+    flickcurl_tag_index_set item_set;
+    const char* end;
+    size_t len;
+    int prefix;
+
+    while(*items == ' ')
+      items++;
+    for(end = items; *end && *end != ','; end++)
+      ;
+    for(len = end - items; len && items[len - 1] == ' '; len--)
+      ;
+    if(!len) {
+      items = *end ? end + 1 : end;
+      continue;
+    }
+
+    if(flickcurl_tag_index_query_key(items, len, machine, key, &prefix) ||
+       flickcurl_tag_index_lookup(index, key, prefix, &item_set))
+      goto tidy;
+
+    if(first) {
+      *set = item_set;
+      first = 0;
+    } else if(all) {
+      /* walk the smaller set */
+      if(item_set.count < set->count) {
+        flickcurl_tag_index_set swap = *set;
+
+        *set = item_set;
+        item_set = swap;
+      }
+      flickcurl_tag_index_intersect(set, &item_set);
+    } else if(flickcurl_tag_index_unite(set, &item_set)) {
+      if(item_set.ids)
+        free(item_set.ids);
+      goto tidy;
+    }
+    if(!first && item_set.ids && item_set.ids != set->ids)
+      free(item_set.ids);
+
+    /* nothing more can match */
+    if(all && !set->count)
+      break;
+
+    items = *end ? end + 1 : end;
+  }
+
+  rc = 0;
+
+  tidy:
+  free(key);
+  return rc;
+}
+
+
+/**
+ * flickcurl_tag_index_search:
+ * @index: tag index
+ * @tags: comma-separated list of tags (or NULL)
+ * @tag_mode: "all" for photos with all of @tags or "any" (or NULL) for any
+ * @machine_tags: comma-separated list of machine tags (or NULL)
+ * @machine_tag_mode: "all" for photos with all of @machine_tags or "any" (or NULL) for any
+ * @count_p: pointer to store the number of photos found (or NULL)
+ *
+ * Find the photos in a tag index with some tags and machine tags
+ *
+ * The parameters follow flickr.photos.search: when both @tags and
+ * @machine_tags are given a photo must match both.  A tag ending in
+ * * matches every tag starting with it.  A machine tag may be
+ * namespace:predicate=value (a value ending in * matches by
+ * prefix), namespace:predicate= or namespace:predicate for any value
+ * and namespace: or namespace:* for any predicate.
+ *
+ * Return value: array of photo IDs in increasing order, to free with flickcurl_array_free(), or NULL on failure or a bad query
+ */
+char**
+flickcurl_tag_index_search(flickcurl_tag_index* index, const char* tags,
+                           const char* tag_mode, const char* machine_tags,
+                           const char* machine_tag_mode, int* count_p)
+{
+  flickcurl_tag_index_set set;
+  flickcurl_tag_index_set machine_set;
+  char** ids;
+  int i;
+
+  set.ids = NULL;
+  set.count = 0;
+  machine_set.ids = NULL;
+  machine_set.count = 0;
+
+  if(!tags && !machine_tags)
+    return NULL;
+
+  if(tags &&
+     flickcurl_tag_index_query(index, tags, 0,
+                               tag_mode && !strcmp(tag_mode, "all"), &set))
+    goto failed;
+
+  if(machine_tags && (!tags || set.count)) {
+    if(flickcurl_tag_index_query(index, machine_tags, 1,
+                                 machine_tag_mode &&
+                                 !strcmp(machine_tag_mode, "all"),
+                                 &machine_set))
+      goto failed;
+
+    if(!tags) {
+      set = machine_set;
+      machine_set.ids = NULL;
+    } else
+      flickcurl_tag_index_intersect(&set, &machine_set);
+  }
+
+  ids = (char**)calloc(set.count + 1, sizeof(char*));
+  if(!ids)
+    goto failed;
+  for(i = 0; i < set.count; i++) {
+    ids[i] = flickcurl_tag_index_format_id(set.ids[i]);
+    if(!ids[i]) {
+      flickcurl_array_free(ids);
+      goto failed;
+    }
+  }
+
+  if(count_p)
+    *count_p = set.count;
+  if(set.ids)
+    free(set.ids);
+  if(machine_set.ids)
+    free(machine_set.ids);
+  return ids;
+
+  failed:
+  if(set.ids)
+    free(set.ids);
+  if(machine_set.ids)
+    free(machine_set.ids);
+  return NULL;
+}
+
+#endif /* !STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+#define TAG_INDEX_TEST_FILE "flickcurl_tagindex_test.idx"
+#define TAG_INDEX_TEST_FOLD_IDS 1000
+
+
+/* Make a photo @id with the raw tags @raw_tags */
+static void
+tag_index_test_photo(flickcurl_photo* photo, flickcurl_tag** tag_ptrs,
+                     flickcurl_tag* tags, const char* id,
+                     const char** raw_tags)
+{
+  int i;
+
+  memset(photo, '\0', sizeof(*photo));
+  photo->id = (char*)id;
+  for(i = 0; raw_tags[i]; i++) {
+    memset(&tags[i], '\0', sizeof(tags[i]));
+    tags[i].raw = (char*)raw_tags[i];
+    tag_ptrs[i] = &tags[i];
+  }
+  tag_ptrs[i] = NULL;
+  photo->tags = tag_ptrs;
+  photo->tags_count = i;
+}
+
+
+static int
+tag_index_test_add(flickcurl_tag_index* index, const char* id,
+                   const char** raw_tags)
+{
+  flickcurl_photo photo;
+  flickcurl_tag* tag_ptrs[4];
+  flickcurl_tag tags[3];
+
+  tag_index_test_photo(&photo, tag_ptrs, tags, id, raw_tags);
+  if(flickcurl_tag_index_add_photo(index, &photo)) {
+    fprintf(stderr, "%s: FAIL\n  photo %s could not be added\n", program, id);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Check a search gives the comma-separated photo IDs @expected */
+static int
+tag_index_test_search(flickcurl_tag_index* index, const char* tags,
+                      const char* machine_tags, const char* expected)
+{
+  char** ids;
+  char* result;
+  size_t len = 1;
+  int failed;
+  int i;
+
+  ids = flickcurl_tag_index_search(index, tags, NULL, machine_tags, NULL,
+                                   NULL);
+  if(!ids) {
+    fprintf(stderr, "%s: FAIL\n  search tags '%s' machine tags '%s' failed\n",
+            program, tags ? tags : "", machine_tags ? machine_tags : "");
+    return 1;
+  }
+
+  for(i = 0; ids[i]; i++)
+    len += strlen(ids[i]) + 1;
+  result = (char*)malloc(len);
+  if(!result) {
+    flickcurl_array_free(ids);
+    return 1;
+  }
+  *result = '\0';
+  for(i = 0; ids[i]; i++) {
+    if(i)
+      strcat(result, ",");
+    strcat(result, ids[i]);
+  }
+
+  failed = strcmp(result, expected) != 0;
+  if(failed) {
+    const char* shown = result;
+
+    if(strlen(shown) > 60)
+      shown = "(long list)";
+    fprintf(stderr, "%s: FAIL\n  search tags '%s' machine tags '%s' gave\n"
+            "    %s\n  expected\n    %.60s\n", program,
+            tags ? tags : "", machine_tags ? machine_tags : "", shown,
+            expected);
+  }
+
+  free(result);
+  flickcurl_array_free(ids);
+  return failed;
+}
+
+
+/* Photo IDs whose deltas need 1 to 10 varint bytes */
+static const char* tag_index_varint_ids[] = {
+  "1", "127", "128", "16383", "16384", "4294967295", "4294967296",
+  "9223372036854775807", "18446744073709551615", NULL
+};
+
+static const char* tag_index_varint_expected =
+  "1,127,128,16383,16384,4294967295,4294967296,"
+  "9223372036854775807,18446744073709551615";
+
+
+/* Machine tags of photos 201 to 203; those of 203 are not machine tags */
+static const char* tag_index_machine_tags[3][3] = {
+  { "Geo:Lat=\"51.5\"", "dc:title=x", NULL },
+  { "geo:lon=0.1", NULL, NULL },
+  { "geo:lat", "a:=b", NULL }
+};
+
+static const struct {
+  const char* tags;
+  const char* machine_tags;
+  const char* expected;
+} tag_index_machine_tests[] = {
+  { NULL, "geo:", "201,202" },
+  { NULL, "geo:*", "201,202" },
+  { NULL, "geo:lat", "201" },
+  { NULL, "geo:lat=", "201" },
+  { NULL, "geo:lat=51.5", "201" },
+  { NULL, "geo:lat=51*", "201" },
+  { NULL, "GEO:LON=0.1", "202" },
+  { NULL, "geo:lat=52", "" },
+  { NULL, "dc:title=x", "201" },
+  { "geo:lat", NULL, "203" },
+  { "a:=b", NULL, "203" },
+  { NULL, NULL, NULL }
+};
+
+
+static int
+test_tag_index_varints(flickcurl_tag_index* index)
+{
+  static const char* big_tags[] = { "big", NULL };
+  int failures = 0;
+  int i;
+
+  for(i = 0; tag_index_varint_ids[i]; i++)
+    failures += tag_index_test_add(index, tag_index_varint_ids[i], big_tags);
+
+  failures += tag_index_test_search(index, "big", NULL,
+                                    tag_index_varint_expected);
+  return failures;
+}
+
+
+/*
+ * Add photos in decreasing ID order so that each is a pending change
+ * folded into the postings, then remove and add some again.
+ */
+static int
+test_tag_index_fold(flickcurl_tag_index* index, char* expected)
+{
+  static const char* fold_tags[] = { "fold", NULL };
+  int present[TAG_INDEX_TEST_FOLD_IDS + 1];
+  char id[16];
+  int failures = 0;
+  int i;
+
+  for(i = TAG_INDEX_TEST_FOLD_IDS; i > 0; i--) {
+    sprintf(id, "%d", i + 100000);
+    failures += tag_index_test_add(index, id, fold_tags);
+    present[i] = 1;
+  }
+
+  for(i = 1; i <= TAG_INDEX_TEST_FOLD_IDS; i += 3) {
+    sprintf(id, "%d", i + 100000);
+    if(flickcurl_tag_index_remove_photo(index, id)) {
+      fprintf(stderr, "%s: FAIL\n  photo %s could not be removed\n", program,
+              id);
+      failures++;
+    }
+    present[i] = 0;
+  }
+
+  for(i = TAG_INDEX_TEST_FOLD_IDS; i > 0; i -= 9) {
+    sprintf(id, "%d", i + 100000);
+    failures += tag_index_test_add(index, id, fold_tags);
+    present[i] = 1;
+  }
+
+  *expected = '\0';
+  for(i = 1; i <= TAG_INDEX_TEST_FOLD_IDS; i++) {
+    if(present[i]) {
+      if(*expected)
+        strcat(expected, ",");
+      sprintf(id, "%d", i + 100000);
+      strcat(expected, id);
+    }
+  }
+
+  failures += tag_index_test_search(index, "fold", NULL, expected);
+  return failures;
+}
+
+
+static int
+test_tag_index_machine_tags(flickcurl_tag_index* index)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; i < 3; i++) {
+    char id[4];
+
+    sprintf(id, "%d", 201 + i);
+    failures += tag_index_test_add(index, id, tag_index_machine_tags[i]);
+  }
+
+  for(i = 0; tag_index_machine_tests[i].expected; i++)
+    failures += tag_index_test_search(index, tag_index_machine_tests[i].tags,
+                                      tag_index_machine_tests[i].machine_tags,
+                                      tag_index_machine_tests[i].expected);
+  return failures;
+}
+
+
+/*
+ * Offsets in the file of an index of photo 1 tagged "a": the header,
+ * then term "ta" with its photo count, last ID, postings length and
+ * the 1 byte posting, then the photo ID, terms length and the 1 byte
+ * term number.
+ */
+#define TAG_INDEX_TEST_COUNT (8 + 4 * 4 + 4 + 2)
+#define TAG_INDEX_TEST_POSTING (TAG_INDEX_TEST_COUNT + 4 + 8 + 4)
+#define TAG_INDEX_TEST_TERM (TAG_INDEX_TEST_POSTING + 1 + 8 + 4)
+#define TAG_INDEX_TEST_SIZE (TAG_INDEX_TEST_TERM + 1)
+
+static const struct {
+  const char* label;
+  size_t offset;
+  unsigned char byte;
+} tag_index_damage_tests[] = {
+  { "photo count past the postings", TAG_INDEX_TEST_COUNT, 2 },
+  { "posting running past the postings", TAG_INDEX_TEST_POSTING, 0x81 },
+  { "posting not the last ID", TAG_INDEX_TEST_POSTING, 2 },
+  { "term number past the terms", TAG_INDEX_TEST_TERM, 1 },
+  { NULL, 0, 0 }
+};
+
+
+/* Check a damaged index file is refused and a lazy photo is not added */
+static int
+test_tag_index_damage(void)
+{
+  static const char* a_tags[] = { "a", NULL };
+  unsigned char block[TAG_INDEX_TEST_SIZE];
+  flickcurl_tag_index* index;
+  flickcurl_photo photo;
+  flickcurl_tag* tag_ptrs[2];
+  flickcurl_tag tags[1];
+  FILE* fh;
+  int failures = 0;
+  int i;
+
+  remove(TAG_INDEX_TEST_FILE);
+  index = flickcurl_new_tag_index(TAG_INDEX_TEST_FILE);
+  if(!index)
+    return 1;
+  failures += tag_index_test_add(index, "1", a_tags);
+
+  /* a lazy photo has no tags; adding it must not remove photo 1 */
+  tag_index_test_photo(&photo, tag_ptrs, tags, "1", a_tags + 1);
+  photo.lazy = (struct flickcurl_photo_lazy_s*)&photo;
+  if(!flickcurl_tag_index_add_photo(index, &photo)) {
+    fprintf(stderr, "%s: FAIL\n  lazy photo was added\n", program);
+    failures++;
+  }
+  failures += tag_index_test_search(index, "a", NULL, "1");
+
+  if(flickcurl_tag_index_save(index))
+    failures++;
+  flickcurl_free_tag_index(index);
+
+  fh = fopen(TAG_INDEX_TEST_FILE, "rb");
+  if(!fh)
+    return failures + 1;
+  i = (fread(block, 1, sizeof(block), fh) != sizeof(block) ||
+       fgetc(fh) != EOF);
+  fclose(fh);
+  if(i) {
+    fprintf(stderr, "%s: FAIL\n  index file is not %d bytes\n", program,
+            (int)sizeof(block));
+    return failures + 1;
+  }
+
+  for(i = 0; tag_index_damage_tests[i].label; i++) {
+    unsigned char damaged[TAG_INDEX_TEST_SIZE];
+
+    memcpy(damaged, block, sizeof(block));
+    damaged[tag_index_damage_tests[i].offset] = tag_index_damage_tests[i].byte;
+    fh = fopen(TAG_INDEX_TEST_FILE, "wb");
+    if(!fh)
+      return failures + 1;
+    fwrite(damaged, 1, sizeof(damaged), fh);
+    fclose(fh);
+
+    index = flickcurl_new_tag_index(TAG_INDEX_TEST_FILE);
+    if(index) {
+      fprintf(stderr, "%s: FAIL\n  index with %s was read\n", program,
+              tag_index_damage_tests[i].label);
+      failures++;
+      flickcurl_free_tag_index(index);
+    }
+  }
+
+  remove(TAG_INDEX_TEST_FILE);
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  flickcurl_tag_index* index;
+  char* fold_expected;
+  int failures = 0;
+  int i;
+
+  program = "flickcurl_tagindex_test";
+
+  /* 6 digits and a comma per ID */
+  fold_expected = (char*)malloc(TAG_INDEX_TEST_FOLD_IDS * 7 + 1);
+  if(!fold_expected)
+    return 1;
+
+  remove(TAG_INDEX_TEST_FILE);
+
+  index = flickcurl_new_tag_index(TAG_INDEX_TEST_FILE);
+  if(!index) {
+    fprintf(stderr, "%s: FAIL\n  index could not be made\n", program);
+    free(fold_expected);
+    return 1;
+  }
+
+  failures += test_tag_index_varints(index);
+  failures += test_tag_index_fold(index, fold_expected);
+  failures += test_tag_index_machine_tags(index);
+
+  if(flickcurl_tag_index_save(index)) {
+    fprintf(stderr, "%s: FAIL\n  index could not be saved\n", program);
+    failures++;
+  }
+  flickcurl_free_tag_index(index);
+
+  /* the same searches on the index read back from its file */
+  index = flickcurl_new_tag_index(TAG_INDEX_TEST_FILE);
+  if(!index) {
+    fprintf(stderr, "%s: FAIL\n  saved index could not be read\n", program);
+    failures++;
+  } else {
+    failures += tag_index_test_search(index, "big", NULL,
+                                      tag_index_varint_expected);
+    failures += tag_index_test_search(index, "fold", NULL, fold_expected);
+    for(i = 0; tag_index_machine_tests[i].expected; i++)
+      failures += tag_index_test_search(index, tag_index_machine_tests[i].tags,
+                                        tag_index_machine_tests[i].machine_tags,
+                                        tag_index_machine_tests[i].expected);
+    flickcurl_free_tag_index(index);
+  }
+
+  remove(TAG_INDEX_TEST_FILE);
+  free(fold_expected);
+
+  failures += test_tag_index_damage();
+
+  return failures;
+}
+#endif
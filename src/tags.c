@@ -31,10 +31,295 @@
 #include <win32_flickcurl_config.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include <flickcurl.h>
 #include <flickcurl_internal.h>
 
 
+/* Initial number of buckets in a tag intern table (a power of 2) */
+#define FLICKCURL_TAG_INTERN_INITIAL_SIZE 256
+
+
+/* One shared tag string */
+typedef struct flickcurl_tag_intern_string_s {
+  struct flickcurl_tag_intern_string_s* next;
+  unsigned long hash;
+  size_t len;
+  /* NUL-terminated string; the struct is allocated to fit it */
+  char string[1];
+} flickcurl_tag_intern_string;
+
+
+/*
+ * A table of tag raw and cooked strings shared by every tag built
+ * while it was set on a session.  Strings are kept until the table
+ * is freed, which is when the session and all the tags using it are
+ * gone.  Tags may be built and freed in several threads.
+ */
+struct flickcurl_tag_intern_s {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+  /* references: the session and each tag */
+  int usage;
+
+  flickcurl_tag_intern_string** buckets;
+  /* number of buckets, a power of 2 */
+  size_t size;
+  size_t count;
+};
+
+
+static flickcurl_tag_intern*
+flickcurl_new_tag_intern(void)
+{
+  flickcurl_tag_intern* ti;
+
+  ti = (flickcurl_tag_intern*)calloc(1, sizeof(*ti));
+  if(!ti)
+    return NULL;
+
+  ti->size = FLICKCURL_TAG_INTERN_INITIAL_SIZE;
+  ti->buckets = (flickcurl_tag_intern_string**)calloc(ti->size,
+                                                      sizeof(*ti->buckets));
+  if(!ti->buckets) {
+    free(ti);
+    return NULL;
+  }
+
+#ifdef HAVE_PTHREAD
+  if(pthread_mutex_init(&ti->lock, NULL)) {
+    free(ti->buckets);
+    free(ti);
+    return NULL;
+  }
+#endif
+
+  ti->usage = 1;
+
+  return ti;
+}
+
+
+/*
+ * flickcurl_release_tag_intern:
+ * @ti: tag intern table
+ *
+ * INTERNAL - Release a reference to a tag intern table, freeing it with the last
+ */
+void
+flickcurl_release_tag_intern(flickcurl_tag_intern* ti)
+{
+  size_t i;
+  int usage;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&ti->lock);
+#endif
+  usage = --ti->usage;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&ti->lock);
+#endif
+  if(usage)
+    return;
+
+  for(i = 0; i < ti->size; i++) {
+    flickcurl_tag_intern_string* is;
+    flickcurl_tag_intern_string* next;
+
+    for(is = ti->buckets[i]; is; is = next) {
+      next = is->next;
+      free(is);
+    }
+  }
+  free(ti->buckets);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&ti->lock);
+#endif
+  free(ti);
+}
+
+
+/* Double the buckets of @ti; on failure the table stays as it is */
+static void
+flickcurl_tag_intern_grow(flickcurl_tag_intern* ti)
+{
+  flickcurl_tag_intern_string** buckets;
+  size_t size = ti->size * 2;
+  size_t i;
+
+  buckets = (flickcurl_tag_intern_string**)calloc(size, sizeof(*buckets));
+  if(!buckets)
+    return;
+
+  for(i = 0; i < ti->size; i++) {
+    flickcurl_tag_intern_string* is;
+    flickcurl_tag_intern_string* next;
+
+    for(is = ti->buckets[i]; is; is = next) {
+      next = is->next;
+      is->next = buckets[is->hash & (size - 1)];
+      buckets[is->hash & (size - 1)] = is;
+    }
+  }
+
+  free(ti->buckets);
+  ti->buckets = buckets;
+  ti->size = size;
+}
+
+
+/* Find or add a string; call with the table locked */
+static char*
+flickcurl_tag_intern_string_locked(flickcurl_tag_intern* ti,
+                                   const char* string, size_t len)
+{
+  flickcurl_tag_intern_string* is;
+  unsigned long hash = 2166136261UL;
+  size_t i;
+
+  /* FNV-1a */
+  for(i = 0; i < len; i++)
+    hash = ((hash ^ (unsigned char)string[i]) * 16777619UL) & 0xffffffffUL;
+
+  for(is = ti->buckets[hash & (ti->size - 1)]; is; is = is->next) {
+    if(is->hash == hash && is->len == len && !memcmp(is->string, string, len))
+      return is->string;
+  }
+
+  is = (flickcurl_tag_intern_string*)malloc(sizeof(*is) + len);
+  if(!is)
+    return NULL;
+
+  is->hash = hash;
+  is->len = len;
+  memcpy(is->string, string, len);
+  is->string[len] = '\0';
+
+  if(ti->count >= ti->size)
+    flickcurl_tag_intern_grow(ti);
+
+  is->next = ti->buckets[hash & (ti->size - 1)];
+  ti->buckets[hash & (ti->size - 1)] = is;
+  ti->count++;
+
+  return is->string;
+}
+
+
+/* Tag string fields set by flickcurl_tag_set_strings() */
+typedef enum {
+  TAG_STRING_AUTHOR,
+  TAG_STRING_AUTHORNAME,
+  TAG_STRING_RAW,
+  TAG_STRING_COOKED,
+  TAG_STRING_LAST = TAG_STRING_COOKED
+} flickcurl_tag_string_field;
+
+
+/*
+ * Set the author, author name, raw and cooked strings of tag @t from
+ * @values, shared through the session's intern table if it has one
+ * and otherwise copied.  NULL values are not set.  @lens gives the
+ * lengths of the values or is NULL when they are NUL-terminated.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+flickcurl_tag_set_strings(flickcurl* fc, flickcurl_tag* t,
+                          const char* values[TAG_STRING_LAST + 1],
+                          const size_t* lens)
+{
+  flickcurl_tag_intern* ti = fc->tag_intern;
+  char** fields[TAG_STRING_LAST + 1];
+  int failed = 0;
+  int i;
+
+  fields[TAG_STRING_AUTHOR] = &t->author;
+  fields[TAG_STRING_AUTHORNAME] = &t->authorname;
+  fields[TAG_STRING_RAW] = &t->raw;
+  fields[TAG_STRING_COOKED] = &t->cooked;
+
+#ifdef HAVE_PTHREAD
+  if(ti)
+    pthread_mutex_lock(&ti->lock);
+#endif
+
+  for(i = 0; i <= TAG_STRING_LAST; i++) {
+    size_t len;
+
+    if(!values[i])
+      continue;
+
+    len = lens ? lens[i] : strlen(values[i]);
+    if(ti)
+      *fields[i] = flickcurl_tag_intern_string_locked(ti, values[i], len);
+    else {
+      *fields[i] = (char*)malloc(len + 1);
+      if(*fields[i]) {
+        memcpy(*fields[i], values[i], len);
+        (*fields[i])[len] = '\0';
+      }
+    }
+    if(!*fields[i])
+      failed = 1;
+  }
+
+  if(ti) {
+    t->intern = ti;
+    ti->usage++;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&ti->lock);
+#endif
+  }
+
+  if(failed)
+    flickcurl_error(fc, "Out of memory");
+
+  return failed;
+}
+
+
+/**
+ * flickcurl_set_tag_interning:
+ * @fc: flickcurl object
+ * @intern_tags: non-0 to share tag strings between tags
+ *
+ * Set tags to share identical raw and cooked strings
+ *
+ * Tags built after this share one copy of each distinct author,
+ * author name, raw and cooked string, so two tags with the same text
+ * have the same @cooked pointer.  This saves a lot of memory when the same few
+ * thousand tags appear on many photos.  The shared strings are kept
+ * until the session and all the tags built with them are freed, and
+ * must not be changed or freed except by flickcurl_free_tag().
+ *
+ * Turning interning off makes later tags have their own strings.
+ * The default is off.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_tag_interning(flickcurl* fc, int intern_tags)
+{
+  if(intern_tags) {
+    if(!fc->tag_intern) {
+      fc->tag_intern = flickcurl_new_tag_intern();
+      if(!fc->tag_intern)
+        return 1;
+    }
+  } else if(fc->tag_intern) {
+    flickcurl_release_tag_intern(fc->tag_intern);
+    fc->tag_intern = NULL;
+  }
+
+  return 0;
+}
+
+
 /**
  * flickcurl_free_tag:
  * @t: tag object
@@ -48,14 +333,18 @@ flickcurl_free_tag(flickcurl_tag *t)
 
   if(t->id)
     free(t->id);
-  if(t->author)
-    free(t->author);
-  if(t->authorname)
-    free(t->authorname);
-  if(t->raw)
-    free(t->raw);
-  if(t->cooked)
-    free(t->cooked);
+  if(t->intern)
+    flickcurl_release_tag_intern(t->intern);
+  else {
+    if(t->author)
+      free(t->author);
+    if(t->authorname)
+      free(t->authorname);
+    if(t->raw)
+      free(t->raw);
+    if(t->cooked)
+      free(t->cooked);
+  }
   free(t);
 }
 
@@ -109,6 +398,7 @@ flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo,
     flickcurl_tag* t;
     int saw_clean = 0;
     xmlNodePtr chnode;
+    const char* values[TAG_STRING_LAST + 1] = { NULL, NULL, NULL, NULL };
     
     if(node->type != XML_ELEMENT_NODE) {
       flickcurl_error(fc, "Got unexpected node type %d", node->type);
@@ -124,24 +414,31 @@ flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo,
       const char *attr_name = (const char*)attr->name;
       char *attr_value;
 
+      /* strings that may be shared are set from the DOM below */
+      if(!strcmp(attr_name, "author")) {
+        values[TAG_STRING_AUTHOR] = (const char*)attr->children->content;
+        continue;
+      } else if(!strcmp(attr_name, "authorname")) {
+        values[TAG_STRING_AUTHORNAME] = (const char*)attr->children->content;
+        continue;
+      } else if(!strcmp(attr_name, "raw")) {
+        values[TAG_STRING_RAW] = (const char*)attr->children->content;
+        continue;
+      } else if(!strcmp(attr_name, "clean")) {
+        values[TAG_STRING_COOKED] = (const char*)attr->children->content;
+        /* If we see @clean we are expecting
+         * <tag clean = "cooked"><raw>raw</raw></tag>
+         */
+        saw_clean = 1;
+        continue;
+      }
+
       attr_value = (char*)malloc(attr_len + 1);
       memcpy(attr_value, attr->children->content, attr_len + 1);
       
       if(!strcmp(attr_name, "id"))
         t->id = attr_value;
-      else if(!strcmp(attr_name, "author"))
-        t->author = attr_value;
-      else if(!strcmp(attr_name, "authorname"))
-        t->authorname = attr_value;
-      else if(!strcmp(attr_name, "raw"))
-        t->raw = attr_value;
-      else if(!strcmp(attr_name, "clean")) {
-        t->cooked = attr_value;
-        /* If we see @clean we are expecting
-         * <tag clean = "cooked"><raw>raw</raw></tag>
-         */
-        saw_clean = 1;
-      } else if(!strcmp(attr_name, "machine_tag")) {
+      else if(!strcmp(attr_name, "machine_tag")) {
         t->machine_tag = atoi(attr_value);
         free(attr_value);
       } else if(!strcmp(attr_name, "count")) {
@@ -159,19 +456,19 @@ flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo,
     for(chnode = node->children; chnode; chnode = chnode->next) {
       const char *chnode_name = (const char*)chnode->name;
       if(chnode->type == XML_ELEMENT_NODE) {
-        if(saw_clean && !strcmp(chnode_name, "raw")) {
-          size_t len = strlen((const char*)chnode->children->content);
-          t->raw = (char*)malloc(len + 1);
-          memcpy(t->raw, chnode->children->content, len + 1);
-        }
+        if(saw_clean && !strcmp(chnode_name, "raw"))
+          values[TAG_STRING_RAW] = (const char*)chnode->children->content;
       } else if(chnode->type == XML_TEXT_NODE) {
-        if(!saw_clean) {
-          size_t len = strlen((const char*)chnode->content);
-          t->cooked = (char*)malloc(len + 1);
-          memcpy(t->cooked, chnode->content, len + 1);
-        }
+        if(!saw_clean)
+          values[TAG_STRING_COOKED] = (const char*)chnode->content;
       }
     }
+
+    if(flickcurl_tag_set_strings(fc, t, values, NULL)) {
+      flickcurl_free_tag(t);
+      fc->failed = 1;
+      break;
+    }
     
 #if FLICKCURL_DEBUG > 1
     fprintf(stderr, "tag: id %s author ID %s name %s raw '%s' cooked '%s' count %d\n",
@@ -200,48 +497,71 @@ flickcurl_build_tags_from_string(flickcurl* fc, flickcurl_photo* photo,
                                  const char *string, int *tag_count_p)
 {
   flickcurl_tag** tags = NULL;
-  int nodes_count;
-  int tag_count;
-  int i;
+  int tags_size = 8;
+  int tag_count = 0;
+  const char* p = string;
   
-  nodes_count = 0;
-  for(i = 0; string[i]; i++) {
-    if(string[i] == ' ')
-      nodes_count++;
-  }
-  
-  tags = (flickcurl_tag**)calloc(nodes_count+1, sizeof(flickcurl_tag*));
+  tags = (flickcurl_tag**)calloc(tags_size + 1, sizeof(flickcurl_tag*));
+  if(!tags)
+    goto failed;
   
-  for(i = 0, tag_count = 0; i < nodes_count; i++) {
+  /* one pass over the space-separated tags */
+  while(*p) {
     flickcurl_tag* t;
-    const char *p = string;
-    size_t len;
-    
-    t = (flickcurl_tag*)calloc(1, sizeof(flickcurl_tag));
-    t->photo = photo;
+    const char* start;
+    const char* values[TAG_STRING_LAST + 1] = { NULL, NULL, NULL, NULL };
+    size_t lens[TAG_STRING_LAST + 1] = { 0, 0, 0, 0 };
 
+    while(*p == ' ')
+      p++;
+    if(!*p)
+      break;
+
+    start = p;
     while(*p && *p != ' ')
       p++;
+
+    if(tag_count == tags_size) {
+      flickcurl_tag** new_tags;
+
+      new_tags = (flickcurl_tag**)realloc(tags, (tags_size * 2 + 1) *
+                                                sizeof(flickcurl_tag*));
+      if(!new_tags)
+        goto failed;
+      tags = new_tags;
+      tags_size *= 2;
+    }
     
-    len = p-string;
+    t = (flickcurl_tag*)calloc(1, sizeof(flickcurl_tag));
+    if(!t)
+      goto failed;
+    t->photo = photo;
 
-    t->cooked = (char*)malloc(len + 1);
-    memcpy(t->cooked, string, len);
-    t->cooked[len] = '\0';
+    values[TAG_STRING_COOKED] = start;
+    lens[TAG_STRING_COOKED] = p - start;
+
+    if(flickcurl_tag_set_strings(fc, t, values, lens)) {
+      flickcurl_free_tag(t);
+      goto failed;
+    }
     
     if(fc->tag_handler)
       fc->tag_handler(fc->tag_data, t);
     
     tags[tag_count++] = t;
-
-    /* move past space */
-    string = p+1;
+    tags[tag_count] = NULL;
   }
 
   if(tag_count_p)
     *tag_count_p = tag_count;
   
   return tags;
+
+  failed:
+  if(tags)
+    flickcurl_free_tags(tags);
+  fc->failed = 1;
+  return NULL;
 }
 
 
@@ -0,0 +1,691 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * triples.c - Buffered N-Triples and Turtle triples writer
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ * Triples are formatted directly into one large output buffer that is
+ * written with fwrite() when full.  Namespace IRIs are escaped once
+ * when they are declared and the Turtle writer groups the triples of
+ * the same subject and predicate, which the photo serializer emits
+ * together.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define TRIPLES_WRITER_BUFFER_SIZE 262144
+
+#define RDF_NS "http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+
+
+static const struct {
+  const char* name;
+  const char* label;
+  int turtle;
+} triples_writer_syntaxes[] = {
+  { "ntriples", "N-Triples", 0 },
+  { "turtle",   "Turtle",    1 },
+  { NULL,       NULL,        0 }
+};
+
+
+/**
+ * flickcurl_get_triples_writer_syntax:
+ * @counter: index into the list of syntaxes
+ * @label_p: pointer to store syntax label (or NULL)
+ *
+ * Get the name of a syntax supported by the triples writer
+ *
+ * Return value: syntax name such as "ntriples" or NULL if @counter is
+ * out of range
+ */
+const char*
+flickcurl_get_triples_writer_syntax(unsigned int counter, const char** label_p)
+{
+  unsigned int i;
+
+  for(i = 0; triples_writer_syntaxes[i].name; i++) {
+    if(i == counter) {
+      if(label_p)
+        *label_p = triples_writer_syntaxes[i].label;
+      return triples_writer_syntaxes[i].name;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * flickcurl_new_triples_writer:
+ * @fh: file handle to write to
+ * @syntax_name: syntax "ntriples" or "turtle"
+ *
+ * Constructor - create a buffered triples writer
+ *
+ * Use the writer as the data of a serializer made with the factory
+ * returned by flickcurl_get_triples_writer_factory().  The output is
+ * written in large blocks so @fh is only up to date after the factory
+ * emit_finish method or flickcurl_triples_writer_flush() is called.
+ *
+ * Return value: new writer object or NULL on failure
+ */
+flickcurl_triples_writer*
+flickcurl_new_triples_writer(FILE* fh, const char* syntax_name)
+{
+  flickcurl_triples_writer* w;
+  int i;
+
+  if(!fh || !syntax_name)
+    return NULL;
+
+  for(i = 0; triples_writer_syntaxes[i].name; i++) {
+    if(!strcmp(triples_writer_syntaxes[i].name, syntax_name))
+      break;
+  }
+  if(!triples_writer_syntaxes[i].name)
+    return NULL;
+
+  w = (flickcurl_triples_writer*)calloc(1, sizeof(*w));
+  if(!w)
+    return NULL;
+
+  w->buffer = (char*)malloc(TRIPLES_WRITER_BUFFER_SIZE);
+  if(!w->buffer) {
+    free(w);
+    return NULL;
+  }
+
+  w->fh = fh;
+  w->turtle = triples_writer_syntaxes[i].turtle;
+  w->last_nspace = -1;
+
+  return w;
+}
+
+
+/**
+ * flickcurl_free_triples_writer:
+ * @w: triples writer object
+ *
+ * Destructor - flush and destroy a triples writer object
+ */
+void
+flickcurl_free_triples_writer(flickcurl_triples_writer* w)
+{
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(w, flickcurl_triples_writer);
+
+  flickcurl_triples_writer_flush(w);
+
+  for(i = 0; i < w->nspaces_count; i++) {
+    free(w->nspaces[i].prefix);
+    free(w->nspaces[i].uri);
+    free(w->nspaces[i].escaped_uri);
+  }
+  if(w->nspaces)
+    free(w->nspaces);
+  if(w->subject)
+    free(w->subject);
+  if(w->predicate)
+    free(w->predicate);
+  free(w->buffer);
+  free(w);
+}
+
+
+static void
+triples_writer_write_buffer(flickcurl_triples_writer* w)
+{
+  if(w->buffer_len) {
+    if(fwrite(w->buffer, 1, w->buffer_len, w->fh) != w->buffer_len)
+      w->failed = 1;
+    w->buffer_len = 0;
+  }
+}
+
+
+static void
+triples_writer_write(flickcurl_triples_writer* w, const char* s, size_t len)
+{
+  if(w->buffer_len + len > TRIPLES_WRITER_BUFFER_SIZE) {
+    triples_writer_write_buffer(w);
+
+    if(len > TRIPLES_WRITER_BUFFER_SIZE) {
+      if(fwrite(s, 1, len, w->fh) != len)
+        w->failed = 1;
+      return;
+    }
+  }
+
+  memcpy(w->buffer + w->buffer_len, s, len);
+  w->buffer_len += len;
+}
+
+
+#define triples_writer_write_string(w, s) \
+  triples_writer_write(w, s, strlen(s))
+
+
+static void
+triples_writer_write_unicode_escape(flickcurl_triples_writer* w,
+                                    unsigned char c)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  char buf[6] = { '\\', 'u', '0', '0', '0', '0' };
+
+  buf[4] = hex[c >> 4];
+  buf[5] = hex[c & 0xf];
+  triples_writer_write(w, buf, 6);
+}
+
+
+/* Percent-encode an octet of an IRI: IRIREF does not allow a UCHAR
+ * escape of a character that cannot appear in it */
+static void
+triples_writer_write_percent_escape(flickcurl_triples_writer* w,
+                                    unsigned char c)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  char buf[3] = { '%', '0', '0' };
+
+  buf[1] = hex[c >> 4];
+  buf[2] = hex[c & 0xf];
+  triples_writer_write(w, buf, 3);
+}
+
+
+#define TRIPLES_IRI_CHAR_OK(c) \
+  ((c) > 0x20 && (c) != '<' && (c) != '>' && (c) != '"' && (c) != '{' && \
+   (c) != '}' && (c) != '|' && (c) != '^' && (c) != '`' && (c) != '\\')
+
+/* Write IRI characters percent-encoding those not allowed inside <> */
+static void
+triples_writer_write_iri_escaped(flickcurl_triples_writer* w, const char* s)
+{
+  const char* run = s;
+  const unsigned char* p;
+
+  for(p = (const unsigned char*)s; *p; p++) {
+    if(TRIPLES_IRI_CHAR_OK(*p))
+      continue;
+
+    triples_writer_write(w, run, (const char*)p - run);
+    triples_writer_write_percent_escape(w, *p);
+    run = (const char*)p + 1;
+  }
+  triples_writer_write(w, run, (const char*)p - run);
+}
+
+
+/* Make an escaped copy of an IRI for writing inside <> */
+static char*
+triples_writer_escape_iri(const char* s, size_t* len_p)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  const unsigned char* p;
+  size_t len = 0;
+  char* escaped;
+  char* q;
+
+  for(p = (const unsigned char*)s; *p; p++)
+    len += TRIPLES_IRI_CHAR_OK(*p) ? 1 : 3;
+
+  escaped = (char*)malloc(len + 1);
+  if(!escaped)
+    return NULL;
+
+  for(p = (const unsigned char*)s, q = escaped; *p; p++) {
+    if(TRIPLES_IRI_CHAR_OK(*p))
+      *q++ = (char)*p;
+    else {
+      q[0] = '%';
+      q[1] = hex[*p >> 4];
+      q[2] = hex[*p & 0xf];
+      q += 3;
+    }
+  }
+  *q = '\0';
+
+  *len_p = len;
+  return escaped;
+}
+
+
+static void
+triples_writer_write_literal_escaped(flickcurl_triples_writer* w,
+                                     const char* s)
+{
+  const char* run = s;
+  const unsigned char* p;
+
+  for(p = (const unsigned char*)s; *p; p++) {
+    const char* esc;
+
+    switch(*p) {
+      case '"':  esc = "\\\""; break;
+      case '\\': esc = "\\\\"; break;
+      case '\n': esc = "\\n"; break;
+      case '\r': esc = "\\r"; break;
+      case '\t': esc = "\\t"; break;
+      default:
+        if(*p >= 0x20)
+          continue;
+        esc = NULL;
+        break;
+    }
+
+    triples_writer_write(w, run, (const char*)p - run);
+    if(esc)
+      triples_writer_write(w, esc, 2);
+    else
+      triples_writer_write_unicode_escape(w, *p);
+    run = (const char*)p + 1;
+  }
+  triples_writer_write(w, run, (const char*)p - run);
+}
+
+
+/* Check for a Turtle prefix name: a letter then letters, digits, _ or - */
+static int
+triples_writer_is_prefix(const char* s)
+{
+  const char* p = s;
+
+  if(!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')))
+    return 0;
+
+  for(p++; *p; p++) {
+    if(!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+         (*p >= '0' && *p <= '9') || *p == '_' || *p == '-'))
+      return 0;
+  }
+  return 1;
+}
+
+
+/* Check for a Turtle local name that needs no escapes */
+static int
+triples_writer_is_local_name(const char* s)
+{
+  const char* p;
+
+  if(!*s || *s == '-')
+    return 0;
+
+  for(p = s; *p; p++) {
+    if(!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+         (*p >= '0' && *p <= '9') || *p == '_' || *p == '-'))
+      return 0;
+  }
+  return 1;
+}
+
+
+/* Find the declared namespace for a namespace IRI; -1 if none */
+static int
+triples_writer_find_nspace(flickcurl_triples_writer* w, const char* uri)
+{
+  int i;
+
+  if(w->last_nspace >= 0 && !strcmp(w->nspaces[w->last_nspace].uri, uri))
+    return w->last_nspace;
+
+  for(i = 0; i < w->nspaces_count; i++) {
+    if(!strcmp(w->nspaces[i].uri, uri)) {
+      w->last_nspace = i;
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+static void
+triples_writer_end_statement(flickcurl_triples_writer* w)
+{
+  if(w->in_statement) {
+    triples_writer_write(w, " .\n", 3);
+    w->in_statement = 0;
+  }
+}
+
+
+static void
+triples_writer_emit_namespace(void* user_data,
+                              const char* prefix, size_t prefix_len,
+                              const char* uri, size_t uri_len)
+{
+  flickcurl_triples_writer* w = (flickcurl_triples_writer*)user_data;
+  flickcurl_triples_writer_nspace* ns;
+  int i;
+
+  if(!prefix || !uri)
+    return;
+
+  for(i = 0; i < w->nspaces_count; i++) {
+    if(!strcmp(w->nspaces[i].prefix, prefix))
+      break;
+  }
+
+  if(i < w->nspaces_count) {
+    if(!strcmp(w->nspaces[i].uri, uri))
+      return;
+
+    /* prefix redeclared for a new namespace IRI */
+    ns = &w->nspaces[i];
+    free(ns->uri);
+    free(ns->escaped_uri);
+  } else {
+    if(w->nspaces_count == w->nspaces_size) {
+      int new_size = w->nspaces_size ? w->nspaces_size * 2 : 16;
+      flickcurl_triples_writer_nspace* new_nspaces;
+
+      new_nspaces = (flickcurl_triples_writer_nspace*)realloc(w->nspaces,
+                      new_size * sizeof(flickcurl_triples_writer_nspace));
+      if(!new_nspaces)
+        return;
+      w->nspaces = new_nspaces;
+      w->nspaces_size = new_size;
+    }
+    ns = &w->nspaces[w->nspaces_count++];
+    ns->prefix = (char*)malloc(prefix_len + 1);
+    if(ns->prefix)
+      memcpy(ns->prefix, prefix, prefix_len + 1);
+  }
+
+  ns->uri = (char*)malloc(uri_len + 1);
+  if(ns->uri)
+    memcpy(ns->uri, uri, uri_len + 1);
+
+  ns->uri_len = uri_len;
+  ns->escaped_uri = triples_writer_escape_iri(uri, &ns->escaped_uri_len);
+
+  ns->usable = (ns->prefix && ns->uri && ns->escaped_uri &&
+                triples_writer_is_prefix(ns->prefix));
+  if(!ns->usable) {
+    if(!ns->prefix || !ns->uri || !ns->escaped_uri) {
+      /* leave out a namespace that could not be copied */
+      free(ns->prefix);
+      free(ns->uri);
+      free(ns->escaped_uri);
+      *ns = w->nspaces[--w->nspaces_count];
+    }
+    w->last_nspace = -1;
+    return;
+  }
+  w->last_nspace = -1;
+
+  if(w->turtle) {
+    triples_writer_end_statement(w);
+    triples_writer_write(w, "@prefix ", 8);
+    triples_writer_write(w, ns->prefix, prefix_len);
+    triples_writer_write(w, ": <", 3);
+    triples_writer_write(w, ns->escaped_uri, ns->escaped_uri_len);
+    triples_writer_write(w, "> .\n", 4);
+  }
+}
+
+
+static void
+triples_writer_write_term(flickcurl_triples_writer* w,
+                          const char* term, int term_type)
+{
+  if(term_type == FLICKCURL_TERM_TYPE_BLANK) {
+    triples_writer_write(w, "_:", 2);
+    triples_writer_write_string(w, term);
+  } else {
+    triples_writer_write(w, "<", 1);
+    triples_writer_write_iri_escaped(w, term);
+    triples_writer_write(w, ">", 1);
+  }
+}
+
+
+static void
+triples_writer_write_predicate(flickcurl_triples_writer* w,
+                               const char* nspace, const char* name)
+{
+  int i = triples_writer_find_nspace(w, nspace);
+
+  if(w->turtle && i >= 0 && w->nspaces[i].usable &&
+     triples_writer_is_local_name(name)) {
+    triples_writer_write_string(w, w->nspaces[i].prefix);
+    triples_writer_write(w, ":", 1);
+    triples_writer_write_string(w, name);
+    return;
+  }
+
+  triples_writer_write(w, "<", 1);
+  if(i >= 0)
+    triples_writer_write(w, w->nspaces[i].escaped_uri,
+                         w->nspaces[i].escaped_uri_len);
+  else
+    triples_writer_write_iri_escaped(w, nspace);
+  triples_writer_write_iri_escaped(w, name);
+  triples_writer_write(w, ">", 1);
+}
+
+
+static void
+triples_writer_write_datatype(flickcurl_triples_writer* w,
+                              const char* datatype_uri)
+{
+  triples_writer_write(w, "^^", 2);
+
+  if(w->turtle) {
+    int i;
+
+    for(i = 0; i < w->nspaces_count; i++) {
+      flickcurl_triples_writer_nspace* ns = &w->nspaces[i];
+
+      if(!ns->usable)
+        continue;
+      if(!strncmp(datatype_uri, ns->uri, ns->uri_len) &&
+         triples_writer_is_local_name(datatype_uri + ns->uri_len)) {
+        triples_writer_write_string(w, ns->prefix);
+        triples_writer_write(w, ":", 1);
+        triples_writer_write_string(w, datatype_uri + ns->uri_len);
+        return;
+      }
+    }
+  }
+
+  triples_writer_write_term(w, datatype_uri, FLICKCURL_TERM_TYPE_RESOURCE);
+}
+
+
+/* Copy @s1 then @s2 into a growing buffer kept for the next triple */
+static int
+triples_writer_save(char** buffer_p, size_t* size_p, size_t* len_p,
+                    const char* s1, const char* s2)
+{
+  size_t len1 = strlen(s1);
+  size_t len2 = s2 ? strlen(s2) : 0;
+  size_t len = len1 + len2;
+
+  if(len + 1 > *size_p) {
+    char* new_buffer = (char*)realloc(*buffer_p, len + 1);
+    if(!new_buffer)
+      return 1;
+    *buffer_p = new_buffer;
+    *size_p = len + 1;
+  }
+  memcpy(*buffer_p, s1, len1);
+  if(len2)
+    memcpy(*buffer_p + len1, s2, len2);
+  (*buffer_p)[len] = '\0';
+  *len_p = len;
+
+  return 0;
+}
+
+
+static int
+triples_writer_is_saved(const char* saved, size_t saved_len,
+                        const char* s1, const char* s2)
+{
+  size_t len1 = strlen(s1);
+
+  if(!saved || saved_len < len1 || memcmp(saved, s1, len1))
+    return 0;
+  if(!s2)
+    return (saved_len == len1);
+  return !strcmp(saved + len1, s2);
+}
+
+
+static void
+triples_writer_emit_triple(void* user_data,
+                           const char* subject, int subject_type,
+                           const char* predicate_nspace,
+                           const char* predicate_name,
+                           const char *object, int object_type,
+                           const char *datatype_uri)
+{
+  flickcurl_triples_writer* w = (flickcurl_triples_writer*)user_data;
+
+  if(!subject || !predicate_nspace || !predicate_name || !object)
+    return;
+
+  if(w->turtle) {
+    int same_subject;
+
+    same_subject = (w->in_statement && w->subject_type == subject_type &&
+                    triples_writer_is_saved(w->subject, w->subject_len,
+                                            subject, NULL));
+    if(same_subject &&
+       triples_writer_is_saved(w->predicate, w->predicate_len,
+                               predicate_nspace, predicate_name)) {
+      triples_writer_write(w, " ,\n        ", 11);
+    } else {
+      if(same_subject)
+        triples_writer_write(w, " ;\n    ", 7);
+      else {
+        triples_writer_end_statement(w);
+        triples_writer_write_term(w, subject, subject_type);
+        triples_writer_write(w, "\n    ", 5);
+
+        w->subject_type = subject_type;
+        if(triples_writer_save(&w->subject, &w->subject_size,
+                               &w->subject_len, subject, NULL))
+          w->subject_len = 0;
+        w->in_statement = 1;
+      }
+
+      if(!strcmp(predicate_name, "type") && !strcmp(predicate_nspace, RDF_NS))
+        triples_writer_write(w, "a", 1);
+      else
+        triples_writer_write_predicate(w, predicate_nspace, predicate_name);
+      triples_writer_write(w, " ", 1);
+
+      if(triples_writer_save(&w->predicate, &w->predicate_size,
+                             &w->predicate_len,
+                             predicate_nspace, predicate_name))
+        w->predicate_len = 0;
+    }
+  } else {
+    triples_writer_write_term(w, subject, subject_type);
+    triples_writer_write(w, " ", 1);
+    triples_writer_write_predicate(w, predicate_nspace, predicate_name);
+    triples_writer_write(w, " ", 1);
+  }
+
+  if(object_type == FLICKCURL_TERM_TYPE_LITERAL) {
+    triples_writer_write(w, "\"", 1);
+    triples_writer_write_literal_escaped(w, object);
+    triples_writer_write(w, "\"", 1);
+    if(datatype_uri)
+      triples_writer_write_datatype(w, datatype_uri);
+  } else
+    triples_writer_write_term(w, object, object_type);
+
+  if(!w->turtle)
+    triples_writer_write(w, " .\n", 3);
+}
+
+
+static void
+triples_writer_emit_finish(void* user_data)
+{
+  flickcurl_triples_writer* w = (flickcurl_triples_writer*)user_data;
+
+  flickcurl_triples_writer_flush(w);
+}
+
+
+/**
+ * flickcurl_triples_writer_flush:
+ * @w: triples writer object
+ *
+ * Finish any open Turtle statement and write the buffered output
+ *
+ * Return value: non-0 if any write to the file handle failed
+ */
+int
+flickcurl_triples_writer_flush(flickcurl_triples_writer* w)
+{
+  triples_writer_end_statement(w);
+  triples_writer_write_buffer(w);
+  if(fflush(w->fh))
+    w->failed = 1;
+
+  return w->failed;
+}
+
+
+static flickcurl_serializer_factory triples_writer_factory = {
+  1,
+  triples_writer_emit_namespace,
+  triples_writer_emit_triple,
+  triples_writer_emit_finish
+};
+
+
+/**
+ * flickcurl_get_triples_writer_factory:
+ *
+ * Get the serializer factory that writes triples with a triples writer
+ *
+ * Pass a #flickcurl_triples_writer as the data argument of
+ * flickcurl_new_serializer() with this factory.
+ *
+ * Return value: shared serializer factory
+ */
+flickcurl_serializer_factory*
+flickcurl_get_triples_writer_factory(void)
+{
+  return &triples_writer_factory;
+}
@@ -93,3 +93,197 @@ flickcurl_cmdline_basename(const char *name)
 
   return name;
 }
+
+
+/*
+ * flickcurl_cmdline_tokenize_line:
+ * @line: line buffer (modified in place)
+ * @argv: array of FLICKCURL_CMDLINE_MAX_ARGS+1 pointers to fill
+ *
+ * Split a batch line into words separated by whitespace.
+ * Words may be quoted with '...' or "..." and a backslash escapes
+ * the next character.  The @argv array is NULL terminated.
+ *
+ * Return value: number of words, 0 for a blank or comment line or <0 on failure
+ */
+int
+flickcurl_cmdline_tokenize_line(char* line, char** argv)
+{
+  char* p = line;
+  int argc = 0;
+
+  while(1) {
+    char* word;
+    char quote = '\0';
+    
+    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+      p++;
+    if(!*p || (!argc && *p == '#'))
+      break;
+
+    if(argc == FLICKCURL_CMDLINE_MAX_ARGS)
+      return -1;
+
+    /* copy the word down in place as quotes and escapes are removed */
+    word = p;
+    argv[argc++] = word;
+    while(*p) {
+      if(quote) {
+        if(*p == quote) {
+          quote = '\0';
+          p++;
+          continue;
+        }
+      } else {
+        if(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+          break;
+        if(*p == '\'' || *p == '"') {
+          quote = *p++;
+          continue;
+        }
+      }
+      if(*p == '\\' && p[1] && quote != '\'')
+        p++;
+      *word++ = *p++;
+    }
+    if(quote)
+      return -1;
+    if(*p)
+      p++;
+    *word = '\0';
+  }
+
+  argv[argc] = NULL;
+  return argc;
+}
+
+
+#ifdef STANDALONE
+#include <stdio.h>
+
+int main(int argc, char *argv[]);
+
+
+static const char* program;
+
+/* Test lines and expected words separated by '|'; NULL for failure */
+static const struct {
+  const char* line;
+  const char* expected;
+} tokenize_tests[] = {
+  { "", "" },
+  { "   \t\r\n", "" },
+  { "# a comment line", "" },
+  { "  # indented comment", "" },
+  { "photos.getInfo 123", "photos.getInfo|123" },
+  { "\tphotos.search  tags  cat\r\n", "photos.search|tags|cat" },
+  { "tags.getListUser #hash", "tags.getListUser|#hash" },
+  { "photos.setMeta 1 'a title' \"a description\"",
+    "photos.setMeta|1|a title|a description" },
+  { "a 'it''s' b", "a|its|b" },
+  { "a \"say \\\"hi\\\"\"", "a|say \"hi\"" },
+  { "a 'back\\slash'", "a|back\\slash" },
+  { "a b\\ c", "a|b c" },
+  { "a pre'quoted'post", "a|prequotedpost" },
+  { "a ''", "a|" },
+  { "a 'unterminated", NULL },
+  { "a \"unterminated", NULL },
+  { NULL, NULL }
+};
+
+
+static int
+test_tokenize(const char* line, const char* expected)
+{
+  char buffer[256];
+  char joined[256];
+  char* words[FLICKCURL_CMDLINE_MAX_ARGS + 1];
+  char* p = joined;
+  int count;
+  int i;
+
+  strcpy(buffer, line);
+  count = flickcurl_cmdline_tokenize_line(buffer, words);
+  if(count < 0) {
+    if(expected)
+      goto failed;
+    return 0;
+  }
+  if(!expected || words[count])
+    goto failed;
+
+  *p = '\0';
+  for(i = 0; i < count; i++) {
+    size_t len = strlen(words[i]);
+    if(i)
+      *p++ = '|';
+    memcpy(p, words[i], len + 1);
+    p += len;
+  }
+  if(strcmp(joined, expected)) {
+    fprintf(stderr, "%s: FAIL\n  line '%s' gave '%s'\n  expected '%s'\n",
+            program, line, joined, expected);
+    return 1;
+  }
+  return 0;
+
+  failed:
+  fprintf(stderr, "%s: FAIL\n  line '%s' gave %d words\n  expected %s\n",
+          program, line, count, expected ? expected : "failure");
+  return 1;
+}
+
+
+static int
+test_tokenize_limit(void)
+{
+  char buffer[FLICKCURL_CMDLINE_MAX_ARGS * 2 + 3];
+  char* words[FLICKCURL_CMDLINE_MAX_ARGS + 1];
+  int failures = 0;
+  int i;
+
+  /* exactly the maximum number of words is allowed */
+  for(i = 0; i < FLICKCURL_CMDLINE_MAX_ARGS; i++) {
+    buffer[i * 2] = 'x';
+    buffer[i * 2 + 1] = ' ';
+  }
+  buffer[FLICKCURL_CMDLINE_MAX_ARGS * 2] = '\0';
+  if(flickcurl_cmdline_tokenize_line(buffer, words) !=
+     FLICKCURL_CMDLINE_MAX_ARGS) {
+    fprintf(stderr, "%s: FAIL\n  %d words were not accepted\n",
+            program, FLICKCURL_CMDLINE_MAX_ARGS);
+    failures++;
+  }
+
+  /* one more is a failure; the separators were overwritten above */
+  for(i = 0; i < FLICKCURL_CMDLINE_MAX_ARGS; i++)
+    buffer[i * 2 + 1] = ' ';
+  buffer[FLICKCURL_CMDLINE_MAX_ARGS * 2] = 'x';
+  buffer[FLICKCURL_CMDLINE_MAX_ARGS * 2 + 1] = '\0';
+  if(flickcurl_cmdline_tokenize_line(buffer, words) >= 0) {
+    fprintf(stderr, "%s: FAIL\n  %d words were accepted\n",
+            program, FLICKCURL_CMDLINE_MAX_ARGS + 1);
+    failures++;
+  }
+
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  int failures = 0;
+  int i;
+
+  program = flickcurl_cmdline_basename(argv[0]);
+
+  for(i = 0; tokenize_tests[i].line; i++)
+    failures += test_tokenize(tokenize_tests[i].line,
+                              tokenize_tests[i].expected);
+
+  failures += test_tokenize_limit();
+
+  return failures;
+}
+#endif
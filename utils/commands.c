@@ -105,11 +105,71 @@ command_people_findByUsername(flickcurl* fc, int argc, char *argv[])
 }
 
 
+/* Add a photo or person field value to the current output record */
+static void
+command_record_field(const char* name, flickcurl_field_value_type datatype,
+                     const char* string, int integer)
+{
+  switch(datatype) {
+    case VALUE_TYPE_NONE:
+      cmd_record_string(name, NULL);
+      break;
+
+    case VALUE_TYPE_BOOLEAN:
+    case VALUE_TYPE_INTEGER:
+      cmd_record_integer(name, integer);
+      break;
+
+    case VALUE_TYPE_FLOAT:
+      cmd_record_number(name, string);
+      break;
+
+    case VALUE_TYPE_PHOTO_ID:
+    case VALUE_TYPE_PHOTO_URI:
+    case VALUE_TYPE_UNIXTIME:
+    case VALUE_TYPE_DATETIME:
+    case VALUE_TYPE_STRING:
+    case VALUE_TYPE_URI:
+    case VALUE_TYPE_PERSON_ID:
+    case VALUE_TYPE_MEDIA_TYPE:
+    case VALUE_TYPE_TAG_STRING:
+    case VALUE_TYPE_COLLECTION_ID:
+    case VALUE_TYPE_ICON_PHOTOS:
+      cmd_record_string(name, string);
+      break;
+  }
+}
+
+
+static void
+command_record_person(flickcurl_person* person)
+{
+  int i;
+
+  cmd_record_start("person");
+  cmd_record_string("nsid", person->nsid);
+  for(i = (int)PERSON_FIELD_FIRST; i <= (int)PERSON_FIELD_LAST; i++) {
+    flickcurl_person_field_type field = (flickcurl_person_field_type)i;
+
+    command_record_field(flickcurl_get_person_field_label(field),
+                         person->fields[field].type,
+                         person->fields[field].string,
+                         person->fields[field].integer);
+  }
+  cmd_record_end();
+}
+
+
 static void
 command_print_person(flickcurl_person* person)
 {
   int i;
 
+  if(output_format != CMD_OUTPUT_FORMAT_TEXT) {
+    command_record_person(person);
+    return;
+  }
+
   fprintf(stdout, "Found person with ID %s\n", person->nsid);
 
   for(i = (int)PERSON_FIELD_FIRST; i <= (int)PERSON_FIELD_LAST; i++) {
@@ -153,6 +213,23 @@ command_print_tags(flickcurl_tag** tags, const char* label, const char* value)
   if(!tags)
     return;
 
+  if(output_format != CMD_OUTPUT_FORMAT_TEXT) {
+    for(i = 0; tags[i]; i++) {
+      flickcurl_tag* tag = tags[i];
+
+      cmd_record_start("tag");
+      cmd_record_string("id", tag->id);
+      cmd_record_string("author", tag->author);
+      cmd_record_string("authorname", tag->authorname);
+      cmd_record_string("raw", tag->raw);
+      cmd_record_string("cooked", tag->cooked);
+      cmd_record_integer("machine_tag", tag->machine_tag);
+      cmd_record_integer("count", tag->count);
+      cmd_record_end();
+    }
+    return;
+  }
+
   if(label)
     fprintf(stdout, "%s: %s %s tags\n", program, label,
             (value ? value : "(none)"));
@@ -218,12 +295,61 @@ command_print_shape(flickcurl_shapedata* shape)
 }
 
 
+static void
+command_record_place(flickcurl_place* place)
+{
+  int i;
+
+  cmd_record_start("place");
+  cmd_record_string("place_type", flickcurl_get_place_type_label(place->type));
+  if(place->location.accuracy != 0) {
+    cmd_record_double("latitude", place->location.latitude);
+    cmd_record_double("longitude", place->location.longitude);
+    cmd_record_integer("accuracy", place->location.accuracy);
+  } else {
+    cmd_record_string("latitude", NULL);
+    cmd_record_string("longitude", NULL);
+    cmd_record_string("accuracy", NULL);
+  }
+  cmd_record_string("timezone", place->timezone);
+  cmd_record_integer("count", place->count);
+
+  for(i = (int)0; i <= (int)FLICKCURL_PLACE_LAST; i++) {
+    const char* type_label;
+    char name[64];
+    size_t len;
+
+    type_label = flickcurl_get_place_type_label((flickcurl_place_type)i);
+    len = strlen(type_label);
+    if(len > sizeof(name) - 7)
+      continue;
+    memcpy(name, type_label, len);
+
+    strcpy(name + len, "_name");
+    cmd_record_string(name, place->names[i]);
+    strcpy(name + len, "_id");
+    cmd_record_string(name, place->ids[i]);
+    strcpy(name + len, "_woeid");
+    cmd_record_string(name, place->woe_ids[i]);
+    strcpy(name + len, "_url");
+    cmd_record_string(name, place->urls[i]);
+  }
+  cmd_record_end();
+}
+
+
 static void
 command_print_place(flickcurl_place* place,
                     const char* label, const char* value,
                     int print_locality)
 {
   int i;
+
+  if(output_format != CMD_OUTPUT_FORMAT_TEXT) {
+    command_record_place(place);
+    return;
+  }
+
   if(label)
     fprintf(stdout, "%s: %s %s places\n", program, label,
             (value ? value : "(none)"));
@@ -308,11 +434,38 @@ command_print_notes(flickcurl_note** notes, const char* label,
 }
 
 
+static void
+command_record_photo(flickcurl_photo* photo)
+{
+  int i;
+
+  cmd_record_start("photo");
+  cmd_record_string("id", photo->id);
+  cmd_record_string("uri", photo->uri);
+  cmd_record_string("media_type", photo->media_type);
+  for(i = PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
+    flickcurl_photo_field_type field = (flickcurl_photo_field_type)i;
+
+    command_record_field(flickcurl_get_photo_field_label(field),
+                         photo->fields[field].type,
+                         photo->fields[field].string,
+                         photo->fields[field].integer);
+  }
+  cmd_record_tags("tags", photo->tags);
+  cmd_record_end();
+}
+
+
 static void
 command_print_photo(flickcurl_photo* photo)
 {
   int i;
 
+  if(output_format != CMD_OUTPUT_FORMAT_TEXT) {
+    command_record_photo(photo);
+    return;
+  }
+
   fprintf(stdout, "%s with URI %s ID %s and %d tags\n",
           photo->media_type,
           (photo->uri ? photo->uri : "(Unknown)"),
@@ -356,7 +509,8 @@ command_photos_getInfo(flickcurl* fc, int argc, char *argv[])
   photo = flickcurl_photos_getInfo2(fc, argv[1], secret);
 
   if(photo) {
-    fprintf(stdout, "%s: ", program);
+    if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+      fprintf(stdout, "%s: ", program);
     command_print_photo(photo);
     flickcurl_free_photo(photo);
   }
@@ -1338,7 +1492,12 @@ command_print_photos_list(flickcurl* fc, flickcurl_photos_list* photos_list,
   int rc = 0;
   int i;
 
-  if(photos_list->photos) {
+  if(photos_list->photos && output_format == CMD_OUTPUT_FORMAT_ARROW) {
+    rc = cmd_output_photos_list(fc, photos_list);
+  } else if(photos_list->photos && output_format != CMD_OUTPUT_FORMAT_TEXT) {
+    for(i = 0; photos_list->photos[i]; i++)
+      command_record_photo(photos_list->photos[i]);
+  } else if(photos_list->photos) {
     fprintf(stdout,
             "%s: %s returned %d photos out of %d, page %d per-page %d\n",
             program, label,
@@ -2844,7 +3003,8 @@ command_places_find(flickcurl* fc, int argc, char *argv[])
   if(places) {
     int i;
     for(i = 0; places[i]; i++) {
-      fprintf(stdout, "Place Result #%d\n", i);
+      if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+        fprintf(stdout, "Place Result #%d\n", i);
       command_print_place(places[i], NULL, NULL, 1);
     }
     flickcurl_free_places(places);
@@ -3000,7 +3160,8 @@ command_places_placesForUser(flickcurl* fc, int argc, char *argv[])
   if(places) {
     int i;
     for(i = 0; places[i]; i++) {
-      fprintf(stdout, "Place Result #%d\n", i);
+      if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+        fprintf(stdout, "Place Result #%d\n", i);
       command_print_place(places[i], NULL, NULL, 0);
     }
     flickcurl_free_places(places);
@@ -3076,7 +3237,8 @@ command_places_getChildrenWithPhotosPublic(flickcurl* fc, int argc, char *argv[]
   if(places) {
     int i;
     for(i = 0; places[i]; i++) {
-      fprintf(stdout, "Place Result #%d\n", i);
+      if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+        fprintf(stdout, "Place Result #%d\n", i);
       command_print_place(places[i], NULL, NULL, 0);
     }
     flickcurl_free_places(places);
@@ -3289,7 +3451,8 @@ command_places_placesForBoundingBox(flickcurl* fc, int argc, char *argv[])
   if(places) {
     int i;
     for(i = 0; places[i]; i++) {
-      fprintf(stdout, "Place Result #%d\n", i);
+      if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+        fprintf(stdout, "Place Result #%d\n", i);
       command_print_place(places[i], NULL, NULL, 0);
     }
     flickcurl_free_places(places);
@@ -3363,7 +3526,8 @@ command_places_placesForContacts(flickcurl* fc, int argc, char *argv[])
   if(places) {
     int i;
     for(i = 0; places[i]; i++) {
-      fprintf(stdout, "Place Result #%d\n", i);
+      if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+        fprintf(stdout, "Place Result #%d\n", i);
       command_print_place(places[i], NULL, NULL, 0);
     }
     flickcurl_free_places(places);
@@ -3681,9 +3845,11 @@ command_panda_getPhotos(flickcurl* fc, int argc, char *argv[])
   if(!photos)
     return 1;
 
-  fprintf(stdout, "%s: Panda %s returned photos!\n", program, panda);
+  if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+    fprintf(stdout, "%s: Panda %s returned photos!\n", program, panda);
   for(i = 0; photos[i]; i++) {
-    fprintf(stdout, "%s: %s photo %d\n", program, panda, i);
+    if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+      fprintf(stdout, "%s: %s photo %d\n", program, panda, i);
     command_print_photo(photos[i]);
   }
   flickcurl_free_photos(photos);
@@ -3862,6 +4028,166 @@ command_comments_getRecentForContacts(flickcurl* fc, int argc, char *argv[])
 }
 
 
+/* Append the photos of a list to a growing array of photos */
+static int
+command_download_add_photos(flickcurl_photos_list* photos_list,
+                            flickcurl_photo*** photos_p, int* count_p)
+{
+  flickcurl_photo** photos;
+  int count = photos_list->photos_count;
+
+  if(!count)
+    return 0;
+
+  photos = (flickcurl_photo**)realloc(*photos_p, sizeof(flickcurl_photo*) *
+                                      (*count_p + count + 1));
+  if(!photos)
+    return 1;
+
+  memcpy(photos + *count_p, photos_list->photos,
+         sizeof(flickcurl_photo*) * count);
+  *count_p += count;
+  photos[*count_p] = NULL;
+  *photos_p = photos;
+
+  /* photos are now owned by the array */
+  photos_list->photos[0] = NULL;
+
+  return 0;
+}
+
+
+static void
+command_download_handler(void* user_data, flickcurl_photo* photo,
+                         const char* filename,
+                         flickcurl_download_status status, size_t bytes)
+{
+  if(status == FLICKCURL_DOWNLOAD_FAILED)
+    fprintf(stderr, "%s: Photo %s download failed\n", program, photo->id);
+  else if(verbose > 1 || (verbose && status == FLICKCURL_DOWNLOAD_OK))
+    fprintf(stdout, "%s: Photo %s %s %s (%d bytes)\n", program, photo->id,
+            (status == FLICKCURL_DOWNLOAD_OK ? "downloaded to" : "exists in"),
+            filename, (int)bytes);
+}
+
+
+static int
+command_download(flickcurl* fc, int argc, char *argv[])
+{
+  flickcurl_download_params params;
+  flickcurl_download_stats stats;
+  flickcurl_photos_list_params list_params;
+  flickcurl_search_params search_params;
+  flickcurl_photo** photos = NULL;
+  int photos_count = 0;
+  const char* source;
+  int rc = 0;
+  int i;
+
+  flickcurl_download_params_init(&params);
+  params.directory = argv[1];
+  if(strcmp(argv[2], "-"))
+    params.size = argv[2][0];
+  if(strcmp(argv[3], "-"))
+    params.workers = atoi(argv[3]);
+  params.resume = 1;
+  params.skip_existing = 1;
+  params.handler = command_download_handler;
+
+  source = argv[4];
+
+  flickcurl_photos_list_params_init(&list_params);
+  list_params.extras = "original_format";
+  list_params.per_page = 500;
+
+  if(!strcmp(source, "photo")) {
+    for(i = 5; i < argc; i++) {
+      flickcurl_photo* photo = flickcurl_photos_getInfo2(fc, argv[i], NULL);
+      flickcurl_photo** new_photos;
+
+      if(!photo) {
+        rc = 1;
+        continue;
+      }
+      new_photos = (flickcurl_photo**)realloc(photos, sizeof(flickcurl_photo*) *
+                                              (photos_count + 2));
+      if(!new_photos) {
+        flickcurl_free_photo(photo);
+        rc = 1;
+        break;
+      }
+      photos = new_photos;
+      photos[photos_count++] = photo;
+      photos[photos_count] = NULL;
+    }
+  } else if(!strcmp(source, "set") || !strcmp(source, "user") ||
+            !strcmp(source, "search")) {
+    if(!strcmp(source, "search")) {
+      flickcurl_search_params_init(&search_params);
+      search_params.text = argv[5];
+    }
+
+    /* get all pages */
+    for(list_params.page = 1; ; list_params.page++) {
+      flickcurl_photos_list* photos_list;
+      int last_page;
+
+      if(!strcmp(source, "set"))
+        photos_list = flickcurl_photosets_getPhotos_params(fc, argv[5], -1,
+                                                           &list_params);
+      else if(!strcmp(source, "user"))
+        photos_list = flickcurl_people_getPhotos_params(fc, argv[5], -1,
+                                                        NULL, NULL,
+                                                        NULL, NULL,
+                                                        -1, -1,
+                                                        &list_params);
+      else
+        photos_list = flickcurl_photos_search_params(fc, &search_params,
+                                                     &list_params);
+      if(!photos_list) {
+        rc = 1;
+        break;
+      }
+
+      last_page = (!photos_list->photos_count ||
+                   list_params.page * list_params.per_page >=
+                     photos_list->total_count);
+      if(command_download_add_photos(photos_list, &photos, &photos_count))
+        rc = 1;
+      flickcurl_free_photos_list(photos_list);
+
+      if(rc || last_page)
+        break;
+    }
+  } else {
+    fprintf(stderr, "%s: Unknown photo source '%s'\n", program, source);
+    return 1;
+  }
+
+  if(!photos)
+    return 1;
+
+  if(verbose)
+    fprintf(stdout, "%s: Downloading %d photos to %s\n", program,
+            photos_count, params.directory);
+
+  if(flickcurl_download_photos(fc, photos, &params, &stats))
+    rc = 1;
+
+  if(verbose)
+    fprintf(stdout,
+            "%s: Downloaded %d, skipped %d, failed %d: %lu bytes in %.1f seconds (%.1f KB/s)\n",
+            program, stats.downloaded, stats.skipped, stats.failed,
+            (unsigned long)stats.bytes, stats.seconds,
+            (stats.seconds > 0.0 ?
+             ((double)stats.bytes / 1024.0) / stats.seconds : 0.0));
+
+  flickcurl_free_photos(photos);
+
+  return rc;
+}
+
+
 static int
 command_short_uri(flickcurl* fc, int argc, char *argv[])
 {
@@ -3927,7 +4253,8 @@ command_places_getTopPlacesList(flickcurl* fc, int argc, char *argv[])
   if(places) {
     int i;
     for(i = 0; places[i]; i++) {
-      fprintf(stdout, "Place Result #%d\n", i);
+      if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+        fprintf(stdout, "Place Result #%d\n", i);
       command_print_place(places[i], NULL, NULL, 1);
     }
     flickcurl_free_places(places);
@@ -4553,9 +4880,11 @@ command_stats_getPopularPhotos(flickcurl* fc, int argc, char *argv[])
   if(!photos)
     return 1;
 
-  fprintf(stdout, "%s: Popular photos:\n", program);
+  if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+    fprintf(stdout, "%s: Popular photos:\n", program);
   for(i = 0; photos[i]; i++) {
-    fprintf(stdout, "%s: popular photo %d\n", program, i);
+    if(output_format == CMD_OUTPUT_FORMAT_TEXT)
+      fprintf(stdout, "%s: popular photo %d\n", program, i);
     command_print_photo(photos[i]);
   }
   flickcurl_free_photos(photos);
@@ -5666,6 +5995,10 @@ flickcurl_cmd commands[FLICKCURL_CMD_COUNT] = {
    "FILE PHOTO-ID [async]", "Replace a photo PHOTO-ID with a new FILE (async)",
    command_replace,  2, 3},
 
+  {"download",
+   "DIRECTORY SIZE|- WORKERS|- set PHOTOSET-ID | user USER-NSID | search TEXT | photo PHOTO-ID...", "Download the SIZE image files for photos in a set, a user's photos, a search or a list\n        of photos into DIRECTORY using WORKERS concurrent transfers.  Existing files\n        are skipped and partial downloads are resumed.",
+   command_download,  5, 0},
+
   {"shorturi",
    "PHOTO-ID", "Get the http://flic.kr short uri for PHOTO-ID",
    command_short_uri,  1, 1},
@@ -48,6 +48,11 @@
  *   -- http://www.flickr.com/services/api/flickr.photos.getInfo.html
  * Gets information about a photo including its tags
  *
+ * Several API calls can be run over one session with:
+ *
+ * flickcurl --batch FILE
+ *   FILE (or - for standard input) contains one command with args per line
+ *
  * See the help message for full list of supported Flickr API Calls.
  *
  */
@@ -118,9 +123,9 @@ my_message_handler(void *user_data, const char *message)
 
 #ifdef HAVE_GETOPT_LONG
 /* + makes GNU getopt_long() never permute the arguments */
-#define GETOPT_STRING "+a:d:ho:qvV"
+#define GETOPT_STRING "+a:b:d:f:ho:qvV"
 #else
-#define GETOPT_STRING "a:d:ho:qvV"
+#define GETOPT_STRING "a:b:d:f:ho:qvV"
 #endif
 
 #ifdef HAVE_GETOPT_LONG
@@ -128,7 +133,9 @@ static struct option long_options[] =
 {
   /* name, has_arg, flag, val */
   {"auth",    1, 0, 'a'},
+  {"batch",   1, 0, 'b'},
   {"delay",   1, 0, 'd'},
+  {"format",  1, 0, 'f'},
   {"help",    0, 0, 'h'},
   {"output",  0, 0, 'o'},
   {"quiet",   0, 0, 'q'},
@@ -159,7 +166,9 @@ print_help_string(void)
   fputs("\n", stdout);
 
   puts(HELP_TEXT("a", "auth FROB       ", "Authenticate with a FROB and write auth config"));
+  puts(HELP_TEXT("b", "batch FILE      ", "Run commands from FILE ('-' for stdin), one per line"));
   puts(HELP_TEXT("d", "delay DELAY     ", "Set delay between requests in milliseconds"));
+  puts(HELP_TEXT("f", "format NAME     ", "Print photos, people, places and tags as NAME records:" HELP_PAD "text (default), jsonl, tsv or arrow"));
   puts(HELP_TEXT("h", "help            ", "Print this help, then exit"));
   puts(HELP_TEXT("o", "output FILE     ", "Write format = FORMAT results to FILE"));
   puts(HELP_TEXT("q", "quiet           ", "Print less information while running"));
@@ -206,6 +215,167 @@ print_help_string(void)
   /* Extra space for neater distinctions in output */
   fputs("\n", stdout);
 }
+/*
+ * lookup_command:
+ * @command_p: pointer to command name (may be updated)
+ * @argc: number of command arguments including command name
+ *
+ * INTERNAL - Normalize a command name, find it in commands[] and
+ * check the argument count against the command min/max.
+ *
+ * Return value: command index or <0 on failure
+ */
+static int
+lookup_command(char** command_p, int argc)
+{
+  char* command = *command_p;
+  int cmd_index = -1;
+  int i;
+  
+  /* allow old format commands to work */
+  for(i = 0; command[i]; i++) {
+    if(command[i] == '-')
+      command[i] = '.';
+  }
+  
+  if(!strncmp(command, "flickr.", 7))
+    command+= 7;
+
+  if(!strcmp(command, "places.forUser"))
+    command = (char*)"places.placesForUser";
+  
+  *command_p = command;
+
+  for(i = 0; commands[i].name; i++)
+    if(!strcmp(command, commands[i].name)) {
+      cmd_index = i;
+      break;
+    }
+  if(cmd_index < 0) {
+    fprintf(stderr, "%s: No such command `%s'\n", program, command);
+    return -1;
+  }
+
+  if((argc-1) < commands[cmd_index].min) {
+    fprintf(stderr,
+            "%s: Minimum of %d arguments for command `%s'\n  USAGE: %s %s %s\n",
+            program,
+            commands[cmd_index].min, command,
+            program, command, commands[cmd_index].args);
+    return -1;
+  }
+  
+  if(commands[cmd_index].max > 0 && 
+     (argc-1) > commands[cmd_index].max) {
+    fprintf(stderr,
+            "%s: Maxiumum of %d arguments for command `%s'\n  USAGE: %s %s %s\n",
+            program,
+            commands[cmd_index].max, command,
+            program, command, commands[cmd_index].args);
+    return -1;
+  }
+
+  return cmd_index;
+}
+
+
+/*
+ * run_batch:
+ * @fc: flickcurl session
+ * @filename: batch file name or "-" for standard input
+ *
+ * INTERNAL - Run commands read one per line from a file over one session
+ *
+ * Each command line is the same as the command line arguments given
+ * to a single invocation.  After every command a line
+ *   # END <line number> <command> <status>
+ * is written to standard output, or standard error when an Arrow
+ * stream is being written there, so that the results of each command
+ * can be separated.
+ *
+ * Return value: non-0 if any command failed
+ */
+static int
+run_batch(flickcurl* fc, const char* filename)
+{
+  FILE* fh;
+  FILE* end_fh;
+  char line[4096];
+  int line_number = 0;
+  int failures = 0;
+  
+  if(!strcmp(filename, "-"))
+    fh = stdin;
+  else {
+    fh = fopen(filename, "r");
+    if(!fh) {
+      fprintf(stderr, "%s: Failed to read batch file %s: %s\n",
+              program, filename, strerror(errno));
+      return 1;
+    }
+  }
+
+  while(fgets(line, sizeof(line), fh)) {
+    char* argv[FLICKCURL_CMDLINE_MAX_ARGS + 1];
+    char* command;
+    int argc;
+    int cmd_index;
+    int rc;
+    size_t len;
+    
+    line_number++;
+
+    len = strlen(line);
+    if(len == sizeof(line) - 1 && line[len - 1] != '\n') {
+      int c;
+
+      fprintf(stderr, "%s: %s:%d: Line too long - ignored\n",
+              program, filename, line_number);
+      while((c = fgetc(fh)) != EOF && c != '\n')
+        ;
+      failures++;
+      continue;
+    }
+
+    argc = flickcurl_cmdline_tokenize_line(line, argv);
+    if(!argc)
+      continue;
+    
+    if(argc < 0) {
+      fprintf(stderr, "%s: %s:%d: Bad command line - ignored\n",
+              program, filename, line_number);
+      failures++;
+      continue;
+    }
+
+    command = argv[0];
+    cmd_index = lookup_command(&command, argc);
+    if(cmd_index < 0)
+      rc = 1;
+    else {
+      rc = commands[cmd_index].handler(fc, argc, argv);
+      if(rc)
+        fprintf(stderr, "%s: %s:%d: Command %s failed\n",
+                program, filename, line_number, command);
+    }
+    if(rc)
+      failures++;
+
+    if(output_fh != stdout)
+      fflush(output_fh);
+    /* keep an Arrow stream on standard output unbroken */
+    end_fh = (output_format == CMD_OUTPUT_FORMAT_ARROW &&
+              output_fh == stdout) ? stderr : stdout;
+    fprintf(end_fh, "# END %d %s %d\n", line_number, command, rc);
+    fflush(end_fh);
+  }
+
+  if(fh != stdin)
+    fclose(fh);
+
+  return (failures > 0);
+}
+
 
 int
 main(int argc, char *argv[]) 
@@ -219,6 +389,7 @@ main(int argc, char *argv[])
   int i;
   int request_delay= -1;
   char *command = NULL;
+  const char *batch_filename = NULL;
 
   output_fh = stdout;
   
@@ -328,11 +499,26 @@ main(int argc, char *argv[])
         }
         goto tidy;
 
+      case 'b':
+        if(optarg)
+          batch_filename = optarg;
+        break;
+
       case 'd':
         if(optarg)
           request_delay = atoi(optarg);
         break;
         
+      case 'f':
+        if(optarg) {
+          if(cmd_output_set_format(optarg)) {
+            fprintf(stderr, "%s: Unknown output format `%s'\n",
+                    program, optarg);
+            usage = 1;
+          }
+        }
+        break;
+
       case 'h':
         help = 1;
         break;
@@ -371,7 +557,7 @@ main(int argc, char *argv[])
   argv += optind;
   argc -= optind;
   
-  if(!help && !argc) {
+  if(!help && !argc && !batch_filename) {
     usage = 2; /* Title and usage */
     goto usage;
   }
@@ -383,48 +569,18 @@ main(int argc, char *argv[])
   if(request_delay >= 0)
     flickcurl_set_request_delay(fc, request_delay);
 
-  command = argv[0];
-  
-  /* allow old format commands to work */
-  for(i = 0; command[i]; i++) {
-    if(command[i] == '-')
-      command[i] = '.';
-  }
-  
-  if(!strncmp(command, "flickr.", 7))
-    command+= 7;
-
-  if(!strcmp(command, "places.forUser"))
-    command = (char*)"places.placesForUser";
-  
-  for(i = 0; commands[i].name; i++)
-    if(!strcmp(command, commands[i].name)) {
-      cmd_index = i;
-      break;
+  if(batch_filename) {
+    if(argc) {
+      fprintf(stderr, "%s: No command allowed with " HELP_ARG(b, batch) "\n",
+              program);
+      usage = 1;
     }
-  if(cmd_index < 0) {
-    fprintf(stderr, "%s: No such command `%s'\n", program, command);
-    usage = 1;
     goto usage;
   }
 
-  if((argc-1) < commands[cmd_index].min) {
-    fprintf(stderr,
-            "%s: Minimum of %d arguments for command `%s'\n  USAGE: %s %s %s\n",
-            program,
-            commands[cmd_index].min, command,
-            program, command, commands[cmd_index].args);
-    usage = 1;
-    goto usage;
-  }
-  
-  if(commands[cmd_index].max > 0 && 
-     (argc-1) > commands[cmd_index].max) {
-    fprintf(stderr,
-            "%s: Maxiumum of %d arguments for command `%s'\n  USAGE: %s %s %s\n",
-            program,
-            commands[cmd_index].max, command,
-            program, command, commands[cmd_index].args);
+  command = argv[0];
+  cmd_index = lookup_command(&command, argc);
+  if(cmd_index < 0) {
     usage = 1;
     goto usage;
   }
@@ -454,17 +610,34 @@ main(int argc, char *argv[])
   }
 
 
+  if(batch_filename) {
+    rc = run_batch(fc, batch_filename);
+    goto tidy;
+  }
+
   /* Perform the API call */
   rc = commands[cmd_index].handler(fc, argc, argv);
   if(rc)
     fprintf(stderr, "%s: Command %s failed\n", program, argv[0]);
   
  tidy:
+  cmd_output_finish();
+
   if(output_fh) {
     fclose(output_fh);
     output_fh = NULL;
   }
   
+  if(fc && verbose > 1) {
+    size_t transfer_bytes;
+    size_t content_bytes;
+
+    flickcurl_get_total_response_bytes(fc, &transfer_bytes, &content_bytes);
+    fprintf(stderr, "%s: Received %lu response bytes (%lu after decoding)\n",
+            program, (unsigned long)transfer_bytes,
+            (unsigned long)content_bytes);
+  }
+
   if(fc)
     flickcurl_free(fc);
 
@@ -29,7 +29,14 @@ typedef struct {
   int             max;
 } flickcurl_cmd;
 
-#define FLICKCURL_CMD_COUNT 184
+#define FLICKCURL_CMD_COUNT 185
+
+typedef enum {
+  CMD_OUTPUT_FORMAT_TEXT,
+  CMD_OUTPUT_FORMAT_JSONL,
+  CMD_OUTPUT_FORMAT_TSV,
+  CMD_OUTPUT_FORMAT_ARROW
+} flickcurl_cmd_output_format;
 
 extern int verbose;
 extern FILE* output_fh;
@@ -43,3 +50,21 @@ extern const char* flickcurl_cmdline_config_section;
 int flickcurl_cmdline_init(void);
 void flickcurl_cmdline_finish(void);
 const char* flickcurl_cmdline_basename(const char *name);
+
+/* maximum number of words (command + arguments) on one batch line */
+#define FLICKCURL_CMDLINE_MAX_ARGS 64
+int flickcurl_cmdline_tokenize_line(char* line, char** argv);
+
+/* output.c */
+extern flickcurl_cmd_output_format output_format;
+
+int cmd_output_set_format(const char* name);
+void cmd_output_finish(void);
+void cmd_record_start(const char* type);
+void cmd_record_string(const char* name, const char* value);
+void cmd_record_integer(const char* name, int value);
+void cmd_record_double(const char* name, double value);
+void cmd_record_number(const char* name, const char* value);
+void cmd_record_tags(const char* name, flickcurl_tag** tags);
+void cmd_record_end(void);
+int cmd_output_photos_list(flickcurl* fc, flickcurl_photos_list* photos_list);
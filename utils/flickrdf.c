@@ -17,7 +17,7 @@
  * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
  * 
  *
- * USAGE: flickrdf [OPTIONS] FLICKR-PHOTO-URI
+ * USAGE: flickrdf [OPTIONS] FLICKR-PHOTO-URI | FLICKR-PHOTOSET-URI...
  *
  *
  */
@@ -51,8 +51,6 @@
 
 #ifdef HAVE_RAPTOR
 #include <raptor2.h>
-#else
-#include <raptor_fake.h>
 #endif
 
 #include <flickcurl_cmd.h>
@@ -106,6 +104,7 @@ static struct option long_options[] =
 
 
 
+#ifdef HAVE_RAPTOR
 static raptor_world* rworld;
 
 
@@ -153,7 +152,7 @@ ser_emit_triple(void* user_data,
   if(object_type == FLICKCURL_TERM_TYPE_RESOURCE)
     s.object = raptor_new_term_from_uri_string(rworld, (const unsigned char*)object);
   else if(object_type == FLICKCURL_TERM_TYPE_BLANK)
-    s.object = raptor_new_term_from_blank(rworld, (const unsigned char*)subject);
+    s.object = raptor_new_term_from_blank(rworld, (const unsigned char*)object);
   else {
     /* literal */
     raptor_uri* raptor_datatype_uri = NULL;
@@ -184,6 +183,255 @@ ser_emit_finish(void* user_data)
 static flickcurl_serializer_factory flickrdf_serializer_factory = {
   1, ser_emit_namespace, ser_emit_triple, ser_emit_finish
 };
+#endif
+
+
+/* Get the name and label of output syntax @counter or NULL at the end */
+static const char*
+flickrdf_get_syntax(unsigned int counter, const char** label_p)
+{
+#ifdef HAVE_RAPTOR
+  const raptor_syntax_description *d;
+
+  d = raptor_world_get_serializer_description(rworld, counter);
+  if(!d)
+    return NULL;
+  if(label_p)
+    *label_p = d->label;
+  return d->names[0];
+#else
+  return flickcurl_get_triples_writer_syntax(counter, label_p);
+#endif
+}
+
+
+static int
+flickrdf_is_syntax(const char* name)
+{
+#ifdef HAVE_RAPTOR
+  return raptor_world_is_serializer_name(rworld, name);
+#else
+  unsigned int i;
+  const char* syntax_name;
+
+  for(i = 0; (syntax_name = flickrdf_get_syntax(i, NULL)); i++) {
+    if(!strcmp(syntax_name, name))
+      return 1;
+  }
+  return 0;
+#endif
+}
+
+
+/* Photos per page when reading photosets */
+#define FLICKRDF_SET_PER_PAGE 500
+
+static const char* flickrdf_uri_prefixes[] = {
+  "http://www.flickr.com/photos/",
+  "https://www.flickr.com/photos/",
+  NULL
+};
+
+
+/*
+ * flickrdf_parse_uri:
+ * @uri: URI string; a trailing '/' is removed
+ * @user_p: pointer to store start of USER
+ * @user_len_p: pointer to store length of USER
+ * @is_set_p: pointer to store flag if the URI is for a photoset
+ *
+ * Parse a photo URI http://www.flickr.com/photos/USER/PHOTO/ or a
+ * photoset URI http://www.flickr.com/photos/USER/sets/PHOTOSET/
+ *
+ * Return value: pointer to the photo or photoset ID in @uri or NULL
+ */
+static char*
+flickrdf_parse_uri(char* uri, const char** user_p, size_t* user_len_p,
+                   int* is_set_p)
+{
+  int i;
+  char* p = NULL;
+  char* user;
+  size_t len;
+
+  for(i = 0; flickrdf_uri_prefixes[i]; i++) {
+    size_t prefix_len = strlen(flickrdf_uri_prefixes[i]);
+
+    if(!strncmp(uri, flickrdf_uri_prefixes[i], prefix_len)) {
+      p = uri + prefix_len;
+      break;
+    }
+  }
+  if(!p)
+    return NULL;
+
+  len = strlen(p);
+  if(!len)
+    return NULL;
+  if(p[len-1] == '/')
+    p[--len] = '\0';
+
+  user = p;
+  while(*p && *p != '/')
+    p++;
+  if(!*p || p == user)
+    return NULL;
+
+  *user_p = user;
+  *user_len_p = p - user;
+  p++;
+
+  *is_set_p = 0;
+  if(!strncmp(p, "sets/", 5)) {
+    *is_set_p = 1;
+    p += 5;
+  }
+
+  if(!*p || strchr(p, '/'))
+    return NULL;
+
+  return p;
+}
+
+
+/* state for reading the photos of all the URIs given */
+typedef struct {
+  flickcurl* fc;
+  char** uris;
+  int uris_count;
+  int uri_index;
+  /* current photo */
+  flickcurl_photo* photo;
+  flickcurl_photo* photo_batch[2];
+  /* current page of current photoset */
+  const char* set_id;
+  const char* set_user;
+  size_t set_user_len;
+  int set_page;
+  flickcurl_photos_list* set_list;
+  int failed;
+} flickrdf_photos_state;
+
+
+/* Give a photoset photo the page URI of the photoset owner */
+static void
+flickrdf_set_photo_uri(flickrdf_photos_state* state, flickcurl_photo* photo)
+{
+  size_t id_len;
+  size_t prefix_len = strlen(flickrdf_uri_prefixes[0]);
+
+  if(photo->uri || !photo->id)
+    return;
+
+  id_len = strlen(photo->id);
+  photo->uri = (char*)malloc(prefix_len + state->set_user_len + 1 + id_len + 1);
+  if(!photo->uri)
+    return;
+
+  memcpy(photo->uri, flickrdf_uri_prefixes[0], prefix_len);
+  memcpy(photo->uri + prefix_len, state->set_user, state->set_user_len);
+  photo->uri[prefix_len + state->set_user_len] = '/';
+  memcpy(photo->uri + prefix_len + state->set_user_len + 1, photo->id,
+         id_len + 1);
+}
+
+
+static flickcurl_photo**
+flickrdf_photos_iterator(void* user_data)
+{
+  flickrdf_photos_state* state = (flickrdf_photos_state*)user_data;
+
+  /* the previous batch is no longer needed */
+  if(state->photo) {
+    flickcurl_free_photo(state->photo);
+    state->photo = NULL;
+  }
+
+  while(1) {
+    const char* id;
+
+    if(state->set_id) {
+      flickcurl_photos_list_params list_params;
+      int i;
+      int more;
+
+      more = !state->set_list ||
+        (state->set_list->photos_count == FLICKRDF_SET_PER_PAGE);
+      if(state->set_list) {
+        flickcurl_free_photos_list(state->set_list);
+        state->set_list = NULL;
+      }
+
+      if(more) {
+        flickcurl_photos_list_params_init(&list_params);
+        /* the url_* extras give the image sizes without a getSizes call */
+        list_params.extras = "date_upload,date_taken,owner_name,license,geo,last_update,original_format,"
+          "url_sq,url_q,url_t,url_s,url_n,url_m,url_z,url_c,url_l,url_o";
+        list_params.per_page = FLICKRDF_SET_PER_PAGE;
+        list_params.page = ++state->set_page;
+
+        state->set_list = flickcurl_photosets_getPhotos_params(state->fc,
+                                                               state->set_id,
+                                                               -1,
+                                                               &list_params);
+        if(!state->set_list)
+          state->failed = 1;
+      }
+
+      if(state->set_list && state->set_list->photos_count > 0) {
+        if(debug)
+          fprintf(stderr, "%s: Photoset %s page %d has %d photos\n",
+                  program, state->set_id, state->set_page,
+                  state->set_list->photos_count);
+
+        for(i = 0; i < state->set_list->photos_count; i++)
+          flickrdf_set_photo_uri(state, state->set_list->photos[i]);
+        return state->set_list->photos;
+      }
+
+      state->set_id = NULL;
+    }
+
+    if(state->uri_index >= state->uris_count)
+      break;
+
+    {
+      const char* user;
+      size_t user_len;
+      int is_set = 0;
+
+      id = flickrdf_parse_uri(state->uris[state->uri_index++], &user,
+                              &user_len, &is_set);
+      if(!id)
+        continue;
+
+      if(is_set) {
+        state->set_id = id;
+        state->set_user = user;
+        state->set_user_len = user_len;
+        state->set_page = 0;
+        continue;
+      }
+    }
+
+    state->photo = flickcurl_photos_getInfo2(state->fc, id, NULL);
+    if(!state->photo) {
+      state->failed = 1;
+      continue;
+    }
+
+    if(debug)
+      fprintf(stderr, "%s: Photo with URI %s ID %s has %d tags\n",
+              program, state->photo->uri, state->photo->id,
+              state->photo->tags_count);
+
+    state->photo_batch[0] = state->photo;
+    state->photo_batch[1] = NULL;
+    return state->photo_batch;
+  }
+
+  return NULL;
+}
 
 
 static const char *title_format_string = "Flickrdf - triples from flickrs %s\n";
@@ -197,22 +445,28 @@ main(int argc, char *argv[])
   int usage = 0;
   int help = 0;
   char* photo_id = NULL;
-  const char* prefix_uri = "http://www.flickr.com/photos/";
-  size_t prefix_uri_len = strlen(prefix_uri);
   const char *serializer_syntax_name = "ntriples";
+#ifdef HAVE_RAPTOR
   raptor_uri* base_uri = NULL;
   raptor_serializer* serializer = NULL;
+#else
+  flickcurl_triples_writer* writer = NULL;
+#endif
   int request_delay= -1;
   flickcurl_serializer* fs = NULL;
   flickcurl_photo* photo = NULL;
+  int is_set = 0;
+  int i;
 
   flickcurl_init();
   flickcurl_cmdline_init();
 
   program = flickcurl_cmdline_basename(argv[0]);
 
+#ifdef HAVE_RAPTOR
   rworld = raptor_new_world();
   raptor_world_open(rworld);
+#endif
 
   while (!usage && !help)
   {
@@ -249,23 +503,18 @@ main(int argc, char *argv[])
 
       case 'o':
         if(optarg) {
-          if(raptor_world_is_serializer_name(rworld, optarg))
+          if(flickrdf_is_syntax(optarg))
             serializer_syntax_name = optarg;
           else {
-            int i;
+            const char* name;
+            const char* label;
             
             fprintf(stderr,
                     "%s: invalid argument `%s' for `" HELP_ARG(o, output) "'\n",
                     program, optarg);
             fprintf(stderr, "Valid arguments are:\n");
-            for(i = 0; 1; i++) {
-              const raptor_syntax_description *d;
-
-              d = raptor_world_get_serializer_description(rworld, i);
-              if(!d)
-                break;
-              printf("  %-12s for %s\n", d->names[0], d->label);
-            }
+            for(i = 0; (name = flickrdf_get_syntax(i, &label)); i++)
+              printf("  %-12s for %s\n", name, label);
             usage = 1;
             break;
             
@@ -298,38 +547,30 @@ main(int argc, char *argv[])
   if(usage || help)
     goto usage;
 
-  photo_id = argv[0];
-  if(strncmp(photo_id, prefix_uri, prefix_uri_len))
-    usage = 1;
-  else {
-    size_t len;
+  /* check all the URIs before starting; parsing only removes any
+   * trailing '/' so they can be parsed again by the iterator */
+  for(i = 0; i < argc; i++) {
+    const char* user;
+    size_t user_len;
 
-    photo_id+= prefix_uri_len;
-    len = strlen(photo_id);
-    if(!len)
+    photo_id = flickrdf_parse_uri(argv[i], &user, &user_len, &is_set);
+    if(!photo_id) {
       usage = 1;
-    else {
-      if(photo_id[len-1] == '/')
-        photo_id[--len] = '\0';
-      
-      while(*photo_id && *photo_id != '/')
-        photo_id++;
-      if(!*photo_id)
-        usage = 1;
-      else
-        photo_id++;
+      break;
     }
   }
 
   if(usage) {
     fprintf(stderr,
-            "%s: Argument is not a Flickr photo URI like\n"
-            "  http://www.flickr.com/photos/USER/PHOTO/\n", 
-            program);
+            "%s: Argument `%s' is not a Flickr photo or photoset URI like\n"
+            "  http://www.flickr.com/photos/USER/PHOTO/\n"
+            "  http://www.flickr.com/photos/USER/sets/PHOTOSET/\n",
+            program, argv[i]);
     goto usage;
   }
 
 
+#ifdef HAVE_RAPTOR
   serializer = raptor_new_serializer(rworld, serializer_syntax_name);
   if(!serializer) {
     fprintf(stderr, 
@@ -341,6 +582,15 @@ main(int argc, char *argv[])
   base_uri = raptor_new_uri(rworld, (const unsigned char*)argv[0]);
 
   raptor_serializer_start_to_file_handle(serializer, base_uri, stdout);
+#else
+  writer = flickcurl_new_triples_writer(stdout, serializer_syntax_name);
+  if(!writer) {
+    fprintf(stderr, 
+            "%s: Failed to create triples writer for syntax %s\n", program,
+            serializer_syntax_name);
+    return(1);
+  }
+#endif
 
 
   /* Initialise the Flickcurl library */
@@ -380,11 +630,9 @@ main(int argc, char *argv[])
   }
 
   if(help) {
-    int i;
-
     printf(title_format_string, flickcurl_version_string);
     puts("Get Triples from Flickr photos.");
-    printf("Usage: %s [OPTIONS] FLICKR-PHOTO-URI\n\n", program);
+    printf("Usage: %s [OPTIONS] FLICKR-PHOTO-URI | FLICKR-PHOTOSET-URI...\n\n", program);
 
     fputs(flickcurl_copyright_string, stdout);
     fputs("\nLicense: ", stdout);
@@ -399,21 +647,22 @@ main(int argc, char *argv[])
     puts(HELP_TEXT("h", "help            ", "Print this help, then exit"));
     puts(HELP_TEXT("o", "output FORMAT   ", "Set output format to one of:"));
     for(i = 0; 1; i++) {
-      const raptor_syntax_description* d;
+      const char* name;
+      const char* label;
 
-      d = raptor_world_get_serializer_description(rworld, i);
-      if(!d)
+      name = flickrdf_get_syntax(i, &label);
+      if(!name)
         break;
 
-      if(!strcmp(d->names[0], serializer_syntax_name))
-        printf("      %-15s %s (default)\n", d->names[0], d->label);
+      if(!strcmp(name, serializer_syntax_name))
+        printf("      %-15s %s (default)\n", name, label);
       else
-        printf("      %-15s %s\n", d->names[0], d->label);
+        printf("      %-15s %s\n", name, label);
     }
 #ifdef HAVE_RAPTOR
     printf("    via Raptor %s serializers\n", raptor_version_string);
 #else
-    puts("    via internal RDF serializer");
+    puts("    via internal triples writer");
 #endif
     puts(HELP_TEXT("v", "version         ", "Print the flickcurl version"));
 
@@ -425,22 +674,47 @@ main(int argc, char *argv[])
   if(request_delay >= 0)
     flickcurl_set_request_delay(fc, request_delay);
   
+#ifdef HAVE_RAPTOR
   fs = flickcurl_new_serializer(fc, serializer, &flickrdf_serializer_factory);
+#else
+  fs = flickcurl_new_serializer(fc, writer,
+                                flickcurl_get_triples_writer_factory());
+#endif
   if(!fs) {
     fprintf(stderr, "%s: Failed to create Flickcurl serializer\n", program);
     goto tidy;
   }
   
-  photo = flickcurl_photos_getInfo2(fc, photo_id, NULL);
+  if(argc == 1 && !is_set) {
+    /* One photo: describe it with just the namespaces it uses */
+    photo = flickcurl_photos_getInfo2(fc, photo_id, NULL);
 
-  if(!photo)
-    goto tidy;
+    if(!photo)
+      goto tidy;
+
+    if(debug)
+      fprintf(stderr, "%s: Photo with URI %s ID %s has %d tags\n",
+              program, photo->uri, photo->id, photo->tags_count);
+
+    rc = flickcurl_serialize_photo(fs, photo);
+  } else {
+    flickrdf_photos_state state;
 
-  if(debug)
-    fprintf(stderr, "%s: Photo with URI %s ID %s has %d tags\n",
-            program, photo->uri, photo->id, photo->tags_count);
+    memset(&state, '\0', sizeof(state));
+    state.fc = fc;
+    state.uris = argv;
+    state.uris_count = argc;
 
-  rc = flickcurl_serialize_photo(fs, photo);
+    rc = flickcurl_serialize_photos_iterator(fs, flickrdf_photos_iterator,
+                                             &state);
+    if(state.failed)
+      rc = 1;
+
+    if(state.photo)
+      flickcurl_free_photo(state.photo);
+    if(state.set_list)
+      flickcurl_free_photos_list(state.set_list);
+  }
 
  tidy:
   if(photo)
@@ -452,6 +726,7 @@ main(int argc, char *argv[])
   if(fc)
     flickcurl_free(fc);
 
+#ifdef HAVE_RAPTOR
   if(serializer)
     raptor_free_serializer(serializer);
   if(base_uri)
@@ -459,6 +734,15 @@ main(int argc, char *argv[])
 
   if(rworld)
     raptor_free_world(rworld);
+#else
+  if(writer) {
+    if(flickcurl_triples_writer_flush(writer)) {
+      fprintf(stderr, "%s: Failed to write triples\n", program);
+      rc = 1;
+    }
+    flickcurl_free_triples_writer(writer);
+  }
+#endif
 
   flickcurl_finish();
 
@@ -0,0 +1,490 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * flickcurl utility record output - JSON lines and tab separated values
+ *
+ * Copyright (C) 2007-2014, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ * Records are written one per line to stdout.  Each record has a
+ * fixed list of fields for its type so the same columns appear in
+ * the same order every time:
+ *
+ * JSONL: {"type":"photo","id":"123",...} with absent fields omitted
+ * TSV: a header line "#photo<TAB>id<TAB>..." is written before the
+ *      first record of a type and after any change of type, then one
+ *      line of values per record with absent fields left empty.
+ *
+ * Arrow: photo lists are written to the output file as one Arrow IPC
+ *      stream with a record batch per list.  Other records are not
+ *      written.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_cmd.h>
+
+
+extern const char* program;
+
+flickcurl_cmd_output_format output_format = CMD_OUTPUT_FORMAT_TEXT;
+
+/* stdout buffer used in record output formats */
+#define CMD_OUTPUT_BUFFER_SIZE 65536
+static char* cmd_output_buffer = NULL;
+
+/* record state */
+static const char* cmd_record_type = NULL;
+static const char* cmd_header_type = NULL;
+
+/* TSV header being collected while the first record of a type is written */
+#define CMD_HEADER_SIZE 8192
+static char cmd_header[CMD_HEADER_SIZE];
+static size_t cmd_header_length = 0;
+static char cmd_row[CMD_OUTPUT_BUFFER_SIZE];
+static size_t cmd_row_length = 0;
+static int cmd_row_overflow = 0;
+
+/* Arrow stream writer started by the first photo list */
+static flickcurl_arrow_writer* cmd_arrow_writer = NULL;
+
+
+static const struct {
+  const char* name;
+  flickcurl_cmd_output_format format;
+} cmd_output_formats[] = {
+  { "text",  CMD_OUTPUT_FORMAT_TEXT },
+  { "jsonl", CMD_OUTPUT_FORMAT_JSONL },
+  { "tsv",   CMD_OUTPUT_FORMAT_TSV },
+  { "arrow", CMD_OUTPUT_FORMAT_ARROW },
+  { NULL,    CMD_OUTPUT_FORMAT_TEXT }
+};
+
+
+/**
+ * cmd_output_set_format:
+ * @name: format name "text", "jsonl", "tsv" or "arrow"
+ *
+ * Set the output format used by the command printing functions
+ *
+ * Return value: non-0 if @name is not a known format
+ */
+int
+cmd_output_set_format(const char* name)
+{
+  int i;
+
+  for(i = 0; cmd_output_formats[i].name; i++) {
+    if(!strcmp(cmd_output_formats[i].name, name)) {
+      output_format = cmd_output_formats[i].format;
+      break;
+    }
+  }
+  if(!cmd_output_formats[i].name)
+    return 1;
+
+  if(output_format != CMD_OUTPUT_FORMAT_TEXT && !cmd_output_buffer) {
+    /* Records are small and many: write them in large blocks */
+    cmd_output_buffer = (char*)malloc(CMD_OUTPUT_BUFFER_SIZE);
+    if(cmd_output_buffer)
+      setvbuf(stdout, cmd_output_buffer, _IOFBF, CMD_OUTPUT_BUFFER_SIZE);
+  }
+
+  return 0;
+}
+
+
+/**
+ * cmd_output_finish:
+ *
+ * End any Arrow stream, flush record output and release the output buffer
+ */
+void
+cmd_output_finish(void)
+{
+  if(cmd_arrow_writer) {
+    flickcurl_arrow_writer_finish(cmd_arrow_writer);
+    flickcurl_free_arrow_writer(cmd_arrow_writer);
+    cmd_arrow_writer = NULL;
+  }
+
+  fflush(stdout);
+  if(cmd_output_buffer) {
+    setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+    free(cmd_output_buffer);
+    cmd_output_buffer = NULL;
+  }
+}
+
+
+static void
+cmd_row_write(const char* s, size_t len)
+{
+  if(cmd_row_length + len > sizeof(cmd_row)) {
+    cmd_row_overflow = 1;
+    return;
+  }
+  memcpy(cmd_row + cmd_row_length, s, len);
+  cmd_row_length += len;
+}
+
+
+static void
+cmd_header_write(const char* s, size_t len)
+{
+  /* the last byte is kept for the terminating newline */
+  if(cmd_header_length + len > sizeof(cmd_header) - 1)
+    return;
+  memcpy(cmd_header + cmd_header_length, s, len);
+  cmd_header_length += len;
+}
+
+
+/* Write a string escaped for a JSON string or a TSV cell as runs of
+ * unescaped bytes between characters needing escapes */
+static void
+cmd_row_write_escaped(const char* s)
+{
+  const char* run = s;
+  const unsigned char* p;
+  int json = (output_format == CMD_OUTPUT_FORMAT_JSONL);
+
+  for(p = (const unsigned char*)s; *p; p++) {
+    const char* esc = NULL;
+    char ubuf[7];
+
+    switch(*p) {
+      case '\t': esc = "\\t"; break;
+      case '\n': esc = "\\n"; break;
+      case '\r': esc = "\\r"; break;
+      case '\\': esc = "\\\\"; break;
+      case '"':
+        if(json)
+          esc = "\\\"";
+        break;
+      default:
+        if(*p < 0x20) {
+          if(json) {
+            sprintf(ubuf, "\\u%04x", *p);
+            esc = ubuf;
+          } else
+            esc = " ";
+        }
+        break;
+    }
+
+    if(esc) {
+      cmd_row_write(run, (const char*)p - run);
+      cmd_row_write(esc, strlen(esc));
+      run = (const char*)p + 1;
+    }
+  }
+  cmd_row_write(run, (const char*)p - run);
+}
+
+
+/**
+ * cmd_record_start:
+ * @type: record type name such as "photo"
+ *
+ * Start writing a record of the given type.  The type name is also
+ * written as the first field of the record.
+ */
+void
+cmd_record_start(const char* type)
+{
+  cmd_record_type = type;
+  cmd_row_length = 0;
+  cmd_row_overflow = 0;
+
+  if(output_format == CMD_OUTPUT_FORMAT_JSONL) {
+    cmd_row_write("{\"type\":\"", 9);
+    cmd_row_write(type, strlen(type));
+    cmd_row_write("\"", 1);
+  } else {
+    cmd_header_length = 0;
+    cmd_header_write("#", 1);
+    cmd_header_write(type, strlen(type));
+    cmd_row_write(type, strlen(type));
+  }
+}
+
+
+static void
+cmd_record_field_name(const char* name)
+{
+  size_t len = strlen(name);
+
+  if(output_format == CMD_OUTPUT_FORMAT_JSONL) {
+    cmd_row_write(",\"", 2);
+    cmd_row_write(name, len);
+    cmd_row_write("\":", 2);
+  } else {
+    cmd_header_write("\t", 1);
+    cmd_header_write(name, len);
+    cmd_row_write("\t", 1);
+  }
+}
+
+
+/**
+ * cmd_record_string:
+ * @name: field name
+ * @value: string value or NULL if absent
+ *
+ * Add a string field to the current record
+ */
+void
+cmd_record_string(const char* name, const char* value)
+{
+  if(!value) {
+    if(output_format == CMD_OUTPUT_FORMAT_TSV)
+      cmd_record_field_name(name);
+    return;
+  }
+
+  cmd_record_field_name(name);
+  if(output_format == CMD_OUTPUT_FORMAT_JSONL) {
+    cmd_row_write("\"", 1);
+    cmd_row_write_escaped(value);
+    cmd_row_write("\"", 1);
+  } else
+    cmd_row_write_escaped(value);
+}
+
+
+/**
+ * cmd_record_integer:
+ * @name: field name
+ * @value: integer value
+ *
+ * Add an integer field to the current record
+ */
+void
+cmd_record_integer(const char* name, int value)
+{
+  char buf[16];
+  char* p = buf + sizeof(buf);
+  unsigned int u = (value < 0) ? (unsigned int)(-(value + 1)) + 1 : (unsigned int)value;
+
+  do {
+    *--p = (char)('0' + (u % 10));
+    u /= 10;
+  } while(u);
+  if(value < 0)
+    *--p = '-';
+
+  cmd_record_field_name(name);
+  cmd_row_write(p, buf + sizeof(buf) - p);
+}
+
+
+/* Check @s is a JSON number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+ * strtod() also takes spaces, hex, inf and nan */
+static int
+cmd_is_json_number(const char* s)
+{
+  const char* p = s;
+
+  if(*p == '-')
+    p++;
+
+  if(*p == '0')
+    p++;
+  else if(*p >= '1' && *p <= '9') {
+    while(*p >= '0' && *p <= '9')
+      p++;
+  } else
+    return 0;
+
+  if(*p == '.') {
+    p++;
+    if(!(*p >= '0' && *p <= '9'))
+      return 0;
+    while(*p >= '0' && *p <= '9')
+      p++;
+  }
+
+  if(*p == 'e' || *p == 'E') {
+    p++;
+    if(*p == '+' || *p == '-')
+      p++;
+    if(!(*p >= '0' && *p <= '9'))
+      return 0;
+    while(*p >= '0' && *p <= '9')
+      p++;
+  }
+
+  return !*p;
+}
+
+
+/**
+ * cmd_record_double:
+ * @name: field name
+ * @value: floating point value
+ *
+ * Add a floating point number field to the current record.  A value
+ * with no JSON number form such as infinity is written as a string.
+ */
+void
+cmd_record_double(const char* name, double value)
+{
+  char buf[32];
+
+  /* %g with a precision bounds the length */
+  sprintf(buf, "%.10g", value);
+
+  if(!cmd_is_json_number(buf)) {
+    cmd_record_string(name, buf);
+    return;
+  }
+
+  cmd_record_field_name(name);
+  cmd_row_write(buf, strlen(buf));
+}
+
+
+/**
+ * cmd_record_number:
+ * @name: field name
+ * @value: decimal number as a string or NULL if absent
+ *
+ * Add a number field to the current record from its string form.
+ * A value that is not a JSON number is written as a string.
+ */
+void
+cmd_record_number(const char* name, const char* value)
+{
+  if(!value || !cmd_is_json_number(value)) {
+    cmd_record_string(name, value);
+    return;
+  }
+
+  cmd_record_field_name(name);
+  cmd_row_write(value, strlen(value));
+}
+
+
+/**
+ * cmd_record_tags:
+ * @name: field name
+ * @tags: NULL-terminated array of tags or NULL
+ *
+ * Add a list of the raw tag strings to the current record.  In JSON
+ * it is an array of strings, in TSV the tags are separated by commas
+ * since raw tags may contain spaces.
+ */
+void
+cmd_record_tags(const char* name, flickcurl_tag** tags)
+{
+  int i;
+
+  if(output_format == CMD_OUTPUT_FORMAT_JSONL) {
+    if(!tags)
+      return;
+    cmd_record_field_name(name);
+    cmd_row_write("[", 1);
+    for(i = 0; tags[i]; i++) {
+      if(i)
+        cmd_row_write(",", 1);
+      cmd_row_write("\"", 1);
+      cmd_row_write_escaped(tags[i]->raw);
+      cmd_row_write("\"", 1);
+    }
+    cmd_row_write("]", 1);
+  } else {
+    cmd_record_field_name(name);
+    if(!tags)
+      return;
+    for(i = 0; tags[i]; i++) {
+      if(i)
+        cmd_row_write(",", 1);
+      cmd_row_write_escaped(tags[i]->raw);
+    }
+  }
+}
+
+
+/**
+ * cmd_record_end:
+ *
+ * Finish the current record and write it as one line
+ */
+void
+cmd_record_end(void)
+{
+  if(output_format == CMD_OUTPUT_FORMAT_ARROW) {
+    cmd_record_type = NULL;
+    return;
+  }
+
+  if(output_format == CMD_OUTPUT_FORMAT_JSONL)
+    cmd_row_write("}", 1);
+  cmd_row_write("\n", 1);
+
+  /* checked after the terminator so a full row is never written cut short */
+  if(cmd_row_overflow) {
+    fprintf(stderr, "%s: %s record too large - skipped\n", program,
+            cmd_record_type);
+    cmd_record_type = NULL;
+    return;
+  }
+
+  if(output_format == CMD_OUTPUT_FORMAT_TSV &&
+     (!cmd_header_type || strcmp(cmd_header_type, cmd_record_type))) {
+    cmd_header[cmd_header_length++] = '\n';
+    fwrite(cmd_header, 1, cmd_header_length, stdout);
+    cmd_header_type = cmd_record_type;
+  }
+
+  fwrite(cmd_row, 1, cmd_row_length, stdout);
+  cmd_record_type = NULL;
+}
+
+
+/**
+ * cmd_output_photos_list:
+ * @fc: flickcurl object
+ * @photos_list: photos list
+ *
+ * Write a photos list as a record batch of the Arrow stream, starting
+ * the stream on the output file if needed
+ *
+ * Return value: non-0 on failure
+ */
+int
+cmd_output_photos_list(flickcurl* fc, flickcurl_photos_list* photos_list)
+{
+  if(!cmd_arrow_writer) {
+    cmd_arrow_writer = flickcurl_new_arrow_writer(fc, output_fh, NULL);
+    if(!cmd_arrow_writer)
+      return 1;
+  }
+
+  return flickcurl_arrow_writer_write_photos_list(cmd_arrow_writer,
+                                                  photos_list);
+}